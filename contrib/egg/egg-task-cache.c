@@ -30,6 +30,8 @@ typedef struct
   gpointer      key;
   gpointer      value;
   gint64        evict_at;
+  gsize         cost;
+  GList         lru_link;
 } CacheItem;
 
 typedef struct
@@ -64,6 +66,11 @@ struct _EggTaskCache
   guint                 evict_source_id;
 
   gint64                time_to_live_usec;
+
+  EggTaskCacheCostFunc  cost_func;
+  GHashTable           *pinned;
+  gsize                 max_cost;
+  gsize                 total_cost;
 };
 
 G_DEFINE_TYPE (EggTaskCache, egg_task_cache, G_TYPE_OBJECT)
@@ -74,6 +81,17 @@ EGG_DEFINE_COUNTER (queued,     "EggTaskCache", "Queued",     "Number of queued
 EGG_DEFINE_COUNTER (cached,     "EggTaskCache", "Cache Size", "Number of cached items")
 EGG_DEFINE_COUNTER (hits,       "EggTaskCache", "Cache Hits", "Number of cache hits")
 EGG_DEFINE_COUNTER (misses,     "EggTaskCache", "Cache Miss", "Number of cache misses")
+EGG_DEFINE_COUNTER (evictions,  "EggTaskCache", "Evictions",  "Number of items evicted by time-to-live or budget")
+EGG_DEFINE_COUNTER (cost,       "EggTaskCache", "Cost",       "Approximate size of cached items in bytes")
+
+/*
+ * Items from every cache are kept in a single LRU queue so that we can
+ * enforce a process-wide budget. Like the caches themselves, this may only
+ * be accessed from the main thread.
+ */
+static GQueue lru_queue = G_QUEUE_INIT;
+static gsize  global_cost;
+static gsize  global_max_cost;
 
 enum {
   PROP_0,
@@ -169,6 +187,11 @@ cache_item_free (gpointer data)
 {
   CacheItem *item = data;
 
+  g_queue_unlink (&lru_queue, &item->lru_link);
+  item->self->total_cost -= item->cost;
+  global_cost -= item->cost;
+  EGG_COUNTER_SUB (cost, (gint64)item->cost);
+
   item->self->key_destroy_func (item->key);
   item->self->value_destroy_func (item->value);
   item->self = NULL;
@@ -216,10 +239,40 @@ cache_item_new (EggTaskCache  *self,
   ret->value = self->value_copy_func ((gpointer)value);
   if (self->time_to_live_usec > 0)
     ret->evict_at = g_get_monotonic_time () + self->time_to_live_usec;
+  if (self->cost_func != NULL)
+    ret->cost = self->cost_func (ret->value);
+
+  ret->lru_link.data = ret;
+  g_queue_push_head_link (&lru_queue, &ret->lru_link);
+
+  self->total_cost += ret->cost;
+  global_cost += ret->cost;
+  EGG_COUNTER_ADD (cost, (gint64)ret->cost);
 
   return ret;
 }
 
+static void
+cache_item_touch (CacheItem *item)
+{
+  g_assert (item != NULL);
+
+  if (lru_queue.head != &item->lru_link)
+    {
+      g_queue_unlink (&lru_queue, &item->lru_link);
+      g_queue_push_head_link (&lru_queue, &item->lru_link);
+    }
+}
+
+static gboolean
+egg_task_cache_is_pinned (EggTaskCache  *self,
+                          gconstpointer  key)
+{
+  g_assert (EGG_IS_TASK_CACHE (self));
+
+  return self->pinned != NULL && g_hash_table_contains (self->pinned, key);
+}
+
 static gboolean
 egg_task_cache_evict_full (EggTaskCache  *self,
                            gconstpointer  key,
@@ -292,6 +345,64 @@ egg_task_cache_evict_all (EggTaskCache *self)
     evict_source_rearm (self->evict_source);
 }
 
+/*
+ * Evicts the least recently used item which is not pinned. If @owner is
+ * set, only items from that cache are considered. @keep is never evicted,
+ * which allows us to insert an item larger than the budget without it
+ * disappearing before the caller had a chance to use it.
+ */
+static gboolean
+egg_task_cache_evict_lru (EggTaskCache *owner,
+                          CacheItem    *keep)
+{
+  GList *iter;
+
+  for (iter = lru_queue.tail; iter != NULL; iter = iter->prev)
+    {
+      CacheItem *item = iter->data;
+
+      if (item == keep)
+        break;
+
+      if (owner != NULL && item->self != owner)
+        continue;
+
+      if (egg_task_cache_is_pinned (item->self, item->key))
+        continue;
+
+      EGG_COUNTER_INC (evictions);
+
+      return egg_task_cache_evict_full (item->self, item->key, TRUE);
+    }
+
+  return FALSE;
+}
+
+static void
+egg_task_cache_enforce_budget (EggTaskCache *self,
+                               CacheItem    *keep)
+{
+  g_assert (!self || EGG_IS_TASK_CACHE (self));
+
+  if (self != NULL && self->max_cost > 0)
+    {
+      while (self->total_cost > self->max_cost)
+        {
+          if (!egg_task_cache_evict_lru (self, keep))
+            break;
+        }
+    }
+
+  if (global_max_cost > 0)
+    {
+      while (global_cost > global_max_cost)
+        {
+          if (!egg_task_cache_evict_lru (NULL, keep))
+            break;
+        }
+    }
+}
+
 /**
  * egg_task_cache_peek:
  * @self: An #EggTaskCache
@@ -318,6 +429,7 @@ egg_task_cache_peek (EggTaskCache  *self,
   if ((item = g_hash_table_lookup (self->cache, key)))
     {
       EGG_COUNTER_INC (hits);
+      cache_item_touch (item);
       return item->value;
     }
 
@@ -377,6 +489,8 @@ egg_task_cache_populate (EggTaskCache  *self,
 
   if (self->evict_source != NULL)
     evict_source_rearm (self->evict_source);
+
+  egg_task_cache_enforce_budget (self, item);
 }
 
 static void
@@ -447,6 +561,32 @@ egg_task_cache_fetch_cb (GObject      *object,
   EGG_COUNTER_DEC (in_flight);
 }
 
+/**
+ * egg_task_cache_insert:
+ * @self: An #EggTaskCache.
+ * @key: the key for @value
+ * @value: (type GObject.Object): the value to cache
+ *
+ * Inserts @value into the cache, replacing any previous value for @key.
+ *
+ * This is useful when the owner of the cache has produced a newer value
+ * by some means other than the populate callback, such as by updating the
+ * previous value incrementally.
+ *
+ * This function may only be called from the main thread.
+ */
+void
+egg_task_cache_insert (EggTaskCache  *self,
+                       gconstpointer  key,
+                       gpointer       value)
+{
+  g_return_if_fail (EGG_IS_TASK_CACHE (self));
+  g_return_if_fail (key != NULL);
+  g_return_if_fail (value != NULL);
+
+  egg_task_cache_populate (self, key, value);
+}
+
 void
 egg_task_cache_get_async (EggTaskCache        *self,
                           gconstpointer        key,
@@ -553,6 +693,16 @@ egg_task_cache_do_eviction (gpointer user_data)
       if (item->evict_at <= now)
         {
           egg_heap_extract (self->evict_heap, NULL);
+
+          /* Pinned items get another lease instead of being evicted */
+          if (egg_task_cache_is_pinned (self, item->key))
+            {
+              item->evict_at = now + self->time_to_live_usec;
+              egg_heap_insert_val (self->evict_heap, item);
+              continue;
+            }
+
+          EGG_COUNTER_INC (evictions);
           egg_task_cache_evict_full (self, item->key, FALSE);
           continue;
         }
@@ -629,6 +779,14 @@ egg_task_cache_constructed (GObject *object)
                                         self->key_destroy_func,
                                         (GDestroyNotify)g_ptr_array_unref);
 
+  /*
+   * This is where we keep the pin count for keys that must not be evicted.
+   */
+  self->pinned = g_hash_table_new_full (self->key_hash_func,
+                                        self->key_equal_func,
+                                        self->key_destroy_func,
+                                        NULL);
+
   /*
    * Register our eviction source if we have a time_to_live.
    */
@@ -694,6 +852,8 @@ egg_task_cache_dispose (GObject *object)
       EGG_COUNTER_SUB (in_flight, count);
     }
 
+  g_clear_pointer (&self->pinned, g_hash_table_unref);
+
   if (self->populate_callback_data)
     {
       if (self->populate_callback_data_destroy)
@@ -947,3 +1107,176 @@ egg_task_cache_set_name (EggTaskCache *self,
       g_source_set_name (self->evict_source, full_name);
     }
 }
+
+/**
+ * egg_task_cache_set_cost_func: (skip)
+ * @self: An #EggTaskCache
+ * @cost_func: (nullable): An #EggTaskCacheCostFunc or %NULL
+ *
+ * Sets the function used to determine the approximate size of an item when
+ * it is inserted into the cache. Items inserted before calling this function
+ * keep their previous cost.
+ */
+void
+egg_task_cache_set_cost_func (EggTaskCache         *self,
+                              EggTaskCacheCostFunc  cost_func)
+{
+  g_return_if_fail (EGG_IS_TASK_CACHE (self));
+
+  self->cost_func = cost_func;
+}
+
+/**
+ * egg_task_cache_set_max_cost:
+ * @self: An #EggTaskCache
+ * @max_cost: the maximum cost for the cache, or 0 for no limit
+ *
+ * Sets the maximum combined cost of items within @self. When the limit is
+ * exceeded, the least recently used items that are not pinned are evicted.
+ */
+void
+egg_task_cache_set_max_cost (EggTaskCache *self,
+                             gsize         max_cost)
+{
+  g_return_if_fail (EGG_IS_TASK_CACHE (self));
+
+  self->max_cost = max_cost;
+
+  egg_task_cache_enforce_budget (self, NULL);
+}
+
+/**
+ * egg_task_cache_get_cost:
+ * @self: An #EggTaskCache
+ *
+ * Gets the combined cost of all items currently in @self.
+ */
+gsize
+egg_task_cache_get_cost (EggTaskCache *self)
+{
+  g_return_val_if_fail (EGG_IS_TASK_CACHE (self), 0);
+
+  return self->total_cost;
+}
+
+/**
+ * egg_task_cache_pin:
+ * @self: An #EggTaskCache
+ * @key: the key to pin
+ *
+ * Pins @key so that the item will not be evicted by the time-to-live or
+ * the cost budget while it is in use. It may still be evicted explicitly
+ * using egg_task_cache_evict().
+ *
+ * Each call must be paired with a call to egg_task_cache_unpin().
+ */
+void
+egg_task_cache_pin (EggTaskCache  *self,
+                    gconstpointer  key)
+{
+  gpointer orig_key;
+  gpointer count;
+
+  g_return_if_fail (EGG_IS_TASK_CACHE (self));
+  g_return_if_fail (key != NULL);
+
+  if (g_hash_table_lookup_extended (self->pinned, key, &orig_key, &count))
+    {
+      g_hash_table_steal (self->pinned, key);
+      g_hash_table_insert (self->pinned,
+                           orig_key,
+                           GUINT_TO_POINTER (GPOINTER_TO_UINT (count) + 1));
+      return;
+    }
+
+  g_hash_table_insert (self->pinned,
+                       self->key_copy_func ((gpointer)key),
+                       GUINT_TO_POINTER (1));
+}
+
+/**
+ * egg_task_cache_unpin:
+ * @self: An #EggTaskCache
+ * @key: the key to unpin
+ *
+ * Releases a pin acquired with egg_task_cache_pin(). Once the last pin is
+ * released, the item may be evicted again.
+ */
+void
+egg_task_cache_unpin (EggTaskCache  *self,
+                      gconstpointer  key)
+{
+  gpointer orig_key;
+  gpointer count;
+
+  g_return_if_fail (EGG_IS_TASK_CACHE (self));
+  g_return_if_fail (key != NULL);
+
+  if (!g_hash_table_lookup_extended (self->pinned, key, &orig_key, &count))
+    {
+      g_warning ("Attempt to unpin a key that is not pinned");
+      return;
+    }
+
+  if (GPOINTER_TO_UINT (count) > 1)
+    {
+      g_hash_table_steal (self->pinned, key);
+      g_hash_table_insert (self->pinned,
+                           orig_key,
+                           GUINT_TO_POINTER (GPOINTER_TO_UINT (count) - 1));
+      return;
+    }
+
+  g_hash_table_remove (self->pinned, key);
+
+  /* The item may have been kept past the budget while pinned */
+  egg_task_cache_enforce_budget (self, NULL);
+}
+
+/**
+ * egg_task_cache_set_global_max_cost:
+ * @max_cost: the maximum cost of all caches, or 0 for no limit
+ *
+ * Sets the maximum combined cost of items across every #EggTaskCache in the
+ * process. When the limit is exceeded, the least recently used items that
+ * are not pinned are evicted, regardless of which cache they belong to.
+ *
+ * This function may only be called from the main thread.
+ */
+void
+egg_task_cache_set_global_max_cost (gsize max_cost)
+{
+  global_max_cost = max_cost;
+
+  egg_task_cache_enforce_budget (NULL, NULL);
+}
+
+/**
+ * egg_task_cache_get_global_cost:
+ *
+ * Gets the combined cost of items across every #EggTaskCache.
+ */
+gsize
+egg_task_cache_get_global_cost (void)
+{
+  return global_cost;
+}
+
+/**
+ * egg_task_cache_trim_all:
+ *
+ * Evicts every item that is not pinned from every #EggTaskCache in the
+ * process. This is meant to be called when the system is low on memory.
+ *
+ * This function may only be called from the main thread.
+ */
+void
+egg_task_cache_trim_all (void)
+{
+  guint count = 0;
+
+  while (egg_task_cache_evict_lru (NULL, NULL))
+    count++;
+
+  g_debug ("Trimmed %u items from task caches", count);
+}
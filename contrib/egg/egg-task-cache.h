@@ -49,33 +49,60 @@ typedef void (*EggTaskCacheCallback) (EggTaskCache  *self,
                                       GTask         *task,
                                       gpointer       user_data);
 
-EggTaskCache *egg_task_cache_new        (GHashFunc              key_hash_func,
-                                         GEqualFunc             key_equal_func,
-                                         GBoxedCopyFunc         key_copy_func,
-                                         GBoxedFreeFunc         key_destroy_func,
-                                         GBoxedCopyFunc         value_copy_func,
-                                         GBoxedFreeFunc         value_free_func,
-                                         gint64                 time_to_live_msec,
-                                         EggTaskCacheCallback   populate_callback,
-                                         gpointer               populate_callback_data,
-                                         GDestroyNotify         populate_callback_data_destroy);
-void          egg_task_cache_set_name   (EggTaskCache          *self,
-                                         const gchar           *name);
-void          egg_task_cache_get_async  (EggTaskCache          *self,
-                                         gconstpointer          key,
-                                         gboolean               force_update,
-                                         GCancellable          *cancellable,
-                                         GAsyncReadyCallback    callback,
-                                         gpointer               user_data);
-gpointer      egg_task_cache_get_finish (EggTaskCache          *self,
-                                         GAsyncResult          *result,
-                                         GError               **error);
-gboolean      egg_task_cache_evict      (EggTaskCache          *self,
-                                         gconstpointer          key);
-void          egg_task_cache_evict_all  (EggTaskCache          *self);
-gpointer      egg_task_cache_peek       (EggTaskCache          *self,
-                                         gconstpointer          key);
-GPtrArray    *egg_task_cache_get_values (EggTaskCache          *self);
+/**
+ * EggTaskCacheCostFunc:
+ * @value: a value stored in the cache
+ *
+ * #EggTaskCacheCostFunc is the prototype for a function that estimates
+ * the number of bytes used by @value. It is called once when @value is
+ * inserted into the cache.
+ *
+ * Returns: the approximate cost of @value in bytes.
+ */
+typedef gsize (*EggTaskCacheCostFunc) (gconstpointer value);
+
+EggTaskCache *egg_task_cache_new                 (GHashFunc              key_hash_func,
+                                                  GEqualFunc             key_equal_func,
+                                                  GBoxedCopyFunc         key_copy_func,
+                                                  GBoxedFreeFunc         key_destroy_func,
+                                                  GBoxedCopyFunc         value_copy_func,
+                                                  GBoxedFreeFunc         value_free_func,
+                                                  gint64                 time_to_live_msec,
+                                                  EggTaskCacheCallback   populate_callback,
+                                                  gpointer               populate_callback_data,
+                                                  GDestroyNotify         populate_callback_data_destroy);
+void          egg_task_cache_set_name            (EggTaskCache          *self,
+                                                  const gchar           *name);
+void          egg_task_cache_get_async           (EggTaskCache          *self,
+                                                  gconstpointer          key,
+                                                  gboolean               force_update,
+                                                  GCancellable          *cancellable,
+                                                  GAsyncReadyCallback    callback,
+                                                  gpointer               user_data);
+gpointer      egg_task_cache_get_finish          (EggTaskCache          *self,
+                                                  GAsyncResult          *result,
+                                                  GError               **error);
+gboolean      egg_task_cache_evict               (EggTaskCache          *self,
+                                                  gconstpointer          key);
+void          egg_task_cache_evict_all           (EggTaskCache          *self);
+gpointer      egg_task_cache_peek                (EggTaskCache          *self,
+                                                  gconstpointer          key);
+void          egg_task_cache_insert              (EggTaskCache          *self,
+                                                  gconstpointer          key,
+                                                  gpointer               value);
+GPtrArray    *egg_task_cache_get_values          (EggTaskCache          *self);
+void          egg_task_cache_set_cost_func       (EggTaskCache          *self,
+                                                  EggTaskCacheCostFunc   cost_func);
+void          egg_task_cache_set_max_cost        (EggTaskCache          *self,
+                                                  gsize                  max_cost);
+gsize         egg_task_cache_get_cost            (EggTaskCache          *self);
+void          egg_task_cache_pin                 (EggTaskCache          *self,
+                                                  gconstpointer          key);
+void          egg_task_cache_unpin               (EggTaskCache          *self,
+                                                  gconstpointer          key);
+void          egg_task_cache_set_global_max_cost (gsize                  max_cost);
+gsize         egg_task_cache_get_global_cost     (void);
+void          egg_task_cache_trim_all            (void);
 
 G_END_DECLS
 
@@ -18,16 +18,29 @@
 
 #define G_LOG_DOMAIN "jsonrpc-input-stream"
 
-#include <errno.h>
 #include <string.h>
 
 #include "jsonrpc-input-stream.h"
 
+/*
+ * Headers are small, so if we have read this much without finding the
+ * end of them the peer is misbehaving.
+ */
+#define MAX_HEADER_BYTES     (64 * 1024)
+
+/*
+ * Initial size of the read buffer. Messages larger than this cause the
+ * buffer to grow, and it is shrunk back once a message has been consumed
+ * if it grew beyond MAX_RETAINED_BYTES.
+ */
+#define INITIAL_BUFFER_SIZE  (64 * 1024)
+#define MAX_RETAINED_BYTES   (1024 * 1024)
+
 typedef struct
 {
   gssize content_length;
-  gchar *buffer;
-  gint priority;
+  gsize  header_len;
+  gint   priority;
 } ReadState;
 
 typedef struct
@@ -37,6 +50,9 @@ typedef struct
 
 G_DEFINE_TYPE_WITH_PRIVATE (JsonrpcInputStream, jsonrpc_input_stream, G_TYPE_DATA_INPUT_STREAM)
 
+static void jsonrpc_input_stream_process (JsonrpcInputStream *self,
+                                          GTask              *task);
+
 static gboolean jsonrpc_input_stream_debug;
 
 static void
@@ -44,7 +60,6 @@ read_state_free (gpointer data)
 {
   ReadState *state = data;
 
-  g_free (state->buffer);
   g_slice_free (ReadState, state);
 }
 
@@ -71,161 +86,266 @@ jsonrpc_input_stream_new (GInputStream *base_stream)
 {
   return g_object_new (JSONRPC_TYPE_INPUT_STREAM,
                        "base-stream", base_stream,
+                       "buffer-size", INITIAL_BUFFER_SIZE,
                        NULL);
 }
 
+/*
+ * Parses the headers found at the beginning of @data. Returns TRUE if the
+ * blank line terminating the headers was found, in which case
+ * state->header_len and state->content_length are set. Returns FALSE if
+ * more data is required, or if @error is set.
+ */
+static gboolean
+jsonrpc_input_stream_parse_headers (JsonrpcInputStream  *self,
+                                    ReadState           *state,
+                                    const gchar         *data,
+                                    gsize                len,
+                                    GError             **error)
+{
+  JsonrpcInputStreamPrivate *priv = jsonrpc_input_stream_get_instance_private (self);
+  const gchar *line = data;
+  const gchar *end = data + len;
+  const gchar *eol;
+
+  g_assert (JSONRPC_IS_INPUT_STREAM (self));
+  g_assert (state != NULL);
+
+  while (line < end && NULL != (eol = memchr (line, '\n', end - line)))
+    {
+      gsize line_len = eol - line;
+
+      if (line_len > 0 && line[line_len - 1] == '\r')
+        line_len--;
+
+      if (line_len == 0)
+        {
+          if (state->content_length <= 0)
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "Invalid or missing Content-Length header from peer");
+              return FALSE;
+            }
+
+          state->header_len = eol + 1 - data;
+          return TRUE;
+        }
+
+      if (line_len > 15 && g_ascii_strncasecmp ("Content-Length:", line, 15) == 0)
+        {
+          const gchar *iter = line + 15;
+          const gchar *line_end = line + line_len;
+          gint64 content_length = 0;
+
+          while (iter < line_end && *iter == ' ')
+            iter++;
+
+          if (iter == line_end)
+            goto invalid_length;
+
+          for (; iter < line_end; iter++)
+            {
+              if (!g_ascii_isdigit (*iter))
+                goto invalid_length;
+
+              content_length = (content_length * 10) + (*iter - '0');
+
+              if (content_length > priv->max_size_bytes)
+                goto invalid_length;
+            }
+
+          state->content_length = content_length;
+        }
+
+      line = eol + 1;
+    }
+
+  return FALSE;
+
+invalid_length:
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_INVALID_DATA,
+               "Invalid Content-Length received from peer");
+  return FALSE;
+}
+
 static void
-jsonrpc_input_stream_read_body_cb (GObject      *object,
-                                   GAsyncResult *result,
-                                   gpointer      user_data)
+jsonrpc_input_stream_fill_cb (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
 {
   JsonrpcInputStream *self = (JsonrpcInputStream *)object;
   g_autoptr(GTask) task = user_data;
-  g_autoptr(JsonParser) parser = NULL;
   g_autoptr(GError) error = NULL;
-  ReadState *state;
-  JsonNode *root;
-  gsize n_read;
+  gssize n_read;
 
   g_assert (JSONRPC_IS_INPUT_STREAM (self));
   g_assert (G_IS_TASK (task));
 
-  state = g_task_get_task_data (task);
+  n_read = g_buffered_input_stream_fill_finish (G_BUFFERED_INPUT_STREAM (self), result, &error);
 
-  if (!g_input_stream_read_all_finish (G_INPUT_STREAM (self), result, &n_read, &error))
+  if (n_read < 0)
     {
       g_task_return_error (task, g_steal_pointer (&error));
       return;
     }
 
-  if ((gssize)n_read != state->content_length)
+  if (n_read == 0)
     {
       g_task_return_new_error (task,
                                G_IO_ERROR,
-                               G_IO_ERROR_INVALID_DATA,
-                               "Failed to read %"G_GSSIZE_FORMAT" bytes",
-                               state->content_length);
+                               G_IO_ERROR_CLOSED,
+                               "The peer has closed the stream");
       return;
     }
 
-  state->buffer [state->content_length] = '\0';
+  jsonrpc_input_stream_process (self, task);
+}
 
-  if G_UNLIKELY (jsonrpc_input_stream_debug)
-    g_message ("<<< %s", state->buffer);
+/*
+ * Makes room for at least @required bytes in the read buffer and reads as
+ * much as will fit from the base stream. That may complete only part of
+ * the message (or more than one message), so the task is resumed from
+ * jsonrpc_input_stream_fill_cb() which tries again.
+ */
+static void
+jsonrpc_input_stream_fill (JsonrpcInputStream *self,
+                           GTask              *task,
+                           gsize               required)
+{
+  GBufferedInputStream *buffered = (GBufferedInputStream *)self;
+  ReadState *state = g_task_get_task_data (task);
+  gsize available;
+  gsize size;
 
-  parser = json_parser_new_immutable ();
+  g_assert (JSONRPC_IS_INPUT_STREAM (self));
+  g_assert (G_IS_TASK (task));
 
-  if (!json_parser_load_from_data (parser, state->buffer, state->content_length, &error))
-    {
-      g_task_return_error (task, g_steal_pointer (&error));
-      return;
-    }
+  available = g_buffered_input_stream_get_available (buffered);
+  size = g_buffered_input_stream_get_buffer_size (buffered);
 
-  if (NULL == (root = json_parser_get_root (parser)))
+  g_assert (required > available);
+
+  if (size < required)
     {
-      /*
-       * If we get back a NULL root node, that means that we got
-       * a short read (such as a closed stream).
-       */
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_CLOSED,
-                               "The peer did not send a reply");
-      return;
+      /* Grow geometrically so that unsized header reads amortize */
+      while (size < required)
+        size *= 2;
+      g_buffered_input_stream_set_buffer_size (buffered, size);
     }
 
-  g_task_return_pointer (task, json_node_copy (root), (GDestroyNotify)json_node_unref);
+  g_buffered_input_stream_fill_async (buffered,
+                                      -1,
+                                      state->priority,
+                                      g_task_get_cancellable (task),
+                                      jsonrpc_input_stream_fill_cb,
+                                      g_object_ref (task));
 }
 
+/*
+ * Tries to complete @task using the data currently in the read buffer. The
+ * headers and body are parsed in place from the buffer, so the only copy
+ * of the message is the one made by the JSON parser.
+ */
 static void
-jsonrpc_input_stream_read_headers_cb (GObject      *object,
-                                      GAsyncResult *result,
-                                      gpointer      user_data)
+jsonrpc_input_stream_process (JsonrpcInputStream *self,
+                              GTask              *task)
 {
-  JsonrpcInputStream *self = (JsonrpcInputStream *)object;
-  JsonrpcInputStreamPrivate *priv = jsonrpc_input_stream_get_instance_private (self);
-  g_autoptr(GTask) task = user_data;
+  GBufferedInputStream *buffered = (GBufferedInputStream *)self;
+  g_autoptr(JsonParser) parser = NULL;
   g_autoptr(GError) error = NULL;
-  g_autofree gchar *line = NULL;
-  GCancellable *cancellable = NULL;
+  const gchar *data;
+  const gchar *body;
   ReadState *state;
-  gsize length = 0;
+  JsonNode *root;
+  gsize available = 0;
+  gsize total;
 
   g_assert (JSONRPC_IS_INPUT_STREAM (self));
   g_assert (G_IS_TASK (task));
 
-  line = g_data_input_stream_read_line_finish_utf8 (G_DATA_INPUT_STREAM (self), result, &length, &error);
+  state = g_task_get_task_data (task);
+  data = g_buffered_input_stream_peek_buffer (buffered, &available);
 
-  if (line == NULL)
+  if (state->header_len == 0)
     {
-      if (error != NULL)
-        g_task_return_error (task, g_steal_pointer (&error));
-      else
-        g_task_return_new_error (task,
-                                 G_IO_ERROR,
-                                 G_IO_ERROR_CLOSED,
-                                 "The peer has closed the stream");
-      return;
+      if (!jsonrpc_input_stream_parse_headers (self, state, data, available, &error))
+        {
+          if (error != NULL)
+            {
+              g_task_return_error (task, g_steal_pointer (&error));
+              return;
+            }
+
+          if (available >= MAX_HEADER_BYTES)
+            {
+              g_task_return_new_error (task,
+                                       G_IO_ERROR,
+                                       G_IO_ERROR_INVALID_DATA,
+                                       "Headers from peer exceed %u bytes",
+                                       MAX_HEADER_BYTES);
+              return;
+            }
+
+          /* Header length is unknown, so just ask for more than we have */
+          jsonrpc_input_stream_fill (self, task, available + 1);
+          return;
+        }
     }
 
-  state = g_task_get_task_data (task);
-  cancellable = g_task_get_cancellable (task);
+  g_assert (state->header_len > 0);
+  g_assert (state->content_length > 0);
 
-  if (strncasecmp ("Content-Length: ", line, 16) == 0)
+  total = state->header_len + state->content_length;
+
+  if (available < total)
     {
-      const gchar *lenptr = line + 16;
-      gint64 content_length;
+      jsonrpc_input_stream_fill (self, task, total);
+      return;
+    }
 
-      content_length = g_ascii_strtoll (lenptr, NULL, 10);
+  body = data + state->header_len;
 
-      if (((content_length == G_MININT64 || content_length == G_MAXINT64) && errno == ERANGE) ||
-          (content_length < 0) ||
-          (content_length > G_MAXSSIZE) ||
-          (content_length > priv->max_size_bytes))
-        {
-          g_task_return_new_error (task,
-                                   G_IO_ERROR,
-                                   G_IO_ERROR_INVALID_DATA,
-                                   "Invalid Content-Length received from peer");
-          return;
-        }
+  if G_UNLIKELY (jsonrpc_input_stream_debug)
+    g_message ("<<< %.*s", (gint)state->content_length, body);
+
+  parser = json_parser_new_immutable ();
 
-      state->content_length = content_length;
+  if (!json_parser_load_from_data (parser, body, state->content_length, &error))
+    {
+      g_input_stream_skip (G_INPUT_STREAM (self), total, NULL, NULL);
+      g_task_return_error (task, g_steal_pointer (&error));
+      return;
     }
 
   /*
-   * If we are at the end of the headers, we can make progress towards
-   * parsing the JSON content. Otherwise we need to continue parsing
-   * the next header.
+   * The message is fully contained in the buffer, so this only advances
+   * the read position and never blocks.
    */
+  g_input_stream_skip (G_INPUT_STREAM (self), total, NULL, NULL);
 
-  if (line[0] == '\0')
-    {
-      if (state->content_length <= 0)
-        {
-          g_task_return_new_error (task,
-                                   G_IO_ERROR,
-                                   G_IO_ERROR_INVALID_DATA,
-                                   "Invalid or missing Content-Length header from peer");
-          return;
-        }
+  /* Release memory from an unusually large message */
+  if (g_buffered_input_stream_get_buffer_size (buffered) > MAX_RETAINED_BYTES &&
+      g_buffered_input_stream_get_available (buffered) < INITIAL_BUFFER_SIZE)
+    g_buffered_input_stream_set_buffer_size (buffered, INITIAL_BUFFER_SIZE);
 
-      state->buffer = g_malloc (state->content_length + 1);
-      g_input_stream_read_all_async (G_INPUT_STREAM (self),
-                                     state->buffer,
-                                     state->content_length,
-                                     state->priority,
-                                     cancellable,
-                                     jsonrpc_input_stream_read_body_cb,
-                                     g_steal_pointer (&task));
+  if (NULL == (root = json_parser_get_root (parser)))
+    {
+      /*
+       * If we get back a NULL root node, that means that we got
+       * a short read (such as a closed stream).
+       */
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_CLOSED,
+                               "The peer did not send a reply");
       return;
     }
 
-  g_data_input_stream_read_line_async (G_DATA_INPUT_STREAM (self),
-                                       state->priority,
-                                       cancellable,
-                                       jsonrpc_input_stream_read_headers_cb,
-                                       g_steal_pointer (&task));
+  g_task_return_pointer (task, json_node_copy (root), (GDestroyNotify)json_node_unref);
 }
 
 void
@@ -248,11 +368,7 @@ jsonrpc_input_stream_read_message_async (JsonrpcInputStream  *self,
   g_task_set_source_tag (task, jsonrpc_input_stream_read_message_async);
   g_task_set_task_data (task, state, read_state_free);
 
-  g_data_input_stream_read_line_async (G_DATA_INPUT_STREAM (self),
-                                       state->priority,
-                                       cancellable,
-                                       jsonrpc_input_stream_read_headers_cb,
-                                       g_steal_pointer (&task));
+  jsonrpc_input_stream_process (self, task);
 }
 
 gboolean
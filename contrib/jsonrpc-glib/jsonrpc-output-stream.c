@@ -23,9 +23,28 @@
 #include "jsonrpc-output-stream.h"
 #include "jsonrpc-version.h"
 
+/*
+ * Room reserved at the head of the framing buffer for the
+ * "Content-Length: N\r\n\r\n" header. This is large enough for any
+ * length that fits in a 64-bit integer, so we never need to move the
+ * serialized body once it has been written into the buffer.
+ */
+#define HEADER_RESERVED    48
+
+/*
+ * If a single message grows the framing buffer beyond this, we release it
+ * after the write completes rather than pinning that memory for the
+ * lifetime of the connection.
+ */
+#define MAX_RETAINED_BYTES (1024 * 1024)
+
 typedef struct
 {
-  GQueue queue;
+  GQueue         queue;
+  GString       *buffer;
+  JsonGenerator *generator;
+  gsize          framed_len;
+  guint          in_flight : 1;
 } JsonrpcOutputStreamPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (JsonrpcOutputStream, jsonrpc_output_stream, G_TYPE_DATA_OUTPUT_STREAM)
@@ -45,6 +64,14 @@ jsonrpc_output_stream_finalize (GObject *object)
   g_queue_foreach (&priv->queue, (GFunc)g_object_unref, NULL);
   g_queue_clear (&priv->queue);
 
+  if (priv->buffer != NULL)
+    {
+      g_string_free (priv->buffer, TRUE);
+      priv->buffer = NULL;
+    }
+
+  g_clear_object (&priv->generator);
+
   G_OBJECT_CLASS (jsonrpc_output_stream_parent_class)->finalize (object);
 }
 
@@ -66,46 +93,67 @@ jsonrpc_output_stream_init (JsonrpcOutputStream *self)
   g_queue_init (&priv->queue);
 }
 
-static GBytes *
-jsonrpc_output_stream_create_bytes (JsonrpcOutputStream  *self,
-                                    JsonNode             *node,
-                                    GError              **error)
+/*
+ * Serializes @node into @buffer after room reserved for the Content-Length
+ * header, and then writes the header right-aligned into that room so that
+ * the body never needs to be moved. Returns the offset of the first byte of
+ * the framed message within @buffer, which ends at the end of @buffer.
+ */
+static gsize
+jsonrpc_output_stream_frame (JsonrpcOutputStream *self,
+                             JsonNode            *node,
+                             GString             *buffer)
 {
-  g_autofree gchar *str = NULL;
-  GString *message;
-  gsize len;
+  JsonrpcOutputStreamPrivate *priv = jsonrpc_output_stream_get_instance_private (self);
+  gchar header[HEADER_RESERVED];
+  gsize body_len;
+  gint header_len;
 
   g_assert (JSONRPC_IS_OUTPUT_STREAM (self));
   g_assert (node != NULL);
+  g_assert (buffer != NULL);
 
-  if (!JSON_NODE_HOLDS_OBJECT (node) && !JSON_NODE_HOLDS_ARRAY (node))
-    {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_INVAL,
-                   "node must be an array or object");
-      return FALSE;
-    }
+  if (priv->generator == NULL)
+    priv->generator = json_generator_new ();
+
+  g_string_set_size (buffer, HEADER_RESERVED);
+
+  json_generator_set_root (priv->generator, node);
+
+#if JSON_CHECK_VERSION (1, 4, 0)
+  json_generator_to_gstring (priv->generator, buffer);
+#else
+  {
+    g_autofree gchar *str = NULL;
+    gsize str_len = 0;
+
+    /*
+     * Older json-glib cannot serialize into an existing GString, so we
+     * still have one temporary allocation here. We do however avoid the
+     * second copy and allocation of the framed message.
+     */
+    str = json_generator_to_data (priv->generator, &str_len);
+    g_string_append_len (buffer, str, str_len);
+  }
+#endif
 
-  str = json_to_string (node, FALSE);
-  len = strlen (str);
+  json_generator_set_root (priv->generator, NULL);
+
+  body_len = buffer->len - HEADER_RESERVED;
 
   if G_UNLIKELY (jsonrpc_output_stream_debug)
-    g_message (">>> %s", str);
+    g_message (">>> %.*s", (gint)body_len, buffer->str + HEADER_RESERVED);
 
-  /*
-   * Try to allocate our buffer in a single shot. Sadly we can't serialize
-   * JsonNode directly into a GString or we could remove the double
-   * allocation going on here.
-   */
-  message = g_string_sized_new (len + 32);
+  header_len = g_snprintf (header, sizeof header,
+                           "Content-Length: %"G_GSIZE_FORMAT"\r\n\r\n",
+                           body_len);
 
-  g_string_append_printf (message, "Content-Length: %"G_GSIZE_FORMAT"\r\n\r\n", len);
-  g_string_append_len (message, str, len);
+  g_assert (header_len > 0);
+  g_assert (header_len < HEADER_RESERVED);
 
-  len = message->len;
+  memcpy (buffer->str + HEADER_RESERVED - header_len, header, header_len);
 
-  return g_bytes_new_take (g_string_free (message, FALSE), len);
+  return HEADER_RESERVED - header_len;
 }
 
 JsonrpcOutputStream *
@@ -144,33 +192,51 @@ jsonrpc_output_stream_fail_pending (JsonrpcOutputStream *self)
   g_list_free (list);
 }
 
+static void
+jsonrpc_output_stream_write (JsonrpcOutputStream *self,
+                             GTask               *task,
+                             const gchar         *data,
+                             gsize                len)
+{
+  JsonrpcOutputStreamPrivate *priv = jsonrpc_output_stream_get_instance_private (self);
+
+  g_assert (JSONRPC_IS_OUTPUT_STREAM (self));
+  g_assert (G_IS_TASK (task));
+  g_assert (!priv->in_flight);
+
+  priv->framed_len = len;
+  priv->in_flight = TRUE;
+
+  g_output_stream_write_all_async (G_OUTPUT_STREAM (self),
+                                   data,
+                                   len,
+                                   G_PRIORITY_DEFAULT,
+                                   g_task_get_cancellable (task),
+                                   jsonrpc_output_stream_write_message_async_cb,
+                                   task);
+}
+
 static void
 jsonrpc_output_stream_pump (JsonrpcOutputStream *self)
 {
   JsonrpcOutputStreamPrivate *priv = jsonrpc_output_stream_get_instance_private (self);
-  g_autoptr(GTask) task = NULL;
-  const guint8 *data;
-  GCancellable *cancellable;
+  GTask *task;
   GBytes *bytes;
-  gsize len;
 
   g_assert (JSONRPC_IS_OUTPUT_STREAM (self));
 
-  if (priv->queue.length == 0)
+  /* We'll be called again once the current write completes */
+  if (priv->in_flight || priv->queue.length == 0)
     return;
 
+  /* The task data keeps the bytes alive until the write completes */
   task = g_queue_pop_head (&priv->queue);
   bytes = g_task_get_task_data (task);
-  data = g_bytes_get_data (bytes, &len);
-  cancellable = g_task_get_cancellable (task);
 
-  g_output_stream_write_all_async (G_OUTPUT_STREAM (self),
-                                   data,
-                                   len,
-                                   G_PRIORITY_DEFAULT,
-                                   cancellable,
-                                   jsonrpc_output_stream_write_message_async_cb,
-                                   g_steal_pointer (&task));
+  jsonrpc_output_stream_write (self,
+                               task,
+                               g_bytes_get_data (bytes, NULL),
+                               g_bytes_get_size (bytes));
 }
 
 static void
@@ -179,10 +245,10 @@ jsonrpc_output_stream_write_message_async_cb (GObject      *object,
                                               gpointer      user_data)
 {
   GOutputStream *stream = (GOutputStream *)object;
+  JsonrpcOutputStreamPrivate *priv;
   JsonrpcOutputStream *self;
   g_autoptr(GError) error = NULL;
   g_autoptr(GTask) task = user_data;
-  GBytes *bytes;
   gsize n_written;
 
   g_assert (G_IS_OUTPUT_STREAM (stream));
@@ -191,15 +257,27 @@ jsonrpc_output_stream_write_message_async_cb (GObject      *object,
   self = g_task_get_source_object (task);
   g_assert (JSONRPC_IS_OUTPUT_STREAM (self));
 
+  priv = jsonrpc_output_stream_get_instance_private (self);
+
+  g_assert (priv->in_flight);
+
+  priv->in_flight = FALSE;
+
+  if (priv->buffer != NULL && priv->buffer->allocated_len > MAX_RETAINED_BYTES)
+    {
+      g_string_free (priv->buffer, TRUE);
+      priv->buffer = NULL;
+    }
+
   if (!g_output_stream_write_all_finish (stream, result, &n_written, &error))
     {
       g_task_return_error (task, g_steal_pointer (&error));
+      /* Cancellation only applies to this message, let the rest proceed */
+      jsonrpc_output_stream_pump (self);
       return;
     }
 
-  bytes = g_task_get_task_data (task);
-
-  if (g_bytes_get_size (bytes) != n_written)
+  if (priv->framed_len != n_written)
     {
       g_task_return_new_error (task,
                                G_IO_ERROR,
@@ -222,9 +300,7 @@ jsonrpc_output_stream_write_message_async (JsonrpcOutputStream *self,
                                            gpointer             user_data)
 {
   JsonrpcOutputStreamPrivate *priv = jsonrpc_output_stream_get_instance_private (self);
-  g_autoptr(GBytes) bytes = NULL;
   g_autoptr(GTask) task = NULL;
-  g_autoptr(GError) error = NULL;
 
   g_return_if_fail (JSONRPC_IS_OUTPUT_STREAM (self));
   g_return_if_fail (node != NULL);
@@ -233,15 +309,51 @@ jsonrpc_output_stream_write_message_async (JsonrpcOutputStream *self,
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_source_tag (task, jsonrpc_output_stream_write_message_async);
 
-  if (NULL == (bytes = jsonrpc_output_stream_create_bytes (self, node, &error)))
+  if (!JSON_NODE_HOLDS_OBJECT (node) && !JSON_NODE_HOLDS_ARRAY (node))
     {
-      g_task_return_error (task, g_steal_pointer (&error));
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_INVAL,
+                               "node must be an array or object");
       return;
     }
 
-  g_task_set_task_data (task, g_steal_pointer (&bytes), (GDestroyNotify)g_bytes_unref);
-  g_queue_push_tail (&priv->queue, g_steal_pointer (&task));
-  jsonrpc_output_stream_pump (self);
+  /*
+   * The node is serialized right away since the caller may modify it as
+   * soon as we return. When no write is in flight, the message is framed
+   * in the reusable buffer and written from there. Otherwise it gets a
+   * buffer of its own and waits in the queue.
+   */
+  if (!priv->in_flight && priv->queue.length == 0)
+    {
+      gsize offset;
+
+      if (priv->buffer == NULL)
+        priv->buffer = g_string_sized_new (4096);
+
+      offset = jsonrpc_output_stream_frame (self, node, priv->buffer);
+      jsonrpc_output_stream_write (self,
+                                   g_steal_pointer (&task),
+                                   priv->buffer->str + offset,
+                                   priv->buffer->len - offset);
+    }
+  else
+    {
+      g_autoptr(GBytes) bytes = NULL;
+      GString *buffer;
+      gsize offset;
+      gsize len;
+
+      buffer = g_string_new (NULL);
+      offset = jsonrpc_output_stream_frame (self, node, buffer);
+      len = buffer->len;
+      bytes = g_string_free_to_bytes (buffer);
+
+      g_task_set_task_data (task,
+                            g_bytes_new_from_bytes (bytes, offset, len - offset),
+                            (GDestroyNotify)g_bytes_unref);
+      g_queue_push_tail (&priv->queue, g_steal_pointer (&task));
+    }
 }
 
 gboolean
@@ -0,0 +1,35 @@
+/* fuzzy-private.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FUZZY_PRIVATE_H
+#define FUZZY_PRIVATE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef void (*FuzzyWorkFunc) (gpointer data);
+typedef void (*FuzzyPushFunc) (FuzzyWorkFunc func,
+                               gpointer      data);
+
+void _fuzzy_set_n_workers (guint         n_workers);
+void _fuzzy_set_push_func (FuzzyPushFunc push_func);
+
+G_END_DECLS
+
+#endif /* FUZZY_PRIVATE_H */
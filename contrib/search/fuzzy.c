@@ -17,9 +17,11 @@
  */
 
 #include <ctype.h>
+#include <egg-heap.h>
 #include <string.h>
 
 #include "fuzzy.h"
+#include "fuzzy-private.h"
 
 /**
  * SECTION:fuzzy
@@ -31,6 +33,12 @@
  * It is a programming error to modify #Fuzzy while holding onto an array
  * of #FuzzyMatch elements. The position of strings within the FuzzyMatch
  * may no longer be valid.
+ *
+ * A #Fuzzy can be serialized with fuzzy_serialize() and later reopened
+ * with fuzzy_new_from_file(). The reopened index is backed by a read-only
+ * memory mapping of the file. Character tables are only copied into the
+ * heap when they are modified by a later fuzzy_insert(), so reopening a
+ * large index is cheap. Values associated with keys are not serialized.
  */
 
 struct _Fuzzy
@@ -41,6 +49,11 @@ struct _Fuzzy
   GPtrArray      *id_to_value;
   GHashTable     *char_tables;
   GHashTable     *removed;
+  GMappedFile    *mapped;
+  GHashTable     *mapped_tables;
+  const gchar    *mapped_heap;
+  const guint64  *mapped_offsets;
+  guint           n_mapped;
   guint           in_bulk_insert : 1;
   guint           case_sensitive : 1;
 };
@@ -55,17 +68,86 @@ typedef struct
 
 G_STATIC_ASSERT (sizeof(FuzzyItem) == 6);
 
+/*
+ * The serialized format is written in host byte order and is only meant
+ * to be used as a cache on the machine that generated it. A file written
+ * with a different byte order will fail the magic check.
+ *
+ *   FuzzyFileHeader
+ *   FuzzyFileTable  [n_tables]   sorted by character
+ *   guint64         [n_ids]      offset of each key within the heap
+ *   FuzzyItem       [...]        per-character tables, sorted by id/pos
+ *   gchar           [heap_len]   \0 terminated keys
+ */
+#define FUZZY_FILE_MAGIC   0x315A5A46 /* FZZ1 */
+#define FUZZY_FILE_VERSION 1
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 case_sensitive;
+  guint32 n_ids;
+  guint32 n_tables;
+  guint32 padding;
+  guint64 tables_offset;
+  guint64 offsets_offset;
+  guint64 heap_offset;
+  guint64 heap_len;
+} FuzzyFileHeader;
+
 typedef struct
 {
-   Fuzzy        *fuzzy;
-   GArray      **tables;
-   gint         *state;
-   guint         n_tables;
-   gsize         max_matches;
-   const gchar  *needle;
-   GHashTable   *matches;
+  guint32 ch;
+  guint32 n_items;
+  guint64 items_offset;
+} FuzzyFileTable;
+
+G_STATIC_ASSERT (sizeof (FuzzyFileHeader) == 56);
+G_STATIC_ASSERT (sizeof (FuzzyFileTable) == 16);
+
+/*
+ * Root tables smaller than this are not worth splitting across threads,
+ * the cost of handing a range to a worker would dominate the search.
+ */
+#define FUZZY_MIN_ITEMS_PER_WORKER 32768
+#define FUZZY_MAX_WORKERS          8
+
+typedef struct
+{
+   Fuzzy            *fuzzy;
+   const FuzzyItem **tables;
+   guint            *table_lens;
+   guint            *state;
+   guint             n_tables;
+   guint             n_ids;
+   guint             begin;
+   guint             end;
+   gsize             max_matches;
+   EggHeap          *heap;
+   GArray           *matches;
 } FuzzyLookup;
 
+/*
+ * The ranges of a single search. Ranges are claimed by the calling thread
+ * and by workers of a shared thread pool, whichever gets to them first, so
+ * the search completes even if no worker is available. Workers hold a
+ * reference since they may only get to run after the search completed.
+ */
+typedef struct
+{
+   volatile gint  ref_count;
+   volatile gint  next_range;
+   GMutex         mutex;
+   GCond          cond;
+   FuzzyLookup   *ranges;
+   guint          n_ranges;
+   guint          n_done;
+} FuzzySearch;
+
+static guint fuzzy_n_workers;
+static FuzzyPushFunc fuzzy_push_func;
+
 static gint
 fuzzy_item_compare (gconstpointer a,
                     gconstpointer b)
@@ -81,6 +163,16 @@ fuzzy_item_compare (gconstpointer a,
   return ret;
 }
 
+static gint
+fuzzy_unichar_compare (gconstpointer a,
+                       gconstpointer b)
+{
+  gunichar ca = *(const gunichar *)a;
+  gunichar cb = *(const gunichar *)b;
+
+  return (ca < cb) ? -1 : (ca > cb) ? 1 : 0;
+}
+
 static gint
 fuzzy_match_compare (gconstpointer a,
                      gconstpointer b)
@@ -170,6 +262,80 @@ fuzzy_heap_insert (Fuzzy       *fuzzy,
   return ret;
 }
 
+static inline guint
+fuzzy_get_n_ids (Fuzzy *fuzzy)
+{
+  return fuzzy->n_mapped + fuzzy->id_to_text_offset->len;
+}
+
+static gboolean
+fuzzy_get_table (Fuzzy            *fuzzy,
+                 gunichar          ch,
+                 const FuzzyItem **items,
+                 guint            *n_items)
+{
+  const FuzzyFileTable *ftable;
+  GArray *table;
+
+  g_assert (fuzzy != NULL);
+  g_assert (items != NULL);
+  g_assert (n_items != NULL);
+
+  if ((table = g_hash_table_lookup (fuzzy->char_tables, GINT_TO_POINTER (ch))))
+    {
+      *items = (const FuzzyItem *)(gpointer)table->data;
+      *n_items = table->len;
+      return TRUE;
+    }
+
+  if (fuzzy->mapped_tables != NULL &&
+      (ftable = g_hash_table_lookup (fuzzy->mapped_tables, GINT_TO_POINTER (ch))))
+    {
+      const gchar *contents = g_mapped_file_get_contents (fuzzy->mapped);
+
+      *items = (const FuzzyItem *)(gconstpointer)(contents + ftable->items_offset);
+      *n_items = ftable->n_items;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Tables loaded from a serialized index are read-only. Before we can
+ * append to one of them we copy it into the heap, which only needs to
+ * happen once per character.
+ */
+static GArray *
+fuzzy_ensure_table (Fuzzy    *fuzzy,
+                    gunichar  ch)
+{
+  const FuzzyFileTable *ftable;
+  GArray *table;
+
+  g_assert (fuzzy != NULL);
+
+  table = g_hash_table_lookup (fuzzy->char_tables, GINT_TO_POINTER (ch));
+
+  if (G_UNLIKELY (table == NULL))
+    {
+      table = g_array_new (FALSE, FALSE, sizeof (FuzzyItem));
+
+      if (fuzzy->mapped_tables != NULL &&
+          (ftable = g_hash_table_lookup (fuzzy->mapped_tables, GINT_TO_POINTER (ch))))
+        {
+          const gchar *contents = g_mapped_file_get_contents (fuzzy->mapped);
+
+          g_array_append_vals (table, contents + ftable->items_offset, ftable->n_items);
+          g_hash_table_remove (fuzzy->mapped_tables, GINT_TO_POINTER (ch));
+        }
+
+      g_hash_table_insert (fuzzy->char_tables, GINT_TO_POINTER (ch), table);
+    }
+
+  return table;
+}
+
 /**
  * fuzzy_begin_bulk_insert:
  * @fuzzy: (in): A #Fuzzy.
@@ -234,14 +400,14 @@ fuzzy_insert (Fuzzy       *fuzzy,
   gsize offset;
   guint id;
 
-  if (G_UNLIKELY (!key || !*key || (fuzzy->id_to_text_offset->len == G_MAXUINT)))
+  if (G_UNLIKELY (!key || !*key || (fuzzy_get_n_ids (fuzzy) == G_MAXUINT)))
     return;
 
   if (!fuzzy->case_sensitive)
     downcase = g_utf8_casefold (key, -1);
 
   offset = fuzzy_heap_insert (fuzzy, key);
-  id = fuzzy->id_to_text_offset->len;
+  id = fuzzy_get_n_ids (fuzzy);
   g_array_append_val (fuzzy->id_to_text_offset, offset);
   g_ptr_array_add (fuzzy->id_to_value, value);
 
@@ -254,13 +420,7 @@ fuzzy_insert (Fuzzy       *fuzzy,
       GArray *table;
       FuzzyItem item;
 
-      table = g_hash_table_lookup (fuzzy->char_tables, GINT_TO_POINTER (ch));
-
-      if (G_UNLIKELY (table == NULL))
-        {
-          table = g_array_new (FALSE, FALSE, sizeof (FuzzyItem));
-          g_hash_table_insert (fuzzy->char_tables, GINT_TO_POINTER (ch), table);
-        }
+      table = fuzzy_ensure_table (fuzzy, ch);
 
       item.id = id;
       item.pos = (guint)(gsize)(tmp - key);
@@ -314,28 +474,90 @@ fuzzy_unref (Fuzzy *fuzzy)
       g_hash_table_unref (fuzzy->removed);
       fuzzy->removed = NULL;
 
+      g_clear_pointer (&fuzzy->mapped_tables, g_hash_table_unref);
+      g_clear_pointer (&fuzzy->mapped, g_mapped_file_unref);
+      fuzzy->mapped_heap = NULL;
+      fuzzy->mapped_offsets = NULL;
+
       g_slice_free (Fuzzy, fuzzy);
     }
 }
 
+static inline const gchar *
+fuzzy_get_string (Fuzzy *fuzzy,
+                  gint   id)
+{
+  gsize offset;
+
+  if ((guint)id < fuzzy->n_mapped)
+    return fuzzy->mapped_heap + fuzzy->mapped_offsets [id];
+
+  offset = g_array_index (fuzzy->id_to_text_offset, gsize, id - fuzzy->n_mapped);
+
+  return (const gchar *)&fuzzy->heap->data [offset];
+}
+
+/*
+ * Advances @pos to the first item in @table whose id is >= @id. Tables
+ * are sorted by id, so rather than stepping over every item belonging to
+ * keys that cannot match we gallop forward and then bisect.
+ */
+static inline guint
+fuzzy_table_seek (const FuzzyItem *table,
+                  guint            table_len,
+                  guint            pos,
+                  guint            id)
+{
+  guint step = 1;
+  guint hi;
+
+  if (pos >= table_len || table [pos].id >= id)
+    return pos;
+
+  while ((pos + step) < table_len && table [pos + step].id < id)
+    {
+      pos += step;
+      step <<= 1;
+    }
+
+  hi = MIN (pos + step, table_len);
+  pos++;
+
+  while (pos < hi)
+    {
+      guint mid = pos + ((hi - pos) / 2);
+
+      if (table [mid].id < id)
+        pos = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return pos;
+}
+
 static gboolean
-fuzzy_do_match (FuzzyLookup *lookup,
-                FuzzyItem   *item,
-                gint         table_index,
-                gint         score)
+fuzzy_do_match (FuzzyLookup     *lookup,
+                const FuzzyItem *item,
+                guint            table_index,
+                gint             score,
+                gint            *best_score)
 {
-  FuzzyItem *iter;
-  gpointer key;
-  GArray *table;
-  gint *state;
+  const FuzzyItem *iter;
+  const FuzzyItem *table;
+  guint table_len;
+  guint *state;
   gint iter_score;
 
   table = lookup->tables [table_index];
+  table_len = lookup->table_lens [table_index];
   state = &lookup->state [table_index];
 
-  for (; state [0] < table->len; state [0]++)
+  state [0] = fuzzy_table_seek (table, table_len, state [0], item->id);
+
+  for (; state [0] < table_len; state [0]++)
     {
-      iter = &g_array_index (table, FuzzyItem, state[0]);
+      iter = &table [state [0]];
 
       if ((iter->id < item->id) || ((iter->id == item->id) && (iter->pos <= item->pos)))
         continue;
@@ -346,16 +568,13 @@ fuzzy_do_match (FuzzyLookup *lookup,
 
       if ((table_index + 1) < lookup->n_tables)
         {
-          if (fuzzy_do_match(lookup, iter, table_index + 1, iter_score))
+          if (fuzzy_do_match (lookup, iter, table_index + 1, iter_score, best_score))
             return TRUE;
           continue;
         }
 
-      key = GINT_TO_POINTER (iter->id);
-
-      if (!g_hash_table_contains (lookup->matches, key) ||
-          (iter_score < GPOINTER_TO_INT (g_hash_table_lookup (lookup->matches, key))))
-        g_hash_table_insert (lookup->matches, key, GINT_TO_POINTER (iter_score));
+      if (iter_score < *best_score)
+        *best_score = iter_score;
 
       return TRUE;
     }
@@ -363,15 +582,191 @@ fuzzy_do_match (FuzzyLookup *lookup,
   return FALSE;
 }
 
-static inline const gchar *
-fuzzy_get_string (Fuzzy *fuzzy,
-                  gint   id)
+static void
+fuzzy_lookup_push (FuzzyLookup *lookup,
+                   guint        id,
+                   gint         gap)
 {
-  gsize offset;
+  Fuzzy *fuzzy = lookup->fuzzy;
+  FuzzyMatch match;
 
-  offset = g_array_index (fuzzy->id_to_text_offset, gsize, id);
+  if (id == G_MAXUINT || gap == G_MAXINT || id >= lookup->n_ids)
+    return;
 
-  return (const gchar *)&fuzzy->heap->data [offset];
+  /* Ignore keys that have a tombstone record. */
+  if (g_hash_table_contains (fuzzy->removed, GINT_TO_POINTER (id)))
+    return;
+
+  match.id = id;
+  match.key = fuzzy_get_string (fuzzy, id);
+  match.score = 1.0 / (strlen (match.key) + gap);
+  match.value = g_ptr_array_index (fuzzy->id_to_value, id);
+
+  if (lookup->max_matches == 0)
+    {
+      g_array_append_val (lookup->matches, match);
+      return;
+    }
+
+  /*
+   * The heap is ordered so that its head is the worst match we are
+   * holding on to, so we only need to compare against the head to know
+   * if the new match makes the cut.
+   */
+  if (lookup->heap->len < lookup->max_matches)
+    {
+      egg_heap_insert_val (lookup->heap, match);
+    }
+  else if (fuzzy_match_compare (&match, &egg_heap_peek (lookup->heap, FuzzyMatch)) < 0)
+    {
+      egg_heap_extract (lookup->heap, NULL);
+      egg_heap_insert_val (lookup->heap, match);
+    }
+}
+
+static void
+fuzzy_lookup_run (FuzzyLookup *lookup)
+{
+  const FuzzyItem *root;
+  guint last_id = G_MAXUINT;
+  gint best_score = G_MAXINT;
+  guint i;
+
+  g_assert (lookup != NULL);
+  g_assert (lookup->n_tables > 0);
+
+  root = lookup->tables [0];
+
+  /*
+   * Our range of the root table never splits a key across workers, so
+   * once we move on to the next id the best score for the previous key
+   * is final and can be pushed into our bounded set of matches.
+   */
+  for (i = lookup->begin; i < lookup->end; i++)
+    {
+      const FuzzyItem *item = &root [i];
+
+      if (item->id != last_id)
+        {
+          fuzzy_lookup_push (lookup, last_id, best_score);
+          last_id = item->id;
+          best_score = G_MAXINT;
+        }
+
+      if (lookup->n_tables == 1)
+        best_score = 0;
+      else
+        fuzzy_do_match (lookup, item, 1, 0, &best_score);
+    }
+
+  fuzzy_lookup_push (lookup, last_id, best_score);
+}
+
+static void
+fuzzy_search_unref (FuzzySearch *search)
+{
+  if (g_atomic_int_dec_and_test (&search->ref_count))
+    {
+      g_mutex_clear (&search->mutex);
+      g_cond_clear (&search->cond);
+      g_free (search->ranges);
+      g_slice_free (FuzzySearch, search);
+    }
+}
+
+static void
+fuzzy_search_run (FuzzySearch *search)
+{
+  guint i;
+
+  while ((i = g_atomic_int_add (&search->next_range, 1)) < search->n_ranges)
+    {
+      fuzzy_lookup_run (&search->ranges [i]);
+
+      g_mutex_lock (&search->mutex);
+      if (++search->n_done == search->n_ranges)
+        g_cond_signal (&search->cond);
+      g_mutex_unlock (&search->mutex);
+    }
+}
+
+static void
+fuzzy_search_work (gpointer data)
+{
+  FuzzySearch *search = data;
+
+  fuzzy_search_run (search);
+  fuzzy_search_unref (search);
+}
+
+static void
+fuzzy_search_worker (gpointer data,
+                     gpointer user_data)
+{
+  fuzzy_search_work (data);
+}
+
+/*
+ * Unless the application provides its own workers with
+ * _fuzzy_set_push_func(), they are shared by every search, so that a query
+ * does not pay for spawning threads. Idle threads are reclaimed by GLib.
+ */
+static GThreadPool *
+fuzzy_get_thread_pool (void)
+{
+  static GThreadPool *thread_pool;
+
+  if (g_once_init_enter (&thread_pool))
+    {
+      GThreadPool *instance;
+
+      instance = g_thread_pool_new (fuzzy_search_worker,
+                                    NULL,
+                                    FUZZY_MAX_WORKERS - 1,
+                                    FALSE,
+                                    NULL);
+      g_once_init_leave (&thread_pool, instance);
+    }
+
+  return thread_pool;
+}
+
+static guint
+fuzzy_get_n_workers (guint root_len)
+{
+  guint n_workers;
+
+  if (fuzzy_n_workers != 0)
+    return fuzzy_n_workers;
+
+  n_workers = MIN (g_get_num_processors (), FUZZY_MAX_WORKERS);
+  n_workers = MIN (n_workers, root_len / FUZZY_MIN_ITEMS_PER_WORKER);
+
+  return MAX (1, n_workers);
+}
+
+/*
+ * Makes searches run their extra ranges through @push_func rather than our
+ * own thread pool, so that they are scheduled along with the other work of
+ * the application. The caller searches alongside the workers and claims any
+ * range they have not started, so @push_func may queue the work for later.
+ * Must be called before the first search.
+ */
+void
+_fuzzy_set_push_func (FuzzyPushFunc push_func)
+{
+  fuzzy_push_func = push_func;
+}
+
+/*
+ * Overrides the number of ranges the root table is split into, so that
+ * tests can compare searches using a single range against several. Zero
+ * restores the default. Must not be called while a search is running.
+ */
+void
+_fuzzy_set_n_workers (guint n_workers)
+{
+  fuzzy_n_workers = n_workers;
 }
 
 /**
@@ -383,7 +778,12 @@ fuzzy_get_string (Fuzzy *fuzzy,
  * Fuzzy searches within @fuzzy for strings that fuzzy match @needle.
  * Only up to @max_matches will be returned.
  *
- * TODO: max_matches is not yet respected.
+ * If @max_matches is non-zero, only the best @max_matches are tracked
+ * while searching and the result is sorted by score. If @max_matches is
+ * zero, all matches are returned in no particular order.
+ *
+ * Large indexes are searched using a shared pool of worker threads.
+ * @fuzzy must not be modified while a search is in progress.
  *
  * Returns: (transfer full) (element-type FuzzyMatch): A newly allocated
  *   #GArray containing #FuzzyMatch elements. This should be freed when
@@ -397,16 +797,16 @@ fuzzy_match (Fuzzy       *fuzzy,
              gsize        max_matches)
 {
   FuzzyLookup lookup = { 0 };
-  FuzzyMatch match;
-  FuzzyItem *item;
-  GHashTableIter iter;
-  gpointer key;
-  gpointer value;
+  FuzzySearch *search = NULL;
+  FuzzyLookup *workers = NULL;
+  GThreadPool *thread_pool;
+  const FuzzyItem *root;
   const gchar *tmp;
   GArray *matches = NULL;
-  GArray *root;
+  guint n_workers = 0;
+  guint root_len;
   gchar *downcase = NULL;
-  gint i;
+  guint i;
 
   g_return_val_if_fail (fuzzy, NULL);
   g_return_val_if_fail (!fuzzy->in_bulk_insert, NULL);
@@ -425,94 +825,119 @@ fuzzy_match (Fuzzy       *fuzzy,
 
   lookup.fuzzy = fuzzy;
   lookup.n_tables = g_utf8_strlen (needle, -1);
-  lookup.state = g_new0 (gint, lookup.n_tables);
-  lookup.tables = g_new0 (GArray*, lookup.n_tables);
-  lookup.needle = needle;
+  lookup.n_ids = fuzzy_get_n_ids (fuzzy);
+  lookup.tables = g_new0 (const FuzzyItem*, lookup.n_tables);
+  lookup.table_lens = g_new0 (guint, lookup.n_tables);
   lookup.max_matches = max_matches;
-  lookup.matches = g_hash_table_new (NULL, NULL);
 
   for (i = 0, tmp = needle; *tmp; tmp = g_utf8_next_char (tmp))
     {
       gunichar ch;
-      GArray *table;
 
       ch = g_utf8_get_char (tmp);
-      table = g_hash_table_lookup (fuzzy->char_tables, GINT_TO_POINTER (ch));
 
-      if (table == NULL)
+      if (!fuzzy_get_table (fuzzy, ch, &lookup.tables [i], &lookup.table_lens [i]))
         goto cleanup;
 
-      lookup.tables [i++] = table;
+      i++;
     }
 
   g_assert (lookup.n_tables == i);
   g_assert (lookup.tables [0] != NULL);
 
   root = lookup.tables [0];
+  root_len = lookup.table_lens [0];
+
+  /*
+   * Split the root table into contiguous ranges, one per worker, making
+   * sure that all items for a given key land within the same range.
+   */
+  n_workers = fuzzy_get_n_workers (root_len);
+
+  search = g_slice_new0 (FuzzySearch);
+  search->ref_count = 1;
+  search->ranges = workers = g_new0 (FuzzyLookup, n_workers);
+  search->n_ranges = n_workers;
+  g_mutex_init (&search->mutex);
+  g_cond_init (&search->cond);
+
+  for (i = 0; i < n_workers; i++)
+    {
+      FuzzyLookup *worker = &workers [i];
+
+      *worker = lookup;
+      worker->state = g_new0 (guint, lookup.n_tables);
+      worker->begin = (i == 0) ? 0 : workers [i - 1].end;
+      worker->end = (i + 1 == n_workers) ? root_len : (guint)(((guint64)root_len * (i + 1)) / n_workers);
+
+      if (worker->end < worker->begin)
+        worker->end = worker->begin;
+
+      while (worker->end > 0 && worker->end < root_len &&
+             root [worker->end].id == root [worker->end - 1].id)
+        worker->end++;
 
-  if (G_LIKELY (lookup.n_tables > 1))
+      if (max_matches == 0)
+        worker->matches = g_array_new (FALSE, FALSE, sizeof (FuzzyMatch));
+      else
+        worker->heap = egg_heap_new (sizeof (FuzzyMatch), fuzzy_match_compare);
+    }
+
+  if (n_workers > 1 && fuzzy_push_func != NULL)
     {
-      for (i = 0; i < root->len; i++)
+      for (i = 1; i < MIN (n_workers, FUZZY_MAX_WORKERS); i++)
         {
-          item = &g_array_index (root, FuzzyItem, i);
-          fuzzy_do_match (&lookup, item, 1, 0);
+          g_atomic_int_inc (&search->ref_count);
+          fuzzy_push_func (fuzzy_search_work, search);
         }
     }
-  else
+  else if (n_workers > 1 && (thread_pool = fuzzy_get_thread_pool ()))
     {
-      guint last_id = G_MAXUINT;
-
-      for (i = 0; i < root->len; i++)
+      for (i = 1; i < MIN (n_workers, FUZZY_MAX_WORKERS); i++)
         {
-          item = &g_array_index (root, FuzzyItem, i);
-          match.id = GPOINTER_TO_INT (item->id);
-          if (match.id != last_id)
-            {
-              match.key = fuzzy_get_string (fuzzy, item->id);
-              match.value = g_ptr_array_index (fuzzy->id_to_value, item->id);
-              match.score = 0;
-              g_array_append_val (matches, match);
-              last_id = match.id;
-            }
+          g_atomic_int_inc (&search->ref_count);
+          g_thread_pool_push (thread_pool, search, NULL);
         }
-
-      goto cleanup;
     }
 
-  g_hash_table_iter_init (&iter, lookup.matches);
+  /* Search alongside the workers, then wait for the ranges they claimed. */
+  fuzzy_search_run (search);
 
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    {
-      /* Ignore keys that have a tombstone record. */
-      if (g_hash_table_contains (fuzzy->removed, key))
-        continue;
+  g_mutex_lock (&search->mutex);
+  while (search->n_done < search->n_ranges)
+    g_cond_wait (&search->cond, &search->mutex);
+  g_mutex_unlock (&search->mutex);
 
-      match.id = GPOINTER_TO_INT (key);
-      match.key = fuzzy_get_string (fuzzy, match.id);
-      match.score = 1.0 / (strlen (match.key) + GPOINTER_TO_INT (value));
-      match.value = g_ptr_array_index (fuzzy->id_to_value, match.id);
+  for (i = 0; i < n_workers; i++)
+    {
+      FuzzyLookup *worker = &workers [i];
 
-      g_array_append_val (matches, match);
+      if (worker->matches != NULL)
+        g_array_append_vals (matches, worker->matches->data, worker->matches->len);
+      else if (worker->heap != NULL)
+        g_array_append_vals (matches, worker->heap->data, worker->heap->len);
     }
 
-  /*
-   * TODO: We could be more clever here when inserting into the array
-   *       only if it is a lower score than the end or < max items.
-   */
-
   if (max_matches != 0)
     {
       g_array_sort (matches, fuzzy_match_compare);
 
-      if (max_matches && (matches->len > max_matches))
+      if (matches->len > max_matches)
         g_array_set_size (matches, max_matches);
     }
 
 cleanup:
+  for (i = 0; i < n_workers; i++)
+    {
+      g_free (workers [i].state);
+      g_clear_pointer (&workers [i].matches, g_array_unref);
+      g_clear_pointer (&workers [i].heap, egg_heap_unref);
+    }
+
+  g_clear_pointer (&search, fuzzy_search_unref);
   g_free (downcase);
-  g_free (lookup.state);
   g_free (lookup.tables);
-  g_clear_pointer (&lookup.matches, g_hash_table_unref);
+  g_free (lookup.table_lens);
 
   return matches;
 }
@@ -561,3 +986,266 @@ fuzzy_remove (Fuzzy       *fuzzy,
 
   g_clear_pointer (&ar, g_array_unref);
 }
+
+/**
+ * fuzzy_serialize:
+ * @fuzzy: (in): A #Fuzzy.
+ *
+ * Serializes the keys of @fuzzy into a compact format suitable for
+ * writing to disk and reopening with fuzzy_new_from_file().
+ *
+ * Removed keys are dropped while serializing, so key identifiers are not
+ * stable across a serialize and reload. Values are not serialized.
+ *
+ * Returns: (transfer full): A #GBytes containing the serialized index.
+ */
+GBytes *
+fuzzy_serialize (Fuzzy *fuzzy)
+{
+  g_autoptr(GArray) chars = NULL;
+  g_autoptr(GArray) ftables = NULL;
+  g_autoptr(GArray) offsets = NULL;
+  g_autoptr(GByteArray) items = NULL;
+  g_autoptr(GByteArray) heap = NULL;
+  FuzzyFileHeader header = { 0 };
+  GHashTableIter iter;
+  GByteArray *ret;
+  gpointer key;
+  guint *remap;
+  guint n_ids;
+  guint n_live = 0;
+  guint i;
+
+  g_return_val_if_fail (fuzzy != NULL, NULL);
+  g_return_val_if_fail (!fuzzy->in_bulk_insert, NULL);
+
+  n_ids = fuzzy_get_n_ids (fuzzy);
+
+  /*
+   * Compact the identifier space so that tombstoned keys are not carried
+   * forward. The remapping is monotonic, so sorted tables stay sorted.
+   */
+  remap = g_new (guint, n_ids);
+  heap = g_byte_array_new ();
+  offsets = g_array_sized_new (FALSE, FALSE, sizeof (guint64), n_ids);
+
+  for (i = 0; i < n_ids; i++)
+    {
+      const gchar *str;
+      guint64 offset;
+
+      if (g_hash_table_contains (fuzzy->removed, GINT_TO_POINTER (i)))
+        {
+          remap [i] = G_MAXUINT;
+          continue;
+        }
+
+      remap [i] = n_live++;
+
+      str = fuzzy_get_string (fuzzy, i);
+      offset = heap->len;
+      g_byte_array_append (heap, (const guint8 *)str, strlen (str) + 1);
+      g_array_append_val (offsets, offset);
+    }
+
+  chars = g_array_new (FALSE, FALSE, sizeof (gunichar));
+
+  g_hash_table_iter_init (&iter, fuzzy->char_tables);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      gunichar ch = GPOINTER_TO_INT (key);
+      g_array_append_val (chars, ch);
+    }
+
+  if (fuzzy->mapped_tables != NULL)
+    {
+      g_hash_table_iter_init (&iter, fuzzy->mapped_tables);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          gunichar ch = GPOINTER_TO_INT (key);
+          g_array_append_val (chars, ch);
+        }
+    }
+
+  g_array_sort (chars, fuzzy_unichar_compare);
+
+  items = g_byte_array_new ();
+  ftables = g_array_sized_new (FALSE, FALSE, sizeof (FuzzyFileTable), chars->len);
+
+  for (i = 0; i < chars->len; i++)
+    {
+      gunichar ch = g_array_index (chars, gunichar, i);
+      const FuzzyItem *table;
+      FuzzyFileTable ftable;
+      guint table_len;
+      guint j;
+
+      if (!fuzzy_get_table (fuzzy, ch, &table, &table_len))
+        continue;
+
+      ftable.ch = ch;
+      ftable.n_items = 0;
+      ftable.items_offset = items->len;
+
+      for (j = 0; j < table_len; j++)
+        {
+          FuzzyItem item = table [j];
+
+          if (item.id >= n_ids || remap [item.id] == G_MAXUINT)
+            continue;
+
+          item.id = remap [item.id];
+          g_byte_array_append (items, (const guint8 *)&item, sizeof item);
+          ftable.n_items++;
+        }
+
+      if (ftable.n_items > 0)
+        g_array_append_val (ftables, ftable);
+    }
+
+  header.magic = FUZZY_FILE_MAGIC;
+  header.version = FUZZY_FILE_VERSION;
+  header.case_sensitive = fuzzy->case_sensitive;
+  header.n_ids = n_live;
+  header.n_tables = ftables->len;
+  header.tables_offset = sizeof header;
+  header.offsets_offset = header.tables_offset + (guint64)ftables->len * sizeof (FuzzyFileTable);
+  header.heap_offset = header.offsets_offset + (guint64)offsets->len * sizeof (guint64) + items->len;
+  header.heap_len = heap->len;
+
+  /* Items are written after the offsets, so rebase them to the file. */
+  for (i = 0; i < ftables->len; i++)
+    {
+      FuzzyFileTable *ftable = &g_array_index (ftables, FuzzyFileTable, i);
+
+      ftable->items_offset += header.offsets_offset + (guint64)offsets->len * sizeof (guint64);
+    }
+
+  ret = g_byte_array_sized_new (header.heap_offset + header.heap_len);
+  g_byte_array_append (ret, (const guint8 *)&header, sizeof header);
+  g_byte_array_append (ret, (const guint8 *)ftables->data, ftables->len * sizeof (FuzzyFileTable));
+  g_byte_array_append (ret, (const guint8 *)offsets->data, offsets->len * sizeof (guint64));
+  g_byte_array_append (ret, items->data, items->len);
+  g_byte_array_append (ret, heap->data, heap->len);
+
+  g_free (remap);
+
+  return g_byte_array_free_to_bytes (ret);
+}
+
+static gboolean
+fuzzy_validate_mapped_file (GMappedFile  *mapped,
+                            GError      **error)
+{
+  const FuzzyFileHeader *header;
+  const FuzzyFileTable *ftables;
+  const guint64 *offsets;
+  const gchar *contents;
+  gsize len;
+  guint i;
+
+  g_assert (mapped != NULL);
+
+  contents = g_mapped_file_get_contents (mapped);
+  len = g_mapped_file_get_length (mapped);
+
+  if (contents == NULL || len < sizeof *header)
+    goto invalid;
+
+  header = (const FuzzyFileHeader *)(gconstpointer)contents;
+
+  if (header->magic != FUZZY_FILE_MAGIC || header->version != FUZZY_FILE_VERSION)
+    goto invalid;
+
+  if ((header->tables_offset % 8) != 0 ||
+      (header->offsets_offset % 8) != 0 ||
+      header->tables_offset > len ||
+      header->n_tables > (len - header->tables_offset) / sizeof (FuzzyFileTable) ||
+      header->offsets_offset > len ||
+      header->n_ids > (len - header->offsets_offset) / sizeof (guint64) ||
+      header->heap_offset > len ||
+      header->heap_len > len - header->heap_offset)
+    goto invalid;
+
+  if (header->heap_len > 0 && contents [header->heap_offset + header->heap_len - 1] != '\0')
+    goto invalid;
+
+  ftables = (const FuzzyFileTable *)(gconstpointer)(contents + header->tables_offset);
+
+  for (i = 0; i < header->n_tables; i++)
+    {
+      if (ftables [i].items_offset > len ||
+          ftables [i].n_items > (len - ftables [i].items_offset) / sizeof (FuzzyItem))
+        goto invalid;
+    }
+
+  offsets = (const guint64 *)(gconstpointer)(contents + header->offsets_offset);
+
+  for (i = 0; i < header->n_ids; i++)
+    {
+      if (offsets [i] >= header->heap_len)
+        goto invalid;
+    }
+
+  return TRUE;
+
+invalid:
+  g_set_error (error,
+               G_FILE_ERROR,
+               G_FILE_ERROR_INVAL,
+               "Serialized fuzzy index is corrupt or from an incompatible version");
+
+  return FALSE;
+}
+
+/**
+ * fuzzy_new_from_file:
+ * @filename: (in): The path to a file created from fuzzy_serialize().
+ * @error: (out): A location for a #GError, or %NULL.
+ *
+ * Opens a serialized #Fuzzy index. The file is memory mapped and used
+ * directly, so this is inexpensive even for very large indexes. The
+ * resulting #Fuzzy may be modified with fuzzy_insert() and fuzzy_remove().
+ *
+ * Returns: (transfer full): A #Fuzzy or %NULL and @error is set.
+ */
+Fuzzy *
+fuzzy_new_from_file (const gchar  *filename,
+                     GError      **error)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  const FuzzyFileHeader *header;
+  const FuzzyFileTable *ftables;
+  const gchar *contents;
+  Fuzzy *fuzzy;
+  guint i;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  if (!(mapped = g_mapped_file_new (filename, FALSE, error)))
+    return NULL;
+
+  if (!fuzzy_validate_mapped_file (mapped, error))
+    return NULL;
+
+  contents = g_mapped_file_get_contents (mapped);
+  header = (const FuzzyFileHeader *)(gconstpointer)contents;
+  ftables = (const FuzzyFileTable *)(gconstpointer)(contents + header->tables_offset);
+
+  fuzzy = fuzzy_new (header->case_sensitive);
+  fuzzy->mapped = g_steal_pointer (&mapped);
+  fuzzy->mapped_heap = contents + header->heap_offset;
+  fuzzy->mapped_offsets = (const guint64 *)(gconstpointer)(contents + header->offsets_offset);
+  fuzzy->n_mapped = header->n_ids;
+  fuzzy->mapped_tables = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < header->n_tables; i++)
+    g_hash_table_insert (fuzzy->mapped_tables,
+                         GINT_TO_POINTER (ftables [i].ch),
+                         (gpointer)&ftables [i]);
+
+  /* Values are not serialized, but must stay indexable by id. */
+  g_ptr_array_set_size (fuzzy->id_to_value, header->n_ids);
+
+  return fuzzy;
+}
@@ -37,6 +37,9 @@ struct _FuzzyMatch
 Fuzzy     *fuzzy_new                (gboolean        case_sensitive);
 Fuzzy     *fuzzy_new_with_free_func (gboolean        case_sensitive,
                                      GDestroyNotify  free_func);
+Fuzzy     *fuzzy_new_from_file      (const gchar    *filename,
+                                     GError        **error);
+GBytes    *fuzzy_serialize          (Fuzzy          *fuzzy);
 void       fuzzy_set_free_func      (Fuzzy          *fuzzy,
                                      GDestroyNotify  free_func);
 void       fuzzy_begin_bulk_insert  (Fuzzy          *fuzzy);
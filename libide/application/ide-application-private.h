@@ -64,7 +64,10 @@ struct _IdeApplication
 
   GHashTable          *plugin_settings;
 
+  guint                memory_pressure_source;
+
   guint                disable_theme_tracking : 1;
+  guint                low_memory : 1;
 };
 
 void     ide_application_discover_plugins           (IdeApplication        *self) G_GNUC_INTERNAL;
@@ -20,12 +20,14 @@
 
 #include "config.h"
 
+#include <egg-task-cache.h>
 #include <glib/gi18n.h>
 #include <girepository.h>
 #include <gtksourceview/gtksource.h>
 #include <ide-icons-resources.h>
 #include <locale.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef __linux
 # include <sys/prctl.h>
 #endif
@@ -47,6 +49,16 @@
 #include "workbench/ide-workbench.h"
 #include "workers/ide-worker.h"
 
+/*
+ * How often to check the memory available to the system, and the fraction
+ * of memory (in percent) below which it is considered low. The caches are
+ * trimmed once when entering the low state, and again only after memory
+ * recovered past the second threshold.
+ */
+#define MEMORY_PRESSURE_INTERVAL 10
+#define LOW_MEMORY_PERCENT       5
+#define RECOVERED_MEMORY_PERCENT 10
+
 G_DEFINE_TYPE (IdeApplication, ide_application, GTK_TYPE_APPLICATION)
 
 static GThread *main_thread;
@@ -129,6 +141,100 @@ ide_application_register_theme_overrides (IdeApplication *self)
   IDE_EXIT;
 }
 
+#ifdef __linux
+static gboolean
+ide_application_get_memory_percent (guint *percent)
+{
+  g_autofree gchar *contents = NULL;
+  const gchar *line;
+  guint64 total = 0;
+  guint64 available = 0;
+
+  g_assert (percent != NULL);
+
+  if (!g_file_get_contents ("/proc/meminfo", &contents, NULL, NULL))
+    return FALSE;
+
+  for (line = contents; line != NULL && *line; line = strchr (line, '\n'))
+    {
+      if (*line == '\n')
+        line++;
+
+      if (g_str_has_prefix (line, "MemTotal:"))
+        total = g_ascii_strtoull (line + strlen ("MemTotal:"), NULL, 10);
+      else if (g_str_has_prefix (line, "MemAvailable:"))
+        available = g_ascii_strtoull (line + strlen ("MemAvailable:"), NULL, 10);
+    }
+
+  /* MemAvailable requires Linux 3.14 */
+  if (total == 0 || available == 0)
+    return FALSE;
+
+  *percent = available * 100 / total;
+
+  return TRUE;
+}
+
+static gboolean
+ide_application_check_memory_pressure (gpointer user_data)
+{
+  IdeApplication *self = user_data;
+  guint percent;
+
+  g_assert (IDE_IS_APPLICATION (self));
+
+  if (!ide_application_get_memory_percent (&percent))
+    {
+      self->memory_pressure_source = 0;
+      return G_SOURCE_REMOVE;
+    }
+
+  if (!self->low_memory && percent < LOW_MEMORY_PERCENT)
+    {
+      /*
+       * Everything in the task caches can be recomputed, so give it back
+       * before the system starts swapping.
+       */
+      g_debug ("Only %u%% of memory available, trimming caches", percent);
+      self->low_memory = TRUE;
+      egg_task_cache_trim_all ();
+    }
+  else if (self->low_memory && percent >= RECOVERED_MEMORY_PERCENT)
+    {
+      self->low_memory = FALSE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+#endif
+
+static void
+ide_application_register_cache_limit (IdeApplication *self)
+{
+  g_autoptr(GSettings) settings = NULL;
+  guint limit;
+
+  g_assert (IDE_IS_APPLICATION (self));
+
+  settings = g_settings_new ("org.gnome.builder");
+  limit = g_settings_get_uint (settings, "cache-memory-limit");
+  limit = MIN (limit, G_MAXSIZE / (1024 * 1024));
+
+  /*
+   * Translation units, build flags and ctags indexes all live in task
+   * caches. Bound their combined size so that opening many files cannot
+   * keep an unbounded amount of memory alive.
+   */
+  egg_task_cache_set_global_max_cost ((gsize)limit * 1024 * 1024);
+
+#ifdef __linux
+  self->memory_pressure_source =
+    g_timeout_add_seconds (MEMORY_PRESSURE_INTERVAL,
+                           ide_application_check_memory_pressure,
+                           self);
+#endif
+}
+
 static void
 ide_application_register_keybindings (IdeApplication *self)
 {
@@ -385,6 +491,7 @@ ide_application_startup (GApplication *application)
       ide_language_defaults_init_async (NULL, ide_application_language_defaults_cb, NULL);
       ide_application_register_theme_overrides (self);
       ide_application_register_keybindings (self);
+      ide_application_register_cache_limit (self);
       ide_application_actions_init (self);
 
       modeline_parser_init ();
@@ -392,6 +499,10 @@ ide_application_startup (GApplication *application)
 
   _ide_battery_monitor_init ();
 
+  /* Worker processes follow the scheduling of the primary instance */
+  if (self->mode == IDE_APPLICATION_MODE_PRIMARY)
+    _ide_battery_monitor_watch (_ide_thread_pool_set_should_conserve);
+
   G_APPLICATION_CLASS (ide_application_parent_class)->startup (application);
 
   if (self->mode == IDE_APPLICATION_MODE_PRIMARY)
@@ -425,6 +536,12 @@ ide_application_shutdown (GApplication *application)
   if (self->worker_manager != NULL)
     ide_worker_manager_shutdown (self->worker_manager);
 
+  if (self->memory_pressure_source != 0)
+    {
+      g_source_remove (self->memory_pressure_source);
+      self->memory_pressure_source = 0;
+    }
+
   if (G_APPLICATION_CLASS (ide_application_parent_class)->shutdown)
     G_APPLICATION_CLASS (ide_application_parent_class)->shutdown (application);
 }
@@ -579,6 +696,37 @@ ide_application_get_worker_async (IdeApplication      *self,
                                   GCancellable        *cancellable,
                                   GAsyncReadyCallback  callback,
                                   gpointer             user_data)
+{
+  g_return_if_fail (IDE_IS_APPLICATION (self));
+  g_return_if_fail (plugin_name != NULL);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  ide_application_get_worker_for_key_async (self, plugin_name, NULL, cancellable, callback, user_data);
+}
+
+/**
+ * ide_application_get_worker_for_key_async:
+ * @self: A #IdeApplication
+ * @plugin_name: The name of the plugin.
+ * @key: (allow-none): A key used to select a worker from the pool, or %NULL.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: A #GAsyncReadyCallback or %NULL.
+ * @user_data: user data for @callback.
+ *
+ * This is like ide_application_get_worker_async() except that the worker is
+ * selected from a pool of subprocesses for the plugin. Requests using the same
+ * @key will always be routed to the same subprocess.
+ *
+ * @callback should call ide_application_get_worker_finish() with the result
+ * provided to retrieve the result.
+ */
+void
+ide_application_get_worker_for_key_async (IdeApplication      *self,
+                                          const gchar         *plugin_name,
+                                          const gchar         *key,
+                                          GCancellable        *cancellable,
+                                          GAsyncReadyCallback  callback,
+                                          gpointer             user_data)
 {
   g_autoptr(GTask) task = NULL;
 
@@ -594,11 +742,12 @@ ide_application_get_worker_async (IdeApplication      *self,
 
   task = g_task_new (self, cancellable, callback, user_data);
 
-  ide_worker_manager_get_worker_async (self->worker_manager,
-                                       plugin_name,
-                                       cancellable,
-                                       ide_application_get_worker_cb,
-                                       g_object_ref (task));
+  ide_worker_manager_get_worker_for_key_async (self->worker_manager,
+                                               plugin_name,
+                                               key,
+                                               cancellable,
+                                               ide_application_get_worker_cb,
+                                               g_object_ref (task));
 }
 
 /**
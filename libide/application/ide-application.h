@@ -39,25 +39,31 @@ typedef enum
   IDE_APPLICATION_MODE_TESTS,
 } IdeApplicationMode;
 
-GThread            *ide_application_get_main_thread      (void);
-IdeApplicationMode  ide_application_get_mode             (IdeApplication       *self);
-IdeApplication     *ide_application_new                  (void);
-GDateTime          *ide_application_get_started_at       (IdeApplication       *self);
-IdeRecentProjects  *ide_application_get_recent_projects  (IdeApplication       *self);
-void                ide_application_show_projects_window (IdeApplication       *self);
-const gchar        *ide_application_get_keybindings_mode (IdeApplication       *self);
-void                ide_application_get_worker_async     (IdeApplication       *self,
-                                                          const gchar          *plugin_name,
-                                                          GCancellable         *cancellable,
-                                                          GAsyncReadyCallback   callback,
-                                                          gpointer              user_data);
-GDBusProxy         *ide_application_get_worker_finish    (IdeApplication       *self,
-                                                          GAsyncResult         *result,
-                                                          GError              **error);
-GMenu              *ide_application_get_menu_by_id       (IdeApplication       *self,
-                                                          const gchar          *id);
-gboolean            ide_application_open_project         (IdeApplication       *self,
-                                                          GFile                *file);
+GThread            *ide_application_get_main_thread          (void);
+IdeApplicationMode  ide_application_get_mode                 (IdeApplication       *self);
+IdeApplication     *ide_application_new                      (void);
+GDateTime          *ide_application_get_started_at           (IdeApplication       *self);
+IdeRecentProjects  *ide_application_get_recent_projects      (IdeApplication       *self);
+void                ide_application_show_projects_window     (IdeApplication       *self);
+const gchar        *ide_application_get_keybindings_mode     (IdeApplication       *self);
+void                ide_application_get_worker_async         (IdeApplication       *self,
+                                                              const gchar          *plugin_name,
+                                                              GCancellable         *cancellable,
+                                                              GAsyncReadyCallback   callback,
+                                                              gpointer              user_data);
+void                ide_application_get_worker_for_key_async (IdeApplication       *self,
+                                                              const gchar          *plugin_name,
+                                                              const gchar          *key,
+                                                              GCancellable         *cancellable,
+                                                              GAsyncReadyCallback   callback,
+                                                              gpointer              user_data);
+GDBusProxy         *ide_application_get_worker_finish        (IdeApplication       *self,
+                                                              GAsyncResult         *result,
+                                                              GError              **error);
+GMenu              *ide_application_get_menu_by_id           (IdeApplication       *self,
+                                                              const gchar          *id);
+gboolean            ide_application_open_project             (IdeApplication       *self,
+                                                              GFile                *file);
 
 G_END_DECLS
 
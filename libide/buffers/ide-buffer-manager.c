@@ -388,7 +388,7 @@ ide_buffer_manager_add_buffer (IdeBufferManager *self,
   if (self->auto_save)
     register_auto_save (self, buffer);
 
-  gtk_source_completion_words_register (self->word_completion, GTK_TEXT_BUFFER (buffer));
+  _ide_completion_words_add_buffer (IDE_COMPLETION_WORDS (self->word_completion), buffer);
 
   g_signal_connect_object (buffer,
                            "changed",
@@ -440,7 +440,7 @@ ide_buffer_manager_remove_buffer (IdeBufferManager *self,
   unsaved_files = ide_context_get_unsaved_files (context);
   ide_unsaved_files_remove (unsaved_files, gfile);
 
-  gtk_source_completion_words_unregister (self->word_completion, GTK_TEXT_BUFFER (buffer));
+  _ide_completion_words_remove_buffer (IDE_COMPLETION_WORDS (self->word_completion), buffer);
 
   unregister_auto_save (self, buffer);
 
@@ -0,0 +1,916 @@
+/* ide-buffer-snapshot.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-buffer-snapshot"
+
+#include <string.h>
+
+#include "buffers/ide-buffer-snapshot.h"
+
+/*
+ * IdeBufferSnapshot is an immutable copy of the contents of an IdeBuffer.
+ *
+ * The text is stored in a rope, which is a balanced (AVL) tree whose leaves
+ * contain chunks of up to LEAF_MAX bytes. Nodes are never modified once
+ * created, so an edit creates a new root by copying the path to the edited
+ * leaves and sharing everything else with the previous snapshot. This makes
+ * updating the snapshot from GtkTextBuffer::insert-text and
+ * GtkTextBuffer::delete-range cheap, and handing out a snapshot is just a
+ * reference count increment.
+ *
+ * Each node caches the number of bytes, characters and line breaks below
+ * it, so converting between character offsets (as used by GtkTextIter),
+ * byte offsets and lines is O(log n).
+ *
+ * Lines are terminated like in GtkTextBuffer, by "\n", "\r", "\r\n" or one of
+ * the Unicode line and paragraph separators. Edits may leave "\r\n" split
+ * across two leaves, in which case each half is counted by its own leaf and
+ * the parent subtracts one. The starts_with_lf and ends_with_cr bits let it
+ * detect this.
+ *
+ * Since snapshots are immutable they may be used from any thread.
+ */
+
+#define LEAF_MAX 1024
+
+typedef struct _RopeNode RopeNode;
+
+struct _RopeNode
+{
+  volatile gint  ref_count;
+  /* Leaves have a height of 1 */
+  guint          height;
+  gsize          len;
+  gsize          n_chars;
+  gsize          n_lines;
+  guint          starts_with_lf : 1;
+  guint          ends_with_cr : 1;
+  RopeNode      *left;
+  RopeNode      *right;
+  gchar          data[];
+};
+
+struct _IdeBufferSnapshot
+{
+  volatile gint  ref_count;
+  RopeNode      *root;
+
+  /* The full contents, created when first requested */
+  GMutex         mutex;
+  GBytes        *bytes;
+
+  guint          implicit_trailing_newline : 1;
+};
+
+G_DEFINE_BOXED_TYPE (IdeBufferSnapshot, ide_buffer_snapshot,
+                     ide_buffer_snapshot_ref, ide_buffer_snapshot_unref)
+
+/*
+ * Finds the first line break in @text, as understood by GtkTextBuffer, and
+ * returns a pointer just past it, or %NULL.
+ */
+static const gchar *
+find_line_break (const gchar *text,
+                 const gchar *end)
+{
+  for (; text < end; text++)
+    {
+      switch (*text)
+        {
+        case '\n':
+          return text + 1;
+
+        case '\r':
+          if (text + 1 < end && text[1] == '\n')
+            return text + 2;
+          return text + 1;
+
+        /* U+2028 LINE SEPARATOR and U+2029 PARAGRAPH SEPARATOR */
+        case '\xe2':
+          if (end - text >= 3 &&
+              text[1] == '\x80' &&
+              (text[2] == '\xa8' || text[2] == '\xa9'))
+            return text + 3;
+          break;
+
+        default:
+          break;
+        }
+    }
+
+  return NULL;
+}
+
+static inline guint
+rope_height (RopeNode *node)
+{
+  return node ? node->height : 0;
+}
+
+static inline gboolean
+rope_is_leaf (RopeNode *node)
+{
+  return node->height == 1;
+}
+
+/* Whether a "\r\n" is split between @left and @right */
+static inline guint
+rope_split_crlf (RopeNode *left,
+                 RopeNode *right)
+{
+  return left->ends_with_cr && right->starts_with_lf;
+}
+
+static RopeNode *
+rope_ref (RopeNode *node)
+{
+  g_assert (node != NULL);
+  g_assert (node->ref_count > 0);
+
+  g_atomic_int_inc (&node->ref_count);
+
+  return node;
+}
+
+static void
+rope_unref (RopeNode *node)
+{
+  if (node == NULL)
+    return;
+
+  g_assert (node->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&node->ref_count))
+    {
+      if (!rope_is_leaf (node))
+        {
+          rope_unref (node->left);
+          rope_unref (node->right);
+        }
+
+      g_free (node);
+    }
+}
+
+static RopeNode *
+rope_leaf_new2 (const gchar *text1,
+                gsize        len1,
+                const gchar *text2,
+                gsize        len2)
+{
+  RopeNode *node;
+  const gchar *iter;
+  const gchar *end;
+
+  if (len1 + len2 == 0)
+    return NULL;
+
+  node = g_malloc (sizeof *node + len1 + len2);
+  node->ref_count = 1;
+  node->height = 1;
+  node->len = len1 + len2;
+  node->left = NULL;
+  node->right = NULL;
+
+  memcpy (node->data, text1, len1);
+  if (len2 > 0)
+    memcpy (node->data + len1, text2, len2);
+
+  node->n_chars = g_utf8_strlen (node->data, node->len);
+  node->n_lines = 0;
+  node->starts_with_lf = node->data[0] == '\n';
+  node->ends_with_cr = node->data[node->len - 1] == '\r';
+
+  end = node->data + node->len;
+  for (iter = node->data; NULL != (iter = find_line_break (iter, end)); )
+    node->n_lines++;
+
+  return node;
+}
+
+static inline RopeNode *
+rope_leaf_new (const gchar *text,
+               gsize        len)
+{
+  return rope_leaf_new2 (text, len, NULL, 0);
+}
+
+/* Takes a new reference to both @left and @right */
+static RopeNode *
+rope_node_new (RopeNode *left,
+               RopeNode *right)
+{
+  RopeNode *node;
+
+  g_assert (left != NULL);
+  g_assert (right != NULL);
+
+  node = g_malloc (sizeof *node);
+  node->ref_count = 1;
+  node->height = MAX (left->height, right->height) + 1;
+  node->len = left->len + right->len;
+  node->n_chars = left->n_chars + right->n_chars;
+  node->n_lines = left->n_lines + right->n_lines - rope_split_crlf (left, right);
+  node->starts_with_lf = left->starts_with_lf;
+  node->ends_with_cr = right->ends_with_cr;
+  node->left = rope_ref (left);
+  node->right = rope_ref (right);
+
+  return node;
+}
+
+/*
+ * Creates a node containing @left and @right, rotating if their heights
+ * differ by more than one. AVL join guarantees that they never differ by
+ * more than two.
+ */
+static RopeNode *
+rope_balance (RopeNode *left,
+              RopeNode *right)
+{
+  RopeNode *a;
+  RopeNode *b;
+  RopeNode *ret;
+  gint diff;
+
+  g_assert (left != NULL);
+  g_assert (right != NULL);
+
+  diff = (gint)left->height - (gint)right->height;
+
+  if (diff > 1)
+    {
+      if (rope_height (left->left) >= rope_height (left->right))
+        {
+          a = rope_node_new (left->right, right);
+          ret = rope_node_new (left->left, a);
+          rope_unref (a);
+        }
+      else
+        {
+          a = rope_node_new (left->left, left->right->left);
+          b = rope_node_new (left->right->right, right);
+          ret = rope_node_new (a, b);
+          rope_unref (a);
+          rope_unref (b);
+        }
+    }
+  else if (diff < -1)
+    {
+      if (rope_height (right->right) >= rope_height (right->left))
+        {
+          a = rope_node_new (left, right->left);
+          ret = rope_node_new (a, right->right);
+          rope_unref (a);
+        }
+      else
+        {
+          a = rope_node_new (left, right->left->left);
+          b = rope_node_new (right->left->right, right->right);
+          ret = rope_node_new (a, b);
+          rope_unref (a);
+          rope_unref (b);
+        }
+    }
+  else
+    {
+      ret = rope_node_new (left, right);
+    }
+
+  return ret;
+}
+
+/*
+ * Concatenates @left and @right, either of which may be %NULL. Small
+ * leaves at the seam are merged so that typing does not leave behind a
+ * leaf per keystroke.
+ */
+static RopeNode *
+rope_join (RopeNode *left,
+           RopeNode *right)
+{
+  RopeNode *tmp;
+  RopeNode *ret;
+
+  if (left == NULL)
+    return right ? rope_ref (right) : NULL;
+
+  if (right == NULL)
+    return rope_ref (left);
+
+  if (rope_is_leaf (left) && rope_is_leaf (right) && left->len + right->len <= LEAF_MAX)
+    return rope_leaf_new2 (left->data, left->len, right->data, right->len);
+
+  if (left->height > right->height + 1)
+    {
+      tmp = rope_join (left->right, right);
+      ret = rope_balance (left->left, tmp);
+      rope_unref (tmp);
+      return ret;
+    }
+
+  if (right->height > left->height + 1)
+    {
+      tmp = rope_join (left, right->left);
+      ret = rope_balance (tmp, right->right);
+      rope_unref (tmp);
+      return ret;
+    }
+
+  if (rope_is_leaf (right) && !rope_is_leaf (left) &&
+      rope_is_leaf (left->right) && left->right->len + right->len <= LEAF_MAX)
+    {
+      tmp = rope_join (left->right, right);
+      ret = rope_balance (left->left, tmp);
+      rope_unref (tmp);
+      return ret;
+    }
+
+  if (rope_is_leaf (left) && !rope_is_leaf (right) &&
+      rope_is_leaf (right->left) && left->len + right->left->len <= LEAF_MAX)
+    {
+      tmp = rope_join (left, right->left);
+      ret = rope_balance (tmp, right->right);
+      rope_unref (tmp);
+      return ret;
+    }
+
+  return rope_node_new (left, right);
+}
+
+/*
+ * Splits @node at the character @offset. @left and @right are set to new
+ * references, or %NULL if they are empty.
+ */
+static void
+rope_split (RopeNode  *node,
+            gsize      offset,
+            RopeNode **left,
+            RopeNode **right)
+{
+  RopeNode *a = NULL;
+  RopeNode *b = NULL;
+
+  if (node == NULL)
+    {
+      *left = NULL;
+      *right = NULL;
+      return;
+    }
+
+  if (offset == 0)
+    {
+      *left = NULL;
+      *right = rope_ref (node);
+      return;
+    }
+
+  if (offset >= node->n_chars)
+    {
+      *left = rope_ref (node);
+      *right = NULL;
+      return;
+    }
+
+  if (rope_is_leaf (node))
+    {
+      const gchar *pos = g_utf8_offset_to_pointer (node->data, offset);
+      gsize n_bytes = pos - node->data;
+
+      *left = rope_leaf_new (node->data, n_bytes);
+      *right = rope_leaf_new (pos, node->len - n_bytes);
+      return;
+    }
+
+  if (offset <= node->left->n_chars)
+    {
+      rope_split (node->left, offset, &a, &b);
+      *left = a;
+      *right = rope_join (b, node->right);
+      rope_unref (b);
+    }
+  else
+    {
+      rope_split (node->right, offset - node->left->n_chars, &a, &b);
+      *left = rope_join (node->left, a);
+      *right = b;
+      rope_unref (a);
+    }
+}
+
+static RopeNode *
+rope_build (RopeNode **leaves,
+            guint      n_leaves)
+{
+  RopeNode *left;
+  RopeNode *right;
+  RopeNode *ret;
+  guint half;
+
+  g_assert (n_leaves > 0);
+
+  if (n_leaves == 1)
+    return rope_ref (leaves[0]);
+
+  half = n_leaves / 2;
+  left = rope_build (leaves, half);
+  right = rope_build (leaves + half, n_leaves - half);
+  ret = rope_node_new (left, right);
+  rope_unref (left);
+  rope_unref (right);
+
+  return ret;
+}
+
+/* Creates a balanced rope containing @text, split at character boundaries */
+static RopeNode *
+rope_new_from_text (const gchar *text,
+                    gsize        len)
+{
+  g_autoptr(GPtrArray) leaves = NULL;
+  const gchar *end = text + len;
+
+  if (len == 0)
+    return NULL;
+
+  if (len <= LEAF_MAX)
+    return rope_leaf_new (text, len);
+
+  leaves = g_ptr_array_new_with_free_func ((GDestroyNotify)rope_unref);
+
+  while (text < end)
+    {
+      const gchar *chunk_end = text + MIN (LEAF_MAX, (gsize)(end - text));
+
+      if (chunk_end < end)
+        {
+          const gchar *prev = g_utf8_find_prev_char (text, chunk_end + 1);
+
+          if (prev != NULL && prev > text)
+            chunk_end = prev;
+        }
+
+      g_ptr_array_add (leaves, rope_leaf_new (text, chunk_end - text));
+      text = chunk_end;
+    }
+
+  return rope_build ((RopeNode **)leaves->pdata, leaves->len);
+}
+
+static gboolean
+rope_foreach_chunk (RopeNode                   *node,
+                    gsize                       begin,
+                    gsize                       end,
+                    IdeBufferSnapshotChunkFunc  func,
+                    gpointer                    user_data)
+{
+  g_assert (node != NULL);
+  g_assert (begin < end);
+  g_assert (end <= node->len);
+
+  if (rope_is_leaf (node))
+    return func (node->data + begin, end - begin, user_data);
+
+  if (begin < node->left->len &&
+      rope_foreach_chunk (node->left, begin, MIN (end, node->left->len), func, user_data))
+    return TRUE;
+
+  if (end > node->left->len)
+    return rope_foreach_chunk (node->right,
+                               begin > node->left->len ? begin - node->left->len : 0,
+                               end - node->left->len,
+                               func,
+                               user_data);
+
+  return FALSE;
+}
+
+IdeBufferSnapshot *
+_ide_buffer_snapshot_new (gboolean implicit_trailing_newline)
+{
+  IdeBufferSnapshot *self;
+
+  self = g_slice_new0 (IdeBufferSnapshot);
+  self->ref_count = 1;
+  self->implicit_trailing_newline = !!implicit_trailing_newline;
+  g_mutex_init (&self->mutex);
+
+  return self;
+}
+
+static IdeBufferSnapshot *
+_ide_buffer_snapshot_new_for_root (RopeNode *root,
+                                   gboolean  implicit_trailing_newline)
+{
+  IdeBufferSnapshot *self;
+
+  self = _ide_buffer_snapshot_new (implicit_trailing_newline);
+  self->root = root;
+
+  return self;
+}
+
+/**
+ * _ide_buffer_snapshot_insert:
+ * @self: An #IdeBufferSnapshot.
+ * @offset: the character offset to insert at
+ * @text: the text to insert
+ * @len: the length of @text in bytes
+ *
+ * Creates a new snapshot with @text inserted at @offset, sharing the
+ * unchanged parts of @self.
+ *
+ * Returns: (transfer full): A new #IdeBufferSnapshot.
+ */
+IdeBufferSnapshot *
+_ide_buffer_snapshot_insert (IdeBufferSnapshot *self,
+                             gsize              offset,
+                             const gchar       *text,
+                             gsize              len)
+{
+  RopeNode *left;
+  RopeNode *right;
+  RopeNode *middle;
+  RopeNode *tmp;
+  RopeNode *root;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (text != NULL || len == 0, NULL);
+
+  rope_split (self->root, offset, &left, &right);
+  middle = rope_new_from_text (text, len);
+  tmp = rope_join (left, middle);
+  root = rope_join (tmp, right);
+
+  rope_unref (left);
+  rope_unref (middle);
+  rope_unref (right);
+  rope_unref (tmp);
+
+  return _ide_buffer_snapshot_new_for_root (root, self->implicit_trailing_newline);
+}
+
+/**
+ * _ide_buffer_snapshot_delete:
+ * @self: An #IdeBufferSnapshot.
+ * @begin: the character offset of the start of the range
+ * @end: the character offset of the end of the range
+ *
+ * Creates a new snapshot with the text between @begin and @end removed,
+ * sharing the unchanged parts of @self.
+ *
+ * Returns: (transfer full): A new #IdeBufferSnapshot.
+ */
+IdeBufferSnapshot *
+_ide_buffer_snapshot_delete (IdeBufferSnapshot *self,
+                             gsize              begin,
+                             gsize              end)
+{
+  RopeNode *left;
+  RopeNode *middle;
+  RopeNode *right;
+  RopeNode *root;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (begin <= end, NULL);
+
+  rope_split (self->root, end, &middle, &right);
+  rope_unref (middle);
+  middle = NULL;
+
+  rope_split (self->root, begin, &left, &middle);
+  rope_unref (middle);
+
+  root = rope_join (left, right);
+
+  rope_unref (left);
+  rope_unref (right);
+
+  return _ide_buffer_snapshot_new_for_root (root, self->implicit_trailing_newline);
+}
+
+IdeBufferSnapshot *
+_ide_buffer_snapshot_set_implicit_trailing_newline (IdeBufferSnapshot *self,
+                                                    gboolean           implicit_trailing_newline)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return _ide_buffer_snapshot_new_for_root (self->root ? rope_ref (self->root) : NULL,
+                                            implicit_trailing_newline);
+}
+
+IdeBufferSnapshot *
+ide_buffer_snapshot_ref (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+ide_buffer_snapshot_unref (IdeBufferSnapshot *self)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_clear_pointer (&self->root, rope_unref);
+      g_clear_pointer (&self->bytes, g_bytes_unref);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (IdeBufferSnapshot, self);
+    }
+}
+
+/**
+ * ide_buffer_snapshot_get_length:
+ * @self: An #IdeBufferSnapshot.
+ *
+ * Gets the length of the snapshot in bytes. Like ide_buffer_get_content(),
+ * this includes the trailing newline if the buffer has
+ * #GtkSourceBuffer:implicit-trailing-newline set.
+ */
+gsize
+ide_buffer_snapshot_get_length (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self, 0);
+
+  return (self->root ? self->root->len : 0) + self->implicit_trailing_newline;
+}
+
+/**
+ * ide_buffer_snapshot_get_line_count:
+ * @self: An #IdeBufferSnapshot.
+ *
+ * Gets the number of lines in the snapshot, which matches
+ * gtk_text_buffer_get_line_count() for the buffer at the time the snapshot
+ * was taken. Like #GtkTextBuffer, "\n", "\r", "\r\n", U+2028 and U+2029 all
+ * end a line.
+ */
+guint
+ide_buffer_snapshot_get_line_count (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self, 0);
+
+  return (self->root ? self->root->n_lines : 0) + 1;
+}
+
+/**
+ * ide_buffer_snapshot_get_line_offset:
+ * @self: An #IdeBufferSnapshot.
+ * @line: the line number, starting from 0
+ * @offset: (out): a location for the offset
+ *
+ * Gets the byte offset of the beginning of @line, which is just past the
+ * line terminator of the previous line.
+ *
+ * Returns: %TRUE if @line exists and @offset was set.
+ */
+gboolean
+ide_buffer_snapshot_get_line_offset (IdeBufferSnapshot *self,
+                                     guint              line,
+                                     gsize             *offset)
+{
+  RopeNode *node;
+  const gchar *iter;
+  const gchar *end;
+  gsize ret = 0;
+
+  g_return_val_if_fail (self, FALSE);
+  g_return_val_if_fail (offset, FALSE);
+
+  if (line == 0)
+    {
+      *offset = 0;
+      return TRUE;
+    }
+
+  node = self->root;
+
+  if (node == NULL || line > node->n_lines)
+    return FALSE;
+
+  /* Find the position just after the line'th line break */
+  while (!rope_is_leaf (node))
+    {
+      guint crlf = rope_split_crlf (node->left, node->right);
+
+      if (line < node->left->n_lines || (line == node->left->n_lines && !crlf))
+        {
+          node = node->left;
+        }
+      else if (line == node->left->n_lines)
+        {
+          /* The line ends with the "\n" starting the right side */
+          *offset = ret + node->left->len + 1;
+          return TRUE;
+        }
+      else
+        {
+          /* Skip the "\n" that the right side counts on its own */
+          line = line - node->left->n_lines + crlf;
+          ret += node->left->len;
+          node = node->right;
+        }
+    }
+
+  end = node->data + node->len;
+
+  for (iter = node->data; line > 0; line--)
+    {
+      iter = find_line_break (iter, end);
+      g_assert (iter != NULL);
+    }
+
+  *offset = ret + (iter - node->data);
+
+  return TRUE;
+}
+
+/**
+ * ide_buffer_snapshot_get_line_at_offset:
+ * @self: An #IdeBufferSnapshot.
+ * @offset: a byte offset within the snapshot
+ *
+ * Gets the line containing the byte at @offset.
+ *
+ * Returns: the line number, starting from 0.
+ */
+guint
+ide_buffer_snapshot_get_line_at_offset (IdeBufferSnapshot *self,
+                                        gsize              offset)
+{
+  RopeNode *node;
+  const gchar *iter;
+  const gchar *end;
+  guint line = 0;
+
+  g_return_val_if_fail (self, 0);
+
+  if (NULL == (node = self->root))
+    return 0;
+
+  if (offset >= node->len)
+    return node->n_lines;
+
+  while (!rope_is_leaf (node))
+    {
+      if (offset < node->left->len)
+        {
+          node = node->left;
+        }
+      else
+        {
+          /* A split "\r\n" only ends the line once the "\n" is passed */
+          line += node->left->n_lines - rope_split_crlf (node->left, node->right);
+          offset -= node->left->len;
+          node = node->right;
+        }
+    }
+
+  end = node->data + node->len;
+
+  for (iter = node->data;
+       NULL != (iter = find_line_break (iter, end)) && iter <= node->data + offset; )
+    line++;
+
+  return line;
+}
+
+/**
+ * ide_buffer_snapshot_foreach_chunk:
+ * @self: An #IdeBufferSnapshot.
+ * @begin: the byte offset to start from
+ * @end: the byte offset to stop at, or -1 for the end of the snapshot
+ * @func: (scope call): a function to call for each chunk
+ * @user_data: closure data for @func
+ *
+ * Calls @func for each chunk of text between @begin and @end, in order,
+ * until @func returns %TRUE. This allows iterating through the contents
+ * without copying them.
+ */
+void
+ide_buffer_snapshot_foreach_chunk (IdeBufferSnapshot          *self,
+                                   gsize                       begin,
+                                   gsize                       end,
+                                   IdeBufferSnapshotChunkFunc  func,
+                                   gpointer                    user_data)
+{
+  gsize root_len;
+
+  g_return_if_fail (self);
+  g_return_if_fail (func);
+
+  root_len = self->root ? self->root->len : 0;
+  end = MIN (end, ide_buffer_snapshot_get_length (self));
+
+  if (begin >= end)
+    return;
+
+  if (begin < root_len &&
+      rope_foreach_chunk (self->root, begin, MIN (end, root_len), func, user_data))
+    return;
+
+  if (end > root_len)
+    func ("\n", 1, user_data);
+}
+
+static gboolean
+append_chunk (const gchar *text,
+              gsize        len,
+              gpointer     user_data)
+{
+  gchar **pos = user_data;
+
+  memcpy (*pos, text, len);
+  *pos += len;
+
+  return FALSE;
+}
+
+/**
+ * ide_buffer_snapshot_get_text:
+ * @self: An #IdeBufferSnapshot.
+ * @begin: the byte offset to start from
+ * @end: the byte offset to stop at, or -1 for the end of the snapshot
+ *
+ * Copies the text between @begin and @end.
+ *
+ * Returns: (transfer full): A newly allocated string.
+ */
+gchar *
+ide_buffer_snapshot_get_text (IdeBufferSnapshot *self,
+                              gsize              begin,
+                              gsize              end)
+{
+  gchar *ret;
+  gchar *pos;
+
+  g_return_val_if_fail (self, NULL);
+
+  end = MIN (end, ide_buffer_snapshot_get_length (self));
+  begin = MIN (begin, end);
+
+  pos = ret = g_malloc (end - begin + 1);
+  ide_buffer_snapshot_foreach_chunk (self, begin, end, append_chunk, &pos);
+  *pos = '\0';
+
+  return ret;
+}
+
+/**
+ * ide_buffer_snapshot_get_bytes:
+ * @self: An #IdeBufferSnapshot.
+ *
+ * Gets the contents of the snapshot as a #GBytes. The contents are copied
+ * the first time this is called, so prefer
+ * ide_buffer_snapshot_foreach_chunk() when you do not need them to be
+ * contiguous.
+ *
+ * Like ide_buffer_get_content(), the data is followed by a \0 which is not
+ * included in the length of the #GBytes.
+ *
+ * This function is thread-safe.
+ *
+ * Returns: (transfer full): A #GBytes.
+ */
+GBytes *
+ide_buffer_snapshot_get_bytes (IdeBufferSnapshot *self)
+{
+  GBytes *ret;
+
+  g_return_val_if_fail (self, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->bytes == NULL)
+    {
+      gsize len = ide_buffer_snapshot_get_length (self);
+
+      self->bytes = g_bytes_new_take (ide_buffer_snapshot_get_text (self, 0, len), len);
+    }
+
+  ret = g_bytes_ref (self->bytes);
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
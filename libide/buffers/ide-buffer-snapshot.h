@@ -0,0 +1,66 @@
+/* ide-buffer-snapshot.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_BUFFER_SNAPSHOT_H
+#define IDE_BUFFER_SNAPSHOT_H
+
+#include <gio/gio.h>
+
+#include "ide-types.h"
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_BUFFER_SNAPSHOT (ide_buffer_snapshot_get_type())
+
+/**
+ * IdeBufferSnapshotChunkFunc:
+ * @text: the text of the chunk, which is not \0 terminated
+ * @len: the length of @text in bytes
+ * @user_data: closure data
+ *
+ * Returns: %TRUE to stop iterating.
+ */
+typedef gboolean (*IdeBufferSnapshotChunkFunc) (const gchar *text,
+                                                gsize        len,
+                                                gpointer     user_data);
+
+GType              ide_buffer_snapshot_get_type           (void);
+IdeBufferSnapshot *ide_buffer_snapshot_ref                (IdeBufferSnapshot          *self);
+void               ide_buffer_snapshot_unref              (IdeBufferSnapshot          *self);
+gsize              ide_buffer_snapshot_get_length         (IdeBufferSnapshot          *self);
+guint              ide_buffer_snapshot_get_line_count     (IdeBufferSnapshot          *self);
+gboolean           ide_buffer_snapshot_get_line_offset    (IdeBufferSnapshot          *self,
+                                                           guint                       line,
+                                                           gsize                      *offset);
+guint              ide_buffer_snapshot_get_line_at_offset (IdeBufferSnapshot          *self,
+                                                           gsize                       offset);
+void               ide_buffer_snapshot_foreach_chunk      (IdeBufferSnapshot          *self,
+                                                           gsize                       begin,
+                                                           gsize                       end,
+                                                           IdeBufferSnapshotChunkFunc  func,
+                                                           gpointer                    user_data);
+gchar             *ide_buffer_snapshot_get_text           (IdeBufferSnapshot          *self,
+                                                           gsize                       begin,
+                                                           gsize                       end);
+GBytes            *ide_buffer_snapshot_get_bytes          (IdeBufferSnapshot          *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeBufferSnapshot, ide_buffer_snapshot_unref)
+
+G_END_DECLS
+
+#endif /* IDE_BUFFER_SNAPSHOT_H */
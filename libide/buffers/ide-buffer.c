@@ -27,10 +27,12 @@
 #include "ide-internal.h"
 
 #include "buffers/ide-buffer-change-monitor.h"
+#include "buffers/ide-buffer-snapshot.h"
 #include "buffers/ide-buffer.h"
 #include "buffers/ide-unsaved-files.h"
 #include "diagnostics/ide-diagnostic.h"
 #include "diagnostics/ide-diagnostics.h"
+#include "diagnostics/ide-diagnostics-index.h"
 #include "diagnostics/ide-diagnostics-manager.h"
 #include "diagnostics/ide-source-location.h"
 #include "diagnostics/ide-source-range.h"
@@ -69,10 +71,11 @@ typedef struct
 {
   IdeContext             *context;
   IdeDiagnostics         *diagnostics;
-  GHashTable             *diagnostics_line_cache;
+  IdeDiagnosticsIndex    *diagnostics_index;
   EggSignalGroup         *diagnostics_manager_signals;
   IdeFile                *file;
   GBytes                 *content;
+  IdeBufferSnapshot      *snapshot;
   IdeBufferChangeMonitor *change_monitor;
   IdeHighlightEngine     *highlight_engine;
   IdeExtensionAdapter    *rename_provider_adapter;
@@ -92,6 +95,7 @@ typedef struct
   GTimeVal                mtime;
 
   gint                    hold_count;
+  gint                    n_mapped_views;
   guint                   reclamation_handler;
 
   gsize                   change_count;
@@ -252,15 +256,47 @@ ide_buffer_set_context (IdeBuffer  *self,
   egg_signal_group_set_target (priv->diagnostics_manager_signals, diagnostics_manager);
 }
 
+/*
+ * Publishes the current snapshot to IdeUnsavedFiles, unless that was
+ * already done since the last change. The bytes are created by the snapshot,
+ * which shares them with every other consumer of the same snapshot.
+ */
+static void
+ide_buffer_update_unsaved_files (IdeBuffer *self)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+  IdeUnsavedFiles *unsaved_files;
+  GFile *gfile = NULL;
+
+  g_assert (IDE_IS_BUFFER (self));
+
+  if (priv->content != NULL)
+    return;
+
+  /*
+   * The snapshot includes the implicit trailing newline, and the bytes
+   * it creates are followed by a \0 that is not included in the length.
+   * This way, compilers that don't want to see the trailing \0 can ignore
+   * that data, but compilers that rely on valid C strings can also rely
+   * on the buffer to be valid.
+   */
+  priv->content = ide_buffer_snapshot_get_bytes (priv->snapshot);
+
+  if ((priv->context != NULL) &&
+      (priv->file != NULL) &&
+      (gfile = ide_file_get_file (priv->file)))
+    {
+      unsaved_files = ide_context_get_unsaved_files (priv->context);
+      ide_unsaved_files_update (unsaved_files, gfile, priv->content);
+    }
+}
+
 void
 ide_buffer_sync_to_unsaved_files (IdeBuffer *self)
 {
-  GBytes *content;
-
   g_assert (IDE_IS_BUFFER (self));
 
-  if ((content = ide_buffer_get_content (self)))
-    g_bytes_unref (content);
+  ide_buffer_update_unsaved_files (self);
 }
 
 static void
@@ -275,8 +311,8 @@ ide_buffer_clear_diagnostics (IdeBuffer *self)
 
   g_assert (IDE_IS_BUFFER (self));
 
-  if (priv->diagnostics_line_cache != NULL)
-    g_hash_table_remove_all (priv->diagnostics_line_cache);
+  if (priv->diagnostics_index != NULL)
+    ide_diagnostics_index_clear (priv->diagnostics_index);
 
   gtk_text_buffer_get_bounds (buffer, &begin, &end);
 
@@ -297,38 +333,28 @@ ide_buffer_clear_diagnostics (IdeBuffer *self)
 
 static void
 ide_buffer_cache_diagnostic_line (IdeBuffer             *self,
+                                  IdeDiagnostic         *diagnostic,
                                   IdeSourceLocation     *begin,
                                   IdeSourceLocation     *end,
                                   IdeDiagnosticSeverity  severity)
 {
   IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
-  gpointer new_value = GINT_TO_POINTER (severity);
-  gsize line_begin;
-  gsize line_end;
-  gsize i;
 
   g_assert (IDE_IS_BUFFER (self));
+  g_assert (diagnostic);
   g_assert (begin);
   g_assert (end);
 
-  if (!priv->diagnostics_line_cache)
+  if (!priv->diagnostics_index)
     return;
 
-  line_begin = MIN (ide_source_location_get_line (begin),
-                    ide_source_location_get_line (end));
-  line_end = MAX (ide_source_location_get_line (begin),
-                  ide_source_location_get_line (end));
-
-  for (i = line_begin; i <= line_end; i++)
-    {
-      gpointer old_value;
-      gpointer key = GINT_TO_POINTER (i);
-
-      old_value = g_hash_table_lookup (priv->diagnostics_line_cache, key);
-
-      if (new_value > old_value)
-        g_hash_table_replace (priv->diagnostics_line_cache, key, new_value);
-    }
+  ide_diagnostics_index_add (priv->diagnostics_index,
+                             ide_source_location_get_line (begin),
+                             ide_source_location_get_line_offset (begin),
+                             ide_source_location_get_line (end),
+                             ide_source_location_get_line_offset (end),
+                             severity,
+                             diagnostic);
 }
 
 static void
@@ -382,7 +408,7 @@ ide_buffer_update_diagnostic (IdeBuffer     *self,
       if (file && priv->file && !ide_file_equal (file, priv->file))
         return;
 
-      ide_buffer_cache_diagnostic_line (self, location, location, severity);
+      ide_buffer_cache_diagnostic_line (self, diagnostic, location, location, severity);
 
       ide_buffer_get_iter_at_location (self, &iter1, location);
       gtk_text_iter_assign (&iter2, &iter1);
@@ -419,7 +445,7 @@ ide_buffer_update_diagnostic (IdeBuffer     *self,
       ide_buffer_get_iter_at_location (self, &iter1, begin);
       ide_buffer_get_iter_at_location (self, &iter2, end);
 
-      ide_buffer_cache_diagnostic_line (self, begin, end, severity);
+      ide_buffer_cache_diagnostic_line (self, diagnostic, begin, end, severity);
 
       if (gtk_text_iter_equal (&iter1, &iter2))
         {
@@ -641,11 +667,50 @@ ide_buffer_changed (GtkTextBuffer *buffer)
   g_clear_pointer (&priv->content, g_bytes_unref);
 }
 
+/* Replaces the current snapshot with @snapshot, taking ownership of it */
+static void
+ide_buffer_take_snapshot (IdeBuffer         *self,
+                          IdeBufferSnapshot *snapshot)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (snapshot != NULL);
+
+  g_clear_pointer (&priv->snapshot, ide_buffer_snapshot_unref);
+  priv->snapshot = snapshot;
+}
+
+/*
+ * The snapshot is updated before chaining up, since GtkTextBuffer emits
+ * GtkTextBuffer::changed from its default handlers and the handlers of
+ * that signal may request the content.
+ */
+static void
+ide_buffer_insert_into_snapshot (IdeBuffer   *self,
+                                 gsize        offset,
+                                 const gchar *text,
+                                 gsize        len)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_assert (IDE_IS_BUFFER (self));
+
+  ide_buffer_take_snapshot (self, _ide_buffer_snapshot_insert (priv->snapshot, offset, text, len));
+}
+
 static void
 ide_buffer_delete_range (GtkTextBuffer *buffer,
                          GtkTextIter   *start,
                          GtkTextIter   *end)
 {
+  IdeBuffer *self = (IdeBuffer *)buffer;
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+  gint begin_char;
+  gint end_char;
+  guint begin_line;
+  guint end_line;
+
   IDE_ENTRY;
 
 #ifdef IDE_ENABLE_TRACE
@@ -664,6 +729,24 @@ ide_buffer_delete_range (GtkTextBuffer *buffer,
   }
 #endif
 
+  begin_char = gtk_text_iter_get_offset (start);
+  end_char = gtk_text_iter_get_offset (end);
+
+  ide_buffer_take_snapshot (self,
+                            _ide_buffer_snapshot_delete (priv->snapshot,
+                                                         MIN (begin_char, end_char),
+                                                         MAX (begin_char, end_char)));
+
+  /*
+   * Keep the diagnostics on the lines they belong to until the diagnostics
+   * are updated for the new contents.
+   */
+  begin_line = gtk_text_iter_get_line (start);
+  end_line = gtk_text_iter_get_line (end);
+  ide_diagnostics_index_remove_lines (priv->diagnostics_index,
+                                      MIN (begin_line, end_line),
+                                      MAX (begin_line, end_line) - MIN (begin_line, end_line));
+
   GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->delete_range (buffer, start, end);
 
   ide_buffer_emit_cursor_moved (IDE_BUFFER (buffer));
@@ -677,7 +760,11 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
                         const gchar   *text,
                         gint           len)
 {
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (IDE_BUFFER (buffer));
   gboolean check_modeline = FALSE;
+  gboolean starts_line;
+  gint line;
+  gint offset;
 
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (location);
@@ -693,14 +780,92 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
       ((text [0] == '\n') || ((len > 1) && (strchr (text, '\n') != NULL))))
     check_modeline = TRUE;
 
+  offset = gtk_text_iter_get_offset (location);
+  ide_buffer_insert_into_snapshot (IDE_BUFFER (buffer), offset, text, len < 0 ? strlen (text) : len);
+
+  line = gtk_text_iter_get_line (location);
+  starts_line = gtk_text_iter_starts_line (location);
+
   GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_text (buffer, location, text, len);
 
+  /*
+   * The location now points to the end of the inserted text. Text inserted
+   * at the start of a line pushes that line down along with its diagnostics,
+   * otherwise only the following lines move.
+   */
+  if (gtk_text_iter_get_line (location) > line)
+    ide_diagnostics_index_insert_lines (priv->diagnostics_index,
+                                        starts_line ? line : line + 1,
+                                        gtk_text_iter_get_line (location) - line);
+
   ide_buffer_emit_cursor_moved (IDE_BUFFER (buffer));
 
   if (check_modeline)
     ide_buffer_do_modeline (IDE_BUFFER (buffer));
 }
 
+/*
+ * Pixbufs and child anchors take up a single character in the buffer, which
+ * gtk_text_buffer_get_text() represents with U+FFFC. Mirror that in the
+ * snapshot so that its offsets stay in sync with the buffer.
+ */
+#define OBJECT_REPLACEMENT_CHAR "\xEF\xBF\xBC"
+
+static void
+ide_buffer_insert_pixbuf (GtkTextBuffer *buffer,
+                          GtkTextIter   *location,
+                          GdkPixbuf     *pixbuf)
+{
+  gint offset;
+
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (location);
+
+  offset = gtk_text_iter_get_offset (location);
+  ide_buffer_insert_into_snapshot (IDE_BUFFER (buffer), offset,
+                                   OBJECT_REPLACEMENT_CHAR,
+                                   strlen (OBJECT_REPLACEMENT_CHAR));
+
+  GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_pixbuf (buffer, location, pixbuf);
+}
+
+static void
+ide_buffer_insert_child_anchor (GtkTextBuffer      *buffer,
+                                GtkTextIter        *location,
+                                GtkTextChildAnchor *anchor)
+{
+  gint offset;
+
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (location);
+
+  offset = gtk_text_iter_get_offset (location);
+  ide_buffer_insert_into_snapshot (IDE_BUFFER (buffer), offset,
+                                   OBJECT_REPLACEMENT_CHAR,
+                                   strlen (OBJECT_REPLACEMENT_CHAR));
+
+  GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_child_anchor (buffer, location, anchor);
+}
+
+static void
+ide_buffer_notify_implicit_trailing_newline (IdeBuffer  *self,
+                                             GParamSpec *pspec,
+                                             gpointer    unused)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+  gboolean implicit_trailing_newline;
+
+  g_assert (IDE_IS_BUFFER (self));
+
+  implicit_trailing_newline = gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (self));
+  ide_buffer_take_snapshot (self,
+                            _ide_buffer_snapshot_set_implicit_trailing_newline (priv->snapshot,
+                                                                                implicit_trailing_newline));
+
+  /* The content includes the trailing newline, so it is no longer valid */
+  g_clear_pointer (&priv->content, g_bytes_unref);
+}
+
 static void
 ide_buffer_mark_set (GtkTextBuffer     *buffer,
                      const GtkTextIter *iter,
@@ -1219,7 +1384,7 @@ ide_buffer_dispose (GObject *object)
 
   egg_signal_group_set_target (priv->diagnostics_manager_signals, NULL);
 
-  g_clear_pointer (&priv->diagnostics_line_cache, g_hash_table_unref);
+  ide_diagnostics_index_clear (priv->diagnostics_index);
   g_clear_pointer (&priv->diagnostics, ide_diagnostics_unref);
   g_clear_pointer (&priv->content, g_bytes_unref);
   g_clear_pointer (&priv->title, g_free);
@@ -1256,6 +1421,8 @@ ide_buffer_finalize (GObject *object)
     }
 
   ide_clear_weak_pointer (&priv->context);
+  g_clear_pointer (&priv->snapshot, ide_buffer_snapshot_unref);
+  g_clear_pointer (&priv->diagnostics_index, ide_diagnostics_index_free);
 
   G_OBJECT_CLASS (ide_buffer_parent_class)->finalize (object);
 
@@ -1361,6 +1528,8 @@ ide_buffer_class_init (IdeBufferClass *klass)
   text_buffer_class->changed = ide_buffer_changed;
   text_buffer_class->delete_range = ide_buffer_delete_range;
   text_buffer_class->insert_text = ide_buffer_insert_text;
+  text_buffer_class->insert_pixbuf = ide_buffer_insert_pixbuf;
+  text_buffer_class->insert_child_anchor = ide_buffer_insert_child_anchor;
   text_buffer_class->mark_set = ide_buffer_mark_set;
 
   properties [PROP_BUSY] =
@@ -1514,6 +1683,13 @@ ide_buffer_init (IdeBuffer *self)
 
   priv->highlight_diagnostics = TRUE;
 
+  priv->snapshot = _ide_buffer_snapshot_new (
+      gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (self)));
+  g_signal_connect (self,
+                    "notify::implicit-trailing-newline",
+                    G_CALLBACK (ide_buffer_notify_implicit_trailing_newline),
+                    NULL);
+
   priv->file_signals = egg_signal_group_new (IDE_TYPE_FILE);
   egg_signal_group_connect_object (priv->file_signals,
                                    "notify::language",
@@ -1526,7 +1702,7 @@ ide_buffer_init (IdeBuffer *self)
                                    self,
                                    G_CONNECT_SWAPPED);
 
-  priv->diagnostics_line_cache = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->diagnostics_index = ide_diagnostics_index_new ();
 
   priv->diagnostics_manager_signals = egg_signal_group_new (IDE_TYPE_DIAGNOSTICS_MANAGER);
   egg_signal_group_connect_object (priv->diagnostics_manager_signals,
@@ -1658,14 +1834,9 @@ ide_buffer_get_line_flags (IdeBuffer *self,
   IdeBufferLineFlags flags = 0;
   IdeBufferLineChange change = 0;
 
-  if (priv->diagnostics_line_cache)
+  if (priv->diagnostics_index)
     {
-      gpointer key = GINT_TO_POINTER (line);
-      gpointer value;
-
-      value = g_hash_table_lookup (priv->diagnostics_line_cache, key);
-
-      switch (GPOINTER_TO_INT (value))
+      switch (ide_diagnostics_index_get_severity (priv->diagnostics_index, line))
         {
         case IDE_DIAGNOSTIC_FATAL:
         case IDE_DIAGNOSTIC_ERROR:
@@ -1766,7 +1937,8 @@ ide_buffer_set_highlight_diagnostics (IdeBuffer *self,
  * @self: A #IdeBuffer.
  * @iter: a #GtkTextIter.
  *
- * Gets the first diagnostic that overlaps the position
+ * Gets the diagnostic overlapping the line of @iter that is closest to
+ * the position of @iter.
  *
  * Returns: (transfer none) (nullable): An #IdeDiagnostic or %NULL.
  */
@@ -1779,89 +1951,14 @@ ide_buffer_get_diagnostic_at_iter (IdeBuffer         *self,
   g_return_val_if_fail (IDE_IS_BUFFER (self), NULL);
   g_return_val_if_fail (iter, NULL);
 
-  if (priv->diagnostics)
-    {
-      IdeDiagnostic *diagnostic = NULL;
-      IdeBufferLineFlags flags;
-      guint distance = G_MAXUINT;
-      gsize size;
-      gsize i;
-      guint line;
-
-      line = gtk_text_iter_get_line (iter);
-      flags = ide_buffer_get_line_flags (self, line);
-
-      if ((flags & IDE_BUFFER_LINE_FLAGS_DIAGNOSTICS_MASK) == 0)
-        return NULL;
-
-      size = ide_diagnostics_get_size (priv->diagnostics);
-
-      for (i = 0; i < size; i++)
-        {
-          IdeDiagnostic *diag;
-          IdeSourceLocation *location;
-          GtkTextIter pos;
-
-          diag = ide_diagnostics_index (priv->diagnostics, i);
-          location = ide_diagnostic_get_location (diag);
-          if (!location)
-            continue;
-
-          /* TODO: This should look at the range for the diagnostic */
-
-          ide_buffer_get_iter_at_location (self, &pos, location);
-
-          if (line == gtk_text_iter_get_line (&pos))
-            {
-              guint offset;
-
-              offset = ABS (gtk_text_iter_get_offset (iter) - gtk_text_iter_get_offset (&pos));
-
-              if (offset < distance)
-                {
-                  distance = offset;
-                  diagnostic = diag;
-                }
-            }
-        }
-
-      return diagnostic;
-    }
+  if (priv->diagnostics_index)
+    return ide_diagnostics_index_get_nearest (priv->diagnostics_index,
+                                              gtk_text_iter_get_line (iter),
+                                              gtk_text_iter_get_line_offset (iter));
 
   return NULL;
 }
 
-static gboolean
-ide_buffer_can_do_newline_hack (IdeBuffer *self,
-                                guint      len)
-{
-  guint next_pow2;
-
-  g_assert (IDE_IS_BUFFER (self));
-
-  /*
-   * If adding two bytes to our length (one for \n and one for \0) is still under the next
-   * power of two, then we can avoid making a copy of the buffer when saving the buffer
-   * to our drafts.
-   *
-   * HACK: This relies on the fact that GtkTextBuffer returns a GString allocated string
-   *       which grows the string in powers of two.
-   */
-
-  if ((len == 0) || (len & (len - 1)) == 0)
-    return FALSE;
-
-  next_pow2 = len;
-  next_pow2 |= next_pow2 >> 1;
-  next_pow2 |= next_pow2 >> 2;
-  next_pow2 |= next_pow2 >> 4;
-  next_pow2 |= next_pow2 >> 8;
-  next_pow2 |= next_pow2 >> 16;
-  next_pow2++;
-
-  return ((len + 2) < next_pow2);
-}
-
 /**
  * ide_buffer_get_content:
  * @self: A #IdeBuffer.
@@ -1883,59 +1980,32 @@ ide_buffer_get_content (IdeBuffer *self)
 
   g_return_val_if_fail (IDE_IS_BUFFER (self), NULL);
 
-  if (!priv->content)
-    {
-      IdeUnsavedFiles *unsaved_files;
-      gchar *text;
-      GtkTextIter begin;
-      GtkTextIter end;
-      GFile *gfile = NULL;
-      gsize len;
-
-      gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self), &begin, &end);
-      text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (self), &begin, &end, TRUE);
+  ide_buffer_update_unsaved_files (self);
 
-      /*
-       * If implicit newline is set, add a \n in place of the \0 and avoid duplicating the buffer.
-       * Make sure to track length beforehand, since we would overwrite afterwards. Since
-       * conversion to \r\n is dealth with during save operations, this should be fine for both.
-       * The unsaved files will restore to a buffer, for which \n is acceptable.
-       */
-      len = strlen (text);
-      if (gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (self)))
-        {
-          if (!ide_buffer_can_do_newline_hack (self, len))
-            {
-              gchar *copy;
-
-              copy = g_malloc (len + 2);
-              memcpy (copy, text, len);
-              g_free (text);
-              text = copy;
-            }
-
-          text [len] = '\n';
-          text [++len] = '\0';
-        }
+  return g_bytes_ref (priv->content);
+}
 
-      /*
-       * We pass a buffer that is longer than the length we tell GBytes about.
-       * This way, compilers that don't want to see the trailing \0 can ignore
-       * that data, but compilers that rely on valid C strings can also rely
-       * on the buffer to be valid.
-       */
-      priv->content = g_bytes_new_take (text, len);
+/**
+ * ide_buffer_get_snapshot:
+ * @self: A #IdeBuffer.
+ *
+ * Gets an immutable snapshot of the contents of the buffer. The snapshot is
+ * kept up to date as the buffer is edited, so this does not copy the
+ * contents of the buffer and is cheap to call after every change.
+ *
+ * The snapshot may be used from any thread, which makes it the preferred
+ * way to pass the contents of the buffer to background work.
+ *
+ * Returns: (transfer full): An #IdeBufferSnapshot.
+ */
+IdeBufferSnapshot *
+ide_buffer_get_snapshot (IdeBuffer *self)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
 
-      if ((priv->context != NULL) &&
-          (priv->file != NULL) &&
-          (gfile = ide_file_get_file (priv->file)))
-        {
-          unsaved_files = ide_context_get_unsaved_files (priv->context);
-          ide_unsaved_files_update (unsaved_files, gfile, priv->content);
-        }
-    }
+  g_return_val_if_fail (IDE_IS_BUFFER (self), NULL);
 
-  return g_bytes_ref (priv->content);
+  return ide_buffer_snapshot_ref (priv->snapshot);
 }
 
 /**
@@ -2095,6 +2165,56 @@ _ide_buffer_get_loading (IdeBuffer *self)
   return priv->loading;
 }
 
+IdeDiagnosticsIndex *
+_ide_buffer_get_diagnostics_index (IdeBuffer *self)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_BUFFER (self), NULL);
+
+  return priv->diagnostics_index;
+}
+
+/*
+ * Views call this when they are mapped or unmapped while displaying the
+ * buffer. A view in a hidden page of a stack is unmapped, even though it
+ * still holds the buffer.
+ */
+void
+_ide_buffer_set_view_mapped (IdeBuffer *self,
+                             gboolean   mapped)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_BUFFER (self));
+  g_return_if_fail (mapped || priv->n_mapped_views > 0);
+
+  priv->n_mapped_views += mapped ? 1 : -1;
+}
+
+/*
+ * Gets if a view displaying the buffer is on screen.
+ */
+gboolean
+_ide_buffer_get_mapped (IdeBuffer *self)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_BUFFER (self), FALSE);
+
+  return priv->n_mapped_views > 0;
+}
+
+IdeHighlightEngine *
+_ide_buffer_get_highlight_engine (IdeBuffer *self)
+{
+  IdeBufferPrivate *priv = ide_buffer_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_BUFFER (self), NULL);
+
+  return priv->highlight_engine;
+}
+
 void
 _ide_buffer_set_loading (IdeBuffer *self,
                          gboolean   loading)
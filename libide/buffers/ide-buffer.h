@@ -70,6 +70,7 @@ IdeDiagnostic      *ide_buffer_get_diagnostic_at_iter        (IdeBuffer
 IdeFile            *ide_buffer_get_file                      (IdeBuffer            *self);
 IdeBufferLineFlags  ide_buffer_get_line_flags                (IdeBuffer            *self,
                                                               guint                 line);
+IdeBufferSnapshot  *ide_buffer_get_snapshot                  (IdeBuffer            *self);
 gboolean            ide_buffer_get_read_only                 (IdeBuffer            *self);
 gboolean            ide_buffer_get_highlight_diagnostics     (IdeBuffer            *self);
 const gchar        *ide_buffer_get_style_scheme_name         (IdeBuffer            *self);
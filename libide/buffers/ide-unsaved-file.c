@@ -18,9 +18,12 @@
 
 #define G_LOG_DOMAIN "ide-unsaved-file"
 
+#include <unistd.h>
+
 #include "ide-debug.h"
 
 #include "buffers/ide-unsaved-file.h"
+#include "util/ide-posix.h"
 
 G_DEFINE_BOXED_TYPE (IdeUnsavedFile, ide_unsaved_file,
                      ide_unsaved_file_ref, ide_unsaved_file_unref)
@@ -32,6 +35,10 @@ struct _IdeUnsavedFile
   GFile         *file;
   gchar         *temp_path;
   gint64         sequence;
+
+  /* Sealed copy of content, created when first requested */
+  GMutex         fd_mutex;
+  gint           fd;
 };
 
 IdeUnsavedFile *
@@ -51,6 +58,8 @@ _ide_unsaved_file_new (GFile       *file,
   ret->content = g_bytes_ref (content);
   ret->sequence = sequence;
   ret->temp_path = g_strdup (temp_path);
+  ret->fd = -1;
+  g_mutex_init (&ret->fd_mutex);
 
   return ret;
 }
@@ -119,6 +128,9 @@ ide_unsaved_file_unref (IdeUnsavedFile *self)
 
   if (g_atomic_int_dec_and_test (&self->ref_count))
     {
+      if (self->fd != -1)
+        close (self->fd);
+      g_mutex_clear (&self->fd_mutex);
       g_clear_pointer (&self->temp_path, g_free);
       g_clear_pointer (&self->content, g_bytes_unref);
       g_clear_object (&self->file);
@@ -156,3 +168,37 @@ ide_unsaved_file_get_file (IdeUnsavedFile *self)
 
   return self->file;
 }
+
+/**
+ * ide_unsaved_file_get_fd:
+ * @self: A #IdeUnsavedFile.
+ * @error: A location for a #GError, or %NULL.
+ *
+ * Gets a read-only file descriptor containing the contents of the unsaved
+ * file. This is useful to pass the contents to a subprocess, which can
+ * mmap() the file descriptor instead of receiving a copy of the contents.
+ *
+ * The file descriptor is created the first time it is requested and is
+ * shared by all users of @self. It is owned by @self and valid for as long
+ * as @self is alive, so use dup() if you need it for longer.
+ *
+ * This function is thread-safe.
+ *
+ * Returns: A file descriptor, or -1 and @error is set.
+ */
+gint
+ide_unsaved_file_get_fd (IdeUnsavedFile  *self,
+                         GError         **error)
+{
+  gint ret;
+
+  g_return_val_if_fail (self, -1);
+
+  g_mutex_lock (&self->fd_mutex);
+  if (self->fd == -1)
+    self->fd = ide_create_sealed_fd ("gnome-builder-unsaved-file", self->content, error);
+  ret = self->fd;
+  g_mutex_unlock (&self->fd_mutex);
+
+  return ret;
+}
@@ -32,6 +32,8 @@ GBytes         *ide_unsaved_file_get_content   (IdeUnsavedFile  *self);
 GFile          *ide_unsaved_file_get_file      (IdeUnsavedFile  *self);
 gint64          ide_unsaved_file_get_sequence  (IdeUnsavedFile  *self);
 const gchar    *ide_unsaved_file_get_temp_path (IdeUnsavedFile  *self);
+gint            ide_unsaved_file_get_fd        (IdeUnsavedFile  *self,
+                                                GError         **error);
 gboolean        ide_unsaved_file_persist       (IdeUnsavedFile  *self,
                                                 GCancellable    *cancellable,
                                                 GError         **error);
@@ -39,18 +39,41 @@ typedef struct
   gchar           *temp_path;
   gint             temp_fd;
   IdeUnsavedFiles *backptr;
+
+  /*
+   * The snapshot handed out to consumers for the current content. It is
+   * created on demand and shared, so its file descriptor (see
+   * ide_unsaved_file_get_fd()) is only created once per change.
+   */
+  IdeUnsavedFile  *snapshot;
+
+  /* The sequence of the content last written to the drafts directory */
+  gint64           saved_sequence;
 } UnsavedFile;
 
+typedef struct
+{
+  GFile  *file;
+  gint64  sequence;
+} RemovedFile;
+
 typedef struct
 {
   GPtrArray *unsaved_files;
+  GPtrArray *removed_files;
   gint64     sequence;
+
+  /* Incremented when files are added or removed, to know when to write the manifest */
+  guint      manifest_serial;
+  guint      saved_manifest_serial;
 } IdeUnsavedFilesPrivate;
 
 typedef struct
 {
   GPtrArray *unsaved_files;
   gchar     *drafts_directory;
+  guint      manifest_serial;
+  guint      write_manifest : 1;
 } AsyncState;
 
 G_DEFINE_TYPE_WITH_PRIVATE (IdeUnsavedFiles, ide_unsaved_files, IDE_TYPE_OBJECT)
@@ -84,6 +107,15 @@ async_state_free (gpointer data)
     }
 }
 
+static void
+removed_file_free (gpointer data)
+{
+  RemovedFile *rf = data;
+
+  g_clear_object (&rf->file);
+  g_slice_free (RemovedFile, rf);
+}
+
 static void
 unsaved_file_free (gpointer data)
 {
@@ -93,6 +125,7 @@ unsaved_file_free (gpointer data)
     {
       g_clear_object (&uf->file);
       g_clear_pointer (&uf->content, g_bytes_unref);
+      g_clear_pointer (&uf->snapshot, ide_unsaved_file_unref);
 
       if (uf->temp_path != NULL)
         {
@@ -118,10 +151,24 @@ unsaved_file_copy (const UnsavedFile *uf)
   copy = g_slice_new0 (UnsavedFile);
   copy->file = g_object_ref (uf->file);
   copy->content = g_bytes_ref (uf->content);
+  copy->sequence = uf->sequence;
+  copy->saved_sequence = uf->saved_sequence;
+  copy->temp_fd = -1;
 
   return copy;
 }
 
+static IdeUnsavedFile *
+unsaved_file_get_snapshot (UnsavedFile *uf)
+{
+  g_assert (uf != NULL);
+
+  if (uf->snapshot == NULL)
+    uf->snapshot = _ide_unsaved_file_new (uf->file, uf->content, uf->temp_path, uf->sequence);
+
+  return ide_unsaved_file_ref (uf->snapshot);
+}
+
 static gboolean
 unsaved_file_save (UnsavedFile  *uf,
                    const gchar  *path,
@@ -198,6 +245,10 @@ ide_unsaved_files_save_worker (GTask        *task,
 
       g_string_append_printf (manifest, "%s\n", uri);
 
+      /* The draft on disk is already up to date */
+      if (uf->sequence == uf->saved_sequence)
+        continue;
+
       hash = hash_uri (uri);
       path = g_build_filename (state->drafts_directory, hash, NULL);
 
@@ -208,7 +259,8 @@ ide_unsaved_files_save_worker (GTask        *task,
         }
     }
 
-  if (!g_file_set_contents (manifest_path,
+  if (state->write_manifest &&
+      !g_file_set_contents (manifest_path,
                             manifest->str, manifest->len,
                             &error))
     {
@@ -232,7 +284,7 @@ async_state_new (IdeUnsavedFiles *files)
 
   context = ide_object_get_context (IDE_OBJECT (files));
 
-  state = g_slice_new (AsyncState);
+  state = g_slice_new0 (AsyncState);
   state->unsaved_files = g_ptr_array_new_with_free_func (unsaved_file_free);
   state->drafts_directory = get_drafts_directory (context);
 
@@ -256,6 +308,8 @@ ide_unsaved_files_save_async (IdeUnsavedFiles     *files,
   priv = ide_unsaved_files_get_instance_private (files);
 
   state = async_state_new (files);
+  state->manifest_serial = priv->manifest_serial;
+  state->write_manifest = (priv->manifest_serial != priv->saved_manifest_serial);
 
   for (i = 0; i < priv->unsaved_files->len; i++)
     {
@@ -272,15 +326,63 @@ ide_unsaved_files_save_async (IdeUnsavedFiles     *files,
   g_task_run_in_thread (task, ide_unsaved_files_save_worker);
 }
 
+static UnsavedFile *
+ide_unsaved_files_lookup (IdeUnsavedFiles *self,
+                          GFile           *file)
+{
+  IdeUnsavedFilesPrivate *priv = ide_unsaved_files_get_instance_private (self);
+  guint i;
+
+  g_assert (IDE_IS_UNSAVED_FILES (self));
+  g_assert (G_IS_FILE (file));
+
+  for (i = 0; i < priv->unsaved_files->len; i++)
+    {
+      UnsavedFile *uf = g_ptr_array_index (priv->unsaved_files, i);
+
+      if (g_file_equal (uf->file, file))
+        return uf;
+    }
+
+  return NULL;
+}
+
 gboolean
 ide_unsaved_files_save_finish (IdeUnsavedFiles  *files,
                                GAsyncResult     *result,
                                GError          **error)
 {
+  IdeUnsavedFilesPrivate *priv;
+  AsyncState *state;
+  gsize i;
+
   g_return_val_if_fail (IDE_IS_UNSAVED_FILES (files), FALSE);
   g_return_val_if_fail (G_IS_TASK (result), FALSE);
 
-  return g_task_propagate_boolean (G_TASK (result), error);
+  if (!g_task_propagate_boolean (G_TASK (result), error))
+    return FALSE;
+
+  priv = ide_unsaved_files_get_instance_private (files);
+  state = g_task_get_task_data (G_TASK (result));
+
+  /*
+   * Remember what we saved so the next save can skip drafts that have not
+   * changed. If a file changed again while we were saving, the sequence
+   * will not match and it will be saved next time.
+   */
+  for (i = 0; i < state->unsaved_files->len; i++)
+    {
+      UnsavedFile *saved = g_ptr_array_index (state->unsaved_files, i);
+      UnsavedFile *uf = ide_unsaved_files_lookup (files, saved->file);
+
+      if (uf != NULL && uf->sequence == saved->sequence)
+        uf->saved_sequence = saved->sequence;
+    }
+
+  if (state->write_manifest)
+    priv->saved_manifest_serial = state->manifest_serial;
+
+  return TRUE;
 }
 
 static void
@@ -354,6 +456,7 @@ ide_unsaved_files_restore_worker (GTask        *task,
       unsaved = g_slice_new0 (UnsavedFile);
       unsaved->file = g_object_ref (file);
       unsaved->content = g_bytes_new_take (contents, data_len);
+      unsaved->temp_fd = -1;
 
       g_ptr_array_add (state->unsaved_files, unsaved);
     }
@@ -399,9 +502,14 @@ ide_unsaved_files_restore_finish (IdeUnsavedFiles  *files,
   for (i = 0; i < state->unsaved_files->len; i++)
     {
       UnsavedFile *uf;
+      UnsavedFile *restored;
 
       uf = g_ptr_array_index (state->unsaved_files, i);
       ide_unsaved_files_update (files, uf->file, uf->content);
+
+      /* No need to write the draft back out until it changes */
+      if (NULL != (restored = ide_unsaved_files_lookup (files, uf->file)))
+        restored->saved_sequence = restored->sequence;
     }
 
   return g_task_propagate_boolean (G_TASK (result), error);
@@ -457,6 +565,55 @@ ide_unsaved_files_remove_draft (IdeUnsavedFiles *self,
   IDE_EXIT;
 }
 
+/*
+ * Checks if the content of @uf is what is on disk, such as right after the
+ * buffer was saved. Mapping the file avoids copying it, and it is likely
+ * still in the page cache.
+ */
+static gboolean
+unsaved_file_matches_disk (UnsavedFile *uf)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autofree gchar *path = NULL;
+  gconstpointer data;
+  gsize len;
+
+  g_assert (uf != NULL);
+
+  if (NULL == (path = g_file_get_path (uf->file)) ||
+      NULL == (mapped = g_mapped_file_new (path, FALSE, NULL)))
+    return FALSE;
+
+  data = g_bytes_get_data (uf->content, &len);
+
+  if (g_mapped_file_get_length (mapped) != len)
+    return FALSE;
+
+  return len == 0 || memcmp (g_mapped_file_get_contents (mapped), data, len) == 0;
+}
+
+static void
+ide_unsaved_files_forget_removed (IdeUnsavedFiles *self,
+                                  GFile           *file)
+{
+  IdeUnsavedFilesPrivate *priv = ide_unsaved_files_get_instance_private (self);
+  guint i;
+
+  g_assert (IDE_IS_UNSAVED_FILES (self));
+  g_assert (G_IS_FILE (file));
+
+  for (i = 0; i < priv->removed_files->len; i++)
+    {
+      RemovedFile *rf = g_ptr_array_index (priv->removed_files, i);
+
+      if (g_file_equal (rf->file, file))
+        {
+          g_ptr_array_remove_index_fast (priv->removed_files, i);
+          break;
+        }
+    }
+}
+
 void
 ide_unsaved_files_remove (IdeUnsavedFiles *self,
                           GFile           *file)
@@ -475,8 +632,31 @@ ide_unsaved_files_remove (IdeUnsavedFiles *self,
 
       if (g_file_equal (file, unsaved->file))
         {
+          RemovedFile *rf;
+
+          ide_unsaved_files_forget_removed (self, file);
+
+          rf = g_slice_new0 (RemovedFile);
+          rf->file = g_object_ref (file);
+
+          /*
+           * When the content was saved, whoever saw its last change already
+           * has what is on disk now. Only those who saw an older content
+           * need to reload the file, so the sequence is left alone, and
+           * consumers keyed on it, such as translation units, stay valid.
+           */
+          if (unsaved_file_matches_disk (unsaved))
+            rf->sequence = unsaved->sequence;
+          else
+            rf->sequence = ++priv->sequence;
+
+          g_ptr_array_add (priv->removed_files, rf);
+
           ide_unsaved_files_remove_draft (self, file);
           g_ptr_array_remove_index_fast (priv->unsaved_files, i);
+
+          priv->manifest_serial++;
+
           break;
         }
     }
@@ -533,6 +713,7 @@ ide_unsaved_files_update (IdeUnsavedFiles *self,
           if (content != unsaved->content)
             {
               g_clear_pointer (&unsaved->content, g_bytes_unref);
+              g_clear_pointer (&unsaved->snapshot, ide_unsaved_file_unref);
               unsaved->content = g_bytes_ref (content);
               unsaved->sequence = priv->sequence;
             }
@@ -557,6 +738,9 @@ ide_unsaved_files_update (IdeUnsavedFiles *self,
   setup_tempfile (file, &unsaved->temp_fd, &unsaved->temp_path);
 
   g_ptr_array_insert (priv->unsaved_files, 0, unsaved);
+
+  priv->manifest_serial++;
+  ide_unsaved_files_forget_removed (self, file);
 }
 
 /**
@@ -590,13 +774,67 @@ ide_unsaved_files_to_array (IdeUnsavedFiles *self)
 
   for (i = 0; i < priv->unsaved_files->len; i++)
     {
-      IdeUnsavedFile *item;
       UnsavedFile *uf;
 
       uf = g_ptr_array_index (priv->unsaved_files, i);
-      item = _ide_unsaved_file_new (uf->file, uf->content, uf->temp_path, uf->sequence);
+      g_ptr_array_add (ar, unsaved_file_get_snapshot (uf));
+    }
 
-      g_ptr_array_add (ar, item);
+  return ar;
+}
+
+/**
+ * ide_unsaved_files_get_changes_since:
+ * @self: An #IdeUnsavedFiles.
+ * @sequence: a sequence number from ide_unsaved_files_get_sequence()
+ * @removed: (out) (optional) (transfer container) (element-type GFile): A
+ *   location for the files that are no longer unsaved, or %NULL.
+ *
+ * This is like ide_unsaved_files_to_array() but only contains the unsaved
+ * files which have changed since @sequence. This allows consumers which
+ * keep state for each unsaved file to only process what changed.
+ *
+ * If @removed is not %NULL, it will be set to the files which have been
+ * saved or closed since @sequence, meaning the contents on disk should be
+ * used again.
+ *
+ * Returns: (transfer container) (element-type IdeUnsavedFile*): A #GPtrArray
+ *   containing #IdeUnsavedFile elements.
+ */
+GPtrArray *
+ide_unsaved_files_get_changes_since (IdeUnsavedFiles  *self,
+                                     gint64            sequence,
+                                     GPtrArray       **removed)
+{
+  IdeUnsavedFilesPrivate *priv;
+  GPtrArray *ar;
+  gsize i;
+
+  g_return_val_if_fail (IDE_IS_UNSAVED_FILES (self), NULL);
+
+  priv = ide_unsaved_files_get_instance_private (self);
+
+  ar = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_unsaved_file_unref);
+
+  for (i = 0; i < priv->unsaved_files->len; i++)
+    {
+      UnsavedFile *uf = g_ptr_array_index (priv->unsaved_files, i);
+
+      if (uf->sequence > sequence)
+        g_ptr_array_add (ar, unsaved_file_get_snapshot (uf));
+    }
+
+  if (removed != NULL)
+    {
+      *removed = g_ptr_array_new_with_free_func (g_object_unref);
+
+      for (i = 0; i < priv->removed_files->len; i++)
+        {
+          RemovedFile *rf = g_ptr_array_index (priv->removed_files, i);
+
+          if (rf->sequence > sequence)
+            g_ptr_array_add (*removed, g_object_ref (rf->file));
+        }
     }
 
   return ar;
@@ -664,7 +902,7 @@ ide_unsaved_files_get_unsaved_file (IdeUnsavedFiles *self,
       if (g_file_equal (uf->file, file))
         {
           IDE_TRACE_MSG ("Hit");
-          ret = _ide_unsaved_file_new (uf->file, uf->content, uf->temp_path, uf->sequence);
+          ret = unsaved_file_get_snapshot (uf);
           goto complete;
         }
     }
@@ -692,6 +930,7 @@ ide_unsaved_files_finalize (GObject *object)
   IdeUnsavedFilesPrivate *priv = ide_unsaved_files_get_instance_private (self);
 
   g_clear_pointer (&priv->unsaved_files, g_ptr_array_unref);
+  g_clear_pointer (&priv->removed_files, g_ptr_array_unref);
 
   G_OBJECT_CLASS (ide_unsaved_files_parent_class)->finalize (object);
 }
@@ -710,6 +949,7 @@ ide_unsaved_files_init (IdeUnsavedFiles *self)
   IdeUnsavedFilesPrivate *priv = ide_unsaved_files_get_instance_private (self);
 
   priv->unsaved_files = g_ptr_array_new_with_free_func (unsaved_file_free);
+  priv->removed_files = g_ptr_array_new_with_free_func (removed_file_free);
 }
 
 void
@@ -0,0 +1,493 @@
+/* ide-build-log.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-build-log"
+
+#include <egg-counter.h>
+#include <string.h>
+
+#include "buildsystem/ide-build-log.h"
+
+/*
+ * IdeBuildLog stores the lines logged by a build so that they can be
+ * displayed without every consumer keeping its own copy.
+ *
+ * Lines are packed into chunks of CHUNK_SIZE bytes, each line stored as a
+ * byte for the stream it was logged to, followed by the text and a \0. Each
+ * chunk keeps the offset of its lines, so finding a line is a binary search
+ * over the chunks followed by an index into the chunk.
+ *
+ * Once the chunks use more than the maximum size, the oldest chunks are
+ * dropped, making the log behave like a ring buffer of chunks. Lines keep
+ * their number for the lifetime of the log, so consumers can tell which
+ * lines they have seen even after older lines were dropped.
+ *
+ * Appending only holds the mutex long enough to copy the line, so build
+ * threads are not blocked by the UI.
+ */
+
+#define CHUNK_SIZE (64 * 1024)
+
+G_DEFINE_BOXED_TYPE (IdeBuildLog, ide_build_log, ide_build_log_ref, ide_build_log_unref)
+
+EGG_DEFINE_COUNTER (lines, "IdeBuildLog", "Lines", "Number of lines appended to build logs")
+EGG_DEFINE_COUNTER (dropped, "IdeBuildLog", "Dropped Lines", "Number of lines dropped to stay within the size limit")
+EGG_DEFINE_COUNTER (chunks, "IdeBuildLog", "Chunks", "Number of chunks allocated for build logs")
+
+typedef struct
+{
+  guint64  first_line;
+  GArray  *offsets;
+  gsize    len;
+  gsize    allocated;
+  gchar   *data;
+} Chunk;
+
+struct _IdeBuildLog
+{
+  volatile gint  ref_count;
+
+  GMutex         mutex;
+
+  /* The chunks, oldest first */
+  GPtrArray     *chunks;
+
+  /* A dropped chunk kept around to be reused */
+  Chunk         *spare;
+
+  gsize          size;
+  gsize          max_size;
+
+  guint64        begin;
+  guint64        end;
+  guint64        n_dropped;
+};
+
+static Chunk *
+chunk_new (gsize allocated)
+{
+  Chunk *chunk;
+
+  chunk = g_slice_new0 (Chunk);
+  chunk->offsets = g_array_new (FALSE, FALSE, sizeof (guint32));
+  chunk->allocated = allocated;
+  chunk->data = g_malloc (allocated);
+
+  EGG_COUNTER_INC (chunks);
+
+  return chunk;
+}
+
+static void
+chunk_free (gpointer data)
+{
+  Chunk *chunk = data;
+
+  if (chunk != NULL)
+    {
+      g_array_unref (chunk->offsets);
+      g_free (chunk->data);
+      g_slice_free (Chunk, chunk);
+
+      EGG_COUNTER_DEC (chunks);
+    }
+}
+
+static inline void
+chunk_get_line (Chunk               *chunk,
+                guint                index,
+                IdeBuildResultLog   *log,
+                const gchar        **text,
+                gsize               *len)
+{
+  guint32 offset;
+  gsize next;
+
+  g_assert (chunk != NULL);
+  g_assert (index < chunk->offsets->len);
+
+  offset = g_array_index (chunk->offsets, guint32, index);
+
+  if (index + 1 < chunk->offsets->len)
+    next = g_array_index (chunk->offsets, guint32, index + 1);
+  else
+    next = chunk->len;
+
+  *log = chunk->data [offset];
+  *text = &chunk->data [offset + 1];
+  *len = next - offset - 2;
+}
+
+/**
+ * ide_build_log_new:
+ * @max_size: the number of bytes to retain, or 0 for no limit
+ *
+ * Creates a new #IdeBuildLog which drops the oldest lines once the lines
+ * use more than @max_size bytes.
+ *
+ * Returns: (transfer full): An #IdeBuildLog.
+ */
+IdeBuildLog *
+ide_build_log_new (gsize max_size)
+{
+  IdeBuildLog *self;
+
+  self = g_slice_new0 (IdeBuildLog);
+  self->ref_count = 1;
+  self->chunks = g_ptr_array_new ();
+  self->max_size = max_size ? max_size : G_MAXSIZE;
+
+  g_mutex_init (&self->mutex);
+
+  return self;
+}
+
+IdeBuildLog *
+ide_build_log_ref (IdeBuildLog *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+ide_build_log_unref (IdeBuildLog *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      for (guint i = 0; i < self->chunks->len; i++)
+        chunk_free (g_ptr_array_index (self->chunks, i));
+
+      g_clear_pointer (&self->chunks, g_ptr_array_unref);
+      g_clear_pointer (&self->spare, chunk_free);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (IdeBuildLog, self);
+    }
+}
+
+static void
+ide_build_log_compact (IdeBuildLog *self)
+{
+  g_assert (self != NULL);
+
+  /* Always keep the chunk being appended to */
+  while (self->size > self->max_size && self->chunks->len > 1)
+    {
+      Chunk *chunk = g_ptr_array_remove_index (self->chunks, 0);
+      Chunk *next = g_ptr_array_index (self->chunks, 0);
+
+      self->n_dropped += chunk->offsets->len;
+      self->begin = next->first_line;
+      self->size -= chunk->allocated;
+
+      EGG_COUNTER_ADD (dropped, chunk->offsets->len);
+
+      /* Keep a chunk around so that we do not need to allocate another */
+      if (self->spare == NULL && chunk->allocated == CHUNK_SIZE)
+        self->spare = chunk;
+      else
+        chunk_free (chunk);
+    }
+}
+
+/**
+ * ide_build_log_append:
+ * @self: An #IdeBuildLog
+ * @log: the stream @text was logged to
+ * @text: the text of the line
+ * @len: the length of @text, or -1 if it is \0 terminated
+ *
+ * Appends a line to the log. A trailing newline in @text is removed.
+ *
+ * This function is thread-safe.
+ */
+void
+ide_build_log_append (IdeBuildLog       *self,
+                      IdeBuildResultLog  log,
+                      const gchar       *text,
+                      gssize             len)
+{
+  Chunk *chunk = NULL;
+  guint32 offset;
+  gsize needed;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (text != NULL);
+
+  if (len < 0)
+    len = strlen (text);
+
+  if (len > 0 && text [len - 1] == '\n')
+    len--;
+
+  /* The stream, the text and a trailing \0 */
+  needed = len + 2;
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->chunks->len > 0)
+    chunk = g_ptr_array_index (self->chunks, self->chunks->len - 1);
+
+  if (chunk == NULL || chunk->len + needed > chunk->allocated)
+    {
+      if (needed <= CHUNK_SIZE && self->spare != NULL)
+        {
+          chunk = self->spare;
+          self->spare = NULL;
+          chunk->len = 0;
+          g_array_set_size (chunk->offsets, 0);
+        }
+      else
+        {
+          chunk = chunk_new (MAX (CHUNK_SIZE, needed));
+        }
+
+      chunk->first_line = self->end;
+      self->size += chunk->allocated;
+
+      g_ptr_array_add (self->chunks, chunk);
+    }
+
+  offset = chunk->len;
+  g_array_append_val (chunk->offsets, offset);
+
+  chunk->data [offset] = log;
+  memcpy (&chunk->data [offset + 1], text, len);
+  chunk->data [offset + 1 + len] = '\0';
+  chunk->len += needed;
+
+  self->end++;
+
+  ide_build_log_compact (self);
+
+  g_mutex_unlock (&self->mutex);
+
+  EGG_COUNTER_INC (lines);
+}
+
+/**
+ * ide_build_log_get_bounds:
+ * @self: An #IdeBuildLog
+ * @begin: (out) (optional): the number of the oldest line still available
+ * @end: (out) (optional): the number of the line after the newest line
+ *
+ * Gets the range of lines which are still available. Lines are numbered
+ * from the first line appended to the log, so @end is the number of lines
+ * appended to the log so far.
+ */
+void
+ide_build_log_get_bounds (IdeBuildLog *self,
+                          guint64     *begin,
+                          guint64     *end)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (begin != NULL)
+    *begin = self->begin;
+
+  if (end != NULL)
+    *end = self->end;
+
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * ide_build_log_get_n_dropped:
+ * @self: An #IdeBuildLog
+ *
+ * Gets the number of lines which were dropped to stay within the maximum
+ * size of the log.
+ *
+ * Returns: the number of dropped lines.
+ */
+guint64
+ide_build_log_get_n_dropped (IdeBuildLog *self)
+{
+  guint64 ret;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  g_mutex_lock (&self->mutex);
+  ret = self->n_dropped;
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * ide_build_log_get_size:
+ * @self: An #IdeBuildLog
+ *
+ * Gets the number of bytes allocated for the lines of the log.
+ *
+ * Returns: the size of the log in bytes.
+ */
+gsize
+ide_build_log_get_size (IdeBuildLog *self)
+{
+  gsize ret;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  g_mutex_lock (&self->mutex);
+  ret = self->size;
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+static guint
+ide_build_log_find_chunk (IdeBuildLog *self,
+                          guint64      line)
+{
+  guint lo = 0;
+  guint hi;
+
+  g_assert (self != NULL);
+  g_assert (line >= self->begin);
+  g_assert (line < self->end);
+
+  hi = self->chunks->len;
+
+  /* Find the last chunk starting at or before line */
+  while (hi - lo > 1)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      Chunk *chunk = g_ptr_array_index (self->chunks, mid);
+
+      if (chunk->first_line <= line)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/**
+ * ide_build_log_foreach:
+ * @self: An #IdeBuildLog
+ * @begin: the first line
+ * @end: the line after the last line
+ * @func: (scope call): a function to call for each line
+ * @user_data: closure data for @func
+ *
+ * Calls @func for each of the available lines from @begin up to @end.
+ *
+ * The log is locked while calling @func, so @func must not call into
+ * @self. Appending to the log blocks until @func returns, so @func should
+ * only copy or scan the lines; render them after ide_build_log_foreach()
+ * returns.
+ */
+void
+ide_build_log_foreach (IdeBuildLog         *self,
+                       guint64              begin,
+                       guint64              end,
+                       IdeBuildLogLineFunc  func,
+                       gpointer             user_data)
+{
+  guint64 line;
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (func != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  begin = MAX (begin, self->begin);
+  end = MIN (end, self->end);
+
+  if (begin >= end)
+    goto unlock;
+
+  line = begin;
+
+  for (i = ide_build_log_find_chunk (self, begin); i < self->chunks->len; i++)
+    {
+      Chunk *chunk = g_ptr_array_index (self->chunks, i);
+
+      for (; line < end && line - chunk->first_line < chunk->offsets->len; line++)
+        {
+          IdeBuildResultLog log;
+          const gchar *text;
+          gsize len;
+
+          chunk_get_line (chunk, line - chunk->first_line, &log, &text, &len);
+
+          if (func (line, log, text, len, user_data))
+            goto unlock;
+        }
+
+      if (line >= end)
+        break;
+    }
+
+unlock:
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * ide_build_log_get_line:
+ * @self: An #IdeBuildLog
+ * @line: the number of the line
+ * @log: (out) (optional): the stream the line was logged to
+ *
+ * Gets a copy of the text of @line.
+ *
+ * Returns: (transfer full) (nullable): the text of the line, or %NULL if
+ *   the line was dropped or has not been appended yet.
+ */
+gchar *
+ide_build_log_get_line (IdeBuildLog       *self,
+                        guint64            line,
+                        IdeBuildResultLog *log)
+{
+  gchar *ret = NULL;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (line >= self->begin && line < self->end)
+    {
+      Chunk *chunk;
+      IdeBuildResultLog line_log;
+      const gchar *text;
+      gsize len;
+
+      chunk = g_ptr_array_index (self->chunks, ide_build_log_find_chunk (self, line));
+      chunk_get_line (chunk, line - chunk->first_line, &line_log, &text, &len);
+
+      ret = g_strndup (text, len);
+
+      if (log != NULL)
+        *log = line_log;
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
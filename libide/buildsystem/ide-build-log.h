@@ -0,0 +1,74 @@
+/* ide-build-log.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_BUILD_LOG_H
+#define IDE_BUILD_LOG_H
+
+#include <gio/gio.h>
+
+#include "ide-types.h"
+
+#include "buildsystem/ide-build-result.h"
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_BUILD_LOG (ide_build_log_get_type())
+
+/**
+ * IdeBuildLogLineFunc:
+ * @line: the number of the line
+ * @log: the stream the line was logged to
+ * @text: the text of the line, without the trailing newline
+ * @len: the length of @text in bytes
+ * @user_data: closure data
+ *
+ * Returns: %TRUE to stop iterating.
+ */
+typedef gboolean (*IdeBuildLogLineFunc) (guint64            line,
+                                         IdeBuildResultLog  log,
+                                         const gchar       *text,
+                                         gsize              len,
+                                         gpointer           user_data);
+
+GType        ide_build_log_get_type      (void);
+IdeBuildLog *ide_build_log_new           (gsize                max_size);
+IdeBuildLog *ide_build_log_ref           (IdeBuildLog         *self);
+void         ide_build_log_unref         (IdeBuildLog         *self);
+void         ide_build_log_append        (IdeBuildLog         *self,
+                                          IdeBuildResultLog    log,
+                                          const gchar         *text,
+                                          gssize               len);
+void         ide_build_log_get_bounds    (IdeBuildLog         *self,
+                                          guint64             *begin,
+                                          guint64             *end);
+guint64      ide_build_log_get_n_dropped (IdeBuildLog         *self);
+gsize        ide_build_log_get_size      (IdeBuildLog         *self);
+gchar       *ide_build_log_get_line      (IdeBuildLog         *self,
+                                          guint64              line,
+                                          IdeBuildResultLog   *log);
+void         ide_build_log_foreach       (IdeBuildLog         *self,
+                                          guint64              begin,
+                                          guint64              end,
+                                          IdeBuildLogLineFunc  func,
+                                          gpointer             user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeBuildLog, ide_build_log_unref)
+
+G_END_DECLS
+
+#endif /* IDE_BUILD_LOG_H */
@@ -26,16 +26,25 @@
 #include "ide-debug.h"
 #include "ide-enums.h"
 
+#include "buildsystem/ide-build-log.h"
 #include "buildsystem/ide-build-result.h"
 #include "buildsystem/ide-build-result-addin.h"
 #include "diagnostics/ide-source-location.h"
 #include "files/ide-file.h"
 #include "subprocess/ide-subprocess.h"
 
-#define POINTER_MARK(p)   GSIZE_TO_POINTER(GPOINTER_TO_SIZE(p)|1)
-#define POINTER_UNMARK(p) GSIZE_TO_POINTER(GPOINTER_TO_SIZE(p)&~(gsize)1)
-#define POINTER_MARKED(p) (GPOINTER_TO_SIZE(p)&1)
-#define DISPATCH_MAX      20
+/*
+ * The number of bytes of log lines kept in memory. The complete log is
+ * still available from the stdout and stderr streams.
+ */
+#define LOG_MAX_SIZE        (16 * 1024 * 1024)
+
+/*
+ * The number of lines copied out of the log at once, and the time we may
+ * spend emitting lines before returning to the main loop.
+ */
+#define LOG_BATCH_SIZE      256
+#define LOG_DISPATCH_BUDGET (G_USEC_PER_SEC / 200)
 
 typedef struct
 {
@@ -50,7 +59,9 @@ typedef struct
   PeasExtensionSet *addins;
 
   GSource          *log_source;
-  GAsyncQueue      *log_queue;
+  IdeBuildLog      *log;
+  guint64           log_emitted;
+  volatile gint     log_pending;
 
   GTimer           *timer;
   gchar            *mode;
@@ -58,8 +69,22 @@ typedef struct
 
   guint             running : 1;
   guint             failed : 1;
+  guint             in_log_flush : 1;
 } IdeBuildResultPrivate;
 
+typedef struct
+{
+  GString *text;
+  GArray  *lines;
+  guint64  next;
+} LogBatch;
+
+typedef struct
+{
+  gsize             offset;
+  IdeBuildResultLog log;
+} LogBatchLine;
+
 typedef struct
 {
   IdeBuildResult    *self;
@@ -81,6 +106,7 @@ enum {
 enum {
   DIAGNOSTIC,
   LOG,
+  LOG_LINES,
   LAST_SIGNAL
 };
 
@@ -117,10 +143,127 @@ _ide_build_result_open_log (IdeBuildResult  *self,
   return FALSE;
 }
 
-G_GNUC_PRINTF (6, 0) static void
+static gboolean
+ide_build_result_collect_line (guint64            line,
+                               IdeBuildResultLog  log,
+                               const gchar       *text,
+                               gsize              len,
+                               gpointer           user_data)
+{
+  LogBatch *batch = user_data;
+  LogBatchLine item = { batch->text->len, log };
+
+  /* Keep the newline for compatibility, and a \0 to separate the lines */
+  g_string_append_len (batch->text, text, len);
+  g_string_append_len (batch->text, "\n", 2);
+  g_array_append_val (batch->lines, item);
+
+  batch->next = line + 1;
+
+  return FALSE;
+}
+
+/*
+ * Emits the IdeBuildResult::log-lines signal once for each batch of lines
+ * which have not been emitted yet.
+ *
+ * The IdeBuildResult::log signal is only emitted, once per line, when it
+ * has handlers. Lines are then copied out of the log in batches so that
+ * the log is not locked while the handlers run.
+ *
+ * Returns: %TRUE if all lines were emitted, %FALSE if @deadline was reached.
+ */
+static gboolean
+ide_build_result_flush_log (IdeBuildResult *self,
+                            gint64          deadline)
+{
+  IdeBuildResultPrivate *priv = ide_build_result_get_instance_private (self);
+  LogBatch batch;
+  gboolean ret = TRUE;
+  gboolean per_line;
+
+  g_assert (IDE_IS_BUILD_RESULT (self));
+
+  /*
+   * If a handler logs while we are emitting, the line will be picked up by
+   * the outer flush which keeps the lines in order.
+   */
+  if (priv->in_log_flush)
+    return TRUE;
+
+  priv->in_log_flush = TRUE;
+
+  per_line = g_signal_has_handler_pending (self, signals [LOG], 0, TRUE);
+
+  batch.text = g_string_new (NULL);
+  batch.lines = g_array_new (FALSE, FALSE, sizeof (LogBatchLine));
+
+  for (;;)
+    {
+      guint64 begin;
+      guint64 end;
+
+      ide_build_log_get_bounds (priv->log, &begin, &end);
+
+      /* Lines may have been dropped before we could emit them */
+      if (priv->log_emitted < begin)
+        {
+          IDE_TRACE_MSG ("%"G_GUINT64_FORMAT" lines dropped before being emitted",
+                         begin - priv->log_emitted);
+          priv->log_emitted = begin;
+        }
+
+      if (priv->log_emitted >= end)
+        break;
+
+      if (!per_line)
+        {
+          guint64 first = priv->log_emitted;
+
+          priv->log_emitted = end;
+          g_signal_emit (self, signals [LOG_LINES], 0, first, end);
+
+          continue;
+        }
+
+      g_string_truncate (batch.text, 0);
+      g_array_set_size (batch.lines, 0);
+      batch.next = priv->log_emitted;
+
+      ide_build_log_foreach (priv->log,
+                             priv->log_emitted,
+                             MIN (end, priv->log_emitted + LOG_BATCH_SIZE),
+                             ide_build_result_collect_line,
+                             &batch);
+
+      priv->log_emitted = batch.next;
+
+      for (guint i = 0; i < batch.lines->len; i++)
+        {
+          const LogBatchLine *item = &g_array_index (batch.lines, LogBatchLine, i);
+
+          g_signal_emit (self, signals [LOG], 0, item->log, &batch.text->str [item->offset]);
+        }
+
+      g_signal_emit (self, signals [LOG_LINES], 0, batch.next - batch.lines->len, batch.next);
+
+      if (deadline > 0 && g_get_monotonic_time () >= deadline)
+        {
+          ret = FALSE;
+          break;
+        }
+    }
+
+  g_string_free (batch.text, TRUE);
+  g_array_unref (batch.lines);
+
+  priv->in_log_flush = FALSE;
+
+  return ret;
+}
+
+G_GNUC_PRINTF (4, 0) static void
 _ide_build_result_log (IdeBuildResult    *self,
-                       GSource           *source,
-                       GAsyncQueue       *queue,
                        GOutputStream     *stream,
                        IdeBuildResultLog  log,
                        const gchar       *format,
@@ -133,8 +276,6 @@ _ide_build_result_log (IdeBuildResult    *self,
   va_list copy;
   gint len;
 
-  g_assert (source != NULL);
-  g_assert (queue != NULL);
   g_assert (G_IS_OUTPUT_STREAM (stream));
   g_assert (message != NULL);
 
@@ -154,35 +295,17 @@ _ide_build_result_log (IdeBuildResult    *self,
 
   g_output_stream_write_all (stream, message, len, NULL, NULL, NULL);
 
-  if G_UNLIKELY (g_source_get_context (source) != g_main_context_get_thread_default ())
-    {
-      gchar *copied;
+  ide_build_log_append (priv->log, log, message, len);
 
-      if G_UNLIKELY (freeme != NULL)
-        copied = g_steal_pointer (&freeme);
-      else
-        copied = g_strdup (message);
-
-      if G_UNLIKELY (log == IDE_BUILD_RESULT_LOG_STDERR)
-        copied = POINTER_MARK (copied);
-
-      /*
-       * Add the log entry to our queue to be dispatched in the main thread.
-       * However, we hold the async queue lock while updating the source ready
-       * time so we are synchronized with the main thread for setting the
-       * ready time. This is needed because the main thread may not dispatch
-       * all available items in a single dispatch (to avoid stalling the
-       * main loop).
-       */
-      g_async_queue_lock (priv->log_queue);
-      g_async_queue_push_unlocked (priv->log_queue, copied);
-      g_source_set_ready_time (source, 0);
-      g_async_queue_unlock (priv->log_queue);
-    }
-  else
-    {
-      g_signal_emit (self, signals [LOG], 0, log, message);
-    }
+  /*
+   * Wake up the main thread to emit the new lines, unless it has already
+   * been woken up and has not yet started emitting. The main thread clears
+   * log_pending before it fetches the bounds of the log, so the line we
+   * just appended can not be missed. Lines logged from the main thread are
+   * batched the same way.
+   */
+  if (g_atomic_int_compare_and_exchange (&priv->log_pending, FALSE, TRUE))
+    g_source_set_ready_time (priv->log_source, 0);
 }
 
 void
@@ -201,8 +324,6 @@ ide_build_result_log_stdout (IdeBuildResult *self,
     {
       va_start (args, format);
       _ide_build_result_log (self,
-                             priv->log_source,
-                             priv->log_queue,
                              priv->stdout_writer,
                              IDE_BUILD_RESULT_LOG_STDOUT,
                              format,
@@ -234,8 +355,6 @@ ide_build_result_log_stderr (IdeBuildResult *self,
     {
       va_start (args, format);
       _ide_build_result_log (self,
-                             priv->log_source,
-                             priv->log_queue,
                              priv->stderr_writer,
                              IDE_BUILD_RESULT_LOG_STDERR,
                              format,
@@ -443,44 +562,18 @@ emit_log_from_main (gpointer user_data)
 {
   IdeBuildResult *self = user_data;
   IdeBuildResultPrivate *priv = ide_build_result_get_instance_private (self);
-  g_autoptr(GPtrArray) ar = g_ptr_array_new ();
-  gpointer item;
 
   g_assert (IDE_IS_BUILD_RESULT (self));
 
+  g_source_set_ready_time (priv->log_source, -1);
+  g_atomic_int_set (&priv->log_pending, FALSE);
+
   /*
-   * Pull up to DISPATCH_MAX items from the log queue. We have an upper
-   * bound here so that we don't stall the main loop. Additionally, we
-   * update the ready-time when we run out of items while holding the
-   * async queue lock to synchronize with the caller for further wakeups.
+   * Emit as many lines as we can within our budget so that we don't stall
+   * the main loop, and come back for the rest on the next iteration.
    */
-  g_async_queue_lock (priv->log_queue);
-  for (guint i = 0; i < DISPATCH_MAX; i++)
-    {
-      if (NULL == (item = g_async_queue_try_pop_unlocked (priv->log_queue)))
-        {
-          g_source_set_ready_time (priv->log_source, -1);
-          break;
-        }
-      g_ptr_array_add (ar, item);
-    }
-  g_async_queue_unlock (priv->log_queue);
-
-  for (guint i = 0; i < ar->len; i++)
-    {
-      IdeBuildResultLog log = IDE_BUILD_RESULT_LOG_STDOUT;
-      gchar *message;
-
-      item = g_ptr_array_index (ar, i);
-      message = POINTER_UNMARK (item);
-
-      if (POINTER_MARKED (item))
-        log = IDE_BUILD_RESULT_LOG_STDERR;
-
-      g_signal_emit (self, signals[LOG], 0, log, message);
-
-      g_free (message);
-    }
+  if (!ide_build_result_flush_log (self, g_get_monotonic_time () + LOG_DISPATCH_BUDGET))
+    g_source_set_ready_time (priv->log_source, 0);
 
   return G_SOURCE_CONTINUE;
 }
@@ -535,7 +628,7 @@ ide_build_result_finalize (GObject *object)
 
   g_clear_pointer (&priv->log_source, g_source_destroy);
 
-  g_clear_pointer (&priv->log_queue, g_async_queue_unref);
+  g_clear_pointer (&priv->log, ide_build_log_unref);
 
   g_mutex_clear (&priv->mutex);
 
@@ -662,6 +755,27 @@ ide_build_result_class_init (IdeBuildResultClass *klass)
                   2,
                   IDE_TYPE_BUILD_RESULT_LOG,
                   G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
+
+  /**
+   * IdeBuildResult::log-lines:
+   * @self: An #IdeBuildResult
+   * @begin: the number of the first new line
+   * @end: the number of the line after the last new line
+   *
+   * Emitted on the main thread once for a batch of lines appended to the
+   * log returned from ide_build_result_get_log(). Prefer this over
+   * #IdeBuildResult::log, which is emitted once for every line.
+   */
+  signals [LOG_LINES] =
+    g_signal_new ("log-lines",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (IdeBuildResultClass, log_lines),
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE,
+                  2,
+                  G_TYPE_UINT64,
+                  G_TYPE_UINT64);
 }
 
 static void
@@ -673,7 +787,7 @@ ide_build_result_init (IdeBuildResult *self)
 
   priv->timer = g_timer_new ();
 
-  priv->log_queue = g_async_queue_new ();
+  priv->log = ide_build_log_new (LOG_MAX_SIZE);
 
   priv->log_source = g_timeout_source_new (G_MAXINT);
   g_source_set_ready_time (priv->log_source, -1);
@@ -682,6 +796,25 @@ ide_build_result_init (IdeBuildResult *self)
   g_source_attach (priv->log_source, g_main_context_default ());
 }
 
+/**
+ * ide_build_result_get_log:
+ *
+ * Gets the lines logged by the build. Only the most recent lines are kept
+ * in memory; use ide_build_result_get_stdout_stream() and
+ * ide_build_result_get_stderr_stream() for the complete output.
+ *
+ * Returns: (transfer none): An #IdeBuildLog.
+ */
+IdeBuildLog *
+ide_build_result_get_log (IdeBuildResult *self)
+{
+  IdeBuildResultPrivate *priv = ide_build_result_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_BUILD_RESULT (self), NULL);
+
+  return priv->log;
+}
+
 GTimeSpan
 ide_build_result_get_running_time (IdeBuildResult *self)
 {
@@ -46,8 +46,10 @@ struct _IdeBuildResultClass
   void (*log)        (IdeBuildResult    *self,
                       IdeBuildResultLog  log,
                       const gchar       *message);
+  void (*log_lines)  (IdeBuildResult    *self,
+                      guint64            begin,
+                      guint64            end);
 
-  gpointer _reserved1;
   gpointer _reserved2;
   gpointer _reserved3;
   gpointer _reserved4;
@@ -61,6 +63,7 @@ GInputStream  *ide_build_result_get_stdout_stream (IdeBuildResult *result);
 GInputStream  *ide_build_result_get_stderr_stream (IdeBuildResult *result);
 void           ide_build_result_log_subprocess    (IdeBuildResult *result,
                                                    IdeSubprocess  *subprocess);
+IdeBuildLog   *ide_build_result_get_log           (IdeBuildResult *self);
 GTimeSpan      ide_build_result_get_running_time  (IdeBuildResult *self);
 gboolean       ide_build_result_get_running       (IdeBuildResult *self);
 void           ide_build_result_set_running       (IdeBuildResult *self,
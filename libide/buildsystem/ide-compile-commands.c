@@ -0,0 +1,956 @@
+/* ide-compile-commands.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-compile-commands"
+
+#include <egg-counter.h>
+#include <string.h>
+
+#include "ide-debug.h"
+
+#include "buildsystem/ide-compile-commands.h"
+#include "threading/ide-thread-pool.h"
+
+/*
+ * IdeCompileCommands provides access to a compile_commands.json database
+ * as produced by meson, cmake, bear and friends.
+ *
+ * These files can be hundreds of megabytes for large projects, so we never
+ * build a JSON tree for them. Instead the file is mapped and scanned once,
+ * picking out the "directory", "file", "command" and "arguments" members
+ * of each entry. Every string is interned in a GStringChunk since nearly
+ * all of the arguments are shared between entries, and entries are indexed
+ * by the absolute path of the source file.
+ *
+ * The database is immutable once parsed. Loading again only re-parses the
+ * file when its modification time changed, and the new database replaces
+ * the old one atomically so that lookups may happen from any thread.
+ */
+
+#define CANCEL_CHECK_INTERVAL 1024
+#define MAX_DEPTH             64
+
+typedef struct
+{
+  volatile gint  ref_count;
+  guint64        mtime;
+  GStringChunk  *strings;
+  GHashTable    *entries;
+} Database;
+
+typedef struct
+{
+  const gchar  *directory;
+  const gchar **argv;
+} CompileInfo;
+
+typedef struct
+{
+  const gchar *pos;
+  const gchar *end;
+} Scanner;
+
+struct _IdeCompileCommands
+{
+  GObject   parent_instance;
+
+  GFile    *file;
+
+  /* Serializes loading so the same file is not parsed twice at once */
+  GMutex    load_mutex;
+
+  /* Protects db, which is swapped when the file is re-parsed */
+  GMutex    mutex;
+  Database *db;
+};
+
+G_DEFINE_TYPE (IdeCompileCommands, ide_compile_commands, G_TYPE_OBJECT)
+
+EGG_DEFINE_COUNTER (entries, "IdeCompileCommands", "Entries", "Number of indexed compile commands")
+
+enum {
+  PROP_0,
+  PROP_FILE,
+  N_PROPS
+};
+
+static GParamSpec *properties [N_PROPS];
+
+static void
+compile_info_free (gpointer data)
+{
+  CompileInfo *info = data;
+
+  g_free (info->argv);
+  g_slice_free (CompileInfo, info);
+}
+
+static Database *
+database_new (guint64 mtime)
+{
+  Database *db;
+
+  db = g_slice_new0 (Database);
+  db->ref_count = 1;
+  db->mtime = mtime;
+  db->strings = g_string_chunk_new (4096 * 4);
+  db->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, compile_info_free);
+
+  return db;
+}
+
+static Database *
+database_ref (Database *db)
+{
+  g_assert (db != NULL);
+  g_assert (db->ref_count > 0);
+
+  g_atomic_int_inc (&db->ref_count);
+
+  return db;
+}
+
+static void
+database_unref (Database *db)
+{
+  g_assert (db != NULL);
+  g_assert (db->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&db->ref_count))
+    {
+      EGG_COUNTER_SUB (entries, g_hash_table_size (db->entries));
+      g_clear_pointer (&db->entries, g_hash_table_unref);
+      g_clear_pointer (&db->strings, g_string_chunk_free);
+      g_slice_free (Database, db);
+    }
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (Database, database_unref)
+
+static gchar *
+resolve_path (const gchar *directory,
+              const gchar *path)
+{
+  g_autoptr(GFile) base = NULL;
+  g_autoptr(GFile) file = NULL;
+
+  g_assert (directory != NULL);
+  g_assert (path != NULL);
+
+  /* GFile takes care of removing "." and ".." for us */
+  if (g_path_is_absolute (path))
+    {
+      file = g_file_new_for_path (path);
+    }
+  else
+    {
+      base = g_file_new_for_path (directory);
+      file = g_file_resolve_relative_path (base, path);
+    }
+
+  return g_file_get_path (file);
+}
+
+static inline void
+scanner_skip_space (Scanner *s)
+{
+  while (s->pos < s->end && g_ascii_isspace (*s->pos))
+    s->pos++;
+}
+
+static inline gboolean
+scanner_expect (Scanner *s,
+                gchar    ch)
+{
+  scanner_skip_space (s);
+
+  if (s->pos < s->end && *s->pos == ch)
+    {
+      s->pos++;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+scanner_read_hex4 (Scanner  *s,
+                   gunichar *ch)
+{
+  guint i;
+
+  if (s->end - s->pos < 4)
+    return FALSE;
+
+  *ch = 0;
+
+  for (i = 0; i < 4; i++)
+    {
+      gint v = g_ascii_xdigit_value (s->pos [i]);
+
+      if (v < 0)
+        return FALSE;
+
+      *ch = (*ch << 4) | v;
+    }
+
+  s->pos += 4;
+
+  return TRUE;
+}
+
+static gboolean
+scanner_read_string (Scanner *s,
+                     GString *str)
+{
+  g_string_truncate (str, 0);
+
+  if (!scanner_expect (s, '"'))
+    return FALSE;
+
+  while (s->pos < s->end)
+    {
+      const gchar *begin = s->pos;
+      gunichar ch;
+      gunichar low;
+
+      while (s->pos < s->end && *s->pos != '"' && *s->pos != '\\')
+        s->pos++;
+
+      g_string_append_len (str, begin, s->pos - begin);
+
+      if (s->pos >= s->end)
+        break;
+
+      if (*s->pos == '"')
+        {
+          s->pos++;
+          return TRUE;
+        }
+
+      /* Skip the backslash */
+      if (++s->pos >= s->end)
+        break;
+
+      switch (*s->pos++)
+        {
+        case '"':  g_string_append_c (str, '"');  break;
+        case '\\': g_string_append_c (str, '\\'); break;
+        case '/':  g_string_append_c (str, '/');  break;
+        case 'b':  g_string_append_c (str, '\b'); break;
+        case 'f':  g_string_append_c (str, '\f'); break;
+        case 'n':  g_string_append_c (str, '\n'); break;
+        case 'r':  g_string_append_c (str, '\r'); break;
+        case 't':  g_string_append_c (str, '\t'); break;
+
+        case 'u':
+          if (!scanner_read_hex4 (s, &ch))
+            return FALSE;
+
+          /* Characters outside the BMP are encoded as surrogate pairs */
+          if (ch >= 0xD800 && ch < 0xDC00)
+            {
+              if (s->end - s->pos < 2 || s->pos [0] != '\\' || s->pos [1] != 'u')
+                return FALSE;
+
+              s->pos += 2;
+
+              if (!scanner_read_hex4 (s, &low) || low < 0xDC00 || low > 0xDFFF)
+                return FALSE;
+
+              ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+            }
+
+          g_string_append_unichar (str, ch);
+          break;
+
+        default:
+          return FALSE;
+        }
+    }
+
+  return FALSE;
+}
+
+static gboolean
+scanner_skip_value (Scanner *s,
+                    GString *scratch,
+                    guint    depth)
+{
+  const gchar *begin;
+
+  if (depth > MAX_DEPTH)
+    return FALSE;
+
+  scanner_skip_space (s);
+
+  if (s->pos >= s->end)
+    return FALSE;
+
+  switch (*s->pos)
+    {
+    case '"':
+      return scanner_read_string (s, scratch);
+
+    case '[':
+      s->pos++;
+      if (scanner_expect (s, ']'))
+        return TRUE;
+      do
+        {
+          if (!scanner_skip_value (s, scratch, depth + 1))
+            return FALSE;
+        }
+      while (scanner_expect (s, ','));
+      return scanner_expect (s, ']');
+
+    case '{':
+      s->pos++;
+      if (scanner_expect (s, '}'))
+        return TRUE;
+      do
+        {
+          if (!scanner_read_string (s, scratch) ||
+              !scanner_expect (s, ':') ||
+              !scanner_skip_value (s, scratch, depth + 1))
+            return FALSE;
+        }
+      while (scanner_expect (s, ','));
+      return scanner_expect (s, '}');
+
+    default:
+      /* Numbers, true, false and null */
+      begin = s->pos;
+      while (s->pos < s->end &&
+             (g_ascii_isalnum (*s->pos) || *s->pos == '-' || *s->pos == '+' || *s->pos == '.'))
+        s->pos++;
+      return s->pos > begin;
+    }
+}
+
+static void
+database_add (Database     *db,
+              const gchar  *directory,
+              const gchar  *file,
+              const gchar  *command,
+              GPtrArray    *arguments)
+{
+  g_auto(GStrv) parsed = NULL;
+  g_autofree gchar *path = NULL;
+  CompileInfo *info;
+  guint n_args;
+  guint i;
+
+  g_assert (db != NULL);
+  g_assert (directory != NULL);
+  g_assert (file != NULL);
+
+  path = resolve_path (directory, file);
+
+  /* Like compilers do with repeated flags, the first entry wins */
+  if (path == NULL || g_hash_table_contains (db->entries, path))
+    return;
+
+  if (arguments == NULL)
+    {
+      if (command == NULL || !g_shell_parse_argv (command, NULL, &parsed, NULL))
+        return;
+      n_args = g_strv_length (parsed);
+    }
+  else
+    {
+      n_args = arguments->len;
+    }
+
+  info = g_slice_new0 (CompileInfo);
+  info->directory = g_string_chunk_insert_const (db->strings, directory);
+  info->argv = g_new (const gchar *, n_args + 1);
+
+  for (i = 0; i < n_args; i++)
+    {
+      const gchar *arg = parsed ? parsed [i] : g_ptr_array_index (arguments, i);
+
+      info->argv [i] = g_string_chunk_insert_const (db->strings, arg);
+    }
+
+  info->argv [n_args] = NULL;
+
+  g_hash_table_insert (db->entries, g_string_chunk_insert_const (db->strings, path), info);
+
+  EGG_COUNTER_INC (entries);
+}
+
+static gboolean
+database_parse_entry (Database  *db,
+                      Scanner   *s,
+                      GString   *scratch,
+                      GPtrArray *arguments)
+{
+  g_autofree gchar *directory = NULL;
+  g_autofree gchar *file = NULL;
+  g_autofree gchar *command = NULL;
+  gboolean has_arguments = FALSE;
+
+  g_assert (db != NULL);
+  g_assert (s != NULL);
+  g_assert (scratch != NULL);
+  g_assert (arguments != NULL);
+
+  g_ptr_array_set_size (arguments, 0);
+
+  if (!scanner_expect (s, '{'))
+    return FALSE;
+
+  if (scanner_expect (s, '}'))
+    return TRUE;
+
+  do
+    {
+      if (!scanner_read_string (s, scratch) || !scanner_expect (s, ':'))
+        return FALSE;
+
+      if (g_str_equal (scratch->str, "directory"))
+        {
+          if (!scanner_read_string (s, scratch))
+            return FALSE;
+          g_free (directory);
+          directory = g_strndup (scratch->str, scratch->len);
+        }
+      else if (g_str_equal (scratch->str, "file"))
+        {
+          if (!scanner_read_string (s, scratch))
+            return FALSE;
+          g_free (file);
+          file = g_strndup (scratch->str, scratch->len);
+        }
+      else if (g_str_equal (scratch->str, "command"))
+        {
+          if (!scanner_read_string (s, scratch))
+            return FALSE;
+          g_free (command);
+          command = g_strndup (scratch->str, scratch->len);
+        }
+      else if (g_str_equal (scratch->str, "arguments"))
+        {
+          if (!scanner_expect (s, '['))
+            return FALSE;
+
+          g_ptr_array_set_size (arguments, 0);
+          has_arguments = TRUE;
+
+          if (!scanner_expect (s, ']'))
+            {
+              do
+                {
+                  if (!scanner_read_string (s, scratch))
+                    return FALSE;
+                  g_ptr_array_add (arguments, g_strndup (scratch->str, scratch->len));
+                }
+              while (scanner_expect (s, ','));
+
+              if (!scanner_expect (s, ']'))
+                return FALSE;
+            }
+        }
+      else if (!scanner_skip_value (s, scratch, 0))
+        {
+          return FALSE;
+        }
+    }
+  while (scanner_expect (s, ','));
+
+  if (!scanner_expect (s, '}'))
+    return FALSE;
+
+  /* Ignore incomplete entries rather than failing the whole database */
+  if (directory != NULL && file != NULL)
+    database_add (db, directory, file, command, has_arguments ? arguments : NULL);
+
+  return TRUE;
+}
+
+static gboolean
+database_parse (Database      *db,
+                const gchar   *data,
+                gsize          len,
+                GCancellable  *cancellable,
+                GError       **error)
+{
+  g_autoptr(GPtrArray) arguments = NULL;
+  g_autoptr(GString) scratch = NULL;
+  Scanner s = { data, data + len };
+  guint n_entries = 0;
+
+  g_assert (db != NULL);
+
+  if (data == NULL)
+    goto failure;
+
+  scratch = g_string_new (NULL);
+  arguments = g_ptr_array_new_with_free_func (g_free);
+
+  if (!scanner_expect (&s, '['))
+    goto failure;
+
+  if (!scanner_expect (&s, ']'))
+    {
+      do
+        {
+          if ((++n_entries % CANCEL_CHECK_INTERVAL) == 0 &&
+              g_cancellable_set_error_if_cancelled (cancellable, error))
+            return FALSE;
+
+          if (!database_parse_entry (db, &s, scratch, arguments))
+            goto failure;
+        }
+      while (scanner_expect (&s, ','));
+
+      if (!scanner_expect (&s, ']'))
+        goto failure;
+    }
+
+  return TRUE;
+
+failure:
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_INVALID_DATA,
+               "Failed to parse compile commands near offset %"G_GSIZE_FORMAT,
+               (gsize)(s.pos - data));
+
+  return FALSE;
+}
+
+static Database *
+ide_compile_commands_dup_database (IdeCompileCommands *self)
+{
+  Database *db = NULL;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+
+  g_mutex_lock (&self->mutex);
+  if (self->db != NULL)
+    db = database_ref (self->db);
+  g_mutex_unlock (&self->mutex);
+
+  return db;
+}
+
+/**
+ * ide_compile_commands_load:
+ * @self: An #IdeCompileCommands
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @error: A location for a #GError or %NULL
+ *
+ * Synchronously loads the database, if it has not been loaded or if the
+ * file has been modified since it was loaded. Otherwise, this only costs
+ * a stat() of the file.
+ *
+ * This may be called from a thread.
+ *
+ * Returns: %TRUE if the database is available; otherwise %FALSE and
+ *   @error is set.
+ */
+gboolean
+ide_compile_commands_load (IdeCompileCommands  *self,
+                           GCancellable        *cancellable,
+                           GError             **error)
+{
+  g_autoptr(GFileInfo) info = NULL;
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(Database) current = NULL;
+  g_autoptr(Database) db = NULL;
+  g_autofree gchar *path = NULL;
+  gboolean ret = FALSE;
+  guint64 mtime;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (IDE_IS_COMPILE_COMMANDS (self), FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+
+  g_mutex_lock (&self->load_mutex);
+
+  info = g_file_query_info (self->file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                            G_FILE_QUERY_INFO_NONE,
+                            cancellable,
+                            error);
+
+  if (info == NULL)
+    goto unlock;
+
+  mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+        + g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+  current = ide_compile_commands_dup_database (self);
+
+  if (current != NULL && current->mtime == mtime)
+    {
+      ret = TRUE;
+      goto unlock;
+    }
+
+  if (NULL == (path = g_file_get_path (self->file)))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "Compile commands must be on a local filesystem");
+      goto unlock;
+    }
+
+  if (NULL == (mapped = g_mapped_file_new (path, FALSE, error)))
+    goto unlock;
+
+  db = database_new (mtime);
+
+  if (!database_parse (db,
+                       g_mapped_file_get_contents (mapped),
+                       g_mapped_file_get_length (mapped),
+                       cancellable,
+                       error))
+    goto unlock;
+
+  IDE_TRACE_MSG ("Indexed %u compile commands from %s",
+                 g_hash_table_size (db->entries), path);
+
+  g_mutex_lock (&self->mutex);
+  g_clear_pointer (&self->db, database_unref);
+  self->db = g_steal_pointer (&db);
+  g_mutex_unlock (&self->mutex);
+
+  ret = TRUE;
+
+unlock:
+  g_mutex_unlock (&self->load_mutex);
+
+  IDE_RETURN (ret);
+}
+
+static void
+ide_compile_commands_load_worker (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  IdeCompileCommands *self = source_object;
+  GError *error = NULL;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+
+  if (!ide_compile_commands_load (self, cancellable, &error))
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * ide_compile_commands_load_async:
+ * @self: An #IdeCompileCommands
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @callback: A callback to execute upon completion
+ * @user_data: User data for @callback
+ *
+ * Asynchronously loads the database. See ide_compile_commands_load() for
+ * details. It is cheap to call this before every lookup.
+ */
+void
+ide_compile_commands_load_async (IdeCompileCommands  *self,
+                                 GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+
+  g_return_if_fail (IDE_IS_COMPILE_COMMANDS (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ide_compile_commands_load_async);
+
+  ide_thread_pool_push_task (IDE_THREAD_POOL_COMPILER, task, ide_compile_commands_load_worker);
+}
+
+/**
+ * ide_compile_commands_load_finish:
+ * @self: An #IdeCompileCommands
+ * @result: A #GAsyncResult
+ * @error: A location for a #GError or %NULL
+ *
+ * Completes an asynchronous request to ide_compile_commands_load_async().
+ *
+ * Returns: %TRUE if the database is available; otherwise %FALSE and
+ *   @error is set.
+ */
+gboolean
+ide_compile_commands_load_finish (IdeCompileCommands  *self,
+                                  GAsyncResult        *result,
+                                  GError             **error)
+{
+  g_return_val_if_fail (IDE_IS_COMPILE_COMMANDS (self), FALSE);
+  g_return_val_if_fail (G_IS_TASK (result), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static inline void
+add_path (GPtrArray   *ar,
+          const gchar *prefix,
+          const gchar *directory,
+          const gchar *path)
+{
+  g_autofree gchar *resolved = resolve_path (directory, path);
+
+  if (resolved != NULL)
+    g_ptr_array_add (ar, g_strconcat (prefix, resolved, NULL));
+}
+
+/**
+ * ide_compile_commands_lookup:
+ * @self: An #IdeCompileCommands
+ * @file: The source file to lookup
+ * @directory: (out) (optional) (transfer full): A location for the
+ *   directory the command is executed in, or %NULL
+ * @error: A location for a #GError or %NULL
+ *
+ * Gets the flags used to compile @file, suitable for use with clang.
+ * Include paths are made absolute, and the compiler, source and output
+ * arguments are removed.
+ *
+ * The database must have been loaded with ide_compile_commands_load() or
+ * ide_compile_commands_load_async().
+ *
+ * Returns: (transfer full) (array zero-terminated=1): A newly allocated
+ *   string array, or %NULL and @error is set.
+ */
+gchar **
+ide_compile_commands_lookup (IdeCompileCommands  *self,
+                             GFile               *file,
+                             GFile              **directory,
+                             GError             **error)
+{
+  g_autoptr(Database) db = NULL;
+  g_autofree gchar *path = NULL;
+  const CompileInfo *info;
+  GPtrArray *ar;
+  guint i;
+
+  g_return_val_if_fail (IDE_IS_COMPILE_COMMANDS (self), NULL);
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+  if (directory != NULL)
+    *directory = NULL;
+
+  if (NULL == (db = ide_compile_commands_dup_database (self)))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_INITIALIZED,
+                   "Compile commands have not been loaded");
+      return NULL;
+    }
+
+  path = g_file_get_path (file);
+
+  if (path == NULL || NULL == (info = g_hash_table_lookup (db->entries, path)))
+    {
+      g_autofree gchar *name = g_file_get_uri (file);
+
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_FOUND,
+                   "No compile command found for %s",
+                   name);
+      return NULL;
+    }
+
+  ar = g_ptr_array_new ();
+
+  /*
+   * Keep the flags that affect how the file is parsed, much like the
+   * autotools makecache does. Everything else, such as the compiler,
+   * inputs, outputs and dependency generation, is dropped.
+   */
+  for (i = 1; info->argv [0] != NULL && info->argv [i] != NULL; i++)
+    {
+      const gchar *arg = info->argv [i];
+      const gchar *next = info->argv [i + 1];
+
+      if (arg [0] != '-' || arg [1] == '\0')
+        continue;
+
+      if (g_str_equal (arg, "-I") ||
+          g_str_equal (arg, "-isystem") ||
+          g_str_equal (arg, "-iquote") ||
+          g_str_equal (arg, "-idirafter") ||
+          g_str_equal (arg, "-include"))
+        {
+          if (next != NULL)
+            {
+              g_ptr_array_add (ar, g_strdup (arg));
+              add_path (ar, "", info->directory, next);
+              i++;
+            }
+        }
+      else if (g_str_has_prefix (arg, "-I"))
+        add_path (ar, "-I", info->directory, arg + 2);
+      else if (g_str_has_prefix (arg, "-isystem"))
+        add_path (ar, "-isystem", info->directory, arg + strlen ("-isystem"));
+      else if (g_str_has_prefix (arg, "-iquote"))
+        add_path (ar, "-iquote", info->directory, arg + strlen ("-iquote"));
+      else if (g_str_equal (arg, "-D") || g_str_equal (arg, "-U") || g_str_equal (arg, "-x"))
+        {
+          if (next != NULL)
+            {
+              g_ptr_array_add (ar, g_strdup (arg));
+              g_ptr_array_add (ar, g_strdup (next));
+              i++;
+            }
+        }
+      else if (arg [1] == 'D' ||
+               arg [1] == 'U' ||
+               arg [1] == 'x' ||
+               arg [1] == 'f' ||
+               arg [1] == 'W' ||
+               arg [1] == 'm' ||
+               g_str_has_prefix (arg, "-std=") ||
+               g_str_equal (arg, "-pthread"))
+        g_ptr_array_add (ar, g_strdup (arg));
+    }
+
+  g_ptr_array_add (ar, NULL);
+
+  if (directory != NULL)
+    *directory = g_file_new_for_path (info->directory);
+
+  return (gchar **)g_ptr_array_free (ar, FALSE);
+}
+
+/**
+ * ide_compile_commands_get_file:
+ *
+ * Gets the compile_commands.json file backing the database.
+ *
+ * Returns: (transfer none): A #GFile.
+ */
+GFile *
+ide_compile_commands_get_file (IdeCompileCommands *self)
+{
+  g_return_val_if_fail (IDE_IS_COMPILE_COMMANDS (self), NULL);
+
+  return self->file;
+}
+
+static void
+ide_compile_commands_finalize (GObject *object)
+{
+  IdeCompileCommands *self = (IdeCompileCommands *)object;
+
+  g_clear_object (&self->file);
+  g_clear_pointer (&self->db, database_unref);
+  g_mutex_clear (&self->mutex);
+  g_mutex_clear (&self->load_mutex);
+
+  G_OBJECT_CLASS (ide_compile_commands_parent_class)->finalize (object);
+}
+
+static void
+ide_compile_commands_get_property (GObject    *object,
+                                   guint       prop_id,
+                                   GValue     *value,
+                                   GParamSpec *pspec)
+{
+  IdeCompileCommands *self = IDE_COMPILE_COMMANDS (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      g_value_set_object (value, self->file);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+ide_compile_commands_set_property (GObject      *object,
+                                   guint         prop_id,
+                                   const GValue *value,
+                                   GParamSpec   *pspec)
+{
+  IdeCompileCommands *self = IDE_COMPILE_COMMANDS (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      self->file = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+ide_compile_commands_class_init (IdeCompileCommandsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_compile_commands_finalize;
+  object_class->get_property = ide_compile_commands_get_property;
+  object_class->set_property = ide_compile_commands_set_property;
+
+  properties [PROP_FILE] =
+    g_param_spec_object ("file",
+                         "File",
+                         "The compile_commands.json file",
+                         G_TYPE_FILE,
+                         (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
+}
+
+static void
+ide_compile_commands_init (IdeCompileCommands *self)
+{
+  g_mutex_init (&self->mutex);
+  g_mutex_init (&self->load_mutex);
+}
+
+/**
+ * ide_compile_commands_new:
+ * @file: A #GFile for a compile_commands.json
+ *
+ * Creates a new #IdeCompileCommands for @file. The file is not read until
+ * ide_compile_commands_load_async() is called.
+ *
+ * Returns: (transfer full): An #IdeCompileCommands.
+ */
+IdeCompileCommands *
+ide_compile_commands_new (GFile *file)
+{
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+  return g_object_new (IDE_TYPE_COMPILE_COMMANDS,
+                       "file", file,
+                       NULL);
+}
@@ -0,0 +1,484 @@
+/* ide-diagnostics-index.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-diagnostics-index"
+
+#include <string.h>
+
+#include "diagnostics/ide-diagnostics-index.h"
+
+/*
+ * IdeDiagnosticsIndex keeps the line ranges covered by the diagnostics of a
+ * buffer so that the gutter and hover lookups do not need to walk every
+ * diagnostic (or every line of every diagnostic).
+ *
+ * The ranges are kept in an array sorted by their first line, which doubles
+ * as an implicit balanced interval tree: the node for the range [lo,hi) of
+ * the array is the element at the midpoint, and each element caches the
+ * largest end line found within its subtree. That lets us find the ranges
+ * overlapping a line range in O(log n + k) without any extra allocations.
+ *
+ * When lines are inserted or removed from the buffer, the ranges are shifted
+ * in place. Shifting is monotonic, so the array stays sorted and only the
+ * cached end lines need to be recalculated, which is done lazily on the next
+ * query.
+ */
+
+typedef struct
+{
+  guint                  begin_line;
+  guint                  end_line;
+  guint                  max_end_line;
+  guint                  begin_column;
+  guint                  end_column;
+  IdeDiagnosticSeverity  severity;
+  IdeDiagnostic         *diagnostic;
+} Range;
+
+struct _IdeDiagnosticsIndex
+{
+  GArray   *ranges;
+  guint     needs_sort : 1;
+  guint     needs_build : 1;
+};
+
+typedef void (*RangeFunc) (const Range *range,
+                           gpointer     user_data);
+
+IdeDiagnosticsIndex *
+ide_diagnostics_index_new (void)
+{
+  IdeDiagnosticsIndex *self;
+
+  self = g_slice_new0 (IdeDiagnosticsIndex);
+  self->ranges = g_array_new (FALSE, FALSE, sizeof (Range));
+
+  return self;
+}
+
+void
+ide_diagnostics_index_free (IdeDiagnosticsIndex *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->ranges, g_array_unref);
+      g_slice_free (IdeDiagnosticsIndex, self);
+    }
+}
+
+void
+ide_diagnostics_index_clear (IdeDiagnosticsIndex *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_array_set_size (self->ranges, 0);
+
+  self->needs_sort = FALSE;
+  self->needs_build = FALSE;
+}
+
+guint
+ide_diagnostics_index_get_size (IdeDiagnosticsIndex *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->ranges->len;
+}
+
+/**
+ * ide_diagnostics_index_add:
+ * @self: An #IdeDiagnosticsIndex
+ * @diagnostic: (nullable): the diagnostic covering the range
+ *
+ * Adds a range covered by @diagnostic. The index does not take a reference
+ * to @diagnostic; the caller must keep it alive until the index is cleared.
+ */
+void
+ide_diagnostics_index_add (IdeDiagnosticsIndex   *self,
+                           guint                  begin_line,
+                           guint                  begin_column,
+                           guint                  end_line,
+                           guint                  end_column,
+                           IdeDiagnosticSeverity  severity,
+                           IdeDiagnostic         *diagnostic)
+{
+  Range range;
+
+  g_return_if_fail (self != NULL);
+
+  if (end_line < begin_line || (end_line == begin_line && end_column < begin_column))
+    {
+      guint tmp;
+
+      tmp = begin_line, begin_line = end_line, end_line = tmp;
+      tmp = begin_column, begin_column = end_column, end_column = tmp;
+    }
+
+  range.begin_line = begin_line;
+  range.end_line = end_line;
+  range.max_end_line = end_line;
+  range.begin_column = begin_column;
+  range.end_column = end_column;
+  range.severity = severity;
+  range.diagnostic = diagnostic;
+
+  if (self->ranges->len > 0)
+    {
+      const Range *last = &g_array_index (self->ranges, Range, self->ranges->len - 1);
+
+      if (last->begin_line > begin_line)
+        self->needs_sort = TRUE;
+    }
+
+  g_array_append_val (self->ranges, range);
+
+  self->needs_build = TRUE;
+}
+
+/**
+ * ide_diagnostics_index_insert_lines:
+ * @self: An #IdeDiagnosticsIndex
+ * @line: the first line to move
+ * @n_lines: the number of lines inserted
+ *
+ * Moves the ranges at or after @line down by @n_lines. Ranges spanning @line
+ * grow to cover the inserted lines.
+ */
+void
+ide_diagnostics_index_insert_lines (IdeDiagnosticsIndex *self,
+                                    guint                line,
+                                    guint                n_lines)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+
+  if (n_lines == 0)
+    return;
+
+  for (i = 0; i < self->ranges->len; i++)
+    {
+      Range *range = &g_array_index (self->ranges, Range, i);
+
+      if (range->begin_line >= line)
+        range->begin_line += n_lines;
+
+      if (range->end_line >= line)
+        range->end_line += n_lines;
+    }
+
+  self->needs_build = TRUE;
+}
+
+/**
+ * ide_diagnostics_index_remove_lines:
+ * @self: An #IdeDiagnosticsIndex
+ * @line: the line which the removed lines are joined into
+ * @n_lines: the number of lines removed
+ *
+ * Handles the lines after @line, up to and including @line + @n_lines,
+ * being joined into @line. Ranges on those lines collapse onto @line and
+ * the ranges after them move up by @n_lines.
+ */
+void
+ide_diagnostics_index_remove_lines (IdeDiagnosticsIndex *self,
+                                    guint                line,
+                                    guint                n_lines)
+{
+  guint i;
+
+  g_return_if_fail (self != NULL);
+
+  if (n_lines == 0)
+    return;
+
+  for (i = 0; i < self->ranges->len; i++)
+    {
+      Range *range = &g_array_index (self->ranges, Range, i);
+
+      if (range->begin_line > line + n_lines)
+        range->begin_line -= n_lines;
+      else if (range->begin_line > line)
+        range->begin_line = line;
+
+      if (range->end_line > line + n_lines)
+        range->end_line -= n_lines;
+      else if (range->end_line > line)
+        range->end_line = line;
+    }
+
+  self->needs_build = TRUE;
+}
+
+static gint
+compare_range (gconstpointer a,
+               gconstpointer b)
+{
+  const Range *range_a = a;
+  const Range *range_b = b;
+
+  if (range_a->begin_line < range_b->begin_line)
+    return -1;
+  else if (range_a->begin_line > range_b->begin_line)
+    return 1;
+
+  return 0;
+}
+
+static guint
+ide_diagnostics_index_build (Range *ranges,
+                             guint  lo,
+                             guint  hi)
+{
+  guint mid;
+  guint max_end_line;
+
+  if (lo >= hi)
+    return 0;
+
+  mid = lo + (hi - lo) / 2;
+
+  max_end_line = ranges [mid].end_line;
+  max_end_line = MAX (max_end_line, ide_diagnostics_index_build (ranges, lo, mid));
+  max_end_line = MAX (max_end_line, ide_diagnostics_index_build (ranges, mid + 1, hi));
+
+  ranges [mid].max_end_line = max_end_line;
+
+  return max_end_line;
+}
+
+static void
+ide_diagnostics_index_ensure (IdeDiagnosticsIndex *self)
+{
+  g_assert (self != NULL);
+
+  if (self->needs_sort)
+    {
+      g_array_sort (self->ranges, compare_range);
+      self->needs_sort = FALSE;
+    }
+
+  if (self->needs_build)
+    {
+      ide_diagnostics_index_build ((Range *)(gpointer)self->ranges->data, 0, self->ranges->len);
+      self->needs_build = FALSE;
+    }
+}
+
+static void
+ide_diagnostics_index_query (const Range *ranges,
+                             guint        lo,
+                             guint        hi,
+                             guint        first_line,
+                             guint        last_line,
+                             RangeFunc    func,
+                             gpointer     user_data)
+{
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      const Range *range = &ranges [mid];
+
+      /* Nothing within this subtree reaches first_line */
+      if (range->max_end_line < first_line)
+        return;
+
+      ide_diagnostics_index_query (ranges, lo, mid, first_line, last_line, func, user_data);
+
+      /* Everything after mid begins after last_line */
+      if (range->begin_line > last_line)
+        return;
+
+      if (range->end_line >= first_line)
+        func (range, user_data);
+
+      lo = mid + 1;
+    }
+}
+
+static void
+ide_diagnostics_index_foreach (IdeDiagnosticsIndex *self,
+                               guint                first_line,
+                               guint                last_line,
+                               RangeFunc            func,
+                               gpointer             user_data)
+{
+  g_assert (self != NULL);
+  g_assert (first_line <= last_line);
+  g_assert (func != NULL);
+
+  ide_diagnostics_index_ensure (self);
+  ide_diagnostics_index_query ((const Range *)(gconstpointer)self->ranges->data,
+                               0,
+                               self->ranges->len,
+                               first_line,
+                               last_line,
+                               func,
+                               user_data);
+}
+
+static void
+get_severity_cb (const Range *range,
+                 gpointer     user_data)
+{
+  IdeDiagnosticSeverity *severity = user_data;
+
+  if (range->severity > *severity)
+    *severity = range->severity;
+}
+
+/**
+ * ide_diagnostics_index_get_severity:
+ * @self: An #IdeDiagnosticsIndex
+ * @line: a line number
+ *
+ * Gets the highest severity of the ranges covering @line.
+ *
+ * Returns: An #IdeDiagnosticSeverity, or %IDE_DIAGNOSTIC_IGNORED if no range
+ *   covers @line.
+ */
+IdeDiagnosticSeverity
+ide_diagnostics_index_get_severity (IdeDiagnosticsIndex *self,
+                                    guint                line)
+{
+  IdeDiagnosticSeverity severity = IDE_DIAGNOSTIC_IGNORED;
+
+  g_return_val_if_fail (self != NULL, IDE_DIAGNOSTIC_IGNORED);
+
+  ide_diagnostics_index_foreach (self, line, line, get_severity_cb, &severity);
+
+  return severity;
+}
+
+typedef struct
+{
+  guint   first_line;
+  guint   last_line;
+  guint8 *severities;
+} GetSeverities;
+
+static void
+get_severities_cb (const Range *range,
+                   gpointer     user_data)
+{
+  GetSeverities *state = user_data;
+  guint begin = MAX (range->begin_line, state->first_line);
+  guint end = MIN (range->end_line, state->last_line);
+  guint i;
+
+  for (i = begin; i <= end; i++)
+    {
+      guint8 *severity = &state->severities [i - state->first_line];
+
+      if (range->severity > *severity)
+        *severity = range->severity;
+    }
+}
+
+/**
+ * ide_diagnostics_index_get_severities:
+ * @self: An #IdeDiagnosticsIndex
+ * @first_line: the first line
+ * @last_line: the last line, inclusive
+ * @severities: (array): an array of @last_line - @first_line + 1 elements
+ *
+ * Stores the highest severity of the ranges covering each line from
+ * @first_line to @last_line into @severities. This is useful to fetch the
+ * severities for all of the visible lines at once.
+ */
+void
+ide_diagnostics_index_get_severities (IdeDiagnosticsIndex *self,
+                                      guint                first_line,
+                                      guint                last_line,
+                                      guint8              *severities)
+{
+  GetSeverities state;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (first_line <= last_line);
+  g_return_if_fail (severities != NULL);
+
+  memset (severities, IDE_DIAGNOSTIC_IGNORED, last_line - first_line + 1);
+
+  state.first_line = first_line;
+  state.last_line = last_line;
+  state.severities = severities;
+
+  ide_diagnostics_index_foreach (self, first_line, last_line, get_severities_cb, &state);
+}
+
+typedef struct
+{
+  guint          line;
+  guint          column;
+  guint          distance;
+  IdeDiagnostic *diagnostic;
+} GetNearest;
+
+static void
+get_nearest_cb (const Range *range,
+                gpointer     user_data)
+{
+  GetNearest *state = user_data;
+  guint begin_column;
+  guint end_column;
+  guint distance;
+
+  if (range->diagnostic == NULL)
+    return;
+
+  begin_column = (range->begin_line == state->line) ? range->begin_column : 0;
+  end_column = (range->end_line == state->line) ? range->end_column : G_MAXUINT;
+
+  if (state->column < begin_column)
+    distance = begin_column - state->column;
+  else if (state->column > end_column)
+    distance = state->column - end_column;
+  else
+    distance = 0;
+
+  if (distance < state->distance)
+    {
+      state->distance = distance;
+      state->diagnostic = range->diagnostic;
+    }
+}
+
+/**
+ * ide_diagnostics_index_get_nearest:
+ * @self: An #IdeDiagnosticsIndex
+ * @line: a line number
+ * @column: a column within @line
+ *
+ * Finds the diagnostic covering @line whose range is closest to @column.
+ *
+ * Returns: (transfer none) (nullable): An #IdeDiagnostic or %NULL.
+ */
+IdeDiagnostic *
+ide_diagnostics_index_get_nearest (IdeDiagnosticsIndex *self,
+                                   guint                line,
+                                   guint                column)
+{
+  GetNearest state = { line, column, G_MAXUINT, NULL };
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  ide_diagnostics_index_foreach (self, line, line, get_nearest_cb, &state);
+
+  return state.diagnostic;
+}
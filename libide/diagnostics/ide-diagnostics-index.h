@@ -0,0 +1,59 @@
+/* ide-diagnostics-index.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_DIAGNOSTICS_INDEX_H
+#define IDE_DIAGNOSTICS_INDEX_H
+
+#include "ide-types.h"
+
+#include "diagnostics/ide-diagnostic.h"
+
+G_BEGIN_DECLS
+
+typedef struct _IdeDiagnosticsIndex IdeDiagnosticsIndex;
+
+IdeDiagnosticsIndex   *ide_diagnostics_index_new            (void);
+void                   ide_diagnostics_index_free           (IdeDiagnosticsIndex   *self);
+void                   ide_diagnostics_index_clear          (IdeDiagnosticsIndex   *self);
+guint                  ide_diagnostics_index_get_size       (IdeDiagnosticsIndex   *self);
+void                   ide_diagnostics_index_add            (IdeDiagnosticsIndex   *self,
+                                                             guint                  begin_line,
+                                                             guint                  begin_column,
+                                                             guint                  end_line,
+                                                             guint                  end_column,
+                                                             IdeDiagnosticSeverity  severity,
+                                                             IdeDiagnostic         *diagnostic);
+void                   ide_diagnostics_index_insert_lines   (IdeDiagnosticsIndex   *self,
+                                                             guint                  line,
+                                                             guint                  n_lines);
+void                   ide_diagnostics_index_remove_lines   (IdeDiagnosticsIndex   *self,
+                                                             guint                  line,
+                                                             guint                  n_lines);
+IdeDiagnosticSeverity  ide_diagnostics_index_get_severity   (IdeDiagnosticsIndex   *self,
+                                                             guint                  line);
+void                   ide_diagnostics_index_get_severities (IdeDiagnosticsIndex   *self,
+                                                             guint                  first_line,
+                                                             guint                  last_line,
+                                                             guint8                *severities);
+IdeDiagnostic         *ide_diagnostics_index_get_nearest    (IdeDiagnosticsIndex   *self,
+                                                             guint                  line,
+                                                             guint                  column);
+
+G_END_DECLS
+
+#endif /* IDE_DIAGNOSTICS_INDEX_H */
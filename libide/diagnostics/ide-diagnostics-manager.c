@@ -18,10 +18,12 @@
 
 #define G_LOG_DOMAIN "ide-diagnostics-manager"
 
+#include <egg-counter.h>
 #include <gtksourceview/gtksource.h>
 
 #include "ide-context.h"
 #include "ide-debug.h"
+#include "ide-internal.h"
 #include "ide-macros.h"
 
 #include "buffers/ide-buffer.h"
@@ -32,6 +34,36 @@
 #include "diagnostics/ide-diagnostics-manager.h"
 #include "plugins/ide-extension-set-adapter.h"
 
+/*
+ * The number of diagnoses that may be in flight at once for each type of
+ * diagnostic provider. Without this, something like "save all" or switching
+ * branches would start a diagnosis for every open buffer at once, which for
+ * compilers means a parse per buffer competing with the focused one.
+ */
+#define MAX_IN_FLIGHT_PER_PROVIDER 2
+
+/*
+ * Diagnoses are started in order of these priorities, and then in the
+ * order they were queued.
+ */
+enum {
+  PRIORITY_FOCUS,
+  PRIORITY_VISIBLE,
+  PRIORITY_OPEN,
+  PRIORITY_BACKGROUND,
+};
+
+EGG_DEFINE_COUNTER (pending, "IdeDiagnosticsManager", "Pending",
+                    "Number of diagnoses waiting to be started.")
+EGG_DEFINE_COUNTER (in_flight, "IdeDiagnosticsManager", "In Flight",
+                    "Number of diagnoses currently running.")
+EGG_DEFINE_COUNTER (started, "IdeDiagnosticsManager", "Started",
+                    "Number of diagnoses started.")
+EGG_DEFINE_COUNTER (cancelled, "IdeDiagnosticsManager", "Cancelled",
+                    "Number of diagnoses cancelled because the buffer changed.")
+EGG_DEFINE_COUNTER (wait_time, "IdeDiagnosticsManager", "Wait Time",
+                    "Total time in microseconds diagnoses waited before starting.")
+
 typedef struct
 {
   /*
@@ -87,6 +119,18 @@ typedef struct
    */
   guint in_diagnose;
 
+  /*
+   * The number of providers queued to diagnose the group which have not
+   * been started yet.
+   */
+  guint n_pending;
+
+  /*
+   * This is cancelled when the group needs another diagnosis, so that the
+   * diagnoses in flight can stop early since their result is out of date.
+   */
+  GCancellable *cancellable;
+
   /*
    * If we need a diagnose this bit will be set. If we complete a
    * diagnosis and this bit is set, then we will automatically queue
@@ -128,8 +172,27 @@ struct _IdeDiagnosticsManager
    * we can coalesce the dispatch of everything at the same time.
    */
   guint queued_diagnose_source;
+
+  /*
+   * The DiagnoseJob waiting for their provider type to have a free slot,
+   * and the number of jobs in flight for each provider type.
+   */
+  GPtrArray *pending;
+  GHashTable *in_flight_by_type;
+  guint n_in_flight;
 };
 
+typedef struct
+{
+  /* Only set once started, pending jobs must not keep the manager alive */
+  IdeDiagnosticsManager *self;
+  IdeDiagnosticsGroup   *group;
+  IdeDiagnosticProvider *provider;
+  GCancellable          *cancellable;
+  gint64                 queued_at;
+  guint                  priority;
+} DiagnoseJob;
+
 enum {
   PROP_0,
   PROP_BUSY,
@@ -178,6 +241,7 @@ ide_diagnostics_group_free (gpointer data)
   g_assert (group->ref_count == 0);
 
   g_clear_pointer (&group->diagnostics_by_provider, g_hash_table_unref);
+  g_clear_object (&group->cancellable);
   g_weak_ref_clear (&group->buffer_wr);
   g_clear_object (&group->adapter);
   g_clear_object (&group->file);
@@ -295,39 +359,151 @@ ide_diagnostics_group_add (IdeDiagnosticsGroup   *group,
   group->sequence++;
 }
 
+static void
+diagnose_job_free (gpointer data)
+{
+  DiagnoseJob *job = data;
+
+  ide_diagnostics_group_unref (job->group);
+  g_clear_object (&job->self);
+  g_clear_object (&job->provider);
+  g_clear_object (&job->cancellable);
+  g_slice_free (DiagnoseJob, job);
+}
+
+static gint
+diagnose_job_compare (gconstpointer a,
+                      gconstpointer b)
+{
+  const DiagnoseJob *job_a = *(const DiagnoseJob **)a;
+  const DiagnoseJob *job_b = *(const DiagnoseJob **)b;
+
+  if (job_a->priority != job_b->priority)
+    return (gint)job_a->priority - (gint)job_b->priority;
+
+  if (job_a->queued_at < job_b->queued_at)
+    return -1;
+  else if (job_a->queued_at > job_b->queued_at)
+    return 1;
+
+  return 0;
+}
+
+static guint
+ide_diagnostics_manager_get_group_priority (IdeDiagnosticsManager *self,
+                                            IdeDiagnosticsGroup   *group)
+{
+  g_autoptr(IdeBuffer) buffer = NULL;
+  IdeBufferManager *buffer_manager;
+  IdeContext *context;
+
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_assert (group != NULL);
+
+  if (NULL == (buffer = g_weak_ref_get (&group->buffer_wr)))
+    return PRIORITY_BACKGROUND;
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  buffer_manager = ide_context_get_buffer_manager (context);
+
+  if (buffer == ide_buffer_manager_get_focus_buffer (buffer_manager))
+    return PRIORITY_FOCUS;
+
+  if (_ide_buffer_get_mapped (buffer))
+    return PRIORITY_VISIBLE;
+
+  return PRIORITY_OPEN;
+}
+
+static void ide_diagnostics_manager_dispatch (IdeDiagnosticsManager *self);
+
+static void
+ide_diagnostics_group_job_finished (IdeDiagnosticsGroup   *group,
+                                    IdeDiagnosticsManager *self)
+{
+  g_assert (group != NULL);
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  if (group->was_removed || group->in_diagnose > 0 || group->n_pending > 0)
+    return;
+
+  /*
+   * If there are no more diagnostics providers active and the group needs
+   * another diagnosis, then we can start the next one now.
+   *
+   * If we are completing this diagnosis and the buffer was already released
+   * (and other diagnose providers have unloaded), we might be able to clean
+   * up the group and be done with things.
+   */
+  if (group->needs_diagnose)
+    {
+      ide_diagnostics_group_queue_diagnose (group, self);
+    }
+  else if (ide_diagnostics_group_can_dispose (group))
+    {
+      group->was_removed = TRUE;
+      g_hash_table_remove (self->groups_by_file, group->file);
+    }
+}
+
 static void
 ide_diagnostics_group_diagnose_cb (GObject      *object,
                                    GAsyncResult *result,
                                    gpointer      user_data)
 {
   IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)object;
-  g_autoptr(IdeDiagnosticsManager) self = user_data;
   g_autoptr(IdeDiagnostics) diagnostics = NULL;
   g_autoptr(GError) error = NULL;
+  DiagnoseJob *job = user_data;
+  IdeDiagnosticsManager *self;
   IdeDiagnosticsGroup *group;
-  gboolean changed;
+  gboolean changed = FALSE;
+  GType type;
+  guint n_in_flight;
 
   IDE_ENTRY;
 
   g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
   g_assert (G_IS_ASYNC_RESULT (result));
-  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_assert (job != NULL);
 
   IDE_TRACE_MSG ("%s diagnosis completed", G_OBJECT_TYPE_NAME (provider));
 
-  diagnostics = ide_diagnostic_provider_diagnose_finish (provider, result, &error);
+  self = job->self;
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
 
-  if (error != NULL)
-    g_warning ("%s", error->message);
+  type = G_OBJECT_TYPE (provider);
+  n_in_flight = GPOINTER_TO_UINT (g_hash_table_lookup (self->in_flight_by_type, GSIZE_TO_POINTER (type)));
+  g_assert (n_in_flight > 0);
+  g_hash_table_insert (self->in_flight_by_type, GSIZE_TO_POINTER (type), GUINT_TO_POINTER (n_in_flight - 1));
+  self->n_in_flight--;
+  EGG_COUNTER_DEC (in_flight);
+
+  diagnostics = ide_diagnostic_provider_diagnose_finish (provider, result, &error);
 
   /*
-   * This fetches the group our provider belongs to. Since the group is
-   * reference counted (and we only release it when our provider is
-   * finalized), we should be guaranteed we have a valid group.
+   * The job holds a reference to the group our provider belongs to, so it
+   * is still valid even if the provider was unloaded while diagnosing.
    */
-  group = g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP");
+  group = job->group;
   g_assert (group != NULL);
 
+  /*
+   * If the diagnosis was cancelled because the buffer changed, keep the
+   * previous diagnostics around rather than flashing an empty gutter. The
+   * next diagnosis will replace them.
+   */
+  if (g_cancellable_is_cancelled (job->cancellable) ||
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      EGG_COUNTER_INC (cancelled);
+      g_clear_pointer (&diagnostics, ide_diagnostics_unref);
+      goto complete;
+    }
+
+  if (error != NULL)
+    g_warning ("%s", error->message);
+
   /*
    * Clear all of our old diagnostics no matter where they ended up.
    */
@@ -361,6 +537,7 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
         changed = TRUE;
     }
 
+complete:
   group->in_diagnose--;
 
   /*
@@ -380,23 +557,137 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
   if (changed)
     g_signal_emit (self, signals [CHANGED], 0);
 
+  ide_diagnostics_group_job_finished (group, self);
+
+  /* Our provider type has a free slot now */
+  ide_diagnostics_manager_dispatch (self);
+
+  if (!ide_diagnostics_manager_get_busy (self))
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUSY]);
+
+  diagnose_job_free (job);
+
+  IDE_EXIT;
+}
+
+static void
+ide_diagnostics_manager_start_job (IdeDiagnosticsManager *self,
+                                   DiagnoseJob           *job)
+{
+  g_autoptr(IdeBuffer) buffer = NULL;
+  g_autoptr(IdeFile) file = NULL;
+  IdeDiagnosticsGroup *group = job->group;
+  IdeContext *context;
+  GType type;
+  guint n_in_flight;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_assert (job != NULL);
+
+  group->n_pending--;
+  EGG_COUNTER_DEC (pending);
+
   /*
-   * If there are no more diagnostics providers active and the group needs
-   * another diagnosis, then we can start the next one now.
-   *
-   * If we are completing this diagnosis and the buffer was already released
-   * (and other diagnose providers have unloaded), we might be able to clean
-   * up the group and be done with things.
+   * If the buffer was unloaded or changed again while we were waiting, there
+   * is no reason to start. A changed buffer will be diagnosed again.
    */
-  if (group->was_removed == FALSE && group->in_diagnose == 0 && group->needs_diagnose)
+  if (group->was_removed || g_cancellable_is_cancelled (job->cancellable))
     {
-      ide_diagnostics_group_queue_diagnose (group, self);
+      ide_diagnostics_group_job_finished (group, self);
+      diagnose_job_free (job);
+      IDE_EXIT;
     }
-  else if (ide_diagnostics_group_can_dispose (group))
+
+  job->self = g_object_ref (self);
+
+  type = G_OBJECT_TYPE (job->provider);
+  n_in_flight = GPOINTER_TO_UINT (g_hash_table_lookup (self->in_flight_by_type, GSIZE_TO_POINTER (type)));
+  g_hash_table_insert (self->in_flight_by_type, GSIZE_TO_POINTER (type), GUINT_TO_POINTER (n_in_flight + 1));
+  self->n_in_flight++;
+
+  group->in_diagnose++;
+
+  EGG_COUNTER_INC (in_flight);
+  EGG_COUNTER_INC (started);
+  EGG_COUNTER_ADD (wait_time, g_get_monotonic_time () - job->queued_at);
+
+  /*
+   * We need to ensure that all the diagnostic providers have access to the
+   * proper data within the unsaved files. This is cheap when the content has
+   * not changed since the last provider synced it.
+   */
+  if (NULL != (buffer = g_weak_ref_get (&group->buffer_wr)))
+    ide_buffer_sync_to_unsaved_files (buffer);
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+
+  file = g_object_new (IDE_TYPE_FILE,
+                       "context", context,
+                       "file", group->file,
+                       NULL);
+
+#ifdef IDE_ENABLE_TRACE
+  {
+    g_autofree gchar *uri = g_file_get_uri (group->file);
+    IDE_TRACE_MSG ("Beginning diagnose on %s with provider %s",
+                   uri, G_OBJECT_TYPE_NAME (job->provider));
+  }
+#endif
+
+  ide_diagnostic_provider_diagnose_async (job->provider,
+                                          file,
+                                          job->cancellable,
+                                          ide_diagnostics_group_diagnose_cb,
+                                          job);
+
+  IDE_EXIT;
+}
+
+/*
+ * Starts as many pending jobs as the per-provider limits allow, in order
+ * of priority. Priorities are recalculated each time, since the focus may
+ * have changed while the jobs were waiting.
+ */
+static void
+ide_diagnostics_manager_dispatch (IdeDiagnosticsManager *self)
+{
+  guint i;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  if (self->pending == NULL)
+    IDE_EXIT;
+
+  for (i = 0; i < self->pending->len; i++)
     {
-      group->was_removed = TRUE;
-      g_hash_table_remove (self->groups_by_file, group->file);
-      IDE_EXIT;
+      DiagnoseJob *job = g_ptr_array_index (self->pending, i);
+
+      job->priority = ide_diagnostics_manager_get_group_priority (self, job->group);
+    }
+
+  g_ptr_array_sort (self->pending, diagnose_job_compare);
+
+  for (i = 0; i < self->pending->len; )
+    {
+      DiagnoseJob *job = g_ptr_array_index (self->pending, i);
+      GType type = G_OBJECT_TYPE (job->provider);
+      guint n_in_flight;
+
+      n_in_flight = GPOINTER_TO_UINT (g_hash_table_lookup (self->in_flight_by_type, GSIZE_TO_POINTER (type)));
+
+      if (n_in_flight >= MAX_IN_FLIGHT_PER_PROVIDER)
+        {
+          i++;
+          continue;
+        }
+
+      /* Keep the order of the remaining jobs */
+      g_ptr_array_remove_index (self->pending, i);
+      ide_diagnostics_manager_start_job (self, job);
     }
 
   IDE_EXIT;
@@ -411,8 +702,7 @@ ide_diagnostics_group_diagnose_foreach (IdeExtensionSetAdapter *adapter,
   IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)exten;
   IdeDiagnosticsManager *self = user_data;
   IdeDiagnosticsGroup *group;
-  IdeContext *context;
-  g_autoptr(IdeFile) file = NULL;
+  DiagnoseJob *job;
 
   IDE_ENTRY;
 
@@ -422,60 +712,43 @@ ide_diagnostics_group_diagnose_foreach (IdeExtensionSetAdapter *adapter,
   g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
 
   group = g_object_get_data (G_OBJECT (provider), "IDE_DIAGNOSTICS_GROUP");
-  group->in_diagnose++;
 
-  context = ide_object_get_context (IDE_OBJECT (self));
+  job = g_slice_new0 (DiagnoseJob);
+  job->group = ide_diagnostics_group_ref (group);
+  job->provider = g_object_ref (provider);
+  job->cancellable = g_object_ref (group->cancellable);
+  job->queued_at = g_get_monotonic_time ();
 
-  file = g_object_new (IDE_TYPE_FILE,
-                       "context", context,
-                       "file", group->file,
-                       NULL);
+  g_ptr_array_add (self->pending, job);
 
-#ifdef IDE_ENABLE_TRACE
-  {
-    g_autofree gchar *uri = g_file_get_uri (group->file);
-    IDE_TRACE_MSG ("Beginning diagnose on %s with provider %s",
-                   uri, G_OBJECT_TYPE_NAME (provider));
-  }
-#endif
+  group->n_pending++;
+  EGG_COUNTER_INC (pending);
 
-  ide_diagnostic_provider_diagnose_async (provider,
-                                          file,
-                                          NULL,
-                                          ide_diagnostics_group_diagnose_cb,
-                                          g_object_ref (self));
+  IDE_EXIT;
 }
 
 static void
 ide_diagnostics_group_diagnose (IdeDiagnosticsGroup   *group,
                                 IdeDiagnosticsManager *self)
 {
-  g_autoptr(IdeBuffer) buffer = NULL;
-
   IDE_ENTRY;
 
   g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
   g_assert (group != NULL);
-  g_assert (group->in_diagnose == FALSE);
+  g_assert (group->in_diagnose == 0);
+  g_assert (group->n_pending == 0);
   g_assert (IDE_IS_EXTENSION_SET_ADAPTER (group->adapter));
 
   group->needs_diagnose = FALSE;
   group->has_diagnostics = FALSE;
 
-  /*
-   * We need to ensure that all the diagnostic providers have access to the
-   * proper data within the unsaved files. So sync the content once to avoid
-   * all providers from having to do this manually.
-   */
-  if (NULL != (buffer = g_weak_ref_get (&group->buffer_wr)))
-    ide_buffer_sync_to_unsaved_files (buffer);
+  g_clear_object (&group->cancellable);
+  group->cancellable = g_cancellable_new ();
 
   ide_extension_set_adapter_foreach (group->adapter,
                                      ide_diagnostics_group_diagnose_foreach,
                                      self);
 
-  g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUSY]);
-
   IDE_EXIT;
 }
 
@@ -485,6 +758,7 @@ ide_diagnostics_manager_begin_diagnose (gpointer data)
   IdeDiagnosticsManager *self = data;
   GHashTableIter iter;
   gpointer value;
+  gboolean was_busy;
 
   IDE_ENTRY;
 
@@ -492,16 +766,31 @@ ide_diagnostics_manager_begin_diagnose (gpointer data)
 
   self->queued_diagnose_source = 0;
 
+  was_busy = ide_diagnostics_manager_get_busy (self);
+
   g_hash_table_iter_init (&iter, self->groups_by_file);
 
+  /*
+   * Groups with providers still running will be queued again when the last
+   * one completes. Groups with providers waiting to start do not need to be
+   * queued again, since those will diagnose the latest contents anyway.
+   */
   while (g_hash_table_iter_next (&iter, NULL, &value))
     {
       IdeDiagnosticsGroup *group = value;
 
-      if (group->needs_diagnose && group->adapter != NULL)
+      if (group->needs_diagnose &&
+          group->adapter != NULL &&
+          group->in_diagnose == 0 &&
+          group->n_pending == 0)
         ide_diagnostics_group_diagnose (group, self);
     }
 
+  ide_diagnostics_manager_dispatch (self);
+
+  if (was_busy != ide_diagnostics_manager_get_busy (self))
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BUSY]);
+
   IDE_RETURN (G_SOURCE_REMOVE);
 }
 
@@ -513,14 +802,30 @@ ide_diagnostics_group_queue_diagnose (IdeDiagnosticsGroup   *group,
 
   /*
    * This checks to see if we are diagnosing and if not queues a diagnose.
-   * If a diagnosis is already running, we don't need to do anything now
-   * because the completion of the diagnose will tick off the next diagnose
-   * upon seening group->needs_diagnose==TRUE.
+   * If a diagnosis is already running, we cancel it since its results are
+   * out of date, and the completion of the diagnose will tick off the next
+   * diagnose upon seeing group->needs_diagnose==TRUE.
    */
 
   group->needs_diagnose = TRUE;
 
-  if (group->in_diagnose == 0 && self->queued_diagnose_source == 0)
+  if (group->in_diagnose > 0)
+    {
+      g_cancellable_cancel (group->cancellable);
+      return;
+    }
+
+  /*
+   * If none of the providers have started yet, they will sync the buffer
+   * when they do and therefore already diagnose the new contents.
+   */
+  if (group->n_pending > 0)
+    {
+      group->needs_diagnose = FALSE;
+      return;
+    }
+
+  if (self->queued_diagnose_source == 0)
     self->queued_diagnose_source =
       gdk_threads_add_idle_full (G_PRIORITY_DEFAULT,
                                  ide_diagnostics_manager_begin_diagnose,
@@ -528,12 +833,37 @@ ide_diagnostics_group_queue_diagnose (IdeDiagnosticsGroup   *group,
                                  g_object_unref);
 }
 
+static void
+ide_diagnostics_manager_dispose (GObject *object)
+{
+  IdeDiagnosticsManager *self = (IdeDiagnosticsManager *)object;
+  guint i;
+
+  /* The jobs which did not start yet never will */
+  if (self->pending != NULL)
+    {
+      for (i = 0; i < self->pending->len; i++)
+        {
+          DiagnoseJob *job = g_ptr_array_index (self->pending, i);
+
+          job->group->n_pending--;
+          EGG_COUNTER_DEC (pending);
+        }
+
+      g_ptr_array_set_size (self->pending, 0);
+    }
+
+  G_OBJECT_CLASS (ide_diagnostics_manager_parent_class)->dispose (object);
+}
+
 static void
 ide_diagnostics_manager_finalize (GObject *object)
 {
   IdeDiagnosticsManager *self = (IdeDiagnosticsManager *)object;
 
   ide_clear_source (&self->queued_diagnose_source);
+  g_clear_pointer (&self->pending, g_ptr_array_unref);
+  g_clear_pointer (&self->in_flight_by_type, g_hash_table_unref);
   g_clear_pointer (&self->groups_by_file, g_hash_table_unref);
 
   G_OBJECT_CLASS (ide_diagnostics_manager_parent_class)->finalize (object);
@@ -563,6 +893,7 @@ ide_diagnostics_manager_class_init (IdeDiagnosticsManagerClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+  object_class->dispose = ide_diagnostics_manager_dispose;
   object_class->finalize = ide_diagnostics_manager_finalize;
   object_class->get_property = ide_diagnostics_manager_get_property;
 
@@ -596,6 +927,8 @@ ide_diagnostics_manager_init (IdeDiagnosticsManager *self)
                                                 (GEqualFunc)g_file_equal,
                                                 NULL,
                                                 (GDestroyNotify)ide_diagnostics_group_unref);
+  self->pending = g_ptr_array_new_with_free_func (diagnose_job_free);
+  self->in_flight_by_type = g_hash_table_new (NULL, NULL);
 }
 
 static void
@@ -1101,6 +1434,10 @@ ide_diagnostics_manager_buffer_unloaded (IdeDiagnosticsManager *self,
 
   group->has_diagnostics = has_diagnostics;
 
+  /* Anything still running for the buffer is no longer interesting */
+  if (group->cancellable != NULL)
+    g_cancellable_cancel (group->cancellable);
+
   IDE_EXIT;
 }
 
@@ -1155,29 +1492,17 @@ initable_iface_init (GInitableIface *iface)
 /**
  * ide_diagnostics_manager_get_busy:
  *
- * Gets if the diagnostics manager is currently executing a diagnosis.
+ * Gets if the diagnostics manager is currently executing a diagnosis, or
+ * has diagnoses waiting to be started.
  *
  * Returns: %TRUE if the #IdeDiagnosticsManager is busy diagnosing.
  */
 gboolean
 ide_diagnostics_manager_get_busy (IdeDiagnosticsManager *self)
 {
-  GHashTableIter iter;
-  gpointer value;
-
   g_return_val_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self), FALSE);
 
-  g_hash_table_iter_init (&iter, self->groups_by_file);
-
-  while (g_hash_table_iter_next (&iter, NULL, &value))
-    {
-      IdeDiagnosticsGroup *group = value;
-
-      if (group->in_diagnose > 0)
-        return TRUE;
-    }
-
-  return FALSE;
+  return self->n_in_flight > 0 || (self->pending != NULL && self->pending->len > 0);
 }
 
 /**
@@ -26,11 +26,15 @@
 #include "ide-internal.h"
 #include "ide-types.h"
 
+#include "buffers/ide-buffer-snapshot.h"
+#include "files/ide-file.h"
 #include "highlighting/ide-highlight-engine.h"
 #include "plugins/ide-extension-adapter.h"
 
-#define HIGHLIGHT_QUANTA_USEC 5000
-#define PRIVATE_TAG_PREFIX    "gb-private-tag"
+#define HIGHLIGHT_QUANTA_USEC  5000
+#define PRIVATE_TAG_PREFIX     "gb-private-tag"
+#define DEFAULT_PRIORITY_PAGES 1
+#define OFFSCREEN_CHUNK_LINES  2000
 
 struct _IdeHighlightEngine
 {
@@ -46,22 +50,71 @@ struct _IdeHighlightEngine
   GtkTextMark         *invalid_begin;
   GtkTextMark         *invalid_end;
 
+  /*
+   * The viewport hint from the view, and the ranges within the invalid
+   * region that have been highlighted out of order because they were on
+   * (or near) the screen, as pairs of marks.
+   */
+  GtkTextMark         *visible_begin;
+  GtkTextMark         *visible_end;
+  GPtrArray           *done_marks;
+
+  guint                priority_pages;
+
   GSList              *private_tags;
   GSList              *public_tags;
 
+  /*
+   * Highlighters implementing IdeHighlighter::compute run on a worker
+   * against a snapshot of the buffer. The resulting spans are applied from
+   * the main loop in time slices.
+   *
+   * Edits and invalidations made after the snapshot was taken are collected
+   * in the stale range. Text outside of it is unchanged, apart from moving
+   * by the difference in length, so spans there are moved to match the
+   * buffer and applied. Spans within it are dropped, and the stale range is
+   * invalidated to be computed again.
+   */
+  GCancellable        *compute_cancellable;
+  GArray              *pending_spans;
+  guint                pending_n_chars;
+  guint                pending_begin;
+  guint                pending_end;
+  guint                pending_pos;
+  guint                pending_priority : 1;
+  guint                compute_serial;
+  GtkTextMark         *stale_begin;
+  GtkTextMark         *stale_end;
+
   guint64              quanta_expiration;
 
   guint                work_timeout;
 
   guint                enabled : 1;
+  guint                computing : 1;
+  guint                has_visible : 1;
+  guint                has_stale : 1;
 };
 
+typedef struct
+{
+  IdeHighlighter    *highlighter;
+  IdeFile           *file;
+  IdeBufferSnapshot *snapshot;
+  guint              n_chars;
+  guint              begin;
+  guint              end;
+  guint              compute_serial;
+  guint              priority : 1;
+} ComputeState;
+
 G_DEFINE_TYPE (IdeHighlightEngine, ide_highlight_engine, IDE_TYPE_OBJECT)
 
 enum {
   PROP_0,
   PROP_BUFFER,
   PROP_HIGHLIGHTER,
+  PROP_PRIORITY_PAGES,
   LAST_PROP
 };
 
@@ -294,6 +347,846 @@ ide_highlight_engine_apply_style (const GtkTextIter *begin,
   return IDE_HIGHLIGHT_CONTINUE;
 }
 
+/*
+ * The done ranges are kept as pairs of marks, so that they follow edits
+ * which do not invalidate anything, such as typing whitespace.
+ */
+static void
+ide_highlight_engine_clear_done (IdeHighlightEngine *self)
+{
+  guint i;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (self->buffer != NULL)
+    {
+      for (i = 0; i < self->done_marks->len; i++)
+        gtk_text_buffer_delete_mark (GTK_TEXT_BUFFER (self->buffer),
+                                     g_ptr_array_index (self->done_marks, i));
+    }
+
+  g_ptr_array_set_size (self->done_marks, 0);
+}
+
+static void
+ide_highlight_engine_up_to_date (IdeHighlightEngine *self)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->buffer);
+  GtkTextIter iter;
+
+  gtk_text_buffer_get_start_iter (buffer, &iter);
+  gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
+  gtk_text_buffer_move_mark (buffer, self->invalid_end, &iter);
+  ide_highlight_engine_clear_done (self);
+}
+
+/*
+ * Finds the first part of @window that is not in @done, which is sorted.
+ */
+static gboolean
+subtract_done (const GArray            *done,
+               const IdeHighlightRange *window,
+               IdeHighlightRange       *range)
+{
+  guint i;
+
+  *range = *window;
+
+  for (i = 0; i < done->len && range->begin < range->end; i++)
+    {
+      const IdeHighlightRange *r = &g_array_index (done, IdeHighlightRange, i);
+
+      if (r->end <= range->begin)
+        continue;
+
+      if (r->begin >= range->end)
+        break;
+
+      if (r->begin > range->begin)
+        {
+          range->end = r->begin;
+          break;
+        }
+
+      range->begin = r->end;
+    }
+
+  return range->begin < range->end;
+}
+
+/**
+ * _ide_highlight_progress_next:
+ * @progress: the highlighting progress
+ * @windows: the ranges to highlight first, in order
+ * @n_windows: the number of elements in @windows
+ * @range: (out): the next range to highlight
+ * @priority: (out): if @range is out of order
+ *
+ * Determines the next range to highlight. The invalid parts of @windows
+ * come first, then the rest of the invalid region from its start.
+ * @priority is set if the range is out of order and must be recorded as
+ * done with _ide_highlight_progress_done().
+ *
+ * Returns: %FALSE if everything is highlighted.
+ */
+gboolean
+_ide_highlight_progress_next (IdeHighlightProgress    *progress,
+                              const IdeHighlightRange *windows,
+                              guint                    n_windows,
+                              IdeHighlightRange       *range,
+                              gboolean                *priority)
+{
+  GArray *done;
+  guint i;
+
+  g_assert (progress != NULL);
+  g_assert (progress->done != NULL);
+  g_assert (windows != NULL || n_windows == 0);
+  g_assert (range != NULL);
+  g_assert (priority != NULL);
+
+  done = progress->done;
+
+  /* Trim the invalid region by the done ranges reaching either end of it. */
+  while (done->len > 0 &&
+         g_array_index (done, IdeHighlightRange, 0).begin <= progress->invalid_begin)
+    {
+      progress->invalid_begin = MAX (progress->invalid_begin,
+                                     g_array_index (done, IdeHighlightRange, 0).end);
+      g_array_remove_index (done, 0);
+    }
+
+  while (done->len > 0 &&
+         g_array_index (done, IdeHighlightRange, done->len - 1).end >= progress->invalid_end)
+    {
+      progress->invalid_end = MIN (progress->invalid_end,
+                                   g_array_index (done, IdeHighlightRange, done->len - 1).begin);
+      g_array_remove_index (done, done->len - 1);
+    }
+
+  if (progress->invalid_begin >= progress->invalid_end)
+    {
+      g_array_set_size (done, 0);
+      return FALSE;
+    }
+
+  for (i = 0; i < n_windows; i++)
+    {
+      IdeHighlightRange window;
+
+      window.begin = MAX (windows [i].begin, progress->invalid_begin);
+      window.end = MIN (windows [i].end, progress->invalid_end);
+
+      if (subtract_done (done, &window, range))
+        {
+          *priority = TRUE;
+          return TRUE;
+        }
+    }
+
+  range->begin = progress->invalid_begin;
+  range->end = progress->invalid_end;
+  if (done->len > 0)
+    range->end = g_array_index (done, IdeHighlightRange, 0).begin;
+  *priority = FALSE;
+
+  return TRUE;
+}
+
+/**
+ * _ide_highlight_progress_done:
+ * @progress: the highlighting progress
+ * @range: the range which was highlighted
+ * @priority: the value returned by _ide_highlight_progress_next()
+ *
+ * Records that @range has been highlighted. Work done in order simply
+ * advances the start of the invalid region, other work is merged into
+ * the done ranges.
+ */
+void
+_ide_highlight_progress_done (IdeHighlightProgress    *progress,
+                              const IdeHighlightRange *range,
+                              gboolean                 priority)
+{
+  IdeHighlightRange merged;
+  GArray *done;
+  guint i;
+
+  g_assert (progress != NULL);
+  g_assert (progress->done != NULL);
+  g_assert (range != NULL);
+  g_assert (range->begin <= range->end);
+
+  if (!priority)
+    {
+      progress->invalid_begin = range->end;
+      return;
+    }
+
+  if (range->begin == range->end)
+    return;
+
+  done = progress->done;
+  merged = *range;
+
+  /* Skip the ranges before, then merge those touching or overlapping. */
+  for (i = 0; i < done->len; i++)
+    {
+      if (g_array_index (done, IdeHighlightRange, i).end >= merged.begin)
+        break;
+    }
+
+  while (i < done->len)
+    {
+      const IdeHighlightRange *r = &g_array_index (done, IdeHighlightRange, i);
+
+      if (r->begin > merged.end)
+        break;
+
+      merged.begin = MIN (merged.begin, r->begin);
+      merged.end = MAX (merged.end, r->end);
+      g_array_remove_index (done, i);
+    }
+
+  g_array_insert_val (done, i, merged);
+}
+
+/**
+ * _ide_highlight_progress_invalidate:
+ * @progress: the highlighting progress
+ * @range: the range which needs to be highlighted again
+ *
+ * Adds @range to the invalid region. Only the done ranges overlapping
+ * @range are dropped, and the text between a disjoint @range and the
+ * invalid region is recorded as done, since it was highlighted already.
+ */
+void
+_ide_highlight_progress_invalidate (IdeHighlightProgress    *progress,
+                                    const IdeHighlightRange *range)
+{
+  IdeHighlightRange gap;
+  GArray *done;
+  guint i;
+
+  g_assert (progress != NULL);
+  g_assert (progress->done != NULL);
+  g_assert (range != NULL);
+  g_assert (range->begin <= range->end);
+
+  done = progress->done;
+
+  if (progress->invalid_begin >= progress->invalid_end)
+    {
+      progress->invalid_begin = range->begin;
+      progress->invalid_end = range->end;
+      g_array_set_size (done, 0);
+      return;
+    }
+
+  if (range->begin > progress->invalid_end)
+    {
+      gap.begin = progress->invalid_end;
+      gap.end = range->begin;
+      progress->invalid_end = range->end;
+      _ide_highlight_progress_done (progress, &gap, TRUE);
+    }
+  else if (range->end < progress->invalid_begin)
+    {
+      gap.begin = range->end;
+      gap.end = progress->invalid_begin;
+      progress->invalid_begin = range->begin;
+      _ide_highlight_progress_done (progress, &gap, TRUE);
+    }
+  else
+    {
+      progress->invalid_begin = MIN (progress->invalid_begin, range->begin);
+      progress->invalid_end = MAX (progress->invalid_end, range->end);
+    }
+
+  /* Cut @range out of the done ranges, splitting those containing it. */
+  for (i = 0; i < done->len; i++)
+    {
+      IdeHighlightRange *r = &g_array_index (done, IdeHighlightRange, i);
+
+      if (r->end <= range->begin)
+        continue;
+
+      if (r->begin >= range->end)
+        break;
+
+      if (r->begin < range->begin && r->end > range->end)
+        {
+          IdeHighlightRange tail = { range->end, r->end };
+
+          r->end = range->begin;
+          g_array_insert_val (done, i + 1, tail);
+          break;
+        }
+
+      if (r->begin < range->begin)
+        r->end = range->begin;
+      else if (r->end > range->end)
+        r->begin = range->end;
+      else
+        g_array_remove_index (done, i--);
+    }
+}
+
+static void
+ide_highlight_engine_get_progress (IdeHighlightEngine   *self,
+                                   IdeHighlightProgress *progress)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->buffer);
+  GtkTextIter iter;
+  guint i;
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter, self->invalid_begin);
+  progress->invalid_begin = gtk_text_iter_get_offset (&iter);
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter, self->invalid_end);
+  progress->invalid_end = gtk_text_iter_get_offset (&iter);
+
+  progress->done = g_array_sized_new (FALSE, FALSE, sizeof (IdeHighlightRange),
+                                      self->done_marks->len / 2 + 1);
+
+  for (i = 0; i < self->done_marks->len; i += 2)
+    {
+      IdeHighlightRange range;
+
+      gtk_text_buffer_get_iter_at_mark (buffer, &iter, g_ptr_array_index (self->done_marks, i));
+      range.begin = gtk_text_iter_get_offset (&iter);
+      gtk_text_buffer_get_iter_at_mark (buffer, &iter, g_ptr_array_index (self->done_marks, i + 1));
+      range.end = gtk_text_iter_get_offset (&iter);
+
+      g_array_append_val (progress->done, range);
+    }
+}
+
+static void
+ide_highlight_engine_set_progress (IdeHighlightEngine   *self,
+                                   IdeHighlightProgress *progress)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->buffer);
+  GtkTextIter iter;
+  guint i;
+
+  gtk_text_buffer_get_iter_at_offset (buffer, &iter, progress->invalid_begin);
+  gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
+  gtk_text_buffer_get_iter_at_offset (buffer, &iter, progress->invalid_end);
+  gtk_text_buffer_move_mark (buffer, self->invalid_end, &iter);
+
+  while (self->done_marks->len > progress->done->len * 2)
+    {
+      gtk_text_buffer_delete_mark (buffer, g_ptr_array_index (self->done_marks, self->done_marks->len - 1));
+      g_ptr_array_remove_index (self->done_marks, self->done_marks->len - 1);
+    }
+
+  gtk_text_buffer_get_start_iter (buffer, &iter);
+
+  while (self->done_marks->len < progress->done->len * 2)
+    {
+      gboolean left_gravity = (self->done_marks->len % 2) == 0;
+
+      g_ptr_array_add (self->done_marks,
+                       gtk_text_buffer_create_mark (buffer, NULL, &iter, left_gravity));
+    }
+
+  for (i = 0; i < progress->done->len; i++)
+    {
+      const IdeHighlightRange *range = &g_array_index (progress->done, IdeHighlightRange, i);
+
+      gtk_text_buffer_get_iter_at_offset (buffer, &iter, range->begin);
+      gtk_text_buffer_move_mark (buffer, g_ptr_array_index (self->done_marks, i * 2), &iter);
+      gtk_text_buffer_get_iter_at_offset (buffer, &iter, range->end);
+      gtk_text_buffer_move_mark (buffer, g_ptr_array_index (self->done_marks, i * 2 + 1), &iter);
+    }
+
+  g_clear_pointer (&progress->done, g_array_unref);
+}
+
+/*
+ * Determines the next range to highlight. Ranges within the viewport come
+ * first, then up to priority-pages of their neighbors, then the rest of the
+ * invalid region from its start.
+ */
+static gboolean
+ide_highlight_engine_next_range (IdeHighlightEngine *self,
+                                 GtkTextIter        *begin,
+                                 GtkTextIter        *end,
+                                 gboolean           *priority)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->buffer);
+  IdeHighlightProgress progress;
+  IdeHighlightRange windows[2];
+  IdeHighlightRange range;
+  guint n_windows = 0;
+  gboolean ret;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (self->has_visible)
+    {
+      GtkTextIter visible_begin;
+      GtkTextIter visible_end;
+      gint lines;
+
+      gtk_text_buffer_get_iter_at_mark (buffer, &visible_begin, self->visible_begin);
+      gtk_text_buffer_get_iter_at_mark (buffer, &visible_end, self->visible_end);
+
+      windows [n_windows].begin = gtk_text_iter_get_offset (&visible_begin);
+      windows [n_windows].end = gtk_text_iter_get_offset (&visible_end);
+      n_windows++;
+
+      lines = (gtk_text_iter_get_line (&visible_end) - gtk_text_iter_get_line (&visible_begin) + 1);
+      lines *= self->priority_pages;
+
+      if (lines > 0)
+        {
+          gtk_text_iter_backward_lines (&visible_begin, lines);
+          gtk_text_iter_forward_lines (&visible_end, lines);
+
+          windows [n_windows].begin = gtk_text_iter_get_offset (&visible_begin);
+          windows [n_windows].end = gtk_text_iter_get_offset (&visible_end);
+          n_windows++;
+        }
+    }
+
+  ide_highlight_engine_get_progress (self, &progress);
+  ret = _ide_highlight_progress_next (&progress, windows, n_windows, &range, priority);
+  ide_highlight_engine_set_progress (self, &progress);
+
+  if (ret)
+    {
+      gtk_text_buffer_get_iter_at_offset (buffer, begin, range.begin);
+      gtk_text_buffer_get_iter_at_offset (buffer, end, range.end);
+    }
+
+  return ret;
+}
+
+static void
+ide_highlight_engine_mark_done (IdeHighlightEngine *self,
+                                const GtkTextIter  *begin,
+                                const GtkTextIter  *end,
+                                gboolean            priority)
+{
+  IdeHighlightProgress progress;
+  IdeHighlightRange range;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  range.begin = gtk_text_iter_get_offset (begin);
+  range.end = gtk_text_iter_get_offset (end);
+
+  ide_highlight_engine_get_progress (self, &progress);
+  _ide_highlight_progress_done (&progress, &range, priority);
+  ide_highlight_engine_set_progress (self, &progress);
+}
+
+/**
+ * _ide_highlight_span_rebase:
+ * @span: a span computed against an older version of the buffer
+ * @stale_begin: the current offset of the beginning of the changed text
+ * @stale_end: the current offset of the end of the changed text
+ * @delta: the number of characters added to the buffer since
+ * @begin: (out): the current offset of the beginning of @span
+ * @end: (out): the current offset of the end of @span
+ *
+ * Maps @span to the current buffer, given that only the text between
+ * @stale_begin and @stale_end changed since it was computed.
+ *
+ * Returns: %FALSE if @span overlaps the changed text and must be dropped.
+ */
+gboolean
+_ide_highlight_span_rebase (const IdeHighlightSpan *span,
+                            guint                   stale_begin,
+                            guint                   stale_end,
+                            gint                    delta,
+                            guint                  *begin,
+                            guint                  *end)
+{
+  g_assert (span != NULL);
+  g_assert (stale_begin <= stale_end);
+  g_assert (begin != NULL);
+  g_assert (end != NULL);
+
+  if (span->end <= stale_begin)
+    {
+      *begin = span->begin;
+      *end = span->end;
+      return TRUE;
+    }
+
+  /* The end of the stale range in the buffer the span was computed for */
+  if ((gint64)span->begin >= (gint64)stale_end - delta)
+    {
+      *begin = span->begin + delta;
+      *end = span->end + delta;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Records that [begin,end) changed while highlights were being computed
+ * or applied. The range is extended to whole lines, since a highlighted
+ * token may start before the change.
+ */
+static void
+ide_highlight_engine_mark_stale (IdeHighlightEngine *self,
+                                 const GtkTextIter  *begin,
+                                 const GtkTextIter  *end)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->buffer);
+  GtkTextIter stale_begin = *begin;
+  GtkTextIter stale_end = *end;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (!self->computing && self->pending_spans == NULL)
+    return;
+
+  gtk_text_iter_set_line_offset (&stale_begin, 0);
+  if (!gtk_text_iter_ends_line (&stale_end))
+    gtk_text_iter_forward_to_line_end (&stale_end);
+
+  if (self->has_stale)
+    {
+      GtkTextIter iter;
+
+      gtk_text_buffer_get_iter_at_mark (buffer, &iter, self->stale_begin);
+      if (gtk_text_iter_compare (&iter, &stale_begin) < 0)
+        stale_begin = iter;
+
+      gtk_text_buffer_get_iter_at_mark (buffer, &iter, self->stale_end);
+      if (gtk_text_iter_compare (&iter, &stale_end) > 0)
+        stale_end = iter;
+    }
+
+  gtk_text_buffer_move_mark (buffer, self->stale_begin, &stale_begin);
+  gtk_text_buffer_move_mark (buffer, self->stale_end, &stale_end);
+  self->has_stale = TRUE;
+}
+
+static void
+compute_state_free (gpointer data)
+{
+  ComputeState *state = data;
+
+  g_clear_object (&state->highlighter);
+  g_clear_object (&state->file);
+  g_clear_pointer (&state->snapshot, ide_buffer_snapshot_unref);
+  g_slice_free (ComputeState, state);
+}
+
+static void ide_highlight_engine_queue_work (IdeHighlightEngine *self);
+
+static void
+ide_highlight_engine_cancel_compute (IdeHighlightEngine *self)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (self->compute_cancellable != NULL)
+    g_cancellable_cancel (self->compute_cancellable);
+  g_clear_object (&self->compute_cancellable);
+  g_clear_pointer (&self->pending_spans, g_array_unref);
+
+  /* Results from the previous worker are ignored via compute_serial. */
+  self->compute_serial++;
+  self->computing = FALSE;
+  self->has_stale = FALSE;
+}
+
+static void
+ide_highlight_engine_compute_worker (GTask        *task,
+                                     gpointer      source_object,
+                                     gpointer      task_data,
+                                     GCancellable *cancellable)
+{
+  ComputeState *state = task_data;
+  g_autoptr(GBytes) content = NULL;
+  GArray *spans;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (state != NULL);
+  g_assert (IDE_IS_HIGHLIGHTER (state->highlighter));
+
+  /* Flattening the snapshot is done here rather than on the main thread */
+  content = ide_buffer_snapshot_get_bytes (state->snapshot);
+  spans = g_array_new (FALSE, FALSE, sizeof (IdeHighlightSpan));
+
+  ide_highlighter_compute (state->highlighter,
+                           state->file,
+                           content,
+                           state->begin,
+                           state->end,
+                           spans,
+                           cancellable);
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_array_unref (spans);
+      return;
+    }
+
+  g_task_return_pointer (task, spans, (GDestroyNotify)g_array_unref);
+}
+
+static void
+ide_highlight_engine_compute_cb (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  IdeHighlightEngine *self = (IdeHighlightEngine *)object;
+  ComputeState *state;
+  GArray *spans;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (G_IS_TASK (result));
+
+  state = g_task_get_task_data (G_TASK (result));
+  spans = g_task_propagate_pointer (G_TASK (result), NULL);
+
+  /* We were cancelled or restarted since this request was made. */
+  if (state->compute_serial != self->compute_serial)
+    {
+      g_clear_pointer (&spans, g_array_unref);
+      IDE_EXIT;
+    }
+
+  self->computing = FALSE;
+  g_clear_object (&self->compute_cancellable);
+
+  if (spans == NULL || self->buffer == NULL)
+    {
+      g_clear_pointer (&spans, g_array_unref);
+      IDE_EXIT;
+    }
+
+  /* Edits made meanwhile are accounted for when applying the spans. */
+  self->pending_spans = spans;
+  self->pending_n_chars = state->n_chars;
+  self->pending_begin = state->begin;
+  self->pending_end = state->end;
+  self->pending_priority = state->priority;
+  self->pending_pos = 0;
+
+  ide_highlight_engine_queue_work (self);
+
+  IDE_EXIT;
+}
+
+static void
+ide_highlight_engine_remove_private_tags (IdeHighlightEngine *self,
+                                          guint               begin_offset,
+                                          guint               end_offset)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->buffer);
+  GtkTextIter begin;
+  GtkTextIter end;
+  GSList *iter;
+
+  if (begin_offset >= end_offset)
+    return;
+
+  gtk_text_buffer_get_iter_at_offset (buffer, &begin, begin_offset);
+  gtk_text_buffer_get_iter_at_offset (buffer, &end, end_offset);
+
+  for (iter = self->private_tags; iter; iter = iter->next)
+    gtk_text_buffer_remove_tag (buffer, iter->data, &begin, &end);
+}
+
+/*
+ * Gets the stale range in current offsets, along with the number of
+ * characters added to the buffer since the pending spans were computed.
+ * Without changes, the stale range is empty and past the pending range.
+ */
+static void
+ide_highlight_engine_get_stale (IdeHighlightEngine *self,
+                                guint              *stale_begin,
+                                guint              *stale_end,
+                                gint               *delta)
+{
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER (self->buffer);
+  GtkTextIter iter;
+
+  *delta = gtk_text_buffer_get_char_count (buffer) - (gint)self->pending_n_chars;
+
+  if (!self->has_stale)
+    {
+      *stale_begin = *stale_end = self->pending_end + *delta;
+      return;
+    }
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter, self->stale_begin);
+  *stale_begin = gtk_text_iter_get_offset (&iter);
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter, self->stale_end);
+  *stale_end = gtk_text_iter_get_offset (&iter);
+}
+
+static gboolean
+ide_highlight_engine_apply_spans (IdeHighlightEngine *self)
+{
+  GtkSourceBuffer *source_buffer;
+  GtkTextBuffer *buffer;
+  GtkTextIter begin;
+  GtkTextIter end;
+  GtkTextIter invalid_begin;
+  guint stale_begin;
+  guint stale_end;
+  guint head_end;
+  gint delta;
+  gboolean head_done;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (self->pending_spans != NULL);
+
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+  source_buffer = GTK_SOURCE_BUFFER (self->buffer);
+
+  /* The buffer cannot change during a time slice, so this holds for all of it */
+  ide_highlight_engine_get_stale (self, &stale_begin, &stale_end, &delta);
+
+  if (self->pending_pos == 0)
+    {
+      /* Clear our tags around the stale range, the rest is left as is */
+      ide_highlight_engine_remove_private_tags (self,
+                                                self->pending_begin,
+                                                MIN (self->pending_end, stale_begin));
+      ide_highlight_engine_remove_private_tags (self,
+                                                MAX (stale_end, self->pending_begin + delta),
+                                                self->pending_end + delta);
+    }
+
+  while (self->pending_pos < self->pending_spans->len)
+    {
+      const IdeHighlightSpan *span;
+      GtkTextTag *tag;
+      guint span_begin;
+      guint span_end;
+
+      span = &g_array_index (self->pending_spans, IdeHighlightSpan, self->pending_pos);
+      self->pending_pos++;
+
+      if (!_ide_highlight_span_rebase (span, stale_begin, stale_end, delta, &span_begin, &span_end))
+        continue;
+
+      gtk_text_buffer_get_iter_at_offset (buffer, &begin, span_begin);
+      gtk_text_buffer_get_iter_at_offset (buffer, &end, span_end);
+
+      if ((span->flags & IDE_HIGHLIGHT_SPAN_CODE_ONLY) != 0 &&
+          (gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "string") ||
+           gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "path") ||
+           gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "comment")))
+        continue;
+
+      tag = get_tag_from_style (self, span->style_name, TRUE);
+      gtk_text_buffer_apply_tag (buffer, tag, &begin, &end);
+
+      if (g_get_monotonic_time () >= self->quanta_expiration)
+        return TRUE;
+    }
+
+  g_clear_pointer (&self->pending_spans, g_array_unref);
+
+  /*
+   * Only the part before the stale range can be marked as done, the rest
+   * will be computed again. When working in order, that also requires that
+   * nothing before the range was invalidated meanwhile.
+   */
+  head_end = MIN (self->pending_end, stale_begin);
+  gtk_text_buffer_get_iter_at_mark (buffer, &invalid_begin, self->invalid_begin);
+  head_done = (head_end > self->pending_begin &&
+               (self->pending_priority ||
+                (guint)gtk_text_iter_get_offset (&invalid_begin) == self->pending_begin));
+
+  if (self->has_stale)
+    {
+      IDE_TRACE_MSG ("Highlights changed in [%u,%u] while computing", stale_begin, stale_end);
+
+      self->has_stale = FALSE;
+      gtk_text_buffer_get_iter_at_offset (buffer, &begin, stale_begin);
+      gtk_text_buffer_get_iter_at_offset (buffer, &end, stale_end);
+      ide_highlight_engine_invalidate (self, &begin, &end);
+    }
+
+  if (head_done)
+    {
+      gtk_text_buffer_get_iter_at_offset (buffer, &begin, self->pending_begin);
+      gtk_text_buffer_get_iter_at_offset (buffer, &end, head_end);
+      ide_highlight_engine_mark_done (self, &begin, &end, self->pending_priority);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+ide_highlight_engine_tick_compute (IdeHighlightEngine *self,
+                                   IdeFile            *file)
+{
+  g_autoptr(GTask) task = NULL;
+  GtkTextIter begin;
+  GtkTextIter end;
+  GtkTextIter limit;
+  ComputeState *state;
+  gboolean priority = FALSE;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (IDE_IS_FILE (file));
+
+  self->quanta_expiration = g_get_monotonic_time () + HIGHLIGHT_QUANTA_USEC;
+
+  if (self->pending_spans != NULL)
+    return ide_highlight_engine_apply_spans (self);
+
+  /* The completion callback will queue more work. */
+  if (self->computing)
+    return FALSE;
+
+  if (!ide_highlight_engine_next_range (self, &begin, &end, &priority))
+    {
+      ide_highlight_engine_up_to_date (self);
+      return FALSE;
+    }
+
+  /*
+   * Keep off-screen requests small so that a scroll never has to wait long
+   * for the worker before the new viewport is computed.
+   */
+  limit = begin;
+  if (!priority &&
+      gtk_text_iter_forward_lines (&limit, OFFSCREEN_CHUNK_LINES) &&
+      gtk_text_iter_compare (&limit, &end) < 0)
+    end = limit;
+
+  state = g_slice_new0 (ComputeState);
+  state->highlighter = g_object_ref (self->highlighter);
+  state->file = g_object_ref (file);
+  state->snapshot = ide_buffer_get_snapshot (self->buffer);
+  state->n_chars = gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (self->buffer));
+  state->begin = gtk_text_iter_get_offset (&begin);
+  state->end = gtk_text_iter_get_offset (&end);
+  state->compute_serial = ++self->compute_serial;
+  state->priority = !!priority;
+
+  IDE_TRACE_MSG ("Computing highlights for [%u,%u] (%s) in thread",
+                 state->begin, state->end,
+                 G_OBJECT_TYPE_NAME (self->highlighter));
+
+  self->computing = TRUE;
+  self->has_stale = FALSE;
+  self->compute_cancellable = g_cancellable_new ();
+
+  task = g_task_new (self, self->compute_cancellable, ide_highlight_engine_compute_cb, NULL);
+  g_task_set_source_tag (task, ide_highlight_engine_tick_compute);
+  g_task_set_task_data (task, state, compute_state_free);
+  g_task_run_in_thread (task, ide_highlight_engine_compute_worker);
+
+  return FALSE;
+}
+
 static gboolean
 ide_highlight_engine_tick (IdeHighlightEngine *self)
 {
@@ -302,6 +1195,7 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
   GtkTextIter invalid_begin;
   GtkTextIter invalid_end;
   GSList *tags_iter;
+  gboolean priority = FALSE;
 
   IDE_PROBE;
 
@@ -311,12 +1205,20 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
   g_assert (self->invalid_begin != NULL);
   g_assert (self->invalid_end != NULL);
 
+  if (ide_highlighter_can_compute (self->highlighter))
+    {
+      IdeFile *file = ide_buffer_get_file (self->buffer);
+
+      if (file != NULL)
+        return ide_highlight_engine_tick_compute (self, file);
+    }
+
   self->quanta_expiration = g_get_monotonic_time () + HIGHLIGHT_QUANTA_USEC;
 
   buffer = GTK_TEXT_BUFFER (self->buffer);
 
-  gtk_text_buffer_get_iter_at_mark (buffer, &invalid_begin, self->invalid_begin);
-  gtk_text_buffer_get_iter_at_mark (buffer, &invalid_end, self->invalid_end);
+  if (!ide_highlight_engine_next_range (self, &invalid_begin, &invalid_end, &priority))
+    IDE_GOTO (up_to_date);
 
   IDE_TRACE_MSG ("Highlight Range [%u:%u,%u:%u] (%s)",
                  gtk_text_iter_get_line (&invalid_begin),
@@ -325,10 +1227,7 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
                  gtk_text_iter_get_line_offset (&invalid_end),
                  G_OBJECT_TYPE_NAME (self->highlighter));
 
-  if (gtk_text_iter_compare (&invalid_begin, &invalid_end) >= 0)
-    IDE_GOTO (up_to_date);
-
-  /*Clear all our tags*/
+  /* Clear our tags in the range, other ranges may already be done. */
   for (tags_iter = self->private_tags; tags_iter; tags_iter = tags_iter->next)
     gtk_text_buffer_remove_tag (buffer,
                                 GTK_TEXT_TAG (tags_iter->data),
@@ -340,21 +1239,16 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
   ide_highlighter_update (self->highlighter, ide_highlight_engine_apply_style,
                           &invalid_begin, &invalid_end, &iter);
 
-  if (gtk_text_iter_compare (&iter, &invalid_end) >= 0)
-    IDE_GOTO (up_to_date);
-
   /* Stop processing until further instruction if no movement was made */
   if (gtk_text_iter_equal (&iter, &invalid_begin))
     return FALSE;
 
-  gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
+  ide_highlight_engine_mark_done (self, &invalid_begin, &iter, priority);
 
   return TRUE;
 
 up_to_date:
-  gtk_text_buffer_get_start_iter (buffer, &iter);
-  gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
-  gtk_text_buffer_move_mark (buffer, self->invalid_end, &iter);
+  ide_highlight_engine_up_to_date (self);
 
   return FALSE;
 }
@@ -406,25 +1300,16 @@ invalidate_and_highlight (IdeHighlightEngine *self,
 
   if (get_invalidation_area (begin, end))
     {
-      GtkTextIter begin_tmp;
-      GtkTextIter end_tmp;
-      GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (self->buffer);
+      IdeHighlightProgress progress;
+      IdeHighlightRange range;
 
-      gtk_text_buffer_get_iter_at_mark (text_buffer, &begin_tmp, self->invalid_begin);
-      gtk_text_buffer_get_iter_at_mark (text_buffer, &end_tmp, self->invalid_end);
+      range.begin = gtk_text_iter_get_offset (begin);
+      range.end = gtk_text_iter_get_offset (end);
 
-      if (gtk_text_iter_equal (&begin_tmp, &end_tmp))
-        {
-          gtk_text_buffer_move_mark (text_buffer, self->invalid_begin, begin);
-          gtk_text_buffer_move_mark (text_buffer, self->invalid_end, end);
-        }
-      else
-        {
-          if (gtk_text_iter_compare (begin, &begin_tmp) < 0)
-            gtk_text_buffer_move_mark (text_buffer, self->invalid_begin, begin);
-          if (gtk_text_iter_compare (end, &end_tmp) > 0)
-            gtk_text_buffer_move_mark (text_buffer, self->invalid_end, end);
-        }
+      /* Only the text around the edit needs highlighting again */
+      ide_highlight_engine_get_progress (self, &progress);
+      _ide_highlight_progress_invalidate (&progress, &range);
+      ide_highlight_engine_set_progress (self, &progress);
 
       ide_highlight_engine_queue_work (self);
 
@@ -452,6 +1337,9 @@ ide_highlight_engine_reload (IdeHighlightEngine *self)
       self->work_timeout = 0;
     }
 
+  ide_highlight_engine_cancel_compute (self);
+  ide_highlight_engine_clear_done (self);
+
   if (self->buffer == NULL)
     IDE_EXIT;
 
@@ -534,6 +1422,7 @@ ide_highlight_engine__buffer_insert_text_cb (IdeHighlightEngine *self,
 
   end = *location;
 
+  ide_highlight_engine_mark_stale (self, &begin, &end);
   invalidate_and_highlight (self, &begin, &end);
 
   IDE_EXIT;
@@ -564,6 +1453,7 @@ ide_highlight_engine__buffer_delete_range_cb (IdeHighlightEngine *self,
   begin = *range_begin;
   end = *range_begin;
 
+  ide_highlight_engine_mark_stale (self, &begin, &end);
   invalidate_and_highlight (self, &begin, &end);
 
   IDE_EXIT;
@@ -648,6 +1538,12 @@ ide_highlight_engine__bind_buffer_cb (IdeHighlightEngine *self,
 
   self->invalid_begin = gtk_text_buffer_create_mark (text_buffer, NULL, &begin, TRUE);
   self->invalid_end = gtk_text_buffer_create_mark (text_buffer, NULL, &end, FALSE);
+  self->visible_begin = gtk_text_buffer_create_mark (text_buffer, NULL, &begin, TRUE);
+  self->visible_end = gtk_text_buffer_create_mark (text_buffer, NULL, &begin, FALSE);
+  self->stale_begin = gtk_text_buffer_create_mark (text_buffer, NULL, &begin, TRUE);
+  self->stale_end = gtk_text_buffer_create_mark (text_buffer, NULL, &begin, FALSE);
+  self->has_visible = FALSE;
+  self->has_stale = FALSE;
 
   ide_highlight_engine_reload (self);
 
@@ -677,15 +1573,29 @@ ide_highlight_engine__unbind_buffer_cb (IdeHighlightEngine  *self,
       self->work_timeout = 0;
     }
 
+  ide_highlight_engine_cancel_compute (self);
+
   g_object_set_qdata (G_OBJECT (text_buffer), engineQuark, NULL);
 
   tag_table = gtk_text_buffer_get_tag_table (text_buffer);
 
+  ide_highlight_engine_clear_done (self);
+
   gtk_text_buffer_delete_mark (text_buffer, self->invalid_begin);
   gtk_text_buffer_delete_mark (text_buffer, self->invalid_end);
+  gtk_text_buffer_delete_mark (text_buffer, self->visible_begin);
+  gtk_text_buffer_delete_mark (text_buffer, self->visible_end);
+  gtk_text_buffer_delete_mark (text_buffer, self->stale_begin);
+  gtk_text_buffer_delete_mark (text_buffer, self->stale_end);
 
   self->invalid_begin = NULL;
   self->invalid_end = NULL;
+  self->visible_begin = NULL;
+  self->visible_end = NULL;
+  self->stale_begin = NULL;
+  self->stale_end = NULL;
+  self->has_visible = FALSE;
+  self->has_stale = FALSE;
 
   gtk_text_buffer_get_bounds (text_buffer, &begin, &end);
 
@@ -791,10 +1701,13 @@ ide_highlight_engine_finalize (GObject *object)
 {
   IdeHighlightEngine *self = (IdeHighlightEngine *)object;
 
+  ide_highlight_engine_cancel_compute (self);
+
   g_clear_object (&self->extension);
   g_clear_object (&self->highlighter);
   g_clear_object (&self->settings);
   g_clear_object (&self->signal_group);
+  g_clear_pointer (&self->done_marks, g_ptr_array_unref);
 
   G_OBJECT_CLASS (ide_highlight_engine_parent_class)->finalize (object);
 }
@@ -817,6 +1730,10 @@ ide_highlight_engine_get_property (GObject    *object,
       g_value_set_object (value, ide_highlight_engine_get_highlighter (self));
       break;
 
+    case PROP_PRIORITY_PAGES:
+      g_value_set_uint (value, ide_highlight_engine_get_priority_pages (self));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -836,6 +1753,10 @@ ide_highlight_engine_set_property (GObject      *object,
       ide_highlight_engine_set_buffer (self, g_value_get_object (value));
       break;
 
+    case PROP_PRIORITY_PAGES:
+      ide_highlight_engine_set_priority_pages (self, g_value_get_uint (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -866,6 +1787,22 @@ ide_highlight_engine_class_init (IdeHighlightEngineClass *klass)
                          IDE_TYPE_HIGHLIGHTER,
                          (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * IdeHighlightEngine:priority-pages:
+   *
+   * The number of pages above and below the visible region, as reported
+   * with ide_highlight_engine_set_visible_range(), to highlight before the
+   * rest of the buffer. Set to zero to only prioritize the visible region.
+   */
+  properties [PROP_PRIORITY_PAGES] =
+    g_param_spec_uint ("priority-pages",
+                       "Priority Pages",
+                       "The number of pages around the visible region to highlight first.",
+                       0,
+                       G_MAXUINT,
+                       DEFAULT_PRIORITY_PAGES,
+                       (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_properties (object_class, LAST_PROP, properties);
 
   engineQuark = g_quark_from_string ("IDE_HIGHLIGHT_ENGINE");
@@ -874,8 +1811,13 @@ ide_highlight_engine_class_init (IdeHighlightEngineClass *klass)
 static void
 ide_highlight_engine_init (IdeHighlightEngine *self)
 {
+  self->priority_pages = DEFAULT_PRIORITY_PAGES;
+  self->done_marks = g_ptr_array_new ();
   self->settings = g_settings_new ("org.gnome.builder.code-insight");
   self->enabled = g_settings_get_boolean (self->settings, "semantic-highlighting");
+  g_settings_bind (self->settings, "highlight-priority-pages",
+                   self, "priority-pages",
+                   G_SETTINGS_BIND_GET);
   self->signal_group = egg_signal_group_new (IDE_TYPE_BUFFER);
 
   egg_signal_group_connect_object (self->signal_group,
@@ -982,8 +1924,10 @@ ide_highlight_engine_rebuild (IdeHighlightEngine *self)
       GtkTextIter end;
 
       gtk_text_buffer_get_bounds (buffer, &begin, &end);
+      ide_highlight_engine_mark_stale (self, &begin, &end);
       gtk_text_buffer_move_mark (buffer, self->invalid_begin, &begin);
       gtk_text_buffer_move_mark (buffer, self->invalid_end, &end);
+      ide_highlight_engine_clear_done (self);
       ide_highlight_engine_queue_work (self);
     }
 
@@ -1025,6 +1969,8 @@ ide_highlight_engine_invalidate (IdeHighlightEngine *self,
 
   buffer = GTK_TEXT_BUFFER (self->buffer);
 
+  ide_highlight_engine_mark_stale (self, begin, end);
+
   gtk_text_buffer_get_iter_at_mark (buffer, &mark_begin, self->invalid_begin);
   gtk_text_buffer_get_iter_at_mark (buffer, &mark_end, self->invalid_end);
 
@@ -1041,6 +1987,8 @@ ide_highlight_engine_invalidate (IdeHighlightEngine *self,
         gtk_text_buffer_move_mark (buffer, self->invalid_end, end);
     }
 
+  ide_highlight_engine_clear_done (self);
+
   ide_highlight_engine_queue_work (self);
 
   IDE_EXIT;
@@ -1061,3 +2009,88 @@ ide_highlight_engine_get_style (IdeHighlightEngine *self,
 {
   return get_tag_from_style (self, style_name, FALSE);
 }
+
+/**
+ * ide_highlight_engine_set_visible_range:
+ * @self: An #IdeHighlightEngine.
+ * @begin: the first visible position
+ * @end: the last visible position
+ *
+ * Provides a hint about the region of the buffer that is currently on screen.
+ * Invalid portions of this region (and the neighboring pages, see
+ * #IdeHighlightEngine:priority-pages) are highlighted before the rest of the
+ * buffer.
+ */
+void
+ide_highlight_engine_set_visible_range (IdeHighlightEngine *self,
+                                        const GtkTextIter  *begin,
+                                        const GtkTextIter  *end)
+{
+  GtkTextBuffer *buffer;
+  GtkTextIter line_begin;
+  GtkTextIter line_end;
+  GtkTextIter mark_begin;
+  GtkTextIter mark_end;
+
+  g_return_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_return_if_fail (begin != NULL);
+  g_return_if_fail (end != NULL);
+
+  if (self->buffer == NULL)
+    return;
+
+  g_return_if_fail (gtk_text_iter_get_buffer (begin) == GTK_TEXT_BUFFER (self->buffer));
+  g_return_if_fail (gtk_text_iter_get_buffer (end) == GTK_TEXT_BUFFER (self->buffer));
+
+  buffer = GTK_TEXT_BUFFER (self->buffer);
+
+  /* Work on whole lines, like the invalidation area. */
+  line_begin = *begin;
+  line_end = *end;
+  gtk_text_iter_order (&line_begin, &line_end);
+  gtk_text_iter_set_line_offset (&line_begin, 0);
+  if (!gtk_text_iter_ends_line (&line_end))
+    gtk_text_iter_forward_to_line_end (&line_end);
+  gtk_text_iter_forward_char (&line_end);
+
+  if (self->has_visible)
+    {
+      gtk_text_buffer_get_iter_at_mark (buffer, &mark_begin, self->visible_begin);
+      gtk_text_buffer_get_iter_at_mark (buffer, &mark_end, self->visible_end);
+
+      if (gtk_text_iter_equal (&mark_begin, &line_begin) &&
+          gtk_text_iter_equal (&mark_end, &line_end))
+        return;
+    }
+
+  gtk_text_buffer_move_mark (buffer, self->visible_begin, &line_begin);
+  gtk_text_buffer_move_mark (buffer, self->visible_end, &line_end);
+  self->has_visible = TRUE;
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &mark_begin, self->invalid_begin);
+  gtk_text_buffer_get_iter_at_mark (buffer, &mark_end, self->invalid_end);
+
+  if (gtk_text_iter_compare (&mark_begin, &mark_end) < 0)
+    ide_highlight_engine_queue_work (self);
+}
+
+guint
+ide_highlight_engine_get_priority_pages (IdeHighlightEngine *self)
+{
+  g_return_val_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self), 0);
+
+  return self->priority_pages;
+}
+
+void
+ide_highlight_engine_set_priority_pages (IdeHighlightEngine *self,
+                                         guint               priority_pages)
+{
+  g_return_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (self->priority_pages != priority_pages)
+    {
+      self->priority_pages = priority_pages;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PRIORITY_PAGES]);
+    }
+}
@@ -29,16 +29,22 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (IdeHighlightEngine, ide_highlight_engine, IDE, HIGHLIGHT_ENGINE, IdeObject)
 
-IdeHighlightEngine *ide_highlight_engine_new             (IdeBuffer          *buffer);
-IdeBuffer          *ide_highlight_engine_get_buffer      (IdeHighlightEngine *self);
-IdeHighlighter     *ide_highlight_engine_get_highlighter (IdeHighlightEngine *self);
-void                ide_highlight_engine_rebuild         (IdeHighlightEngine *self);
-void                ide_highlight_engine_clear           (IdeHighlightEngine *self);
-void                ide_highlight_engine_invalidate      (IdeHighlightEngine *self,
-                                                          const GtkTextIter  *begin,
-                                                          const GtkTextIter  *end);
-GtkTextTag         *ide_highlight_engine_get_style       (IdeHighlightEngine *self,
-                                                          const gchar        *style_name);
+IdeHighlightEngine *ide_highlight_engine_new                (IdeBuffer          *buffer);
+IdeBuffer          *ide_highlight_engine_get_buffer         (IdeHighlightEngine *self);
+IdeHighlighter     *ide_highlight_engine_get_highlighter    (IdeHighlightEngine *self);
+void                ide_highlight_engine_rebuild            (IdeHighlightEngine *self);
+void                ide_highlight_engine_clear              (IdeHighlightEngine *self);
+void                ide_highlight_engine_invalidate         (IdeHighlightEngine *self,
+                                                             const GtkTextIter  *begin,
+                                                             const GtkTextIter  *end);
+GtkTextTag         *ide_highlight_engine_get_style          (IdeHighlightEngine *self,
+                                                             const gchar        *style_name);
+void                ide_highlight_engine_set_visible_range  (IdeHighlightEngine *self,
+                                                             const GtkTextIter  *begin,
+                                                             const GtkTextIter  *end);
+guint               ide_highlight_engine_get_priority_pages (IdeHighlightEngine *self);
+void                ide_highlight_engine_set_priority_pages (IdeHighlightEngine *self,
+                                                             guint               priority_pages);
 
 G_END_DECLS
 
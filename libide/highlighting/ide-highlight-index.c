@@ -101,6 +101,26 @@ ide_highlight_index_lookup (IdeHighlightIndex *self,
   return g_hash_table_lookup (self->index, word);
 }
 
+/**
+ * ide_highlight_index_get_size:
+ * @self: An #IdeHighlightIndex.
+ *
+ * Gets an estimate of the number of bytes used by the index, which is
+ * useful to account for indexes in caches.
+ *
+ * Returns: The approximate size of the index in bytes.
+ */
+gsize
+ide_highlight_index_get_size (IdeHighlightIndex *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  /* Each hashtable entry stores a hash, a key and a value */
+  return sizeof *self
+       + self->chunk_size
+       + self->count * (sizeof (guint) + sizeof (gpointer) * 2);
+}
+
 IdeHighlightIndex *
 ide_highlight_index_ref (IdeHighlightIndex *self)
 {
@@ -136,6 +156,101 @@ ide_highlight_index_unref (IdeHighlightIndex *self)
     ide_highlight_index_finalize (self);
 }
 
+/**
+ * ide_highlight_index_to_variant:
+ * @self: An #IdeHighlightIndex.
+ *
+ * Serializes the index so that it may be transferred to another process.
+ * This is only valid if the tags registered in the index are strings.
+ *
+ * Words are grouped by their tag, so the resulting #GVariant is of type
+ * "a{sas}", mapping each tag to the words registered for it.
+ *
+ * Returns: (transfer full): A new floating #GVariant.
+ */
+GVariant *
+ide_highlight_index_to_variant (IdeHighlightIndex *self)
+{
+  g_autoptr(GHashTable) by_tag = NULL;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  by_tag = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_ptr_array_unref);
+
+  g_hash_table_iter_init (&iter, self->index);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GPtrArray *words;
+
+      if (NULL == (words = g_hash_table_lookup (by_tag, value)))
+        {
+          words = g_ptr_array_new ();
+          g_hash_table_insert (by_tag, value, words);
+        }
+
+      g_ptr_array_add (words, key);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sas}"));
+
+  g_hash_table_iter_init (&iter, by_tag);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GPtrArray *words = value;
+
+      g_variant_builder_add (&builder, "{s@as}",
+                             key,
+                             g_variant_new_strv ((const gchar * const *)words->pdata, words->len));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * ide_highlight_index_new_from_variant:
+ * @variant: A #GVariant of type "a{sas}"
+ *
+ * Creates a new #IdeHighlightIndex from a #GVariant created with
+ * ide_highlight_index_to_variant(). The tags of the new index are
+ * interned strings.
+ *
+ * Returns: (transfer full): An #IdeHighlightIndex.
+ */
+IdeHighlightIndex *
+ide_highlight_index_new_from_variant (GVariant *variant)
+{
+  IdeHighlightIndex *self;
+  GVariantIter iter;
+  GVariantIter *words;
+  const gchar *tag;
+
+  g_return_val_if_fail (variant != NULL, NULL);
+  g_return_val_if_fail (g_variant_is_of_type (variant, G_VARIANT_TYPE ("a{sas}")), NULL);
+
+  self = ide_highlight_index_new ();
+
+  g_variant_iter_init (&iter, variant);
+
+  while (g_variant_iter_next (&iter, "{&sas}", &tag, &words))
+    {
+      const gchar *interned = g_intern_string (tag);
+      const gchar *word;
+
+      while (g_variant_iter_next (words, "&s", &word))
+        ide_highlight_index_insert (self, word, (gpointer)interned);
+
+      g_variant_iter_free (words);
+    }
+
+  return self;
+}
+
 void
 ide_highlight_index_dump (IdeHighlightIndex *self)
 {
@@ -22,6 +22,8 @@
 #include "ide-highlighter.h"
 #include "ide-internal.h"
 
+#include "files/ide-file.h"
+
 G_DEFINE_INTERFACE (IdeHighlighter, ide_highlighter, IDE_TYPE_OBJECT)
 
 static void
@@ -92,3 +94,54 @@ ide_highlighter_load (IdeHighlighter *self)
   if (IDE_HIGHLIGHTER_GET_IFACE (self)->load)
     IDE_HIGHLIGHTER_GET_IFACE (self)->load (self);
 }
+
+/**
+ * ide_highlighter_can_compute:
+ * @self: A #IdeHighlighter.
+ *
+ * Checks if @self implements #IdeHighlighter::compute and can therefore
+ * be run from a worker thread.
+ *
+ * Returns: %TRUE if ide_highlighter_compute() is supported.
+ */
+gboolean
+ide_highlighter_can_compute (IdeHighlighter *self)
+{
+  g_return_val_if_fail (IDE_IS_HIGHLIGHTER (self), FALSE);
+
+  return IDE_HIGHLIGHTER_GET_IFACE (self)->compute != NULL;
+}
+
+/**
+ * ide_highlighter_compute:
+ * @self: A #IdeHighlighter.
+ * @file: The #IdeFile for @content.
+ * @content: A snapshot of the buffer contents.
+ * @begin_offset: The character offset to start from.
+ * @end_offset: The character offset to stop at.
+ * @spans: (element-type IdeHighlightSpan): An array to append spans to.
+ * @cancellable: (nullable): A #GCancellable or %NULL.
+ *
+ * Computes the highlights for a range of @content. Unlike
+ * ide_highlighter_update(), this may be called from a thread.
+ */
+void
+ide_highlighter_compute (IdeHighlighter *self,
+                         IdeFile        *file,
+                         GBytes         *content,
+                         guint           begin_offset,
+                         guint           end_offset,
+                         GArray         *spans,
+                         GCancellable   *cancellable)
+{
+  g_return_if_fail (IDE_IS_HIGHLIGHTER (self));
+  g_return_if_fail (IDE_IS_FILE (file));
+  g_return_if_fail (content != NULL);
+  g_return_if_fail (begin_offset <= end_offset);
+  g_return_if_fail (spans != NULL);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  if (IDE_HIGHLIGHTER_GET_IFACE (self)->compute)
+    IDE_HIGHLIGHTER_GET_IFACE (self)->compute (self, file, content, begin_offset,
+                                               end_offset, spans, cancellable);
+}
@@ -43,6 +43,32 @@ typedef IdeHighlightResult (*IdeHighlightCallback) (const GtkTextIter *begin,
                                                     const GtkTextIter *end,
                                                     const gchar       *style_name);
 
+typedef enum
+{
+  IDE_HIGHLIGHT_SPAN_NONE      = 0,
+  IDE_HIGHLIGHT_SPAN_CODE_ONLY = 1 << 0,
+} IdeHighlightSpanFlags;
+
+/**
+ * IdeHighlightSpan:
+ * @begin: the character offset of the start of the span
+ * @end: the character offset of the end of the span
+ * @style_name: an interned style name, see g_intern_string()
+ * @flags: #IdeHighlightSpanFlags for the span
+ *
+ * A span computed by #IdeHighlighter::compute. If @flags contains
+ * %IDE_HIGHLIGHT_SPAN_CODE_ONLY, the engine skips the span when it starts
+ * within a string, path or comment according to the buffer's own syntax
+ * highlighting, since that information is not available from a worker.
+ */
+typedef struct
+{
+  guint                 begin;
+  guint                 end;
+  const gchar          *style_name;
+  IdeHighlightSpanFlags flags;
+} IdeHighlightSpan;
+
 struct _IdeHighlighterInterface
 {
   GTypeInterface parent_interface;
@@ -70,14 +96,42 @@ struct _IdeHighlighterInterface
                       IdeHighlightEngine   *engine);
 
   void (*load)       (IdeHighlighter       *self);
+
+  /**
+   * IdeHighlighter::compute:
+   *
+   * Optional. #IdeHighlighter may implement this to compute highlights from
+   * a worker thread instead of from the main loop. @content is an immutable
+   * snapshot of the buffer for @file, and the highlighter should append an
+   * #IdeHighlightSpan to @spans for every range between the character offsets
+   * @begin_offset and @end_offset that should be styled.
+   *
+   * This is called without access to the #GtkTextBuffer, so implementations
+   * must only use state that is safe to access from another thread.
+   */
+  void (*compute)    (IdeHighlighter       *self,
+                      IdeFile              *file,
+                      GBytes               *content,
+                      guint                 begin_offset,
+                      guint                 end_offset,
+                      GArray               *spans,
+                      GCancellable         *cancellable);
 };
 
-void ide_highlighter_load   (IdeHighlighter       *self);
-void ide_highlighter_update (IdeHighlighter       *self,
-                             IdeHighlightCallback  callback,
-                             const GtkTextIter    *range_begin,
-                             const GtkTextIter    *range_end,
-                             GtkTextIter          *location);
+void     ide_highlighter_load        (IdeHighlighter       *self);
+void     ide_highlighter_update      (IdeHighlighter       *self,
+                                      IdeHighlightCallback  callback,
+                                      const GtkTextIter    *range_begin,
+                                      const GtkTextIter    *range_end,
+                                      GtkTextIter          *location);
+gboolean ide_highlighter_can_compute (IdeHighlighter       *self);
+void     ide_highlighter_compute     (IdeHighlighter       *self,
+                                      IdeFile              *file,
+                                      GBytes               *content,
+                                      guint                 begin_offset,
+                                      guint                 end_offset,
+                                      GArray               *spans,
+                                      GCancellable         *cancellable);
 
 G_END_DECLS
 
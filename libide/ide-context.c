@@ -87,13 +87,17 @@ struct _IdeContext
 
   guint                     restored : 1;
   guint                     restoring : 1;
+  guint                     deferred_loaded : 1;
+
+  GTask                    *pending_restore;
 
   GMutex                    unload_mutex;
   gint                      hold_count;
   GTask                    *delayed_unload_task;
 };
 
-static void async_initable_init (GAsyncInitableIface *);
+static void     async_initable_init (GAsyncInitableIface *);
+static gboolean restore_in_idle     (gpointer             user_data);
 
 G_DEFINE_TYPE_EXTENDED (IdeContext, ide_context, G_TYPE_OBJECT, 0,
                         G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE,
@@ -535,11 +539,33 @@ ide_context_loaded (IdeContext *self)
                               self);
 }
 
+static void
+ide_context_cancel_pending_restore (IdeContext *self)
+{
+  g_autoptr(GTask) task = NULL;
+
+  g_assert (IDE_IS_CONTEXT (self));
+
+  if (NULL == (task = g_steal_pointer (&self->pending_restore)))
+    return;
+
+  self->restoring = FALSE;
+
+  g_task_return_new_error (task,
+                           G_IO_ERROR,
+                           G_IO_ERROR_CANCELLED,
+                           "The context was unloaded before files could be restored");
+}
+
 static void
 ide_context_dispose (GObject *object)
 {
+  IdeContext *self = (IdeContext *)object;
+
   IDE_ENTRY;
 
+  ide_context_cancel_pending_restore (self);
+
   /*
    * TODO: Shutdown services.
    */
@@ -1542,22 +1568,113 @@ ide_context_init_diagnostics_manager (gpointer             source_object,
     g_task_return_boolean (task, TRUE);
 }
 
+/*
+ * Everything required before the workbench can be displayed. Steps whose
+ * requirements are satisfied run concurrently, so keep the requirements
+ * honest when adding new steps.
+ */
+static const IdeAsyncGraphStep init_steps[] = {
+  { "build-system",          ide_context_init_build_system },
+  { "vcs",                   ide_context_init_vcs,
+                             { "build-system" } },
+  { "project-name",          ide_context_init_project_name,
+                             { "build-system" } },
+  { "services",              ide_context_init_services,
+                             { "build-system", "vcs", "project-name" } },
+  { "unsaved-files",         ide_context_init_unsaved_files,
+                             { "project-name" } },
+  { "add-recent",            ide_context_init_add_recent,
+                             { "project-name" } },
+  { "search-engine",         ide_context_init_search_engine,
+                             { "services" } },
+  { "runtimes",              ide_context_init_runtimes,
+                             { "build-system", "vcs", "project-name" } },
+  { "configuration-manager", ide_context_init_configuration_manager,
+                             { "runtimes" } },
+  { "diagnostics-manager",   ide_context_init_diagnostics_manager,
+                             { "services" } },
+};
+
+/*
+ * Steps that are not needed to display the workbench. These are started
+ * from a low priority idle once the context has loaded so that they do
+ * not compete with the first frames of the workbench.
+ */
+static const IdeAsyncGraphStep deferred_init_steps[] = {
+  { "back-forward-list",     ide_context_init_back_forward_list },
+  { "snippets",              ide_context_init_snippets },
+  { "scripts",               ide_context_init_scripts },
+};
+
 static void
-ide_context_init_loaded (gpointer             source_object,
-                         GCancellable        *cancellable,
-                         GAsyncReadyCallback  callback,
-                         gpointer             user_data)
+ide_context_init_deferred_cb (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
 {
-  g_autoptr(GTask) task = NULL;
-  IdeContext *self = source_object;
+  IdeContext *self = (IdeContext *)object;
+  g_autoptr(GError) error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CONTEXT (self));
+  g_assert (G_IS_TASK (result));
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    g_warning ("Failed to complete deferred initialization: %s", error->message);
+
+  self->deferred_loaded = TRUE;
+
+  /* Restoring files wants the back-forward list to place the cursor */
+  if (self->pending_restore != NULL)
+    g_idle_add (restore_in_idle, g_steal_pointer (&self->pending_restore));
+
+  IDE_EXIT;
+}
+
+static gboolean
+ide_context_init_deferred (gpointer user_data)
+{
+  IdeContext *self = user_data;
 
   g_assert (IDE_IS_CONTEXT (self));
-  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  ide_async_helper_run_graph (self,
+                              deferred_init_steps,
+                              G_N_ELEMENTS (deferred_init_steps),
+                              NULL,
+                              ide_context_init_deferred_cb,
+                              NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_context_init_cb (GObject      *object,
+                     GAsyncResult *result,
+                     gpointer      user_data)
+{
+  IdeContext *self = (IdeContext *)object;
+  g_autoptr(GTask) task = user_data;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_CONTEXT (self));
+  g_assert (G_IS_TASK (result));
+  g_assert (G_IS_TASK (task));
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
 
   g_signal_emit (self, signals [LOADED], 0);
 
-  task = g_task_new (self, cancellable, callback, user_data);
   g_task_return_boolean (task, TRUE);
+
+  g_idle_add_full (G_PRIORITY_LOW,
+                   ide_context_init_deferred,
+                   g_object_ref (self),
+                   g_object_unref);
 }
 
 static void
@@ -1568,29 +1685,19 @@ ide_context_init_async (GAsyncInitable      *initable,
                         gpointer             user_data)
 {
   IdeContext *context = (IdeContext *)initable;
+  g_autoptr(GTask) task = NULL;
 
   g_return_if_fail (G_IS_ASYNC_INITABLE (context));
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  ide_async_helper_run (context,
-                        cancellable,
-                        callback,
-                        user_data,
-                        ide_context_init_build_system,
-                        ide_context_init_vcs,
-                        ide_context_init_services,
-                        ide_context_init_project_name,
-                        ide_context_init_back_forward_list,
-                        ide_context_init_snippets,
-                        ide_context_init_scripts,
-                        ide_context_init_unsaved_files,
-                        ide_context_init_add_recent,
-                        ide_context_init_search_engine,
-                        ide_context_init_runtimes,
-                        ide_context_init_configuration_manager,
-                        ide_context_init_diagnostics_manager,
-                        ide_context_init_loaded,
-                        NULL);
+  task = g_task_new (context, cancellable, callback, user_data);
+
+  ide_async_helper_run_graph (context,
+                              init_steps,
+                              G_N_ELEMENTS (init_steps),
+                              cancellable,
+                              ide_context_init_cb,
+                              g_object_ref (task));
 }
 
 static gboolean
@@ -1792,6 +1899,18 @@ ide_context_unload_back_forward_list (gpointer             source_object,
 
   task = g_task_new (self, cancellable, callback, user_data);
 
+  /*
+   * The back-forward list is loaded from a low priority idle after the
+   * context has loaded. If that has not finished yet, saving now would
+   * replace the user's history with an empty list.
+   */
+  if (!self->deferred_loaded)
+    {
+      IDE_TRACE_MSG ("Skipping back-forward list save, it was never loaded");
+      g_task_return_boolean (task, TRUE);
+      IDE_EXIT;
+    }
+
   file = get_back_forward_list_file (self);
   _ide_back_forward_list_save_async (self->back_forward_list,
                                      file,
@@ -1892,6 +2011,9 @@ ide_context_do_unload_locked (IdeContext *self)
   task = self->delayed_unload_task;
   self->delayed_unload_task = NULL;
 
+  /* Don't restore files into a context that is going away */
+  ide_context_cancel_pending_restore (self);
+
   g_clear_object (&self->device_manager);
   g_clear_object (&self->runtime_manager);
 
@@ -1973,8 +2095,6 @@ ide_context_unload_finish (IdeContext    *self,
   IDE_RETURN (ret);
 }
 
-static gboolean restore_in_idle (gpointer user_data);
-
 static void
 ide_context_restore__load_file_cb (GObject      *object,
                                    GAsyncResult *result,
@@ -2091,6 +2211,17 @@ ide_context_restore_async (IdeContext          *self,
 
   g_task_set_task_data (task, g_ptr_array_ref (ar), (GDestroyNotify)g_ptr_array_unref);
 
+  /*
+   * The back-forward list is loaded after the context has been loaded and
+   * we need it to restore the cursor positions, so wait for it if necessary.
+   */
+  if (!self->deferred_loaded)
+    {
+      g_assert (self->pending_restore == NULL);
+      self->pending_restore = g_object_ref (task);
+      return;
+    }
+
   g_idle_add (restore_in_idle, g_object_ref (task));
 }
 
@@ -23,31 +23,72 @@
 
 #include "ide-types.h"
 
+#include "diagnostics/ide-diagnostics-index.h"
 #include "highlighting/ide-highlight-engine.h"
 #include "history/ide-back-forward-item.h"
 #include "history/ide-back-forward-list.h"
+#include "sourceview/ide-completion-words.h"
 #include "sourceview/ide-source-view-mode.h"
 #include "sourceview/ide-source-view.h"
 #include "symbols/ide-symbol.h"
+#include "util/ide-ref-ptr.h"
 #include "util/ide-settings.h"
 
 G_BEGIN_DECLS
 
+typedef struct
+{
+  guint begin;
+  guint end;
+} IdeHighlightRange;
+
+/*
+ * The character offsets of the region of a buffer that is not highlighted
+ * yet, and the sorted ranges within it that were highlighted out of order.
+ */
+typedef struct
+{
+  guint   invalid_begin;
+  guint   invalid_end;
+  GArray *done;
+} IdeHighlightProgress;
+
 void                _ide_battery_monitor_init               (void);
 void                _ide_battery_monitor_shutdown           (void);
+void                _ide_battery_monitor_watch              (void                 (*func) (gboolean should_conserve));
 void                _ide_buffer_set_changed_on_volume       (IdeBuffer             *self,
                                                              gboolean               changed_on_volume);
+IdeDiagnosticsIndex *_ide_buffer_get_diagnostics_index     (IdeBuffer             *self);
+IdeHighlightEngine *_ide_buffer_get_highlight_engine        (IdeBuffer             *self);
+gboolean            _ide_buffer_get_mapped                  (IdeBuffer             *self);
 gboolean            _ide_buffer_get_loading                 (IdeBuffer             *self);
 void                _ide_buffer_set_loading                 (IdeBuffer             *self,
                                                              gboolean               loading);
 void                _ide_buffer_set_mtime                   (IdeBuffer             *self,
                                                              const GTimeVal        *mtime);
+void                _ide_buffer_set_view_mapped             (IdeBuffer             *self,
+                                                             gboolean               mapped);
 void                _ide_buffer_set_read_only               (IdeBuffer             *buffer,
                                                              gboolean               read_only);
 void                _ide_buffer_manager_reclaim             (IdeBufferManager      *self,
                                                              IdeBuffer             *buffer);
+IdeBufferSnapshot  *_ide_buffer_snapshot_new                (gboolean               implicit_trailing_newline);
+IdeBufferSnapshot  *_ide_buffer_snapshot_insert             (IdeBufferSnapshot     *self,
+                                                             gsize                  offset,
+                                                             const gchar           *text,
+                                                             gsize                  len);
+IdeBufferSnapshot  *_ide_buffer_snapshot_delete             (IdeBufferSnapshot     *self,
+                                                             gsize                  begin,
+                                                             gsize                  end);
+IdeBufferSnapshot  *_ide_buffer_snapshot_set_implicit_trailing_newline
+                                                            (IdeBufferSnapshot     *self,
+                                                             gboolean               implicit_trailing_newline);
 void                _ide_build_system_set_project_file      (IdeBuildSystem        *self,
                                                              GFile                 *project_file);
+void                _ide_completion_words_add_buffer        (IdeCompletionWords    *self,
+                                                             IdeBuffer             *buffer);
+void                _ide_completion_words_remove_buffer     (IdeCompletionWords    *self,
+                                                             IdeBuffer             *buffer);
 void                _ide_configuration_set_prebuild         (IdeConfiguration      *self,
                                                              IdeBuildCommandQueue  *prebuild);
 void                _ide_configuration_set_postbuild        (IdeConfiguration      *self,
@@ -61,6 +102,7 @@ IdeFixit           *_ide_fixit_new                          (IdeSourceRange
                                                              const gchar           *replacement_text);
 void                _ide_project_set_name                   (IdeProject            *project,
                                                              const gchar           *name);
+gboolean            _ide_ref_ptr_is_unique                  (IdeRefPtr             *self);
 void                _ide_runtime_manager_unload             (IdeRuntimeManager     *self);
 void                _ide_search_context_add_provider        (IdeSearchContext      *context,
                                                              IdeSearchProvider     *provider,
@@ -82,12 +124,32 @@ void                _ide_source_view_set_count              (IdeSourceView
 void                _ide_source_view_set_modifier           (IdeSourceView         *self,
                                                              gunichar               modifier);
 void                _ide_thread_pool_init                   (gboolean               is_worker);
+void                _ide_thread_pool_set_should_conserve    (gboolean               conserve);
+GPtrArray          *_ide_todo_miner_scan                    (GFile                 *file,
+                                                             const gchar           *data,
+                                                             gsize                  len);
 IdeUnsavedFile     *_ide_unsaved_file_new                   (GFile                 *file,
                                                              GBytes                *content,
                                                              const gchar           *temp_path,
                                                              gint64                 sequence);
 void                _ide_highlighter_set_highlighter_engine (IdeHighlighter        *highlighter,
                                                              IdeHighlightEngine    *highlight_engine);
+gboolean            _ide_highlight_span_rebase              (const IdeHighlightSpan *span,
+                                                             guint                  stale_begin,
+                                                             guint                  stale_end,
+                                                             gint                   delta,
+                                                             guint                 *begin,
+                                                             guint                 *end);
+gboolean            _ide_highlight_progress_next            (IdeHighlightProgress  *progress,
+                                                             const IdeHighlightRange *windows,
+                                                             guint                  n_windows,
+                                                             IdeHighlightRange     *range,
+                                                             gboolean              *priority);
+void                _ide_highlight_progress_done            (IdeHighlightProgress  *progress,
+                                                             const IdeHighlightRange *range,
+                                                             gboolean               priority);
+void                _ide_highlight_progress_invalidate      (IdeHighlightProgress  *progress,
+                                                             const IdeHighlightRange *range);
 const gchar        *_ide_source_view_get_mode_name          (IdeSourceView         *self);
 
 G_END_DECLS
@@ -35,8 +35,11 @@ typedef struct _IdeBufferChangeMonitor         IdeBufferChangeMonitor;
 
 typedef struct _IdeBufferManager               IdeBufferManager;
 
+typedef struct _IdeBufferSnapshot              IdeBufferSnapshot;
+
 typedef struct _IdeBuilder                     IdeBuilder;
 typedef struct _IdeBuildCommand                IdeBuildCommand;
+typedef struct _IdeBuildLog                    IdeBuildLog;
 typedef struct _IdeBuildCommandQueue           IdeBuildCommandQueue;
 typedef struct _IdeBuildManager                IdeBuildManager;
 typedef struct _IdeBuildResult                 IdeBuildResult;
@@ -32,17 +32,20 @@ G_BEGIN_DECLS
 #include "application/ide-application.h"
 #include "buffers/ide-buffer-change-monitor.h"
 #include "buffers/ide-buffer-manager.h"
+#include "buffers/ide-buffer-snapshot.h"
 #include "buffers/ide-buffer.h"
 #include "buffers/ide-unsaved-file.h"
 #include "buffers/ide-unsaved-files.h"
 #include "buildsystem/ide-build-command.h"
 #include "buildsystem/ide-build-command-queue.h"
+#include "buildsystem/ide-build-log.h"
 #include "buildsystem/ide-build-manager.h"
 #include "buildsystem/ide-build-result-addin.h"
 #include "buildsystem/ide-build-result.h"
 #include "buildsystem/ide-build-system.h"
 #include "buildsystem/ide-build-target.h"
 #include "buildsystem/ide-builder.h"
+#include "buildsystem/ide-compile-commands.h"
 #include "buildsystem/ide-configuration-manager.h"
 #include "buildsystem/ide-configuration.h"
 #include "buildsystem/ide-environment-variable.h"
@@ -132,6 +135,8 @@ G_BEGIN_DECLS
 #include "template/ide-project-template.h"
 #include "template/ide-template-provider.h"
 #include "threading/ide-thread-pool.h"
+#include "todo/ide-todo-item.h"
+#include "todo/ide-todo-miner.h"
 #include "transfers/ide-transfer.h"
 #include "transfers/ide-transfer-manager.h"
 #include "tree/ide-tree-builder.h"
@@ -25,9 +25,11 @@
 
 #include "ide-context.h"
 #include "ide-debug.h"
+#include "ide-macros.h"
 
 #include "buffers/ide-buffer.h"
 #include "buffers/ide-buffer-manager.h"
+#include "buffers/ide-buffer-snapshot.h"
 #include "diagnostics/ide-diagnostic.h"
 #include "diagnostics/ide-diagnostics.h"
 #include "diagnostics/ide-source-location.h"
@@ -43,11 +45,49 @@ typedef struct
   JsonrpcClient  *rpc_client;
   GIOStream      *io_stream;
   GHashTable     *diagnostics_by_file;
+  GHashTable     *documents;
   GPtrArray      *languages;
+  guint           flush_changes_source;
 } IdeLangservClientPrivate;
 
+typedef struct
+{
+  gint line;
+  gint column;
+} ChangePosition;
+
+/*
+ * Edits to a document are accumulated here and sent to the peer in a
+ * single textDocument/didChange. Adjacent edits, such as those made when
+ * typing or pressing backspace, are merged into a single change.
+ */
+typedef struct
+{
+  IdeBuffer      *buffer;
+  /* The insert-text and delete-range handlers of the buffer */
+  EggSignalGroup *buffer_signals;
+  /* Completed changes, not yet sent */
+  JsonArray      *changes;
+  /* The change being accumulated, relative to the document before it */
+  GString        *text;
+  ChangePosition  begin;
+  ChangePosition  end;
+  gint            range_length;
+  /* Where the accumulated text ends once applied */
+  ChangePosition  cursor;
+  /* Rough size of the serialized changes */
+  gsize           n_bytes;
+  gint            version;
+  guint           has_open : 1;
+  guint           full_sync : 1;
+} DocumentChanges;
+
 G_DEFINE_TYPE_WITH_PRIVATE (IdeLangservClient, ide_langserv_client, IDE_TYPE_OBJECT)
 
+#define FLUSH_CHANGES_DELAY_MSEC 50
+#define MAX_BATCHED_CHANGES      256
+#define CHANGE_OVERHEAD_BYTES    128
+
 enum {
   FILE_CHANGE_TYPE_CREATED = 1,
   FILE_CHANGE_TYPE_CHANGED = 2,
@@ -117,32 +157,152 @@ ide_langserv_client_clear_diagnostics (IdeLangservClient *self,
   IDE_EXIT;
 }
 
+static gint
+change_position_compare (const ChangePosition *a,
+                         const ChangePosition *b)
+{
+  if (a->line != b->line)
+    return a->line - b->line;
+  return a->column - b->column;
+}
+
 static void
-ide_langserv_client_buffer_saved (IdeLangservClient *self,
-                                  IdeBuffer         *buffer,
-                                  IdeBufferManager  *buffer_manager)
+change_position_advance (ChangePosition *pos,
+                         const gchar    *text,
+                         gsize           len)
+{
+  const gchar *end = text + len;
+
+  for (const gchar *iter = text; iter < end; iter = g_utf8_next_char (iter))
+    {
+      if (*iter == '\n')
+        {
+          pos->line++;
+          pos->column = 0;
+        }
+      else
+        pos->column++;
+    }
+}
+
+static void
+document_changes_free (gpointer data)
+{
+  DocumentChanges *doc = data;
+
+  if (doc->buffer_signals != NULL)
+    egg_signal_group_set_target (doc->buffer_signals, NULL);
+
+  g_clear_object (&doc->buffer_signals);
+  g_clear_object (&doc->buffer);
+  g_clear_pointer (&doc->changes, json_array_unref);
+  g_string_free (doc->text, TRUE);
+  g_slice_free (DocumentChanges, doc);
+}
+
+static DocumentChanges *
+document_changes_new (IdeBuffer *buffer)
+{
+  DocumentChanges *doc;
+
+  doc = g_slice_new0 (DocumentChanges);
+  doc->buffer = g_object_ref (buffer);
+  doc->changes = json_array_new ();
+  doc->text = g_string_new (NULL);
+
+  return doc;
+}
+
+/*
+ * Moves the change currently being accumulated into the list of changes
+ * that will be sent with the next textDocument/didChange.
+ */
+static void
+document_changes_close (DocumentChanges *doc)
+{
+  JsonNode *change;
+
+  g_assert (doc != NULL);
+
+  if (!doc->has_open)
+    return;
+
+  change = JCON_NEW (
+    "range", "{",
+      "start", "{",
+        "line", JCON_INT (doc->begin.line),
+        "character", JCON_INT (doc->begin.column),
+      "}",
+      "end", "{",
+        "line", JCON_INT (doc->end.line),
+        "character", JCON_INT (doc->end.column),
+      "}",
+    "}",
+    "rangeLength", JCON_INT (doc->range_length),
+    "text", JCON_STRING (doc->text->str)
+  );
+
+  json_array_add_element (doc->changes, change);
+
+  g_string_truncate (doc->text, 0);
+  doc->has_open = FALSE;
+}
+
+static void
+ide_langserv_client_flush_document (IdeLangservClient *self,
+                                    DocumentChanges   *doc)
 {
   g_autoptr(JsonNode) params = NULL;
+  g_autoptr(JsonArray) changes = NULL;
   g_autofree gchar *uri = NULL;
 
   IDE_ENTRY;
 
   g_assert (IDE_IS_LANGSERV_CLIENT (self));
-  g_assert (IDE_IS_BUFFER (buffer));
-  g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
+  g_assert (doc != NULL);
 
-  if (!ide_langserv_client_supports_buffer (self, buffer))
+  if (doc->full_sync)
+    {
+      g_autoptr(IdeBufferSnapshot) snapshot = ide_buffer_get_snapshot (doc->buffer);
+      g_autofree gchar *text = NULL;
+
+      /* Like the unsaved files, this includes the implicit trailing newline */
+      text = ide_buffer_snapshot_get_text (snapshot, 0, G_MAXSIZE);
+
+      g_clear_pointer (&doc->changes, json_array_unref);
+      doc->changes = json_array_new ();
+      json_array_add_element (doc->changes, JCON_NEW ("text", JCON_STRING (text)));
+
+      g_string_truncate (doc->text, 0);
+      doc->has_open = FALSE;
+      doc->full_sync = FALSE;
+    }
+  else
+    document_changes_close (doc);
+
+  if (json_array_get_length (doc->changes) == 0)
     IDE_EXIT;
 
-  uri = ide_buffer_get_uri (buffer);
+  IDE_TRACE_MSG ("Flushing %u changes", json_array_get_length (doc->changes));
+
+  changes = g_steal_pointer (&doc->changes);
+  doc->changes = json_array_new ();
+  doc->n_bytes = 0;
+
+  /* Versions must increase, even if the buffer change count does not */
+  doc->version = MAX ((gint)ide_buffer_get_change_count (doc->buffer), doc->version + 1);
+
+  uri = ide_buffer_get_uri (doc->buffer);
 
   params = JCON_NEW (
     "textDocument", "{",
       "uri", JCON_STRING (uri),
-    "}"
+      "version", JCON_INT (doc->version),
+    "}",
+    "contentChanges", JCON_ARRAY (changes)
   );
 
-  ide_langserv_client_send_notification_async (self, "textDocument/didSave",
+  ide_langserv_client_send_notification_async (self, "textDocument/didChange",
                                                g_steal_pointer (&params),
                                                NULL, NULL, NULL);
 
@@ -150,9 +310,94 @@ ide_langserv_client_buffer_saved (IdeLangservClient *self,
 }
 
 /*
- * TODO: This should all be delayed and buffered so we coalesce multiple
- *       events into a single dispatch.
+ * Sends all of the changes that have been accumulated for open documents.
+ * This must be done before any request which depends on the contents of
+ * the document as seen by the peer.
+ */
+static void
+ide_langserv_client_flush_changes (IdeLangservClient *self)
+{
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+  GHashTableIter iter;
+  gpointer value;
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+
+  ide_clear_source (&priv->flush_changes_source);
+
+  g_hash_table_iter_init (&iter, priv->documents);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    ide_langserv_client_flush_document (self, value);
+}
+
+static gboolean
+ide_langserv_client_flush_changes_timeout (gpointer data)
+{
+  IdeLangservClient *self = data;
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+
+  priv->flush_changes_source = 0;
+
+  ide_langserv_client_flush_changes (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Called after a change has been recorded for @doc. Takes care of falling
+ * back to a full document sync when the changes have become larger than
+ * the document itself, and of scheduling the flush.
+ */
+static void
+ide_langserv_client_changes_queued (IdeLangservClient *self,
+                                    DocumentChanges   *doc)
+{
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+  g_assert (doc != NULL);
+
+  if (!doc->full_sync &&
+      doc->n_bytes > (gsize)gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (doc->buffer)))
+    {
+      g_clear_pointer (&doc->changes, json_array_unref);
+      doc->changes = json_array_new ();
+      g_string_truncate (doc->text, 0);
+      doc->has_open = FALSE;
+      doc->full_sync = TRUE;
+    }
+
+  if (priv->flush_changes_source == 0)
+    priv->flush_changes_source = g_timeout_add (FLUSH_CHANGES_DELAY_MSEC,
+                                                ide_langserv_client_flush_changes_timeout,
+                                                self);
+}
+
+/*
+ * Closes the current change so that a new one may be started. If we have
+ * accumulated too many changes, they are sent immediately. That is safe
+ * to do from within the insert-text and delete-range handlers since the
+ * queued changes describe the document before the pending edit.
  */
+static void
+ide_langserv_client_begin_change (IdeLangservClient *self,
+                                  DocumentChanges   *doc)
+{
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+  g_assert (doc != NULL);
+  g_assert (!doc->full_sync);
+
+  document_changes_close (doc);
+
+  if (json_array_get_length (doc->changes) >= MAX_BATCHED_CHANGES)
+    ide_langserv_client_flush_document (self, doc);
+
+  doc->has_open = TRUE;
+  doc->n_bytes += CHANGE_OVERHEAD_BYTES;
+}
 
 static void
 ide_langserv_client_buffer_insert_text (IdeLangservClient *self,
@@ -161,12 +406,9 @@ ide_langserv_client_buffer_insert_text (IdeLangservClient *self,
                                         gint               len,
                                         IdeBuffer         *buffer)
 {
-  g_autoptr(JsonNode) params = NULL;
-  g_autofree gchar *uri = NULL;
-  g_autofree gchar *copy = NULL;
-  gint line;
-  gint column;
-  gint version;
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+  DocumentChanges *doc;
+  ChangePosition pos;
 
   IDE_ENTRY;
 
@@ -174,39 +416,34 @@ ide_langserv_client_buffer_insert_text (IdeLangservClient *self,
   g_assert (location != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
 
-  copy = g_strndup (new_text, len);
+  if (NULL == (doc = g_hash_table_lookup (priv->documents, buffer)))
+    IDE_EXIT;
 
-  uri = ide_buffer_get_uri (buffer);
-  version = (gint)ide_buffer_get_change_count (buffer);
+  if (doc->full_sync)
+    IDE_GOTO (queued);
 
-  line = gtk_text_iter_get_line (location);
-  column = gtk_text_iter_get_line_offset (location);
+  pos.line = gtk_text_iter_get_line (location);
+  pos.column = gtk_text_iter_get_line_offset (location);
 
-  params = JCON_NEW (
-    "textDocument", "{",
-      "uri", JCON_STRING (uri),
-      "version", JCON_INT (version),
-    "}",
-    "contentChanges", "[",
-      "{",
-        "range", "{",
-          "start", "{",
-            "line", JCON_INT (line),
-            "character", JCON_INT (column),
-          "}",
-          "end", "{",
-            "line", JCON_INT (line),
-            "character", JCON_INT (column),
-          "}",
-        "}",
-        "rangeLength", JCON_INT (0),
-        "text", JCON_STRING (copy),
-      "}",
-    "]");
+  /*
+   * If we are inserting at the end of the text we are accumulating, such
+   * as when typing, we can simply extend it.
+   */
+  if (!doc->has_open || change_position_compare (&pos, &doc->cursor) != 0)
+    {
+      ide_langserv_client_begin_change (self, doc);
+      doc->begin = pos;
+      doc->end = pos;
+      doc->cursor = pos;
+      doc->range_length = 0;
+    }
 
-  ide_langserv_client_send_notification_async (self, "textDocument/didChange",
-                                               g_steal_pointer (&params),
-                                               NULL, NULL, NULL);
+  g_string_append_len (doc->text, new_text, len);
+  change_position_advance (&doc->cursor, new_text, len);
+  doc->n_bytes += len;
+
+queued:
+  ide_langserv_client_changes_queued (self, doc);
 
   IDE_EXIT;
 }
@@ -217,14 +454,10 @@ ide_langserv_client_buffer_delete_range (IdeLangservClient *self,
                                          GtkTextIter       *end_iter,
                                          IdeBuffer         *buffer)
 {
-
-  g_autoptr(JsonNode) params = NULL;
-  g_autofree gchar *uri = NULL;
-  struct {
-    gint line;
-    gint column;
-  } begin, end;
-  gint version;
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+  DocumentChanges *doc;
+  ChangePosition begin;
+  ChangePosition end;
   gint length;
 
   IDE_ENTRY;
@@ -234,8 +467,11 @@ ide_langserv_client_buffer_delete_range (IdeLangservClient *self,
   g_assert (end_iter != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
 
-  uri = ide_buffer_get_uri (buffer);
-  version = (gint)ide_buffer_get_change_count (buffer);
+  if (NULL == (doc = g_hash_table_lookup (priv->documents, buffer)))
+    IDE_EXIT;
+
+  if (doc->full_sync)
+    IDE_GOTO (queued);
 
   begin.line = gtk_text_iter_get_line (begin_iter);
   begin.column = gtk_text_iter_get_line_offset (begin_iter);
@@ -245,29 +481,103 @@ ide_langserv_client_buffer_delete_range (IdeLangservClient *self,
 
   length = gtk_text_iter_get_offset (end_iter) - gtk_text_iter_get_offset (begin_iter);
 
+  if (doc->has_open && doc->text->len > 0)
+    {
+      /*
+       * Backspace over text we have not sent yet. The accumulated text
+       * covers doc->begin up to doc->cursor, so just trim it.
+       */
+      if (change_position_compare (&end, &doc->cursor) == 0 &&
+          change_position_compare (&begin, &doc->begin) >= 0)
+        {
+          const gchar *iter = doc->text->str + doc->text->len;
+
+          for (gint i = 0; i < length; i++)
+            iter = g_utf8_prev_char (iter);
+
+          doc->n_bytes -= (doc->text->str + doc->text->len) - iter;
+          g_string_truncate (doc->text, iter - doc->text->str);
+          doc->cursor = begin;
+
+          IDE_GOTO (queued);
+        }
+    }
+  else if (doc->has_open)
+    {
+      /* Backspace extending a pending deletion */
+      if (change_position_compare (&end, &doc->begin) == 0)
+        {
+          doc->begin = begin;
+          doc->cursor = begin;
+          doc->range_length += length;
+
+          IDE_GOTO (queued);
+        }
+
+      /*
+       * Forward delete extending a pending deletion. The text after the
+       * cursor continues from doc->end in the original document.
+       */
+      if (change_position_compare (&begin, &doc->begin) == 0)
+        {
+          if (end.line == begin.line)
+            doc->end.column += end.column - begin.column;
+          else
+            {
+              doc->end.line += end.line - begin.line;
+              doc->end.column = end.column;
+            }
+
+          doc->range_length += length;
+
+          IDE_GOTO (queued);
+        }
+    }
+
+  ide_langserv_client_begin_change (self, doc);
+
+  doc->begin = begin;
+  doc->end = end;
+  doc->cursor = begin;
+  doc->range_length = length;
+
+queued:
+  ide_langserv_client_changes_queued (self, doc);
+
+  IDE_EXIT;
+}
+
+static void
+ide_langserv_client_buffer_saved (IdeLangservClient *self,
+                                  IdeBuffer         *buffer,
+                                  IdeBufferManager  *buffer_manager)
+{
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+  g_autoptr(JsonNode) params = NULL;
+  g_autofree gchar *uri = NULL;
+  DocumentChanges *doc;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_LANGSERV_CLIENT (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
+
+  if (!ide_langserv_client_supports_buffer (self, buffer))
+    IDE_EXIT;
+
+  if (NULL != (doc = g_hash_table_lookup (priv->documents, buffer)))
+    ide_langserv_client_flush_document (self, doc);
+
+  uri = ide_buffer_get_uri (buffer);
+
   params = JCON_NEW (
     "textDocument", "{",
       "uri", JCON_STRING (uri),
-      "version", JCON_INT (version),
-    "}",
-    "contentChanges", "[",
-      "{",
-        "range", "{",
-          "start", "{",
-            "line", JCON_INT (begin.line),
-            "character", JCON_INT (begin.column),
-          "}",
-          "end", "{",
-            "line", JCON_INT (end.line),
-            "character", JCON_INT (end.column),
-          "}",
-        "}",
-        "rangeLength", JCON_INT (length),
-        "text", "",
-      "}",
-    "]");
+    "}"
+  );
 
-  ide_langserv_client_send_notification_async (self, "textDocument/didChange",
+  ide_langserv_client_send_notification_async (self, "textDocument/didSave",
                                                g_steal_pointer (&params),
                                                NULL, NULL, NULL);
 
@@ -279,8 +589,10 @@ ide_langserv_client_buffer_loaded (IdeLangservClient *self,
                                    IdeBuffer         *buffer,
                                    IdeBufferManager  *buffer_manager)
 {
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
   g_autoptr(JsonNode) params = NULL;
   g_autofree gchar *uri = NULL;
+  DocumentChanges *doc;
 
   IDE_ENTRY;
 
@@ -291,17 +603,30 @@ ide_langserv_client_buffer_loaded (IdeLangservClient *self,
   if (!ide_langserv_client_supports_buffer (self, buffer))
     IDE_EXIT;
 
-  g_signal_connect_object (buffer,
-                           "insert-text",
-                           G_CALLBACK (ide_langserv_client_buffer_insert_text),
-                           self,
-                           G_CONNECT_SWAPPED);
+  if (g_hash_table_contains (priv->documents, buffer))
+    IDE_EXIT;
 
-  g_signal_connect_object (buffer,
-                           "delete-range",
-                           G_CALLBACK (ide_langserv_client_buffer_delete_range),
-                           self,
-                           G_CONNECT_SWAPPED);
+  /*
+   * The handlers are disconnected along with the document, so that a
+   * buffer which is loaded again after an unbind is not tracked twice.
+   */
+  doc = document_changes_new (buffer);
+  doc->buffer_signals = egg_signal_group_new (IDE_TYPE_BUFFER);
+
+  egg_signal_group_connect_object (doc->buffer_signals,
+                                   "insert-text",
+                                   G_CALLBACK (ide_langserv_client_buffer_insert_text),
+                                   self,
+                                   G_CONNECT_SWAPPED);
+  egg_signal_group_connect_object (doc->buffer_signals,
+                                   "delete-range",
+                                   G_CALLBACK (ide_langserv_client_buffer_delete_range),
+                                   self,
+                                   G_CONNECT_SWAPPED);
+
+  egg_signal_group_set_target (doc->buffer_signals, buffer);
+
+  g_hash_table_insert (priv->documents, buffer, doc);
 
   uri = ide_buffer_get_uri (buffer);
 
@@ -324,8 +649,10 @@ ide_langserv_client_buffer_unloaded (IdeLangservClient *self,
                                      IdeBuffer         *buffer,
                                      IdeBufferManager  *buffer_manager)
 {
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
   g_autoptr(JsonNode) params = NULL;
   g_autofree gchar *uri = NULL;
+  DocumentChanges *doc;
 
   IDE_ENTRY;
 
@@ -336,6 +663,12 @@ ide_langserv_client_buffer_unloaded (IdeLangservClient *self,
   if (!ide_langserv_client_supports_buffer (self, buffer))
     IDE_EXIT;
 
+  if (NULL != (doc = g_hash_table_lookup (priv->documents, buffer)))
+    {
+      ide_langserv_client_flush_document (self, doc);
+      g_hash_table_remove (priv->documents, buffer);
+    }
+
   uri = ide_buffer_get_uri (buffer);
 
   params = JCON_NEW (
@@ -378,12 +711,17 @@ static void
 ide_langserv_client_buffer_manager_unbind (IdeLangservClient *self,
                                            EggSignalGroup    *signal_group)
 {
+  IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
+
   g_assert (IDE_IS_LANGSERV_CLIENT (self));
   g_assert (EGG_IS_SIGNAL_GROUP (signal_group));
 
   /* TODO: We need to track everything we've notified so that we
    *       can notify the peer to release its resources.
    */
+
+  ide_langserv_client_flush_changes (self);
+  g_hash_table_remove_all (priv->documents);
 }
 
 static void
@@ -654,7 +992,10 @@ ide_langserv_client_finalize (GObject *object)
   IdeLangservClient *self = (IdeLangservClient *)object;
   IdeLangservClientPrivate *priv = ide_langserv_client_get_instance_private (self);
 
+  ide_clear_source (&priv->flush_changes_source);
+
   g_clear_pointer (&priv->diagnostics_by_file, g_hash_table_unref);
+  g_clear_pointer (&priv->documents, g_hash_table_unref);
   g_clear_pointer (&priv->languages, g_ptr_array_unref);
   g_clear_object (&priv->rpc_client);
   g_clear_object (&priv->buffer_manager_signals);
@@ -791,6 +1132,8 @@ ide_langserv_client_init (IdeLangservClient *self)
                                                      g_object_unref,
                                                      (GDestroyNotify)ide_diagnostics_unref);
 
+  priv->documents = g_hash_table_new_full (NULL, NULL, NULL, document_changes_free);
+
   priv->buffer_manager_signals = egg_signal_group_new (IDE_TYPE_BUFFER_MANAGER);
 
   egg_signal_group_connect_object (priv->buffer_manager_signals,
@@ -982,6 +1325,7 @@ ide_langserv_client_stop (IdeLangservClient *self)
 
   if (priv->rpc_client != NULL)
     {
+      ide_langserv_client_flush_changes (self);
       jsonrpc_client_call_async (priv->rpc_client,
                                  "shutdown",
                                  NULL,
@@ -1056,6 +1400,9 @@ ide_langserv_client_call_async (IdeLangservClient   *self,
       IDE_EXIT;
     }
 
+  /* The peer must see our edits before it can answer the request */
+  ide_langserv_client_flush_changes (self);
+
   jsonrpc_client_call_async (priv->rpc_client,
                              method,
                              params,
@@ -1189,6 +1536,9 @@ ide_langserv_client_get_diagnostics_async (IdeLangservClient   *self,
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_source_tag (task, ide_langserv_client_get_diagnostics_async);
 
+  /* Make sure the peer is diagnosing the current contents */
+  ide_langserv_client_flush_changes (self);
+
   diagnostics = g_hash_table_lookup (priv->diagnostics_by_file, file);
 
   if (diagnostics != NULL)
@@ -189,6 +189,7 @@ ide_preferences_builtin_register_code_insight (IdePreferences *preferences)
 
   ide_preferences_add_list_group (preferences, "code-insight", "highlighting", _("Highlighting"), GTK_SELECTION_NONE, 0);
   ide_preferences_add_switch (preferences, "code-insight", "highlighting", "org.gnome.builder.code-insight", "semantic-highlighting", NULL, NULL, _("Semantic Highlighting"), _("Use code insight to highlight additional information discovered in source file"), NULL, 0);
+  ide_preferences_add_spin_button (preferences, "code-insight", "highlighting", "org.gnome.builder.code-insight", "highlight-priority-pages", NULL, _("Pages to highlight first"), _("Number of pages around the visible region to highlight before the rest of the file"), NULL, 10);
 
   ide_preferences_add_list_group (preferences, "code-insight", "completion", _("Completion"), GTK_SELECTION_NONE, 100);
   ide_preferences_add_switch (preferences, "code-insight", "completion", "org.gnome.builder.code-insight", "word-completion", NULL, NULL, _("Suggest words found in open files"), _("Suggests completions as you type based on words found in any open document"), NULL, 0);
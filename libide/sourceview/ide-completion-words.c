@@ -18,27 +18,331 @@
 
 #define G_LOG_DOMAIN "ide-completion-words"
 
+#include <string.h>
+
+#include "ide-internal.h"
+
+#include "buffers/ide-buffer.h"
+#include "buffers/ide-buffer-snapshot.h"
+#include "threading/ide-thread-pool.h"
+
 #include "ide-completion-provider.h"
 #include "ide-completion-words.h"
 
+#define SCAN_DELAY_MSEC 1000
+
+/*
+ * GtkSourceCompletionWords scans each buffer on the main thread with
+ * GtkTextIter, a batch at a time. Instead, we index the words of each
+ * buffer from its IdeBufferSnapshot on a worker thread, shortly after the
+ * buffer stops changing, and only use the parent class for its properties
+ * and the parts of GtkSourceCompletionProvider that do not depend on the
+ * index.
+ */
+
 struct _IdeCompletionWords
 {
   GtkSourceCompletionWords parent_instance;
+
+  /* IdeBuffer to WordsBuffer */
+  GHashTable *buffers;
 };
 
+typedef struct
+{
+  IdeCompletionWords *self;
+  IdeBuffer          *buffer;
+  gulong              changed_handler;
+  guint               scan_source;
+  GCancellable       *cancellable;
+
+  /* The snapshot @words was built from */
+  IdeBufferSnapshot  *scanned;
+
+  /* Unique words of the buffer, sorted with strcmp() */
+  GPtrArray          *words;
+} WordsBuffer;
+
+typedef struct
+{
+  IdeBufferSnapshot *snapshot;
+  GCancellable      *cancellable;
+  GHashTable        *words;
+  GString           *word;
+  guint              minimum_word_size;
+} Scan;
+
 static void completion_provider_init (GtkSourceCompletionProviderIface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (IdeCompletionWords, ide_completion_words, GTK_SOURCE_TYPE_COMPLETION_WORDS,
                          G_IMPLEMENT_INTERFACE (GTK_SOURCE_TYPE_COMPLETION_PROVIDER, completion_provider_init))
 
+static inline gboolean
+is_word_char (gunichar ch)
+{
+  return g_unichar_isalnum (ch) || ch == '_';
+}
+
+static void
+words_buffer_free (gpointer data)
+{
+  WordsBuffer *wb = data;
+
+  g_cancellable_cancel (wb->cancellable);
+  g_clear_object (&wb->cancellable);
+
+  if (wb->scan_source != 0)
+    {
+      g_source_remove (wb->scan_source);
+      wb->scan_source = 0;
+    }
+
+  g_signal_handler_disconnect (wb->buffer, wb->changed_handler);
+
+  g_clear_pointer (&wb->scanned, ide_buffer_snapshot_unref);
+  g_clear_pointer (&wb->words, g_ptr_array_unref);
+  g_clear_object (&wb->buffer);
+
+  g_slice_free (WordsBuffer, wb);
+}
+
+static void
+scan_free (gpointer data)
+{
+  Scan *scan = data;
+
+  g_clear_pointer (&scan->snapshot, ide_buffer_snapshot_unref);
+  g_clear_object (&scan->cancellable);
+  g_clear_pointer (&scan->words, g_hash_table_unref);
+  g_string_free (scan->word, TRUE);
+
+  g_slice_free (Scan, scan);
+}
+
+static void
+scan_flush_word (Scan *scan)
+{
+  if (scan->word->len == 0)
+    return;
+
+  if (g_utf8_strlen (scan->word->str, scan->word->len) >= scan->minimum_word_size &&
+      !g_hash_table_contains (scan->words, scan->word->str))
+    g_hash_table_add (scan->words, g_strndup (scan->word->str, scan->word->len));
+
+  g_string_truncate (scan->word, 0);
+}
+
+static gboolean
+scan_chunk (const gchar *text,
+            gsize        len,
+            gpointer     user_data)
+{
+  Scan *scan = user_data;
+  const gchar *end = text + len;
+
+  /* Chunks never split a character, but words may span several chunks */
+  while (text < end)
+    {
+      const gchar *next = g_utf8_next_char (text);
+
+      if (is_word_char (g_utf8_get_char (text)))
+        g_string_append_len (scan->word, text, next - text);
+      else
+        scan_flush_word (scan);
+
+      text = next;
+    }
+
+  return g_cancellable_is_cancelled (scan->cancellable);
+}
+
+static gint
+compare_words (gconstpointer a,
+               gconstpointer b)
+{
+  return strcmp (*(const gchar * const *)a, *(const gchar * const *)b);
+}
+
+static void
+ide_completion_words_scan_worker (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  Scan *scan = task_data;
+  GPtrArray *words;
+  GHashTableIter iter;
+  gpointer key;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (scan != NULL);
+
+  ide_buffer_snapshot_foreach_chunk (scan->snapshot, 0, G_MAXSIZE, scan_chunk, scan);
+  scan_flush_word (scan);
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  words = g_ptr_array_new_full (g_hash_table_size (scan->words), g_free);
+
+  g_hash_table_iter_init (&iter, scan->words);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      g_ptr_array_add (words, key);
+      g_hash_table_iter_steal (&iter);
+    }
+
+  g_ptr_array_sort (words, compare_words);
+
+  g_task_return_pointer (task, words, (GDestroyNotify)g_ptr_array_unref);
+}
+
+static void
+ide_completion_words_scan_cb (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  GTask *task = (GTask *)result;
+  g_autoptr(GError) error = NULL;
+  WordsBuffer *wb = user_data;
+  GPtrArray *words;
+  Scan *scan;
+
+  g_assert (IDE_IS_COMPLETION_WORDS (object));
+  g_assert (G_IS_TASK (task));
+
+  /* @wb is freed after cancelling the scan, so check before touching it */
+  if (!(words = g_task_propagate_pointer (task, &error)))
+    return;
+
+  scan = g_task_get_task_data (task);
+
+  g_clear_pointer (&wb->words, g_ptr_array_unref);
+  wb->words = words;
+
+  g_clear_pointer (&wb->scanned, ide_buffer_snapshot_unref);
+  wb->scanned = ide_buffer_snapshot_ref (scan->snapshot);
+}
+
+static gboolean
+ide_completion_words_scan_timeout (gpointer data)
+{
+  WordsBuffer *wb = data;
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
+  g_autoptr(GTask) task = NULL;
+  Scan *scan;
+
+  g_assert (wb != NULL);
+
+  wb->scan_source = 0;
+
+  snapshot = ide_buffer_get_snapshot (wb->buffer);
+
+  if (snapshot == wb->scanned)
+    return G_SOURCE_REMOVE;
+
+  g_cancellable_cancel (wb->cancellable);
+  g_clear_object (&wb->cancellable);
+  wb->cancellable = g_cancellable_new ();
+
+  scan = g_slice_new0 (Scan);
+  scan->snapshot = g_steal_pointer (&snapshot);
+  scan->cancellable = g_object_ref (wb->cancellable);
+  scan->words = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  scan->word = g_string_new (NULL);
+  g_object_get (wb->self, "minimum-word-size", &scan->minimum_word_size, NULL);
+
+  task = g_task_new (wb->self, wb->cancellable, ide_completion_words_scan_cb, wb);
+  g_task_set_source_tag (task, ide_completion_words_scan_timeout);
+  g_task_set_task_data (task, scan, scan_free);
+
+  ide_thread_pool_push_task_with_priority (IDE_THREAD_POOL_COMPILER,
+                                           IDE_THREAD_PRIORITY_IDLE,
+                                           task,
+                                           ide_completion_words_scan_worker);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_completion_words_queue_scan (WordsBuffer *wb,
+                                 guint        delay)
+{
+  g_assert (wb != NULL);
+
+  if (wb->scan_source != 0)
+    g_source_remove (wb->scan_source);
+
+  wb->scan_source = g_timeout_add (delay, ide_completion_words_scan_timeout, wb);
+}
+
+static void
+ide_completion_words_buffer_changed (WordsBuffer *wb,
+                                     IdeBuffer   *buffer)
+{
+  g_assert (wb != NULL);
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  ide_completion_words_queue_scan (wb, SCAN_DELAY_MSEC);
+}
+
+void
+_ide_completion_words_add_buffer (IdeCompletionWords *self,
+                                  IdeBuffer          *buffer)
+{
+  WordsBuffer *wb;
+
+  g_return_if_fail (IDE_IS_COMPLETION_WORDS (self));
+  g_return_if_fail (IDE_IS_BUFFER (buffer));
+
+  if (g_hash_table_contains (self->buffers, buffer))
+    return;
+
+  wb = g_slice_new0 (WordsBuffer);
+  wb->self = self;
+  wb->buffer = g_object_ref (buffer);
+  wb->changed_handler = g_signal_connect_swapped (buffer,
+                                                  "changed",
+                                                  G_CALLBACK (ide_completion_words_buffer_changed),
+                                                  wb);
+
+  g_hash_table_insert (self->buffers, buffer, wb);
+
+  ide_completion_words_queue_scan (wb, 0);
+}
+
+void
+_ide_completion_words_remove_buffer (IdeCompletionWords *self,
+                                     IdeBuffer          *buffer)
+{
+  g_return_if_fail (IDE_IS_COMPLETION_WORDS (self));
+  g_return_if_fail (IDE_IS_BUFFER (buffer));
+
+  g_hash_table_remove (self->buffers, buffer);
+}
+
+static void
+ide_completion_words_finalize (GObject *object)
+{
+  IdeCompletionWords *self = (IdeCompletionWords *)object;
+
+  g_clear_pointer (&self->buffers, g_hash_table_unref);
+
+  G_OBJECT_CLASS (ide_completion_words_parent_class)->finalize (object);
+}
+
 static void
 ide_completion_words_class_init (IdeCompletionWordsClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_completion_words_finalize;
 }
 
 static void
 ide_completion_words_init (IdeCompletionWords *self)
 {
+  self->buffers = g_hash_table_new_full (NULL, NULL, NULL, words_buffer_free);
 }
 
 static gboolean
@@ -73,8 +377,123 @@ ide_completion_words_match (GtkSourceCompletionProvider *provider,
   return TRUE;
 }
 
+/* Gets the word being typed before @iter */
+static gchar *
+get_word_before_iter (const GtkTextIter *iter)
+{
+  GtkTextIter begin = *iter;
+
+  while (gtk_text_iter_backward_char (&begin))
+    {
+      if (!is_word_char (gtk_text_iter_get_char (&begin)))
+        {
+          gtk_text_iter_forward_char (&begin);
+          break;
+        }
+    }
+
+  return gtk_text_iter_get_slice (&begin, iter);
+}
+
+/* Finds the first word that is not sorted before @prefix */
+static guint
+words_lower_bound (GPtrArray   *words,
+                   const gchar *prefix)
+{
+  guint lo = 0;
+  guint hi = words->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (strcmp (g_ptr_array_index (words, mid), prefix) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static void
+ide_completion_words_populate (GtkSourceCompletionProvider *provider,
+                               GtkSourceCompletionContext  *context)
+{
+  IdeCompletionWords *self = (IdeCompletionWords *)provider;
+  g_autoptr(GHashTable) seen = NULL;
+  g_autoptr(GPtrArray) matches = NULL;
+  g_autoptr(GdkPixbuf) icon = NULL;
+  g_autofree gchar *prefix = NULL;
+  GList *proposals = NULL;
+  GHashTableIter hiter;
+  GtkTextIter iter;
+  gpointer value;
+  guint minimum_word_size;
+  guint i;
+
+  g_assert (IDE_IS_COMPLETION_WORDS (self));
+  g_assert (GTK_SOURCE_IS_COMPLETION_CONTEXT (context));
+
+  if (!gtk_source_completion_context_get_iter (context, &iter))
+    goto finish;
+
+  g_object_get (self,
+                "icon", &icon,
+                "minimum-word-size", &minimum_word_size,
+                NULL);
+
+  prefix = get_word_before_iter (&iter);
+
+  if (*prefix == '\0' ||
+      (gtk_source_completion_context_get_activation (context) == GTK_SOURCE_COMPLETION_ACTIVATION_INTERACTIVE &&
+       g_utf8_strlen (prefix, -1) < minimum_word_size))
+    goto finish;
+
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  matches = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&hiter, self->buffers);
+
+  while (g_hash_table_iter_next (&hiter, NULL, &value))
+    {
+      WordsBuffer *wb = value;
+
+      if (wb->words == NULL)
+        continue;
+
+      for (i = words_lower_bound (wb->words, prefix); i < wb->words->len; i++)
+        {
+          gchar *word = g_ptr_array_index (wb->words, i);
+
+          if (!g_str_has_prefix (word, prefix))
+            break;
+
+          if (g_str_equal (word, prefix) || g_hash_table_contains (seen, word))
+            continue;
+
+          g_hash_table_add (seen, word);
+          g_ptr_array_add (matches, word);
+        }
+    }
+
+  g_ptr_array_sort (matches, compare_words);
+
+  for (i = matches->len; i > 0; i--)
+    {
+      const gchar *word = g_ptr_array_index (matches, i - 1);
+
+      proposals = g_list_prepend (proposals, gtk_source_completion_item_new (word, word, icon, NULL));
+    }
+
+finish:
+  gtk_source_completion_context_add_proposals (context, provider, proposals, TRUE);
+  g_list_free_full (proposals, g_object_unref);
+}
+
 static void
 completion_provider_init (GtkSourceCompletionProviderIface *iface)
 {
   iface->match = ide_completion_words_match;
+  iface->populate = ide_completion_words_populate;
 }
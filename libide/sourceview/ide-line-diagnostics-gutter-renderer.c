@@ -18,26 +18,73 @@
 
 #define G_LOG_DOMAIN "ide-line-diagnostics-gutter-renderer"
 
+#include "ide-internal.h"
+
 #include "buffers/ide-buffer.h"
+#include "diagnostics/ide-diagnostics-index.h"
 #include "sourceview/ide-line-diagnostics-gutter-renderer.h"
 
 struct _IdeLineDiagnosticsGutterRenderer
 {
   GtkSourceGutterRendererPixbuf parent_instance;
+
+  /*
+   * The severities of the lines being drawn, fetched at once from the
+   * diagnostics index of the buffer when drawing begins.
+   */
+  GArray *severities;
+  guint   first_line;
 };
 
 G_DEFINE_TYPE (IdeLineDiagnosticsGutterRenderer,
                ide_line_diagnostics_gutter_renderer,
                GTK_SOURCE_TYPE_GUTTER_RENDERER_PIXBUF)
 
+static void
+ide_line_diagnostics_gutter_renderer_begin (GtkSourceGutterRenderer *renderer,
+                                            cairo_t                 *cr,
+                                            GdkRectangle            *background_area,
+                                            GdkRectangle            *cell_area,
+                                            GtkTextIter             *begin,
+                                            GtkTextIter             *end)
+{
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)renderer;
+  GtkTextBuffer *buffer;
+  guint last_line;
+
+  g_assert (IDE_IS_LINE_DIAGNOSTICS_GUTTER_RENDERER (self));
+  g_assert (begin != NULL);
+  g_assert (end != NULL);
+
+  g_array_set_size (self->severities, 0);
+
+  buffer = gtk_text_iter_get_buffer (begin);
+
+  if (IDE_IS_BUFFER (buffer))
+    {
+      self->first_line = gtk_text_iter_get_line (begin);
+      last_line = MAX (self->first_line, gtk_text_iter_get_line (end));
+
+      g_array_set_size (self->severities, last_line - self->first_line + 1);
+      ide_diagnostics_index_get_severities (_ide_buffer_get_diagnostics_index (IDE_BUFFER (buffer)),
+                                            self->first_line,
+                                            last_line,
+                                            (guint8 *)(gpointer)self->severities->data);
+    }
+
+  if (GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->begin)
+    GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->begin (renderer, cr, background_area, cell_area, begin, end);
+}
+
 static void
 ide_line_diagnostics_gutter_renderer_query_data (GtkSourceGutterRenderer      *renderer,
                                                  GtkTextIter                  *begin,
                                                  GtkTextIter                  *end,
                                                  GtkSourceGutterRendererState  state)
 {
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)renderer;
   GtkTextBuffer *buffer;
-  IdeBufferLineFlags flags;
+  IdeDiagnosticSeverity severity;
   const gchar *icon_name = NULL;
   guint line;
 
@@ -51,19 +98,33 @@ ide_line_diagnostics_gutter_renderer_query_data (GtkSourceGutterRenderer      *r
     return;
 
   line = gtk_text_iter_get_line (begin);
-  flags = ide_buffer_get_line_flags (IDE_BUFFER (buffer), line);
-  flags &= IDE_BUFFER_LINE_FLAGS_DIAGNOSTICS_MASK;
-
-  if (flags == 0)
-    icon_name = NULL;
-  else if ((flags & IDE_BUFFER_LINE_FLAGS_ERROR) != 0)
-    icon_name = "process-stop-symbolic";
-  else if ((flags & IDE_BUFFER_LINE_FLAGS_WARNING) != 0)
-    icon_name = "dialog-warning-symbolic";
-  else if ((flags & IDE_BUFFER_LINE_FLAGS_NOTE) != 0)
-    icon_name = "dialog-information-symbolic";
+
+  if (line >= self->first_line && line - self->first_line < self->severities->len)
+    severity = g_array_index (self->severities, guint8, line - self->first_line);
   else
-    icon_name = NULL;
+    severity = ide_diagnostics_index_get_severity (_ide_buffer_get_diagnostics_index (IDE_BUFFER (buffer)), line);
+
+  switch (severity)
+    {
+    case IDE_DIAGNOSTIC_FATAL:
+    case IDE_DIAGNOSTIC_ERROR:
+      icon_name = "process-stop-symbolic";
+      break;
+
+    case IDE_DIAGNOSTIC_DEPRECATED:
+    case IDE_DIAGNOSTIC_WARNING:
+      icon_name = "dialog-warning-symbolic";
+      break;
+
+    case IDE_DIAGNOSTIC_NOTE:
+      icon_name = "dialog-information-symbolic";
+      break;
+
+    case IDE_DIAGNOSTIC_IGNORED:
+    default:
+      icon_name = NULL;
+      break;
+    }
 
   if (icon_name)
     g_object_set (renderer, "icon-name", icon_name, NULL);
@@ -71,15 +132,45 @@ ide_line_diagnostics_gutter_renderer_query_data (GtkSourceGutterRenderer      *r
     g_object_set (renderer, "pixbuf", NULL, NULL);
 }
 
+static void
+ide_line_diagnostics_gutter_renderer_end (GtkSourceGutterRenderer *renderer)
+{
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)renderer;
+
+  g_assert (IDE_IS_LINE_DIAGNOSTICS_GUTTER_RENDERER (self));
+
+  /* The severities are only valid while drawing */
+  g_array_set_size (self->severities, 0);
+
+  if (GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->end)
+    GTK_SOURCE_GUTTER_RENDERER_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->end (renderer);
+}
+
+static void
+ide_line_diagnostics_gutter_renderer_finalize (GObject *object)
+{
+  IdeLineDiagnosticsGutterRenderer *self = (IdeLineDiagnosticsGutterRenderer *)object;
+
+  g_clear_pointer (&self->severities, g_array_unref);
+
+  G_OBJECT_CLASS (ide_line_diagnostics_gutter_renderer_parent_class)->finalize (object);
+}
+
 static void
 ide_line_diagnostics_gutter_renderer_class_init (IdeLineDiagnosticsGutterRendererClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkSourceGutterRendererClass *renderer_class = GTK_SOURCE_GUTTER_RENDERER_CLASS (klass);
 
+  object_class->finalize = ide_line_diagnostics_gutter_renderer_finalize;
+
+  renderer_class->begin = ide_line_diagnostics_gutter_renderer_begin;
   renderer_class->query_data = ide_line_diagnostics_gutter_renderer_query_data;
+  renderer_class->end = ide_line_diagnostics_gutter_renderer_end;
 }
 
 static void
 ide_line_diagnostics_gutter_renderer_init (IdeLineDiagnosticsGutterRenderer *self)
 {
+  self->severities = g_array_new (FALSE, FALSE, sizeof (guint8));
 }
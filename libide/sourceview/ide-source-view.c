@@ -126,6 +126,7 @@ typedef struct
 
   EggBindingGroup             *file_setting_bindings;
   EggSignalGroup              *buffer_signals;
+  EggSignalGroup              *vadjustment_signals;
 
   guint                        change_sequence;
 
@@ -166,6 +167,7 @@ typedef struct
   GRegex                      *include_regex;
 
   guint                        auto_indent : 1;
+  guint                        buffer_mapped : 1;
   guint                        completion_blocked : 1;
   guint                        completion_visible : 1;
   guint                        enable_word_completion : 1;
@@ -1408,6 +1410,34 @@ ide_source_view__buffer_line_flags_changed_cb (IdeSourceView *self,
   IDE_EXIT;
 }
 
+/*
+ * Lets the highlight engine know what is on screen so that it can highlight
+ * that region before the rest of the buffer. This is only needed when the
+ * view scrolls, is resized, or the buffer is loaded, not on every draw.
+ */
+static void
+ide_source_view_update_visible_range (IdeSourceView *self)
+{
+  IdeSourceViewPrivate *priv = ide_source_view_get_instance_private (self);
+  IdeHighlightEngine *engine;
+  GdkRectangle area;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (IDE_IS_SOURCE_VIEW (self));
+
+  if (priv->buffer == NULL ||
+      !(engine = _ide_buffer_get_highlight_engine (priv->buffer)))
+    return;
+
+  gtk_text_view_get_visible_rect (GTK_TEXT_VIEW (self), &area);
+  gtk_text_view_get_iter_at_location (GTK_TEXT_VIEW (self), &begin, area.x, area.y);
+  gtk_text_view_get_iter_at_location (GTK_TEXT_VIEW (self), &end,
+                                      area.x + area.width, area.y + area.height);
+
+  ide_highlight_engine_set_visible_range (engine, &begin, &end);
+}
+
 static void
 ide_source_view__buffer_loaded_cb (IdeSourceView *self,
                                    IdeBuffer     *buffer)
@@ -1442,6 +1472,8 @@ ide_source_view__buffer_loaded_cb (IdeSourceView *self,
   if (gtk_adjustment_get_value (adj) == gtk_adjustment_get_lower (adj))
     ide_source_view_scroll_to_mark (self, insert, 0.0, TRUE, 0.5, 0.5, TRUE);
 
+  ide_source_view_update_visible_range (self);
+
   IDE_EXIT;
 }
 
@@ -1588,6 +1620,12 @@ ide_source_view_bind_buffer (IdeSourceView  *self,
 
   ide_buffer_hold (buffer);
 
+  if (gtk_widget_get_mapped (GTK_WIDGET (self)))
+    {
+      _ide_buffer_set_view_mapped (buffer, TRUE);
+      priv->buffer_mapped = TRUE;
+    }
+
   if (_ide_buffer_get_loading (buffer))
     {
       GtkSourceCompletion *completion;
@@ -1708,8 +1746,17 @@ ide_source_view_unbind_buffer (IdeSourceView  *self,
   g_clear_object (&priv->definition_highlight_start_mark);
   g_clear_object (&priv->definition_highlight_end_mark);
 
+  if (priv->buffer_mapped)
+    {
+      _ide_buffer_set_view_mapped (priv->buffer, FALSE);
+      priv->buffer_mapped = FALSE;
+    }
+
   ide_buffer_release (priv->buffer);
 
+  /* Not a reference, it must not be used once the buffer is unbound */
+  priv->buffer = NULL;
+
   IDE_EXIT;
 }
 
@@ -5437,6 +5484,7 @@ ide_source_view_do_size_allocate_hack_cb (gpointer data)
   priv->delay_size_allocate_chainup = 0;
 
   GTK_WIDGET_CLASS (ide_source_view_parent_class)->size_allocate (GTK_WIDGET (self), &alloc);
+  ide_source_view_update_visible_range (self);
 
   return G_SOURCE_REMOVE;
 }
@@ -5508,11 +5556,49 @@ ide_source_view_size_allocate (GtkWidget     *widget,
   g_assert (allocation != NULL);
 
   if (!ide_source_view_do_size_allocate_hack (self, allocation))
-    GTK_WIDGET_CLASS (ide_source_view_parent_class)->size_allocate (GTK_WIDGET (self), allocation);
+    {
+      GTK_WIDGET_CLASS (ide_source_view_parent_class)->size_allocate (GTK_WIDGET (self), allocation);
+      ide_source_view_update_visible_range (self);
+    }
 
   ide_source_view_set_overscroll_num_lines (self, priv->overscroll_num_lines);
 }
 
+static void
+ide_source_view_map (GtkWidget *widget)
+{
+  IdeSourceView *self = (IdeSourceView *)widget;
+  IdeSourceViewPrivate *priv = ide_source_view_get_instance_private (self);
+
+  g_assert (IDE_IS_SOURCE_VIEW (self));
+
+  GTK_WIDGET_CLASS (ide_source_view_parent_class)->map (widget);
+
+  /* Lets the buffer know it is on screen, such as to diagnose it first */
+  if (priv->buffer != NULL && !priv->buffer_mapped)
+    {
+      _ide_buffer_set_view_mapped (priv->buffer, TRUE);
+      priv->buffer_mapped = TRUE;
+    }
+}
+
+static void
+ide_source_view_unmap (GtkWidget *widget)
+{
+  IdeSourceView *self = (IdeSourceView *)widget;
+  IdeSourceViewPrivate *priv = ide_source_view_get_instance_private (self);
+
+  g_assert (IDE_IS_SOURCE_VIEW (self));
+
+  if (priv->buffer_mapped)
+    {
+      _ide_buffer_set_view_mapped (priv->buffer, FALSE);
+      priv->buffer_mapped = FALSE;
+    }
+
+  GTK_WIDGET_CLASS (ide_source_view_parent_class)->unmap (widget);
+}
+
 static gboolean
 ide_source_view_scroll_event (GtkWidget      *widget,
                               GdkEventScroll *event)
@@ -5821,6 +5907,7 @@ ide_source_view_dispose (GObject *object)
   g_clear_object (&priv->css_provider);
   g_clear_object (&priv->mode);
   g_clear_object (&priv->buffer_signals);
+  g_clear_object (&priv->vadjustment_signals);
   g_clear_object (&priv->file_setting_bindings);
 
   if (priv->command_str != NULL)
@@ -6082,6 +6169,8 @@ ide_source_view_class_init (IdeSourceViewClass *klass)
   widget_class->focus_out_event = ide_source_view_focus_out_event;
   widget_class->key_press_event = ide_source_view_key_press_event;
   widget_class->key_release_event = ide_source_view_key_release_event;
+  widget_class->map = ide_source_view_map;
+  widget_class->unmap = ide_source_view_unmap;
   widget_class->query_tooltip = ide_source_view_query_tooltip;
   widget_class->scroll_event = ide_source_view_scroll_event;
   widget_class->size_allocate = ide_source_view_size_allocate;
@@ -7070,6 +7159,17 @@ ide_source_view_init (IdeSourceView *self)
   g_object_bind_property_full (self, "buffer", priv->buffer_signals, "target", 0,
                                ignore_invalid_buffers, NULL, NULL, NULL);
 
+  priv->vadjustment_signals = egg_signal_group_new (GTK_TYPE_ADJUSTMENT);
+
+  egg_signal_group_connect_object (priv->vadjustment_signals,
+                                   "value-changed",
+                                   G_CALLBACK (ide_source_view_update_visible_range),
+                                   self,
+                                   G_CONNECT_SWAPPED);
+
+  g_object_bind_property (self, "vadjustment", priv->vadjustment_signals, "target",
+                          G_BINDING_SYNC_CREATE);
+
   /*
    * We block completion when we are not focused so that two SourceViews
    * viewing the same GtkTextBuffer do not both show completion
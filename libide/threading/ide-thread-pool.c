@@ -19,17 +19,42 @@
 #define G_LOG_DOMAIN "ide-thread-pool"
 
 #include <egg-counter.h>
+#include <fuzzy-private.h>
 
 #include "ide-debug.h"
+#include "ide-internal.h"
 
 #include "threading/ide-thread-pool.h"
 
-#define COMPILER_MAX_THREADS 4
-#define INDEXER_MAX_THREADS  1
+#define MIN_WORKERS              2
+#define MAX_WORKERS              16
+#define COMPILER_MAX_RUNNING     4
+#define INDEXER_MAX_RUNNING      1
+#define CONSERVE_MAX_RUNNING     1
+
+/*
+ * All worker threads share one set of queues, one per priority class. When a
+ * worker becomes idle it takes the first item of the highest priority class
+ * that it is allowed to run, so a long backlog of index work can no longer sit
+ * in front of interactive requests such as code completion.
+ *
+ * Each IdeThreadPoolKind has a limit on how many of its items may run at the
+ * same time. This keeps the indexer serialized as it always has been (several
+ * callers rely on that) and leaves a worker free for compiler work while a
+ * ctags index is being built. Compiler work is still capped at four items,
+ * since each of them can hold a large translation unit in memory.
+ *
+ * The battery state is watched from the main thread of the primary instance,
+ * where the UPower proxies live, and published to the workers with
+ * _ide_thread_pool_set_should_conserve() when it changes.
+ */
 
 typedef struct
 {
-  int type;
+  IdeThreadPoolKind  kind;
+  IdeThreadPriority  priority;
+  gint64             queued_at;
+  int                type;
   union {
     struct {
       GTask           *task;
@@ -44,59 +69,294 @@ typedef struct
 
 EGG_DEFINE_COUNTER (TotalTasks, "ThreadPool", "Total Tasks", "Total number of tasks processed.")
 EGG_DEFINE_COUNTER (QueuedTasks, "ThreadPool", "Queued Tasks", "Current number of pending tasks.")
-
-static GThreadPool *thread_pools [IDE_THREAD_POOL_LAST];
+EGG_DEFINE_COUNTER (CancelledTasks, "ThreadPool", "Cancelled Tasks", "Number of tasks cancelled before they were run.")
+
+EGG_DEFINE_COUNTER (InteractiveQueued, "ThreadPool", "Interactive Queued", "Current number of pending interactive tasks.")
+EGG_DEFINE_COUNTER (InteractiveRun, "ThreadPool", "Interactive Run", "Number of interactive tasks dequeued.")
+EGG_DEFINE_COUNTER (InteractiveWait, "ThreadPool", "Interactive Wait", "Total time interactive tasks spent queued, in microseconds.")
+EGG_DEFINE_COUNTER (DiagnoseQueued, "ThreadPool", "Diagnose Queued", "Current number of pending diagnose tasks.")
+EGG_DEFINE_COUNTER (DiagnoseRun, "ThreadPool", "Diagnose Run", "Number of diagnose tasks dequeued.")
+EGG_DEFINE_COUNTER (DiagnoseWait, "ThreadPool", "Diagnose Wait", "Total time diagnose tasks spent queued, in microseconds.")
+EGG_DEFINE_COUNTER (IndexQueued, "ThreadPool", "Index Queued", "Current number of pending index tasks.")
+EGG_DEFINE_COUNTER (IndexRun, "ThreadPool", "Index Run", "Number of index tasks dequeued.")
+EGG_DEFINE_COUNTER (IndexWait, "ThreadPool", "Index Wait", "Total time index tasks spent queued, in microseconds.")
+EGG_DEFINE_COUNTER (IdleQueued, "ThreadPool", "Idle Queued", "Current number of pending idle tasks.")
+EGG_DEFINE_COUNTER (IdleRun, "ThreadPool", "Idle Run", "Number of idle tasks dequeued.")
+EGG_DEFINE_COUNTER (IdleWait, "ThreadPool", "Idle Wait", "Total time idle tasks spent queued, in microseconds.")
 
 enum {
   TYPE_TASK,
   TYPE_FUNC,
 };
 
-static inline GThreadPool *
-ide_thread_pool_get_pool (IdeThreadPoolKind kind)
+static GMutex   scheduler_mutex;
+static GCond    scheduler_cond;
+static GQueue   queues [IDE_THREAD_PRIORITY_LAST];
+static guint    running [IDE_THREAD_POOL_LAST];
+static guint    max_running [IDE_THREAD_POOL_LAST];
+static guint    running_background;
+static guint    n_workers;
+static volatile gint should_conserve;
+
+static const IdeThreadPriority default_priorities [IDE_THREAD_POOL_LAST] = {
+  IDE_THREAD_PRIORITY_DIAGNOSE,
+  IDE_THREAD_PRIORITY_INDEX,
+};
+
+static inline gboolean
+is_background (IdeThreadPriority priority)
+{
+  return priority >= IDE_THREAD_PRIORITY_INDEX;
+}
+
+static void
+ide_thread_pool_count_queued (IdeThreadPriority priority,
+                              gint64            count)
+{
+  EGG_COUNTER_ADD (QueuedTasks, count);
+
+  switch (priority)
+    {
+    case IDE_THREAD_PRIORITY_INTERACTIVE:
+      EGG_COUNTER_ADD (InteractiveQueued, count);
+      break;
+
+    case IDE_THREAD_PRIORITY_DIAGNOSE:
+      EGG_COUNTER_ADD (DiagnoseQueued, count);
+      break;
+
+    case IDE_THREAD_PRIORITY_INDEX:
+      EGG_COUNTER_ADD (IndexQueued, count);
+      break;
+
+    case IDE_THREAD_PRIORITY_IDLE:
+      EGG_COUNTER_ADD (IdleQueued, count);
+      break;
+
+    case IDE_THREAD_PRIORITY_LAST:
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+ide_thread_pool_count_dequeued (IdeThreadPriority priority,
+                                gint64            waited)
+{
+  ide_thread_pool_count_queued (priority, -1);
+
+  switch (priority)
+    {
+    case IDE_THREAD_PRIORITY_INTERACTIVE:
+      EGG_COUNTER_INC (InteractiveRun);
+      EGG_COUNTER_ADD (InteractiveWait, waited);
+      break;
+
+    case IDE_THREAD_PRIORITY_DIAGNOSE:
+      EGG_COUNTER_INC (DiagnoseRun);
+      EGG_COUNTER_ADD (DiagnoseWait, waited);
+      break;
+
+    case IDE_THREAD_PRIORITY_INDEX:
+      EGG_COUNTER_INC (IndexRun);
+      EGG_COUNTER_ADD (IndexWait, waited);
+      break;
+
+    case IDE_THREAD_PRIORITY_IDLE:
+      EGG_COUNTER_INC (IdleRun);
+      EGG_COUNTER_ADD (IdleWait, waited);
+      break;
+
+    case IDE_THREAD_PRIORITY_LAST:
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/*
+ * Publishes the power state to the worker threads. While @conserve is set,
+ * only CONSERVE_MAX_RUNNING background items may run at the same time.
+ */
+void
+_ide_thread_pool_set_should_conserve (gboolean conserve)
+{
+  conserve = !!conserve;
+
+  if (conserve == g_atomic_int_get (&should_conserve))
+    return;
+
+  IDE_TRACE_MSG ("Background work %s", conserve ? "throttled" : "unthrottled");
+
+  /* Take the lock so that no worker can miss the wakeup. */
+  g_mutex_lock (&scheduler_mutex);
+  g_atomic_int_set (&should_conserve, conserve);
+  g_cond_broadcast (&scheduler_cond);
+  g_mutex_unlock (&scheduler_mutex);
+}
+
+static WorkItem *
+ide_thread_pool_dequeue_locked (void)
+{
+  guint i;
+
+  for (i = 0; i < IDE_THREAD_PRIORITY_LAST; i++)
+    {
+      GList *iter;
+
+      if (is_background (i) &&
+          g_atomic_int_get (&should_conserve) &&
+          running_background >= CONSERVE_MAX_RUNNING)
+        break;
+
+      for (iter = queues [i].head; iter != NULL; iter = iter->next)
+        {
+          WorkItem *work_item = iter->data;
+
+          if (running [work_item->kind] < max_running [work_item->kind])
+            {
+              g_queue_delete_link (&queues [i], iter);
+              return work_item;
+            }
+        }
+    }
+
+  return NULL;
+}
+
+static void
+ide_thread_pool_run (WorkItem *work_item)
+{
+  gpointer source_object;
+  gpointer task_data;
+  GCancellable *cancellable;
+
+  g_assert (work_item != NULL);
+
+  if (work_item->type == TYPE_TASK)
+    {
+      /*
+       * Don't spend a worker on a task nobody is waiting for anymore. This
+       * is common for diagnostics, which are cancelled on every keystroke.
+       */
+      if (g_task_return_error_if_cancelled (work_item->task.task))
+        {
+          EGG_COUNTER_INC (CancelledTasks);
+        }
+      else
+        {
+          source_object = g_task_get_source_object (work_item->task.task);
+          task_data = g_task_get_task_data (work_item->task.task);
+          cancellable = g_task_get_cancellable (work_item->task.task);
+
+          work_item->task.func (work_item->task.task, source_object, task_data, cancellable);
+        }
+
+      g_object_unref (work_item->task.task);
+    }
+  else if (work_item->type == TYPE_FUNC)
+    {
+      work_item->func.callback (work_item->func.data);
+    }
+}
+
+static gpointer
+ide_thread_pool_worker (gpointer data)
+{
+  for (;;)
+    {
+      WorkItem *work_item;
+
+      g_mutex_lock (&scheduler_mutex);
+
+      while (NULL == (work_item = ide_thread_pool_dequeue_locked ()))
+        g_cond_wait (&scheduler_cond, &scheduler_mutex);
+
+      running [work_item->kind]++;
+      if (is_background (work_item->priority))
+        running_background++;
+
+      g_mutex_unlock (&scheduler_mutex);
+
+      ide_thread_pool_count_dequeued (work_item->priority,
+                                      g_get_monotonic_time () - work_item->queued_at);
+
+      ide_thread_pool_run (work_item);
+
+      g_mutex_lock (&scheduler_mutex);
+
+      running [work_item->kind]--;
+      if (is_background (work_item->priority))
+        running_background--;
+
+      /* Items held back by the limits above may be runnable now. */
+      g_cond_broadcast (&scheduler_cond);
+
+      g_mutex_unlock (&scheduler_mutex);
+
+      g_slice_free (WorkItem, work_item);
+    }
+
+  return NULL;
+}
+
+static void
+ide_thread_pool_enqueue (WorkItem *work_item)
 {
-  return thread_pools [kind];
+  g_assert (work_item != NULL);
+  g_assert (work_item->kind < IDE_THREAD_POOL_LAST);
+  g_assert (work_item->priority < IDE_THREAD_PRIORITY_LAST);
+
+  work_item->queued_at = g_get_monotonic_time ();
+
+  ide_thread_pool_count_queued (work_item->priority, 1);
+
+  g_mutex_lock (&scheduler_mutex);
+  g_queue_push_tail (&queues [work_item->priority], work_item);
+  g_cond_signal (&scheduler_cond);
+  g_mutex_unlock (&scheduler_mutex);
 }
 
 /**
- * ide_thread_pool_push_task:
+ * ide_thread_pool_push_task_with_priority:
  * @kind: The task kind.
+ * @priority: The priority class for @task.
  * @task: A #GTask to execute.
  * @func: (scope async): The thread worker to execute for @task.
  *
- * This pushes a task to be executed on a worker thread based on the task kind as denoted by
- * @kind. Some tasks will be placed on special work queues or throttled based on priority.
+ * Like ide_thread_pool_push_task() but allows the caller to choose the
+ * priority class of the work item. If @task has been cancelled by the time
+ * a worker thread picks it up, @func is not called and the task returns
+ * %G_IO_ERROR_CANCELLED.
  */
 void
-ide_thread_pool_push_task (IdeThreadPoolKind  kind,
-                           GTask             *task,
-                           GTaskThreadFunc    func)
+ide_thread_pool_push_task_with_priority (IdeThreadPoolKind  kind,
+                                         IdeThreadPriority  priority,
+                                         GTask             *task,
+                                         GTaskThreadFunc    func)
 {
-  GThreadPool *pool;
-
   IDE_ENTRY;
 
   g_return_if_fail (kind >= 0);
   g_return_if_fail (kind < IDE_THREAD_POOL_LAST);
+  g_return_if_fail (priority >= 0);
+  g_return_if_fail (priority < IDE_THREAD_PRIORITY_LAST);
   g_return_if_fail (G_IS_TASK (task));
   g_return_if_fail (func != NULL);
 
   EGG_COUNTER_INC (TotalTasks);
 
-  pool = ide_thread_pool_get_pool (kind);
-
-  if (pool != NULL)
+  if (n_workers > 0)
     {
       WorkItem *work_item;
 
       work_item = g_slice_new0 (WorkItem);
+      work_item->kind = kind;
+      work_item->priority = priority;
       work_item->type = TYPE_TASK;
       work_item->task.task = g_object_ref (task);
       work_item->task.func = func;
 
-      EGG_COUNTER_INC (QueuedTasks);
-
-      g_thread_pool_push (pool, work_item, NULL);
+      ide_thread_pool_enqueue (work_item);
     }
   else
     {
@@ -107,42 +367,66 @@ ide_thread_pool_push_task (IdeThreadPoolKind  kind,
 }
 
 /**
- * ide_thread_pool_push:
+ * ide_thread_pool_push_task:
+ * @kind: The task kind.
+ * @task: A #GTask to execute.
+ * @func: (scope async): The thread worker to execute for @task.
+ *
+ * This pushes a task to be executed on a worker thread based on the task kind as denoted by
+ * @kind. Some tasks will be placed on special work queues or throttled based on priority.
+ *
+ * Compiler tasks are queued with %IDE_THREAD_PRIORITY_DIAGNOSE and indexer tasks with
+ * %IDE_THREAD_PRIORITY_INDEX.
+ */
+void
+ide_thread_pool_push_task (IdeThreadPoolKind  kind,
+                           GTask             *task,
+                           GTaskThreadFunc    func)
+{
+  g_return_if_fail (kind >= 0);
+  g_return_if_fail (kind < IDE_THREAD_POOL_LAST);
+
+  ide_thread_pool_push_task_with_priority (kind, default_priorities [kind], task, func);
+}
+
+/**
+ * ide_thread_pool_push_with_priority:
  * @kind: the threadpool kind to use.
+ * @priority: The priority class for @func.
  * @func: (scope async) (closure func_data): A function to call in the worker thread.
  * @func_data: user data for @func.
  *
- * Runs the callback on the thread pool thread.
+ * Like ide_thread_pool_push() but allows the caller to choose the priority
+ * class of the work item.
  */
 void
-ide_thread_pool_push (IdeThreadPoolKind kind,
-                      IdeThreadFunc     func,
-                      gpointer          func_data)
+ide_thread_pool_push_with_priority (IdeThreadPoolKind kind,
+                                    IdeThreadPriority priority,
+                                    IdeThreadFunc     func,
+                                    gpointer          func_data)
 {
-  GThreadPool *pool;
-
   IDE_ENTRY;
 
   g_return_if_fail (kind >= 0);
   g_return_if_fail (kind < IDE_THREAD_POOL_LAST);
+  g_return_if_fail (priority >= 0);
+  g_return_if_fail (priority < IDE_THREAD_PRIORITY_LAST);
   g_return_if_fail (func != NULL);
 
   EGG_COUNTER_INC (TotalTasks);
 
-  pool = ide_thread_pool_get_pool (kind);
-
-  if (pool != NULL)
+  if (n_workers > 0)
     {
       WorkItem *work_item;
 
       work_item = g_slice_new0 (WorkItem);
+      work_item->kind = kind;
+      work_item->priority = priority;
       work_item->type = TYPE_FUNC;
       work_item->func.callback = func;
       work_item->func.data = func_data;
 
-      EGG_COUNTER_INC (QueuedTasks);
-
-      g_thread_pool_push (pool, work_item, NULL);
+      ide_thread_pool_enqueue (work_item);
     }
   else
     {
@@ -152,69 +436,65 @@ ide_thread_pool_push (IdeThreadPoolKind kind,
   IDE_EXIT;
 }
 
-static void
-ide_thread_pool_worker (gpointer data,
-                        gpointer user_data)
+/**
+ * ide_thread_pool_push:
+ * @kind: the threadpool kind to use.
+ * @func: (scope async) (closure func_data): A function to call in the worker thread.
+ * @func_data: user data for @func.
+ *
+ * Runs the callback on the thread pool thread.
+ */
+void
+ide_thread_pool_push (IdeThreadPoolKind kind,
+                      IdeThreadFunc     func,
+                      gpointer          func_data)
 {
-  WorkItem *work_item = data;
-  gpointer source_object;
-  gpointer task_data;
-  GCancellable *cancellable;
-
-  g_assert (work_item != NULL);
-
-  EGG_COUNTER_DEC (QueuedTasks);
-
-  if (work_item->type == TYPE_TASK)
-    {
-      source_object = g_task_get_source_object (work_item->task.task);
-      task_data = g_task_get_task_data (work_item->task.task);
-      cancellable = g_task_get_cancellable (work_item->task.task);
-
-      work_item->task.func (work_item->task.task, source_object, task_data, cancellable);
+  g_return_if_fail (kind >= 0);
+  g_return_if_fail (kind < IDE_THREAD_POOL_LAST);
 
-      g_object_unref (work_item->task.task);
-    }
-  else if (work_item->type == TYPE_FUNC)
-    {
-      work_item->func.callback (work_item->func.data);
-    }
+  ide_thread_pool_push_with_priority (kind, default_priorities [kind], func, func_data);
+}
 
-  g_slice_free (WorkItem, work_item);
+static void
+ide_thread_pool_push_fuzzy (FuzzyWorkFunc func,
+                            gpointer      data)
+{
+  ide_thread_pool_push_with_priority (IDE_THREAD_POOL_COMPILER,
+                                      IDE_THREAD_PRIORITY_INTERACTIVE,
+                                      func,
+                                      data);
 }
 
 void
 _ide_thread_pool_init (gboolean is_worker)
 {
-  gint compiler = COMPILER_MAX_THREADS;
-  gint indexer = INDEXER_MAX_THREADS;
-  gboolean exclusive = FALSE;
+  guint i;
 
-  if (is_worker)
-    {
-      compiler = 1;
-      indexer = 1;
-      exclusive = TRUE;
-    }
+  g_return_if_fail (n_workers == 0);
 
   /*
-   * Create our thread pool exclusive to compiler tasks (such as those from Clang).
-   * We don't want to consume threads from other GTask's such as those regarding IO so we manage
-   * these work items exclusively.
+   * Size the pool from the number of processors, but keep at least two
+   * workers so that indexing can never starve the compiler. Worker processes
+   * only service a single client and get the minimum.
    */
-  thread_pools [IDE_THREAD_POOL_COMPILER] = g_thread_pool_new (ide_thread_pool_worker,
-                                                               NULL,
-                                                               compiler,
-                                                               exclusive,
-                                                               NULL);
+  if (is_worker)
+    n_workers = MIN_WORKERS;
+  else
+    n_workers = CLAMP (g_get_num_processors (), MIN_WORKERS, MAX_WORKERS);
 
-  /*
-   * Create our pool exclusive to things like indexing. Such examples including building of
-   * ctags indexes or highlight indexes.
-   */
-  thread_pools [IDE_THREAD_POOL_INDEXER] = g_thread_pool_new (ide_thread_pool_worker,
-                                                              NULL,
-                                                              indexer,
-                                                              exclusive,
-                                                              NULL);
+  max_running [IDE_THREAD_POOL_COMPILER] = MIN (COMPILER_MAX_RUNNING, MAX (1, n_workers - 1));
+  max_running [IDE_THREAD_POOL_INDEXER] = INDEXER_MAX_RUNNING;
+
+  for (i = 0; i < IDE_THREAD_PRIORITY_LAST; i++)
+    g_queue_init (&queues [i]);
+
+  for (i = 0; i < n_workers; i++)
+    {
+      g_autofree gchar *name = g_strdup_printf ("ide-worker-%u", i);
+
+      g_thread_unref (g_thread_new (name, ide_thread_pool_worker, NULL));
+    }
+
+  /* Searches are interactive, so they may overtake queued diagnostics */
+  _fuzzy_set_push_func (ide_thread_pool_push_fuzzy);
 }
@@ -32,6 +32,25 @@ typedef enum
   IDE_THREAD_POOL_LAST
 } IdeThreadPoolKind;
 
+/**
+ * IdeThreadPriority:
+ * @IDE_THREAD_PRIORITY_INTERACTIVE: Work the user is actively waiting on, such as completion.
+ * @IDE_THREAD_PRIORITY_DIAGNOSE: Parsing and diagnostics for open buffers.
+ * @IDE_THREAD_PRIORITY_INDEX: Building of indexes such as ctags or the build cache.
+ * @IDE_THREAD_PRIORITY_IDLE: Opportunistic work that may be delayed indefinitely.
+ *
+ * Work items are always dequeued from the highest priority class that has
+ * runnable work. Index and idle work is throttled while on battery power.
+ */
+typedef enum
+{
+  IDE_THREAD_PRIORITY_INTERACTIVE,
+  IDE_THREAD_PRIORITY_DIAGNOSE,
+  IDE_THREAD_PRIORITY_INDEX,
+  IDE_THREAD_PRIORITY_IDLE,
+  IDE_THREAD_PRIORITY_LAST
+} IdeThreadPriority;
+
 /**
  * IdeThreadFunc:
  * @user_data: (closure) (transfer full): The closure for the callback.
@@ -39,12 +58,20 @@ typedef enum
  */
 typedef void (*IdeThreadFunc) (gpointer user_data);
 
-void     ide_thread_pool_push      (IdeThreadPoolKind     kind,
-                                    IdeThreadFunc         func,
-                                    gpointer              func_data);
-void     ide_thread_pool_push_task (IdeThreadPoolKind     kind,
-                                    GTask                *task,
-                                    GTaskThreadFunc       func);
+void     ide_thread_pool_push                    (IdeThreadPoolKind     kind,
+                                                  IdeThreadFunc         func,
+                                                  gpointer              func_data);
+void     ide_thread_pool_push_with_priority      (IdeThreadPoolKind     kind,
+                                                  IdeThreadPriority     priority,
+                                                  IdeThreadFunc         func,
+                                                  gpointer              func_data);
+void     ide_thread_pool_push_task               (IdeThreadPoolKind     kind,
+                                                  GTask                *task,
+                                                  GTaskThreadFunc       func);
+void     ide_thread_pool_push_task_with_priority (IdeThreadPoolKind     kind,
+                                                  IdeThreadPriority     priority,
+                                                  GTask                *task,
+                                                  GTaskThreadFunc       func);
 
 G_END_DECLS
 
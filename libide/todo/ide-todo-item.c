@@ -0,0 +1,221 @@
+/* ide-todo-item.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-todo-item"
+
+#include <string.h>
+
+#include "todo/ide-todo-item.h"
+
+struct _IdeTodoItem
+{
+  GObject  parent_instance;
+
+  GFile   *file;
+  gchar   *message;
+  guint    line;
+};
+
+enum {
+  PROP_0,
+  PROP_FILE,
+  PROP_LINE,
+  PROP_MESSAGE,
+  LAST_PROP
+};
+
+G_DEFINE_TYPE (IdeTodoItem, ide_todo_item, G_TYPE_OBJECT)
+
+static GParamSpec *properties [LAST_PROP];
+
+/**
+ * ide_todo_item_new:
+ * @file: the file containing the item
+ * @line: the line of the item, starting from 1
+ * @message: the line of the item followed by the lines after it
+ *
+ * Returns: (transfer full): An #IdeTodoItem.
+ */
+IdeTodoItem *
+ide_todo_item_new (GFile       *file,
+                   guint        line,
+                   const gchar *message)
+{
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+  g_return_val_if_fail (message != NULL, NULL);
+
+  return g_object_new (IDE_TYPE_TODO_ITEM,
+                       "file", file,
+                       "line", line,
+                       "message", message,
+                       NULL);
+}
+
+/**
+ * ide_todo_item_get_file:
+ *
+ * Returns: (transfer none): A #GFile.
+ */
+GFile *
+ide_todo_item_get_file (IdeTodoItem *self)
+{
+  g_return_val_if_fail (IDE_IS_TODO_ITEM (self), NULL);
+
+  return self->file;
+}
+
+guint
+ide_todo_item_get_line (IdeTodoItem *self)
+{
+  g_return_val_if_fail (IDE_IS_TODO_ITEM (self), 0);
+
+  return self->line;
+}
+
+const gchar *
+ide_todo_item_get_message (IdeTodoItem *self)
+{
+  g_return_val_if_fail (IDE_IS_TODO_ITEM (self), NULL);
+
+  return self->message;
+}
+
+/**
+ * ide_todo_item_get_summary:
+ *
+ * Gets the first line of the message, without surrounding whitespace.
+ *
+ * Returns: (transfer full): A newly allocated string.
+ */
+gchar *
+ide_todo_item_get_summary (IdeTodoItem *self)
+{
+  const gchar *endptr;
+
+  g_return_val_if_fail (IDE_IS_TODO_ITEM (self), NULL);
+
+  if (NULL == (endptr = strchr (self->message, '\n')))
+    endptr = self->message + strlen (self->message);
+
+  return g_strstrip (g_strndup (self->message, endptr - self->message));
+}
+
+static void
+ide_todo_item_finalize (GObject *object)
+{
+  IdeTodoItem *self = (IdeTodoItem *)object;
+
+  g_clear_object (&self->file);
+  g_clear_pointer (&self->message, g_free);
+
+  G_OBJECT_CLASS (ide_todo_item_parent_class)->finalize (object);
+}
+
+static void
+ide_todo_item_get_property (GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  IdeTodoItem *self = IDE_TODO_ITEM (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      g_value_set_object (value, self->file);
+      break;
+
+    case PROP_LINE:
+      g_value_set_uint (value, self->line);
+      break;
+
+    case PROP_MESSAGE:
+      g_value_set_string (value, self->message);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+ide_todo_item_set_property (GObject      *object,
+                            guint         prop_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+  IdeTodoItem *self = IDE_TODO_ITEM (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      self->file = g_value_dup_object (value);
+      break;
+
+    case PROP_LINE:
+      self->line = g_value_get_uint (value);
+      break;
+
+    case PROP_MESSAGE:
+      self->message = g_value_dup_string (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+ide_todo_item_class_init (IdeTodoItemClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_todo_item_finalize;
+  object_class->get_property = ide_todo_item_get_property;
+  object_class->set_property = ide_todo_item_set_property;
+
+  properties [PROP_FILE] =
+    g_param_spec_object ("file",
+                         "File",
+                         "The file containing the item",
+                         G_TYPE_FILE,
+                         (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_LINE] =
+    g_param_spec_uint ("line",
+                       "Line",
+                       "The line of the item, starting from 1",
+                       0,
+                       G_MAXUINT,
+                       0,
+                       (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_MESSAGE] =
+    g_param_spec_string ("message",
+                         "Message",
+                         "The line of the item followed by the lines after it",
+                         NULL,
+                         (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, LAST_PROP, properties);
+}
+
+static void
+ide_todo_item_init (IdeTodoItem *self)
+{
+}
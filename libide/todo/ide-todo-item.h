@@ -0,0 +1,40 @@
+/* ide-todo-item.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_TODO_ITEM_H
+#define IDE_TODO_ITEM_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_TODO_ITEM (ide_todo_item_get_type())
+
+G_DECLARE_FINAL_TYPE (IdeTodoItem, ide_todo_item, IDE, TODO_ITEM, GObject)
+
+IdeTodoItem *ide_todo_item_new         (GFile       *file,
+                                        guint        line,
+                                        const gchar *message);
+GFile       *ide_todo_item_get_file    (IdeTodoItem *self);
+guint        ide_todo_item_get_line    (IdeTodoItem *self);
+const gchar *ide_todo_item_get_message (IdeTodoItem *self);
+gchar       *ide_todo_item_get_summary (IdeTodoItem *self);
+
+G_END_DECLS
+
+#endif /* IDE_TODO_ITEM_H */
@@ -0,0 +1,961 @@
+/* ide-todo-miner.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-todo-miner"
+
+#include <egg-counter.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ide-context.h"
+#include "ide-debug.h"
+#include "ide-global.h"
+#include "ide-internal.h"
+
+#include "projects/ide-project.h"
+#include "threading/ide-thread-pool.h"
+#include "todo/ide-todo-item.h"
+#include "todo/ide-todo-miner.h"
+#include "vcs/ide-vcs.h"
+
+/*
+ * IdeTodoMiner finds the FIXME:, XXX: and TODO: items in the files of the
+ * project.
+ *
+ * Files are mapped into memory and scanned with memchr() for the colon
+ * following a keyword, which glibc implements with vector instructions.
+ * The items of each file are cached on disk along with the modification
+ * time of the file, so that reopening a project only scans the files
+ * changed since it was closed.
+ *
+ * Mining tasks run on the indexer thread pool and hold the mutex of the
+ * miner while they run, so the index itself is not shared between threads.
+ * Changed files are scanned one after another within that work item rather
+ * than from a thread pool of our own, so mining occupies a single indexer
+ * thread and is throttled along with the rest of the idle work.
+ *
+ * Mining the files of a project one at a time as they are saved would
+ * rewrite the whole cache for every file, so saving is delayed until the
+ * index has been left alone for SAVE_DELAY_SECONDS.
+ */
+
+#define CACHE_VERSION     1
+#define CACHE_FORMAT      "(ua{s(ta(us))})"
+
+/* The number of lines following the keyword included in the message */
+#define CONTEXT_LINES     5
+
+/* Longer lines are most likely not source code, such as in SVG files */
+#define MAX_LINE_LENGTH   1024
+
+/* Like grep -I, files containing \0 within this many bytes are binary */
+#define BINARY_CHECK_SIZE 8000
+
+#define SAVE_DELAY_SECONDS 5
+
+struct _IdeTodoMiner
+{
+  IdeObject   parent_instance;
+
+  GMutex      mutex;
+
+  /* Relative path to FileEntry */
+  GHashTable *entries;
+
+  gchar      *cache_path;
+  guint       save_source;
+
+  guint       loaded : 1;
+  guint       dirty : 1;
+};
+
+typedef struct
+{
+  GFile     *file;
+  guint64    mtime;
+  /* IdeTodoItem, or NULL if the file has no items */
+  GPtrArray *items;
+} FileEntry;
+
+typedef struct
+{
+  IdeVcs *vcs;
+  GFile  *workdir;
+  GFile  *file;
+  gchar  *cache_path;
+} MineState;
+
+typedef struct
+{
+  gsize        len;
+  const gchar *str;
+} Keyword;
+
+static const Keyword keywords [] = {
+  { 5, "FIXME" },
+  { 3, "XXX" },
+  { 4, "TODO" },
+};
+
+static const gchar *skip_suffixes [] = {
+  ".m4",
+  ".po",
+};
+
+G_DEFINE_TYPE (IdeTodoMiner, ide_todo_miner, IDE_TYPE_OBJECT)
+
+EGG_DEFINE_COUNTER (scanned, "TodoMiner", "Scanned", "Number of files scanned for todo items")
+EGG_DEFINE_COUNTER (cached, "TodoMiner", "Cached", "Number of files with todo items loaded from the cache")
+
+static void
+file_entry_free (gpointer data)
+{
+  FileEntry *entry = data;
+
+  g_clear_object (&entry->file);
+  g_clear_pointer (&entry->items, g_ptr_array_unref);
+  g_slice_free (FileEntry, entry);
+}
+
+static FileEntry *
+file_entry_new (GFile     *file,
+                guint64    mtime,
+                GPtrArray *items)
+{
+  FileEntry *entry;
+
+  entry = g_slice_new0 (FileEntry);
+  entry->file = g_object_ref (file);
+  entry->mtime = mtime;
+  entry->items = items;
+
+  return entry;
+}
+
+static void
+mine_state_free (gpointer data)
+{
+  MineState *state = data;
+
+  g_clear_object (&state->vcs);
+  g_clear_object (&state->workdir);
+  g_clear_object (&state->file);
+  g_clear_pointer (&state->cache_path, g_free);
+  g_slice_free (MineState, state);
+}
+
+static inline gboolean
+has_keyword (const gchar *data,
+             const gchar *colon)
+{
+  /* Cheap rejection of the colons in ordinary code */
+  if (colon == data)
+    return FALSE;
+
+  switch (colon [-1])
+    {
+    case 'E': case 'O': case 'X':
+      break;
+
+    default:
+      return FALSE;
+    }
+
+  for (guint i = 0; i < G_N_ELEMENTS (keywords); i++)
+    {
+      const Keyword *keyword = &keywords [i];
+
+      if ((gsize)(colon - data) >= keyword->len &&
+          memcmp (colon - keyword->len, keyword->str, keyword->len) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gchar *
+build_message (const gchar *begin,
+               const gchar *end)
+{
+  const gchar *iter = begin;
+  const gchar *msg_end = begin;
+
+  g_assert (begin != NULL);
+  g_assert (end >= begin);
+
+  /*
+   * Take the line containing the keyword and up to CONTEXT_LINES lines after
+   * it, stopping at a blank line as that usually ends the comment.
+   */
+  for (guint i = 0; i <= CONTEXT_LINES && iter < end; i++)
+    {
+      const gchar *eol = memchr (iter, '\n', end - iter);
+      const gchar *p;
+
+      if (eol == NULL)
+        eol = end;
+
+      if (eol - iter > MAX_LINE_LENGTH)
+        break;
+
+      for (p = iter; p < eol && g_ascii_isspace (*p); p++) { }
+
+      if (i > 0 && p == eol)
+        break;
+
+      msg_end = eol;
+      iter = eol + 1;
+    }
+
+  if (msg_end == begin || !g_utf8_validate (begin, msg_end - begin, NULL))
+    return NULL;
+
+  return g_strndup (begin, msg_end - begin);
+}
+
+/*
+ * Finds the todo items in @data, the contents of @file.
+ *
+ * Returns a GPtrArray of IdeTodoItem, or NULL if there are no items.
+ */
+GPtrArray *
+_ide_todo_miner_scan (GFile       *file,
+                      const gchar *data,
+                      gsize        len)
+{
+  g_autoptr(GArray) lines = NULL;
+  g_autoptr(GArray) begins = NULL;
+  GPtrArray *ret = NULL;
+  const gchar *end = data + len;
+  const gchar *counted = data;
+  const gchar *p;
+  guint line = 1;
+
+  g_assert (G_IS_FILE (file));
+
+  if (data == NULL || len == 0)
+    return NULL;
+
+  if (memchr (data, '\0', MIN (len, BINARY_CHECK_SIZE)) != NULL)
+    return NULL;
+
+  lines = g_array_new (FALSE, FALSE, sizeof (guint));
+  begins = g_array_new (FALSE, FALSE, sizeof (const gchar *));
+
+  for (p = memchr (data, ':', len);
+       p != NULL;
+       p = memchr (p + 1, ':', end - p - 1))
+    {
+      const gchar *line_begin;
+      const gchar *nl;
+
+      if G_LIKELY (!has_keyword (data, p))
+        continue;
+
+      for (line_begin = p; line_begin > data && line_begin [-1] != '\n'; line_begin--) { }
+
+      /* Only count the newlines up to each match, once */
+      while (counted < line_begin && NULL != (nl = memchr (counted, '\n', line_begin - counted)))
+        {
+          line++;
+          counted = nl + 1;
+        }
+
+      g_array_append_val (lines, line);
+      g_array_append_val (begins, line_begin);
+
+      /* Further keywords on this line belong to the same item */
+      if (NULL == (p = memchr (p, '\n', end - p)))
+        break;
+    }
+
+  for (guint i = 0; i < lines->len; i++)
+    {
+      const gchar *begin = g_array_index (begins, const gchar *, i);
+      const gchar *stop = end;
+      g_autofree gchar *message = NULL;
+
+      /* Do not include the next item in the message of this one */
+      if (i + 1 < lines->len)
+        stop = g_array_index (begins, const gchar *, i + 1);
+
+      if (NULL == (message = build_message (begin, stop)))
+        continue;
+
+      if (ret == NULL)
+        ret = g_ptr_array_new_with_free_func (g_object_unref);
+
+      g_ptr_array_add (ret, ide_todo_item_new (file, g_array_index (lines, guint, i), message));
+    }
+
+  return ret;
+}
+
+static gboolean
+ide_todo_miner_should_skip (const gchar *name)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (skip_suffixes); i++)
+    {
+      if (g_str_has_suffix (name, skip_suffixes [i]))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static guint64
+get_mtime (GFileInfo *file_info)
+{
+  return g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+       + g_file_info_get_attribute_uint32 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+static GPtrArray *
+ide_todo_miner_scan_file (GFile *file)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autofree gchar *path = NULL;
+
+  g_assert (G_IS_FILE (file));
+
+  EGG_COUNTER_INC (scanned);
+
+  if (NULL == (path = g_file_get_path (file)) ||
+      NULL == (mapped = g_mapped_file_new (path, FALSE, NULL)))
+    return NULL;
+
+  return _ide_todo_miner_scan (file,
+                               g_mapped_file_get_contents (mapped),
+                               g_mapped_file_get_length (mapped));
+}
+
+static void
+ide_todo_miner_load_cache (IdeTodoMiner *self,
+                           MineState    *state)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariantIter) files = NULL;
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) error = NULL;
+  GVariantIter *items;
+  const gchar *relpath;
+  guint64 mtime;
+  guint version;
+
+  g_assert (IDE_IS_TODO_MINER (self));
+  g_assert (state != NULL);
+
+  if (state->cache_path == NULL)
+    return;
+
+  if (NULL == (mapped = g_mapped_file_new (state->cache_path, FALSE, &error)))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Failed to load todo cache: %s", error->message);
+      return;
+    }
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (CACHE_FORMAT), bytes, FALSE));
+
+  /* The cache was written by us, but might be truncated or corrupted */
+  if (!g_variant_is_normal_form (variant))
+    return;
+
+  g_variant_get (variant, "(ua{s(ta(us))})", &version, &files);
+
+  if (version != CACHE_VERSION)
+    return;
+
+  while (g_variant_iter_next (files, "{&s(ta(us))}", &relpath, &mtime, &items))
+    {
+      g_autoptr(GFile) file = g_file_get_child (state->workdir, relpath);
+      GPtrArray *ar = NULL;
+      const gchar *message;
+      guint line;
+
+      while (g_variant_iter_next (items, "(u&s)", &line, &message))
+        {
+          if (ar == NULL)
+            ar = g_ptr_array_new_with_free_func (g_object_unref);
+          g_ptr_array_add (ar, ide_todo_item_new (file, line, message));
+        }
+
+      g_variant_iter_free (items);
+
+      g_hash_table_insert (self->entries, g_strdup (relpath), file_entry_new (file, mtime, ar));
+
+      EGG_COUNTER_INC (cached);
+    }
+}
+
+static void
+ide_todo_miner_save_cache (IdeTodoMiner *self)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *cache_dir = NULL;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const gchar *relpath;
+  FileEntry *entry;
+
+  g_assert (IDE_IS_TODO_MINER (self));
+
+  if (self->cache_path == NULL)
+    return;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(ta(us))}"));
+
+  g_hash_table_iter_init (&iter, self->entries);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *)&relpath, (gpointer *)&entry))
+    {
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("{s(ta(us))}"));
+      g_variant_builder_add (&builder, "s", relpath);
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("(ta(us))"));
+      g_variant_builder_add (&builder, "t", entry->mtime);
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(us)"));
+
+      for (guint i = 0; entry->items != NULL && i < entry->items->len; i++)
+        {
+          IdeTodoItem *item = g_ptr_array_index (entry->items, i);
+
+          g_variant_builder_add (&builder, "(us)",
+                                 ide_todo_item_get_line (item),
+                                 ide_todo_item_get_message (item));
+        }
+
+      g_variant_builder_close (&builder);
+      g_variant_builder_close (&builder);
+      g_variant_builder_close (&builder);
+    }
+
+  variant = g_variant_ref_sink (g_variant_new ("(ua{s(ta(us))})", CACHE_VERSION, &builder));
+
+  cache_dir = g_path_get_dirname (self->cache_path);
+
+  if (g_mkdir_with_parents (cache_dir, 0750) != 0)
+    {
+      g_warning ("Failed to create todo cache directory \"%s\": %s",
+                 cache_dir, g_strerror (errno));
+      return;
+    }
+
+  if (!g_file_set_contents (self->cache_path,
+                            g_variant_get_data (variant),
+                            g_variant_get_size (variant),
+                            &error))
+    g_warning ("Failed to save todo cache: %s", error->message);
+}
+
+static void
+ide_todo_miner_save_worker (gpointer data)
+{
+  g_autoptr(IdeTodoMiner) self = data;
+
+  g_assert (IDE_IS_TODO_MINER (self));
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->dirty)
+    {
+      ide_todo_miner_save_cache (self);
+      self->dirty = FALSE;
+    }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+static gboolean
+ide_todo_miner_save_timeout (gpointer data)
+{
+  IdeTodoMiner *self = data;
+
+  g_assert (IDE_IS_TODO_MINER (self));
+
+  /* Unless a worker replaced us while we waited for the lock */
+  g_mutex_lock (&self->mutex);
+  if (self->save_source == g_source_get_id (g_main_current_source ()))
+    self->save_source = 0;
+  g_mutex_unlock (&self->mutex);
+
+  ide_thread_pool_push_with_priority (IDE_THREAD_POOL_INDEXER,
+                                      IDE_THREAD_PRIORITY_IDLE,
+                                      ide_todo_miner_save_worker,
+                                      g_object_ref (self));
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Restarts the countdown to saving the cache. The source holds a reference
+ * to the miner so that pending changes are saved even if the project is
+ * closed in the meantime.
+ *
+ * Must be called with the mutex held.
+ */
+static void
+ide_todo_miner_queue_save (IdeTodoMiner *self)
+{
+  g_assert (IDE_IS_TODO_MINER (self));
+
+  if (self->save_source != 0)
+    g_source_remove (self->save_source);
+
+  self->save_source = g_timeout_add_seconds_full (G_PRIORITY_LOW,
+                                                  SAVE_DELAY_SECONDS,
+                                                  ide_todo_miner_save_timeout,
+                                                  g_object_ref (self),
+                                                  g_object_unref);
+}
+
+static void
+ide_todo_miner_walk (IdeVcs       *vcs,
+                     GFile        *workdir,
+                     GFile        *directory,
+                     GHashTable   *found,
+                     GCancellable *cancellable)
+{
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+  g_autoptr(GPtrArray) children = NULL;
+  g_autoptr(GPtrArray) files = NULL;
+  g_autoptr(GPtrArray) infos = NULL;
+  g_autofree guint8 *ignored = NULL;
+  gpointer file_info_ptr;
+
+  g_assert (IDE_IS_VCS (vcs));
+  g_assert (G_IS_FILE (directory));
+  g_assert (found != NULL);
+
+  /* Pruning ignored directories keeps us out of .git and build trees */
+  if (ide_vcs_is_ignored (vcs, directory, NULL))
+    return;
+
+  enumerator = g_file_enumerate_children (directory,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                          G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                          G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                                          G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          cancellable,
+                                          NULL);
+
+  if (enumerator == NULL)
+    return;
+
+  files = g_ptr_array_new_with_free_func (g_object_unref);
+  infos = g_ptr_array_new_with_free_func (g_object_unref);
+
+  while ((file_info_ptr = g_file_enumerator_next_file (enumerator, cancellable, NULL)))
+    {
+      g_autoptr(GFileInfo) file_info = file_info_ptr;
+      g_autoptr(GFile) file = NULL;
+      const gchar *name;
+
+      name = g_file_info_get_name (file_info);
+      file = g_file_get_child (directory, name);
+
+      switch (g_file_info_get_file_type (file_info))
+        {
+        case G_FILE_TYPE_DIRECTORY:
+          if (children == NULL)
+            children = g_ptr_array_new_with_free_func (g_object_unref);
+          g_ptr_array_add (children, g_steal_pointer (&file));
+          break;
+
+        case G_FILE_TYPE_REGULAR:
+          if (ide_todo_miner_should_skip (name))
+            break;
+
+          g_ptr_array_add (files, g_steal_pointer (&file));
+          g_ptr_array_add (infos, g_steal_pointer (&file_info));
+          break;
+
+        default:
+          break;
+        }
+    }
+
+  /* Filter the candidates of this directory with a single query */
+  ignored = g_malloc0 (IDE_VCS_IGNORED_BITMAP_SIZE (files->len));
+  ide_vcs_is_ignored_many (vcs, (GFile **)files->pdata, files->len, ignored, NULL);
+
+  for (guint i = 0; i < files->len; i++)
+    {
+      GFile *file = g_ptr_array_index (files, i);
+      GFileInfo *file_info = g_ptr_array_index (infos, i);
+      gchar *relpath;
+
+      if (IDE_VCS_IGNORED_BITMAP_GET (ignored, i))
+        continue;
+
+      if (NULL != (relpath = g_file_get_relative_path (workdir, file)))
+        g_hash_table_insert (found, relpath, file_entry_new (file, get_mtime (file_info), NULL));
+    }
+
+  for (guint i = 0; children != NULL && i < children->len; i++)
+    {
+      if (g_cancellable_is_cancelled (cancellable))
+        return;
+
+      ide_todo_miner_walk (vcs, workdir, g_ptr_array_index (children, i), found, cancellable);
+    }
+}
+
+static void
+ide_todo_miner_mine_directory (IdeTodoMiner *self,
+                               MineState    *state,
+                               GCancellable *cancellable)
+{
+  g_autoptr(GHashTable) found = NULL;
+  g_autoptr(GPtrArray) to_scan = NULL;
+  GHashTableIter iter;
+  const gchar *relpath;
+  FileEntry *entry;
+  FileEntry *existing;
+
+  g_assert (IDE_IS_TODO_MINER (self));
+  g_assert (state != NULL);
+
+  found = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, file_entry_free);
+  to_scan = g_ptr_array_new ();
+
+  ide_todo_miner_walk (state->vcs, state->workdir, state->file, found, cancellable);
+
+  if (g_cancellable_is_cancelled (cancellable))
+    return;
+
+  /* Forget about files below the directory which no longer exist */
+  g_hash_table_iter_init (&iter, self->entries);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *)&relpath, (gpointer *)&entry))
+    {
+      if (g_file_has_prefix (entry->file, state->file) && !g_hash_table_contains (found, relpath))
+        {
+          g_hash_table_iter_remove (&iter);
+          self->dirty = TRUE;
+        }
+    }
+
+  /* Only scan the files which changed since we last scanned them */
+  g_hash_table_iter_init (&iter, found);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *)&relpath, (gpointer *)&entry))
+    {
+      existing = g_hash_table_lookup (self->entries, relpath);
+
+      if (existing == NULL || existing->mtime != entry->mtime)
+        g_ptr_array_add (to_scan, entry);
+    }
+
+  IDE_TRACE_MSG ("Scanning %u of %u files for todo items",
+                 to_scan->len, g_hash_table_size (found));
+
+  for (guint i = 0; i < to_scan->len; i++)
+    {
+      if (g_cancellable_is_cancelled (cancellable))
+        return;
+
+      entry = g_ptr_array_index (to_scan, i);
+      entry->items = ide_todo_miner_scan_file (entry->file);
+    }
+
+  /* Move the new entries into the index, along with their keys */
+  g_hash_table_iter_init (&iter, found);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *)&relpath, (gpointer *)&entry))
+    {
+      existing = g_hash_table_lookup (self->entries, relpath);
+
+      if (existing == NULL || existing->mtime != entry->mtime)
+        {
+          g_hash_table_iter_steal (&iter);
+          g_hash_table_insert (self->entries, (gchar *)relpath, entry);
+          self->dirty = TRUE;
+        }
+    }
+}
+
+static void
+ide_todo_miner_mine_file (IdeTodoMiner *self,
+                          MineState    *state,
+                          GCancellable *cancellable)
+{
+  g_autoptr(GFileInfo) file_info = NULL;
+  g_autofree gchar *relpath = NULL;
+  g_autofree gchar *name = NULL;
+  GPtrArray *items;
+
+  g_assert (IDE_IS_TODO_MINER (self));
+  g_assert (state != NULL);
+
+  if (NULL == (relpath = g_file_get_relative_path (state->workdir, state->file)))
+    return;
+
+  name = g_file_get_basename (state->file);
+
+  file_info = g_file_query_info (state->file,
+                                 G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                                 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                 G_FILE_QUERY_INFO_NONE,
+                                 cancellable,
+                                 NULL);
+
+  if (file_info == NULL ||
+      ide_todo_miner_should_skip (name) ||
+      ide_vcs_is_ignored (state->vcs, state->file, NULL))
+    {
+      if (g_hash_table_remove (self->entries, relpath))
+        self->dirty = TRUE;
+      return;
+    }
+
+  items = ide_todo_miner_scan_file (state->file);
+
+  g_hash_table_insert (self->entries,
+                       g_steal_pointer (&relpath),
+                       file_entry_new (state->file, get_mtime (file_info), items));
+
+  self->dirty = TRUE;
+}
+
+static gint
+sort_by_path (gconstpointer a,
+              gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar **)a, *(const gchar **)b);
+}
+
+static void
+ide_todo_miner_mine_worker (GTask        *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+  IdeTodoMiner *self = source_object;
+  MineState *state = task_data;
+  g_autoptr(GPtrArray) paths = NULL;
+  GPtrArray *ret;
+  GHashTableIter iter;
+  const gchar *relpath;
+  FileEntry *entry;
+
+  IDE_ENTRY;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_TODO_MINER (self));
+  g_assert (state != NULL);
+
+  /* Files outside of the project are scanned without being cached */
+  if (!g_file_equal (state->file, state->workdir) && !g_file_has_prefix (state->file, state->workdir))
+    {
+      ret = NULL;
+
+      if (g_file_query_file_type (state->file, G_FILE_QUERY_INFO_NONE, cancellable) == G_FILE_TYPE_REGULAR)
+        ret = ide_todo_miner_scan_file (state->file);
+
+      if (ret == NULL)
+        ret = g_ptr_array_new_with_free_func (g_object_unref);
+
+      g_task_return_pointer (task, ret, (GDestroyNotify)g_ptr_array_unref);
+
+      IDE_EXIT;
+    }
+
+  g_mutex_lock (&self->mutex);
+
+  if (!self->loaded)
+    {
+      ide_todo_miner_load_cache (self, state);
+      self->cache_path = g_strdup (state->cache_path);
+      self->loaded = TRUE;
+    }
+
+  if (g_file_query_file_type (state->file, G_FILE_QUERY_INFO_NONE, cancellable) == G_FILE_TYPE_DIRECTORY)
+    ide_todo_miner_mine_directory (self, state, cancellable);
+  else
+    ide_todo_miner_mine_file (self, state, cancellable);
+
+  if (g_cancellable_is_cancelled (cancellable))
+    {
+      g_mutex_unlock (&self->mutex);
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_CANCELLED,
+                               "The operation was cancelled");
+      IDE_EXIT;
+    }
+
+  /* Return the items sorted by file so the results are stable */
+  paths = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, self->entries);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *)&relpath, (gpointer *)&entry))
+    {
+      if (entry->items != NULL &&
+          (g_file_equal (entry->file, state->file) || g_file_has_prefix (entry->file, state->file)))
+        g_ptr_array_add (paths, (gpointer)relpath);
+    }
+
+  g_ptr_array_sort (paths, sort_by_path);
+
+  ret = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < paths->len; i++)
+    {
+      entry = g_hash_table_lookup (self->entries, g_ptr_array_index (paths, i));
+
+      for (guint j = 0; j < entry->items->len; j++)
+        g_ptr_array_add (ret, g_object_ref (g_ptr_array_index (entry->items, j)));
+    }
+
+  if (self->dirty)
+    ide_todo_miner_queue_save (self);
+
+  g_mutex_unlock (&self->mutex);
+
+  g_task_return_pointer (task, ret, (GDestroyNotify)g_ptr_array_unref);
+
+  IDE_EXIT;
+}
+
+static gchar *
+ide_todo_miner_get_cache_path (IdeTodoMiner *self)
+{
+  g_autofree gchar *name = NULL;
+  IdeContext *context;
+  IdeProject *project;
+  const gchar *id;
+
+  g_assert (IDE_IS_TODO_MINER (self));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  project = ide_context_get_project (context);
+
+  if (NULL == (id = ide_project_get_id (project)))
+    return NULL;
+
+  name = g_strconcat (id, ".todo", NULL);
+
+  return g_build_filename (g_get_user_cache_dir (),
+                           ide_get_program_name (),
+                           "todo",
+                           name,
+                           NULL);
+}
+
+/**
+ * ide_todo_miner_mine_async:
+ * @self: An #IdeTodoMiner
+ * @file: a file or directory within the project
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @callback: A callback to execute upon completion
+ * @user_data: user data for @callback
+ *
+ * Asynchronously finds the todo items in @file, or in the files below @file
+ * if it is a directory. Files which have not changed since they were last
+ * mined are not scanned again.
+ *
+ * Files ignored by the version control system are skipped.
+ */
+void
+ide_todo_miner_mine_async (IdeTodoMiner        *self,
+                           GFile               *file,
+                           GCancellable        *cancellable,
+                           GAsyncReadyCallback  callback,
+                           gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  IdeContext *context;
+  MineState *state;
+  IdeVcs *vcs;
+
+  IDE_ENTRY;
+
+  g_return_if_fail (IDE_IS_TODO_MINER (self));
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  vcs = ide_context_get_vcs (context);
+
+  state = g_slice_new0 (MineState);
+  state->vcs = g_object_ref (vcs);
+  state->workdir = g_object_ref (ide_vcs_get_working_directory (vcs));
+  state->file = g_object_ref (file);
+  state->cache_path = ide_todo_miner_get_cache_path (self);
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ide_todo_miner_mine_async);
+  g_task_set_task_data (task, state, mine_state_free);
+
+  ide_thread_pool_push_task_with_priority (IDE_THREAD_POOL_INDEXER,
+                                           IDE_THREAD_PRIORITY_IDLE,
+                                           task,
+                                           ide_todo_miner_mine_worker);
+
+  IDE_EXIT;
+}
+
+/**
+ * ide_todo_miner_mine_finish:
+ *
+ * Completes an asynchronous request to ide_todo_miner_mine_async().
+ *
+ * Returns: (transfer container) (element-type Ide.TodoItem): A #GPtrArray
+ *   of #IdeTodoItem sorted by file and line.
+ */
+GPtrArray *
+ide_todo_miner_mine_finish (IdeTodoMiner  *self,
+                            GAsyncResult  *result,
+                            GError       **error)
+{
+  g_return_val_if_fail (IDE_IS_TODO_MINER (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (result), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+ide_todo_miner_finalize (GObject *object)
+{
+  IdeTodoMiner *self = (IdeTodoMiner *)object;
+
+  g_clear_pointer (&self->entries, g_hash_table_unref);
+  g_clear_pointer (&self->cache_path, g_free);
+  g_mutex_clear (&self->mutex);
+
+  G_OBJECT_CLASS (ide_todo_miner_parent_class)->finalize (object);
+}
+
+static void
+ide_todo_miner_class_init (IdeTodoMinerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_todo_miner_finalize;
+}
+
+static void
+ide_todo_miner_init (IdeTodoMiner *self)
+{
+  g_mutex_init (&self->mutex);
+  self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, file_entry_free);
+}
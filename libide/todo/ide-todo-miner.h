@@ -0,0 +1,41 @@
+/* ide-todo-miner.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_TODO_MINER_H
+#define IDE_TODO_MINER_H
+
+#include "ide-object.h"
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_TODO_MINER (ide_todo_miner_get_type())
+
+G_DECLARE_FINAL_TYPE (IdeTodoMiner, ide_todo_miner, IDE, TODO_MINER, IdeObject)
+
+void       ide_todo_miner_mine_async  (IdeTodoMiner         *self,
+                                       GFile                *file,
+                                       GCancellable         *cancellable,
+                                       GAsyncReadyCallback   callback,
+                                       gpointer              user_data);
+GPtrArray *ide_todo_miner_mine_finish (IdeTodoMiner         *self,
+                                       GAsyncResult         *result,
+                                       GError              **error);
+
+G_END_DECLS
+
+#endif /* IDE_TODO_MINER_H */
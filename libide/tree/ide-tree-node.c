@@ -167,6 +167,28 @@ ide_tree_node_append (IdeTreeNode *node,
   _ide_tree_append (node->tree, node, child);
 }
 
+/**
+ * ide_tree_node_append_all:
+ * @node: A #IdeTreeNode.
+ * @children: (element-type Ide.TreeNode): An array of #IdeTreeNode.
+ *
+ * Appends all of @children to the list of children owned by @node, in the
+ * order they are found in @children.
+ *
+ * This is much faster than calling ide_tree_node_insert_sorted() for each
+ * child when populating large nodes, since the siblings do not need to be
+ * walked for every insertion. Sort @children beforehand if necessary.
+ */
+void
+ide_tree_node_append_all (IdeTreeNode *node,
+                          GPtrArray   *children)
+{
+  g_return_if_fail (IDE_IS_TREE_NODE (node));
+  g_return_if_fail (children != NULL);
+
+  _ide_tree_append_all (node->tree, node, children);
+}
+
 /**
  * ide_tree_node_prepend:
  * @node: A #IdeTreeNode.
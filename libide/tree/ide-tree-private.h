@@ -32,6 +32,9 @@ void         _ide_tree_build_node              (IdeTree        *self,
 void         _ide_tree_append                  (IdeTree        *self,
                                                 IdeTreeNode    *node,
                                                 IdeTreeNode    *child);
+void         _ide_tree_append_all              (IdeTree        *self,
+                                                IdeTreeNode    *node,
+                                                GPtrArray      *children);
 void         _ide_tree_prepend                 (IdeTree        *self,
                                                 IdeTreeNode    *node,
                                                 IdeTreeNode    *child);
@@ -1411,6 +1411,79 @@ _ide_tree_append (IdeTree     *self,
   ide_tree_add (self, node, child, FALSE);
 }
 
+void
+_ide_tree_append_all (IdeTree     *self,
+                      IdeTreeNode *node,
+                      GPtrArray   *children)
+{
+  IdeTreePrivate *priv = ide_tree_get_instance_private (self);
+  GtkTreeIter *parentptr = NULL;
+  GtkTreeIter parent;
+  GtkTreeIter prev;
+  guint i;
+
+  g_return_if_fail (IDE_IS_TREE (self));
+  g_return_if_fail (IDE_IS_TREE_NODE (node));
+  g_return_if_fail (children != NULL);
+
+  if (node != priv->root)
+    {
+      if (!ide_tree_node_get_iter (node, &parent))
+        {
+          g_warning ("Cannot append to a node that is not in the tree");
+          return;
+        }
+      parentptr = &parent;
+    }
+
+  /*
+   * Resolve the parent once and then insert each child after the previous
+   * one. Inserting at -1 or looking up the parent path for every child
+   * would walk all of the siblings for each insertion.
+   */
+  for (i = 0; i < children->len; i++)
+    {
+      IdeTreeNode *child = g_ptr_array_index (children, i);
+      GtkTreeIter iter;
+
+      g_return_if_fail (IDE_IS_TREE_NODE (child));
+
+      _ide_tree_node_set_tree (child, self);
+      _ide_tree_node_set_parent (child, node);
+
+      g_object_ref_sink (child);
+
+      if (i == 0)
+        {
+          gtk_tree_store_insert_with_values (priv->store, &iter, parentptr, -1,
+                                             0, child,
+                                             -1);
+        }
+      else
+        {
+          gtk_tree_store_insert_after (priv->store, &iter, parentptr, &prev);
+          gtk_tree_store_set (priv->store, &iter, 0, child, -1);
+        }
+
+      if (ide_tree_node_get_children_possible (child))
+        {
+          g_autoptr(IdeTreeNode) dummy = g_object_ref_sink (ide_tree_node_new ());
+          GtkTreeIter dummy_iter;
+
+          gtk_tree_store_insert_with_values (priv->store, &dummy_iter, &iter, -1,
+                                             0, dummy,
+                                             -1);
+        }
+
+      if (node == priv->root)
+        _ide_tree_build_node (self, child);
+
+      prev = iter;
+
+      g_object_unref (child);
+    }
+}
+
 void
 _ide_tree_prepend (IdeTree     *self,
                    IdeTreeNode *node,
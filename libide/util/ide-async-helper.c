@@ -16,8 +16,40 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define G_LOG_DOMAIN "ide-async-helper"
+
 #include "ide-async-helper.h"
 
+typedef enum
+{
+  GRAPH_STEP_PENDING,
+  GRAPH_STEP_RUNNING,
+  GRAPH_STEP_DONE,
+} GraphStepState;
+
+typedef struct
+{
+  const IdeAsyncGraphStep *steps;
+  guint                    n_steps;
+  guint                    n_running;
+  guint                    n_done;
+  GraphStepState          *state;
+  gint64                  *begin_time;
+  gint64                  *end_time;
+  gint64                   start_time;
+  GError                  *error;
+  guint                    pumping : 1;
+  guint                    repump : 1;
+} GraphState;
+
+typedef struct
+{
+  GTask *task;
+  guint  index;
+} GraphStepClosure;
+
+static void ide_async_helper_graph_pump (GTask *task);
+
 static void
 ide_async_helper_cb (GObject      *object,
                      GAsyncResult *result,
@@ -83,3 +115,241 @@ ide_async_helper_run (gpointer             source_object,
          ide_async_helper_cb,
          g_object_ref (task));
 }
+
+static void
+graph_state_free (gpointer data)
+{
+  GraphState *state = data;
+
+  g_clear_error (&state->error);
+  g_free (state->state);
+  g_free (state->begin_time);
+  g_free (state->end_time);
+  g_slice_free (GraphState, state);
+}
+
+static gint
+graph_find_step (GraphState  *state,
+                 const gchar *name)
+{
+  guint i;
+
+  for (i = 0; i < state->n_steps; i++)
+    {
+      if (g_strcmp0 (state->steps [i].name, name) == 0)
+        return i;
+    }
+
+  return -1;
+}
+
+static gboolean
+graph_step_is_ready (GraphState *state,
+                     guint       index)
+{
+  const IdeAsyncGraphStep *step = &state->steps [index];
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (step->requires) && step->requires [i] != NULL; i++)
+    {
+      gint dep = graph_find_step (state, step->requires [i]);
+
+      if (dep < 0 || state->state [dep] != GRAPH_STEP_DONE)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+graph_log_timings (GraphState *state)
+{
+  guint i;
+
+  for (i = 0; i < state->n_steps; i++)
+    {
+      if (state->state [i] != GRAPH_STEP_DONE)
+        continue;
+
+      g_debug ("%-24s started at %8.3lf ms, took %8.3lf ms",
+               state->steps [i].name,
+               (state->begin_time [i] - state->start_time) / 1000.0,
+               (state->end_time [i] - state->begin_time [i]) / 1000.0);
+    }
+
+  g_debug ("%u steps completed in %.3lf ms",
+           state->n_done,
+           (g_get_monotonic_time () - state->start_time) / 1000.0);
+}
+
+static void
+ide_async_helper_graph_cb (GObject      *object,
+                           GAsyncResult *result,
+                           gpointer      user_data)
+{
+  GraphStepClosure *closure = user_data;
+  g_autoptr(GTask) task = closure->task;
+  GraphState *state;
+  GError *error = NULL;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (G_IS_TASK (result));
+
+  state = g_task_get_task_data (task);
+
+  g_assert (state->state [closure->index] == GRAPH_STEP_RUNNING);
+  g_assert (state->n_running > 0);
+
+  state->state [closure->index] = GRAPH_STEP_DONE;
+  state->end_time [closure->index] = g_get_monotonic_time ();
+  state->n_running--;
+  state->n_done++;
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      g_debug ("%s failed: %s", state->steps [closure->index].name, error->message);
+
+      /* Only the first failure is reported, later ones are noise */
+      if (state->error == NULL)
+        state->error = error;
+      else
+        g_clear_error (&error);
+    }
+
+  g_slice_free (GraphStepClosure, closure);
+
+  ide_async_helper_graph_pump (task);
+}
+
+static void
+ide_async_helper_graph_pump (GTask *task)
+{
+  GraphState *state = g_task_get_task_data (task);
+  GCancellable *cancellable = g_task_get_cancellable (task);
+
+  /*
+   * Steps may complete synchronously from within the launch loop below, so
+   * just note that another pass is required instead of recursing.
+   */
+  if (state->pumping)
+    {
+      state->repump = TRUE;
+      return;
+    }
+
+  state->pumping = TRUE;
+
+  do
+    {
+      guint i;
+
+      state->repump = FALSE;
+
+      if (state->error == NULL)
+        g_cancellable_set_error_if_cancelled (cancellable, &state->error);
+
+      if (state->error != NULL)
+        break;
+
+      for (i = 0; i < state->n_steps; i++)
+        {
+          GraphStepClosure *closure;
+
+          if (state->state [i] != GRAPH_STEP_PENDING || !graph_step_is_ready (state, i))
+            continue;
+
+          closure = g_slice_new0 (GraphStepClosure);
+          closure->task = g_object_ref (task);
+          closure->index = i;
+
+          state->state [i] = GRAPH_STEP_RUNNING;
+          state->begin_time [i] = g_get_monotonic_time ();
+          state->n_running++;
+
+          state->steps [i].step (g_task_get_source_object (task),
+                                 cancellable,
+                                 ide_async_helper_graph_cb,
+                                 closure);
+        }
+    }
+  while (state->repump);
+
+  state->pumping = FALSE;
+
+  /* Wait for in-flight steps before completing, even after a failure */
+  if (state->n_running > 0)
+    return;
+
+  graph_log_timings (state);
+
+  if (state->error != NULL)
+    g_task_return_error (task, g_steal_pointer (&state->error));
+  else if (state->n_done < state->n_steps)
+    g_task_return_new_error (task,
+                             G_IO_ERROR,
+                             G_IO_ERROR_FAILED,
+                             "Unsatisfiable dependency in async graph");
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+/*
+ * Like ide_async_helper_run(), but every step whose requirements have been
+ * satisfied is started immediately rather than waiting for the previous step
+ * in the list. Steps name their requirements in #IdeAsyncGraphStep.requires.
+ * @steps is not copied and must outlive the operation, typically it is a
+ * static table.
+ *
+ * Once a step fails no new steps are started, and the first error is
+ * reported once all running steps have completed.
+ *
+ * The time spent in each step is logged with g_debug() under the
+ * "ide-async-helper" log domain when the graph completes.
+ */
+void
+ide_async_helper_run_graph (gpointer                  source_object,
+                            const IdeAsyncGraphStep  *steps,
+                            guint                     n_steps,
+                            GCancellable             *cancellable,
+                            GAsyncReadyCallback       callback,
+                            gpointer                  user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  GraphState *state;
+  guint i;
+
+  g_return_if_fail (steps != NULL || n_steps == 0);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  for (i = 0; i < n_steps; i++)
+    {
+      g_return_if_fail (steps [i].name != NULL);
+      g_return_if_fail (steps [i].step != NULL);
+    }
+
+  state = g_slice_new0 (GraphState);
+  state->steps = steps;
+  state->n_steps = n_steps;
+  state->state = g_new0 (GraphStepState, n_steps);
+  state->begin_time = g_new0 (gint64, n_steps);
+  state->end_time = g_new0 (gint64, n_steps);
+  state->start_time = g_get_monotonic_time ();
+
+  for (i = 0; i < n_steps; i++)
+    {
+      guint j;
+
+      for (j = 0; j < G_N_ELEMENTS (steps [i].requires) && steps [i].requires [j]; j++)
+        {
+          if (graph_find_step (state, steps [i].requires [j]) < 0)
+            g_critical ("Step \"%s\" requires unknown step \"%s\"",
+                        steps [i].name, steps [i].requires [j]);
+        }
+    }
+
+  task = g_task_new (source_object, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ide_async_helper_run_graph);
+  g_task_set_task_data (task, state, graph_state_free);
+
+  ide_async_helper_graph_pump (task);
+}
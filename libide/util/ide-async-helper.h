@@ -35,6 +35,22 @@ void ide_async_helper_run (gpointer             source_object,
                            IdeAsyncStep         step1,
                            ...);
 
+#define IDE_ASYNC_GRAPH_MAX_REQUIRES 8
+
+typedef struct
+{
+  const gchar  *name;
+  IdeAsyncStep  step;
+  const gchar  *requires[IDE_ASYNC_GRAPH_MAX_REQUIRES];
+} IdeAsyncGraphStep;
+
+void ide_async_helper_run_graph (gpointer                  source_object,
+                                 const IdeAsyncGraphStep  *steps,
+                                 guint                     n_steps,
+                                 GCancellable             *cancellable,
+                                 GAsyncReadyCallback       callback,
+                                 gpointer                  user_data);
+
 G_END_DECLS
 
 #endif /* IDE_ASYNC_HELPER_H */
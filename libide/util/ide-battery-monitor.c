@@ -26,6 +26,11 @@ static GDBusProxy *power_proxy;
 static GDBusProxy *power_device_proxy;
 static gint        power_hold;
 
+/* Main thread only, see _ide_battery_monitor_watch() */
+static GDBusProxy *watch_proxy;
+static GDBusProxy *watch_device_proxy;
+static void      (*watch_func) (gboolean should_conserve);
+
 G_LOCK_DEFINE_STATIC (proxy_lock);
 
 static GDBusProxy *
@@ -96,62 +101,65 @@ ide_battery_monitor_get_device_proxy (void)
   return proxy;
 }
 
-gboolean
-ide_battery_monitor_get_on_battery (void)
+static gboolean
+get_on_battery (GDBusProxy *proxy)
 {
-  GDBusProxy *proxy;
-  gboolean ret = FALSE;
+  g_autoptr(GVariant) prop = NULL;
 
-  proxy = ide_battery_monitor_get_proxy ();
+  if (proxy != NULL && NULL != (prop = g_dbus_proxy_get_cached_property (proxy, "OnBattery")))
+    return g_variant_get_boolean (prop);
 
-  if (proxy)
-    {
-      GVariant *prop;
+  return FALSE;
+}
 
-      prop = g_dbus_proxy_get_cached_property (proxy, "OnBattery");
-      if (prop)
-        ret = g_variant_get_boolean (prop);
-      g_object_unref (proxy);
-    }
+static gdouble
+get_energy_percentage (GDBusProxy *device_proxy)
+{
+  g_autoptr(GVariant) prop = NULL;
 
-  return ret;
+  if (device_proxy != NULL && NULL != (prop = g_dbus_proxy_get_cached_property (device_proxy, "Percentage")))
+    return g_variant_get_double (prop);
+
+  return 0.0;
 }
 
-gdouble
-ide_battery_monitor_get_energy_percentage (void)
+static gboolean
+get_should_conserve (GDBusProxy *proxy,
+                     GDBusProxy *device_proxy)
 {
-  GDBusProxy *proxy;
-  gdouble ret = 0.0;
+  gdouble energy;
 
-  proxy = ide_battery_monitor_get_device_proxy ();
+  if (!get_on_battery (proxy))
+    return FALSE;
 
-  if (proxy)
-    {
-      GVariant *prop;
+  energy = get_energy_percentage (device_proxy);
 
-      prop = g_dbus_proxy_get_cached_property (proxy, "Percentage");
-      if (prop)
-        ret = g_variant_get_double (prop);
-      g_object_unref (proxy);
-    }
-
-  return ret;
+  return (energy != 0.0) && (energy < CONSERVE_THRESHOLD);
 }
 
 gboolean
-ide_battery_monitor_get_should_conserve (void)
+ide_battery_monitor_get_on_battery (void)
 {
-  gboolean should_conserve = FALSE;
+  g_autoptr(GDBusProxy) proxy = ide_battery_monitor_get_proxy ();
 
-  if (ide_battery_monitor_get_on_battery ())
-    {
-      gdouble energy;
+  return get_on_battery (proxy);
+}
 
-      energy = ide_battery_monitor_get_energy_percentage ();
-      should_conserve = (energy != 0.0) && (energy < CONSERVE_THRESHOLD);
-    }
+gdouble
+ide_battery_monitor_get_energy_percentage (void)
+{
+  g_autoptr(GDBusProxy) device_proxy = ide_battery_monitor_get_device_proxy ();
+
+  return get_energy_percentage (device_proxy);
+}
+
+gboolean
+ide_battery_monitor_get_should_conserve (void)
+{
+  g_autoptr(GDBusProxy) proxy = ide_battery_monitor_get_proxy ();
+  g_autoptr(GDBusProxy) device_proxy = ide_battery_monitor_get_device_proxy ();
 
-  return should_conserve;
+  return get_should_conserve (proxy, device_proxy);
 }
 
 void
@@ -181,3 +189,87 @@ _ide_battery_monitor_init (void)
   proxy = ide_battery_monitor_get_proxy ();
   device_proxy = ide_battery_monitor_get_device_proxy ();
 }
+
+static void
+ide_battery_monitor_watch_notify (void)
+{
+  g_assert (watch_func != NULL);
+
+  watch_func (get_should_conserve (watch_proxy, watch_device_proxy));
+}
+
+static void
+ide_battery_monitor_watch_properties_changed (GDBusProxy *proxy,
+                                              GVariant   *changed_properties,
+                                              GStrv       invalidated_properties,
+                                              gpointer    user_data)
+{
+  ide_battery_monitor_watch_notify ();
+}
+
+static void
+ide_battery_monitor_watch_proxy_cb (GObject      *object,
+                                    GAsyncResult *result,
+                                    gpointer      user_data)
+{
+  GDBusProxy **location = user_data;
+  g_autoptr(GError) error = NULL;
+  GDBusProxy *proxy;
+
+  g_assert (location != NULL);
+  g_assert (*location == NULL);
+
+  /* Without a system bus the power state is never known, don't retry */
+  if (NULL == (proxy = g_dbus_proxy_new_for_bus_finish (result, &error)))
+    {
+      g_debug ("Failed to monitor the power state: %s", error->message);
+      return;
+    }
+
+  *location = proxy;
+
+  g_signal_connect (proxy,
+                    "g-properties-changed",
+                    G_CALLBACK (ide_battery_monitor_watch_properties_changed),
+                    NULL);
+
+  ide_battery_monitor_watch_notify ();
+}
+
+/*
+ * Calls @func on the main thread whenever the result of
+ * ide_battery_monitor_get_should_conserve() may have changed.
+ *
+ * The UPower proxies are created asynchronously, once, and @func is called
+ * from their property change notifications rather than by polling. Should
+ * UPower appear later, the proxies pick up its properties once it owns
+ * the name.
+ */
+void
+_ide_battery_monitor_watch (void (*func) (gboolean should_conserve))
+{
+  g_return_if_fail (func != NULL);
+  g_return_if_fail (watch_func == NULL);
+
+  watch_func = func;
+
+  g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                            G_DBUS_PROXY_FLAGS_GET_INVALIDATED_PROPERTIES,
+                            NULL,
+                            "org.freedesktop.UPower",
+                            "/org/freedesktop/UPower",
+                            "org.freedesktop.UPower",
+                            NULL,
+                            ide_battery_monitor_watch_proxy_cb,
+                            &watch_proxy);
+
+  g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                            G_DBUS_PROXY_FLAGS_GET_INVALIDATED_PROPERTIES,
+                            NULL,
+                            "org.freedesktop.UPower",
+                            "/org/freedesktop/UPower/devices/DisplayDevice",
+                            "org.freedesktop.UPower.Device",
+                            NULL,
+                            ide_battery_monitor_watch_proxy_cb,
+                            &watch_device_proxy);
+}
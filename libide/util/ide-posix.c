@@ -16,7 +16,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "config.h"
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/user.h>
 #include <sys/utsname.h>
@@ -109,3 +120,108 @@ ide_path_collapse (const gchar *path)
 
   return g_steal_pointer (&expanded);
 }
+
+/**
+ * ide_create_sealed_fd:
+ * @name: a name for the file, used for debugging
+ * @bytes: the contents of the file
+ * @error: a location for a #GError, or %NULL
+ *
+ * Creates an anonymous, read-only file containing @bytes. The file
+ * descriptor can be passed to other processes, which may mmap() it.
+ *
+ * With memfd_create(), the contents are kept in memory and the file is
+ * sealed so that it can no longer be modified. Otherwise, a temporary file
+ * is used. It is made read-only, reopened with O_RDONLY and unlinked, so
+ * that the file descriptor cannot be used to modify it.
+ *
+ * Returns: a file descriptor, or -1 and @error is set.
+ */
+gint
+ide_create_sealed_fd (const gchar  *name,
+                      GBytes       *bytes,
+                      GError      **error)
+{
+  g_autofree gchar *path = NULL;
+  const guint8 *data;
+  gsize len;
+  gint fd;
+
+  g_return_val_if_fail (name != NULL, -1);
+  g_return_val_if_fail (bytes != NULL, -1);
+
+#ifdef HAVE_MEMFD_CREATE
+  fd = memfd_create (name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+  {
+    g_autofree gchar *tmpl = g_strdup_printf ("%s-XXXXXX", name);
+
+    if (-1 == (fd = g_file_open_tmp (tmpl, &path, error)))
+      return -1;
+  }
+#endif
+
+  if (fd == -1)
+    goto failure;
+
+  data = g_bytes_get_data (bytes, &len);
+
+  while (len > 0)
+    {
+      gssize n_written = write (fd, data, len);
+
+      if (n_written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          goto failure;
+        }
+
+      data += n_written;
+      len -= n_written;
+    }
+
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+  if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+    goto failure;
+#endif
+
+  /*
+   * Without seals, hand out a descriptor which cannot write. The file mode
+   * is read-only too, so that it cannot be reopened for writing through
+   * /proc/self/fd either.
+   */
+  if (path != NULL)
+    {
+      gint rdonly_fd;
+
+      if (fchmod (fd, S_IRUSR) != 0 ||
+          -1 == (rdonly_fd = open (path, O_RDONLY | O_CLOEXEC)))
+        goto failure;
+
+      close (fd);
+      fd = rdonly_fd;
+
+      g_unlink (path);
+    }
+
+  return fd;
+
+failure:
+  {
+    gint errsv = errno;
+
+    if (fd != -1)
+      close (fd);
+
+    if (path != NULL)
+      g_unlink (path);
+
+    g_set_error (error,
+                 G_IO_ERROR,
+                 g_io_error_from_errno (errsv),
+                 "%s", g_strerror (errsv));
+
+    return -1;
+  }
+}
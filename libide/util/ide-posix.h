@@ -19,14 +19,17 @@
 #ifndef IDE_POSIX_H
 #define IDE_POSIX_H
 
-#include <glib.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
 gchar *ide_get_system_arch      (void);
 gsize  ide_get_system_page_size (void) G_GNUC_CONST;
-gchar *ide_path_collapse        (const gchar *path);
-gchar *ide_path_expand          (const gchar *path);
+gchar *ide_path_collapse        (const gchar  *path);
+gchar *ide_path_expand          (const gchar  *path);
+gint   ide_create_sealed_fd     (const gchar  *name,
+                                 GBytes       *bytes,
+                                 GError      **error);
 
 G_END_DECLS
 
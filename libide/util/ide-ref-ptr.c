@@ -20,6 +20,7 @@
 
 #include "egg-counter.h"
 
+#include "ide-internal.h"
 #include "ide-ref-ptr.h"
 
 G_DEFINE_BOXED_TYPE (IdeRefPtr, ide_ref_ptr, ide_ref_ptr_ref, ide_ref_ptr_unref)
@@ -85,3 +86,15 @@ ide_ref_ptr_get (IdeRefPtr *self)
 
   return self->data;
 }
+
+/*
+ * Checks if the caller holds the only reference to @self. Since nobody else
+ * can take a new reference then, the answer cannot change behind its back.
+ */
+gboolean
+_ide_ref_ptr_is_unique (IdeRefPtr *self)
+{
+  g_return_val_if_fail (self, FALSE);
+
+  return g_atomic_int_get (&self->ref_count) == 1;
+}
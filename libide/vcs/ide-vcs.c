@@ -18,6 +18,8 @@
 
 #define G_LOG_DOMAIN "ide-vcs"
 
+#include <string.h>
+
 #include "ide-context.h"
 
 #include "buffers/ide-buffer.h"
@@ -85,6 +87,76 @@ ide_vcs_is_ignored (IdeVcs  *self,
   return FALSE;
 }
 
+/**
+ * ide_vcs_is_ignored_many:
+ * @self: An #IdeVcs.
+ * @files: (array length=n_files): An array of #GFile.
+ * @n_files: The number of elements in @files.
+ * @ignored: A bitmap of at least IDE_VCS_IGNORED_BITMAP_SIZE(@n_files) bytes.
+ * @error: A location for a #GError, or %NULL.
+ *
+ * Checks if each of @files is ignored by the VCS, setting the bit for the
+ * file's index in @ignored when it is. Use IDE_VCS_IGNORED_BITMAP_GET() to
+ * read the result.
+ *
+ * This is much faster than calling ide_vcs_is_ignored() for each file when
+ * filtering many files, such as the contents of a directory, since the
+ * implementation may answer all of them in a single pass.
+ *
+ * A failure to check one of @files does not stop the query. That file is
+ * reported as not ignored, like ide_vcs_is_ignored() does, and the other
+ * files are still checked. So @ignored is always complete, and callers may
+ * pass %NULL for @error if they do not care about failures.
+ *
+ * This function is safe to call from a thread.
+ *
+ * Returns: %TRUE if every file could be checked; otherwise %FALSE and
+ *   @error is set to the first failure.
+ */
+gboolean
+ide_vcs_is_ignored_many (IdeVcs  *self,
+                         GFile  **files,
+                         guint    n_files,
+                         guint8  *ignored,
+                         GError **error)
+{
+  gboolean ret = TRUE;
+  guint i;
+
+  g_return_val_if_fail (IDE_IS_VCS (self), FALSE);
+  g_return_val_if_fail (files != NULL || n_files == 0, FALSE);
+  g_return_val_if_fail (ignored != NULL || n_files == 0, FALSE);
+
+  if (n_files == 0)
+    return TRUE;
+
+  memset (ignored, 0, IDE_VCS_IGNORED_BITMAP_SIZE (n_files));
+
+  if (IDE_VCS_GET_IFACE (self)->is_ignored_many)
+    return IDE_VCS_GET_IFACE (self)->is_ignored_many (self, files, n_files, ignored, error);
+
+  if (IDE_VCS_GET_IFACE (self)->is_ignored == NULL)
+    return TRUE;
+
+  for (i = 0; i < n_files; i++)
+    {
+      GError *local_error = NULL;
+
+      if (ide_vcs_is_ignored (self, files [i], &local_error))
+        ignored [i / 8] |= 1 << (i % 8);
+      else if (local_error != NULL)
+        {
+          if (ret)
+            g_propagate_error (error, local_error);
+          else
+            g_error_free (local_error);
+          ret = FALSE;
+        }
+    }
+
+  return ret;
+}
+
 gint
 ide_vcs_get_priority (IdeVcs *self)
 {
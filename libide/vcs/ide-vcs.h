@@ -28,6 +28,24 @@ G_BEGIN_DECLS
 
 #define IDE_TYPE_VCS (ide_vcs_get_type())
 
+/**
+ * IDE_VCS_IGNORED_BITMAP_SIZE:
+ * @n_files: the number of files to be queried
+ *
+ * The number of bytes required for the bitmap passed to
+ * ide_vcs_is_ignored_many().
+ */
+#define IDE_VCS_IGNORED_BITMAP_SIZE(n_files) (((n_files) + 7) / 8)
+
+/**
+ * IDE_VCS_IGNORED_BITMAP_GET:
+ * @bitmap: a bitmap filled by ide_vcs_is_ignored_many()
+ * @i: the index of the file
+ *
+ * Checks if the file at index @i was found to be ignored.
+ */
+#define IDE_VCS_IGNORED_BITMAP_GET(bitmap, i) ((((bitmap)[(i) / 8]) >> ((i) % 8)) & 1)
+
 G_DECLARE_INTERFACE (IdeVcs, ide_vcs, IDE, VCS, IdeObject)
 
 struct _IdeVcsInterface
@@ -44,6 +62,11 @@ struct _IdeVcsInterface
   void                    (*changed)                   (IdeVcs     *self);
   IdeVcsConfig           *(*get_config)                (IdeVcs     *self);
   gchar                  *(*get_branch_name)           (IdeVcs     *self);
+  gboolean                (*is_ignored_many)           (IdeVcs     *self,
+                                                        GFile     **files,
+                                                        guint       n_files,
+                                                        guint8     *ignored,
+                                                        GError    **error);
 };
 
 IdeBufferChangeMonitor *ide_vcs_get_buffer_change_monitor (IdeVcs               *self,
@@ -59,6 +82,11 @@ IdeVcs                 *ide_vcs_new_finish                (GAsyncResult
 gboolean                ide_vcs_is_ignored                (IdeVcs               *self,
                                                            GFile                *file,
                                                            GError              **error);
+gboolean                ide_vcs_is_ignored_many           (IdeVcs               *self,
+                                                           GFile               **files,
+                                                           guint                 n_files,
+                                                           guint8               *ignored,
+                                                           GError              **error);
 gint                    ide_vcs_get_priority              (IdeVcs               *self);
 void                    ide_vcs_emit_changed              (IdeVcs               *self);
 IdeVcsConfig           *ide_vcs_get_config                (IdeVcs               *self);
@@ -31,6 +31,13 @@
 #include "workers/ide-worker-process.h"
 #include "workers/ide-worker-manager.h"
 
+/*
+ * Workers requested with a key are spread across a pool of processes so
+ * that independent requests (such as parsing different files) may run in
+ * parallel. Each worker can consume a lot of memory, so we cap the pool.
+ */
+#define MAX_WORKERS_PER_PLUGIN 4
+
 struct _IdeWorkerManager
 {
   GObject      parent_instance;
@@ -187,11 +194,24 @@ ide_worker_manager_init (IdeWorkerManager *self)
                            ide_worker_manager_force_exit_worker);
 }
 
+static guint
+ide_worker_manager_get_n_workers (void)
+{
+  static guint n_workers;
+
+  if (g_once_init_enter (&n_workers))
+    g_once_init_leave (&n_workers, CLAMP (g_get_num_processors (), 1, MAX_WORKERS_PER_PLUGIN));
+
+  return n_workers;
+}
+
 static IdeWorkerProcess *
 ide_worker_manager_get_worker_process (IdeWorkerManager *self,
-                                       const gchar      *plugin_name)
+                                       const gchar      *plugin_name,
+                                       guint             shard)
 {
   IdeWorkerProcess *worker_process;
+  g_autofree gchar *process_key = NULL;
 
   g_assert (IDE_IS_WORKER_MANAGER (self));
   g_assert (plugin_name != NULL);
@@ -199,7 +219,13 @@ ide_worker_manager_get_worker_process (IdeWorkerManager *self,
   if (!self->plugin_name_to_worker || !self->dbus_server)
     return NULL;
 
-  worker_process = g_hash_table_lookup (self->plugin_name_to_worker, plugin_name);
+  /* The first process of a pool is the one used for unkeyed requests */
+  if (shard == 0)
+    process_key = g_strdup (plugin_name);
+  else
+    process_key = g_strdup_printf ("%s:%u", plugin_name, shard);
+
+  worker_process = g_hash_table_lookup (self->plugin_name_to_worker, process_key);
 
   if (worker_process == NULL)
     {
@@ -218,7 +244,7 @@ ide_worker_manager_get_worker_process (IdeWorkerManager *self,
         path = "gnome-builder-worker";
 
       worker_process = ide_worker_process_new (path, plugin_name, address);
-      g_hash_table_insert (self->plugin_name_to_worker, g_strdup (plugin_name), worker_process);
+      g_hash_table_insert (self->plugin_name_to_worker, g_steal_pointer (&process_key), worker_process);
       ide_worker_process_run (worker_process);
     }
 
@@ -256,16 +282,63 @@ ide_worker_manager_get_worker_async (IdeWorkerManager    *self,
                                      GCancellable        *cancellable,
                                      GAsyncReadyCallback  callback,
                                      gpointer             user_data)
+{
+  g_return_if_fail (IDE_IS_WORKER_MANAGER (self));
+  g_return_if_fail (plugin_name != NULL);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  ide_worker_manager_get_worker_for_key_async (self, plugin_name, NULL, cancellable, callback, user_data);
+}
+
+/**
+ * ide_worker_manager_get_worker_for_key_async:
+ * @self: An #IdeWorkerManager
+ * @plugin_name: the name of the plugin providing the #IdeWorker
+ * @key: (nullable): a key used to select the worker process
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @callback: A #GAsyncReadyCallback
+ * @user_data: user data for @callback
+ *
+ * Like ide_worker_manager_get_worker_async(), but the worker is selected
+ * from a pool of processes based on @key. Requests with the same @key are
+ * always routed to the same process, so workers may keep state (such as a
+ * parsed file) around between requests.
+ *
+ * The pool is sized to the number of processors, up to a small maximum.
+ *
+ * Complete the request with ide_worker_manager_get_worker_finish().
+ */
+void
+ide_worker_manager_get_worker_for_key_async (IdeWorkerManager    *self,
+                                             const gchar         *plugin_name,
+                                             const gchar         *key,
+                                             GCancellable        *cancellable,
+                                             GAsyncReadyCallback  callback,
+                                             gpointer             user_data)
 {
   IdeWorkerProcess *worker_process;
   GTask *task;
+  guint shard = 0;
 
   g_return_if_fail (IDE_IS_WORKER_MANAGER (self));
   g_return_if_fail (plugin_name != NULL);
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
+  if (key != NULL)
+    shard = g_str_hash (key) % ide_worker_manager_get_n_workers ();
+
   task = g_task_new (self, cancellable, callback, user_data);
-  worker_process = ide_worker_manager_get_worker_process (self, plugin_name);
+  worker_process = ide_worker_manager_get_worker_process (self, plugin_name, shard);
+
+  if (worker_process == NULL)
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_CLOSED,
+                               "The worker manager has been shutdown.");
+      g_object_unref (task);
+      return;
+    }
   ide_worker_process_get_proxy_async (worker_process,
                                       cancellable,
                                       ide_worker_manager_get_worker_cb,
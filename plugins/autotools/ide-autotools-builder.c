@@ -39,6 +39,7 @@ struct _IdeAutotoolsBuilder
 G_DEFINE_TYPE (IdeAutotoolsBuilder, ide_autotools_builder, IDE_TYPE_BUILDER)
 
 static EggTaskCache *makecaches;
+static GHashTable   *compile_commands;
 
 static void
 get_makecache_cb (GObject      *object,
@@ -169,6 +170,79 @@ ide_autotools_builder_get_build_flags_makecache_cb (GObject      *object,
   IDE_EXIT;
 }
 
+static void
+ide_autotools_builder_get_build_flags_commands_cb (GObject      *object,
+                                                   GAsyncResult *result,
+                                                   gpointer      user_data)
+{
+  IdeCompileCommands *commands = (IdeCompileCommands *)object;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GTask) task = user_data;
+  IdeConfiguration *configuration;
+  IdeBuilder *builder;
+  gchar **flags;
+  GFile *file;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (commands));
+  g_assert (G_IS_TASK (task));
+
+  file = g_task_get_task_data (task);
+  g_assert (G_IS_FILE (file));
+
+  if (ide_compile_commands_load_finish (commands, result, &error) &&
+      (flags = ide_compile_commands_lookup (commands, file, NULL, &error)))
+    {
+      EGG_COUNTER_DEC (build_flags);
+      g_task_return_pointer (task, flags, (GDestroyNotify)g_strfreev);
+      IDE_EXIT;
+    }
+
+  /*
+   * Headers, and files that were added after the database was generated,
+   * are not in the database. Fall back to the makecache for those.
+   */
+  IDE_TRACE_MSG ("Falling back to makecache: %s", error->message);
+
+  builder = g_task_get_source_object (task);
+  configuration = ide_builder_get_configuration (builder);
+
+  get_makecache_async (configuration,
+                       g_task_get_cancellable (task),
+                       ide_autotools_builder_get_build_flags_makecache_cb,
+                       g_steal_pointer (&task));
+
+  IDE_EXIT;
+}
+
+static IdeCompileCommands *
+get_compile_commands (GFile *file)
+{
+  g_autofree gchar *path = NULL;
+  IdeCompileCommands *commands;
+
+  g_assert (G_IS_FILE (file));
+
+  /*
+   * Builders are short lived, so keep the parsed databases around for the
+   * lifetime of the process. Loading them again is cheap unless the file
+   * has changed.
+   */
+  if (compile_commands == NULL)
+    compile_commands = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+
+  path = g_file_get_path (file);
+
+  if (!(commands = g_hash_table_lookup (compile_commands, path)))
+    {
+      commands = ide_compile_commands_new (file);
+      g_hash_table_insert (compile_commands, g_steal_pointer (&path), commands);
+    }
+
+  return commands;
+}
+
 static void
 ide_autotools_builder_get_build_flags_async (IdeBuilder          *builder,
                                              IdeFile             *file,
@@ -178,6 +252,9 @@ ide_autotools_builder_get_build_flags_async (IdeBuilder          *builder,
 {
   IdeAutotoolsBuilder *self = (IdeAutotoolsBuilder *)builder;
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GFile) build_dir = NULL;
+  g_autoptr(GFile) commands_file = NULL;
+  g_autofree gchar *commands_path = NULL;
   IdeConfiguration *configuration;
   GFile *gfile;
 
@@ -194,6 +271,23 @@ ide_autotools_builder_get_build_flags_async (IdeBuilder          *builder,
   g_task_set_source_tag (task, ide_autotools_builder_get_build_flags_async);
   g_task_set_task_data (task, g_object_ref (gfile), g_object_unref);
 
+  /*
+   * Prefer a compilation database, such as one generated with bear, when
+   * the build directory has one. It is much cheaper than running make.
+   */
+  build_dir = ide_autotools_builder_get_build_directory (self);
+  commands_file = g_file_get_child (build_dir, "compile_commands.json");
+  commands_path = g_file_get_path (commands_file);
+
+  if (commands_path != NULL && g_file_test (commands_path, G_FILE_TEST_IS_REGULAR))
+    {
+      ide_compile_commands_load_async (get_compile_commands (commands_file),
+                                       cancellable,
+                                       ide_autotools_builder_get_build_flags_commands_cb,
+                                       g_steal_pointer (&task));
+      IDE_EXIT;
+    }
+
   configuration = ide_builder_get_configuration (builder);
   g_assert (IDE_IS_CONFIGURATION (configuration));
 
@@ -0,0 +1,172 @@
+/* ide-makecache-inputs.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-makecache-inputs"
+
+#include <glib/gstdio.h>
+
+#include "ide-makecache-inputs.h"
+
+/*
+ * The inputs of a makecache are the files that cause make to regenerate
+ * the Makefiles when they change. For every input we record the absolute
+ * path along with its mtime and size. Inputs that did not exist when the
+ * makecache was generated are recorded with an mtime of -1 so that
+ * creating them (such as a new Makefile.am) is noticed as well.
+ */
+
+void
+ide_makecache_inputs_init (GVariantBuilder *builder)
+{
+  g_return_if_fail (builder != NULL);
+
+  g_variant_builder_init (builder, G_VARIANT_TYPE (IDE_MAKECACHE_INPUTS_TYPE));
+}
+
+void
+ide_makecache_inputs_add (GVariantBuilder *builder,
+                          const gchar     *path)
+{
+  GStatBuf st;
+  gint64 mtime = -1;
+  guint64 size = 0;
+
+  g_return_if_fail (builder != NULL);
+  g_return_if_fail (path != NULL);
+  g_return_if_fail (g_path_is_absolute (path));
+
+  if (g_stat (path, &st) == 0)
+    {
+      mtime = (gint64)st.st_mtime;
+      size = (guint64)st.st_size;
+    }
+
+  g_variant_builder_add (builder, "{s(xt)}", path, mtime, size);
+}
+
+/*
+ * Adds the files that regenerate every Makefile in the project, such as
+ * configure.ac and config.status.
+ */
+void
+ide_makecache_inputs_add_toplevel (GVariantBuilder *builder,
+                                   const gchar     *srcdir,
+                                   const gchar     *builddir)
+{
+  static const gchar *srcdir_inputs[] = { "configure.ac", "configure.in", "configure", "aclocal.m4" };
+  guint i;
+
+  g_return_if_fail (builder != NULL);
+  g_return_if_fail (srcdir != NULL);
+  g_return_if_fail (builddir != NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (srcdir_inputs); i++)
+    {
+      g_autofree gchar *path = g_build_filename (srcdir, srcdir_inputs [i], NULL);
+      ide_makecache_inputs_add (builder, path);
+    }
+
+  {
+    g_autofree gchar *path = g_build_filename (builddir, "config.status", NULL);
+    ide_makecache_inputs_add (builder, path);
+  }
+}
+
+/*
+ * Adds the Makefile of @subdir within @builddir along with the
+ * Makefile.in and Makefile.am it is generated from within @srcdir.
+ */
+void
+ide_makecache_inputs_add_directory (GVariantBuilder *builder,
+                                    const gchar     *srcdir,
+                                    const gchar     *builddir,
+                                    const gchar     *subdir)
+{
+  g_autofree gchar *makefile = NULL;
+  g_autofree gchar *makefile_in = NULL;
+  g_autofree gchar *makefile_am = NULL;
+
+  g_return_if_fail (builder != NULL);
+  g_return_if_fail (srcdir != NULL);
+  g_return_if_fail (builddir != NULL);
+  g_return_if_fail (subdir != NULL);
+
+  makefile = g_build_filename (builddir, subdir, "Makefile", NULL);
+  makefile_in = g_build_filename (srcdir, subdir, "Makefile.in", NULL);
+  makefile_am = g_build_filename (srcdir, subdir, "Makefile.am", NULL);
+
+  ide_makecache_inputs_add (builder, makefile);
+  ide_makecache_inputs_add (builder, makefile_in);
+  ide_makecache_inputs_add (builder, makefile_am);
+}
+
+/**
+ * ide_makecache_inputs_check:
+ * @inputs: a #GVariant of type %IDE_MAKECACHE_INPUTS_TYPE
+ * @newest_mtime: (out) (optional): location for the newest mtime
+ *
+ * Checks that every input is unchanged since it was recorded. An input
+ * has changed if its mtime or size differ, or if it was created or
+ * removed since.
+ *
+ * Returns: %TRUE if none of the inputs have changed.
+ */
+gboolean
+ide_makecache_inputs_check (GVariant *inputs,
+                            gint64   *newest_mtime)
+{
+  GVariantIter iter;
+  const gchar *path;
+  gint64 newest = 0;
+  gint64 mtime;
+  guint64 size;
+
+  g_return_val_if_fail (inputs != NULL, FALSE);
+  g_return_val_if_fail (g_variant_is_of_type (inputs, G_VARIANT_TYPE (IDE_MAKECACHE_INPUTS_TYPE)), FALSE);
+
+  g_variant_iter_init (&iter, inputs);
+
+  while (g_variant_iter_next (&iter, "{&s(xt)}", &path, &mtime, &size))
+    {
+      GStatBuf st;
+
+      if (g_stat (path, &st) != 0)
+        {
+          if (mtime != -1)
+            {
+              g_debug ("%s was removed", path);
+              return FALSE;
+            }
+
+          continue;
+        }
+
+      if (mtime == -1 || (gint64)st.st_mtime != mtime || (guint64)st.st_size != size)
+        {
+          g_debug ("%s has changed", path);
+          return FALSE;
+        }
+
+      newest = MAX (newest, mtime);
+    }
+
+  if (newest_mtime != NULL)
+    *newest_mtime = newest;
+
+  return TRUE;
+}
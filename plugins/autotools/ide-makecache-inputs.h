@@ -0,0 +1,43 @@
+/* ide-makecache-inputs.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_MAKECACHE_INPUTS_H
+#define IDE_MAKECACHE_INPUTS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define IDE_MAKECACHE_INPUTS_TYPE "a{s(xt)}"
+
+void     ide_makecache_inputs_init          (GVariantBuilder *builder);
+void     ide_makecache_inputs_add           (GVariantBuilder *builder,
+                                             const gchar     *path);
+void     ide_makecache_inputs_add_toplevel  (GVariantBuilder *builder,
+                                             const gchar     *srcdir,
+                                             const gchar     *builddir);
+void     ide_makecache_inputs_add_directory (GVariantBuilder *builder,
+                                             const gchar     *srcdir,
+                                             const gchar     *builddir,
+                                             const gchar     *subdir);
+gboolean ide_makecache_inputs_check         (GVariant        *inputs,
+                                             gint64          *newest_mtime);
+
+G_END_DECLS
+
+#endif /* IDE_MAKECACHE_INPUTS_H */
@@ -37,6 +37,7 @@
 
 #include "ide-autotools-build-target.h"
 #include "ide-makecache.h"
+#include "ide-makecache-inputs.h"
 #include "ide-makecache-target.h"
 
 #define FAKE_CC      "__LIBIDE_FAKE_CC__"
@@ -44,6 +45,15 @@
 #define FAKE_VALAC   "__LIBIDE_FAKE_VALAC__"
 #define PRINT_VARS   "include Makefile\nprint-%: ; @echo $* = $($*)\n"
 
+/*
+ * The flags database is a GVariant containing the version of the format,
+ * the inputs that were used to generate it (see ide-makecache-inputs.c),
+ * and the compiler flags for every source file (relative to the project
+ * working directory).
+ */
+#define FLAGS_DB_VERSION 2
+#define FLAGS_DB_TYPE    "(u" IDE_MAKECACHE_INPUTS_TYPE "a{sas})"
+
 struct _IdeMakecache
 {
   IdeObject     parent_instance;
@@ -56,6 +66,10 @@ struct _IdeMakecache
   GPtrArray    *build_targets;
   IdeRuntime   *runtime;
   const gchar  *make_name;
+  gchar        *cache_name;
+  GHashTable   *flags_db;
+
+  guint         flags_db_requested : 1;
 };
 
 typedef struct
@@ -72,6 +86,12 @@ typedef struct
   gchar       *path;
 } FileTargetsLookup;
 
+typedef struct
+{
+  GFile *workdir;
+  gchar *db_path;
+} FlagsDbState;
+
 G_DEFINE_TYPE (IdeMakecache, ide_makecache, IDE_TYPE_OBJECT)
 
 EGG_DEFINE_COUNTER (instances, "IdeMakecache", "Instances", "The number of IdeMakecache")
@@ -84,6 +104,8 @@ enum {
 
 static GParamSpec *properties [LAST_PROP];
 
+static void ide_makecache_populate_flags_db (IdeMakecache *self);
+
 static void
 file_flags_lookup_free (gpointer data)
 {
@@ -106,6 +128,16 @@ file_targets_lookup_free (gpointer data)
   g_slice_free (FileTargetsLookup, lookup);
 }
 
+static void
+flags_db_state_free (gpointer data)
+{
+  FlagsDbState *state = data;
+
+  g_clear_object (&state->workdir);
+  g_clear_pointer (&state->db_path, g_free);
+  g_slice_free (FlagsDbState, state);
+}
+
 static gboolean
 file_is_clangable (GFile *file)
 {
@@ -344,14 +376,30 @@ ide_makecache_validate_mapped_file (GMappedFile  *mapped,
   IDE_RETURN (TRUE);
 }
 
+static gchar *
+ide_makecache_get_cache_path (IdeMakecache *self,
+                              const gchar  *suffix)
+{
+  g_autofree gchar *name = NULL;
+
+  g_assert (IDE_IS_MAKECACHE (self));
+  g_assert (self->cache_name != NULL);
+  g_assert (suffix != NULL);
+
+  name = g_strdup_printf ("%s.%s", self->cache_name, suffix);
+
+  return g_build_filename (g_get_user_cache_dir (),
+                           ide_get_program_name (),
+                           "makecache",
+                           name,
+                           NULL);
+}
+
 static int
 ide_makecache_open_temp (IdeMakecache  *self,
                          gchar        **name_used,
                          GError       **error)
 {
-  IdeContext *context;
-  IdeProject *project;
-  const gchar *project_id;
   g_autofree gchar *name = NULL;
   g_autofree gchar *path = NULL;
   g_autofree gchar *directory = NULL;
@@ -365,10 +413,6 @@ ide_makecache_open_temp (IdeMakecache  *self,
   g_assert (error);
   g_assert (!*error);
 
-  context = ide_object_get_context (IDE_OBJECT (self));
-  project = ide_context_get_project (context);
-  project_id = ide_project_get_id (project);
-
   directory = g_build_filename (g_get_user_cache_dir (),
                                 ide_get_program_name (),
                                 "makecache",
@@ -386,7 +430,7 @@ ide_makecache_open_temp (IdeMakecache  *self,
     }
 
   now = time (NULL);
-  name = g_strdup_printf ("%s.makecache.tmp-%u", project_id, (guint)now);
+  name = g_strdup_printf ("%s.makecache.tmp-%u", self->cache_name, (guint)now);
   path = g_build_filename (directory, name, NULL);
 
   g_debug ("Creating temporary makecache at \"%s\"", path);
@@ -409,6 +453,63 @@ ide_makecache_open_temp (IdeMakecache  *self,
   IDE_RETURN (fd);
 }
 
+/*
+ * Loads the flags database from a previous session. If any of the inputs
+ * that were used to generate it have changed, such as a Makefile.am or
+ * configure.ac, or the makecache was generated before they last changed,
+ * %NULL is returned so that we regenerate both.
+ */
+static GHashTable *
+ide_makecache_load_flags_db (IdeMakecache *self,
+                             const gchar  *db_path,
+                             const gchar  *cache_path)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariant) inputs = NULL;
+  g_autoptr(GVariantIter) files = NULL;
+  g_autoptr(GHashTable) ret = NULL;
+  gchar **flags;
+  gchar *path;
+  GStatBuf st;
+  gint64 newest = 0;
+  guint version = 0;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAKECACHE (self));
+  g_assert (db_path != NULL);
+  g_assert (cache_path != NULL);
+
+  if (NULL == (mapped = g_mapped_file_new (db_path, FALSE, NULL)))
+    IDE_RETURN (NULL);
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (FLAGS_DB_TYPE), bytes, FALSE));
+
+  g_variant_get (variant, "(u@" IDE_MAKECACHE_INPUTS_TYPE "a{sas})", &version, &inputs, &files);
+
+  if (version != FLAGS_DB_VERSION)
+    IDE_RETURN (NULL);
+
+  if (!ide_makecache_inputs_check (inputs, &newest))
+    {
+      IDE_TRACE_MSG ("Inputs have changed, discarding flags database");
+      IDE_RETURN (NULL);
+    }
+
+  if (g_stat (cache_path, &st) != 0 || (gint64)st.st_mtime < newest)
+    IDE_RETURN (NULL);
+
+  ret = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_strfreev);
+
+  while (g_variant_iter_next (files, "{s^as}", &path, &flags))
+    g_hash_table_insert (ret, path, flags);
+
+  IDE_RETURN (g_steal_pointer (&ret));
+}
+
 static void
 ide_makecache_new_worker (GTask        *task,
                           gpointer      source_object,
@@ -417,12 +518,10 @@ ide_makecache_new_worker (GTask        *task,
 {
   IdeMakecache *self = source_object;
   IdeRuntime *runtime = task_data;
-  IdeContext *context;
-  IdeProject *project;
-  const gchar *project_id;
   g_autofree gchar *name_used = NULL;
-  g_autofree gchar *name = NULL;
   g_autofree gchar *cache_path = NULL;
+  g_autofree gchar *db_path = NULL;
+  g_autoptr(GHashTable) flags_db = NULL;
   g_autoptr(GFile) parent = NULL;
   g_autofree gchar *workdir = NULL;
   g_autoptr(GMappedFile) mapped = NULL;
@@ -465,15 +564,32 @@ ide_makecache_new_worker (GTask        *task,
   if (ide_runtime_contains_program_in_path (runtime, "gmake", cancellable))
     self->make_name = "gmake";
 
-  context = ide_object_get_context (IDE_OBJECT (self));
-  project = ide_context_get_project (context);
-  project_id = ide_project_get_id (project);
-  name = g_strdup_printf ("%s.makecache", project_id);
-  cache_path = g_build_filename (g_get_user_cache_dir (),
-                                 ide_get_program_name (),
-                                 "makecache",
-                                 name,
-                                 NULL);
+  cache_path = ide_makecache_get_cache_path (self, "makecache");
+  db_path = ide_makecache_get_cache_path (self, "flags");
+
+  /*
+   * If we have a flags database from a previous session and none of the
+   * Makefiles have changed since, the makecache from that session is still
+   * valid and we can avoid running make entirely.
+   */
+  if (NULL != (flags_db = ide_makecache_load_flags_db (self, db_path, cache_path)) &&
+      NULL != (mapped = g_mapped_file_new (cache_path, FALSE, NULL)) &&
+      ide_makecache_validate_mapped_file (mapped, &error))
+    {
+      IDE_TRACE_MSG ("Reusing makecache and flags database from %s", db_path);
+
+      self->mapped = g_steal_pointer (&mapped);
+      self->runtime = g_object_ref (runtime);
+      self->flags_db = g_steal_pointer (&flags_db);
+
+      g_task_return_pointer (task, g_object_ref (self), g_object_unref);
+
+      IDE_EXIT;
+    }
+
+  g_clear_error (&error);
+  g_clear_pointer (&mapped, g_mapped_file_unref);
+  g_clear_pointer (&flags_db, g_hash_table_unref);
 
  /*
   * NOTE:
@@ -490,7 +606,7 @@ ide_makecache_new_worker (GTask        *task,
   * 3) Spawn `make -p -n -s` using the temporary file as stdout.
   * 4) Wait for the subprocess to complete. It would be nice if we could do this asynchronously,
   *    but we'd need to break this whole thing into more tasks.
-  * 5) Move the temporary file into position at ~/.cache/<prgname>/<project>.makecache
+  * 5) Move the temporary file into position at ~/.cache/<prgname>/<project>-<config>.makecache
   * 6) mmap() the cache file using g_mapped_file_new_from_fd().
   * 7) Close the fd. This does NOT cause the mmap() region to be unmapped.
   * 8) Validate the mmap() contents with g_utf8_validate().
@@ -902,6 +1018,69 @@ ide_makecache_parse_line (IdeMakecache *self,
   IDE_RETURN (NULL);
 }
 
+/*
+ * Runs make with @argv from the build directory and returns the lines of
+ * output, with escaped newlines joined to simplify command parsing.
+ */
+static gchar **
+ide_makecache_dry_run (IdeMakecache        *self,
+                       const gchar * const *argv,
+                       GCancellable        *cancellable,
+                       GError             **error)
+{
+  g_autoptr(IdeSubprocessLauncher) launcher = NULL;
+  g_autoptr(IdeSubprocess) subprocess = NULL;
+  g_autofree gchar *stdoutstr = NULL;
+  g_autofree gchar *cwd = NULL;
+  gchar **lines;
+  gchar *tmp;
+  gsize i;
+
+  g_assert (IDE_IS_MAKECACHE (self));
+  g_assert (argv != NULL);
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  if (NULL == (launcher = ide_runtime_create_launcher (self->runtime, error)))
+    return NULL;
+
+  cwd = g_file_get_path (self->parent);
+
+  ide_subprocess_launcher_set_flags (launcher, (G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                                G_SUBPROCESS_FLAGS_STDERR_SILENCE));
+  ide_subprocess_launcher_set_cwd (launcher, cwd);
+  ide_subprocess_launcher_push_args (launcher, argv);
+
+  if (NULL == (subprocess = ide_subprocess_launcher_spawn (launcher, cancellable, error)))
+    return NULL;
+
+  /* Don't let ourselves be cancelled from this operation */
+  if (!ide_subprocess_communicate_utf8 (subprocess, NULL, NULL, &stdoutstr, NULL, error))
+    return NULL;
+
+  /*
+   * Replace escaped newlines with " " to simplify command parsing
+   */
+  tmp = stdoutstr;
+  while (NULL != (tmp = strstr (tmp, "\\\n")))
+    {
+      tmp[0] = ' ';
+      tmp[1] = ' ';
+    }
+
+  lines = g_strsplit (stdoutstr, "\n", 0);
+
+  for (i = 0; lines [i]; i++)
+    {
+      gchar *line = lines [i];
+      gsize linelen = strlen (line);
+
+      if (linelen > 0 && line [linelen - 1] == '\\')
+        line [linelen - 1] = '\0';
+    }
+
+  return lines;
+}
+
 static void
 ide_makecache_get_file_flags_worker (GTask        *task,
                                      gpointer      source_object,
@@ -926,18 +1105,13 @@ ide_makecache_get_file_flags_worker (GTask        *task,
   for (j = 0; j < lookup->targets->len; j++)
     {
       IdeMakecacheTarget *target;
-      g_autoptr(IdeSubprocessLauncher) launcher = NULL;
-      g_autoptr(IdeSubprocess) subprocess = NULL;
       g_autoptr(GPtrArray) argv = NULL;
-      g_autofree gchar *stdoutstr = NULL;
-      g_autofree gchar *cwd = NULL;
       const gchar *subdir;
       const gchar *targetstr;
       const gchar *relpath;
       GError *error = NULL;
       gchar **lines;
       gchar **ret = NULL;
-      gchar *tmp;
 
       if (g_cancellable_is_cancelled (cancellable))
         break;
@@ -947,8 +1121,6 @@ ide_makecache_get_file_flags_worker (GTask        *task,
       subdir = ide_makecache_target_get_subdir (target);
       targetstr = ide_makecache_target_get_target (target);
 
-      cwd = g_file_get_path (lookup->self->parent);
-
       if ((subdir != NULL) && g_str_has_prefix (lookup->relative_path, subdir))
         relpath = lookup->relative_path + strlen (subdir);
       else
@@ -983,63 +1155,24 @@ ide_makecache_get_file_flags_worker (GTask        *task,
       }
 #endif
 
-      launcher = ide_runtime_create_launcher (lookup->self->runtime, &error);
-
-      if (launcher == NULL)
-        {
-          g_assert (error != NULL);
-          g_task_return_error (task, error);
-          IDE_EXIT;
-        }
-
-      ide_subprocess_launcher_set_flags (launcher, (G_SUBPROCESS_FLAGS_STDOUT_PIPE |
-                                                    G_SUBPROCESS_FLAGS_STDERR_SILENCE));
-      ide_subprocess_launcher_set_cwd (launcher, cwd);
-      ide_subprocess_launcher_push_args (launcher, (const gchar * const *)argv->pdata);
-
-      subprocess = ide_subprocess_launcher_spawn (launcher, cancellable, &error);
+      lines = ide_makecache_dry_run (lookup->self,
+                                     (const gchar * const *)argv->pdata,
+                                     cancellable,
+                                     &error);
 
-      if (subprocess == NULL)
+      if (lines == NULL)
         {
           g_assert (error != NULL);
           g_task_return_error (task, error);
           IDE_EXIT;
         }
 
-      /* Don't let ourselves be cancelled from this operation */
-      if (!ide_subprocess_communicate_utf8 (subprocess, NULL, NULL, &stdoutstr, NULL, &error))
-        {
-          g_assert (error != NULL);
-          g_task_return_error (task, error);
-          IDE_EXIT;
-        }
-
-      /*
-       * Replace escaped newlines with " " to simplify command parsing
-       */
-      tmp = stdoutstr;
-      while (NULL != (tmp = strstr (tmp, "\\\n")))
-        {
-          tmp[0] = ' ';
-          tmp[1] = ' ';
-        }
-
-      lines = g_strsplit (stdoutstr, "\n", 0);
-
       for (i = 0; lines [i]; i++)
         {
-          gchar *line = lines [i];
-          gsize linelen;
-
-          if (line [0] == '\0')
+          if (lines [i][0] == '\0')
             continue;
 
-          linelen = strlen (line);
-
-          if (line [linelen - 1] == '\\')
-            line [linelen - 1] = '\0';
-
-          if ((ret = ide_makecache_parse_line (lookup->self, line, relpath, subdir ?: ".")))
+          if ((ret = ide_makecache_parse_line (lookup->self, lines [i], relpath, subdir ?: ".")))
             break;
         }
 
@@ -1296,6 +1429,7 @@ ide_makecache_get_file_flags_dispatch (EggTaskCache  *cache,
   IdeMakecache *self = user_data;
   FileFlagsLookup *lookup;
   GFile *file = (GFile *)key;
+  const gchar * const *flags;
 
   IDE_ENTRY;
 
@@ -1319,6 +1453,17 @@ ide_makecache_get_file_flags_dispatch (EggTaskCache  *cache,
       return;
     }
 
+  if (self->flags_db != NULL &&
+      NULL != (flags = g_hash_table_lookup (self->flags_db, lookup->relative_path)))
+    {
+      IDE_TRACE_MSG ("Found flags for %s in flags database", lookup->relative_path);
+      file_flags_lookup_free (lookup);
+      g_task_return_pointer (task, g_strdupv ((gchar **)flags), (GDestroyNotify)g_strfreev);
+      IDE_EXIT;
+    }
+
+  ide_makecache_populate_flags_db (self);
+
   g_task_set_task_data (task, lookup, file_flags_lookup_free);
 
   ide_makecache_get_file_targets_async (self,
@@ -1342,6 +1487,8 @@ ide_makecache_finalize (GObject *object)
   g_clear_object (&self->file_flags_cache);
   g_clear_object (&self->runtime);
   g_clear_pointer (&self->build_targets, g_ptr_array_unref);
+  g_clear_pointer (&self->flags_db, g_hash_table_unref);
+  g_clear_pointer (&self->cache_name, g_free);
 
   G_OBJECT_CLASS (ide_makecache_parent_class)->finalize (object);
 
@@ -1405,6 +1552,40 @@ ide_makecache_class_init (IdeMakecacheClass *klass)
   g_object_class_install_properties (object_class, LAST_PROP, properties);
 }
 
+static gsize
+ide_makecache_get_file_targets_cost (gconstpointer value)
+{
+  const GPtrArray *targets = value;
+  gsize cost = sizeof *targets;
+  guint i;
+
+  for (i = 0; i < targets->len; i++)
+    {
+      IdeMakecacheTarget *target = g_ptr_array_index (targets, i);
+      const gchar *subdir = ide_makecache_target_get_subdir (target);
+      const gchar *name = ide_makecache_target_get_target (target);
+
+      cost += sizeof (gpointer) * 4;
+      cost += subdir ? strlen (subdir) + 1 : 0;
+      cost += name ? strlen (name) + 1 : 0;
+    }
+
+  return cost;
+}
+
+static gsize
+ide_makecache_get_file_flags_cost (gconstpointer value)
+{
+  const gchar * const *flags = value;
+  gsize cost = sizeof (gpointer);
+  guint i;
+
+  for (i = 0; flags [i] != NULL; i++)
+    cost += sizeof (gpointer) + strlen (flags [i]) + 1;
+
+  return cost;
+}
+
 static void
 ide_makecache_init (IdeMakecache *self)
 {
@@ -1424,6 +1605,7 @@ ide_makecache_init (IdeMakecache *self)
                                                  NULL);
 
   egg_task_cache_set_name (self->file_targets_cache, "makecache: file-targets-cache");
+  egg_task_cache_set_cost_func (self->file_targets_cache, ide_makecache_get_file_targets_cost);
 
   self->file_flags_cache = egg_task_cache_new ((GHashFunc)g_file_hash,
                                                (GEqualFunc)g_file_equal,
@@ -1437,6 +1619,7 @@ ide_makecache_init (IdeMakecache *self)
                                                NULL);
 
   egg_task_cache_set_name (self->file_flags_cache, "makecache: file-flags-cache");
+  egg_task_cache_set_cost_func (self->file_flags_cache, ide_makecache_get_file_flags_cost);
 }
 
 GFile *
@@ -1456,7 +1639,11 @@ ide_makecache_new_for_makefile_async (IdeRuntime          *runtime,
 {
   g_autoptr(GTask) task = NULL;
   g_autoptr(IdeMakecache) self = NULL;
+  g_autofree gchar *uri = NULL;
+  g_autofree gchar *config_key = NULL;
+  g_autofree gchar *checksum = NULL;
   IdeContext *context;
+  IdeProject *project;
 
   IDE_ENTRY;
 
@@ -1478,6 +1665,16 @@ ide_makecache_new_for_makefile_async (IdeRuntime          *runtime,
                        "makefile", makefile,
                        NULL);
 
+  /*
+   * Each configuration has its own build directory and runtime, so they
+   * each get their own makecache and flags database.
+   */
+  project = ide_context_get_project (context);
+  uri = g_file_get_uri (makefile);
+  config_key = g_strdup_printf ("%s\n%s", uri, ide_runtime_get_id (runtime));
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, config_key, -1);
+  self->cache_name = g_strdup_printf ("%s-%s", ide_project_get_id (project), checksum);
+
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_source_tag (task, ide_makecache_new_for_makefile_async);
   g_task_set_task_data (task, g_object_ref (runtime), g_object_unref);
@@ -1733,6 +1930,318 @@ find_make_directories (IdeMakecache  *self,
   return g_steal_pointer (&ret);
 }
 
+static gboolean
+is_source_file (const gchar *name)
+{
+  static const gchar *suffixes[] = {
+    ".c", ".cc", ".cpp", ".cxx", ".c++", ".C", ".m", ".vala", ".gs",
+  };
+  const gchar *dot;
+
+  if (NULL == (dot = strrchr (name, '.')))
+    return FALSE;
+
+  for (guint i = 0; i < G_N_ELEMENTS (suffixes); i++)
+    {
+      if (strcmp (dot, suffixes [i]) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Extracts the source files from a compiler command line produced by a dry
+ * run of make. Automake wraps sources found through VPATH in an expansion
+ * such as `test -f 'foo.c' || echo '$(srcdir)/'`foo.c, in which case the
+ * source follows the closing backtick.
+ */
+static gchar **
+extract_sources (const gchar *line)
+{
+  g_auto(GStrv) argv = NULL;
+  GPtrArray *ret;
+  const gchar *pos;
+  gboolean in_expand = FALSE;
+  gint argc = 0;
+
+  g_assert (line != NULL);
+
+  if ((pos = strstr (line, FAKE_CXX)))
+    pos += strlen (FAKE_CXX);
+  else if ((pos = strstr (line, FAKE_CC)))
+    pos += strlen (FAKE_CC);
+  else if ((pos = strstr (line, FAKE_VALAC)))
+    pos += strlen (FAKE_VALAC);
+  else
+    return NULL;
+
+  if (!g_shell_parse_argv (pos, &argc, &argv, NULL))
+    return NULL;
+
+  ret = g_ptr_array_new ();
+
+  for (gint i = 0; i < argc; i++)
+    {
+      const gchar *arg = argv [i];
+      const gchar *tick;
+      guint n_ticks = 0;
+
+      for (tick = arg; (tick = strchr (tick, '`')); tick++)
+        n_ticks++;
+
+      if (n_ticks % 2)
+        in_expand = !in_expand;
+
+      if (in_expand)
+        continue;
+
+      if (NULL != (tick = strrchr (arg, '`')))
+        arg = tick + 1;
+
+      if (arg [0] != '-' && is_source_file (arg))
+        g_ptr_array_add (ret, g_strdup (arg));
+    }
+
+  g_ptr_array_add (ret, NULL);
+
+  return (gchar **)g_ptr_array_free (ret, FALSE);
+}
+
+static void
+ide_makecache_populate_flags_db_worker (GTask        *task,
+                                        gpointer      source_object,
+                                        gpointer      task_data,
+                                        GCancellable *cancellable)
+{
+  IdeMakecache *self = source_object;
+  FlagsDbState *state = task_data;
+  g_autoptr(GPtrArray) makedirs = NULL;
+  g_autoptr(GHashTable) ret = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_auto(GVariantBuilder) inputs = { { 0 } };
+  g_auto(GVariantBuilder) files = { { 0 } };
+  g_autofree gchar *parent = NULL;
+  g_autofree gchar *srcdir_path = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  GError *error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_MAKECACHE (self));
+  g_assert (state != NULL);
+  g_assert (G_IS_FILE (state->workdir));
+  g_assert (state->db_path != NULL);
+
+  /*
+   * Rather than asking make for the flags of each file as it is opened, we
+   * do a single dry run per Makefile directory pretending that everything
+   * is out of date (-B) so that make prints the compiler command line for
+   * every object it knows how to build. We avoid remaking the Makefile
+   * itself (-o Makefile) and only build the local targets (all-am) since
+   * we visit each subdirectory ourselves.
+   */
+
+  if (NULL == (makedirs = find_make_directories (self, self->parent, cancellable, &error)))
+    {
+      g_task_return_error (task, error);
+      IDE_EXIT;
+    }
+
+  parent = g_file_get_path (self->parent);
+  srcdir_path = g_file_get_path (state->workdir);
+
+  if (parent == NULL || srcdir_path == NULL)
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NOT_SUPPORTED,
+                               "Flags database requires a local project");
+      IDE_EXIT;
+    }
+
+  ret = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_strfreev);
+
+  /*
+   * Record the inputs before running make so that changes made while we
+   * are running cause the database to be discarded next time.
+   */
+  ide_makecache_inputs_init (&inputs);
+  ide_makecache_inputs_add_toplevel (&inputs, srcdir_path, parent);
+
+  g_variant_builder_init (&files, G_VARIANT_TYPE ("a{sas}"));
+
+  for (guint i = 0; i < makedirs->len; i++)
+    {
+      GFile *makedir = g_ptr_array_index (makedirs, i);
+      g_autofree gchar *subdir = NULL;
+      g_autofree gchar *makefile = NULL;
+      g_autoptr(GFile) srcdir = NULL;
+      g_auto(GStrv) lines = NULL;
+      GStatBuf st;
+      const gchar *argv[] = {
+        self->make_name, "-C", NULL, "-s", "-i", "-n", "-B", "-o", "Makefile", "all-am",
+        "V=1", "CC="FAKE_CC, "CXX="FAKE_CXX, "VALAC="FAKE_VALAC, NULL
+      };
+
+      if (NULL == (subdir = g_file_get_relative_path (self->parent, makedir)))
+        subdir = g_strdup (".");
+
+      makefile = g_build_filename (parent, subdir, "Makefile", NULL);
+
+      if (g_stat (makefile, &st) != 0)
+        continue;
+
+      ide_makecache_inputs_add_directory (&inputs, srcdir_path, parent, subdir);
+
+      argv [2] = subdir;
+
+      if (NULL == (lines = ide_makecache_dry_run (self, argv, cancellable, &error)))
+        {
+          g_task_return_error (task, error);
+          IDE_EXIT;
+        }
+
+      srcdir = g_file_resolve_relative_path (state->workdir, subdir);
+
+      for (guint j = 0; lines [j]; j++)
+        {
+          g_auto(GStrv) sources = NULL;
+          g_auto(GStrv) flags = NULL;
+
+          if (NULL == (sources = extract_sources (lines [j])) || sources [0] == NULL)
+            continue;
+
+          if (NULL == (flags = ide_makecache_parse_line (self, lines [j], subdir, subdir)))
+            continue;
+
+          for (guint k = 0; sources [k]; k++)
+            {
+              g_autoptr(GFile) file = NULL;
+              gchar *relpath;
+
+              /*
+               * Sources are usually relative to the source directory, but
+               * generated sources will be found in the build directory.
+               */
+              file = g_file_resolve_relative_path (srcdir, sources [k]);
+
+              if (!g_file_query_exists (file, NULL))
+                {
+                  g_clear_object (&file);
+                  file = g_file_resolve_relative_path (makedir, sources [k]);
+                }
+
+              if (NULL == (relpath = g_file_get_relative_path (state->workdir, file)))
+                continue;
+
+              /* Like ide_makecache_get_file_flags_worker(), the first target wins */
+              if (g_hash_table_contains (ret, relpath))
+                g_free (relpath);
+              else
+                g_hash_table_insert (ret, relpath, g_strdupv (flags));
+            }
+        }
+    }
+
+  g_hash_table_iter_init (&iter, ret);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    g_variant_builder_add (&files, "{s^as}", key, value);
+
+  variant = g_variant_ref_sink (g_variant_new (FLAGS_DB_TYPE,
+                                               FLAGS_DB_VERSION,
+                                               &inputs,
+                                               &files));
+
+  if (!g_file_set_contents (state->db_path,
+                            g_variant_get_data (variant),
+                            g_variant_get_size (variant),
+                            &error))
+    {
+      g_warning ("Failed to save flags database: %s", error->message);
+      g_clear_error (&error);
+    }
+
+  IDE_TRACE_MSG ("Saved flags for %u files to %s",
+                 g_hash_table_size (ret), state->db_path);
+
+  g_task_return_pointer (task, g_steal_pointer (&ret), (GDestroyNotify)g_hash_table_unref);
+
+  IDE_EXIT;
+}
+
+static void
+ide_makecache_populate_flags_db_cb (GObject      *object,
+                                    GAsyncResult *result,
+                                    gpointer      user_data)
+{
+  IdeMakecache *self = (IdeMakecache *)object;
+  g_autoptr(GError) error = NULL;
+  GHashTable *flags_db;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAKECACHE (self));
+  g_assert (G_IS_TASK (result));
+
+  if (NULL == (flags_db = g_task_propagate_pointer (G_TASK (result), &error)))
+    {
+      g_debug ("Failed to populate flags database: %s", error->message);
+      IDE_EXIT;
+    }
+
+  g_clear_pointer (&self->flags_db, g_hash_table_unref);
+  self->flags_db = flags_db;
+
+  IDE_EXIT;
+}
+
+/*
+ * Builds the flags database in the background so that further requests for
+ * file flags (in this session and following ones) do not need to run make.
+ * This only happens once per makecache; until it completes, requests fall
+ * back to running make for the individual file.
+ */
+static void
+ide_makecache_populate_flags_db (IdeMakecache *self)
+{
+  g_autoptr(GTask) task = NULL;
+  FlagsDbState *state;
+  IdeContext *context;
+  IdeVcs *vcs;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAKECACHE (self));
+
+  if (self->flags_db != NULL || self->flags_db_requested)
+    IDE_EXIT;
+
+  self->flags_db_requested = TRUE;
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  vcs = ide_context_get_vcs (context);
+
+  state = g_slice_new0 (FlagsDbState);
+  state->workdir = g_object_ref (ide_vcs_get_working_directory (vcs));
+  state->db_path = ide_makecache_get_cache_path (self, "flags");
+
+  task = g_task_new (self, NULL, ide_makecache_populate_flags_db_cb, NULL);
+  g_task_set_source_tag (task, ide_makecache_populate_flags_db);
+  g_task_set_task_data (task, state, flags_db_state_free);
+
+  /* This can take a while, so keep it out of the way of the compiler pool */
+  ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER,
+                             task,
+                             ide_makecache_populate_flags_db_worker);
+
+  IDE_EXIT;
+}
+
 static GFile *
 find_install_dir (const gchar *key,
                   GHashTable  *dirs)
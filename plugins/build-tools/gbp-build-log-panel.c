@@ -24,6 +24,7 @@
 #include "egg-signal-group.h"
 
 #include "gbp-build-log-panel.h"
+#include "gbp-build-log-view.h"
 
 struct _GbpBuildLogPanel
 {
@@ -33,11 +34,9 @@ struct _GbpBuildLogPanel
   EggSignalGroup    *signals;
   GtkCssProvider    *css;
   GSettings         *settings;
-  GtkTextBuffer     *buffer;
 
   GtkScrolledWindow *scroller;
-  GtkTextView       *text_view;
-  GtkTextTag        *stderr_tag;
+  GbpBuildLogView   *view;
 };
 
 enum {
@@ -51,73 +50,20 @@ G_DEFINE_TYPE (GbpBuildLogPanel, gbp_build_log_panel, PNL_TYPE_DOCK_WIDGET)
 static GParamSpec *properties [LAST_PROP];
 
 static void
-gbp_build_log_panel_reset_view (GbpBuildLogPanel *self)
+gbp_build_log_panel_log_lines (GbpBuildLogPanel *self,
+                               guint64           begin,
+                               guint64           end,
+                               IdeBuildResult   *result)
 {
-  GtkStyleContext *context;
-
-  g_assert (GBP_IS_BUILD_LOG_PANEL (self));
-
-  g_clear_object (&self->buffer);
-
-  if (self->text_view != NULL)
-    gtk_widget_destroy (GTK_WIDGET (self->text_view));
-
-  self->buffer = gtk_text_buffer_new (NULL);
-  self->stderr_tag = gtk_text_buffer_create_tag (self->buffer,
-                                                 "stderr-tag",
-                                                 "foreground", "#ff0000",
-                                                 "weight", PANGO_WEIGHT_BOLD,
-                                                 NULL);
-
-  self->text_view = g_object_new (GTK_TYPE_TEXT_VIEW,
-                                  "bottom-margin", 3,
-                                  "buffer", self->buffer,
-                                  "editable", FALSE,
-                                  "left-margin", 3,
-                                  "monospace", TRUE,
-                                  "right-margin", 3,
-                                  "top-margin", 3,
-                                  "visible", TRUE,
-                                  NULL);
-  context = gtk_widget_get_style_context (GTK_WIDGET (self->text_view));
-  gtk_style_context_add_provider (context,
-                                  GTK_STYLE_PROVIDER (self->css),
-                                  GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-  gtk_container_add (GTK_CONTAINER (self->scroller), GTK_WIDGET (self->text_view));
-}
-
-static void
-gbp_build_log_panel_log (GbpBuildLogPanel  *self,
-                         IdeBuildResultLog  log,
-                         const gchar       *message,
-                         IdeBuildResult    *result)
-{
-  GtkTextMark *insert;
-  GtkTextIter iter;
-
   g_assert (GBP_IS_BUILD_LOG_PANEL (self));
-  g_assert (message != NULL);
+  g_assert (begin <= end);
   g_assert (IDE_IS_BUILD_RESULT (result));
 
-  gtk_text_buffer_get_end_iter (self->buffer, &iter);
-
-  if (G_LIKELY (log == IDE_BUILD_RESULT_LOG_STDOUT))
-    {
-      gtk_text_buffer_insert (self->buffer, &iter, message, -1);
-    }
-  else
-    {
-      GtkTextIter begin;
-      guint offset;
-
-      offset = gtk_text_iter_get_offset (&iter);
-      gtk_text_buffer_insert (self->buffer, &iter, message, -1);
-      gtk_text_buffer_get_iter_at_offset (self->buffer, &begin, offset);
-      gtk_text_buffer_apply_tag (self->buffer, self->stderr_tag, &begin, &iter);
-    }
-
-  insert = gtk_text_buffer_get_insert (self->buffer);
-  gtk_text_view_scroll_to_mark (self->text_view, insert, 0.0, TRUE, 0.0, 0.0);
+  /*
+   * The lines are already in the log of the result, so we only need to let
+   * the view know to redraw. The view coalesces these to once per frame.
+   */
+  gbp_build_log_view_queue_update (self->view);
 }
 
 void
@@ -129,7 +75,7 @@ gbp_build_log_panel_set_result (GbpBuildLogPanel *self,
 
   if (g_set_object (&self->result, result))
     {
-      gbp_build_log_panel_reset_view (self);
+      gbp_build_log_view_set_log (self->view, result ? ide_build_result_get_log (result) : NULL);
       egg_signal_group_set_target (self->signals, result);
     }
 }
@@ -155,7 +101,7 @@ gbp_build_log_panel_changed_font_name (GbpBuildLogPanel *self,
       gchar *css;
 
       fragment = ide_pango_font_description_to_css (font_desc);
-      css = g_strdup_printf ("textview { %s }", fragment);
+      css = g_strdup_printf ("buildlogview { %s }", fragment);
 
       gtk_css_provider_load_from_data (self->css, css, -1, NULL);
 
@@ -172,8 +118,6 @@ gbp_build_log_panel_finalize (GObject *object)
 {
   GbpBuildLogPanel *self = (GbpBuildLogPanel *)object;
 
-  self->stderr_tag = NULL;
-
   g_clear_object (&self->result);
   g_clear_object (&self->signals);
   g_clear_object (&self->css);
@@ -253,13 +197,19 @@ gbp_build_log_panel_init (GbpBuildLogPanel *self)
 
   g_object_set (self, "title", _("Build Output"), NULL);
 
-  gbp_build_log_panel_reset_view (self);
+  self->view = g_object_new (GBP_TYPE_BUILD_LOG_VIEW,
+                             "visible", TRUE,
+                             NULL);
+  gtk_style_context_add_provider (gtk_widget_get_style_context (GTK_WIDGET (self->view)),
+                                  GTK_STYLE_PROVIDER (self->css),
+                                  GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+  gtk_container_add (GTK_CONTAINER (self->scroller), GTK_WIDGET (self->view));
 
   self->signals = egg_signal_group_new (IDE_TYPE_BUILD_RESULT);
 
   egg_signal_group_connect_object (self->signals,
-                                   "log",
-                                   G_CALLBACK (gbp_build_log_panel_log),
+                                   "log-lines",
+                                   G_CALLBACK (gbp_build_log_panel_log_lines),
                                    self,
                                    G_CONNECT_SWAPPED);
 
@@ -0,0 +1,1094 @@
+/* gbp-build-log-view.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gi18n.h>
+#include <string.h>
+
+#include "gbp-build-log-view.h"
+
+/*
+ * GbpBuildLogView draws the lines of an IdeBuildLog. Unlike a GtkTextView,
+ * it does not copy the lines into a buffer of its own, and only lays out the
+ * lines that are visible, so a build producing millions of lines costs no
+ * more to display than one producing a hundred.
+ *
+ * Every line has the same height, so the vertical adjustment maps directly
+ * to line numbers. The horizontal adjustment grows as wider lines are drawn.
+ *
+ * Updates are coalesced to once per frame, and while scrolled to the end the
+ * view follows new lines.
+ *
+ * Text may be selected with the pointer and copied with the usual key
+ * bindings. The selection is kept as positions within the log rather than
+ * as text, so selecting millions of lines costs nothing until it is copied.
+ */
+
+#define MARGIN 3
+
+typedef struct
+{
+  guint64 line;
+  gint    index;
+} LogPosition;
+
+struct _GbpBuildLogView
+{
+  GtkDrawingArea  parent_instance;
+
+  IdeBuildLog    *log;
+
+  GtkAdjustment  *hadjustment;
+  GtkAdjustment  *vadjustment;
+
+  PangoLayout    *layout;
+  PangoAttrList  *stderr_attrs;
+  PangoAttrList  *dropped_attrs;
+
+  /* The bounds of the log as of the last update */
+  guint64         begin;
+  guint64         end;
+  guint64         n_dropped;
+
+  gint            line_height;
+  gint            max_width;
+
+  guint           tick_handler;
+
+  /* The selection, from where the button was pressed to the pointer */
+  LogPosition     sel_anchor;
+  LogPosition     sel_cursor;
+
+  guint           hscroll_policy : 1;
+  guint           vscroll_policy : 1;
+  guint           follow : 1;
+  guint           has_selection : 1;
+  guint           selecting : 1;
+};
+
+typedef struct
+{
+  GbpBuildLogView *self;
+  cairo_t         *cr;
+  guint64          first_row_line;
+  gdouble          first_row_y;
+  gdouble          x;
+  LogPosition      sel_begin;
+  LogPosition      sel_end;
+} DrawState;
+
+typedef struct
+{
+  GString     *str;
+  LogPosition  begin;
+  LogPosition  end;
+} CopyState;
+
+/*
+ * The visible lines are copied out of the log before drawing them, so that
+ * appending to the log from the build does not wait on Pango.
+ */
+typedef struct
+{
+  GString *text;
+  GArray  *lines;
+} VisibleLines;
+
+typedef struct
+{
+  guint64           line;
+  gsize             offset;
+  gsize             len;
+  IdeBuildResultLog log;
+} VisibleLine;
+
+enum {
+  COPY_CLIPBOARD,
+  SELECT_ALL,
+  LAST_SIGNAL
+};
+
+enum {
+  PROP_0,
+  PROP_LOG,
+  LAST_PROP,
+
+  PROP_HADJUSTMENT,
+  PROP_VADJUSTMENT,
+  PROP_HSCROLL_POLICY,
+  PROP_VSCROLL_POLICY,
+};
+
+G_DEFINE_TYPE_EXTENDED (GbpBuildLogView, gbp_build_log_view, GTK_TYPE_DRAWING_AREA, 0,
+                        G_IMPLEMENT_INTERFACE (GTK_TYPE_SCROLLABLE, NULL))
+
+static GParamSpec *properties [LAST_PROP];
+static guint signals [LAST_SIGNAL];
+
+static inline gint
+log_position_compare (const LogPosition *a,
+                      const LogPosition *b)
+{
+  if (a->line < b->line)
+    return -1;
+  else if (a->line > b->line)
+    return 1;
+  else
+    return a->index - b->index;
+}
+
+static inline guint64
+gbp_build_log_view_get_n_rows (GbpBuildLogView *self)
+{
+  /* The first row notes how many lines were dropped, if any */
+  return (self->end - self->begin) + (self->n_dropped > 0 ? 1 : 0);
+}
+
+/*
+ * Gets the selection in order, clamped to the lines still in the log.
+ * Returns %FALSE if nothing is selected.
+ */
+static gboolean
+gbp_build_log_view_get_selection_bounds (GbpBuildLogView *self,
+                                         LogPosition     *begin,
+                                         LogPosition     *end)
+{
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+  g_assert (begin != NULL);
+  g_assert (end != NULL);
+
+  if (!self->has_selection || self->log == NULL)
+    return FALSE;
+
+  if (log_position_compare (&self->sel_anchor, &self->sel_cursor) <= 0)
+    {
+      *begin = self->sel_anchor;
+      *end = self->sel_cursor;
+    }
+  else
+    {
+      *begin = self->sel_cursor;
+      *end = self->sel_anchor;
+    }
+
+  if (end->line < self->begin)
+    return FALSE;
+
+  if (begin->line < self->begin)
+    {
+      begin->line = self->begin;
+      begin->index = 0;
+    }
+
+  return log_position_compare (begin, end) < 0;
+}
+
+static void
+gbp_build_log_view_update_adjustments (GbpBuildLogView *self)
+{
+  GtkAllocation alloc;
+  gdouble upper;
+  gdouble value;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  gtk_widget_get_allocation (GTK_WIDGET (self), &alloc);
+
+  if (self->hadjustment != NULL)
+    {
+      upper = MAX (alloc.width, self->max_width + MARGIN * 2);
+      value = CLAMP (gtk_adjustment_get_value (self->hadjustment), 0, upper - alloc.width);
+
+      gtk_adjustment_configure (self->hadjustment,
+                                value,
+                                0,
+                                upper,
+                                self->line_height,
+                                alloc.width * 0.9,
+                                alloc.width);
+    }
+
+  if (self->vadjustment != NULL)
+    {
+      gboolean follow = self->follow;
+
+      upper = MAX (alloc.height, gbp_build_log_view_get_n_rows (self) * self->line_height + MARGIN * 2);
+
+      if (follow)
+        value = upper - alloc.height;
+      else
+        value = CLAMP (gtk_adjustment_get_value (self->vadjustment), 0, upper - alloc.height);
+
+      gtk_adjustment_configure (self->vadjustment,
+                                value,
+                                0,
+                                upper,
+                                self->line_height,
+                                alloc.height * 0.9,
+                                alloc.height);
+
+      self->follow = follow;
+    }
+}
+
+static gboolean
+gbp_build_log_view_tick (GtkWidget     *widget,
+                         GdkFrameClock *frame_clock,
+                         gpointer       user_data)
+{
+  GbpBuildLogView *self = (GbpBuildLogView *)widget;
+  guint64 old_rows;
+  guint64 begin = 0;
+  guint64 end = 0;
+  guint64 n_dropped = 0;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  self->tick_handler = 0;
+
+  old_rows = gbp_build_log_view_get_n_rows (self);
+
+  if (self->log != NULL)
+    {
+      ide_build_log_get_bounds (self->log, &begin, &end);
+      n_dropped = ide_build_log_get_n_dropped (self->log);
+    }
+
+  /*
+   * If lines were dropped from the top while the user is looking at older
+   * lines, move the view up by the same amount so the text does not slide
+   * out from under them.
+   */
+  if (!self->follow && self->vadjustment != NULL && begin > self->begin)
+    {
+      gdouble value = gtk_adjustment_get_value (self->vadjustment);
+      gint64 removed = (gint64)(begin - self->begin) - ((n_dropped > 0) != (self->n_dropped > 0));
+
+      gtk_adjustment_set_value (self->vadjustment, MAX (0, value - removed * self->line_height));
+    }
+
+  self->begin = begin;
+  self->end = end;
+  self->n_dropped = n_dropped;
+
+  if (old_rows != gbp_build_log_view_get_n_rows (self) || self->follow)
+    gbp_build_log_view_update_adjustments (self);
+
+  gtk_widget_queue_draw (widget);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gbp_build_log_view_queue_update:
+ *
+ * Queues an update of the view to show the lines added to the log. Updates
+ * are coalesced, so this may be called for every line.
+ */
+void
+gbp_build_log_view_queue_update (GbpBuildLogView *self)
+{
+  g_return_if_fail (GBP_IS_BUILD_LOG_VIEW (self));
+
+  if (self->tick_handler == 0)
+    self->tick_handler =
+      gtk_widget_add_tick_callback (GTK_WIDGET (self), gbp_build_log_view_tick, NULL, NULL);
+}
+
+static gboolean
+gbp_build_log_view_draw_line (guint64            line,
+                              IdeBuildResultLog  log,
+                              const gchar       *text,
+                              gsize              len,
+                              gpointer           user_data)
+{
+  DrawState *state = user_data;
+  GbpBuildLogView *self = state->self;
+  gdouble y;
+  gint width;
+
+  y = state->first_row_y + (line - state->first_row_line) * self->line_height;
+
+  pango_layout_set_text (self->layout, text, len);
+  pango_layout_set_attributes (self->layout,
+                               log == IDE_BUILD_RESULT_LOG_STDERR ? self->stderr_attrs : NULL);
+
+  if (line >= state->sel_begin.line && line <= state->sel_end.line)
+    {
+      GtkStyleContext *style_context;
+      gint begin_index;
+      gint end_index;
+      gint *ranges = NULL;
+      gint n_ranges = 0;
+
+      begin_index = (line == state->sel_begin.line) ? state->sel_begin.index : 0;
+      end_index = (line == state->sel_end.line) ? state->sel_end.index : (gint)len;
+
+      pango_layout_line_get_x_ranges (pango_layout_get_line_readonly (self->layout, 0),
+                                      begin_index,
+                                      end_index,
+                                      &ranges,
+                                      &n_ranges);
+
+      style_context = gtk_widget_get_style_context (GTK_WIDGET (self));
+      gtk_style_context_save (style_context);
+      gtk_style_context_add_class (style_context, "view");
+      gtk_style_context_set_state (style_context, GTK_STATE_FLAG_SELECTED);
+
+      for (gint i = 0; i < n_ranges; i++)
+        gtk_render_background (style_context,
+                               state->cr,
+                               state->x + PANGO_PIXELS (ranges [i * 2]),
+                               y,
+                               PANGO_PIXELS (ranges [i * 2 + 1] - ranges [i * 2]),
+                               self->line_height);
+
+      /* Show that the newline is selected too */
+      if (line < state->sel_end.line)
+        {
+          pango_layout_get_pixel_size (self->layout, &width, NULL);
+          gtk_render_background (style_context,
+                                 state->cr,
+                                 state->x + width,
+                                 y,
+                                 self->line_height / 2,
+                                 self->line_height);
+        }
+
+      gtk_style_context_restore (style_context);
+
+      g_free (ranges);
+    }
+
+  cairo_move_to (state->cr, state->x, y);
+  pango_cairo_show_layout (state->cr, self->layout);
+
+  pango_layout_get_pixel_size (self->layout, &width, NULL);
+
+  if (width > self->max_width)
+    {
+      self->max_width = width;
+      gbp_build_log_view_queue_update (self);
+    }
+
+  return FALSE;
+}
+
+static gboolean
+gbp_build_log_view_collect_line (guint64            line,
+                                 IdeBuildResultLog  log,
+                                 const gchar       *text,
+                                 gsize              len,
+                                 gpointer           user_data)
+{
+  VisibleLines *visible = user_data;
+  VisibleLine item = { line, visible->text->len, len, log };
+
+  g_string_append_len (visible->text, text, len);
+  g_array_append_val (visible->lines, item);
+
+  return FALSE;
+}
+
+static gboolean
+gbp_build_log_view_draw (GtkWidget *widget,
+                         cairo_t   *cr)
+{
+  GbpBuildLogView *self = (GbpBuildLogView *)widget;
+  GtkStyleContext *style_context;
+  GtkAllocation alloc;
+  VisibleLines visible;
+  DrawState state;
+  GdkRGBA color;
+  gdouble hvalue;
+  gdouble vvalue;
+  guint64 first_row;
+  guint64 last_row;
+  guint64 n_rows;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  gtk_widget_get_allocation (widget, &alloc);
+
+  style_context = gtk_widget_get_style_context (widget);
+  gtk_render_background (style_context, cr, 0, 0, alloc.width, alloc.height);
+
+  if (self->log == NULL || self->line_height == 0)
+    return GDK_EVENT_PROPAGATE;
+
+  gtk_style_context_get_color (style_context, gtk_widget_get_state_flags (widget), &color);
+  gdk_cairo_set_source_rgba (cr, &color);
+
+  hvalue = self->hadjustment ? gtk_adjustment_get_value (self->hadjustment) : 0;
+  vvalue = self->vadjustment ? gtk_adjustment_get_value (self->vadjustment) : 0;
+
+  n_rows = gbp_build_log_view_get_n_rows (self);
+  first_row = MAX (0, vvalue - MARGIN) / self->line_height;
+  last_row = MIN (n_rows, (vvalue + alloc.height) / self->line_height + 1);
+
+  state.self = self;
+  state.cr = cr;
+  state.x = MARGIN - hvalue;
+  state.first_row_y = MARGIN + (gdouble)first_row * self->line_height - vvalue;
+  state.first_row_line = self->begin + first_row;
+
+  if (!gbp_build_log_view_get_selection_bounds (self, &state.sel_begin, &state.sel_end))
+    {
+      state.sel_begin.line = G_MAXUINT64;
+      state.sel_end.line = 0;
+    }
+
+  if (self->n_dropped > 0)
+    {
+      if (first_row == 0)
+        {
+          g_autofree gchar *text = NULL;
+
+          text = g_strdup_printf (ngettext ("%"G_GUINT64_FORMAT" earlier line was discarded",
+                                            "%"G_GUINT64_FORMAT" earlier lines were discarded",
+                                            self->n_dropped),
+                                  self->n_dropped);
+
+          pango_layout_set_text (self->layout, text, -1);
+          pango_layout_set_attributes (self->layout, self->dropped_attrs);
+          cairo_move_to (cr, state.x, state.first_row_y);
+          pango_cairo_show_layout (cr, self->layout);
+
+          first_row++;
+          state.first_row_y += self->line_height;
+        }
+
+      /* Lines are one row further down than their offset in the log */
+      state.first_row_line = self->begin + first_row - 1;
+      last_row--;
+    }
+
+  visible.text = g_string_new (NULL);
+  visible.lines = g_array_new (FALSE, FALSE, sizeof (VisibleLine));
+
+  ide_build_log_foreach (self->log,
+                         state.first_row_line,
+                         self->begin + last_row,
+                         gbp_build_log_view_collect_line,
+                         &visible);
+
+  for (guint i = 0; i < visible.lines->len; i++)
+    {
+      const VisibleLine *item = &g_array_index (visible.lines, VisibleLine, i);
+
+      gbp_build_log_view_draw_line (item->line,
+                                    item->log,
+                                    &visible.text->str [item->offset],
+                                    item->len,
+                                    &state);
+    }
+
+  g_string_free (visible.text, TRUE);
+  g_array_unref (visible.lines);
+
+  return GDK_EVENT_PROPAGATE;
+}
+
+static void
+gbp_build_log_view_size_allocate (GtkWidget     *widget,
+                                  GtkAllocation *alloc)
+{
+  GbpBuildLogView *self = (GbpBuildLogView *)widget;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  GTK_WIDGET_CLASS (gbp_build_log_view_parent_class)->size_allocate (widget, alloc);
+
+  gbp_build_log_view_update_adjustments (self);
+}
+
+/*
+ * Translates a point in widget coordinates to the nearest position in the
+ * log. Returns %FALSE if the log is empty.
+ */
+static gboolean
+gbp_build_log_view_get_position_at (GbpBuildLogView *self,
+                                    gdouble          x,
+                                    gdouble          y,
+                                    LogPosition     *pos)
+{
+  g_autofree gchar *text = NULL;
+  IdeBuildResultLog log = IDE_BUILD_RESULT_LOG_STDOUT;
+  gdouble hvalue;
+  gdouble vvalue;
+  gint64 row;
+  gint index = 0;
+  gint trailing = 0;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+  g_assert (pos != NULL);
+
+  if (self->log == NULL || self->end <= self->begin || self->line_height == 0)
+    return FALSE;
+
+  hvalue = self->hadjustment ? gtk_adjustment_get_value (self->hadjustment) : 0;
+  vvalue = self->vadjustment ? gtk_adjustment_get_value (self->vadjustment) : 0;
+
+  row = (gint64)((y + vvalue - MARGIN) / self->line_height);
+
+  /* The banner for discarded lines is not part of the log */
+  if (self->n_dropped > 0)
+    row--;
+
+  if (row < 0)
+    {
+      pos->line = self->begin;
+      pos->index = 0;
+      return TRUE;
+    }
+
+  if ((guint64)row >= self->end - self->begin)
+    {
+      pos->line = self->end - 1;
+      text = ide_build_log_get_line (self->log, pos->line, NULL);
+      pos->index = text ? strlen (text) : 0;
+      return TRUE;
+    }
+
+  pos->line = self->begin + row;
+
+  if (NULL == (text = ide_build_log_get_line (self->log, pos->line, &log)))
+    {
+      pos->index = 0;
+      return TRUE;
+    }
+
+  /* Measure the line the same way it is drawn */
+  pango_layout_set_text (self->layout, text, -1);
+  pango_layout_set_attributes (self->layout,
+                               log == IDE_BUILD_RESULT_LOG_STDERR ? self->stderr_attrs : NULL);
+  pango_layout_xy_to_index (self->layout,
+                            (x - MARGIN + hvalue) * PANGO_SCALE,
+                            0,
+                            &index,
+                            &trailing);
+
+  for (; trailing > 0 && text [index] != '\0'; trailing--)
+    index = g_utf8_next_char (&text [index]) - text;
+
+  pos->index = index;
+
+  return TRUE;
+}
+
+static gboolean
+gbp_build_log_view_copy_line (guint64            line,
+                              IdeBuildResultLog  log,
+                              const gchar       *text,
+                              gsize              len,
+                              gpointer           user_data)
+{
+  CopyState *state = user_data;
+  gsize begin = 0;
+  gsize end = len;
+
+  if (line == state->begin.line)
+    begin = MIN (len, (gsize)state->begin.index);
+
+  if (line == state->end.line)
+    end = MIN (len, (gsize)state->end.index);
+
+  if (end > begin)
+    g_string_append_len (state->str, text + begin, end - begin);
+
+  if (line < state->end.line)
+    g_string_append_c (state->str, '\n');
+
+  return FALSE;
+}
+
+static gchar *
+gbp_build_log_view_get_selected_text (GbpBuildLogView *self)
+{
+  CopyState state;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  if (!gbp_build_log_view_get_selection_bounds (self, &state.begin, &state.end))
+    return NULL;
+
+  state.str = g_string_new (NULL);
+
+  ide_build_log_foreach (self->log,
+                         state.begin.line,
+                         state.end.line + 1,
+                         gbp_build_log_view_copy_line,
+                         &state);
+
+  return g_string_free (state.str, FALSE);
+}
+
+static void
+gbp_build_log_view_copy_clipboard (GbpBuildLogView *self)
+{
+  g_autofree gchar *text = NULL;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  if (NULL != (text = gbp_build_log_view_get_selected_text (self)))
+    gtk_clipboard_set_text (gtk_widget_get_clipboard (GTK_WIDGET (self), GDK_SELECTION_CLIPBOARD),
+                            text,
+                            -1);
+}
+
+static void
+gbp_build_log_view_select_all (GbpBuildLogView *self)
+{
+  g_autofree gchar *text = NULL;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  if (self->log == NULL || self->end <= self->begin)
+    return;
+
+  text = ide_build_log_get_line (self->log, self->end - 1, NULL);
+
+  self->sel_anchor.line = self->begin;
+  self->sel_anchor.index = 0;
+  self->sel_cursor.line = self->end - 1;
+  self->sel_cursor.index = text ? strlen (text) : 0;
+  self->has_selection = TRUE;
+
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+static void
+gbp_build_log_view_select_line (GbpBuildLogView *self,
+                                guint64          line)
+{
+  g_autofree gchar *text = NULL;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  text = ide_build_log_get_line (self->log, line, NULL);
+
+  self->sel_anchor.line = line;
+  self->sel_anchor.index = 0;
+  self->sel_cursor.line = line;
+  self->sel_cursor.index = text ? strlen (text) : 0;
+  self->has_selection = (text != NULL && text [0] != '\0');
+}
+
+static gboolean
+gbp_build_log_view_button_press_event (GtkWidget      *widget,
+                                       GdkEventButton *event)
+{
+  GbpBuildLogView *self = (GbpBuildLogView *)widget;
+  LogPosition pos;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  if (!gtk_widget_has_focus (widget))
+    gtk_widget_grab_focus (widget);
+
+  if (event->button != GDK_BUTTON_PRIMARY)
+    return GDK_EVENT_PROPAGATE;
+
+  if (!gbp_build_log_view_get_position_at (self, event->x, event->y, &pos))
+    return GDK_EVENT_STOP;
+
+  if (event->type == GDK_2BUTTON_PRESS)
+    {
+      gbp_build_log_view_select_line (self, pos.line);
+      self->selecting = FALSE;
+    }
+  else if (event->type == GDK_BUTTON_PRESS)
+    {
+      if ((event->state & GDK_SHIFT_MASK) == 0 || !self->has_selection)
+        self->sel_anchor = pos;
+      self->sel_cursor = pos;
+      self->has_selection = TRUE;
+      self->selecting = TRUE;
+    }
+
+  gtk_widget_queue_draw (widget);
+
+  return GDK_EVENT_STOP;
+}
+
+static gboolean
+gbp_build_log_view_motion_notify_event (GtkWidget      *widget,
+                                        GdkEventMotion *event)
+{
+  GbpBuildLogView *self = (GbpBuildLogView *)widget;
+  LogPosition pos;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  if (!self->selecting)
+    return GDK_EVENT_PROPAGATE;
+
+  if (gbp_build_log_view_get_position_at (self, event->x, event->y, &pos) &&
+      log_position_compare (&pos, &self->sel_cursor) != 0)
+    {
+      self->sel_cursor = pos;
+      gtk_widget_queue_draw (widget);
+    }
+
+  return GDK_EVENT_STOP;
+}
+
+static gboolean
+gbp_build_log_view_button_release_event (GtkWidget      *widget,
+                                         GdkEventButton *event)
+{
+  GbpBuildLogView *self = (GbpBuildLogView *)widget;
+  g_autofree gchar *text = NULL;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  if (event->button != GDK_BUTTON_PRIMARY)
+    return GDK_EVENT_PROPAGATE;
+
+  self->selecting = FALSE;
+
+  if (log_position_compare (&self->sel_anchor, &self->sel_cursor) == 0)
+    {
+      self->has_selection = FALSE;
+      gtk_widget_queue_draw (widget);
+    }
+  else if (NULL != (text = gbp_build_log_view_get_selected_text (self)))
+    {
+      gtk_clipboard_set_text (gtk_widget_get_clipboard (widget, GDK_SELECTION_PRIMARY),
+                              text,
+                              -1);
+    }
+
+  return GDK_EVENT_STOP;
+}
+
+static void
+gbp_build_log_view_style_updated (GtkWidget *widget)
+{
+  GbpBuildLogView *self = (GbpBuildLogView *)widget;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+
+  GTK_WIDGET_CLASS (gbp_build_log_view_parent_class)->style_updated (widget);
+
+  /* The font may have changed, so measure the lines again */
+  pango_layout_context_changed (self->layout);
+  pango_layout_set_attributes (self->layout, NULL);
+  pango_layout_set_text (self->layout, "Xg", -1);
+  pango_layout_get_pixel_size (self->layout, NULL, &self->line_height);
+
+  self->line_height = MAX (1, self->line_height);
+  self->max_width = 0;
+
+  gbp_build_log_view_update_adjustments (self);
+  gtk_widget_queue_draw (widget);
+}
+
+static void
+gbp_build_log_view_vadjustment_value_changed (GbpBuildLogView *self,
+                                              GtkAdjustment   *adjustment)
+{
+  gdouble value;
+  gdouble upper;
+  gdouble page_size;
+
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+  g_assert (GTK_IS_ADJUSTMENT (adjustment));
+
+  value = gtk_adjustment_get_value (adjustment);
+  upper = gtk_adjustment_get_upper (adjustment);
+  page_size = gtk_adjustment_get_page_size (adjustment);
+
+  /* Follow new lines only while scrolled to the end */
+  self->follow = (value + page_size >= upper - self->line_height / 2);
+
+  gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+static void
+gbp_build_log_view_set_adjustment (GbpBuildLogView  *self,
+                                   GtkAdjustment   **ptr,
+                                   GtkAdjustment    *adjustment,
+                                   GCallback         value_changed)
+{
+  g_assert (GBP_IS_BUILD_LOG_VIEW (self));
+  g_assert (ptr != NULL);
+  g_assert (!adjustment || GTK_IS_ADJUSTMENT (adjustment));
+
+  if (adjustment != NULL && adjustment == *ptr)
+    return;
+
+  if (*ptr != NULL)
+    {
+      g_signal_handlers_disconnect_by_data (*ptr, self);
+      g_clear_object (ptr);
+    }
+
+  if (adjustment == NULL)
+    adjustment = gtk_adjustment_new (0, 0, 0, 0, 0, 0);
+
+  *ptr = g_object_ref_sink (adjustment);
+
+  g_signal_connect_object (adjustment,
+                           "value-changed",
+                           value_changed,
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  gbp_build_log_view_update_adjustments (self);
+}
+
+IdeBuildLog *
+gbp_build_log_view_get_log (GbpBuildLogView *self)
+{
+  g_return_val_if_fail (GBP_IS_BUILD_LOG_VIEW (self), NULL);
+
+  return self->log;
+}
+
+void
+gbp_build_log_view_set_log (GbpBuildLogView *self,
+                            IdeBuildLog     *log)
+{
+  g_return_if_fail (GBP_IS_BUILD_LOG_VIEW (self));
+
+  if (log != self->log)
+    {
+      g_clear_pointer (&self->log, ide_build_log_unref);
+
+      if (log != NULL)
+        self->log = ide_build_log_ref (log);
+
+      self->begin = 0;
+      self->end = 0;
+      self->n_dropped = 0;
+      self->max_width = 0;
+      self->follow = TRUE;
+      self->has_selection = FALSE;
+      self->selecting = FALSE;
+
+      gbp_build_log_view_queue_update (self);
+
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_LOG]);
+    }
+}
+
+GtkWidget *
+gbp_build_log_view_new (void)
+{
+  return g_object_new (GBP_TYPE_BUILD_LOG_VIEW, NULL);
+}
+
+static void
+gbp_build_log_view_finalize (GObject *object)
+{
+  GbpBuildLogView *self = (GbpBuildLogView *)object;
+
+  g_clear_pointer (&self->log, ide_build_log_unref);
+  g_clear_pointer (&self->stderr_attrs, pango_attr_list_unref);
+  g_clear_pointer (&self->dropped_attrs, pango_attr_list_unref);
+  g_clear_object (&self->layout);
+  g_clear_object (&self->hadjustment);
+  g_clear_object (&self->vadjustment);
+
+  G_OBJECT_CLASS (gbp_build_log_view_parent_class)->finalize (object);
+}
+
+static void
+gbp_build_log_view_dispose (GObject *object)
+{
+  GbpBuildLogView *self = (GbpBuildLogView *)object;
+
+  if (self->tick_handler != 0)
+    {
+      gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->tick_handler);
+      self->tick_handler = 0;
+    }
+
+  G_OBJECT_CLASS (gbp_build_log_view_parent_class)->dispose (object);
+}
+
+static void
+gbp_build_log_view_get_property (GObject    *object,
+                                 guint       prop_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  GbpBuildLogView *self = GBP_BUILD_LOG_VIEW (object);
+
+  switch (prop_id)
+    {
+    case PROP_LOG:
+      g_value_set_boxed (value, self->log);
+      break;
+
+    case PROP_HADJUSTMENT:
+      g_value_set_object (value, self->hadjustment);
+      break;
+
+    case PROP_VADJUSTMENT:
+      g_value_set_object (value, self->vadjustment);
+      break;
+
+    case PROP_HSCROLL_POLICY:
+      g_value_set_enum (value, self->hscroll_policy);
+      break;
+
+    case PROP_VSCROLL_POLICY:
+      g_value_set_enum (value, self->vscroll_policy);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+gbp_build_log_view_set_property (GObject      *object,
+                                 guint         prop_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  GbpBuildLogView *self = GBP_BUILD_LOG_VIEW (object);
+
+  switch (prop_id)
+    {
+    case PROP_LOG:
+      gbp_build_log_view_set_log (self, g_value_get_boxed (value));
+      break;
+
+    case PROP_HADJUSTMENT:
+      gbp_build_log_view_set_adjustment (self,
+                                         &self->hadjustment,
+                                         g_value_get_object (value),
+                                         G_CALLBACK (gtk_widget_queue_draw));
+      break;
+
+    case PROP_VADJUSTMENT:
+      gbp_build_log_view_set_adjustment (self,
+                                         &self->vadjustment,
+                                         g_value_get_object (value),
+                                         G_CALLBACK (gbp_build_log_view_vadjustment_value_changed));
+      break;
+
+    case PROP_HSCROLL_POLICY:
+      self->hscroll_policy = g_value_get_enum (value);
+      gtk_widget_queue_resize (GTK_WIDGET (self));
+      break;
+
+    case PROP_VSCROLL_POLICY:
+      self->vscroll_policy = g_value_get_enum (value);
+      gtk_widget_queue_resize (GTK_WIDGET (self));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+gbp_build_log_view_class_init (GbpBuildLogViewClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+  GtkBindingSet *binding_set;
+
+  object_class->dispose = gbp_build_log_view_dispose;
+  object_class->finalize = gbp_build_log_view_finalize;
+  object_class->get_property = gbp_build_log_view_get_property;
+  object_class->set_property = gbp_build_log_view_set_property;
+
+  widget_class->button_press_event = gbp_build_log_view_button_press_event;
+  widget_class->button_release_event = gbp_build_log_view_button_release_event;
+  widget_class->draw = gbp_build_log_view_draw;
+  widget_class->motion_notify_event = gbp_build_log_view_motion_notify_event;
+  widget_class->size_allocate = gbp_build_log_view_size_allocate;
+  widget_class->style_updated = gbp_build_log_view_style_updated;
+
+  gtk_widget_class_set_css_name (widget_class, "buildlogview");
+
+  properties [PROP_LOG] =
+    g_param_spec_boxed ("log",
+                        "Log",
+                        "The build log to display",
+                        IDE_TYPE_BUILD_LOG,
+                        (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, LAST_PROP, properties);
+
+  g_object_class_override_property (object_class, PROP_HADJUSTMENT, "hadjustment");
+  g_object_class_override_property (object_class, PROP_VADJUSTMENT, "vadjustment");
+  g_object_class_override_property (object_class, PROP_HSCROLL_POLICY, "hscroll-policy");
+  g_object_class_override_property (object_class, PROP_VSCROLL_POLICY, "vscroll-policy");
+
+  signals [COPY_CLIPBOARD] =
+    g_signal_new_class_handler ("copy-clipboard",
+                                G_TYPE_FROM_CLASS (klass),
+                                G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                                G_CALLBACK (gbp_build_log_view_copy_clipboard),
+                                NULL, NULL, NULL,
+                                G_TYPE_NONE, 0);
+
+  signals [SELECT_ALL] =
+    g_signal_new_class_handler ("select-all",
+                                G_TYPE_FROM_CLASS (klass),
+                                G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                                G_CALLBACK (gbp_build_log_view_select_all),
+                                NULL, NULL, NULL,
+                                G_TYPE_NONE, 0);
+
+  binding_set = gtk_binding_set_by_class (klass);
+
+  gtk_binding_entry_add_signal (binding_set, GDK_KEY_c, GDK_CONTROL_MASK, "copy-clipboard", 0);
+  gtk_binding_entry_add_signal (binding_set, GDK_KEY_Insert, GDK_CONTROL_MASK, "copy-clipboard", 0);
+  gtk_binding_entry_add_signal (binding_set, GDK_KEY_a, GDK_CONTROL_MASK, "select-all", 0);
+}
+
+static void
+gbp_build_log_view_init (GbpBuildLogView *self)
+{
+  PangoAttribute *attr;
+
+  self->follow = TRUE;
+
+  gtk_widget_set_can_focus (GTK_WIDGET (self), TRUE);
+  gtk_widget_add_events (GTK_WIDGET (self),
+                         (GDK_BUTTON_PRESS_MASK |
+                          GDK_BUTTON_RELEASE_MASK |
+                          GDK_BUTTON1_MOTION_MASK));
+
+  self->layout = gtk_widget_create_pango_layout (GTK_WIDGET (self), NULL);
+
+  self->stderr_attrs = pango_attr_list_new ();
+  attr = pango_attr_foreground_new (0xffff, 0, 0);
+  pango_attr_list_insert (self->stderr_attrs, attr);
+  attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
+  pango_attr_list_insert (self->stderr_attrs, attr);
+
+  self->dropped_attrs = pango_attr_list_new ();
+  attr = pango_attr_style_new (PANGO_STYLE_ITALIC);
+  pango_attr_list_insert (self->dropped_attrs, attr);
+
+  gbp_build_log_view_set_adjustment (self,
+                                     &self->hadjustment,
+                                     NULL,
+                                     G_CALLBACK (gtk_widget_queue_draw));
+  gbp_build_log_view_set_adjustment (self,
+                                     &self->vadjustment,
+                                     NULL,
+                                     G_CALLBACK (gbp_build_log_view_vadjustment_value_changed));
+}
@@ -30,6 +30,9 @@
 #include "ide-clang-symbol-resolver.h"
 #include "ide-clang-symbol-tree.h"
 #include "ide-clang-translation-unit.h"
+#include "ide-clang-worker.h"
+
+#include "workers/ide-worker.h"
 
 void
 peas_register_types (PeasObjectModule *module)
@@ -52,4 +55,7 @@ peas_register_types (PeasObjectModule *module)
   peas_object_module_register_extension_type (module,
                                               IDE_TYPE_PREFERENCES_ADDIN,
                                               IDE_TYPE_CLANG_PREFERENCES_ADDIN);
+  peas_object_module_register_extension_type (module,
+                                              IDE_TYPE_WORKER,
+                                              IDE_TYPE_CLANG_WORKER);
 }
@@ -642,6 +642,14 @@ ide_clang_completion_provider_populate (GtkSourceCompletionProvider *provider,
       IDE_EXIT;
     }
 
+  /*
+   * Unlike diagnostics, completion is not routed through the worker
+   * processes. The results are filtered and rendered lazily from the
+   * CXCodeCompleteResults as the user types, which would otherwise require
+   * serializing every result (and its chunks) across the process boundary
+   * for each keystroke. The translation unit of the focused buffer is pinned
+   * by the service, so it is usually already parsed when we get here.
+   */
   ide_clang_service_get_translation_unit_async (service,
                                                 state->file,
                                                 0,
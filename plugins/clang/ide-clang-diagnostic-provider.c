@@ -44,37 +44,19 @@ G_DEFINE_TYPE_EXTENDED (IdeClangDiagnosticProvider,
                                                diagnostic_provider_iface_init))
 
 static void
-get_translation_unit_cb (GObject      *object,
-                         GAsyncResult *result,
-                         gpointer      user_data)
+diagnose_cb (GObject      *object,
+             GAsyncResult *result,
+             gpointer      user_data)
 {
   IdeClangService *service = (IdeClangService *)object;
-  g_autoptr(IdeClangTranslationUnit) tu = NULL;
   g_autoptr(GTask) task = user_data;
   IdeDiagnostics *diagnostics;
-  IdeFile *target;
-  GFile *gfile;
   GError *error = NULL;
 
-  tu = ide_clang_service_get_translation_unit_finish (service, result, &error);
-
-  if (!tu)
-    {
-      g_task_return_error (task, error);
-      return;
-    }
-
-  target = g_task_get_task_data (task);
-  g_assert (IDE_IS_FILE (target));
-
-  gfile = ide_file_get_file (target);
-  g_assert (G_IS_FILE (gfile));
-
-  diagnostics = ide_clang_translation_unit_get_diagnostics_for_file (tu, gfile);
-
-  g_task_return_pointer (task,
-                         ide_diagnostics_ref (diagnostics),
-                         (GDestroyNotify)ide_diagnostics_unref);
+  if (!(diagnostics = ide_clang_service_diagnose_finish (service, result, &error)))
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, diagnostics, (GDestroyNotify)ide_diagnostics_unref);
 }
 
 static gboolean
@@ -98,6 +80,7 @@ ide_clang_diagnostic_provider_diagnose__file_find_other_cb (GObject      *object
                                                             gpointer      user_data)
 {
   IdeFile *file = (IdeFile *)object;
+  IdeFile *target = (IdeFile *)object;
   g_autoptr(IdeFile) other = NULL;
   g_autoptr(GTask) task = user_data;
   IdeClangService *service;
@@ -113,12 +96,12 @@ ide_clang_diagnostic_provider_diagnose__file_find_other_cb (GObject      *object
   context = ide_object_get_context (IDE_OBJECT (file));
   service = ide_context_get_service_typed (context, IDE_TYPE_CLANG_SERVICE);
 
-  ide_clang_service_get_translation_unit_async (service,
-                                                file,
-                                                0,
-                                                g_task_get_cancellable (task),
-                                                get_translation_unit_cb,
-                                                g_object_ref (task));
+  ide_clang_service_diagnose_async (service,
+                                    file,
+                                    target,
+                                    g_task_get_cancellable (task),
+                                    diagnose_cb,
+                                    g_object_ref (task));
 }
 
 static void
@@ -134,7 +117,6 @@ ide_clang_diagnostic_provider_diagnose_async (IdeDiagnosticProvider *provider,
   g_return_if_fail (IDE_IS_CLANG_DIAGNOSTIC_PROVIDER (self));
 
   task = g_task_new (self, cancellable, callback, user_data);
-  g_task_set_task_data (task, g_object_ref (file), g_object_unref);
 
   if (is_header (file))
     {
@@ -151,12 +133,12 @@ ide_clang_diagnostic_provider_diagnose_async (IdeDiagnosticProvider *provider,
       context = ide_object_get_context (IDE_OBJECT (provider));
       service = ide_context_get_service_typed (context, IDE_TYPE_CLANG_SERVICE);
 
-      ide_clang_service_get_translation_unit_async (service,
-                                                    file,
-                                                    0,
-                                                    cancellable,
-                                                    get_translation_unit_cb,
-                                                    g_object_ref (task));
+      ide_clang_service_diagnose_async (service,
+                                        file,
+                                        file,
+                                        cancellable,
+                                        diagnose_cb,
+                                        g_object_ref (task));
     }
 }
 
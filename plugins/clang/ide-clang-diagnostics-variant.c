@@ -0,0 +1,203 @@
+/* ide-clang-diagnostics-variant.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-clang-diagnostics-variant"
+
+#include "ide-clang-diagnostics-variant.h"
+#include "ide-internal.h"
+
+/*
+ * This is the wire format of the diagnostics produced by the clang worker
+ * processes (see ide-clang-worker.c). It does not depend on libclang, so
+ * that it may be used (and tested) without a translation unit.
+ */
+
+static IdeSourceRange *
+create_range (IdeFile *file,
+              guint    begin_line,
+              guint    begin_column,
+              guint    end_line,
+              guint    end_column)
+{
+  g_autoptr(IdeSourceLocation) begin = NULL;
+  g_autoptr(IdeSourceLocation) end = NULL;
+
+  begin = ide_source_location_new (file, begin_line, begin_column, 0);
+  end = ide_source_location_new (file, end_line, end_column, 0);
+
+  return ide_source_range_new (begin, end);
+}
+
+static void
+get_range (IdeSourceRange *range,
+           guint          *begin_line,
+           guint          *begin_column,
+           guint          *end_line,
+           guint          *end_column)
+{
+  IdeSourceLocation *begin = ide_source_range_get_begin (range);
+  IdeSourceLocation *end = ide_source_range_get_end (range);
+
+  *begin_line = ide_source_location_get_line (begin);
+  *begin_column = ide_source_location_get_line_offset (begin);
+  *end_line = ide_source_location_get_line (end);
+  *end_column = ide_source_location_get_line_offset (end);
+}
+
+/**
+ * ide_clang_diagnostics_to_variant:
+ * @diagnostics: An #IdeDiagnostics
+ *
+ * Encodes @diagnostics in the format used by the clang workers. The files
+ * of the locations are not encoded, see
+ * ide_clang_diagnostics_new_from_variant().
+ *
+ * Returns: (transfer full): A new floating #GVariant.
+ */
+GVariant *
+ide_clang_diagnostics_to_variant (IdeDiagnostics *diagnostics)
+{
+  GVariantBuilder builder;
+  gsize size;
+  gsize i;
+
+  g_return_val_if_fail (diagnostics != NULL, NULL);
+
+  g_variant_builder_init (&builder, IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE);
+
+  size = ide_diagnostics_get_size (diagnostics);
+
+  for (i = 0; i < size; i++)
+    {
+      IdeDiagnostic *diag = ide_diagnostics_index (diagnostics, i);
+      IdeSourceLocation *location = ide_diagnostic_get_location (diag);
+      GVariantBuilder ranges;
+      GVariantBuilder fixits;
+      guint begin_line;
+      guint begin_column;
+      guint end_line;
+      guint end_column;
+      guint n;
+      guint j;
+
+      g_variant_builder_init (&ranges, G_VARIANT_TYPE ("a(uuuu)"));
+
+      n = ide_diagnostic_get_num_ranges (diag);
+
+      for (j = 0; j < n; j++)
+        {
+          get_range (ide_diagnostic_get_range (diag, j),
+                     &begin_line, &begin_column, &end_line, &end_column);
+          g_variant_builder_add (&ranges, "(uuuu)",
+                                 begin_line, begin_column, end_line, end_column);
+        }
+
+      g_variant_builder_init (&fixits, G_VARIANT_TYPE ("a(uuuus)"));
+
+      n = ide_diagnostic_get_num_fixits (diag);
+
+      for (j = 0; j < n; j++)
+        {
+          IdeFixit *fixit = ide_diagnostic_get_fixit (diag, j);
+
+          get_range (ide_fixit_get_range (fixit),
+                     &begin_line, &begin_column, &end_line, &end_column);
+          g_variant_builder_add (&fixits, "(uuuus)",
+                                 begin_line, begin_column, end_line, end_column,
+                                 ide_fixit_get_text (fixit) ?: "");
+        }
+
+      g_variant_builder_add (&builder, "(us(uuu)a(uuuu)a(uuuus))",
+                             ide_diagnostic_get_severity (diag),
+                             ide_diagnostic_get_text (diag) ?: "",
+                             location ? ide_source_location_get_line (location) : 0,
+                             location ? ide_source_location_get_line_offset (location) : 0,
+                             location ? ide_source_location_get_offset (location) : 0,
+                             &ranges,
+                             &fixits);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * ide_clang_diagnostics_new_from_variant:
+ * @target: the file the diagnostics were requested for
+ * @variant: A #GVariant created by a clang worker or with
+ *   ide_clang_diagnostics_to_variant()
+ *
+ * Decodes the diagnostics in @variant, placing all of their locations
+ * in @target.
+ *
+ * Returns: (transfer full): An #IdeDiagnostics.
+ */
+IdeDiagnostics *
+ide_clang_diagnostics_new_from_variant (IdeFile  *target,
+                                        GVariant *variant)
+{
+  GPtrArray *ar;
+  GVariantIter iter;
+  GVariantIter *ranges;
+  GVariantIter *fixits;
+  const gchar *text;
+  guint severity;
+  guint line;
+  guint column;
+  guint offset;
+
+  g_return_val_if_fail (IDE_IS_FILE (target), NULL);
+  g_return_val_if_fail (variant != NULL, NULL);
+  g_return_val_if_fail (g_variant_is_of_type (variant, IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE), NULL);
+
+  ar = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_diagnostic_unref);
+
+  g_variant_iter_init (&iter, variant);
+
+  while (g_variant_iter_next (&iter, "(u&s(uuu)a(uuuu)a(uuuus))",
+                              &severity, &text, &line, &column, &offset, &ranges, &fixits))
+    {
+      g_autoptr(IdeSourceLocation) location = NULL;
+      IdeDiagnostic *diag;
+      const gchar *fixit_text;
+      guint begin_line;
+      guint begin_column;
+      guint end_line;
+      guint end_column;
+
+      location = ide_source_location_new (target, line, column, offset);
+      diag = ide_diagnostic_new (severity, text, location);
+
+      while (g_variant_iter_next (ranges, "(uuuu)", &begin_line, &begin_column, &end_line, &end_column))
+        ide_diagnostic_take_range (diag, create_range (target, begin_line, begin_column, end_line, end_column));
+
+      while (g_variant_iter_next (fixits, "(uuuu&s)", &begin_line, &begin_column, &end_line, &end_column, &fixit_text))
+        {
+          g_autoptr(IdeSourceRange) range = NULL;
+
+          range = create_range (target, begin_line, begin_column, end_line, end_column);
+          ide_diagnostic_take_fixit (diag, _ide_fixit_new (range, fixit_text));
+        }
+
+      g_variant_iter_free (ranges);
+      g_variant_iter_free (fixits);
+
+      g_ptr_array_add (ar, diag);
+    }
+
+  return ide_diagnostics_new (ar);
+}
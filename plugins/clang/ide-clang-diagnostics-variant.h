@@ -0,0 +1,41 @@
+/* ide-clang-diagnostics-variant.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_CLANG_DIAGNOSTICS_VARIANT_H
+#define IDE_CLANG_DIAGNOSTICS_VARIANT_H
+
+#include <ide.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Each diagnostic is encoded as its severity, text, location (line, column
+ * and offset), ranges and fixits. Ranges are the begin and end line and
+ * column, fixits are a range followed by the replacement text. All of the
+ * locations refer to the file the diagnostics were requested for.
+ */
+#define IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE_STRING "a(us(uuu)a(uuuu)a(uuuus))"
+#define IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE        G_VARIANT_TYPE (IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE_STRING)
+
+GVariant       *ide_clang_diagnostics_to_variant       (IdeDiagnostics *diagnostics);
+IdeDiagnostics *ide_clang_diagnostics_new_from_variant (IdeFile        *target,
+                                                        GVariant       *variant);
+
+G_END_DECLS
+
+#endif /* IDE_CLANG_DIAGNOSTICS_VARIANT_H */
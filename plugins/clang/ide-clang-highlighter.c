@@ -63,20 +63,20 @@ select_next_word (GtkTextIter *begin,
 }
 
 static void
-get_unit_cb (GObject      *object,
+diagnose_cb (GObject      *object,
              GAsyncResult *result,
              gpointer      user_data)
 {
   IdeClangService *service = (IdeClangService *)object;
   g_autoptr(IdeClangHighlighter) self = user_data;
-  g_autoptr(IdeClangTranslationUnit) unit = NULL;
+  g_autoptr(IdeDiagnostics) diagnostics = NULL;
 
   g_assert (IDE_IS_CLANG_SERVICE (service));
   g_assert (IDE_IS_CLANG_HIGHLIGHTER (self));
 
   self->waiting_for_unit = FALSE;
 
-  if (!(unit = ide_clang_service_get_translation_unit_finish (service, result, NULL)))
+  if (!(diagnostics = ide_clang_service_diagnose_finish (service, result, NULL)))
     return;
 
   if (self->engine != NULL)
@@ -90,11 +90,10 @@ ide_clang_highlighter_real_update (IdeHighlighter       *highlighter,
                                    const GtkTextIter    *range_end,
                                    GtkTextIter          *location)
 {
-  g_autoptr(IdeClangTranslationUnit) unit = NULL;
+  g_autoptr(IdeHighlightIndex) index = NULL;
   IdeClangHighlighter *self = (IdeClangHighlighter *)highlighter;
   GtkTextBuffer *text_buffer;
   GtkSourceBuffer *source_buffer;
-  IdeHighlightIndex *index;
   IdeContext *context;
   IdeClangService *service = NULL;
   IdeBuffer *buffer;
@@ -117,25 +116,26 @@ ide_clang_highlighter_real_update (IdeHighlighter       *highlighter,
       !(service = ide_context_get_service_typed (context, IDE_TYPE_CLANG_SERVICE)))
     return;
 
-  if (!(unit = ide_clang_service_get_cached_translation_unit (service, file)))
+  /*
+   * The index is updated as a side effect of diagnosing the file, which
+   * happens in a worker process. Request that if we do not have one yet.
+   */
+  if (!(index = ide_clang_service_get_cached_index (service, file)))
     {
       if (!self->waiting_for_unit)
         {
           self->waiting_for_unit = TRUE;
-          ide_clang_service_get_translation_unit_async (service,
-                                                        file,
-                                                        0,
-                                                        NULL,
-                                                        get_unit_cb,
-                                                        g_object_ref (self));
+          ide_clang_service_diagnose_async (service,
+                                            file,
+                                            file,
+                                            NULL,
+                                            diagnose_cb,
+                                            g_object_ref (self));
         }
 
       return;
     }
 
-  if (!(index = ide_clang_translation_unit_get_index (unit)))
-    return;
-
   begin = end = *location = *range_begin;
 
   while (gtk_text_iter_compare (&begin, range_end) < 0)
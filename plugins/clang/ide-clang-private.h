@@ -33,13 +33,36 @@ IdeClangTranslationUnit *_ide_clang_translation_unit_new     (IdeContext
                                                               GFile              *file,
                                                               IdeHighlightIndex  *index,
                                                               gint64              serial);
+gboolean                 _ide_clang_translation_unit_is_uncontended
+                                                             (IdeClangTranslationUnit *self);
 void                     _ide_clang_dispose_string           (CXString           *str);
-IdeSymbolNode           *_ide_clang_symbol_node_new          (IdeContext         *context,
-                                                              CXCursor            cursor);
-CXCursor                 _ide_clang_symbol_node_get_cursor   (IdeClangSymbolNode *self);
-GArray                  *_ide_clang_symbol_node_get_children (IdeClangSymbolNode *self);
-void                     _ide_clang_symbol_node_set_children (IdeClangSymbolNode *self,
-                                                              GArray             *children);
+void                     _ide_clang_release_native           (CXTranslationUnit   tu);
+IdeHighlightIndex       *_ide_clang_build_index              (CXTranslationUnit   tu,
+                                                              const gchar        *filename);
+IdeDiagnosticSeverity    _ide_clang_translate_severity       (enum CXDiagnosticSeverity severity);
+gboolean                 _ide_clang_strv_equal               (const gchar * const *a,
+                                                              const gchar * const *b);
+IdeClangSymbolNode      *_ide_clang_symbol_node_new          (IdeContext         *context,
+                                                              GFile              *file,
+                                                              const gchar        *name,
+                                                              IdeSymbolKind       kind,
+                                                              IdeSymbolFlags      flags,
+                                                              guint               line,
+                                                              guint               line_offset);
+GPtrArray               *_ide_clang_symbol_node_get_children (IdeClangSymbolNode *self);
+void                     _ide_clang_symbol_node_add_child    (IdeClangSymbolNode *self,
+                                                              IdeClangSymbolNode *child);
+GVariant                *_ide_clang_build_symbol_tree        (CXTranslationUnit   tu,
+                                                              const gchar        *path);
+IdeSymbolTree           *_ide_clang_symbol_tree_new          (IdeContext         *context,
+                                                              GFile              *file,
+                                                              GVariant           *nodes);
+GVariant                *_ide_clang_lookup_symbol            (CXTranslationUnit   tu,
+                                                              const gchar        *path,
+                                                              guint               line,
+                                                              guint               line_offset);
+IdeSymbol               *_ide_clang_symbol_new_from_variant  (IdeContext         *context,
+                                                              GVariant           *variant);
 
 G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (CXString, _ide_clang_dispose_string)
 
@@ -21,33 +21,78 @@
 #include <clang-c/Index.h>
 #include <egg-counter.h>
 #include <egg-task-cache.h>
+#include <gio/gunixfdlist.h>
 #include <glib/gi18n.h>
 #include <ide.h>
 
+#include "ide-clang-diagnostics-variant.h"
 #include "ide-clang-highlighter.h"
 #include "ide-clang-private.h"
 #include "ide-clang-service.h"
+#include "ide-clang-unit-pool.h"
+#include "ide-clang-worker.h"
+#include "ide-internal.h"
 
 #define DEFAULT_EVICTION_MSEC (60 * 1000)
-
+#define MAX_SPARE_UNITS       4
+
+/*
+ * Parsing a translation unit from scratch means parsing every header it
+ * includes, which for GTK+ based code can take seconds. Instead, when the
+ * last reference to a native translation unit is dropped (by the
+ * IdeClangTranslationUnit, completion results, etc) it is released into a
+ * pool and reparsed in place the next time that file is requested. Since the
+ * units are created with CXTranslationUnit_PrecompiledPreamble, clang only
+ * needs to reparse the main file unless one of the headers has changed.
+ *
+ * When a file is parsed again and nothing but the cache holds its current
+ * unit, that unit is evicted so it can be reparsed. A second unit is only
+ * created while a consumer still holds the current one.
+ */
 struct _IdeClangService
 {
-  IdeObject     parent_instance;
+  IdeObject         parent_instance;
+
+  CXIndex           index;
+  GCancellable     *cancellable;
+  EggTaskCache     *units_cache;
+  IdeClangUnitPool *pool;
 
-  CXIndex       index;
-  GCancellable *cancellable;
-  EggTaskCache *units_cache;
+  /* The file of the focused buffer, pinned within both caches */
+  IdeFile          *pinned_file;
+
+  /*
+   * Highlight indexes received from the worker processes. They are
+   * evicted with the same time-to-live and budget as units_cache.
+   */
+  EggTaskCache     *indexes;
 };
 
 typedef struct
 {
-  IdeFile    *file;
-  CXIndex     index;
-  gchar      *source_filename;
-  gchar     **command_line_args;
-  GPtrArray  *unsaved_files;
-  gint64      sequence;
-  guint       options;
+  IdeFile   *file;
+  gchar     *path;
+  gchar     *method;
+  GVariant  *params;
+  gchar    **argv;
+} WorkerCall;
+
+typedef struct
+{
+  IdeFile  *file;
+  IdeFile  *target;
+} DiagnoseState;
+
+typedef struct
+{
+  IdeFile           *file;
+  CXIndex            index;
+  IdeClangUnitPool  *pool;
+  gchar             *source_filename;
+  gchar            **command_line_args;
+  GPtrArray         *unsaved_files;
+  gint64             sequence;
+  guint              options;
 } ParseRequest;
 
 typedef struct
@@ -67,6 +112,108 @@ EGG_DEFINE_COUNTER (ParseAttempts,
                     "Total Parse Attempts",
                     "Total number of attempts to create a translation unit.")
 
+EGG_DEFINE_COUNTER (ReparseAttempts,
+                    "Clang",
+                    "Total Reparse Attempts",
+                    "Total number of attempts to reparse an existing translation unit.")
+
+/* Maps CXTranslationUnit to the IdeClangUnit it was created for */
+G_LOCK_DEFINE_STATIC (live_units);
+static GHashTable *live_units;
+
+gboolean
+_ide_clang_strv_equal (const gchar * const *a,
+                       const gchar * const *b)
+{
+  guint i;
+
+  for (i = 0; a [i] != NULL && b [i] != NULL; i++)
+    {
+      if (!g_str_equal (a [i], b [i]))
+        return FALSE;
+    }
+
+  return a [i] == b [i];
+}
+
+/*
+ * Counts the unsaved files that were modified, added, or removed since the
+ * unit was last parsed.
+ */
+static guint
+count_changed_files (GHashTable *before,
+                     GHashTable *after)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  guint changed = 0;
+
+  g_hash_table_iter_init (&iter, after);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      gint64 *seq = g_hash_table_lookup (before, key);
+
+      if (seq == NULL || *seq != *(gint64 *)value)
+        changed++;
+    }
+
+  g_hash_table_iter_init (&iter, before);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (!g_hash_table_contains (after, key))
+        changed++;
+    }
+
+  return changed;
+}
+
+/**
+ * _ide_clang_release_native:
+ * @tu: a #CXTranslationUnit
+ *
+ * Releases the native translation unit once nothing references it anymore.
+ * If it was created by #IdeClangService, it is kept so that it can be
+ * reparsed the next time the file is requested. Otherwise it is disposed.
+ */
+void
+_ide_clang_release_native (CXTranslationUnit tu)
+{
+  IdeClangUnit *unit = NULL;
+
+  if (tu == NULL)
+    return;
+
+  G_LOCK (live_units);
+  if (live_units != NULL)
+    {
+      unit = g_hash_table_lookup (live_units, tu);
+      g_hash_table_remove (live_units, tu);
+    }
+  G_UNLOCK (live_units);
+
+  if (unit == NULL)
+    {
+      clang_disposeTranslationUnit (tu);
+      return;
+    }
+
+  ide_clang_unit_pool_release (unit->pool, unit);
+}
+
+static void
+register_native (IdeClangUnit *unit)
+{
+  g_assert (unit != NULL);
+  g_assert (unit->tu != NULL);
+
+  G_LOCK (live_units);
+  if (live_units == NULL)
+    live_units = g_hash_table_new (NULL, NULL);
+  g_hash_table_insert (live_units, unit->tu, unit);
+  G_UNLOCK (live_units);
+}
+
 static void
 parse_request_free (gpointer data)
 {
@@ -75,6 +222,7 @@ parse_request_free (gpointer data)
   g_free (request->source_filename);
   g_strfreev (request->command_line_args);
   g_ptr_array_unref (request->unsaved_files);
+  g_clear_pointer (&request->pool, ide_clang_unit_pool_unref);
   g_clear_object (&request->file);
   g_slice_free (ParseRequest, request);
 }
@@ -138,10 +286,13 @@ ide_clang_service_build_index_visitor (CXCursor     cursor,
   return CXChildVisit_Continue;
 }
 
-static IdeHighlightIndex *
-ide_clang_service_build_index (IdeClangService   *self,
-                               CXTranslationUnit  tu,
-                               ParseRequest      *request)
+/*
+ * Builds the highlight index for @filename, the main file of @tu. This is
+ * shared with the worker process, which sends the index back serialized.
+ */
+IdeHighlightIndex *
+_ide_clang_build_index (CXTranslationUnit  tu,
+                        const gchar       *filename)
 {
   static const gchar *common_defines[] = {
     "NULL", "MIN", "MAX", "__LINE__", "__FILE__", NULL
@@ -152,11 +303,10 @@ ide_clang_service_build_index (IdeClangService   *self,
   CXFile file;
   gsize i;
 
-  g_assert (IDE_IS_CLANG_SERVICE (self));
   g_assert (tu != NULL);
-  g_assert (request != NULL);
+  g_assert (filename != NULL);
 
-  file = clang_getFile (tu, request->source_filename);
+  file = clang_getFile (tu, filename);
   if (file == NULL)
     return NULL;
 
@@ -164,7 +314,7 @@ ide_clang_service_build_index (IdeClangService   *self,
 
   client_data.index = index;
   client_data.file = file;
-  client_data.filename = request->source_filename;
+  client_data.filename = filename;
 
   /*
    * Add some common defines so they don't get changed by clang.
@@ -253,11 +403,12 @@ ide_clang_service_parse_worker (GTask        *task,
   g_autoptr(IdeClangTranslationUnit) ret = NULL;
   g_autoptr(IdeHighlightIndex) index = NULL;
   g_autoptr(IdeFile) file_copy = NULL;
-  IdeClangService *self = source_object;
   CXTranslationUnit tu = NULL;
   ParseRequest *request = task_data;
   IdeContext *context;
   g_autoptr(GPtrArray) built_argv = NULL;
+  g_autoptr(GHashTable) sequences = NULL;
+  IdeClangUnit *unit;
   GFile *gfile;
   const gchar *detail_error = NULL;
   const gchar *llvm_flags;
@@ -275,12 +426,15 @@ ide_clang_service_parse_worker (GTask        *task,
   ar = g_array_new (FALSE, FALSE, sizeof (struct CXUnsavedFile));
   g_array_set_clear_func (ar, clear_unsaved_file);
 
+  sequences = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
   for (i = 0; i < request->unsaved_files->len; i++)
     {
       IdeUnsavedFile *iuf = g_ptr_array_index (request->unsaved_files, i);
       struct CXUnsavedFile uf;
       GBytes *content;
       GFile *file;
+      gint64 *sequence;
 
       file = ide_unsaved_file_get_file (iuf);
       content = ide_unsaved_file_get_content (iuf);
@@ -289,6 +443,13 @@ ide_clang_service_parse_worker (GTask        *task,
       uf.Contents = g_bytes_get_data (content, NULL);
       uf.Length = g_bytes_get_size (content);
 
+      if (uf.Filename == NULL)
+        continue;
+
+      sequence = g_new (gint64, 1);
+      *sequence = ide_unsaved_file_get_sequence (iuf);
+      g_hash_table_insert (sequences, g_strdup (uf.Filename), sequence);
+
       g_array_append_val (ar, uf);
     }
 
@@ -303,20 +464,73 @@ ide_clang_service_parse_worker (GTask        *task,
     g_ptr_array_add (built_argv, request->command_line_args[i]);
   g_ptr_array_add (built_argv, NULL);
 
-  EGG_COUNTER_INC (ParseAttempts);
-  code = clang_parseTranslationUnit2 (request->index,
-                                      request->source_filename,
-                                      (const gchar * const *)built_argv->pdata,
-                                      built_argv->len - 1,
-                                      (struct CXUnsavedFile *)(gpointer)ar->data,
-                                      ar->len,
-                                      request->options,
-                                      &tu);
+  /*
+   * If we have a spare unit for this file that was created with the same
+   * arguments, reparse it in place. If none of the unsaved files changed
+   * since it was parsed, it can be used as is.
+   */
+  if (NULL != (unit = ide_clang_unit_pool_take (request->pool,
+                                               request->source_filename,
+                                               (const gchar * const *)built_argv->pdata)))
+    {
+      guint changed = count_changed_files (unit->sequences, sequences);
+
+      IDE_TRACE_MSG ("Reusing translation unit for %s with %u changed files",
+                     request->source_filename, changed);
+
+      if (changed > 0)
+        {
+          EGG_COUNTER_INC (ReparseAttempts);
+
+          /* On failure, the only valid thing to do is dispose the unit */
+          if (0 != clang_reparseTranslationUnit (unit->tu,
+                                                 ar->len,
+                                                 (struct CXUnsavedFile *)(gpointer)ar->data,
+                                                 clang_defaultReparseOptions (unit->tu)))
+            g_clear_pointer (&unit, ide_clang_unit_free);
+        }
+    }
+
+  if (unit != NULL)
+    {
+      tu = unit->tu;
+      code = CXError_Success;
+      g_clear_pointer (&unit->sequences, g_hash_table_unref);
+      unit->sequences = g_steal_pointer (&sequences);
+    }
+  else
+    {
+      EGG_COUNTER_INC (ParseAttempts);
+      code = clang_parseTranslationUnit2 (request->index,
+                                          request->source_filename,
+                                          (const gchar * const *)built_argv->pdata,
+                                          built_argv->len - 1,
+                                          (struct CXUnsavedFile *)(gpointer)ar->data,
+                                          ar->len,
+                                          request->options,
+                                          &tu);
+
+      if (tu != NULL)
+        {
+          unit = ide_clang_unit_new (request->pool,
+                                     tu,
+                                     request->source_filename,
+                                     (const gchar * const *)built_argv->pdata);
+          unit->sequences = g_steal_pointer (&sequences);
+        }
+    }
+
+  /* Track the unit so it can be reparsed when released */
+  if (unit != NULL)
+    {
+      ide_clang_unit_pool_publish (request->pool, unit);
+      register_native (unit);
+    }
 
   switch (code)
     {
     case CXError_Success:
-      index = ide_clang_service_build_index (self, tu, request);
+      index = _ide_clang_build_index (tu, request->source_filename);
 #ifdef IDE_ENABLE_TRACE
       ide_highlight_index_dump (index);
 #endif
@@ -433,6 +647,7 @@ ide_clang_service_get_translation_unit_worker (EggTaskCache  *cache,
   g_autoptr(GTask) real_task = NULL;
   g_autofree gchar *path = NULL;
   IdeClangService *self = user_data;
+  IdeClangTranslationUnit *cached;
   IdeUnsavedFiles *unsaved_files;
   IdeBuildSystem *build_system;
   ParseRequest *request;
@@ -465,6 +680,7 @@ ide_clang_service_get_translation_unit_worker (EggTaskCache  *cache,
    */
   request->file = ide_file_new (context, gfile);
   request->index = self->index;
+  request->pool = ide_clang_unit_pool_ref (self->pool);
   request->source_filename = g_steal_pointer (&path);
   request->command_line_args = NULL;
   request->unsaved_files = ide_unsaved_files_to_array (unsaved_files);
@@ -472,6 +688,9 @@ ide_clang_service_get_translation_unit_worker (EggTaskCache  *cache,
   /*
    * NOTE:
    *
+   * The default editing options include CXTranslationUnit_PrecompiledPreamble
+   * which is what makes reparsing the unit cheap.
+   *
    * I'm torn on this one. It requires a bunch of extra memory, but without it
    * we don't get information about macros.  And since we need that to provide
    * quality highlighting, I'm going try try enabling it for now and see how
@@ -486,6 +705,16 @@ ide_clang_service_get_translation_unit_worker (EggTaskCache  *cache,
                           g_object_ref (task));
   g_task_set_task_data (real_task, request, parse_request_free);
 
+  /*
+   * If nothing but the cache holds the previous unit for this file, evict
+   * it. Its native unit is then released into the pool and reparsed in
+   * place, rather than parsing a second copy next to it. Requests made in
+   * the meantime wait for this one to complete.
+   */
+  if ((cached = egg_task_cache_peek (self->units_cache, file)) &&
+      _ide_clang_translation_unit_is_uncontended (cached))
+    egg_task_cache_evict (self->units_cache, file);
+
   /*
    * Request the build flags necessary to build this module from the build system.
    */
@@ -525,7 +754,9 @@ ide_clang_service_get_translation_unit_cb (GObject      *object,
  * existing translation unit will be used.
  *
  * If the translation unit is out of date, then the source file(s) will be
- * parsed via clang_parseTranslationUnit() asynchronously.
+ * parsed via clang_parseTranslationUnit() asynchronously, or reparsed via
+ * clang_reparseTranslationUnit() if a previous unit for the file is no
+ * longer in use.
  */
 void
 ide_clang_service_get_translation_unit_async (IdeClangService     *self,
@@ -604,10 +835,807 @@ ide_clang_service_get_translation_unit_finish (IdeClangService  *self,
   return g_task_propagate_pointer (task, error);
 }
 
+static void
+worker_call_free (gpointer data)
+{
+  WorkerCall *call = data;
+
+  g_clear_object (&call->file);
+  g_free (call->path);
+  g_free (call->method);
+  g_clear_pointer (&call->params, g_variant_unref);
+  g_strfreev (call->argv);
+  g_slice_free (WorkerCall, call);
+}
+
+static void
+diagnose_state_free (gpointer data)
+{
+  DiagnoseState *state = data;
+
+  g_clear_object (&state->file);
+  g_clear_object (&state->target);
+  g_slice_free (DiagnoseState, state);
+}
+
+/*
+ * Builds the "a(sh)" of unsaved files for the worker, appending their file
+ * descriptors to @fd_list. The unsaved file snapshots own their file
+ * descriptor, so buffers that have not changed since a previous request
+ * are not copied again.
+ */
+static GVariant *
+ide_clang_service_build_unsaved_files (IdeClangService *self,
+                                       GUnixFDList     *fd_list)
+{
+  g_autoptr(GPtrArray) ar = NULL;
+  IdeUnsavedFiles *unsaved_files;
+  IdeContext *context;
+  GVariantBuilder builder;
+  guint i;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (G_IS_UNIX_FD_LIST (fd_list));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  unsaved_files = ide_context_get_unsaved_files (context);
+  ar = ide_unsaved_files_to_array (unsaved_files);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sh)"));
+
+  for (i = 0; i < ar->len; i++)
+    {
+      IdeUnsavedFile *iuf = g_ptr_array_index (ar, i);
+      g_autofree gchar *path = NULL;
+      g_autoptr(GError) error = NULL;
+      gint handle;
+      gint fd;
+
+      if (NULL == (path = g_file_get_path (ide_unsaved_file_get_file (iuf))))
+        continue;
+
+      if (-1 == (fd = ide_unsaved_file_get_fd (iuf, &error)))
+        {
+          g_warning ("Failed to create file descriptor for unsaved file %s: %s",
+                     path, error->message);
+          continue;
+        }
+
+      if (-1 == (handle = g_unix_fd_list_append (fd_list, fd, NULL)))
+        continue;
+
+      g_variant_builder_add (&builder, "(sh)", path, handle);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static void
+ide_clang_service_call_worker_cb (GObject      *object,
+                                  GAsyncResult *result,
+                                  gpointer      user_data)
+{
+  GDBusProxy *proxy = (GDBusProxy *)object;
+  g_autoptr(GTask) task = user_data;
+  GVariant *reply;
+  GError *error = NULL;
+
+  g_assert (G_IS_DBUS_PROXY (proxy));
+  g_assert (G_IS_TASK (task));
+
+  if (!(reply = g_dbus_proxy_call_with_unix_fd_list_finish (proxy, NULL, result, &error)))
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, reply, (GDestroyNotify)g_variant_unref);
+}
+
+static void
+ide_clang_service_call_worker_get_worker_cb (GObject      *object,
+                                             GAsyncResult *result,
+                                             gpointer      user_data)
+{
+  IdeApplication *app = (IdeApplication *)object;
+  g_autoptr(GDBusProxy) proxy = NULL;
+  g_autoptr(GUnixFDList) fd_list = NULL;
+  g_autoptr(GTask) task = user_data;
+  IdeClangService *self;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  GVariant *param;
+  WorkerCall *call;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_APPLICATION (app));
+  g_assert (G_IS_TASK (task));
+
+  self = g_task_get_source_object (task);
+  call = g_task_get_task_data (task);
+
+  if (!(proxy = ide_application_get_worker_finish (app, result, &error)))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  if (self->indexes == NULL)
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_CANCELLED,
+                               "The clang service has been stopped.");
+      return;
+    }
+
+  fd_list = g_unix_fd_list_new ();
+
+  /* Every method starts with the file, its command line and the unsaved files */
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_TUPLE);
+  g_variant_builder_add (&builder, "s", call->path);
+  g_variant_builder_add (&builder, "^as", call->argv);
+  g_variant_builder_add_value (&builder, ide_clang_service_build_unsaved_files (self, fd_list));
+  g_variant_iter_init (&iter, call->params);
+  while (NULL != (param = g_variant_iter_next_value (&iter)))
+    {
+      g_variant_builder_add_value (&builder, param);
+      g_variant_unref (param);
+    }
+
+  g_dbus_proxy_call_with_unix_fd_list (proxy,
+                                       call->method,
+                                       g_variant_builder_end (&builder),
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       -1,
+                                       fd_list,
+                                       g_task_get_cancellable (task),
+                                       ide_clang_service_call_worker_cb,
+                                       g_object_ref (task));
+}
+
+static void
+ide_clang_service_call_worker_get_build_flags_cb (GObject      *object,
+                                                  GAsyncResult *result,
+                                                  gpointer      user_data)
+{
+  IdeBuildSystem *build_system = (IdeBuildSystem *)object;
+  g_autoptr(GTask) task = user_data;
+  g_auto(GStrv) argv = NULL;
+  g_autoptr(GPtrArray) built_argv = NULL;
+  WorkerCall *call;
+  const gchar *llvm_flags;
+  GError *error = NULL;
+  gsize i;
+
+  g_assert (IDE_IS_BUILD_SYSTEM (build_system));
+  g_assert (G_IS_TASK (task));
+
+  call = g_task_get_task_data (task);
+
+  if (!(argv = ide_build_system_get_build_flags_finish (build_system, result, &error)))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        g_message ("%s", error->message);
+      g_clear_error (&error);
+      argv = g_new0 (gchar*, 1);
+    }
+
+  /* The worker gets the final command line, including our llvm flags */
+  built_argv = g_ptr_array_new ();
+  if (NULL != (llvm_flags = discover_llvm_flags ()))
+    g_ptr_array_add (built_argv, g_strdup (llvm_flags));
+  for (i = 0; argv[i] != NULL; i++)
+    g_ptr_array_add (built_argv, g_strdup (argv[i]));
+  g_ptr_array_add (built_argv, NULL);
+
+  call->argv = (gchar **)g_ptr_array_free (g_steal_pointer (&built_argv), FALSE);
+
+  ide_application_get_worker_for_key_async (IDE_APPLICATION_DEFAULT,
+                                            IDE_CLANG_WORKER_PLUGIN_NAME,
+                                            call->path,
+                                            g_task_get_cancellable (task),
+                                            ide_clang_service_call_worker_get_worker_cb,
+                                            g_object_ref (task));
+}
+
+/*
+ * Calls @method on the worker process that @file is sharded to. The
+ * parameters of the method are the path of @file, its build flags and
+ * the unsaved files, followed by the members of the @params tuple.
+ */
+static void
+ide_clang_service_call_worker_async (IdeClangService     *self,
+                                     IdeFile             *file,
+                                     const gchar         *method,
+                                     GVariant            *params,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  IdeBuildSystem *build_system;
+  IdeContext *context;
+  WorkerCall *call;
+  GFile *gfile;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (IDE_IS_FILE (file));
+  g_assert (method != NULL);
+  g_assert (params != NULL);
+  g_assert (g_variant_is_of_type (params, G_VARIANT_TYPE_TUPLE));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+
+  call = g_slice_new0 (WorkerCall);
+  call->file = g_object_ref (file);
+  call->method = g_strdup (method);
+  call->params = g_variant_ref_sink (params);
+  g_task_set_task_data (task, call, worker_call_free);
+
+  if (ide_file_get_is_temporary (file) ||
+      !(gfile = ide_file_get_file (file)) ||
+      !(call->path = g_file_get_path (gfile)))
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NOT_SUPPORTED,
+                               _("File must be saved locally to parse."));
+      return;
+    }
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  build_system = ide_context_get_build_system (context);
+
+  ide_build_system_get_build_flags_async (build_system,
+                                          file,
+                                          cancellable,
+                                          ide_clang_service_call_worker_get_build_flags_cb,
+                                          g_object_ref (task));
+}
+
+static GVariant *
+ide_clang_service_call_worker_finish (IdeClangService  *self,
+                                      GAsyncResult     *result,
+                                      GError          **error)
+{
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (G_IS_TASK (result));
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/*
+ * Worker processes are only available to the primary instance, so tests
+ * and tools parse the file in process instead.
+ */
+static gboolean
+ide_clang_service_has_workers (IdeClangService *self)
+{
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+
+  return ide_application_get_mode (IDE_APPLICATION_DEFAULT) == IDE_APPLICATION_MODE_PRIMARY;
+}
+
+static void
+ide_clang_service_diagnose_call_cb (GObject      *object,
+                                    GAsyncResult *result,
+                                    gpointer      user_data)
+{
+  IdeClangService *self = (IdeClangService *)object;
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(GVariant) reply = NULL;
+  g_autoptr(GVariant) diagnostics = NULL;
+  g_autoptr(GVariant) index = NULL;
+  DiagnoseState *state;
+  GError *error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (G_IS_TASK (task));
+
+  state = g_task_get_task_data (task);
+
+  if (!(reply = ide_clang_service_call_worker_finish (self, result, &error)))
+    {
+      g_task_return_error (task, error);
+      IDE_EXIT;
+    }
+
+  g_variant_get (reply, "(@" IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE_STRING "@a{sas})", &diagnostics, &index);
+
+  /* The service may have been stopped while the worker was busy */
+  if (self->indexes != NULL)
+    {
+      g_autoptr(IdeHighlightIndex) highlight_index = NULL;
+
+      highlight_index = ide_highlight_index_new_from_variant (index);
+      egg_task_cache_insert (self->indexes, state->file, highlight_index);
+    }
+
+  g_task_return_pointer (task,
+                         ide_clang_diagnostics_new_from_variant (state->target, diagnostics),
+                         (GDestroyNotify)ide_diagnostics_unref);
+
+  IDE_EXIT;
+}
+
+static void
+ide_clang_service_diagnose_get_unit_cb (GObject      *object,
+                                        GAsyncResult *result,
+                                        gpointer      user_data)
+{
+  IdeClangService *self = (IdeClangService *)object;
+  g_autoptr(IdeClangTranslationUnit) unit = NULL;
+  g_autoptr(GTask) task = user_data;
+  IdeDiagnostics *diagnostics;
+  DiagnoseState *state;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (G_IS_TASK (task));
+
+  state = g_task_get_task_data (task);
+
+  if (!(unit = ide_clang_service_get_translation_unit_finish (self, result, &error)))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  diagnostics = ide_clang_translation_unit_get_diagnostics_for_file (unit, ide_file_get_file (state->target));
+
+  g_task_return_pointer (task,
+                         ide_diagnostics_ref (diagnostics),
+                         (GDestroyNotify)ide_diagnostics_unref);
+}
+
+/**
+ * ide_clang_service_diagnose_async:
+ * @self: An #IdeClangService
+ * @file: the file to parse
+ * @target: the file to get diagnostics for, such as a header included by @file
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @callback: A callback to execute upon completion
+ * @user_data: user data for @callback
+ *
+ * Parses @file and gets the diagnostics that are located in @target.
+ *
+ * The parsing is done by a pool of worker processes so that libclang does
+ * not consume memory (or crash) in the UI process. Unsaved buffers are passed
+ * to the worker as file descriptors. As a side effect, the highlight index of
+ * @file is updated, see ide_clang_service_get_cached_index().
+ *
+ * If worker processes are not available, such as when running the tests, the
+ * file is parsed in process with ide_clang_service_get_translation_unit_async().
+ */
+void
+ide_clang_service_diagnose_async (IdeClangService     *self,
+                                  IdeFile             *file,
+                                  IdeFile             *target,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  g_autofree gchar *target_path = NULL;
+  DiagnoseState *state;
+  GFile *target_gfile;
+
+  IDE_ENTRY;
+
+  g_return_if_fail (IDE_IS_CLANG_SERVICE (self));
+  g_return_if_fail (IDE_IS_FILE (file));
+  g_return_if_fail (IDE_IS_FILE (target));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+
+  state = g_slice_new0 (DiagnoseState);
+  state->file = g_object_ref (file);
+  state->target = g_object_ref (target);
+  g_task_set_task_data (task, state, diagnose_state_free);
+
+  if (!ide_clang_service_has_workers (self))
+    {
+      ide_clang_service_get_translation_unit_async (self,
+                                                    file,
+                                                    0,
+                                                    cancellable,
+                                                    ide_clang_service_diagnose_get_unit_cb,
+                                                    g_object_ref (task));
+      IDE_EXIT;
+    }
+
+  if (!(target_gfile = ide_file_get_file (target)) ||
+      !(target_path = g_file_get_path (target_gfile)))
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NOT_SUPPORTED,
+                               _("File must be saved locally to parse."));
+      IDE_EXIT;
+    }
+
+  ide_clang_service_call_worker_async (self,
+                                       file,
+                                       "Diagnose",
+                                       g_variant_new ("(s)", target_path),
+                                       cancellable,
+                                       ide_clang_service_diagnose_call_cb,
+                                       g_object_ref (task));
+
+  IDE_EXIT;
+}
+
+/**
+ * ide_clang_service_diagnose_finish:
+ *
+ * Completes a request to ide_clang_service_diagnose_async().
+ *
+ * Returns: (transfer full): An #IdeDiagnostics or %NULL up on failure.
+ */
+IdeDiagnostics *
+ide_clang_service_diagnose_finish (IdeClangService  *self,
+                                   GAsyncResult     *result,
+                                   GError          **error)
+{
+  g_return_val_if_fail (IDE_IS_CLANG_SERVICE (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (result), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+ide_clang_service_lookup_symbol_call_cb (GObject      *object,
+                                         GAsyncResult *result,
+                                         gpointer      user_data)
+{
+  IdeClangService *self = (IdeClangService *)object;
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(GVariant) reply = NULL;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (G_IS_TASK (task));
+
+  if (!(reply = ide_clang_service_call_worker_finish (self, result, &error)))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_task_return_pointer (task,
+                         _ide_clang_symbol_new_from_variant (ide_object_get_context (IDE_OBJECT (self)), reply),
+                         (GDestroyNotify)ide_symbol_unref);
+}
+
+static void
+ide_clang_service_lookup_symbol_get_unit_cb (GObject      *object,
+                                             GAsyncResult *result,
+                                             gpointer      user_data)
+{
+  IdeClangService *self = (IdeClangService *)object;
+  g_autoptr(IdeClangTranslationUnit) unit = NULL;
+  g_autoptr(GTask) task = user_data;
+  IdeSourceLocation *location;
+  IdeSymbol *symbol;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (G_IS_TASK (task));
+
+  location = g_task_get_task_data (task);
+
+  if (!(unit = ide_clang_service_get_translation_unit_finish (self, result, &error)) ||
+      !(symbol = ide_clang_translation_unit_lookup_symbol (unit, location, &error)))
+    {
+      if (error == NULL)
+        error = g_error_new_literal (G_IO_ERROR,
+                                     G_IO_ERROR_NOT_FOUND,
+                                     _("Failed to locate symbol"));
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_task_return_pointer (task, symbol, (GDestroyNotify)ide_symbol_unref);
+}
+
+/**
+ * ide_clang_service_lookup_symbol_async:
+ * @self: An #IdeClangService
+ * @location: the location of the symbol
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @callback: A callback to execute upon completion
+ * @user_data: user data for @callback
+ *
+ * Resolves the symbol at @location. Like ide_clang_service_diagnose_async(),
+ * this is done by the worker process that keeps the translation unit of the
+ * file when workers are available.
+ */
+void
+ide_clang_service_lookup_symbol_async (IdeClangService     *self,
+                                       IdeSourceLocation   *location,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  IdeFile *file;
+
+  g_return_if_fail (IDE_IS_CLANG_SERVICE (self));
+  g_return_if_fail (location != NULL);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_task_data (task,
+                        ide_source_location_ref (location),
+                        (GDestroyNotify)ide_source_location_unref);
+
+  file = ide_source_location_get_file (location);
+
+  if (!ide_clang_service_has_workers (self))
+    {
+      ide_clang_service_get_translation_unit_async (self,
+                                                    file,
+                                                    0,
+                                                    cancellable,
+                                                    ide_clang_service_lookup_symbol_get_unit_cb,
+                                                    g_object_ref (task));
+      return;
+    }
+
+  ide_clang_service_call_worker_async (self,
+                                       file,
+                                       "LookupSymbol",
+                                       g_variant_new ("(uu)",
+                                                      ide_source_location_get_line (location),
+                                                      ide_source_location_get_line_offset (location)),
+                                       cancellable,
+                                       ide_clang_service_lookup_symbol_call_cb,
+                                       g_object_ref (task));
+}
+
+/**
+ * ide_clang_service_lookup_symbol_finish:
+ *
+ * Completes a request to ide_clang_service_lookup_symbol_async().
+ *
+ * Returns: (transfer full): An #IdeSymbol or %NULL up on failure.
+ */
+IdeSymbol *
+ide_clang_service_lookup_symbol_finish (IdeClangService  *self,
+                                        GAsyncResult     *result,
+                                        GError          **error)
+{
+  g_return_val_if_fail (IDE_IS_CLANG_SERVICE (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (result), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+ide_clang_service_get_symbol_tree_call_cb (GObject      *object,
+                                           GAsyncResult *result,
+                                           gpointer      user_data)
+{
+  IdeClangService *self = (IdeClangService *)object;
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(GVariant) reply = NULL;
+  g_autoptr(GVariant) nodes = NULL;
+  IdeFile *file;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (G_IS_TASK (task));
+
+  file = g_task_get_task_data (task);
+
+  if (!(reply = ide_clang_service_call_worker_finish (self, result, &error)))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  nodes = g_variant_get_child_value (reply, 0);
+
+  g_task_return_pointer (task,
+                         _ide_clang_symbol_tree_new (ide_object_get_context (IDE_OBJECT (self)),
+                                                     ide_file_get_file (file),
+                                                     nodes),
+                         g_object_unref);
+}
+
+static void
+ide_clang_service_get_symbol_tree_cb2 (GObject      *object,
+                                       GAsyncResult *result,
+                                       gpointer      user_data)
+{
+  IdeClangTranslationUnit *unit = (IdeClangTranslationUnit *)object;
+  g_autoptr(GTask) task = user_data;
+  IdeSymbolTree *ret;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_CLANG_TRANSLATION_UNIT (unit));
+  g_assert (G_IS_TASK (task));
+
+  if (!(ret = ide_clang_translation_unit_get_symbol_tree_finish (unit, result, &error)))
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, ret, g_object_unref);
+}
+
+static void
+ide_clang_service_get_symbol_tree_get_unit_cb (GObject      *object,
+                                               GAsyncResult *result,
+                                               gpointer      user_data)
+{
+  IdeClangService *self = (IdeClangService *)object;
+  g_autoptr(IdeClangTranslationUnit) unit = NULL;
+  g_autoptr(GTask) task = user_data;
+  IdeFile *file;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (G_IS_TASK (task));
+
+  file = g_task_get_task_data (task);
+
+  if (!(unit = ide_clang_service_get_translation_unit_finish (self, result, &error)))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  ide_clang_translation_unit_get_symbol_tree_async (unit,
+                                                    ide_file_get_file (file),
+                                                    g_task_get_cancellable (task),
+                                                    ide_clang_service_get_symbol_tree_cb2,
+                                                    g_object_ref (task));
+}
+
+/**
+ * ide_clang_service_get_symbol_tree_async:
+ * @self: An #IdeClangService
+ * @file: the file to get the symbols of
+ * @cancellable: (nullable): A #GCancellable or %NULL
+ * @callback: A callback to execute upon completion
+ * @user_data: user data for @callback
+ *
+ * Gets the tree of symbols declared in @file. When workers are available,
+ * the tree is built by the worker process that keeps the translation unit
+ * of @file and returned in a single message.
+ */
+void
+ide_clang_service_get_symbol_tree_async (IdeClangService     *self,
+                                         IdeFile             *file,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+
+  g_return_if_fail (IDE_IS_CLANG_SERVICE (self));
+  g_return_if_fail (IDE_IS_FILE (file));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_task_data (task, g_object_ref (file), g_object_unref);
+
+  if (!ide_clang_service_has_workers (self))
+    {
+      ide_clang_service_get_translation_unit_async (self,
+                                                    file,
+                                                    0,
+                                                    cancellable,
+                                                    ide_clang_service_get_symbol_tree_get_unit_cb,
+                                                    g_object_ref (task));
+      return;
+    }
+
+  ide_clang_service_call_worker_async (self,
+                                       file,
+                                       "GetSymbolTree",
+                                       g_variant_new ("()"),
+                                       cancellable,
+                                       ide_clang_service_get_symbol_tree_call_cb,
+                                       g_object_ref (task));
+}
+
+/**
+ * ide_clang_service_get_symbol_tree_finish:
+ *
+ * Completes a request to ide_clang_service_get_symbol_tree_async().
+ *
+ * Returns: (transfer full): An #IdeSymbolTree or %NULL up on failure.
+ */
+IdeSymbolTree *
+ide_clang_service_get_symbol_tree_finish (IdeClangService  *self,
+                                          GAsyncResult     *result,
+                                          GError          **error)
+{
+  g_return_val_if_fail (IDE_IS_CLANG_SERVICE (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (result), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static gsize
+ide_clang_service_get_unit_cost (gconstpointer value)
+{
+  return ide_clang_translation_unit_get_memory_usage ((IdeClangTranslationUnit *)value);
+}
+
+static gsize
+ide_clang_service_get_index_cost (gconstpointer value)
+{
+  return ide_highlight_index_get_size ((IdeHighlightIndex *)value);
+}
+
+static void
+ide_clang_service_get_index_worker (EggTaskCache  *cache,
+                                    gconstpointer  key,
+                                    GTask         *task,
+                                    gpointer       user_data)
+{
+  g_assert (EGG_IS_TASK_CACHE (cache));
+  g_assert (IDE_IS_FILE ((IdeFile *)key));
+  g_assert (G_IS_TASK (task));
+
+  /* Indexes are only ever inserted as the worker processes send them */
+  g_task_return_new_error (task,
+                           G_IO_ERROR,
+                           G_IO_ERROR_NOT_FOUND,
+                           "No highlight index has been received for the file");
+}
+
+static void
+ide_clang_service_unpin_file (IdeClangService *self)
+{
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+
+  if (self->pinned_file != NULL)
+    {
+      if (self->units_cache != NULL)
+        egg_task_cache_unpin (self->units_cache, self->pinned_file);
+      if (self->indexes != NULL)
+        egg_task_cache_unpin (self->indexes, self->pinned_file);
+      g_clear_object (&self->pinned_file);
+    }
+}
+
+static void
+ide_clang_service_notify_focus_buffer (IdeClangService  *self,
+                                       GParamSpec       *pspec,
+                                       IdeBufferManager *buffer_manager)
+{
+  IdeBuffer *buffer;
+
+  g_assert (IDE_IS_CLANG_SERVICE (self));
+  g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
+
+  if (self->units_cache == NULL)
+    return;
+
+  /*
+   * The translation unit of the focused buffer is used for completion,
+   * highlighting and symbol lookup, so keep it around even when the cache
+   * is over budget or the item has not been touched for a while.
+   */
+  ide_clang_service_unpin_file (self);
+
+  if ((buffer = ide_buffer_manager_get_focus_buffer (buffer_manager)))
+    {
+      self->pinned_file = g_object_ref (ide_buffer_get_file (buffer));
+      egg_task_cache_pin (self->units_cache, self->pinned_file);
+      egg_task_cache_pin (self->indexes, self->pinned_file);
+    }
+}
+
 static void
 ide_clang_service_start (IdeService *service)
 {
   IdeClangService *self = (IdeClangService *)service;
+  IdeBufferManager *buffer_manager;
+  IdeContext *context;
 
   g_return_if_fail (IDE_IS_CLANG_SERVICE (self));
   g_return_if_fail (self->index == NULL);
@@ -626,6 +1654,33 @@ ide_clang_service_start (IdeService *service)
                                           g_object_unref);
 
   egg_task_cache_set_name (self->units_cache, "clang translation-unit cache");
+  egg_task_cache_set_cost_func (self->units_cache, ide_clang_service_get_unit_cost);
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  buffer_manager = ide_context_get_buffer_manager (context);
+
+  g_signal_connect_object (buffer_manager,
+                           "notify::focus-buffer",
+                           G_CALLBACK (ide_clang_service_notify_focus_buffer),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  self->pool = ide_clang_unit_pool_new (MAX_SPARE_UNITS,
+                                        (GDestroyNotify)clang_disposeTranslationUnit);
+
+  self->indexes = egg_task_cache_new ((GHashFunc)ide_file_hash,
+                                      (GEqualFunc)ide_file_equal,
+                                      g_object_ref,
+                                      g_object_unref,
+                                      (GBoxedCopyFunc)ide_highlight_index_ref,
+                                      (GBoxedFreeFunc)ide_highlight_index_unref,
+                                      DEFAULT_EVICTION_MSEC,
+                                      ide_clang_service_get_index_worker,
+                                      NULL,
+                                      NULL);
+
+  egg_task_cache_set_name (self->indexes, "clang highlight-index cache");
+  egg_task_cache_set_cost_func (self->indexes, ide_clang_service_get_index_cost);
 
   self->index = clang_createIndex (0, 0);
   clang_CXIndex_setGlobalOptions (self->index,
@@ -641,7 +1696,9 @@ ide_clang_service_stop (IdeService *service)
   g_return_if_fail (self->index != NULL);
 
   g_cancellable_cancel (self->cancellable);
+  ide_clang_service_unpin_file (self);
   g_clear_object (&self->units_cache);
+  g_clear_object (&self->indexes);
 }
 
 static void
@@ -651,8 +1708,17 @@ ide_clang_service_dispose (GObject *object)
 
   IDE_ENTRY;
 
+  ide_clang_service_unpin_file (self);
   g_clear_object (&self->units_cache);
   g_clear_object (&self->cancellable);
+  g_clear_object (&self->indexes);
+
+  if (self->pool != NULL)
+    {
+      ide_clang_unit_pool_dispose (self->pool);
+      g_clear_pointer (&self->pool, ide_clang_unit_pool_unref);
+    }
+
   g_clear_pointer (&self->index, clang_disposeIndex);
 
   G_OBJECT_CLASS (ide_clang_service_parent_class)->dispose (object);
@@ -713,6 +1779,36 @@ ide_clang_service_get_cached_translation_unit (IdeClangService *self,
   return cached ? g_object_ref (cached) : NULL;
 }
 
+/**
+ * ide_clang_service_get_cached_index:
+ * @self: A #IdeClangService.
+ *
+ * Gets the most recent highlight index for @file, either as received from
+ * a worker process or from a cached translation unit.
+ *
+ * Returns: (transfer full) (nullable): An #IdeHighlightIndex or %NULL.
+ */
+IdeHighlightIndex *
+ide_clang_service_get_cached_index (IdeClangService *self,
+                                    IdeFile         *file)
+{
+  IdeClangTranslationUnit *cached;
+  IdeHighlightIndex *index;
+
+  g_return_val_if_fail (IDE_IS_CLANG_SERVICE (self), NULL);
+  g_return_val_if_fail (IDE_IS_FILE (file), NULL);
+
+  if (self->indexes != NULL && (index = egg_task_cache_peek (self->indexes, file)))
+    return ide_highlight_index_ref (index);
+
+  if (self->units_cache != NULL &&
+      (cached = egg_task_cache_peek (self->units_cache, file)) &&
+      (index = ide_clang_translation_unit_get_index (cached)))
+    return ide_highlight_index_ref (index);
+
+  return NULL;
+}
+
 void
 _ide_clang_dispose_string (CXString *str)
 {
@@ -38,6 +38,33 @@ IdeClangTranslationUnit *ide_clang_service_get_translation_unit_finish (IdeClang
                                                                         GError              **error);
 IdeClangTranslationUnit *ide_clang_service_get_cached_translation_unit (IdeClangService      *self,
                                                                         IdeFile              *file);
+void                     ide_clang_service_diagnose_async              (IdeClangService      *self,
+                                                                        IdeFile              *file,
+                                                                        IdeFile              *target,
+                                                                        GCancellable         *cancellable,
+                                                                        GAsyncReadyCallback   callback,
+                                                                        gpointer              user_data);
+IdeDiagnostics          *ide_clang_service_diagnose_finish             (IdeClangService      *self,
+                                                                        GAsyncResult         *result,
+                                                                        GError              **error);
+void                     ide_clang_service_lookup_symbol_async         (IdeClangService      *self,
+                                                                        IdeSourceLocation    *location,
+                                                                        GCancellable         *cancellable,
+                                                                        GAsyncReadyCallback   callback,
+                                                                        gpointer              user_data);
+IdeSymbol               *ide_clang_service_lookup_symbol_finish        (IdeClangService      *self,
+                                                                        GAsyncResult         *result,
+                                                                        GError              **error);
+void                     ide_clang_service_get_symbol_tree_async       (IdeClangService      *self,
+                                                                        IdeFile              *file,
+                                                                        GCancellable         *cancellable,
+                                                                        GAsyncReadyCallback   callback,
+                                                                        gpointer              user_data);
+IdeSymbolTree           *ide_clang_service_get_symbol_tree_finish      (IdeClangService      *self,
+                                                                        GAsyncResult         *result,
+                                                                        GError              **error);
+IdeHighlightIndex       *ide_clang_service_get_cached_index            (IdeClangService      *self,
+                                                                        IdeFile              *file);
 
 G_END_DECLS
 
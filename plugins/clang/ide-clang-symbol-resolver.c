@@ -38,34 +38,17 @@ ide_clang_symbol_resolver_lookup_symbol_cb (GObject      *object,
                                             gpointer      user_data)
 {
   IdeClangService *service = (IdeClangService *)object;
-  g_autoptr(IdeClangTranslationUnit) unit = NULL;
   g_autoptr(GTask) task = user_data;
-  g_autoptr(IdeSymbol) symbol = NULL;
-  IdeSourceLocation *location;
+  IdeSymbol *symbol;
   GError *error = NULL;
 
   g_assert (IDE_IS_CLANG_SERVICE (service));
   g_assert (G_IS_TASK (task));
 
-  location = g_task_get_task_data (task);
-
-  unit = ide_clang_service_get_translation_unit_finish (service, result, &error);
-
-  if (unit == NULL)
-    {
-      g_task_return_error (task, error);
-      return;
-    }
-
-  symbol = ide_clang_translation_unit_lookup_symbol (unit, location, &error);
-
-  if (symbol == NULL)
-    {
-      g_task_return_error (task, error);
-      return;
-    }
-
-  g_task_return_pointer (task, ide_symbol_ref (symbol), (GDestroyNotify)ide_symbol_unref);
+  if (!(symbol = ide_clang_service_lookup_symbol_finish (service, result, &error)))
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, symbol, (GDestroyNotify)ide_symbol_unref);
 }
 
 static void
@@ -78,7 +61,6 @@ ide_clang_symbol_resolver_lookup_symbol_async (IdeSymbolResolver   *resolver,
   IdeClangSymbolResolver *self = (IdeClangSymbolResolver *)resolver;
   IdeClangService *service = NULL;
   IdeContext *context;
-  IdeFile *file;
   g_autoptr(GTask) task = NULL;
 
   IDE_ENTRY;
@@ -88,18 +70,14 @@ ide_clang_symbol_resolver_lookup_symbol_async (IdeSymbolResolver   *resolver,
 
   context = ide_object_get_context (IDE_OBJECT (self));
   service = ide_context_get_service_typed (context, IDE_TYPE_CLANG_SERVICE);
-  file = ide_source_location_get_file (location);
 
   task = g_task_new (self, cancellable, callback, user_data);
-  g_task_set_task_data (task, ide_source_location_ref (location),
-                        (GDestroyNotify)ide_source_location_unref);
 
-  ide_clang_service_get_translation_unit_async (service,
-                                                file,
-                                                0,
-                                                cancellable,
-                                                ide_clang_symbol_resolver_lookup_symbol_cb,
-                                                g_object_ref (task));
+  ide_clang_service_lookup_symbol_async (service,
+                                         location,
+                                         cancellable,
+                                         ide_clang_symbol_resolver_lookup_symbol_cb,
+                                         g_object_ref (task));
 
   IDE_EXIT;
 }
@@ -122,31 +100,14 @@ ide_clang_symbol_resolver_lookup_symbol_finish (IdeSymbolResolver  *resolver,
   IDE_RETURN (ret);
 }
 
-static void
-ide_clang_symbol_resolver_get_symbol_tree_cb2 (GObject      *object,
-                                               GAsyncResult *result,
-                                               gpointer      user_data)
-{
-  IdeClangTranslationUnit *unit = (IdeClangTranslationUnit *)object;
-  IdeSymbolTree *ret;
-  GError *error = NULL;
-  g_autoptr(GTask) task = user_data;
-
-  if (!(ret = ide_clang_translation_unit_get_symbol_tree_finish (unit, result, &error)))
-    g_task_return_error (task, error);
-  else
-    g_task_return_pointer (task, ret, g_object_unref);
-}
-
 static void
 ide_clang_symbol_resolver_get_symbol_tree_cb (GObject      *object,
                                               GAsyncResult *result,
                                               gpointer      user_data)
 {
   IdeClangService *service = (IdeClangService *)object;
-  g_autoptr(IdeClangTranslationUnit) unit = NULL;
   g_autoptr(GTask) task = user_data;
-  GFile *file;
+  IdeSymbolTree *ret;
   GError *error = NULL;
 
   IDE_ENTRY;
@@ -154,22 +115,10 @@ ide_clang_symbol_resolver_get_symbol_tree_cb (GObject      *object,
   g_assert (IDE_IS_CLANG_SERVICE (service));
   g_assert (G_IS_TASK (task));
 
-  unit = ide_clang_service_get_translation_unit_finish (service, result, &error);
-
-  if (unit == NULL)
-    {
-      g_task_return_error (task, error);
-      IDE_EXIT;
-    }
-
-  file = g_task_get_task_data (task);
-  g_assert (G_IS_FILE (file));
-
-  ide_clang_translation_unit_get_symbol_tree_async (unit,
-                                                    file,
-                                                    g_task_get_cancellable (task),
-                                                    ide_clang_symbol_resolver_get_symbol_tree_cb2,
-                                                    g_object_ref (task));
+  if (!(ret = ide_clang_service_get_symbol_tree_finish (service, result, &error)))
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, ret, g_object_unref);
 
   IDE_EXIT;
 }
@@ -197,19 +146,17 @@ ide_clang_symbol_resolver_get_symbol_tree_async (IdeSymbolResolver   *resolver,
   service = ide_context_get_service_typed (context, IDE_TYPE_CLANG_SERVICE);
 
   task = g_task_new (self, cancellable, callback, user_data);
-  g_task_set_task_data (task, g_object_ref (file), g_object_unref);
 
   ifile = g_object_new (IDE_TYPE_FILE,
                         "file", file,
                         "context", context,
                         NULL);
 
-  ide_clang_service_get_translation_unit_async (service,
-                                                ifile,
-                                                0,
-                                                cancellable,
-                                                ide_clang_symbol_resolver_get_symbol_tree_cb,
-                                                g_object_ref (task));
+  ide_clang_service_get_symbol_tree_async (service,
+                                           ifile,
+                                           cancellable,
+                                           ide_clang_symbol_resolver_get_symbol_tree_cb,
+                                           g_object_ref (task));
 
   IDE_EXIT;
 }
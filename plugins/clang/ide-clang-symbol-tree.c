@@ -25,20 +25,30 @@
 #include "ide-clang-symbol-node.h"
 #include "ide-clang-symbol-tree.h"
 
+/*
+ * The symbol tree is built in one pass over the translation unit by
+ * _ide_clang_build_symbol_tree() and flattened into an "a(iuusuu)". Each
+ * node is the index of its parent (or -1 for the toplevel), the kind and
+ * flags of the symbol, its name and the line and column of its location.
+ * Parents always come before their children.
+ *
+ * That allows the tree to be built by the worker process that keeps the
+ * translation unit of the file rather than parsing the file again here.
+ */
 struct _IdeClangSymbolTree
 {
-  GObject    parent_instance;
+  IdeObject  parent_instance;
 
-  IdeRefPtr *native;
   GFile     *file;
-  gchar     *path;
-  GArray    *children;
+  GPtrArray *children;
 };
 
 typedef struct
 {
-  const gchar   *path;
-  GArray        *children;
+  const gchar     *path;
+  GVariantBuilder *builder;
+  gint             parent;
+  gint             n_nodes;
 } TraversalState;
 
 static void symbol_tree_iface_init (IdeSymbolTreeInterface *iface);
@@ -49,7 +59,6 @@ G_DEFINE_TYPE_WITH_CODE (IdeClangSymbolTree, ide_clang_symbol_tree, IDE_TYPE_OBJ
 enum {
   PROP_0,
   PROP_FILE,
-  PROP_NATIVE,
   LAST_PROP
 };
 
@@ -71,17 +80,6 @@ ide_clang_symbol_tree_get_file (IdeClangSymbolTree *self)
   return self->file;
 }
 
-static void
-ide_clang_symbol_tree_set_file (IdeClangSymbolTree *self,
-                                GFile              *file)
-{
-  g_return_if_fail (IDE_IS_CLANG_SYMBOL_TREE (self));
-  g_return_if_fail (G_IS_FILE (file));
-
-  self->file = g_object_ref (file);
-  self->path = g_file_get_path (file);
-}
-
 static gboolean
 cursor_is_recognized (TraversalState *state,
                       CXCursor        cursor)
@@ -124,70 +122,227 @@ cursor_is_recognized (TraversalState *state,
 }
 
 static enum CXChildVisitResult
-count_recognizable_children (CXCursor     cursor,
-                             CXCursor     parent,
-                             CXClientData user_data)
+find_child_type (CXCursor     cursor,
+                 CXCursor     parent,
+                 CXClientData user_data)
 {
-  TraversalState *state = user_data;
+  enum CXCursorKind *child_kind = user_data;
+  enum CXCursorKind kind = clang_getCursorKind (cursor);
+
+  switch ((int)kind)
+    {
+    case CXCursor_StructDecl:
+    case CXCursor_UnionDecl:
+    case CXCursor_EnumDecl:
+      *child_kind = kind;
+      return CXChildVisit_Break;
 
-  if (cursor_is_recognized (state, cursor))
-    g_array_append_val (state->children, cursor);
+    case CXCursor_TypeRef:
+      cursor = clang_getCursorReferenced (cursor);
+      *child_kind = clang_getCursorKind (cursor);
+      return CXChildVisit_Break;
+
+    default:
+      break;
+    }
 
   return CXChildVisit_Continue;
 }
 
-static guint
-ide_clang_symbol_tree_get_n_children (IdeSymbolTree *symbol_tree,
-                                      IdeSymbolNode *parent)
+static IdeSymbolKind
+get_symbol_kind (CXCursor        cursor,
+                 IdeSymbolFlags *flags)
 {
-  IdeClangSymbolTree *self = (IdeClangSymbolTree *)symbol_tree;
-  CXTranslationUnit tu;
-  CXCursor cursor;
-  TraversalState state = { 0 };
-  GArray *children = NULL;
-  guint count;
+  enum CXAvailabilityKind availability;
+  enum CXCursorKind cxkind;
+  IdeSymbolFlags local_flags = 0;
+  IdeSymbolKind kind = 0;
 
-  g_return_val_if_fail (IDE_IS_CLANG_SYMBOL_TREE (self), 0);
-  g_return_val_if_fail (!parent || IDE_IS_CLANG_SYMBOL_NODE (parent), 0);
-  g_return_val_if_fail (self->native != NULL, 0);
+  availability = clang_getCursorAvailability (cursor);
+  if (availability == CXAvailability_Deprecated)
+    local_flags |= IDE_SYMBOL_FLAGS_IS_DEPRECATED;
 
-  if (parent == NULL)
-    children = self->children;
-  else
-    children = _ide_clang_symbol_node_get_children (IDE_CLANG_SYMBOL_NODE (parent));
-
-  if (children != NULL)
-    return children->len;
+  cxkind = clang_getCursorKind (cursor);
 
-  if (parent == NULL)
+  if (cxkind == CXCursor_TypedefDecl)
     {
-      tu = ide_ref_ptr_get (self->native);
-      cursor = clang_getTranslationUnitCursor (tu);
+      enum CXCursorKind child_kind = 0;
+
+      clang_visitChildren (cursor, find_child_type, &child_kind);
+      cxkind = child_kind;
     }
-  else
+
+  switch ((int)cxkind)
     {
-      cursor = _ide_clang_symbol_node_get_cursor (IDE_CLANG_SYMBOL_NODE (parent));
+    case CXCursor_StructDecl:
+      kind = IDE_SYMBOL_STRUCT;
+      break;
+
+    case CXCursor_UnionDecl:
+      kind = IDE_SYMBOL_UNION;
+      break;
+
+    case CXCursor_ClassDecl:
+      kind = IDE_SYMBOL_CLASS;
+      break;
+
+    case CXCursor_FunctionDecl:
+      kind = IDE_SYMBOL_FUNCTION;
+      break;
+
+    case CXCursor_EnumDecl:
+      kind = IDE_SYMBOL_ENUM;
+      break;
+
+    case CXCursor_EnumConstantDecl:
+      kind = IDE_SYMBOL_ENUM_VALUE;
+      break;
+
+    case CXCursor_FieldDecl:
+      kind = IDE_SYMBOL_FIELD;
+      break;
+
+    case CXCursor_VarDecl:
+      kind = IDE_SYMBOL_VARIABLE;
+      break;
+
+    default:
+      break;
     }
 
-  children = g_array_new (FALSE, FALSE, sizeof (CXCursor));
+  *flags = local_flags;
+
+  return kind;
+}
+
+static enum CXChildVisitResult
+build_symbol_tree_visitor (CXCursor     cursor,
+                           CXCursor     parent,
+                           CXClientData user_data)
+{
+  TraversalState *state = user_data;
+  g_auto(CXString) cxname = { 0 };
+  IdeSymbolFlags flags = 0;
+  IdeSymbolKind kind;
+  guint line = 0;
+  guint line_offset = 0;
+  gint saved_parent;
+
+  if (!cursor_is_recognized (state, cursor))
+    return CXChildVisit_Continue;
+
+  kind = get_symbol_kind (cursor, &flags);
+  cxname = clang_getCursorSpelling (cursor);
+  clang_getFileLocation (clang_getCursorLocation (cursor), NULL, &line, &line_offset, NULL);
+
+  g_variant_builder_add (state->builder, "(iuusuu)",
+                         state->parent,
+                         kind,
+                         flags,
+                         clang_getCString (cxname) ?: "",
+                         line > 0 ? line - 1 : 0,
+                         line_offset > 0 ? line_offset - 1 : 0);
+
+  saved_parent = state->parent;
+  state->parent = state->n_nodes++;
+  clang_visitChildren (cursor, build_symbol_tree_visitor, state);
+  state->parent = saved_parent;
 
-  state.path = self->path;
-  state.children = children;
+  return CXChildVisit_Continue;
+}
 
-  clang_visitChildren (cursor,
-                       count_recognizable_children,
+/*
+ * Builds the flattened symbol tree of @path, see the comment at the top of
+ * this file. This does not require an #IdeContext so that it may be used
+ * from the clang worker processes.
+ */
+GVariant *
+_ide_clang_build_symbol_tree (CXTranslationUnit  tu,
+                              const gchar       *path)
+{
+  GVariantBuilder builder;
+  TraversalState state = { 0 };
+
+  g_return_val_if_fail (tu != NULL, NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(iuusuu)"));
+
+  state.path = path;
+  state.builder = &builder;
+  state.parent = -1;
+
+  clang_visitChildren (clang_getTranslationUnitCursor (tu),
+                       build_symbol_tree_visitor,
                        &state);
 
-  if (parent == NULL)
-    self->children = g_array_ref (children);
-  else
-    _ide_clang_symbol_node_set_children (IDE_CLANG_SYMBOL_NODE (parent), children);
+  return g_variant_builder_end (&builder);
+}
+
+/*
+ * Inflates the nodes created with _ide_clang_build_symbol_tree().
+ */
+IdeSymbolTree *
+_ide_clang_symbol_tree_new (IdeContext *context,
+                            GFile      *file,
+                            GVariant   *nodes)
+{
+  g_autoptr(GPtrArray) all = NULL;
+  IdeClangSymbolTree *self;
+  GVariantIter iter;
+  const gchar *name;
+  guint kind;
+  guint flags;
+  guint line;
+  guint line_offset;
+  gint parent;
+
+  g_return_val_if_fail (IDE_IS_CONTEXT (context), NULL);
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+  g_return_val_if_fail (nodes != NULL, NULL);
+  g_return_val_if_fail (g_variant_is_of_type (nodes, G_VARIANT_TYPE ("a(iuusuu)")), NULL);
+
+  self = g_object_new (IDE_TYPE_CLANG_SYMBOL_TREE,
+                       "context", context,
+                       "file", file,
+                       NULL);
+
+  all = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_variant_iter_init (&iter, nodes);
+
+  while (g_variant_iter_next (&iter, "(iuu&suu)", &parent, &kind, &flags, &name, &line, &line_offset))
+    {
+      IdeClangSymbolNode *node;
 
-  count = children->len;
+      node = _ide_clang_symbol_node_new (context, file, name, kind, flags, line, line_offset);
+      g_ptr_array_add (all, node);
 
-  g_array_unref (children);
+      if (parent >= 0 && parent < (gint)all->len - 1)
+        _ide_clang_symbol_node_add_child (g_ptr_array_index (all, parent), node);
+      else
+        g_ptr_array_add (self->children, g_object_ref (node));
+    }
 
-  return count;
+  return IDE_SYMBOL_TREE (self);
+}
+
+static guint
+ide_clang_symbol_tree_get_n_children (IdeSymbolTree *symbol_tree,
+                                      IdeSymbolNode *parent)
+{
+  IdeClangSymbolTree *self = (IdeClangSymbolTree *)symbol_tree;
+  GPtrArray *children;
+
+  g_return_val_if_fail (IDE_IS_CLANG_SYMBOL_TREE (self), 0);
+  g_return_val_if_fail (!parent || IDE_IS_CLANG_SYMBOL_NODE (parent), 0);
+
+  if (parent == NULL)
+    children = self->children;
+  else
+    children = _ide_clang_symbol_node_get_children (IDE_CLANG_SYMBOL_NODE (parent));
+
+  return children != NULL ? children->len : 0;
 }
 
 static IdeSymbolNode *
@@ -196,28 +351,18 @@ ide_clang_symbol_tree_get_nth_child (IdeSymbolTree *symbol_tree,
                                      guint          nth)
 {
   IdeClangSymbolTree *self = (IdeClangSymbolTree *)symbol_tree;
-  IdeContext *context;
-  GArray *children;
+  GPtrArray *children;
 
   g_return_val_if_fail (IDE_IS_CLANG_SYMBOL_TREE (self), NULL);
-  g_return_val_if_fail (!parent || IDE_IS_SYMBOL_NODE (parent), NULL);
-
-  context = ide_object_get_context (IDE_OBJECT (self));
+  g_return_val_if_fail (!parent || IDE_IS_CLANG_SYMBOL_NODE (parent), NULL);
 
   if (parent == NULL)
     children = self->children;
   else
     children = _ide_clang_symbol_node_get_children (IDE_CLANG_SYMBOL_NODE (parent));
 
-  g_assert (children != NULL);
-
-  if (nth < children->len)
-    {
-      CXCursor cursor;
-
-      cursor = g_array_index (children, CXCursor, nth);
-      return _ide_clang_symbol_node_new (context, cursor);
-    }
+  if (children != NULL && nth < children->len)
+    return g_object_ref (g_ptr_array_index (children, nth));
 
   g_warning ("nth child %u is out of bounds", nth);
 
@@ -229,9 +374,8 @@ ide_clang_symbol_tree_finalize (GObject *object)
 {
   IdeClangSymbolTree *self = (IdeClangSymbolTree *)object;
 
-  g_clear_pointer (&self->native, ide_ref_ptr_unref);
-  g_clear_pointer (&self->children, g_array_unref);
-  g_clear_pointer (&self->path, g_free);
+  g_clear_object (&self->file);
+  g_clear_pointer (&self->children, g_ptr_array_unref);
 
   G_OBJECT_CLASS (ide_clang_symbol_tree_parent_class)->finalize (object);
 }
@@ -250,10 +394,6 @@ ide_clang_symbol_tree_get_property (GObject    *object,
       g_value_set_object (value, ide_clang_symbol_tree_get_file (self));
       break;
 
-    case PROP_NATIVE:
-      g_value_set_boxed (value, self->native);
-      break;
-
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -270,11 +410,7 @@ ide_clang_symbol_tree_set_property (GObject      *object,
   switch (prop_id)
     {
     case PROP_FILE:
-      ide_clang_symbol_tree_set_file (self, g_value_get_object (value));
-      break;
-
-    case PROP_NATIVE:
-      self->native = g_value_dup_boxed (value);
+      self->file = g_value_dup_object (value);
       break;
 
     default:
@@ -298,19 +434,13 @@ ide_clang_symbol_tree_class_init (IdeClangSymbolTreeClass *klass)
                          G_TYPE_FILE,
                          (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
 
-  properties [PROP_NATIVE] =
-    g_param_spec_boxed ("native",
-                        "Native",
-                        "Native",
-                        IDE_TYPE_REF_PTR,
-                        (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
-
   g_object_class_install_properties (object_class, LAST_PROP, properties);
 }
 
 static void
 ide_clang_symbol_tree_init (IdeClangSymbolTree *self)
 {
+  self->children = g_ptr_array_new_with_free_func (g_object_unref);
 }
 
 static void
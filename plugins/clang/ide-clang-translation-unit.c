@@ -39,6 +39,7 @@ struct _IdeClangTranslationUnit
   GFile             *file;
   IdeHighlightIndex *index;
   GHashTable        *diagnostics;
+  gsize              memory_usage;
 };
 
 typedef struct
@@ -152,8 +153,8 @@ _ide_clang_translation_unit_new (IdeContext        *context,
   return ret;
 }
 
-static IdeDiagnosticSeverity
-translate_severity (enum CXDiagnosticSeverity severity)
+IdeDiagnosticSeverity
+_ide_clang_translate_severity (enum CXDiagnosticSeverity severity)
 {
   switch (severity)
     {
@@ -193,6 +194,40 @@ get_path (const gchar *workpath,
   return g_strdup (path);
 }
 
+static IdeSourceLocation *
+create_location_for_path (IdeContext  *context,
+                          IdeProject  *project,
+                          const gchar *workpath,
+                          const gchar *abspath,
+                          guint        line,
+                          guint        column,
+                          guint        offset)
+{
+  g_autofree gchar *path = NULL;
+  g_autoptr(IdeFile) file = NULL;
+
+  g_assert (IDE_IS_CONTEXT (context));
+  g_assert (workpath != NULL);
+  g_assert (abspath != NULL);
+
+  path = get_path (workpath, abspath);
+  file = ide_project_get_file_for_path (project, path);
+
+  if (!file)
+    {
+      g_autoptr(GFile) gfile = NULL;
+
+      gfile = g_file_new_for_path (path);
+      file = g_object_new (IDE_TYPE_FILE,
+                           "context", context,
+                           "file", gfile,
+                           "path", path,
+                           NULL);
+    }
+
+  return ide_source_location_new (file, line, column, offset);
+}
+
 static IdeSourceLocation *
 create_location (IdeClangTranslationUnit *self,
                  IdeProject              *project,
@@ -200,9 +235,7 @@ create_location (IdeClangTranslationUnit *self,
                  CXSourceLocation         cxloc)
 {
   IdeSourceLocation *ret = NULL;
-  IdeFile *file = NULL;
   CXFile cxfile = NULL;
-  g_autofree gchar *path = NULL;
   const gchar *cstr;
   CXString str;
   unsigned line;
@@ -220,29 +253,9 @@ create_location (IdeClangTranslationUnit *self,
   str = clang_getFileName (cxfile);
   cstr = clang_getCString (str);
   if (cstr != NULL)
-    path = get_path (workpath, cstr);
+    ret = create_location_for_path (ide_object_get_context (IDE_OBJECT (self)),
+                                    project, workpath, cstr, line, column, offset);
   clang_disposeString (str);
-  if (cstr == NULL)
-    return NULL;
-
-  file = ide_project_get_file_for_path (project, path);
-
-  if (!file)
-    {
-      IdeContext *context;
-      GFile *gfile;
-
-      context = ide_object_get_context (IDE_OBJECT (self));
-      gfile = g_file_new_for_path (path);
-
-      file = g_object_new (IDE_TYPE_FILE,
-                           "context", context,
-                           "file", gfile,
-                           "path", path,
-                           NULL);
-    }
-
-  ret = ide_source_location_new (file, line, column, offset);
 
   return ret;
 }
@@ -320,7 +333,7 @@ create_diagnostic (IdeClangTranslationUnit *self,
     return NULL;
 
   cxseverity = clang_getDiagnosticSeverity (cxdiag);
-  severity = translate_severity (cxseverity);
+  severity = _ide_clang_translate_severity (cxseverity);
 
   cxstr = clang_getDiagnosticSpelling (cxdiag);
   spelling = g_strdup (clang_getCString (cxstr));
@@ -474,7 +487,50 @@ ide_clang_translation_unit_set_native (IdeClangTranslationUnit *self,
   g_assert (IDE_IS_CLANG_TRANSLATION_UNIT (self));
 
   if (native != NULL)
-    self->native = ide_ref_ptr_new (native, (GDestroyNotify)clang_disposeTranslationUnit);
+    {
+      CXTUResourceUsage usage;
+      guint i;
+
+      self->native = ide_ref_ptr_new (native, (GDestroyNotify)_ide_clang_release_native);
+
+      /*
+       * The translation unit does not change after it has been parsed, so
+       * we only need to query the resource usage once.
+       */
+      usage = clang_getCXTUResourceUsage (native);
+      for (i = 0; i < usage.numEntries; i++)
+        self->memory_usage += usage.entries [i].amount;
+      clang_disposeCXTUResourceUsage (usage);
+    }
+}
+
+/*
+ * Checks if the caller holds the only reference to @self, and nothing else
+ * (symbol trees, completion requests, etc) uses its native unit. This may
+ * only be called from the main thread.
+ */
+gboolean
+_ide_clang_translation_unit_is_uncontended (IdeClangTranslationUnit *self)
+{
+  g_return_val_if_fail (IDE_IS_CLANG_TRANSLATION_UNIT (self), FALSE);
+
+  return (g_atomic_int_get ((gint *)&G_OBJECT (self)->ref_count) == 1 &&
+          (self->native == NULL || _ide_ref_ptr_is_unique (self->native)));
+}
+
+/**
+ * ide_clang_translation_unit_get_memory_usage:
+ * @self: An #IdeClangTranslationUnit
+ *
+ * Gets the approximate number of bytes used by the native translation unit,
+ * as reported by clang when the unit was parsed.
+ */
+gsize
+ide_clang_translation_unit_get_memory_usage (IdeClangTranslationUnit *self)
+{
+  g_return_val_if_fail (IDE_IS_CLANG_TRANSLATION_UNIT (self), 0);
+
+  return self->memory_usage;
 }
 
 static void
@@ -741,9 +797,10 @@ ide_clang_translation_unit_code_complete_async (IdeClangTranslationUnit *self,
 
   g_task_set_task_data (task, state, code_complete_state_free);
 
-  ide_thread_pool_push_task (IDE_THREAD_POOL_COMPILER,
-                             task,
-                             ide_clang_translation_unit_code_complete_worker);
+  ide_thread_pool_push_task_with_priority (IDE_THREAD_POOL_COMPILER,
+                                           IDE_THREAD_PRIORITY_INTERACTIVE,
+                                           task,
+                                           ide_clang_translation_unit_code_complete_worker);
 
   IDE_EXIT;
 }
@@ -871,109 +928,158 @@ get_symbol_kind (CXCursor        cursor,
   return kind;
 }
 
-IdeSymbol *
-ide_clang_translation_unit_lookup_symbol (IdeClangTranslationUnit  *self,
-                                          IdeSourceLocation        *location,
-                                          GError                  **error)
+/*
+ * Resolves the symbol at @line and @line_offset of @path into a "(suusuu)"
+ * of its name, kind and flags followed by the path, line and column of its
+ * definition. The path is empty if the definition is not known.
+ *
+ * This does not require an #IdeContext so that it may be used from the
+ * clang worker processes, see _ide_clang_symbol_new_from_variant().
+ */
+GVariant *
+_ide_clang_lookup_symbol (CXTranslationUnit  tu,
+                          const gchar       *path,
+                          guint              line,
+                          guint              line_offset)
 {
-  g_autofree gchar *filename = NULL;
-  g_autofree gchar *workpath = NULL;
   g_auto(CXString) cxstr = { 0 };
-  g_autoptr(IdeSourceLocation) declaration = NULL;
-  g_autoptr(IdeSourceLocation) definition = NULL;
-  g_autoptr(IdeSourceLocation) canonical = NULL;
-  CXTranslationUnit tu;
+  g_autofree gchar *definition_path = NULL;
   IdeSymbolKind symkind = 0;
   IdeSymbolFlags symflags = 0;
-  IdeProject *project;
-  IdeContext *context;
-  IdeVcs *vcs;
-  GFile *workdir;
   CXSourceLocation cxlocation;
   CXCursor tmpcursor;
   CXCursor cursor;
   CXFile cxfile;
-  IdeSymbol *ret = NULL;
-  IdeFile *file;
-  GFile *gfile;
-  guint line;
-  guint line_offset;
-
-  IDE_ENTRY;
-
-  g_return_val_if_fail (IDE_IS_CLANG_TRANSLATION_UNIT (self), NULL);
-  g_return_val_if_fail (location != NULL, NULL);
-
-  tu = ide_ref_ptr_get (self->native);
-
-  context = ide_object_get_context (IDE_OBJECT (self));
-  project = ide_context_get_project (context);
-  vcs = ide_context_get_vcs (context);
-  workdir = ide_vcs_get_working_directory (vcs);
-  workpath = g_file_get_path (workdir);
+  guint definition_line = 0;
+  guint definition_column = 0;
 
-  line = ide_source_location_get_line (location);
-  line_offset = ide_source_location_get_line_offset (location);
+  g_return_val_if_fail (tu != NULL, NULL);
+  g_return_val_if_fail (path != NULL, NULL);
 
-  if (!(file = ide_source_location_get_file (location)) ||
-      !(gfile = ide_file_get_file (file)) ||
-      !(filename = g_file_get_path (gfile)) ||
-      !(cxfile = clang_getFile (tu, filename)))
-    IDE_RETURN (NULL);
+  if (!(cxfile = clang_getFile (tu, path)))
+    return NULL;
 
   cxlocation = clang_getLocation (tu, cxfile, line + 1, line_offset + 1);
   cursor = clang_getCursor (tu, cxlocation);
   if (clang_Cursor_isNull (cursor))
-    IDE_RETURN (NULL);
+    return NULL;
 
   tmpcursor = clang_getCursorReferenced (cursor);
   if (!clang_Cursor_isNull (tmpcursor))
     {
+      g_auto(CXString) tmpname = { 0 };
       CXSourceLocation tmploc;
-      CXSourceRange cxrange;
+      CXFile tmpfile = NULL;
 
-      cxrange = clang_getCursorExtent (tmpcursor);
-      tmploc = clang_getRangeStart (cxrange);
-      definition = create_location (self, project, workpath, tmploc);
+      tmploc = clang_getRangeStart (clang_getCursorExtent (tmpcursor));
+      clang_getFileLocation (tmploc, &tmpfile, &definition_line, &definition_column, NULL);
+      tmpname = clang_getFileName (tmpfile);
+      definition_path = g_strdup (clang_getCString (tmpname));
+
+      if (definition_line > 0) definition_line--;
+      if (definition_column > 0) definition_column--;
     }
 
   symkind = get_symbol_kind (cursor, &symflags);
 
   if (symkind == IDE_SYMBOL_HEADER)
     {
-      CXFile included_file;
-      CXString included_file_name;
-      const gchar *path;
+      g_auto(CXString) included_file_name = { 0 };
+      const gchar *included_path;
 
-      included_file = clang_getIncludedFile (cursor);
-      included_file_name = clang_getFileName (included_file);
-      path = clang_getCString (included_file_name);
+      included_file_name = clang_getFileName (clang_getIncludedFile (cursor));
+      included_path = clang_getCString (included_file_name);
 
-      if (path != NULL)
+      if (included_path != NULL)
         {
-          gfile = g_file_new_for_path (path);
-          file = g_object_new (IDE_TYPE_FILE,
-                               "context", context,
-                               "file", gfile,
-                               "path", path,
-                               NULL);
-
-          g_clear_pointer (&definition, ide_symbol_unref);
-          definition = ide_source_location_new (file, 0, 0, 0);
-
-          g_clear_object (&file);
-          g_clear_object (&gfile);
+          g_free (definition_path);
+          definition_path = g_strdup (included_path);
+          definition_line = 0;
+          definition_column = 0;
         }
     }
 
   cxstr = clang_getCursorDisplayName (cursor);
-  ret = ide_symbol_new (clang_getCString (cxstr), symkind, symflags,
-                        declaration, definition, canonical);
 
-  /*
-   * TODO: We should also get information about the defintion of the symbol.
-   *       Possibly more.
-   */
+  return g_variant_new ("(suusuu)",
+                        clang_getCString (cxstr) ?: "",
+                        symkind,
+                        symflags,
+                        definition_path ?: "",
+                        definition_line,
+                        definition_column);
+}
+
+/*
+ * Creates the #IdeSymbol for a result of _ide_clang_lookup_symbol().
+ */
+IdeSymbol *
+_ide_clang_symbol_new_from_variant (IdeContext *context,
+                                    GVariant   *variant)
+{
+  g_autoptr(IdeSourceLocation) definition = NULL;
+  const gchar *definition_path;
+  const gchar *name;
+  guint definition_line;
+  guint definition_column;
+  guint symkind;
+  guint symflags;
+
+  g_return_val_if_fail (IDE_IS_CONTEXT (context), NULL);
+  g_return_val_if_fail (variant != NULL, NULL);
+  g_return_val_if_fail (g_variant_is_of_type (variant, G_VARIANT_TYPE ("(suusuu)")), NULL);
+
+  g_variant_get (variant, "(&suu&suu)",
+                 &name, &symkind, &symflags,
+                 &definition_path, &definition_line, &definition_column);
+
+  if (*definition_path != '\0')
+    {
+      g_autofree gchar *workpath = NULL;
+      IdeVcs *vcs;
+
+      vcs = ide_context_get_vcs (context);
+      workpath = g_file_get_path (ide_vcs_get_working_directory (vcs));
+      definition = create_location_for_path (context,
+                                             ide_context_get_project (context),
+                                             workpath,
+                                             definition_path,
+                                             definition_line,
+                                             definition_column,
+                                             0);
+    }
+
+  return ide_symbol_new (name, symkind, symflags, NULL, definition, NULL);
+}
+
+IdeSymbol *
+ide_clang_translation_unit_lookup_symbol (IdeClangTranslationUnit  *self,
+                                          IdeSourceLocation        *location,
+                                          GError                  **error)
+{
+  g_autofree gchar *filename = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  IdeSymbol *ret;
+  IdeFile *file;
+  GFile *gfile;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (IDE_IS_CLANG_TRANSLATION_UNIT (self), NULL);
+  g_return_val_if_fail (location != NULL, NULL);
+
+  if (!(file = ide_source_location_get_file (location)) ||
+      !(gfile = ide_file_get_file (file)) ||
+      !(filename = g_file_get_path (gfile)) ||
+      !(variant = _ide_clang_lookup_symbol (ide_ref_ptr_get (self->native),
+                                            filename,
+                                            ide_source_location_get_line (location),
+                                            ide_source_location_get_line_offset (location))))
+    IDE_RETURN (NULL);
+
+  g_variant_ref_sink (variant);
+
+  ret = _ide_clang_symbol_new_from_variant (ide_object_get_context (IDE_OBJECT (self)), variant);
 
   IDE_RETURN (ret);
 }
@@ -1095,7 +1201,8 @@ ide_clang_translation_unit_get_symbol_tree_async (IdeClangTranslationUnit *self,
                                                   gpointer                 user_data)
 {
   g_autoptr(GTask) task = NULL;
-  IdeSymbolTree *symbol_tree;
+  g_autoptr(GVariant) nodes = NULL;
+  g_autofree gchar *path = NULL;
   IdeContext *context;
 
   g_return_if_fail (IDE_IS_CLANG_TRANSLATION_UNIT (self));
@@ -1104,13 +1211,21 @@ ide_clang_translation_unit_get_symbol_tree_async (IdeClangTranslationUnit *self,
 
   task = g_task_new (self, cancellable, callback, user_data);
 
+  if (NULL == (path = g_file_get_path (file)))
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NOT_SUPPORTED,
+                               _("File must be saved locally to parse."));
+      return;
+    }
+
   context = ide_object_get_context (IDE_OBJECT (self));
-  symbol_tree = g_object_new (IDE_TYPE_CLANG_SYMBOL_TREE,
-                              "context", context,
-                              "native", self->native,
-                              "file", file,
-                              NULL);
-  g_task_return_pointer (task, symbol_tree, g_object_unref);
+  nodes = g_variant_ref_sink (_ide_clang_build_symbol_tree (ide_ref_ptr_get (self->native), path));
+
+  g_task_return_pointer (task,
+                         _ide_clang_symbol_tree_new (context, file, nodes),
+                         g_object_unref);
 }
 
 IdeSymbolTree *
@@ -55,6 +55,7 @@ IdeSymbol         *ide_clang_translation_unit_lookup_symbol            (IdeClang
                                                                         GError                  **error);
 GPtrArray         *ide_clang_translation_unit_get_symbols              (IdeClangTranslationUnit  *self,
                                                                         IdeFile                  *file);
+gsize              ide_clang_translation_unit_get_memory_usage         (IdeClangTranslationUnit  *self);
 
 G_END_DECLS
 
@@ -0,0 +1,313 @@
+/* ide-clang-unit-pool.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-clang-unit-pool"
+
+#include "ide-clang-unit-pool.h"
+
+/*
+ * Keeps native translation units that nothing references anymore, so that
+ * the next request for the same file can reparse one in place instead of
+ * parsing every header again.
+ *
+ * Each file normally has a single unit, which is released into the pool
+ * once its consumers are done and then reparsed. If a consumer still held
+ * the unit when the file had to be parsed again, a second unit is created.
+ * Units are published when parsed, so the older one is then known to be
+ * superseded and is disposed as soon as it is released rather than kept
+ * as a spare.
+ */
+
+struct _IdeClangUnitPool
+{
+  volatile gint   ref_count;
+
+  /* Protects every field below */
+  GMutex          mutex;
+
+  GDestroyNotify  tu_free_func;
+  guint           max_spares;
+
+  /* Most recently released first */
+  GQueue          spares;
+
+  /* Maps a file to the generation of its most recently published unit */
+  GHashTable     *current;
+  guint64         generation;
+
+  guint           disposed : 1;
+};
+
+IdeClangUnitPool *
+ide_clang_unit_pool_new (guint          max_spares,
+                         GDestroyNotify tu_free_func)
+{
+  IdeClangUnitPool *self;
+
+  g_return_val_if_fail (tu_free_func != NULL, NULL);
+
+  self = g_slice_new0 (IdeClangUnitPool);
+  self->ref_count = 1;
+  self->max_spares = max_spares;
+  self->tu_free_func = tu_free_func;
+  self->current = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  g_mutex_init (&self->mutex);
+  g_queue_init (&self->spares);
+
+  return self;
+}
+
+IdeClangUnitPool *
+ide_clang_unit_pool_ref (IdeClangUnitPool *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+ide_clang_unit_pool_unref (IdeClangUnitPool *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_assert (self->spares.length == 0);
+      g_clear_pointer (&self->current, g_hash_table_unref);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (IdeClangUnitPool, self);
+    }
+}
+
+/**
+ * ide_clang_unit_new:
+ * @pool: the #IdeClangUnitPool the unit will be released into
+ * @tu: (transfer full): the native translation unit
+ * @source_filename: the main file of @tu
+ * @command_line_args: the arguments used to parse @tu
+ *
+ * Creates a new unit for @tu. It must be published with
+ * ide_clang_unit_pool_publish() before it can be kept as a spare.
+ */
+IdeClangUnit *
+ide_clang_unit_new (IdeClangUnitPool    *pool,
+                    gpointer             tu,
+                    const gchar         *source_filename,
+                    const gchar * const *command_line_args)
+{
+  IdeClangUnit *unit;
+
+  g_return_val_if_fail (pool != NULL, NULL);
+  g_return_val_if_fail (tu != NULL, NULL);
+  g_return_val_if_fail (source_filename != NULL, NULL);
+  g_return_val_if_fail (command_line_args != NULL, NULL);
+
+  unit = g_slice_new0 (IdeClangUnit);
+  unit->pool = ide_clang_unit_pool_ref (pool);
+  unit->tu = tu;
+  unit->source_filename = g_strdup (source_filename);
+  unit->command_line_args = g_strdupv ((gchar **)command_line_args);
+
+  return unit;
+}
+
+void
+ide_clang_unit_free (IdeClangUnit *unit)
+{
+  if (unit == NULL)
+    return;
+
+  if (unit->tu != NULL)
+    unit->pool->tu_free_func (unit->tu);
+
+  g_clear_pointer (&unit->source_filename, g_free);
+  g_clear_pointer (&unit->command_line_args, g_strfreev);
+  g_clear_pointer (&unit->sequences, g_hash_table_unref);
+  g_clear_pointer (&unit->pool, ide_clang_unit_pool_unref);
+  g_slice_free (IdeClangUnit, unit);
+}
+
+static gboolean
+strv_equal (const gchar * const *a,
+            const gchar * const *b)
+{
+  guint i;
+
+  for (i = 0; a [i] != NULL && b [i] != NULL; i++)
+    {
+      if (!g_str_equal (a [i], b [i]))
+        return FALSE;
+    }
+
+  return a [i] == b [i];
+}
+
+/**
+ * ide_clang_unit_pool_dispose:
+ *
+ * Frees every spare. Units released afterwards are freed right away.
+ */
+void
+ide_clang_unit_pool_dispose (IdeClangUnitPool *self)
+{
+  GQueue spares;
+
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->disposed = TRUE;
+  spares = self->spares;
+  g_queue_init (&self->spares);
+  g_hash_table_remove_all (self->current);
+  g_mutex_unlock (&self->mutex);
+
+  g_list_free_full (spares.head, (GDestroyNotify)ide_clang_unit_free);
+}
+
+guint
+ide_clang_unit_pool_get_n_spares (IdeClangUnitPool *self)
+{
+  guint ret;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  g_mutex_lock (&self->mutex);
+  ret = self->spares.length;
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * ide_clang_unit_pool_take:
+ *
+ * Takes the spare unit for @source_filename, if any, so that it can be
+ * reparsed. A spare parsed with different arguments cannot be reparsed,
+ * so it is freed and %NULL is returned.
+ *
+ * Returns: (transfer full) (nullable): an #IdeClangUnit or %NULL.
+ */
+IdeClangUnit *
+ide_clang_unit_pool_take (IdeClangUnitPool    *self,
+                          const gchar         *source_filename,
+                          const gchar * const *command_line_args)
+{
+  IdeClangUnit *ret = NULL;
+  IdeClangUnit *stale = NULL;
+  GList *iter;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (source_filename != NULL, NULL);
+  g_return_val_if_fail (command_line_args != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  for (iter = self->spares.head; iter != NULL; iter = iter->next)
+    {
+      IdeClangUnit *unit = iter->data;
+
+      if (g_str_equal (unit->source_filename, source_filename))
+        {
+          g_queue_delete_link (&self->spares, iter);
+
+          if (strv_equal ((const gchar * const *)unit->command_line_args, command_line_args))
+            ret = unit;
+          else
+            stale = unit;
+
+          break;
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  ide_clang_unit_free (stale);
+
+  return ret;
+}
+
+/**
+ * ide_clang_unit_pool_publish:
+ *
+ * Marks @unit as the most recent unit for its file, after it was parsed
+ * or reparsed. Any other unit for the file is freed once released.
+ */
+void
+ide_clang_unit_pool_publish (IdeClangUnitPool *self,
+                             IdeClangUnit     *unit)
+{
+  guint64 *generation;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (unit != NULL);
+  g_return_if_fail (unit->pool == self);
+
+  generation = g_new (guint64, 1);
+
+  g_mutex_lock (&self->mutex);
+  *generation = unit->generation = ++self->generation;
+  g_hash_table_insert (self->current, g_strdup (unit->source_filename), generation);
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * ide_clang_unit_pool_release:
+ * @unit: (transfer full): an #IdeClangUnit
+ *
+ * Releases @unit once nothing references its translation unit anymore. It
+ * is kept as a spare unless a newer unit was published for the same file,
+ * in which case it is freed.
+ */
+void
+ide_clang_unit_pool_release (IdeClangUnitPool *self,
+                             IdeClangUnit     *unit)
+{
+  IdeClangUnit *evicted = NULL;
+  guint64 *current;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (unit != NULL);
+  g_return_if_fail (unit->pool == self);
+
+  g_mutex_lock (&self->mutex);
+
+  current = g_hash_table_lookup (self->current, unit->source_filename);
+
+  if (self->disposed || current == NULL || *current != unit->generation)
+    {
+      evicted = unit;
+    }
+  else
+    {
+      g_queue_push_head (&self->spares, unit);
+
+      if (self->spares.length > self->max_spares)
+        {
+          evicted = g_queue_pop_tail (&self->spares);
+          g_hash_table_remove (self->current, evicted->source_filename);
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  ide_clang_unit_free (evicted);
+}
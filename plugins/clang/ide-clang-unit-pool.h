@@ -0,0 +1,73 @@
+/* ide-clang-unit-pool.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_CLANG_UNIT_POOL_H
+#define IDE_CLANG_UNIT_POOL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _IdeClangUnitPool IdeClangUnitPool;
+
+/**
+ * IdeClangUnit:
+ * @tu: the native translation unit
+ * @source_filename: the main file of @tu
+ * @command_line_args: the arguments @tu was parsed with
+ * @sequences: the sequence number of each unsaved file @tu was parsed
+ *   with, keyed by path
+ *
+ * A native translation unit along with what is needed to decide whether
+ * it can be reparsed for a new request.
+ */
+typedef struct
+{
+  /*< private >*/
+  IdeClangUnitPool  *pool;
+  guint64            generation;
+
+  /*< public >*/
+  gpointer           tu;
+  gchar             *source_filename;
+  gchar            **command_line_args;
+  GHashTable        *sequences;
+} IdeClangUnit;
+
+IdeClangUnitPool *ide_clang_unit_pool_new          (guint                max_spares,
+                                                    GDestroyNotify       tu_free_func);
+IdeClangUnitPool *ide_clang_unit_pool_ref          (IdeClangUnitPool    *self);
+void              ide_clang_unit_pool_unref        (IdeClangUnitPool    *self);
+void              ide_clang_unit_pool_dispose      (IdeClangUnitPool    *self);
+guint             ide_clang_unit_pool_get_n_spares (IdeClangUnitPool    *self);
+IdeClangUnit     *ide_clang_unit_pool_take         (IdeClangUnitPool    *self,
+                                                    const gchar         *source_filename,
+                                                    const gchar * const *command_line_args);
+void              ide_clang_unit_pool_publish      (IdeClangUnitPool    *self,
+                                                    IdeClangUnit        *unit);
+void              ide_clang_unit_pool_release      (IdeClangUnitPool    *self,
+                                                    IdeClangUnit        *unit);
+IdeClangUnit     *ide_clang_unit_new               (IdeClangUnitPool    *pool,
+                                                    gpointer             tu,
+                                                    const gchar         *source_filename,
+                                                    const gchar * const *command_line_args);
+void              ide_clang_unit_free              (IdeClangUnit        *unit);
+
+G_END_DECLS
+
+#endif /* IDE_CLANG_UNIT_POOL_H */
@@ -0,0 +1,660 @@
+/* ide-clang-worker.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-clang-worker"
+
+#include <clang-c/Index.h>
+#include <gio/gunixfdlist.h>
+#include <glib/gi18n.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ide-clang-diagnostics-variant.h"
+#include "ide-clang-private.h"
+#include "ide-clang-worker.h"
+
+#include "workers/ide-worker.h"
+
+/*
+ * IdeClangWorker runs inside of a gnome-builder-worker subprocess and parses
+ * translation units on behalf of IdeClangService. Files are sharded across a
+ * pool of these processes by the worker manager, so each process only keeps
+ * the units for its share of the files and a crash in libclang only takes
+ * down the worker (which is then respawned) rather than the IDE.
+ *
+ * Unsaved buffers are passed as file descriptors to memory backed files (see
+ * ide_unsaved_file_get_fd()) and mapped here, rather than being
+ * copied into the message. The results are returned as compact GVariants.
+ *
+ * Since requests for a file are always routed to the same process, the unit
+ * is kept around and reparsed in place on the next request. Diagnose is
+ * requested whenever the buffer changes, so the symbol requests use the
+ * unit as it is and only parse the file if the worker does not have it.
+ */
+
+#define MAX_UNITS 8
+
+static const gchar introspection_xml[] =
+  "<node>"
+  "  <interface name='" IDE_CLANG_WORKER_INTERFACE_NAME "'>"
+  "    <method name='Diagnose'>"
+  "      <arg type='s' name='path' direction='in'/>"
+  "      <arg type='as' name='argv' direction='in'/>"
+  "      <arg type='a(sh)' name='unsaved_files' direction='in'/>"
+  "      <arg type='s' name='target' direction='in'/>"
+  "      <arg type='" IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE_STRING "' name='diagnostics' direction='out'/>"
+  "      <arg type='a{sas}' name='index' direction='out'/>"
+  "    </method>"
+  "    <method name='LookupSymbol'>"
+  "      <arg type='s' name='path' direction='in'/>"
+  "      <arg type='as' name='argv' direction='in'/>"
+  "      <arg type='a(sh)' name='unsaved_files' direction='in'/>"
+  "      <arg type='u' name='line' direction='in'/>"
+  "      <arg type='u' name='line_offset' direction='in'/>"
+  "      <arg type='s' name='name' direction='out'/>"
+  "      <arg type='u' name='kind' direction='out'/>"
+  "      <arg type='u' name='flags' direction='out'/>"
+  "      <arg type='s' name='definition_path' direction='out'/>"
+  "      <arg type='u' name='definition_line' direction='out'/>"
+  "      <arg type='u' name='definition_line_offset' direction='out'/>"
+  "    </method>"
+  "    <method name='GetSymbolTree'>"
+  "      <arg type='s' name='path' direction='in'/>"
+  "      <arg type='as' name='argv' direction='in'/>"
+  "      <arg type='a(sh)' name='unsaved_files' direction='in'/>"
+  "      <arg type='a(iuusuu)' name='nodes' direction='out'/>"
+  "    </method>"
+  "  </interface>"
+  "</node>";
+
+typedef struct
+{
+  gchar             *path;
+  gchar            **argv;
+  CXTranslationUnit  tu;
+} WorkerUnit;
+
+struct _IdeClangWorker
+{
+  GObject  parent_instance;
+
+  CXIndex  index;
+
+  /* Most recently used first */
+  GQueue   units;
+};
+
+static void worker_iface_init (IdeWorkerInterface *iface);
+
+G_DEFINE_TYPE_EXTENDED (IdeClangWorker, ide_clang_worker, G_TYPE_OBJECT, 0,
+                        G_IMPLEMENT_INTERFACE (IDE_TYPE_WORKER, worker_iface_init))
+
+static void
+worker_unit_free (gpointer data)
+{
+  WorkerUnit *unit = data;
+
+  g_free (unit->path);
+  g_strfreev (unit->argv);
+  g_clear_pointer (&unit->tu, clang_disposeTranslationUnit);
+  g_slice_free (WorkerUnit, unit);
+}
+
+static WorkerUnit *
+ide_clang_worker_take_unit (IdeClangWorker      *self,
+                            const gchar         *path,
+                            const gchar * const *argv)
+{
+  GList *iter;
+
+  g_assert (IDE_IS_CLANG_WORKER (self));
+  g_assert (path != NULL);
+  g_assert (argv != NULL);
+
+  for (iter = self->units.head; iter != NULL; iter = iter->next)
+    {
+      WorkerUnit *unit = iter->data;
+
+      if (g_strcmp0 (unit->path, path) == 0)
+        {
+          g_queue_delete_link (&self->units, iter);
+
+          /* The build flags changed, so we need to parse from scratch */
+          if (!_ide_clang_strv_equal ((const gchar * const *)unit->argv, argv))
+            {
+              worker_unit_free (unit);
+              return NULL;
+            }
+
+          return unit;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+ide_clang_worker_push_unit (IdeClangWorker *self,
+                            WorkerUnit     *unit)
+{
+  g_assert (IDE_IS_CLANG_WORKER (self));
+  g_assert (unit != NULL);
+
+  g_queue_push_head (&self->units, unit);
+
+  while (self->units.length > MAX_UNITS)
+    worker_unit_free (g_queue_pop_tail (&self->units));
+}
+
+static gboolean
+is_target (CXFile       cxfile,
+           const gchar *target)
+{
+  CXString cxstr;
+  gboolean ret;
+
+  if (cxfile == NULL)
+    return FALSE;
+
+  cxstr = clang_getFileName (cxfile);
+  ret = (g_strcmp0 (clang_getCString (cxstr), target) == 0);
+  clang_disposeString (cxstr);
+
+  return ret;
+}
+
+static gboolean
+get_location (CXSourceLocation  cxloc,
+              const gchar      *target,
+              guint            *line,
+              guint            *column,
+              guint            *offset)
+{
+  CXFile cxfile = NULL;
+
+  clang_getFileLocation (cxloc, &cxfile, line, column, offset);
+
+  if (!is_target (cxfile, target))
+    return FALSE;
+
+  if (*line > 0) (*line)--;
+  if (*column > 0) (*column)--;
+
+  return TRUE;
+}
+
+static gboolean
+get_range (CXSourceRange  cxrange,
+           const gchar   *target,
+           guint         *begin_line,
+           guint         *begin_column,
+           guint         *end_line,
+           guint         *end_column)
+{
+  guint offset;
+
+  return (get_location (clang_getRangeStart (cxrange), target, begin_line, begin_column, &offset) &&
+          get_location (clang_getRangeEnd (cxrange), target, end_line, end_column, &offset));
+}
+
+/*
+ * Serializes the diagnostics located in @target. Ranges and fixits which
+ * point outside of @target are dropped, so that we do not need to send
+ * file names along with every location.
+ */
+static GVariant *
+ide_clang_worker_build_diagnostics (CXTranslationUnit  tu,
+                                    const gchar       *target)
+{
+  GVariantBuilder builder;
+  guint count;
+  guint i;
+
+  g_assert (tu != NULL);
+  g_assert (target != NULL);
+
+  g_variant_builder_init (&builder, IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE);
+
+  count = clang_getNumDiagnostics (tu);
+
+  for (i = 0; i < count; i++)
+    {
+      IdeDiagnosticSeverity severity;
+      GVariantBuilder ranges;
+      GVariantBuilder fixits;
+      CXDiagnostic cxdiag;
+      CXSourceLocation cxloc;
+      CXString cxstr;
+      CXFile cxfile = NULL;
+      const gchar *spelling;
+      guint line;
+      guint column;
+      guint offset;
+      guint n;
+      guint j;
+
+      cxdiag = clang_getDiagnostic (tu, i);
+      cxloc = clang_getDiagnosticLocation (cxdiag);
+      clang_getExpansionLocation (cxloc, &cxfile, NULL, NULL, NULL);
+
+      if (!is_target (cxfile, target))
+        {
+          clang_disposeDiagnostic (cxdiag);
+          continue;
+        }
+
+      clang_getFileLocation (cxloc, NULL, &line, &column, &offset);
+      if (line > 0) line--;
+      if (column > 0) column--;
+
+      severity = _ide_clang_translate_severity (clang_getDiagnosticSeverity (cxdiag));
+      cxstr = clang_getDiagnosticSpelling (cxdiag);
+      spelling = clang_getCString (cxstr);
+
+      /* Same heuristic as IdeClangTranslationUnit */
+      if ((severity == IDE_DIAGNOSTIC_WARNING) &&
+          (spelling != NULL) &&
+          (strstr (spelling, "deprecated") != NULL))
+        severity = IDE_DIAGNOSTIC_DEPRECATED;
+
+      g_variant_builder_init (&ranges, G_VARIANT_TYPE ("a(uuuu)"));
+
+      n = clang_getDiagnosticNumRanges (cxdiag);
+
+      for (j = 0; j < n; j++)
+        {
+          guint begin_line, begin_column, end_line, end_column;
+
+          if (get_range (clang_getDiagnosticRange (cxdiag, j), target,
+                         &begin_line, &begin_column, &end_line, &end_column))
+            g_variant_builder_add (&ranges, "(uuuu)",
+                                   begin_line, begin_column, end_line, end_column);
+        }
+
+      g_variant_builder_init (&fixits, G_VARIANT_TYPE ("a(uuuus)"));
+
+      n = clang_getDiagnosticNumFixIts (cxdiag);
+
+      for (j = 0; j < n; j++)
+        {
+          guint begin_line, begin_column, end_line, end_column;
+          CXSourceRange cxrange;
+          CXString fixit_str;
+
+          fixit_str = clang_getDiagnosticFixIt (cxdiag, j, &cxrange);
+
+          if (get_range (cxrange, target, &begin_line, &begin_column, &end_line, &end_column))
+            g_variant_builder_add (&fixits, "(uuuus)",
+                                   begin_line, begin_column, end_line, end_column,
+                                   clang_getCString (fixit_str) ?: "");
+
+          clang_disposeString (fixit_str);
+        }
+
+      g_variant_builder_add (&builder, "(us(uuu)a(uuuu)a(uuuus))",
+                             severity,
+                             spelling ?: "",
+                             line, column, offset,
+                             &ranges,
+                             &fixits);
+
+      clang_disposeString (cxstr);
+      clang_disposeDiagnostic (cxdiag);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static void
+clear_mapped_file (gpointer data)
+{
+  GMappedFile **mapped = data;
+
+  g_clear_pointer (mapped, g_mapped_file_unref);
+}
+
+/*
+ * Gets the unit for @path, parsing it if necessary. The unit is reparsed
+ * with the unsaved files if @reparse is set. On failure, an error is
+ * returned for @invocation and %NULL is returned. Otherwise, the unit must
+ * be given back with ide_clang_worker_push_unit().
+ */
+static WorkerUnit *
+ide_clang_worker_get_unit (IdeClangWorker        *self,
+                           GDBusMethodInvocation *invocation,
+                           const gchar           *path,
+                           const gchar * const   *argv,
+                           GVariantIter          *unsaved_iter,
+                           gboolean               reparse)
+{
+  g_autoptr(GArray) unsaved_files = NULL;
+  g_autoptr(GArray) mapped_files = NULL;
+  GUnixFDList *fd_list;
+  CXTranslationUnit tu = NULL;
+  enum CXErrorCode code;
+  WorkerUnit *unit;
+  const gchar *unsaved_path;
+  gint32 handle;
+
+  g_assert (IDE_IS_CLANG_WORKER (self));
+  g_assert (G_IS_DBUS_METHOD_INVOCATION (invocation));
+  g_assert (path != NULL);
+  g_assert (argv != NULL);
+  g_assert (unsaved_iter != NULL);
+
+  if (NULL != (unit = ide_clang_worker_take_unit (self, path, argv)) && !reparse)
+    return unit;
+
+  fd_list = g_dbus_message_get_unix_fd_list (g_dbus_method_invocation_get_message (invocation));
+
+  unsaved_files = g_array_new (FALSE, FALSE, sizeof (struct CXUnsavedFile));
+  mapped_files = g_array_new (FALSE, TRUE, sizeof (GMappedFile *));
+  g_array_set_clear_func (mapped_files, clear_mapped_file);
+
+  while (g_variant_iter_next (unsaved_iter, "(&sh)", &unsaved_path, &handle))
+    {
+      g_autoptr(GError) error = NULL;
+      struct CXUnsavedFile uf;
+      GMappedFile *mapped;
+      gint fd;
+
+      if (fd_list == NULL || -1 == (fd = g_unix_fd_list_get (fd_list, handle, &error)))
+        {
+          g_warning ("Failed to access unsaved file %s: %s",
+                     unsaved_path, error ? error->message : "missing file descriptor");
+          continue;
+        }
+
+      mapped = g_mapped_file_new_from_fd (fd, FALSE, &error);
+      close (fd);
+
+      if (mapped == NULL)
+        {
+          g_warning ("Failed to map unsaved file %s: %s", unsaved_path, error->message);
+          continue;
+        }
+
+      g_array_append_val (mapped_files, mapped);
+
+      uf.Filename = unsaved_path;
+      uf.Contents = g_mapped_file_get_contents (mapped) ?: "";
+      uf.Length = g_mapped_file_get_length (mapped);
+
+      g_array_append_val (unsaved_files, uf);
+    }
+
+  if (self->index == NULL)
+    {
+      self->index = clang_createIndex (0, 0);
+      clang_CXIndex_setGlobalOptions (self->index, CXGlobalOpt_ThreadBackgroundPriorityForAll);
+    }
+
+  if (unit != NULL)
+    {
+      /* On failure, the only valid thing to do is dispose the unit */
+      if (0 == clang_reparseTranslationUnit (unit->tu,
+                                             unsaved_files->len,
+                                             (struct CXUnsavedFile *)(gpointer)unsaved_files->data,
+                                             clang_defaultReparseOptions (unit->tu)))
+        return unit;
+
+      g_clear_pointer (&unit, worker_unit_free);
+    }
+
+  code = clang_parseTranslationUnit2 (self->index,
+                                      path,
+                                      argv,
+                                      g_strv_length ((gchar **)argv),
+                                      (struct CXUnsavedFile *)(gpointer)unsaved_files->data,
+                                      unsaved_files->len,
+                                      (clang_defaultEditingTranslationUnitOptions () |
+                                       CXTranslationUnit_DetailedPreprocessingRecord),
+                                      &tu);
+
+  if (code != CXError_Success || tu == NULL)
+    {
+      g_clear_pointer (&tu, clang_disposeTranslationUnit);
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_IO_ERROR,
+                                             G_IO_ERROR_FAILED,
+                                             _("Failed to create translation unit: %d"),
+                                             code);
+      return NULL;
+    }
+
+  unit = g_slice_new0 (WorkerUnit);
+  unit->path = g_strdup (path);
+  unit->argv = g_strdupv ((gchar **)argv);
+  unit->tu = tu;
+
+  return unit;
+}
+
+static void
+ide_clang_worker_diagnose (IdeClangWorker        *self,
+                           GVariant              *parameters,
+                           GDBusMethodInvocation *invocation)
+{
+  g_autoptr(IdeHighlightIndex) index = NULL;
+  g_autoptr(GVariantIter) unsaved_iter = NULL;
+  g_autofree const gchar **argv = NULL;
+  WorkerUnit *unit;
+  const gchar *path;
+  const gchar *target;
+  GVariant *diagnostics;
+
+  g_assert (IDE_IS_CLANG_WORKER (self));
+  g_assert (G_IS_DBUS_METHOD_INVOCATION (invocation));
+
+  g_variant_get (parameters, "(&s^a&sa(sh)&s)", &path, &argv, &unsaved_iter, &target);
+
+  if (!(unit = ide_clang_worker_get_unit (self, invocation, path, argv, unsaved_iter, TRUE)))
+    return;
+
+  diagnostics = ide_clang_worker_build_diagnostics (unit->tu, target);
+
+  if (NULL == (index = _ide_clang_build_index (unit->tu, path)))
+    index = ide_highlight_index_new ();
+
+  ide_clang_worker_push_unit (self, unit);
+
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(@" IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE_STRING "@a{sas})",
+                                                        diagnostics,
+                                                        ide_highlight_index_to_variant (index)));
+}
+
+static void
+ide_clang_worker_lookup_symbol (IdeClangWorker        *self,
+                                GVariant              *parameters,
+                                GDBusMethodInvocation *invocation)
+{
+  g_autoptr(GVariantIter) unsaved_iter = NULL;
+  g_autofree const gchar **argv = NULL;
+  WorkerUnit *unit;
+  const gchar *path;
+  GVariant *symbol;
+  guint line;
+  guint line_offset;
+
+  g_assert (IDE_IS_CLANG_WORKER (self));
+  g_assert (G_IS_DBUS_METHOD_INVOCATION (invocation));
+
+  g_variant_get (parameters, "(&s^a&sa(sh)uu)", &path, &argv, &unsaved_iter, &line, &line_offset);
+
+  if (!(unit = ide_clang_worker_get_unit (self, invocation, path, argv, unsaved_iter, FALSE)))
+    return;
+
+  symbol = _ide_clang_lookup_symbol (unit->tu, path, line, line_offset);
+
+  ide_clang_worker_push_unit (self, unit);
+
+  if (symbol == NULL)
+    g_dbus_method_invocation_return_error (invocation,
+                                           G_IO_ERROR,
+                                           G_IO_ERROR_NOT_FOUND,
+                                           _("Failed to locate symbol"));
+  else
+    g_dbus_method_invocation_return_value (invocation, symbol);
+}
+
+static void
+ide_clang_worker_get_symbol_tree (IdeClangWorker        *self,
+                                  GVariant              *parameters,
+                                  GDBusMethodInvocation *invocation)
+{
+  g_autoptr(GVariantIter) unsaved_iter = NULL;
+  g_autofree const gchar **argv = NULL;
+  WorkerUnit *unit;
+  const gchar *path;
+  GVariant *nodes;
+
+  g_assert (IDE_IS_CLANG_WORKER (self));
+  g_assert (G_IS_DBUS_METHOD_INVOCATION (invocation));
+
+  g_variant_get (parameters, "(&s^a&sa(sh))", &path, &argv, &unsaved_iter);
+
+  if (!(unit = ide_clang_worker_get_unit (self, invocation, path, argv, unsaved_iter, FALSE)))
+    return;
+
+  nodes = _ide_clang_build_symbol_tree (unit->tu, path);
+
+  ide_clang_worker_push_unit (self, unit);
+
+  g_dbus_method_invocation_return_value (invocation, g_variant_new_tuple (&nodes, 1));
+}
+
+static void
+ide_clang_worker_method_call (GDBusConnection       *connection,
+                              const gchar           *sender,
+                              const gchar           *object_path,
+                              const gchar           *interface_name,
+                              const gchar           *method_name,
+                              GVariant              *parameters,
+                              GDBusMethodInvocation *invocation,
+                              gpointer               user_data)
+{
+  IdeClangWorker *self = user_data;
+
+  g_assert (IDE_IS_CLANG_WORKER (self));
+
+  /*
+   * Requests are handled one at a time on the main thread of the worker.
+   * Parallelism comes from the pool of worker processes instead, which
+   * keeps us from having to synchronize access to the units.
+   */
+  if (g_strcmp0 (method_name, "Diagnose") == 0)
+    ide_clang_worker_diagnose (self, parameters, invocation);
+  else if (g_strcmp0 (method_name, "LookupSymbol") == 0)
+    ide_clang_worker_lookup_symbol (self, parameters, invocation);
+  else if (g_strcmp0 (method_name, "GetSymbolTree") == 0)
+    ide_clang_worker_get_symbol_tree (self, parameters, invocation);
+  else
+    g_dbus_method_invocation_return_error (invocation,
+                                           G_DBUS_ERROR,
+                                           G_DBUS_ERROR_UNKNOWN_METHOD,
+                                           "No such method %s",
+                                           method_name);
+}
+
+static const GDBusInterfaceVTable vtable = {
+  ide_clang_worker_method_call,
+};
+
+static GDBusInterfaceInfo *
+get_interface_info (void)
+{
+  static GDBusNodeInfo *node_info;
+
+  if (g_once_init_enter (&node_info))
+    g_once_init_leave (&node_info, g_dbus_node_info_new_for_xml (introspection_xml, NULL));
+
+  return node_info->interfaces [0];
+}
+
+static void
+ide_clang_worker_register_service (IdeWorker       *worker,
+                                   GDBusConnection *connection)
+{
+  IdeClangWorker *self = (IdeClangWorker *)worker;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (IDE_IS_CLANG_WORKER (self));
+  g_assert (G_IS_DBUS_CONNECTION (connection));
+
+  if (0 == g_dbus_connection_register_object (connection,
+                                              IDE_CLANG_WORKER_OBJECT_PATH,
+                                              get_interface_info (),
+                                              &vtable,
+                                              g_object_ref (self),
+                                              g_object_unref,
+                                              &error))
+    g_warning ("%s", error->message);
+}
+
+static GDBusProxy *
+ide_clang_worker_create_proxy (IdeWorker        *worker,
+                               GDBusConnection  *connection,
+                               GError          **error)
+{
+  g_assert (IDE_IS_CLANG_WORKER (worker));
+  g_assert (G_IS_DBUS_CONNECTION (connection));
+
+  return g_dbus_proxy_new_sync (connection,
+                                (G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                 G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS),
+                                get_interface_info (),
+                                NULL,
+                                IDE_CLANG_WORKER_OBJECT_PATH,
+                                IDE_CLANG_WORKER_INTERFACE_NAME,
+                                NULL,
+                                error);
+}
+
+static void
+ide_clang_worker_finalize (GObject *object)
+{
+  IdeClangWorker *self = (IdeClangWorker *)object;
+
+  g_queue_foreach (&self->units, (GFunc)worker_unit_free, NULL);
+  g_queue_clear (&self->units);
+  g_clear_pointer (&self->index, clang_disposeIndex);
+
+  G_OBJECT_CLASS (ide_clang_worker_parent_class)->finalize (object);
+}
+
+static void
+ide_clang_worker_class_init (IdeClangWorkerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_clang_worker_finalize;
+}
+
+static void
+ide_clang_worker_init (IdeClangWorker *self)
+{
+  g_queue_init (&self->units);
+}
+
+static void
+worker_iface_init (IdeWorkerInterface *iface)
+{
+  iface->register_service = ide_clang_worker_register_service;
+  iface->create_proxy = ide_clang_worker_create_proxy;
+}
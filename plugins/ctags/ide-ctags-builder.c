@@ -29,6 +29,7 @@
 
 EGG_DEFINE_COUNTER (instances, "IdeCtagsBuilder", "Instances", "Number of IdeCtagsBuilder instances.")
 EGG_DEFINE_COUNTER (parse_count, "IdeCtagsBuilder", "Build Count", "Number of build attempts.");
+EGG_DEFINE_COUNTER (partial_count, "IdeCtagsBuilder", "Partial Build Count", "Number of per-file build attempts.");
 
 struct _IdeCtagsBuilder
 {
@@ -58,6 +59,40 @@ ide_ctags_builder_new (void)
   return g_object_new (IDE_TYPE_CTAGS_BUILDER, NULL);
 }
 
+static GPtrArray *
+ide_ctags_builder_new_argv (IdeCtagsBuilder *self,
+                            gboolean         recurse)
+{
+  g_autofree gchar *options_path = NULL;
+  GPtrArray *argv;
+
+  g_assert (IDE_IS_CTAGS_BUILDER (self));
+
+  options_path = g_build_filename (g_get_user_config_dir (),
+                                   ide_get_program_name (),
+                                   "ctags.conf",
+                                   NULL);
+
+  argv = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (argv, g_strdup (g_quark_to_string (self->ctags_path)));
+  g_ptr_array_add (argv, g_strdup ("-f"));
+  g_ptr_array_add (argv, g_strdup ("-"));
+  if (recurse)
+    g_ptr_array_add (argv, g_strdup ("--recurse=yes"));
+  g_ptr_array_add (argv, g_strdup ("--tag-relative=no"));
+  g_ptr_array_add (argv, g_strdup ("--exclude=.git"));
+  g_ptr_array_add (argv, g_strdup ("--exclude=.bzr"));
+  g_ptr_array_add (argv, g_strdup ("--exclude=.svn"));
+  g_ptr_array_add (argv, g_strdup ("--sort=yes"));
+  g_ptr_array_add (argv, g_strdup ("--languages=all"));
+  g_ptr_array_add (argv, g_strdup ("--file-scope=yes"));
+  g_ptr_array_add (argv, g_strdup ("--c-kinds=+defgpstx"));
+  if (g_file_test (options_path, G_FILE_TEST_IS_REGULAR))
+    g_ptr_array_add (argv, g_strdup_printf ("--options=%s", options_path));
+
+  return argv;
+}
+
 static void
 ide_ctags_builder_build_cb (GObject      *object,
                             GAsyncResult *result,
@@ -126,7 +161,6 @@ ide_ctags_builder_build_worker (GTask        *task,
   g_autofree gchar *tags_file = NULL;
   g_autofree gchar *tags_filename = NULL;
   g_autofree gchar *workpath = NULL;
-  g_autofree gchar *options_path = NULL;
   g_autofree gchar *tagsdir = NULL;
   IdeContext *context;
   IdeProject *project;
@@ -154,10 +188,6 @@ ide_ctags_builder_build_worker (GTask        *task,
                                 "tags",
                                 tags_filename,
                                 NULL);
-  options_path = g_build_filename (g_get_user_config_dir (),
-                                   ide_get_program_name (),
-                                   "ctags.conf",
-                                   NULL);
   ide_object_release (IDE_OBJECT (self));
 
   /*
@@ -181,21 +211,7 @@ ide_ctags_builder_build_worker (GTask        *task,
   if (g_file_test (tags_file, G_FILE_TEST_EXISTS))
     g_unlink (tags_file);
 
-  argv = g_ptr_array_new_with_free_func (g_free);
-  g_ptr_array_add (argv, g_strdup (g_quark_to_string (self->ctags_path)));
-  g_ptr_array_add (argv, g_strdup ("-f"));
-  g_ptr_array_add (argv, g_strdup ("-"));
-  g_ptr_array_add (argv, g_strdup ("--recurse=yes"));
-  g_ptr_array_add (argv, g_strdup ("--tag-relative=no"));
-  g_ptr_array_add (argv, g_strdup ("--exclude=.git"));
-  g_ptr_array_add (argv, g_strdup ("--exclude=.bzr"));
-  g_ptr_array_add (argv, g_strdup ("--exclude=.svn"));
-  g_ptr_array_add (argv, g_strdup ("--sort=yes"));
-  g_ptr_array_add (argv, g_strdup ("--languages=all"));
-  g_ptr_array_add (argv, g_strdup ("--file-scope=yes"));
-  g_ptr_array_add (argv, g_strdup ("--c-kinds=+defgpstx"));
-  if (g_file_test (options_path, G_FILE_TEST_IS_REGULAR))
-    g_ptr_array_add (argv, g_strdup_printf ("--options=%s", options_path));
+  argv = ide_ctags_builder_new_argv (self, TRUE);
   g_ptr_array_add (argv, g_strdup ("."));
   g_ptr_array_add (argv, NULL);
 
@@ -247,6 +263,149 @@ ide_ctags_builder_rebuild (IdeCtagsBuilder *self)
   ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER, task, ide_ctags_builder_build_worker);
 }
 
+static void
+ide_ctags_builder_communicate_cb (GObject      *object,
+                                  GAsyncResult *result,
+                                  gpointer      user_data)
+{
+  GSubprocess *process = (GSubprocess *)object;
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(GBytes) stdout_buf = NULL;
+  GError *error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (G_IS_SUBPROCESS (process));
+  g_assert (G_IS_TASK (task));
+
+  if (!g_subprocess_communicate_finish (process, result, &stdout_buf, NULL, &error))
+    {
+      g_task_return_error (task, error);
+      IDE_EXIT;
+    }
+
+  if (stdout_buf == NULL)
+    stdout_buf = g_bytes_new (NULL, 0);
+
+  g_task_return_pointer (task, g_bytes_ref (stdout_buf), (GDestroyNotify)g_bytes_unref);
+
+  IDE_EXIT;
+}
+
+/**
+ * ide_ctags_builder_build_files_async:
+ * @self: An #IdeCtagsBuilder
+ * @files: (element-type GFile): the files to generate tags for
+ *
+ * Runs ctags on just @files instead of the whole project tree. The tags are
+ * returned in memory (sorted, with paths relative to the working directory)
+ * so that they can be merged into an existing index as a delta.
+ *
+ * Files that are not within the working directory of the project are
+ * ignored.
+ */
+void
+ide_ctags_builder_build_files_async (IdeCtagsBuilder     *self,
+                                     GPtrArray           *files,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  g_autoptr(GSubprocessLauncher) launcher = NULL;
+  g_autoptr(GSubprocess) process = NULL;
+  g_autoptr(GPtrArray) argv = NULL;
+  g_autofree gchar *workpath = NULL;
+  IdeContext *context;
+  GFile *workdir;
+  IdeVcs *vcs;
+  GError *error = NULL;
+  guint n_files = 0;
+  guint i;
+
+  IDE_ENTRY;
+
+  g_return_if_fail (IDE_IS_CTAGS_BUILDER (self));
+  g_return_if_fail (files != NULL);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  vcs = ide_context_get_vcs (context);
+  workdir = ide_vcs_get_working_directory (vcs);
+
+  if (!(workpath = g_file_get_path (workdir)))
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_INVALID_FILENAME,
+                               "ctags can only operate on local files.");
+      IDE_EXIT;
+    }
+
+  argv = ide_ctags_builder_new_argv (self, FALSE);
+
+  for (i = 0; i < files->len; i++)
+    {
+      GFile *file = g_ptr_array_index (files, i);
+      g_autofree gchar *relative = NULL;
+
+      g_assert (G_IS_FILE (file));
+
+      if (!(relative = g_file_get_relative_path (workdir, file)))
+        continue;
+
+      /* Match the "./" prefix produced when tagging the whole tree. */
+      g_ptr_array_add (argv, g_strdup_printf ("./%s", relative));
+      n_files++;
+    }
+
+  if (n_files == 0)
+    {
+      g_task_return_pointer (task, g_bytes_new (NULL, 0), (GDestroyNotify)g_bytes_unref);
+      IDE_EXIT;
+    }
+
+  g_ptr_array_add (argv, NULL);
+
+  launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE);
+  g_subprocess_launcher_set_cwd (launcher, workpath);
+  process = g_subprocess_launcher_spawnv (launcher, (const gchar * const *)argv->pdata, &error);
+
+  EGG_COUNTER_INC (partial_count);
+
+  if (process == NULL)
+    {
+      g_task_return_error (task, error);
+      IDE_EXIT;
+    }
+
+  g_subprocess_communicate_async (process,
+                                  NULL,
+                                  cancellable,
+                                  ide_ctags_builder_communicate_cb,
+                                  g_object_ref (task));
+
+  IDE_EXIT;
+}
+
+/**
+ * ide_ctags_builder_build_files_finish:
+ *
+ * Returns: (transfer full): A #GBytes containing the generated tags.
+ */
+GBytes *
+ide_ctags_builder_build_files_finish (IdeCtagsBuilder  *self,
+                                      GAsyncResult     *result,
+                                      GError          **error)
+{
+  g_return_val_if_fail (IDE_IS_CTAGS_BUILDER (self), NULL);
+  g_return_val_if_fail (G_IS_TASK (result), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 static void
 ide_ctags_builder__ctags_path_changed (IdeCtagsBuilder *self,
                                        const gchar     *key,
@@ -27,8 +27,16 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (IdeCtagsBuilder, ide_ctags_builder, IDE, CTAGS_BUILDER, IdeObject)
 
-IdeCtagsBuilder *ide_ctags_builder_new     (void);
-void             ide_ctags_builder_rebuild (IdeCtagsBuilder *self);
+IdeCtagsBuilder *ide_ctags_builder_new                (void);
+void             ide_ctags_builder_rebuild            (IdeCtagsBuilder      *self);
+void             ide_ctags_builder_build_files_async  (IdeCtagsBuilder      *self,
+                                                       GPtrArray            *files,
+                                                       GCancellable         *cancellable,
+                                                       GAsyncReadyCallback   callback,
+                                                       gpointer              user_data);
+GBytes          *ide_ctags_builder_build_files_finish (IdeCtagsBuilder      *self,
+                                                       GAsyncResult         *result,
+                                                       GError              **error);
 
 G_END_DECLS
 
@@ -29,8 +29,10 @@
 struct _IdeCtagsCompletionItem
 {
   IdeCompletionItem           parent_instance;
-  const IdeCtagsIndexEntry   *entry;
   IdeCtagsCompletionProvider *provider;
+
+  /* The strings are owned by the index, which the results keep alive */
+  IdeCtagsIndexEntry          entry;
 };
 
 static void proposal_iface_init (GtkSourceCompletionProposalIface *iface);
@@ -53,7 +55,7 @@ ide_ctags_completion_item_new (IdeCtagsCompletionProvider *provider,
 
   self = g_object_new (IDE_TYPE_CTAGS_COMPLETION_ITEM, NULL);
   self->provider = provider;
-  self->entry = entry;
+  self->entry = *entry;
 
   return self;
 }
@@ -62,7 +64,7 @@ gint
 ide_ctags_completion_item_compare (IdeCtagsCompletionItem *itema,
                                    IdeCtagsCompletionItem *itemb)
 {
-  return ide_ctags_index_entry_compare (itema->entry, itemb->entry);
+  return ide_ctags_index_entry_compare (&itema->entry, &itemb->entry);
 }
 
 static gboolean
@@ -72,9 +74,9 @@ ide_ctags_completion_item_match (IdeCompletionItem *item,
 {
   IdeCtagsCompletionItem *self = (IdeCtagsCompletionItem *)item;
 
-  if (ide_completion_item_fuzzy_match (self->entry->name, casefold, &item->priority))
+  if (ide_completion_item_fuzzy_match (self->entry.name, casefold, &item->priority))
     {
-      if (!ide_str_equal0 (self->entry->name, query))
+      if (!ide_str_equal0 (self->entry.name, query))
         return TRUE;
     }
 
@@ -117,9 +119,9 @@ get_markup (GtkSourceCompletionProposal *proposal)
   IdeCtagsCompletionItem *self = (IdeCtagsCompletionItem *)proposal;
 
   if (self->provider->current_word != NULL)
-    return ide_completion_item_fuzzy_highlight (self->entry->name, self->provider->current_word);
+    return ide_completion_item_fuzzy_highlight (self->entry.name, self->provider->current_word);
 
-  return g_strdup (self->entry->name);
+  return g_strdup (self->entry.name);
 }
 
 static gchar *
@@ -127,7 +129,7 @@ get_text (GtkSourceCompletionProposal *proposal)
 {
   IdeCtagsCompletionItem *self = (IdeCtagsCompletionItem *)proposal;
 
-  return g_strdup (self->entry->name);
+  return g_strdup (self->entry.name);
 }
 
 static const gchar *
@@ -136,10 +138,7 @@ get_icon_name (GtkSourceCompletionProposal *proposal)
   IdeCtagsCompletionItem *self = (IdeCtagsCompletionItem *)proposal;
   const gchar *icon_name = NULL;
 
-  if (self->entry == NULL)
-    return NULL;
-
-  switch (self->entry->kind)
+  switch (self->entry.kind)
     {
     case IDE_CTAGS_INDEX_ENTRY_CLASS_NAME:
       icon_name = "lang-class-symbolic";
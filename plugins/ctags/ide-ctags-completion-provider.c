@@ -205,9 +205,8 @@ ide_ctags_completion_provider_populate (GtkSourceCompletionProvider *provider,
     {
       g_autofree gchar *copy = g_strdup (self->current_word);
       IdeCtagsIndex *index = g_ptr_array_index (self->indexes, i);
-      const IdeCtagsIndexEntry *entries = NULL;
+      g_autoptr(GArray) entries = NULL;
       guint tmp_len = word_len;
-      gsize n_entries = 0;
       gchar gdata_key[64];
 
       /*
@@ -220,16 +219,21 @@ ide_ctags_completion_provider_populate (GtkSourceCompletionProvider *provider,
 
       while (entries == NULL && *copy)
         {
-          if (!(entries = ide_ctags_index_lookup_prefix (index, copy, &n_entries)))
-            copy [--tmp_len] = '\0';
+          entries = ide_ctags_index_lookup_prefix (index, copy);
+
+          if (entries->len == 0)
+            {
+              g_clear_pointer (&entries, g_array_unref);
+              copy [--tmp_len] = '\0';
+            }
         }
 
-      if ((entries == NULL) || (n_entries == 0))
+      if (entries == NULL)
         continue;
 
-      for (j = 0; j < n_entries; j++)
+      for (j = 0; j < entries->len; j++)
         {
-          const IdeCtagsIndexEntry *entry = &entries [j];
+          const IdeCtagsIndexEntry *entry = &g_array_index (entries, IdeCtagsIndexEntry, j);
           IdeCtagsCompletionItem *item;
 
           if (g_hash_table_contains (completions, entry->name))
@@ -27,6 +27,8 @@ struct _IdeCtagsHighlighter
 {
   IdeObject           parent_instance;
 
+  /* indexes is also read from IdeHighlighter::compute, so guard it. */
+  GMutex              mutex;
   GPtrArray          *indexes;
   IdeCtagsService    *service;
   IdeHighlightEngine *engine;
@@ -100,28 +102,37 @@ get_tag_from_kind (IdeCtagsIndexEntryKind kind)
 }
 
 static const gchar *
-get_tag (IdeCtagsHighlighter *self,
-         IdeFile             *file,
-         const gchar         *word)
+get_tag (GPtrArray   *indexes,
+         const gchar *file_path,
+         const gchar *word)
 {
-  const gchar *file_path = ide_file_get_path (file);
-  const IdeCtagsIndexEntry *entries;
-  gsize n_entries;
   gsize i;
-  gsize j;
 
-  for (i = 0; i < self->indexes->len; i++)
+  for (i = 0; i < indexes->len; i++)
     {
-      IdeCtagsIndex *item = g_ptr_array_index (self->indexes, i);
-      entries = ide_ctags_index_lookup_prefix (item, word, &n_entries);
-      if ((entries == NULL) || (n_entries == 0))
+      IdeCtagsIndex *item = g_ptr_array_index (indexes, i);
+      IdeCtagsIndexEntryKind first_kind = 0;
+      IdeCtagsIndexEntry entry;
+      IdeCtagsIndexIter iter;
+      gboolean found = FALSE;
+
+      if (!ide_ctags_index_lookup_full (item, word, TRUE, &iter))
         continue;
 
-      for (j = 0; j < n_entries; j++)
-        if (ide_str_equal0 (entries[j].path, file_path))
-          return get_tag_from_kind (entries[j].kind);
+      while (ide_ctags_index_iter_next (&iter, &entry))
+        {
+          if (ide_str_equal0 (entry.path, file_path))
+            return get_tag_from_kind (entry.kind);
 
-      return get_tag_from_kind (entries[0].kind);
+          if (!found)
+            {
+              first_kind = entry.kind;
+              found = TRUE;
+            }
+        }
+
+      if (found)
+        return get_tag_from_kind (first_kind);
     }
 
   return NULL;
@@ -134,6 +145,7 @@ ide_ctags_highlighter_real_update (IdeHighlighter       *highlighter,
                                    const GtkTextIter    *range_end,
                                    GtkTextIter          *location)
 {
+  IdeCtagsHighlighter *self = (IdeCtagsHighlighter *)highlighter;
   GtkTextBuffer *text_buffer;
   GtkSourceBuffer *source_buffer;
   IdeBuffer *buffer;
@@ -174,7 +186,7 @@ ide_ctags_highlighter_real_update (IdeHighlighter       *highlighter,
           gchar *word;
 
           word = gtk_text_iter_get_slice (&begin, &end);
-          tag = get_tag (IDE_CTAGS_HIGHLIGHTER (highlighter), file, word);
+          tag = get_tag (self->indexes, ide_file_get_path (file), word);
           g_free (word);
 
           if (tag != NULL)
@@ -194,6 +206,110 @@ completed:
   *location = *range_end;
 }
 
+static GPtrArray *
+ide_ctags_highlighter_copy_indexes (IdeCtagsHighlighter *self)
+{
+  GPtrArray *ret;
+  guint i;
+
+  g_assert (IDE_IS_CTAGS_HIGHLIGHTER (self));
+
+  g_mutex_lock (&self->mutex);
+  ret = g_ptr_array_new_full (self->indexes->len, g_object_unref);
+  for (i = 0; i < self->indexes->len; i++)
+    g_ptr_array_add (ret, g_object_ref (g_ptr_array_index (self->indexes, i)));
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+static void
+ide_ctags_highlighter_real_compute (IdeHighlighter *highlighter,
+                                    IdeFile        *file,
+                                    GBytes         *content,
+                                    guint           begin_offset,
+                                    guint           end_offset,
+                                    GArray         *spans,
+                                    GCancellable   *cancellable)
+{
+  IdeCtagsHighlighter *self = (IdeCtagsHighlighter *)highlighter;
+  g_autoptr(GPtrArray) indexes = NULL;
+  g_autoptr(GString) word = NULL;
+  const gchar *file_path;
+  const gchar *text;
+  const gchar *iter;
+  const gchar *text_end;
+  guint offset = 0;
+  guint word_begin = 0;
+  gsize len;
+
+  g_assert (IDE_IS_CTAGS_HIGHLIGHTER (self));
+  g_assert (IDE_IS_FILE (file));
+  g_assert (content != NULL);
+  g_assert (spans != NULL);
+
+  indexes = ide_ctags_highlighter_copy_indexes (self);
+
+  if (indexes->len == 0)
+    return;
+
+  if (!(text = g_bytes_get_data (content, &len)))
+    return;
+
+  text_end = text + len;
+
+  for (iter = text; iter < text_end && offset < begin_offset; offset++)
+    iter = g_utf8_next_char (iter);
+
+  file_path = ide_file_get_path (file);
+  word = g_string_new (NULL);
+
+  /*
+   * Walk the words in the range, same as the update() path. We don't have
+   * the buffer's context classes here, so strings and comments are filtered
+   * by the engine when applying the spans.
+   */
+  for (; iter < text_end && offset < end_offset; iter = g_utf8_next_char (iter), offset++)
+    {
+      gunichar ch = g_utf8_get_char (iter);
+
+      if (accepts_char (ch))
+        {
+          if (word->len == 0)
+            word_begin = offset;
+          g_string_append_len (word, iter, g_utf8_next_char (iter) - iter);
+          continue;
+        }
+
+      if (word->len > 0)
+        {
+          const gchar *tag;
+
+          if ((tag = get_tag (indexes, file_path, word->str)))
+            {
+              IdeHighlightSpan span = { word_begin, offset, tag, IDE_HIGHLIGHT_SPAN_CODE_ONLY };
+              g_array_append_val (spans, span);
+            }
+
+          g_string_truncate (word, 0);
+
+          if (g_cancellable_is_cancelled (cancellable))
+            return;
+        }
+    }
+
+  if (word->len > 0)
+    {
+      const gchar *tag;
+
+      if ((tag = get_tag (indexes, file_path, word->str)))
+        {
+          IdeHighlightSpan span = { word_begin, offset, tag, IDE_HIGHLIGHT_SPAN_CODE_ONLY };
+          g_array_append_val (spans, span);
+        }
+    }
+}
+
 void
 ide_ctags_highlighter_add_index (IdeCtagsHighlighter *self,
                                  IdeCtagsIndex       *index)
@@ -212,6 +328,8 @@ ide_ctags_highlighter_add_index (IdeCtagsHighlighter *self,
 
   file = ide_ctags_index_get_file (index);
 
+  g_mutex_lock (&self->mutex);
+
   for (i = 0; i < self->indexes->len; i++)
     {
       IdeCtagsIndex *item = g_ptr_array_index (self->indexes, i);
@@ -221,6 +339,7 @@ ide_ctags_highlighter_add_index (IdeCtagsHighlighter *self,
         {
           /* Steal the existing slot in the index to preserve ordering. */
           g_ptr_array_index (self->indexes, i) = g_object_ref (index);
+          g_mutex_unlock (&self->mutex);
           g_object_unref (item);
 
           IDE_EXIT;
@@ -229,6 +348,8 @@ ide_ctags_highlighter_add_index (IdeCtagsHighlighter *self,
 
   g_ptr_array_add (self->indexes, g_object_ref (index));
 
+  g_mutex_unlock (&self->mutex);
+
   IDE_EXIT;
 }
 
@@ -265,6 +386,7 @@ ide_ctags_highlighter_finalize (GObject *object)
     }
 
   g_clear_pointer (&self->indexes, g_ptr_array_unref);
+  g_mutex_clear (&self->mutex);
 
   G_OBJECT_CLASS (ide_ctags_highlighter_parent_class)->finalize (object);
 }
@@ -285,6 +407,7 @@ ide_ctags_highlighter_class_finalize (IdeCtagsHighlighterClass *klass)
 static void
 ide_ctags_highlighter_init (IdeCtagsHighlighter *self)
 {
+  g_mutex_init (&self->mutex);
   self->indexes = g_ptr_array_new_with_free_func (g_object_unref);
 }
 
@@ -293,6 +416,7 @@ highlighter_iface_init (IdeHighlighterInterface *iface)
 {
   iface->update = ide_ctags_highlighter_real_update;
   iface->set_engine = ide_ctags_highlighter_real_set_engine;
+  iface->compute = ide_ctags_highlighter_real_compute;
 }
 
 void
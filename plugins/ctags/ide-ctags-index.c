@@ -19,23 +19,129 @@
 #define G_LOG_DOMAIN "ide-ctags-index"
 
 #include <egg-counter.h>
+#include <errno.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <ide.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "ide-ctags-index.h"
 
+/*
+ * Parsing a large tags file is expensive and requires keeping the whole
+ * file on the heap, since entries point into it. So the first time a tags
+ * file is loaded we compile it into a binary table in the user cache
+ * directory which later loads (and other windows) simply map read-only.
+ *
+ *   IdeCtagsCompiledHeader
+ *   IdeCtagsCompiledEntry  [n_entries]  sorted like ide_ctags_index_entry_compare()
+ *   IdeCtagsCompiledNode   [n_nodes]    trie nodes, the root is node 0
+ *   IdeCtagsCompiledEdge   [n_edges]    trie edges, grouped by node
+ *   guint32                [n_paths]    paths replaced by this table
+ *   gchar                  [strings_len] deduplicated \0 terminated strings
+ *
+ * Entries are resolved from the records on demand, so loading a table does
+ * not allocate anything proportional to the number of entries.
+ *
+ * The trie is keyed by the bytes of the entry names. Each edge covers the
+ * range of entries which share the prefix leading to it, and only edges
+ * covering more than TRIE_SPLIT_THRESHOLD entries get a child node. So
+ * lookups walk the trie as far as it goes and then bisect the (small)
+ * remaining range, while the trie itself stays small even for huge files.
+ *
+ * Deltas use the same format and are written next to the compiled index
+ * with a ".delta" suffix. They carry the generation of the compiled index
+ * they apply to, and their paths section lists the files they shadow.
+ */
+#define COMPILED_MAGIC       0x32495443 /* CTI2 */
+#define COMPILED_VERSION     2
+#define COMPILED_NONE        G_MAXUINT32
+#define TRIE_SPLIT_THRESHOLD 64
+#define TRIE_MAX_DEPTH       4
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint64 source_mtime;
+  guint64 source_size;
+  guint64 generation;
+  guint32 n_entries;
+  guint32 n_nodes;
+  guint32 n_edges;
+  guint32 n_paths;
+  guint32 n_deltas;
+  guint32 padding;
+  guint64 entries_offset;
+  guint64 nodes_offset;
+  guint64 edges_offset;
+  guint64 paths_offset;
+  guint64 strings_offset;
+  guint64 strings_len;
+} IdeCtagsCompiledHeader;
+
+typedef struct
+{
+  guint32 name;
+  guint32 path;
+  guint32 pattern;
+  guint32 keyval;
+  guint8  kind;
+  guint8  padding[3];
+} IdeCtagsCompiledEntry;
+
+typedef struct
+{
+  guint32 first_edge;
+  guint32 n_edges;
+} IdeCtagsCompiledNode;
+
+typedef struct
+{
+  guint32 begin;
+  guint32 end;
+  guint32 child;
+  guint8  byte;
+  guint8  padding[3];
+} IdeCtagsCompiledEdge;
+
+G_STATIC_ASSERT (sizeof (IdeCtagsCompiledHeader) == 104);
+G_STATIC_ASSERT (sizeof (IdeCtagsCompiledEntry) == 20);
+G_STATIC_ASSERT (sizeof (IdeCtagsCompiledNode) == 8);
+G_STATIC_ASSERT (sizeof (IdeCtagsCompiledEdge) == 16);
+
+typedef struct
+{
+  volatile gint                 ref_count;
+  GMappedFile                  *mapped;
+  GBytes                       *bytes;
+  const IdeCtagsCompiledHeader *header;
+  const IdeCtagsCompiledEntry  *entries;
+  const IdeCtagsCompiledNode   *nodes;
+  const IdeCtagsCompiledEdge   *edges;
+  const guint32                *paths;
+  const gchar                  *strings;
+} IdeCtagsTable;
+
 struct _IdeCtagsIndex
 {
-  IdeObject  parent_instance;
+  IdeObject      parent_instance;
+
+  /* The compiled tags file */
+  IdeCtagsTable *base;
+
+  /*
+   * Entries for the files that were re-tagged since the base was compiled.
+   * Entries of the base belonging to those files are shadowed.
+   */
+  IdeCtagsTable *overlay;
+  GHashTable    *shadowed;
 
-  GArray    *index;
-  GBytes    *buffer;
-  GFile     *file;
-  gchar     *path_root;
+  GFile         *file;
+  gchar         *path_root;
 
-  guint64    mtime;
+  guint64        mtime;
 };
 
 enum {
@@ -53,38 +159,12 @@ G_DEFINE_DYNAMIC_TYPE_EXTENDED (IdeCtagsIndex, ide_ctags_index, IDE_TYPE_OBJECT,
                                                        async_initable_iface_init))
 
 EGG_DEFINE_COUNTER (instances, "IdeCtagsIndex", "Instances", "Number of IdeCtagsIndex instances.")
-EGG_DEFINE_COUNTER (index_entries, "IdeCtagsIndex", "N Entries", "Number of entries in indexes.")
-EGG_DEFINE_COUNTER (heap_size, "IdeCtagsIndex", "Heap Size", "Size of index string heaps.")
+EGG_DEFINE_COUNTER (index_entries, "IdeCtagsIndex", "N Entries", "Number of entries in compiled tables.")
+EGG_DEFINE_COUNTER (heap_size, "IdeCtagsIndex", "Heap Size", "Size of compiled tables on the heap.")
+EGG_DEFINE_COUNTER (mapped_size, "IdeCtagsIndex", "Mapped Size", "Size of mapped compiled tables.")
 
 static GParamSpec *properties [LAST_PROP];
 
-static gint
-ide_ctags_index_entry_compare_keyword (gconstpointer a,
-                                       gconstpointer b)
-{
-  const IdeCtagsIndexEntry *entrya = a;
-  const IdeCtagsIndexEntry *entryb = b;
-
-  return g_strcmp0 (entrya->name, entryb->name);
-}
-
-static gint
-ide_ctags_index_entry_compare_prefix (gconstpointer a,
-                                      gconstpointer b)
-{
-  const IdeCtagsIndexEntry *entrya = a;
-  const IdeCtagsIndexEntry *entryb = b;
-
-  /*
-   * With bsearch(), the first element is always the key.
-   */
-
-  if (g_str_has_prefix (entryb->name, entrya->name))
-    return 0;
-  else
-    return g_strcmp0 (entrya->name, entryb->name);
-}
-
 gint
 ide_ctags_index_entry_compare (gconstpointer a,
                                gconstpointer b)
@@ -183,32 +263,16 @@ ide_ctags_index_parse_line (gchar              *line,
   return TRUE;
 }
 
-static void
-ide_ctags_index_build_index (GTask        *task,
-                             gpointer      source_object,
-                             gpointer      task_data,
-                             GCancellable *cancellable)
+static GArray *
+ide_ctags_index_parse (gchar *contents,
+                       gsize  length)
 {
-  IdeCtagsIndex *self = source_object;
   IdeLineReader reader;
-  GError *error = NULL;
-  GArray *index = NULL;
-  gchar *contents = NULL;
+  GArray *index;
   gchar *line;
-  gsize length = 0;
   gsize line_length;
 
-  IDE_ENTRY;
-
-  g_assert (G_IS_TASK (task));
-  g_assert (IDE_IS_CTAGS_INDEX (self));
-  g_assert (G_IS_FILE (self->file));
-
-  if (!g_file_load_contents (self->file, cancellable, &contents, &length, NULL, &error))
-    IDE_GOTO (failure);
-
-  if (length > G_MAXSSIZE)
-    IDE_GOTO (failure);
+  g_assert (contents != NULL);
 
   index = g_array_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry));
 
@@ -239,20 +303,815 @@ ide_ctags_index_build_index (GTask        *task,
 
   g_array_sort (index, ide_ctags_index_entry_compare);
 
-  self->index = index;
-  self->buffer = g_bytes_new_take (contents, length);
+  return index;
+}
+
+static const gchar *
+skip_dot_slash (const gchar *path)
+{
+  while (path [0] == '.' && path [1] == '/')
+    path += 2;
+  return path;
+}
+
+static gchar *
+ide_ctags_index_get_compiled_path (GFile       *file,
+                                   const gchar *suffix)
+{
+  g_autofree gchar *uri = NULL;
+  g_autofree gchar *checksum = NULL;
+  g_autofree gchar *name = NULL;
+
+  g_assert (G_IS_FILE (file));
+  g_assert (suffix != NULL);
+
+  uri = g_file_get_uri (file);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+  name = g_strconcat (checksum, suffix, NULL);
+
+  return g_build_filename (g_get_user_cache_dir (),
+                           ide_get_program_name (),
+                           "tags",
+                           "compiled",
+                           name,
+                           NULL);
+}
+
+static guint32
+intern_string (GHashTable  *strings,
+               GByteArray  *heap,
+               const gchar *str)
+{
+  gpointer value;
+  guint32 offset;
+
+  g_assert (strings != NULL);
+  g_assert (heap != NULL);
+
+  if (str == NULL)
+    return COMPILED_NONE;
+
+  if (g_hash_table_lookup_extended (strings, str, NULL, &value))
+    return GPOINTER_TO_UINT (value);
+
+  offset = heap->len;
+  g_byte_array_append (heap, (const guint8 *)str, strlen (str) + 1);
+  g_hash_table_insert (strings, (gchar *)str, GUINT_TO_POINTER (offset));
+
+  return offset;
+}
+
+/*
+ * Builds the trie node for the entries within [begin,end), which all share
+ * the first @depth bytes of their name. Returns the index of the node.
+ */
+static guint32
+ide_ctags_compile_node (GArray *entries,
+                        GArray *nodes,
+                        GArray *edges,
+                        guint   begin,
+                        guint   end,
+                        guint   depth)
+{
+  IdeCtagsCompiledNode node;
+  guint32 node_index;
+  guint i;
+
+  g_assert (entries != NULL);
+  g_assert (nodes != NULL);
+  g_assert (edges != NULL);
+  g_assert (begin <= end);
+
+  node_index = nodes->len;
+  node.first_edge = edges->len;
+  node.n_edges = 0;
+
+  for (i = begin; i < end;)
+    {
+      const IdeCtagsIndexEntry *entry = &g_array_index (entries, IdeCtagsIndexEntry, i);
+      IdeCtagsCompiledEdge edge = { 0 };
+      guint8 byte = (guint8)entry->name [depth];
+
+      edge.begin = i;
+      edge.byte = byte;
+
+      /* Names ending at this depth sort first and are never split further */
+      for (i++; i < end; i++)
+        {
+          entry = &g_array_index (entries, IdeCtagsIndexEntry, i);
+          if ((guint8)entry->name [depth] != byte)
+            break;
+        }
+
+      edge.end = i;
+      g_array_append_val (edges, edge);
+      node.n_edges++;
+    }
+
+  g_array_append_val (nodes, node);
+
+  if (depth + 1 >= TRIE_MAX_DEPTH)
+    return node_index;
+
+  /* Children are appended after all of our edges so the edges stay grouped */
+  for (i = 0; i < node.n_edges; i++)
+    {
+      IdeCtagsCompiledEdge *edge = &g_array_index (edges, IdeCtagsCompiledEdge, node.first_edge + i);
+      guint32 child;
+
+      if (edge->byte == '\0' || edge->end - edge->begin <= TRIE_SPLIT_THRESHOLD)
+        continue;
+
+      child = ide_ctags_compile_node (entries, nodes, edges, edge->begin, edge->end, depth + 1);
+
+      /* The array may have been reallocated by the recursion */
+      edge = &g_array_index (edges, IdeCtagsCompiledEdge, node.first_edge + i);
+      edge->child = child;
+    }
+
+  return node_index;
+}
+
+/*
+ * Compiles @entries, which must be sorted with ide_ctags_index_entry_compare(),
+ * into the binary format described at the top of this file. The strings of
+ * @entries and @paths are copied.
+ */
+static GBytes *
+ide_ctags_compile (GArray     *entries,
+                   GPtrArray  *paths,
+                   guint64     source_mtime,
+                   guint64     source_size,
+                   guint64     generation,
+                   guint       n_deltas,
+                   GError    **error)
+{
+  g_autoptr(GHashTable) strings = NULL;
+  g_autoptr(GByteArray) heap = NULL;
+  g_autoptr(GArray) records = NULL;
+  g_autoptr(GArray) nodes = NULL;
+  g_autoptr(GArray) edges = NULL;
+  g_autoptr(GArray) path_offsets = NULL;
+  IdeCtagsCompiledHeader header = { 0 };
+  GByteArray *image;
+  guint i;
+
+  g_assert (entries != NULL);
+
+  /*
+   * Paths and patterns are heavily repeated within tags files, so the
+   * string table is deduplicated which makes it much smaller than the
+   * source file.
+   */
+  strings = g_hash_table_new (g_str_hash, g_str_equal);
+  heap = g_byte_array_new ();
+  records = g_array_sized_new (FALSE, FALSE, sizeof (IdeCtagsCompiledEntry), entries->len);
+  nodes = g_array_new (FALSE, FALSE, sizeof (IdeCtagsCompiledNode));
+  edges = g_array_new (FALSE, FALSE, sizeof (IdeCtagsCompiledEdge));
+  path_offsets = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+  for (i = 0; i < entries->len; i++)
+    {
+      const IdeCtagsIndexEntry *entry = &g_array_index (entries, IdeCtagsIndexEntry, i);
+      IdeCtagsCompiledEntry compiled = { 0 };
+
+      compiled.name = intern_string (strings, heap, entry->name);
+      compiled.path = intern_string (strings, heap, entry->path);
+      compiled.pattern = intern_string (strings, heap, entry->pattern);
+      compiled.keyval = intern_string (strings, heap, entry->keyval);
+      compiled.kind = entry->kind;
+
+      g_array_append_val (records, compiled);
+    }
+
+  if (paths != NULL)
+    {
+      for (i = 0; i < paths->len; i++)
+        {
+          guint32 offset = intern_string (strings, heap, g_ptr_array_index (paths, i));
+          g_array_append_val (path_offsets, offset);
+        }
+    }
+
+  if (heap->len >= COMPILED_NONE || entries->len >= COMPILED_NONE)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "ctags file is too large to compile");
+      return NULL;
+    }
+
+  ide_ctags_compile_node (entries, nodes, edges, 0, entries->len, 0);
+
+  header.magic = COMPILED_MAGIC;
+  header.version = COMPILED_VERSION;
+  header.source_mtime = source_mtime;
+  header.source_size = source_size;
+  header.generation = generation;
+  header.n_entries = records->len;
+  header.n_nodes = nodes->len;
+  header.n_edges = edges->len;
+  header.n_paths = path_offsets->len;
+  header.n_deltas = n_deltas;
+  header.entries_offset = sizeof header;
+  header.nodes_offset = header.entries_offset + (guint64)records->len * sizeof (IdeCtagsCompiledEntry);
+  header.edges_offset = header.nodes_offset + (guint64)nodes->len * sizeof (IdeCtagsCompiledNode);
+  header.paths_offset = header.edges_offset + (guint64)edges->len * sizeof (IdeCtagsCompiledEdge);
+  header.strings_offset = header.paths_offset + (guint64)path_offsets->len * sizeof (guint32);
+  header.strings_len = heap->len;
+
+  image = g_byte_array_sized_new (header.strings_offset + header.strings_len);
+  g_byte_array_append (image, (const guint8 *)&header, sizeof header);
+  g_byte_array_append (image, (const guint8 *)records->data, records->len * sizeof (IdeCtagsCompiledEntry));
+  g_byte_array_append (image, (const guint8 *)nodes->data, nodes->len * sizeof (IdeCtagsCompiledNode));
+  g_byte_array_append (image, (const guint8 *)edges->data, edges->len * sizeof (IdeCtagsCompiledEdge));
+  g_byte_array_append (image, (const guint8 *)path_offsets->data, path_offsets->len * sizeof (guint32));
+  g_byte_array_append (image, heap->data, heap->len);
+
+  return g_byte_array_free_to_bytes (image);
+}
+
+static inline gboolean
+section_is_valid (gsize   len,
+                  guint64 offset,
+                  guint64 n_items,
+                  gsize   item_size)
+{
+  return offset <= len &&
+         (offset % 4) == 0 &&
+         n_items <= (len - offset) / item_size;
+}
+
+/*
+ * Validates the structure of the trie so that lookups never leave the
+ * bounds of the table. Every node but the root must be the child of
+ * exactly one edge, and children always come after their parent, which
+ * guarantees that walking the trie terminates.
+ */
+static gboolean
+ide_ctags_table_validate_trie (const IdeCtagsTable *table)
+{
+  const IdeCtagsCompiledHeader *header = table->header;
+  g_autofree guint32 *ranges = NULL;
+  guint i;
+
+  if (header->n_nodes == 0)
+    return FALSE;
+
+  ranges = g_new (guint32, (gsize)header->n_nodes * 2);
+  for (i = 0; i < header->n_nodes * 2; i++)
+    ranges [i] = COMPILED_NONE;
+
+  ranges [0] = 0;
+  ranges [1] = header->n_entries;
+
+  for (i = 0; i < header->n_nodes; i++)
+    {
+      const IdeCtagsCompiledNode *node = &table->nodes [i];
+      guint32 begin = ranges [i * 2];
+      guint32 end = ranges [i * 2 + 1];
+      guint32 last = begin;
+      guint j;
+
+      if (begin == COMPILED_NONE ||
+          node->first_edge > header->n_edges ||
+          node->n_edges > header->n_edges - node->first_edge ||
+          node->n_edges > 256)
+        return FALSE;
+
+      for (j = 0; j < node->n_edges; j++)
+        {
+          const IdeCtagsCompiledEdge *edge = &table->edges [node->first_edge + j];
+
+          if (edge->begin < last ||
+              edge->end < edge->begin ||
+              edge->end > end ||
+              (j > 0 && edge->byte <= table->edges [node->first_edge + j - 1].byte))
+            return FALSE;
+
+          last = edge->end;
+
+          if (edge->child != 0)
+            {
+              if (edge->child <= i ||
+                  edge->child >= header->n_nodes ||
+                  ranges [edge->child * 2] != COMPILED_NONE)
+                return FALSE;
+
+              ranges [edge->child * 2] = edge->begin;
+              ranges [edge->child * 2 + 1] = edge->end;
+            }
+        }
+    }
+
+  return TRUE;
+}
+
+static void
+ide_ctags_table_free (IdeCtagsTable *table)
+{
+  EGG_COUNTER_SUB (index_entries, (gint64)table->header->n_entries);
+
+  if (table->mapped != NULL)
+    EGG_COUNTER_SUB (mapped_size, (gint64)g_mapped_file_get_length (table->mapped));
+  else
+    EGG_COUNTER_SUB (heap_size, (gint64)g_bytes_get_size (table->bytes));
+
+  g_clear_pointer (&table->mapped, g_mapped_file_unref);
+  g_clear_pointer (&table->bytes, g_bytes_unref);
+  g_slice_free (IdeCtagsTable, table);
+}
+
+static IdeCtagsTable *
+ide_ctags_table_ref (IdeCtagsTable *table)
+{
+  g_assert (table != NULL);
+  g_assert (table->ref_count > 0);
+
+  g_atomic_int_inc (&table->ref_count);
+
+  return table;
+}
+
+static void
+ide_ctags_table_unref (IdeCtagsTable *table)
+{
+  g_assert (table != NULL);
+  g_assert (table->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&table->ref_count))
+    ide_ctags_table_free (table);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeCtagsTable, ide_ctags_table_unref)
+
+/*
+ * Creates a table from the contents of either @mapped or @bytes after
+ * checking that every section lies within the data. Records are not
+ * inspected here, they are checked as they are resolved.
+ */
+static IdeCtagsTable *
+ide_ctags_table_new (GMappedFile  *mapped,
+                     GBytes       *bytes,
+                     GError      **error)
+{
+  const IdeCtagsCompiledHeader *header;
+  IdeCtagsTable *table;
+  const gchar *contents;
+  gsize len;
+
+  g_assert (mapped != NULL || bytes != NULL);
+
+  if (mapped != NULL)
+    {
+      contents = g_mapped_file_get_contents (mapped);
+      len = g_mapped_file_get_length (mapped);
+    }
+  else
+    {
+      contents = g_bytes_get_data (bytes, &len);
+    }
+
+  header = (const IdeCtagsCompiledHeader *)(gconstpointer)contents;
+
+  if (contents == NULL ||
+      len < sizeof *header ||
+      header->magic != COMPILED_MAGIC ||
+      header->version != COMPILED_VERSION ||
+      !section_is_valid (len, header->entries_offset, header->n_entries, sizeof (IdeCtagsCompiledEntry)) ||
+      !section_is_valid (len, header->nodes_offset, header->n_nodes, sizeof (IdeCtagsCompiledNode)) ||
+      !section_is_valid (len, header->edges_offset, header->n_edges, sizeof (IdeCtagsCompiledEdge)) ||
+      !section_is_valid (len, header->paths_offset, header->n_paths, sizeof (guint32)) ||
+      header->strings_offset > len ||
+      header->strings_len > len - header->strings_offset ||
+      header->strings_len >= COMPILED_NONE ||
+      (header->strings_len > 0 && contents [header->strings_offset + header->strings_len - 1] != '\0'))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Compiled ctags index is invalid");
+      return NULL;
+    }
+
+  table = g_slice_new0 (IdeCtagsTable);
+  table->ref_count = 1;
+  table->header = header;
+  table->entries = (const IdeCtagsCompiledEntry *)(gconstpointer)(contents + header->entries_offset);
+  table->nodes = (const IdeCtagsCompiledNode *)(gconstpointer)(contents + header->nodes_offset);
+  table->edges = (const IdeCtagsCompiledEdge *)(gconstpointer)(contents + header->edges_offset);
+  table->paths = (const guint32 *)(gconstpointer)(contents + header->paths_offset);
+  table->strings = contents + header->strings_offset;
+
+  if (!ide_ctags_table_validate_trie (table))
+    {
+      g_slice_free (IdeCtagsTable, table);
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Compiled ctags index is corrupt");
+      return NULL;
+    }
+
+  if (mapped != NULL)
+    {
+      table->mapped = g_mapped_file_ref (mapped);
+      EGG_COUNTER_ADD (mapped_size, (gint64)len);
+    }
+  else
+    {
+      table->bytes = g_bytes_ref (bytes);
+      EGG_COUNTER_ADD (heap_size, (gint64)len);
+    }
+
+  EGG_COUNTER_ADD (index_entries, (gint64)header->n_entries);
+
+  return table;
+}
+
+static IdeCtagsTable *
+ide_ctags_table_new_for_path (const gchar  *path,
+                              GError      **error)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+
+  g_assert (path != NULL);
+
+  if (!(mapped = g_mapped_file_new (path, FALSE, error)))
+    return NULL;
+
+  return ide_ctags_table_new (mapped, NULL, error);
+}
+
+static inline const gchar *
+ide_ctags_table_get_string (const IdeCtagsTable *table,
+                            guint32              offset)
+{
+  /* This also catches COMPILED_NONE */
+  if (offset >= table->header->strings_len)
+    return NULL;
+  return table->strings + offset;
+}
+
+static inline const gchar *
+ide_ctags_table_get_name (const IdeCtagsTable *table,
+                          guint                position)
+{
+  const gchar *name = ide_ctags_table_get_string (table, table->entries [position].name);
+
+  return name ? name : "";
+}
+
+static void
+ide_ctags_table_get_entry (const IdeCtagsTable *table,
+                           guint                position,
+                           IdeCtagsIndexEntry  *entry)
+{
+  const IdeCtagsCompiledEntry *record;
+
+  g_assert (table != NULL);
+  g_assert (position < table->header->n_entries);
+  g_assert (entry != NULL);
+
+  record = &table->entries [position];
+
+  entry->name = ide_ctags_table_get_name (table, position);
+  entry->path = ide_ctags_table_get_string (table, record->path);
+  entry->pattern = ide_ctags_table_get_string (table, record->pattern);
+  entry->keyval = ide_ctags_table_get_string (table, record->keyval);
+  entry->kind = record->kind;
+
+  if (entry->path == NULL)
+    entry->path = "";
+
+  if (entry->pattern == NULL)
+    entry->pattern = "";
+}
+
+static const IdeCtagsCompiledEdge *
+ide_ctags_table_find_edge (const IdeCtagsTable *table,
+                           guint32              node_index,
+                           guint8               byte)
+{
+  const IdeCtagsCompiledNode *node = &table->nodes [node_index];
+  guint begin = node->first_edge;
+  guint end = node->first_edge + node->n_edges;
+
+  while (begin < end)
+    {
+      guint mid = begin + ((end - begin) / 2);
+      const IdeCtagsCompiledEdge *edge = &table->edges [mid];
+
+      if (edge->byte == byte)
+        return edge;
+      else if (edge->byte < byte)
+        begin = mid + 1;
+      else
+        end = mid;
+    }
+
+  return NULL;
+}
+
+/*
+ * Gets the range of entries whose name is @keyword, or starts with
+ * @keyword if @is_prefix is set.
+ */
+static void
+ide_ctags_table_lookup (const IdeCtagsTable *table,
+                        const gchar         *keyword,
+                        gboolean             is_prefix,
+                        guint               *begin,
+                        guint               *end)
+{
+  const guint8 *key = (const guint8 *)keyword;
+  gsize keyword_len = strlen (keyword);
+  guint32 node_index = 0;
+  guint depth = 0;
+  guint lo = 0;
+  guint hi = table->header->n_entries;
+  guint limit;
+  guint first;
+  guint mid;
+
+  g_assert (table != NULL);
+  g_assert (keyword != NULL);
+  g_assert (begin != NULL);
+  g_assert (end != NULL);
+
+  /* Walk the trie as far as it goes to narrow the range */
+  while (key [depth] != '\0')
+    {
+      const IdeCtagsCompiledEdge *edge;
+
+      if (!(edge = ide_ctags_table_find_edge (table, node_index, key [depth])))
+        {
+          *begin = *end = 0;
+          return;
+        }
+
+      lo = edge->begin;
+      hi = edge->end;
+      depth++;
+
+      if (edge->child == 0)
+        break;
+
+      node_index = edge->child;
+    }
+
+  limit = hi;
+
+  /* Then bisect to the first match */
+  while (lo < hi)
+    {
+      mid = lo + ((hi - lo) / 2);
+
+      if (strcmp (ide_ctags_table_get_name (table, mid), keyword) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  first = lo;
+
+  /* And to the entry after the last match */
+  hi = limit;
+  while (lo < hi)
+    {
+      const gchar *name;
+      gint cmp;
+
+      mid = lo + ((hi - lo) / 2);
+      name = ide_ctags_table_get_name (table, mid);
+      cmp = is_prefix ? strncmp (name, keyword, keyword_len) : strcmp (name, keyword);
+
+      if (cmp <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  *begin = first;
+  *end = lo;
+}
+
+static gboolean
+ide_ctags_index_is_shadowed (IdeCtagsIndex *self,
+                             const gchar   *path)
+{
+  return self->shadowed != NULL &&
+         g_hash_table_contains (self->shadowed, skip_dot_slash (path));
+}
+
+static void
+ide_ctags_index_set_overlay (IdeCtagsIndex *self,
+                             IdeCtagsTable *overlay)
+{
+  guint i;
+
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+  g_assert (self->overlay == NULL);
+  g_assert (overlay != NULL);
+
+  self->overlay = overlay;
+  self->shadowed = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Keys point into the string table of the overlay */
+  for (i = 0; i < overlay->header->n_paths; i++)
+    {
+      const gchar *path = ide_ctags_table_get_string (overlay, overlay->paths [i]);
+
+      if (path != NULL)
+        g_hash_table_add (self->shadowed, (gchar *)skip_dot_slash (path));
+    }
+}
+
+/*
+ * Compiles @entries and writes the result to @compiled_path, then maps the
+ * file. If the file cannot be written we fall back to keeping the compiled
+ * table on the heap.
+ */
+static IdeCtagsTable *
+ide_ctags_index_compile_table (GArray       *entries,
+                               GPtrArray    *paths,
+                               const gchar  *compiled_path,
+                               guint64       source_mtime,
+                               guint64       source_size,
+                               guint64       generation,
+                               guint         n_deltas,
+                               GError      **error)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) write_error = NULL;
+  g_autofree gchar *compiled_dir = NULL;
+  IdeCtagsTable *table;
+
+  g_assert (entries != NULL);
+
+  bytes = ide_ctags_compile (entries, paths, source_mtime, source_size,
+                             generation, n_deltas, error);
 
-  EGG_COUNTER_ADD (index_entries, (gint64)index->len);
-  EGG_COUNTER_ADD (heap_size, (gint64)length);
+  if (bytes == NULL)
+    return NULL;
+
+  if (compiled_path != NULL)
+    {
+      compiled_dir = g_path_get_dirname (compiled_path);
+
+      if (g_mkdir_with_parents (compiled_dir, 0750) != 0)
+        g_set_error (&write_error,
+                     G_IO_ERROR,
+                     g_io_error_from_errno (errno),
+                     "Failed to create directory \"%s\"",
+                     compiled_dir);
+      else if (g_file_set_contents (compiled_path,
+                                    g_bytes_get_data (bytes, NULL),
+                                    g_bytes_get_size (bytes),
+                                    &write_error) &&
+               (table = ide_ctags_table_new_for_path (compiled_path, &write_error)))
+        return table;
+
+      g_debug ("Failed to write compiled ctags index: %s", write_error->message);
+    }
+
+  return ide_ctags_table_new (NULL, bytes, error);
+}
+
+static guint64
+ide_ctags_index_new_generation (IdeCtagsTable *previous)
+{
+  guint64 generation = g_get_real_time ();
+
+  if (previous != NULL && previous->header->generation >= generation)
+    generation = previous->header->generation + 1;
+
+  return generation;
+}
+
+/*
+ * Loads the delta persisted for the compiled index of @self, if it still
+ * applies to it. Stale or corrupt deltas are removed.
+ */
+static void
+ide_ctags_index_load_overlay (IdeCtagsIndex *self)
+{
+  g_autofree gchar *delta_path = NULL;
+  g_autoptr(GError) error = NULL;
+  IdeCtagsTable *overlay;
+
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+  g_assert (self->base != NULL);
+
+  delta_path = ide_ctags_index_get_compiled_path (self->file, ".delta");
+
+  if (!(overlay = ide_ctags_table_new_for_path (delta_path, &error)))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+          g_debug ("Discarding ctags delta: %s", error->message);
+          g_unlink (delta_path);
+        }
+      return;
+    }
+
+  if (overlay->header->generation != self->base->header->generation ||
+      overlay->header->source_mtime != self->base->header->source_mtime ||
+      overlay->header->source_size != self->base->header->source_size ||
+      overlay->header->n_deltas == 0)
+    {
+      g_debug ("Discarding stale ctags delta");
+      ide_ctags_table_unref (overlay);
+      g_unlink (delta_path);
+      return;
+    }
+
+  ide_ctags_index_set_overlay (self, overlay);
+}
+
+static void
+ide_ctags_index_build_index (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  IdeCtagsIndex *self = source_object;
+  g_autoptr(GFileInfo) info = NULL;
+  g_autoptr(GError) compile_error = NULL;
+  g_autoptr(GArray) index = NULL;
+  g_autofree gchar *compiled_path = NULL;
+  g_autofree gchar *delta_path = NULL;
+  g_autofree gchar *contents = NULL;
+  IdeCtagsTable *table;
+  GError *error = NULL;
+  guint64 source_mtime;
+  guint64 source_size;
+  gsize length = 0;
+
+  IDE_ENTRY;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+  g_assert (G_IS_FILE (self->file));
+
+  info = g_file_query_info (self->file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                            G_FILE_QUERY_INFO_NONE,
+                            cancellable,
+                            &error);
+
+  if (info == NULL)
+    IDE_GOTO (failure);
+
+  source_mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  source_size = g_file_info_get_size (info);
+  compiled_path = ide_ctags_index_get_compiled_path (self->file, ".idx");
+
+  if ((table = ide_ctags_table_new_for_path (compiled_path, &compile_error)))
+    {
+      if (table->header->source_mtime == source_mtime &&
+          table->header->source_size == source_size &&
+          table->header->n_paths == 0)
+        {
+          self->base = table;
+          ide_ctags_index_load_overlay (self);
+          g_task_return_boolean (task, TRUE);
+          IDE_EXIT;
+        }
+
+      ide_ctags_table_unref (table);
+    }
+
+  g_clear_error (&compile_error);
+
+  if (!g_file_load_contents (self->file, cancellable, &contents, &length, NULL, &error))
+    IDE_GOTO (failure);
+
+  index = ide_ctags_index_parse (contents, length);
+
+  /* Deltas against the previous compiled index no longer apply */
+  delta_path = ide_ctags_index_get_compiled_path (self->file, ".delta");
+  g_unlink (delta_path);
+
+  /*
+   * Compile the index for future loads, and then switch to the compiled
+   * version so that we can release the parsed contents of the file.
+   */
+  self->base = ide_ctags_index_compile_table (index, NULL, compiled_path,
+                                              source_mtime, source_size,
+                                              ide_ctags_index_new_generation (NULL), 0,
+                                              &error);
+
+  if (self->base == NULL)
+    IDE_GOTO (failure);
 
   g_task_return_boolean (task, TRUE);
 
   IDE_EXIT;
 
 failure:
-  g_clear_pointer (&contents, g_free);
-  g_clear_pointer (&index, g_array_unref);
-
   if (error != NULL)
     g_task_return_error (task, error);
   else
@@ -356,18 +1215,10 @@ ide_ctags_index_finalize (GObject *object)
 {
   IdeCtagsIndex *self = (IdeCtagsIndex *)object;
 
-  if (self->index != NULL)
-    EGG_COUNTER_SUB (index_entries, (gint64)self->index->len);
-
-  if (self->buffer != NULL)
-    {
-      gsize len = g_bytes_get_size (self->buffer);
-      EGG_COUNTER_SUB (heap_size, (gint64)len);
-    }
-
   g_clear_object (&self->file);
-  g_clear_pointer (&self->index, g_array_unref);
-  g_clear_pointer (&self->buffer, g_bytes_unref);
+  g_clear_pointer (&self->shadowed, g_hash_table_unref);
+  g_clear_pointer (&self->overlay, ide_ctags_table_unref);
+  g_clear_pointer (&self->base, ide_ctags_table_unref);
   g_clear_pointer (&self->path_root, g_free);
 
   G_OBJECT_CLASS (ide_ctags_index_parent_class)->finalize (object);
@@ -493,6 +1344,222 @@ ide_ctags_index_new (GFile       *file,
                        NULL);
 }
 
+/**
+ * ide_ctags_index_new_with_delta:
+ * @base: An #IdeCtagsIndex that has been loaded
+ * @delta: the ctags output for @paths
+ * @paths: (array zero-terminated=1): the paths that were re-tagged,
+ *   relative to the path root of @base
+ * @error: a location for a #GError, or %NULL
+ *
+ * Creates a new index containing every entry of @base that does not belong
+ * to one of @paths, plus all of the entries found in @delta. This allows
+ * re-tagging a handful of saved files without regenerating the whole tags
+ * file for the project.
+ *
+ * The new index shares the compiled tags file of @base. The entries of
+ * @delta, and those of previous deltas for other files, are compiled into
+ * an overlay which shadows the entries of the re-tagged files. So the cost
+ * of a delta only depends on the number of files re-tagged so far.
+ *
+ * The overlay is written next to the compiled tags file so that it is
+ * applied again the next time the tags file is loaded. Use
+ * ide_ctags_index_compact() to merge it into the compiled tags file.
+ *
+ * This function may be called from a thread.
+ *
+ * Returns: (transfer full): A new #IdeCtagsIndex, or %NULL upon failure.
+ */
+IdeCtagsIndex *
+ide_ctags_index_new_with_delta (IdeCtagsIndex        *base,
+                                GBytes               *delta,
+                                const gchar * const  *paths,
+                                GError              **error)
+{
+  g_autoptr(GHashTable) replaced = NULL;
+  g_autoptr(GPtrArray) shadowed = NULL;
+  g_autoptr(GArray) delta_index = NULL;
+  g_autoptr(GArray) entries = NULL;
+  g_autofree gchar *contents = NULL;
+  g_autofree gchar *delta_path = NULL;
+  IdeCtagsTable *overlay;
+  IdeCtagsIndex *self;
+  GHashTableIter iter;
+  gpointer key;
+  gsize length;
+  guint i;
+
+  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (base), NULL);
+  g_return_val_if_fail (base->base != NULL, NULL);
+  g_return_val_if_fail (delta != NULL, NULL);
+  g_return_val_if_fail (paths != NULL, NULL);
+
+  /* The files shadowed by the new overlay, both old and new */
+  replaced = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; paths [i]; i++)
+    g_hash_table_add (replaced, (gchar *)skip_dot_slash (paths [i]));
+
+  shadowed = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, replaced);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_ptr_array_add (shadowed, key);
+
+  if (base->shadowed != NULL)
+    {
+      g_hash_table_iter_init (&iter, base->shadowed);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          if (!g_hash_table_contains (replaced, key))
+            g_ptr_array_add (shadowed, key);
+        }
+    }
+
+  /*
+   * The parser writes a \0 over the end of each line, so make sure the
+   * last line has somewhere to put it.
+   */
+  length = g_bytes_get_size (delta);
+  contents = g_malloc (length + 1);
+  memcpy (contents, g_bytes_get_data (delta, NULL), length);
+  contents [length] = '\0';
+
+  delta_index = ide_ctags_index_parse (contents, length);
+
+  /* Keep the entries of previous deltas for files that were not re-tagged */
+  entries = g_array_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry));
+
+  if (base->overlay != NULL)
+    {
+      for (i = 0; i < base->overlay->header->n_entries; i++)
+        {
+          IdeCtagsIndexEntry entry;
+
+          ide_ctags_table_get_entry (base->overlay, i, &entry);
+
+          if (!g_hash_table_contains (replaced, skip_dot_slash (entry.path)))
+            g_array_append_val (entries, entry);
+        }
+    }
+
+  g_array_append_vals (entries, delta_index->data, delta_index->len);
+  g_array_sort (entries, ide_ctags_index_entry_compare);
+
+  delta_path = ide_ctags_index_get_compiled_path (base->file, ".delta");
+  overlay = ide_ctags_index_compile_table (entries, shadowed, delta_path,
+                                           base->base->header->source_mtime,
+                                           base->base->header->source_size,
+                                           base->base->header->generation,
+                                           ide_ctags_index_get_n_deltas (base) + 1,
+                                           error);
+
+  if (overlay == NULL)
+    return NULL;
+
+  self = g_object_new (IDE_TYPE_CTAGS_INDEX,
+                       "file", base->file,
+                       "path-root", base->path_root,
+                       "mtime", base->mtime,
+                       NULL);
+
+  self->base = ide_ctags_table_ref (base->base);
+  ide_ctags_index_set_overlay (self, overlay);
+
+  return self;
+}
+
+/**
+ * ide_ctags_index_get_n_deltas:
+ *
+ * Gets the number of deltas that have been merged on top of the compiled
+ * tags file.
+ */
+guint
+ide_ctags_index_get_n_deltas (IdeCtagsIndex *self)
+{
+  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), 0);
+
+  if (self->overlay != NULL)
+    return self->overlay->header->n_deltas;
+
+  return 0;
+}
+
+static GArray *
+ide_ctags_index_collect (IdeCtagsIndex *self,
+                         const gchar   *keyword,
+                         gboolean       is_prefix)
+{
+  IdeCtagsIndexIter iter;
+  IdeCtagsIndexEntry entry;
+  GArray *ar;
+
+  ar = g_array_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry));
+
+  if (ide_ctags_index_lookup_full (self, keyword, is_prefix, &iter))
+    {
+      while (ide_ctags_index_iter_next (&iter, &entry))
+        g_array_append_val (ar, entry);
+    }
+
+  return ar;
+}
+
+/**
+ * ide_ctags_index_compact:
+ * @self: An #IdeCtagsIndex
+ * @error: a location for a #GError, or %NULL
+ *
+ * Merges the deltas of @self into its compiled tags file, without running
+ * ctags again. The entries of @self are already sorted, so this is a
+ * single pass over them.
+ *
+ * The persisted delta is removed, and the compiled tags file gets a new
+ * generation so that a delta written concurrently against the previous
+ * one is never applied to it.
+ *
+ * This function may be called from a thread.
+ *
+ * Returns: (transfer full): A new #IdeCtagsIndex without deltas, or %NULL
+ *   upon failure.
+ */
+IdeCtagsIndex *
+ide_ctags_index_compact (IdeCtagsIndex  *self,
+                         GError        **error)
+{
+  g_autoptr(GArray) entries = NULL;
+  g_autofree gchar *compiled_path = NULL;
+  g_autofree gchar *delta_path = NULL;
+  IdeCtagsIndex *ret;
+  IdeCtagsTable *table;
+
+  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), NULL);
+  g_return_val_if_fail (self->base != NULL, NULL);
+
+  entries = ide_ctags_index_collect (self, "", TRUE);
+
+  compiled_path = ide_ctags_index_get_compiled_path (self->file, ".idx");
+  table = ide_ctags_index_compile_table (entries, NULL, compiled_path,
+                                         self->base->header->source_mtime,
+                                         self->base->header->source_size,
+                                         ide_ctags_index_new_generation (self->base), 0,
+                                         error);
+
+  if (table == NULL)
+    return NULL;
+
+  delta_path = ide_ctags_index_get_compiled_path (self->file, ".delta");
+  g_unlink (delta_path);
+
+  ret = g_object_new (IDE_TYPE_CTAGS_INDEX,
+                      "file", self->file,
+                      "path-root", self->path_root,
+                      "mtime", self->mtime,
+                      NULL);
+  ret->base = table;
+
+  return ret;
+}
+
 const gchar *
 ide_ctags_index_get_path_root (IdeCtagsIndex *self)
 {
@@ -501,77 +1568,147 @@ ide_ctags_index_get_path_root (IdeCtagsIndex *self)
   return self->path_root;
 }
 
+/**
+ * ide_ctags_index_get_size:
+ *
+ * Gets the number of entries in the index. Entries of the compiled tags
+ * file that are shadowed by a delta are included, so this is an upper
+ * bound when ide_ctags_index_get_n_deltas() is not zero.
+ */
 gsize
 ide_ctags_index_get_size (IdeCtagsIndex *self)
 {
+  gsize ret = 0;
+
   g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), 0);
 
-  if (self->index != NULL)
-    return self->index->len;
+  if (self->base != NULL)
+    ret += self->base->header->n_entries;
 
-  return 0;
+  if (self->overlay != NULL)
+    ret += self->overlay->header->n_entries;
+
+  return ret;
+}
+
+/**
+ * ide_ctags_index_get_memory_usage:
+ *
+ * Gets the approximate number of bytes of heap memory used by the index.
+ * Memory mapped from a compiled index is not included since it may be
+ * reclaimed by the kernel at any time.
+ */
+gsize
+ide_ctags_index_get_memory_usage (IdeCtagsIndex *self)
+{
+  gsize ret = sizeof *self;
+
+  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), 0);
+
+  if (self->base != NULL && self->base->bytes != NULL)
+    ret += g_bytes_get_size (self->base->bytes);
+
+  if (self->overlay != NULL && self->overlay->bytes != NULL)
+    ret += g_bytes_get_size (self->overlay->bytes);
+
+  return ret;
 }
 
-static const IdeCtagsIndexEntry *
-ide_ctags_index_lookup_full (IdeCtagsIndex *self,
-                             const gchar   *keyword,
-                             gsize         *length,
-                             GCompareFunc   compare_func)
+/**
+ * ide_ctags_index_lookup_full:
+ * @self: An #IdeCtagsIndex
+ * @keyword: the name to look for
+ * @is_prefix: if entries whose name starts with @keyword should match
+ * @iter: (out caller-allocates): An #IdeCtagsIndexIter
+ *
+ * Initializes @iter to walk the entries matching @keyword, in sorted
+ * order. Use ide_ctags_index_iter_next() to resolve them.
+ *
+ * Returns: %TRUE if there may be matching entries.
+ */
+gboolean
+ide_ctags_index_lookup_full (IdeCtagsIndex     *self,
+                             const gchar       *keyword,
+                             gboolean           is_prefix,
+                             IdeCtagsIndexIter *iter)
 {
-  IdeCtagsIndexEntry key = { 0 };
-  IdeCtagsIndexEntry *ret;
+  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), FALSE);
+  g_return_val_if_fail (keyword != NULL, FALSE);
+  g_return_val_if_fail (iter != NULL, FALSE);
 
-  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), NULL);
-  g_return_val_if_fail (keyword != NULL, NULL);
+  memset (iter, 0, sizeof *iter);
+  iter->index = self;
 
-  if (length != NULL)
-    *length = 0;
+  if (self->base != NULL)
+    ide_ctags_table_lookup (self->base, keyword, is_prefix,
+                            &iter->base_pos, &iter->base_end);
 
-  if ((self->index == NULL) || (self->index->data == NULL) || (self->index->len == 0))
-    return NULL;
+  if (self->overlay != NULL)
+    ide_ctags_table_lookup (self->overlay, keyword, is_prefix,
+                            &iter->overlay_pos, &iter->overlay_end);
 
-  key.name = keyword;
+  return iter->base_pos < iter->base_end || iter->overlay_pos < iter->overlay_end;
+}
 
-  ret = bsearch (&key,
-                 self->index->data,
-                 self->index->len,
-                 sizeof (IdeCtagsIndexEntry),
-                 compare_func);
+/**
+ * ide_ctags_index_iter_next:
+ * @iter: An #IdeCtagsIndexIter
+ * @entry: (out caller-allocates): A location for the next entry
+ *
+ * Resolves the next entry of @iter. The strings of @entry are owned by the
+ * index and are valid for as long as the index is alive.
+ *
+ * Returns: %TRUE if @entry was set, %FALSE when there are no more entries.
+ */
+gboolean
+ide_ctags_index_iter_next (IdeCtagsIndexIter  *iter,
+                           IdeCtagsIndexEntry *entry)
+{
+  IdeCtagsIndex *self;
+  IdeCtagsIndexEntry base_entry;
+  IdeCtagsIndexEntry overlay_entry;
+  gboolean has_base = FALSE;
+  gboolean has_overlay = FALSE;
 
-  if (ret != NULL)
-    {
-      IdeCtagsIndexEntry *last;
-      IdeCtagsIndexEntry *first;
-      gsize count = 0;
-      gsize i;
+  g_return_val_if_fail (iter != NULL, FALSE);
+  g_return_val_if_fail (entry != NULL, FALSE);
 
-      first = &g_array_index (self->index, IdeCtagsIndexEntry, 0);
-      last = &g_array_index (self->index, IdeCtagsIndexEntry, self->index->len - 1);
+  self = iter->index;
 
-      /*
-       * We might be smack in the middle of a group of items that match this keyword.
-       * So let's walk backwards to the first match, being careful not to access the
-       * array out of bounds.
-       */
-      while ((ret > first) && (compare_func (&key, &ret [-1]) == 0))
-        ret--;
+  while (iter->base_pos < iter->base_end)
+    {
+      ide_ctags_table_get_entry (self->base, iter->base_pos, &base_entry);
 
-      /*
-       * Now count how many index entries match this.
-       */
-      for (i = 0; &ret[i] <= last; i++)
+      if (!ide_ctags_index_is_shadowed (self, base_entry.path))
         {
-          if (compare_func (&key, &ret [i]) == 0)
-            count++;
-          else
-            break;
+          has_base = TRUE;
+          break;
         }
 
-      if (length != NULL)
-        *length = count;
+      iter->base_pos++;
     }
 
-  return ret;
+  if (iter->overlay_pos < iter->overlay_end)
+    {
+      ide_ctags_table_get_entry (self->overlay, iter->overlay_pos, &overlay_entry);
+      has_overlay = TRUE;
+    }
+
+  if (has_base && (!has_overlay || ide_ctags_index_entry_compare (&base_entry, &overlay_entry) <= 0))
+    {
+      *entry = base_entry;
+      iter->base_pos++;
+      return TRUE;
+    }
+
+  if (has_overlay)
+    {
+      *entry = overlay_entry;
+      iter->overlay_pos++;
+      return TRUE;
+    }
+
+  return FALSE;
 }
 
 gchar *
@@ -607,22 +1744,46 @@ ide_ctags_index_entry_free (IdeCtagsIndexEntry *entry)
   g_slice_free (IdeCtagsIndexEntry, entry);
 }
 
-const IdeCtagsIndexEntry *
+/**
+ * ide_ctags_index_lookup:
+ * @self: An #IdeCtagsIndex
+ * @keyword: the name to look for
+ *
+ * Gets the entries named @keyword. The strings of the entries are owned by
+ * the index.
+ *
+ * Returns: (transfer container) (element-type Ide.CtagsIndexEntry): An
+ *   array of entries, which may be empty.
+ */
+GArray *
 ide_ctags_index_lookup (IdeCtagsIndex *self,
-                        const gchar   *keyword,
-                        gsize         *length)
+                        const gchar   *keyword)
 {
-  return ide_ctags_index_lookup_full (self, keyword, length,
-                                      ide_ctags_index_entry_compare_keyword);
+  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), NULL);
+  g_return_val_if_fail (keyword != NULL, NULL);
+
+  return ide_ctags_index_collect (self, keyword, FALSE);
 }
 
-const IdeCtagsIndexEntry *
+/**
+ * ide_ctags_index_lookup_prefix:
+ * @self: An #IdeCtagsIndex
+ * @keyword: the prefix to look for
+ *
+ * Like ide_ctags_index_lookup() but gets the entries whose name starts
+ * with @keyword.
+ *
+ * Returns: (transfer container) (element-type Ide.CtagsIndexEntry): An
+ *   array of entries, which may be empty.
+ */
+GArray *
 ide_ctags_index_lookup_prefix (IdeCtagsIndex *self,
-                               const gchar   *keyword,
-                               gsize         *length)
+                               const gchar   *keyword)
 {
-  return ide_ctags_index_lookup_full (self, keyword, length,
-                                      ide_ctags_index_entry_compare_prefix);
+  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), NULL);
+  g_return_val_if_fail (keyword != NULL, NULL);
+
+  return ide_ctags_index_collect (self, keyword, TRUE);
 }
 
 void
@@ -644,11 +1805,8 @@ ide_ctags_index_get_mtime (IdeCtagsIndex *self)
  * @self: A #IdeCtagsIndex
  * @relative_path: A path relative to the indexes base_path.
  *
- * This will return a GPtrArray of #IdeCtagsIndex pointers. These
- * pointers are const and should not be modified or freed.
- *
- * The container is owned by the caller and should be freed by the
- * caller with g_ptr_array_unref().
+ * This will return a GArray of the entries whose path is @relative_path.
+ * The strings of the entries are owned by the index.
  *
  * Note that this function is not indexed, and therefore is O(n)
  * running time with `n` is the number of items in the index.
@@ -656,23 +1814,26 @@ ide_ctags_index_get_mtime (IdeCtagsIndex *self)
  * Returns: (transfer container) (element-type Ide.CtagsIndexEntry): An array
  *   of items matching the relative path.
  */
-GPtrArray *
+GArray *
 ide_ctags_index_find_with_path (IdeCtagsIndex *self,
                                 const gchar   *relative_path)
 {
-  GPtrArray *ar;
+  IdeCtagsIndexIter iter;
+  IdeCtagsIndexEntry entry;
+  GArray *ar;
 
   g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), NULL);
   g_return_val_if_fail (relative_path != NULL, NULL);
 
-  ar = g_ptr_array_new ();
+  ar = g_array_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry));
 
-  for (guint i = 0; i < self->index->len; i++)
+  if (ide_ctags_index_lookup_full (self, "", TRUE, &iter))
     {
-      IdeCtagsIndexEntry *entry = &g_array_index (self->index, IdeCtagsIndexEntry, i);
-
-      if (g_str_equal (entry->path, relative_path))
-        g_ptr_array_add (ar, entry);
+      while (ide_ctags_index_iter_next (&iter, &entry))
+        {
+          if (g_str_equal (entry.path, relative_path))
+            g_array_append_val (ar, entry);
+        }
     }
 
   return ar;
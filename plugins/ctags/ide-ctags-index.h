@@ -55,9 +55,26 @@ typedef struct
   guint8                  padding[3];
 } IdeCtagsIndexEntry;
 
+typedef struct
+{
+  /*< private >*/
+  IdeCtagsIndex *index;
+  guint          base_pos;
+  guint          base_end;
+  guint          overlay_pos;
+  guint          overlay_end;
+} IdeCtagsIndexIter;
+
 IdeCtagsIndex            *ide_ctags_index_new           (GFile                    *file,
                                                          const gchar              *path_root,
                                                          guint64                   mtime);
+IdeCtagsIndex            *ide_ctags_index_new_with_delta(IdeCtagsIndex            *base,
+                                                         GBytes                   *delta,
+                                                         const gchar * const      *paths,
+                                                         GError                  **error);
+guint                     ide_ctags_index_get_n_deltas  (IdeCtagsIndex            *self);
+IdeCtagsIndex            *ide_ctags_index_compact       (IdeCtagsIndex            *self,
+                                                         GError                  **error);
 void                      ide_ctags_index_load_async    (IdeCtagsIndex            *self,
                                                          GFile                    *file,
                                                          GCancellable             *cancellable,
@@ -66,19 +83,24 @@ void                      ide_ctags_index_load_async    (IdeCtagsIndex
 gboolean                  ide_ctags_index_load_finish   (IdeCtagsIndex            *index,
                                                          GAsyncResult             *result,
                                                          GError                  **error);
-GPtrArray                *ide_ctags_index_find_with_path(IdeCtagsIndex           *self,
-                                                         const gchar             *relative_path);
+GArray                   *ide_ctags_index_find_with_path(IdeCtagsIndex            *self,
+                                                         const gchar              *relative_path);
 gchar                    *ide_ctags_index_resolve_path  (IdeCtagsIndex            *self,
                                                          const gchar              *path);
 GFile                    *ide_ctags_index_get_file      (IdeCtagsIndex            *self);
 gsize                     ide_ctags_index_get_size      (IdeCtagsIndex            *self);
+gsize                     ide_ctags_index_get_memory_usage (IdeCtagsIndex         *self);
 const gchar              *ide_ctags_index_get_path_root (IdeCtagsIndex            *self);
-const IdeCtagsIndexEntry *ide_ctags_index_lookup        (IdeCtagsIndex            *self,
-                                                         const gchar              *keyword,
-                                                         gsize                    *length);
-const IdeCtagsIndexEntry *ide_ctags_index_lookup_prefix (IdeCtagsIndex            *self,
+GArray                   *ide_ctags_index_lookup        (IdeCtagsIndex            *self,
+                                                         const gchar              *keyword);
+GArray                   *ide_ctags_index_lookup_prefix (IdeCtagsIndex            *self,
+                                                         const gchar              *keyword);
+gboolean                  ide_ctags_index_lookup_full   (IdeCtagsIndex            *self,
                                                          const gchar              *keyword,
-                                                         gsize                    *length);
+                                                         gboolean                  is_prefix,
+                                                         IdeCtagsIndexIter        *iter);
+gboolean                  ide_ctags_index_iter_next     (IdeCtagsIndexIter        *iter,
+                                                         IdeCtagsIndexEntry       *entry);
 guint64                   ide_ctags_index_get_mtime     (IdeCtagsIndex            *self);
 gint                      ide_ctags_index_entry_compare (gconstpointer             a,
                                                          gconstpointer             b);
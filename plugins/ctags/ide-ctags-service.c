@@ -28,6 +28,16 @@
 #include "ide-ctags-index.h"
 #include "ide-ctags-service.h"
 
+#define BUILD_TAGS_DELAY_SECONDS 5
+
+/*
+ * Saving a file only re-tags that file and merges the result into the
+ * overlay of the loaded project index. The overlay grows with every file
+ * re-tagged, so after this many deltas we merge it into the compiled
+ * tags file in the background.
+ */
+#define MAX_TAGS_DELTAS 8
+
 struct _IdeCtagsService
 {
   IdeObject         parent_instance;
@@ -37,15 +47,67 @@ struct _IdeCtagsService
   IdeCtagsBuilder  *builder;
   GPtrArray        *highlighters;
   GPtrArray        *completions;
+  GHashTable       *changed_files;
 
   guint             build_tags_timeout;
+
+  guint             needs_full_build : 1;
+  /* Set while merging or compacting the project index */
+  guint             delta_in_progress : 1;
 };
 
-static void service_iface_init (IdeServiceInterface *iface);
+typedef struct
+{
+  IdeCtagsService *self;
+  IdeCtagsIndex   *base;
+  GFile           *tags_file;
+  GPtrArray       *files;
+  gchar          **paths;
+  GBytes          *delta;
+} TagsDelta;
+
+static void     service_iface_init (IdeServiceInterface *iface);
+static gboolean restart_miner      (gpointer             data);
 
 G_DEFINE_DYNAMIC_TYPE_EXTENDED (IdeCtagsService, ide_ctags_service, IDE_TYPE_OBJECT, 0,
                                 G_IMPLEMENT_INTERFACE (IDE_TYPE_SERVICE, service_iface_init))
 
+static void
+tags_delta_free (gpointer data)
+{
+  TagsDelta *state = data;
+
+  g_clear_object (&state->self);
+  g_clear_object (&state->base);
+  g_clear_object (&state->tags_file);
+  g_clear_pointer (&state->files, g_ptr_array_unref);
+  g_clear_pointer (&state->paths, g_strfreev);
+  g_clear_pointer (&state->delta, g_bytes_unref);
+  g_slice_free (TagsDelta, state);
+}
+
+static GFile *
+ide_ctags_service_get_project_tags (IdeCtagsService *self)
+{
+  g_autofree gchar *filename = NULL;
+  g_autofree gchar *path = NULL;
+  IdeContext *context;
+  IdeProject *project;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  project = ide_context_get_project (context);
+  filename = g_strconcat (ide_project_get_id (project), ".tags", NULL);
+  path = g_build_filename (g_get_user_cache_dir (),
+                           ide_get_program_name (),
+                           "tags",
+                           filename,
+                           NULL);
+
+  return g_file_new_for_path (path);
+}
+
 static void
 ide_ctags_service_build_index_init_cb (GObject      *object,
                                        GAsyncResult *result,
@@ -148,6 +210,30 @@ ide_ctags_service_build_index_cb (EggTaskCache  *cache,
   IDE_EXIT;
 }
 
+static void
+ide_ctags_service_add_index (IdeCtagsService *self,
+                             IdeCtagsIndex   *index)
+{
+  gsize i;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (IDE_IS_CTAGS_INDEX (index));
+
+  /* Indexes are replaced by providers when they share the same file. */
+
+  for (i = 0; i < self->highlighters->len; i++)
+    {
+      IdeCtagsHighlighter *highlighter = g_ptr_array_index (self->highlighters, i);
+      ide_ctags_highlighter_add_index (highlighter, index);
+    }
+
+  for (i = 0; i < self->completions->len; i++)
+    {
+      IdeCtagsCompletionProvider *provider = g_ptr_array_index (self->completions, i);
+      ide_ctags_completion_provider_add_index (provider, index);
+    }
+}
+
 static void
 ide_ctags_service_tags_loaded_cb (GObject      *object,
                                   GAsyncResult *result,
@@ -157,7 +243,6 @@ ide_ctags_service_tags_loaded_cb (GObject      *object,
   g_autoptr(IdeCtagsService) self = user_data;
   g_autoptr(IdeCtagsIndex) index = NULL;
   GError *error = NULL;
-  gsize i;
 
   IDE_ENTRY;
 
@@ -173,17 +258,7 @@ ide_ctags_service_tags_loaded_cb (GObject      *object,
 
   g_assert (IDE_IS_CTAGS_INDEX (index));
 
-  for (i = 0; i < self->highlighters->len; i++)
-    {
-      IdeCtagsHighlighter *highlighter = g_ptr_array_index (self->highlighters, i);
-      ide_ctags_highlighter_add_index (highlighter, index);
-    }
-
-  for (i = 0; i < self->completions->len; i++)
-    {
-      IdeCtagsCompletionProvider *provider = g_ptr_array_index (self->completions, i);
-      ide_ctags_completion_provider_add_index (provider, index);
-    }
+  ide_ctags_service_add_index (self, index);
 
   IDE_EXIT;
 }
@@ -316,11 +391,8 @@ ide_ctags_service_miner (GTask        *task,
                          gpointer      task_data,
                          GCancellable *cancellable)
 {
-  g_autofree gchar *project_tags = NULL;
-  g_autofree gchar *filename = NULL;
   IdeCtagsService *self = source_object;
   IdeContext *context;
-  IdeProject *project;
   IdeVcs *vcs;
   GFile *file;
 
@@ -329,16 +401,9 @@ ide_ctags_service_miner (GTask        *task,
 
   context = ide_object_get_context (IDE_OBJECT (self));
   vcs = ide_context_get_vcs (context);
-  project = ide_context_get_project (context);
-  filename = g_strconcat (ide_project_get_id (project), ".tags", NULL);
-  project_tags = g_build_filename (g_get_user_cache_dir (),
-                                   ide_get_program_name (),
-                                   "tags",
-                                   filename,
-                                   NULL);
 
   /* mine ~/.cache/gnome-builder/tags/<name>.tags */
-  file = g_file_new_for_path (project_tags);
+  file = ide_ctags_service_get_project_tags (self);
   ide_ctags_service_load_tags (self, file);
   g_object_unref (file);
 
@@ -410,6 +475,297 @@ build_system_tags_cb (GObject      *object,
   ide_ctags_service_mine (self);
 }
 
+static void
+ide_ctags_service_queue_build (IdeCtagsService *self)
+{
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+
+  if (self->build_tags_timeout == 0)
+    self->build_tags_timeout = g_timeout_add_seconds (BUILD_TAGS_DELAY_SECONDS, restart_miner, self);
+}
+
+static void
+ide_ctags_service_rebuild (IdeCtagsService *self)
+{
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+
+  /* A full build covers every file that has changed so far. */
+  self->needs_full_build = FALSE;
+  g_hash_table_remove_all (self->changed_files);
+
+  if (self->builder != NULL)
+    ide_ctags_builder_rebuild (self->builder);
+}
+
+static void
+ide_ctags_service_merge_worker (GTask        *task,
+                                gpointer      source_object,
+                                gpointer      task_data,
+                                GCancellable *cancellable)
+{
+  TagsDelta *state = task_data;
+  IdeCtagsIndex *index;
+  GError *error = NULL;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (state != NULL);
+  g_assert (IDE_IS_CTAGS_INDEX (state->base));
+  g_assert (state->delta != NULL);
+
+  index = ide_ctags_index_new_with_delta (state->base,
+                                          state->delta,
+                                          (const gchar * const *)state->paths,
+                                          &error);
+
+  if (index == NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, index, g_object_unref);
+}
+
+static void
+ide_ctags_service_compact_worker (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  TagsDelta *state = task_data;
+  IdeCtagsIndex *index;
+  GError *error = NULL;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (state != NULL);
+  g_assert (IDE_IS_CTAGS_INDEX (state->base));
+
+  if (!(index = ide_ctags_index_compact (state->base, &error)))
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, index, g_object_unref);
+}
+
+static void
+ide_ctags_service_compact_cb (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  IdeCtagsService *self = (IdeCtagsService *)object;
+  g_autoptr(IdeCtagsIndex) index = NULL;
+  TagsDelta *state;
+  GError *error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (G_IS_TASK (result));
+
+  self->delta_in_progress = FALSE;
+  state = g_task_get_task_data (G_TASK (result));
+
+  if (!(index = g_task_propagate_pointer (G_TASK (result), &error)))
+    {
+      g_debug ("%s", error->message);
+      g_clear_error (&error);
+      if (!g_cancellable_is_cancelled (self->cancellable))
+        {
+          self->needs_full_build = TRUE;
+          ide_ctags_service_queue_build (self);
+        }
+      IDE_EXIT;
+    }
+
+  /* A full rebuild replaced the index while we were compacting */
+  if (egg_task_cache_peek (self->indexes, state->tags_file) != (gpointer)state->base)
+    IDE_EXIT;
+
+  egg_task_cache_insert (self->indexes, state->tags_file, index);
+  ide_ctags_service_add_index (self, index);
+
+  IDE_EXIT;
+}
+
+static void
+ide_ctags_service_compact (IdeCtagsService *self,
+                           GFile           *tags_file,
+                           IdeCtagsIndex   *index)
+{
+  g_autoptr(GTask) task = NULL;
+  TagsDelta *state;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (G_IS_FILE (tags_file));
+  g_assert (IDE_IS_CTAGS_INDEX (index));
+
+  IDE_TRACE_MSG ("Compacting ctags index after %u deltas",
+                 ide_ctags_index_get_n_deltas (index));
+
+  state = g_slice_new0 (TagsDelta);
+  state->self = g_object_ref (self);
+  state->base = g_object_ref (index);
+  state->tags_file = g_object_ref (tags_file);
+
+  /* Files saved meanwhile are merged into the compacted index */
+  self->delta_in_progress = TRUE;
+
+  task = g_task_new (self, self->cancellable, ide_ctags_service_compact_cb, NULL);
+  g_task_set_task_data (task, state, tags_delta_free);
+  ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER, task, ide_ctags_service_compact_worker);
+}
+
+static void
+ide_ctags_service_merge_cb (GObject      *object,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+  IdeCtagsService *self = (IdeCtagsService *)object;
+  g_autoptr(IdeCtagsIndex) index = NULL;
+  TagsDelta *state;
+  GError *error = NULL;
+  guint i;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (G_IS_TASK (result));
+
+  self->delta_in_progress = FALSE;
+  state = g_task_get_task_data (G_TASK (result));
+
+  if (!(index = g_task_propagate_pointer (G_TASK (result), &error)))
+    {
+      g_debug ("%s", error->message);
+      g_clear_error (&error);
+      IDE_EXIT;
+    }
+
+  /*
+   * If the project index was replaced while we were merging (such as by a
+   * full rebuild), our base is stale. Requeue the files against the new one.
+   */
+  if (egg_task_cache_peek (self->indexes, state->tags_file) != (gpointer)state->base)
+    {
+      for (i = 0; i < state->files->len; i++)
+        g_hash_table_add (self->changed_files, g_object_ref (g_ptr_array_index (state->files, i)));
+      ide_ctags_service_queue_build (self);
+      IDE_EXIT;
+    }
+
+  egg_task_cache_insert (self->indexes, state->tags_file, index);
+  ide_ctags_service_add_index (self, index);
+
+  if (ide_ctags_index_get_n_deltas (index) >= MAX_TAGS_DELTAS)
+    ide_ctags_service_compact (self, state->tags_file, index);
+
+  IDE_EXIT;
+}
+
+static void
+ide_ctags_service_build_files_cb (GObject      *object,
+                                  GAsyncResult *result,
+                                  gpointer      user_data)
+{
+  IdeCtagsBuilder *builder = (IdeCtagsBuilder *)object;
+  TagsDelta *state = user_data;
+  IdeCtagsService *self = state->self;
+  g_autoptr(GTask) task = NULL;
+  GError *error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CTAGS_BUILDER (builder));
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+
+  if (!(state->delta = ide_ctags_builder_build_files_finish (builder, result, &error)))
+    {
+      g_debug ("%s", error->message);
+      g_clear_error (&error);
+      self->delta_in_progress = FALSE;
+      if (!g_cancellable_is_cancelled (self->cancellable))
+        ide_ctags_service_rebuild (self);
+      tags_delta_free (state);
+      IDE_EXIT;
+    }
+
+  task = g_task_new (self, self->cancellable, ide_ctags_service_merge_cb, NULL);
+  g_task_set_task_data (task, state, tags_delta_free);
+  ide_thread_pool_push_task (IDE_THREAD_POOL_INDEXER, task, ide_ctags_service_merge_worker);
+
+  IDE_EXIT;
+}
+
+/*
+ * Re-tags the files saved since the last build and merges them into the
+ * loaded project index. Returns %FALSE if a full build is required instead.
+ */
+static gboolean
+ide_ctags_service_update_changed (IdeCtagsService *self)
+{
+  g_autoptr(GFile) tags_file = NULL;
+  g_autoptr(GPtrArray) files = NULL;
+  g_autoptr(GPtrArray) paths = NULL;
+  GHashTableIter iter;
+  IdeCtagsIndex *index;
+  IdeContext *context;
+  TagsDelta *state;
+  GFile *workdir;
+  IdeVcs *vcs;
+  gpointer key;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+
+  if (self->needs_full_build || g_hash_table_size (self->changed_files) == 0)
+    return FALSE;
+
+  tags_file = ide_ctags_service_get_project_tags (self);
+  index = egg_task_cache_peek (self->indexes, tags_file);
+
+  if (index == NULL)
+    return FALSE;
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  vcs = ide_context_get_vcs (context);
+  workdir = ide_vcs_get_working_directory (vcs);
+
+  files = g_ptr_array_new_with_free_func (g_object_unref);
+  paths = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&iter, self->changed_files);
+
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      GFile *file = key;
+      gchar *relative;
+
+      if ((relative = g_file_get_relative_path (workdir, file)))
+        {
+          g_ptr_array_add (files, g_object_ref (file));
+          g_ptr_array_add (paths, relative);
+        }
+    }
+
+  g_ptr_array_add (paths, NULL);
+  g_hash_table_remove_all (self->changed_files);
+
+  if (files->len == 0)
+    return TRUE;
+
+  state = g_slice_new0 (TagsDelta);
+  state->self = g_object_ref (self);
+  state->base = g_object_ref (index);
+  state->tags_file = g_steal_pointer (&tags_file);
+  state->files = g_ptr_array_ref (files);
+  state->paths = (gchar **)g_ptr_array_free (g_steal_pointer (&paths), FALSE);
+
+  self->delta_in_progress = TRUE;
+
+  ide_ctags_builder_build_files_async (self->builder,
+                                       files,
+                                       self->cancellable,
+                                       ide_ctags_service_build_files_cb,
+                                       state);
+
+  return TRUE;
+}
+
 static gboolean
 restart_miner (gpointer data)
 {
@@ -441,9 +797,14 @@ restart_miner (gpointer data)
                                         build_system_tags_cb, g_object_ref (self));
           IDE_GOTO (finish);
         }
-      else
+      else if (self->delta_in_progress)
+        {
+          /* Wait for the pending delta so that we merge against its result. */
+          ide_ctags_service_queue_build (self);
+        }
+      else if (!ide_ctags_service_update_changed (self))
         {
-          ide_ctags_builder_rebuild (self->builder);
+          ide_ctags_service_rebuild (self);
         }
     }
 
@@ -457,14 +818,41 @@ ide_ctags_service_buffer_saved (IdeCtagsService  *self,
                                 IdeBuffer        *buffer,
                                 IdeBufferManager *buffer_manager)
 {
+  IdeFile *file;
+  GFile *gfile;
+
   IDE_ENTRY;
 
   g_assert (IDE_IS_CTAGS_SERVICE (self));
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (IDE_IS_BUFFER_MANAGER (buffer_manager));
 
-  if (self->build_tags_timeout == 0)
-    self->build_tags_timeout = g_timeout_add_seconds (5, restart_miner, self);
+  file = ide_buffer_get_file (buffer);
+  gfile = ide_file_get_file (file);
+
+  if (gfile != NULL)
+    g_hash_table_add (self->changed_files, g_object_ref (gfile));
+
+  ide_ctags_service_queue_build (self);
+
+  IDE_EXIT;
+}
+
+static void
+ide_ctags_service_vcs_changed (IdeCtagsService *self,
+                               IdeVcs          *vcs)
+{
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CTAGS_SERVICE (self));
+  g_assert (IDE_IS_VCS (vcs));
+
+  /*
+   * We can't know which files changed underneath us (a checkout, for
+   * example), so regenerate the whole tree.
+   */
+  self->needs_full_build = TRUE;
+  ide_ctags_service_queue_build (self);
 
   IDE_EXIT;
 }
@@ -489,6 +877,12 @@ ide_ctags_service_context_loaded (IdeService *service)
                            self,
                            G_CONNECT_SWAPPED);
 
+  g_signal_connect_object (ide_context_get_vcs (context),
+                           "changed",
+                           G_CALLBACK (ide_ctags_service_vcs_changed),
+                           self,
+                           G_CONNECT_SWAPPED);
+
   ide_ctags_service_mine (self);
 
   IDE_EXIT;
@@ -540,6 +934,7 @@ ide_ctags_service_finalize (GObject *object)
   g_clear_object (&self->cancellable);
   g_clear_pointer (&self->highlighters, g_ptr_array_unref);
   g_clear_pointer (&self->completions, g_ptr_array_unref);
+  g_clear_pointer (&self->changed_files, g_hash_table_unref);
 
   G_OBJECT_CLASS (ide_ctags_service_parent_class)->finalize (object);
 
@@ -567,11 +962,21 @@ ide_ctags_service_class_finalize (IdeCtagsServiceClass *klass)
 {
 }
 
+static gsize
+ide_ctags_service_get_index_cost (gconstpointer value)
+{
+  return ide_ctags_index_get_memory_usage ((IdeCtagsIndex *)value);
+}
+
 static void
 ide_ctags_service_init (IdeCtagsService *self)
 {
   self->highlighters = g_ptr_array_new ();
   self->completions = g_ptr_array_new ();
+  self->changed_files = g_hash_table_new_full ((GHashFunc)g_file_hash,
+                                               (GEqualFunc)g_file_equal,
+                                               g_object_unref,
+                                               NULL);
 
   self->indexes = egg_task_cache_new ((GHashFunc)g_file_hash,
                                       (GEqualFunc)g_file_equal,
@@ -585,6 +990,7 @@ ide_ctags_service_init (IdeCtagsService *self)
                                       NULL);
 
   egg_task_cache_set_name (self->indexes, "ctags index cache");
+  egg_task_cache_set_cost_func (self->indexes, ide_ctags_service_get_index_cost);
 }
 
 void
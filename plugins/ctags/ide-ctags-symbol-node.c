@@ -25,8 +25,10 @@ struct _IdeCtagsSymbolNode
   IdeSymbolNode             parent_instance;
   IdeCtagsIndex            *index;
   IdeCtagsSymbolResolver   *resolver;
-  const IdeCtagsIndexEntry *entry;
   GPtrArray                *children;
+
+  /* The strings are owned by index */
+  IdeCtagsIndexEntry        entry;
 };
 
 G_DEFINE_TYPE (IdeCtagsSymbolNode, ide_ctags_symbol_node, IDE_TYPE_SYMBOL_NODE)
@@ -70,7 +72,7 @@ ide_ctags_symbol_node_get_location_async (IdeSymbolNode       *node,
 
   ide_ctags_symbol_resolver_get_location_async (self->resolver,
                                                 self->index,
-                                                self->entry,
+                                                &self->entry,
                                                 NULL,
                                                 ide_ctags_symbol_node_get_location_cb,
                                                 g_steal_pointer (&task));
@@ -93,7 +95,6 @@ ide_ctags_symbol_node_finalize (GObject *object)
   IdeCtagsSymbolNode *self = (IdeCtagsSymbolNode *)object;
 
   g_clear_pointer (&self->children, g_ptr_array_unref);
-  self->entry = NULL;
   g_clear_object (&self->index);
 
   G_OBJECT_CLASS (ide_ctags_symbol_node_parent_class)->finalize (object);
@@ -134,7 +135,7 @@ ide_ctags_symbol_node_new (IdeCtagsSymbolResolver   *resolver,
                        "flags", flags,
                        NULL);
 
-  self->entry = entry;
+  self->entry = *entry;
   self->index = g_object_ref (index);
   self->resolver = g_object_ref (resolver);
 
@@ -178,5 +179,5 @@ ide_ctags_symbol_node_get_entry (IdeCtagsSymbolNode *self)
 {
   g_return_val_if_fail (IDE_IS_CTAGS_SYMBOL_NODE (self), NULL);
 
-  return self->entry;
+  return &self->entry;
 }
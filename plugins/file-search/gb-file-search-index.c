@@ -18,6 +18,7 @@
 
 #define G_LOG_DOMAIN "gb-file-search-index"
 
+#include <errno.h>
 #include <fuzzy.h>
 #include <glib/gi18n.h>
 #include <ide.h>
@@ -25,14 +26,28 @@
 #include "gb-file-search-index.h"
 #include "gb-file-search-result.h"
 
+#define SAVE_DELAY_SECONDS 5
+
 struct _GbFileSearchIndex
 {
   IdeObject     parent_instance;
 
   GFile        *root_directory;
   Fuzzy        *fuzzy;
+  gchar        *cache_path;
+
+  GCancellable *save_cancellable;
+  guint         save_source;
+  guint         from_cache : 1;
 };
 
+typedef struct
+{
+  GFile        *directory;
+  gchar        *cache_path;
+  guint         use_cache : 1;
+} BuildState;
+
 G_DEFINE_TYPE (GbFileSearchIndex, gb_file_search_index, IDE_TYPE_OBJECT)
 
 enum {
@@ -43,6 +58,155 @@ enum {
 
 static GParamSpec *properties [LAST_PROP];
 
+static void
+build_state_free (gpointer data)
+{
+  BuildState *state = data;
+
+  g_clear_object (&state->directory);
+  g_clear_pointer (&state->cache_path, g_free);
+  g_slice_free (BuildState, state);
+}
+
+static gchar *
+gb_file_search_index_get_cache_path (GbFileSearchIndex *self)
+{
+  g_autofree gchar *name = NULL;
+  IdeContext *context;
+  IdeProject *project;
+
+  g_assert (GB_IS_FILE_SEARCH_INDEX (self));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  project = ide_context_get_project (context);
+  name = g_strconcat (ide_project_get_id (project), ".fuzzy", NULL);
+
+  return g_build_filename (g_get_user_cache_dir (),
+                           ide_get_program_name (),
+                           "file-search",
+                           name,
+                           NULL);
+}
+
+static gboolean
+gb_file_search_index_write_cache (Fuzzy        *fuzzy,
+                                  const gchar  *cache_path,
+                                  GError      **error)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  g_autofree gchar *cache_dir = NULL;
+
+  g_assert (fuzzy != NULL);
+  g_assert (cache_path != NULL);
+
+  cache_dir = g_path_get_dirname (cache_path);
+
+  if (g_mkdir_with_parents (cache_dir, 0750) != 0)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   "Failed to create cache directory \"%s\"",
+                   cache_dir);
+      return FALSE;
+    }
+
+  bytes = fuzzy_serialize (fuzzy);
+
+  return g_file_set_contents (cache_path,
+                              g_bytes_get_data (bytes, NULL),
+                              g_bytes_get_size (bytes),
+                              error);
+}
+
+static void
+gb_file_search_index_save_cb (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  GFile *file = (GFile *)object;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (G_IS_FILE (file));
+
+  if (!g_file_replace_contents_finish (file, result, NULL, &error) &&
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_warning ("Failed to save file index: %s", error->message);
+}
+
+static gboolean
+gb_file_search_index_save_timeout (gpointer data)
+{
+  GbFileSearchIndex *self = data;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GFile) file = NULL;
+
+  g_assert (GB_IS_FILE_SEARCH_INDEX (self));
+
+  self->save_source = 0;
+
+  if (self->fuzzy == NULL || self->cache_path == NULL)
+    return G_SOURCE_REMOVE;
+
+  /*
+   * The index is only modified from the main thread, so serialize it here
+   * and let GIO write the result out. The cache directory already exists
+   * since we previously built or loaded the index from it.
+   */
+  file = g_file_new_for_path (self->cache_path);
+  bytes = fuzzy_serialize (self->fuzzy);
+
+  if (self->save_cancellable == NULL)
+    self->save_cancellable = g_cancellable_new ();
+
+  g_file_replace_contents_bytes_async (file,
+                                       bytes,
+                                       NULL,
+                                       FALSE,
+                                       G_FILE_CREATE_REPLACE_DESTINATION,
+                                       self->save_cancellable,
+                                       gb_file_search_index_save_cb,
+                                       NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+gb_file_search_index_queue_save (GbFileSearchIndex *self)
+{
+  g_assert (GB_IS_FILE_SEARCH_INDEX (self));
+
+  if (self->save_source != 0)
+    g_source_remove (self->save_source);
+
+  self->save_source = g_timeout_add_seconds (SAVE_DELAY_SECONDS,
+                                             gb_file_search_index_save_timeout,
+                                             self);
+}
+
+/*
+ * Drops a queued save without writing it, and aborts a save in progress.
+ * Used when the index is replaced by a fresh one, so that its stale
+ * contents never overwrite the cache written for the replacement.
+ */
+void
+gb_file_search_index_cancel_save (GbFileSearchIndex *self)
+{
+  g_return_if_fail (GB_IS_FILE_SEARCH_INDEX (self));
+
+  if (self->save_source != 0)
+    {
+      g_source_remove (self->save_source);
+      self->save_source = 0;
+    }
+
+  if (self->save_cancellable != NULL)
+    {
+      g_cancellable_cancel (self->save_cancellable);
+      g_clear_object (&self->save_cancellable);
+    }
+}
+
 static void
 gb_file_search_index_set_root_directory (GbFileSearchIndex *self,
                                          GFile             *root_directory)
@@ -63,8 +227,16 @@ gb_file_search_index_finalize (GObject *object)
 {
   GbFileSearchIndex *self = (GbFileSearchIndex *)object;
 
+  if (self->save_source != 0)
+    {
+      g_source_remove (self->save_source);
+      gb_file_search_index_save_timeout (self);
+    }
+
+  g_clear_object (&self->save_cancellable);
   g_clear_object (&self->root_directory);
   g_clear_pointer (&self->fuzzy, fuzzy_unref);
+  g_clear_pointer (&self->cache_path, g_free);
 
   G_OBJECT_CLASS (gb_file_search_index_parent_class)->finalize (object);
 }
@@ -140,7 +312,10 @@ populate_from_dir (Fuzzy        *fuzzy,
 {
   GFileEnumerator *enumerator;
   GPtrArray *children = NULL;
+  g_autoptr(GPtrArray) files = NULL;
+  g_autofree guint8 *ignored = NULL;
   gpointer file_info_ptr;
+  gsize i;
 
   g_assert (fuzzy != NULL);
   g_assert (G_IS_FILE (directory));
@@ -159,10 +334,11 @@ populate_from_dir (Fuzzy        *fuzzy,
   if (enumerator == NULL)
     return;
 
+  files = g_ptr_array_new_with_free_func (g_object_unref);
+
   while ((file_info_ptr = g_file_enumerator_next_file (enumerator, cancellable, NULL)))
     {
       g_autoptr(GFileInfo) file_info = file_info_ptr;
-      g_autofree gchar *path = NULL;
       g_autoptr(GFile) file = NULL;
       const gchar *name;
 
@@ -177,21 +353,33 @@ populate_from_dir (Fuzzy        *fuzzy,
           continue;
         }
 
-      if (ide_vcs_is_ignored (vcs, file, NULL))
+      g_ptr_array_add (files, g_steal_pointer (&file));
+    }
+
+  /* Filter all of the files in this directory with a single query */
+  ignored = g_malloc0 (IDE_VCS_IGNORED_BITMAP_SIZE (files->len));
+  ide_vcs_is_ignored_many (vcs, (GFile **)files->pdata, files->len, ignored, NULL);
+
+  for (i = 0; i < files->len; i++)
+    {
+      g_autofree gchar *name = NULL;
+      g_autofree gchar *path = NULL;
+
+      if (IDE_VCS_IGNORED_BITMAP_GET (ignored, i))
         continue;
 
+      name = g_file_get_basename (g_ptr_array_index (files, i));
+
       if (relpath != NULL)
-        name = path = g_build_filename (relpath, name, NULL);
+        path = g_build_filename (relpath, name, NULL);
 
-      fuzzy_insert (fuzzy, name, NULL);
+      fuzzy_insert (fuzzy, path ? path : name, NULL);
     }
 
   g_clear_object (&enumerator);
 
   if (children != NULL)
     {
-      gsize i;
-
       for (i = 0; i < children->len; i++)
         {
           g_autofree gchar *path = NULL;
@@ -219,7 +407,8 @@ gb_file_search_index_builder (GTask        *task,
 {
   GbFileSearchIndex *self = source_object;
   g_autoptr(GTimer) timer = NULL;
-  GFile *directory = task_data;
+  g_autoptr(GError) error = NULL;
+  BuildState *state = task_data;
   IdeContext *context;
   IdeVcs *vcs;
   Fuzzy *fuzzy;
@@ -228,18 +417,44 @@ gb_file_search_index_builder (GTask        *task,
   g_assert (G_IS_TASK (task));
   g_assert (GB_IS_FILE_SEARCH_INDEX (self));
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
-  g_assert (G_IS_FILE (directory));
+  g_assert (state != NULL);
+  g_assert (G_IS_FILE (state->directory));
+
+  timer = g_timer_new ();
+
+  if (state->use_cache)
+    {
+      if ((fuzzy = fuzzy_new_from_file (state->cache_path, &error)))
+        {
+          self->fuzzy = fuzzy;
+          self->from_cache = TRUE;
+
+          g_timer_stop (timer);
+          elapsed = g_timer_elapsed (timer, NULL);
+
+          g_message ("File index loaded from cache in %lf seconds.", elapsed);
+
+          g_task_return_boolean (task, TRUE);
+          return;
+        }
+
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_debug ("Ignoring file index cache: %s", error->message);
+
+      g_clear_error (&error);
+    }
 
   context = ide_object_get_context (IDE_OBJECT (self));
   vcs = ide_context_get_vcs (context);
 
-  timer = g_timer_new ();
-
   fuzzy = fuzzy_new (FALSE);
   fuzzy_begin_bulk_insert (fuzzy);
-  populate_from_dir (fuzzy, vcs, NULL, directory, cancellable);
+  populate_from_dir (fuzzy, vcs, NULL, state->directory, cancellable);
   fuzzy_end_bulk_insert (fuzzy);
 
+  if (!gb_file_search_index_write_cache (fuzzy, state->cache_path, &error))
+    g_warning ("Failed to save file index: %s", error->message);
+
   self->fuzzy = fuzzy;
 
   g_timer_stop (timer);
@@ -250,16 +465,18 @@ gb_file_search_index_builder (GTask        *task,
   g_task_return_boolean (task, TRUE);
 }
 
-void
-gb_file_search_index_build_async (GbFileSearchIndex   *self,
-                                  GCancellable        *cancellable,
-                                  GAsyncReadyCallback  callback,
-                                  gpointer             user_data)
+static void
+gb_file_search_index_run (GbFileSearchIndex   *self,
+                          gboolean             use_cache,
+                          GCancellable        *cancellable,
+                          GAsyncReadyCallback  callback,
+                          gpointer             user_data)
 {
   g_autoptr(GTask) task = NULL;
+  BuildState *state;
 
-  g_return_if_fail (GB_IS_FILE_SEARCH_INDEX (self));
-  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_assert (GB_IS_FILE_SEARCH_INDEX (self));
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   task = g_task_new (self, cancellable, callback, user_data);
 
@@ -272,10 +489,63 @@ gb_file_search_index_build_async (GbFileSearchIndex   *self,
       return;
     }
 
-  g_task_set_task_data (task, g_object_ref (self->root_directory), g_object_unref);
+  if (self->cache_path == NULL)
+    self->cache_path = gb_file_search_index_get_cache_path (self);
+
+  state = g_slice_new0 (BuildState);
+  state->directory = g_object_ref (self->root_directory);
+  state->cache_path = g_strdup (self->cache_path);
+  state->use_cache = !!use_cache;
+
+  g_task_set_task_data (task, state, build_state_free);
   g_task_run_in_thread (task, gb_file_search_index_builder);
 }
 
+void
+gb_file_search_index_build_async (GbFileSearchIndex   *self,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+  g_return_if_fail (GB_IS_FILE_SEARCH_INDEX (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  gb_file_search_index_run (self, FALSE, cancellable, callback, user_data);
+}
+
+/*
+ * Like gb_file_search_index_build_async() but reopens the index stored in
+ * the project cache when available, only walking the root directory when
+ * there is no usable cache. Complete with gb_file_search_index_build_finish().
+ *
+ * The cache may be out of date if files were added or removed while the
+ * project was closed. Check gb_file_search_index_get_from_cache() and build
+ * a fresh index to replace it.
+ */
+void
+gb_file_search_index_load_async (GbFileSearchIndex   *self,
+                                 GCancellable        *cancellable,
+                                 GAsyncReadyCallback  callback,
+                                 gpointer             user_data)
+{
+  g_return_if_fail (GB_IS_FILE_SEARCH_INDEX (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  gb_file_search_index_run (self, TRUE, cancellable, callback, user_data);
+}
+
+/*
+ * Returns %TRUE if the index was reopened from the project cache rather
+ * than built by walking the root directory.
+ */
+gboolean
+gb_file_search_index_get_from_cache (GbFileSearchIndex *self)
+{
+  g_return_val_if_fail (GB_IS_FILE_SEARCH_INDEX (self), FALSE);
+
+  return self->from_cache;
+}
+
 gboolean
 gb_file_search_index_build_finish (GbFileSearchIndex  *self,
                                    GAsyncResult       *result,
@@ -360,6 +630,7 @@ gb_file_search_index_insert (GbFileSearchIndex *self,
   g_return_if_fail (self->fuzzy != NULL);
 
   fuzzy_insert (self->fuzzy, relative_path, NULL);
+  gb_file_search_index_queue_save (self);
 }
 
 void
@@ -371,4 +642,5 @@ gb_file_search_index_remove (GbFileSearchIndex *self,
   g_return_if_fail (self->fuzzy != NULL);
 
   fuzzy_remove (self->fuzzy, relative_path);
+  gb_file_search_index_queue_save (self);
 }
@@ -27,8 +27,22 @@ struct _GbFileSearchProvider
 {
   IdeObject          parent_instance;
   GbFileSearchIndex *index;
+
+  /*
+   * Changes to the tree made while an index is being built. The walk may
+   * have already passed them, so they are replayed into the new index
+   * before it replaces the current one.
+   */
+  GArray            *changes;
+  guint              n_building;
 };
 
+typedef struct
+{
+  gchar *path;
+  guint  insert : 1;
+} IndexChange;
+
 static void search_provider_iface_init (IdeSearchProviderInterface *iface);
 
 G_DEFINE_DYNAMIC_TYPE_EXTENDED (GbFileSearchProvider,
@@ -64,6 +78,51 @@ gb_file_search_provider_populate (IdeSearchProvider *provider,
   ide_search_context_provider_completed (context, provider);
 }
 
+static void
+index_change_clear (gpointer data)
+{
+  IndexChange *change = data;
+
+  g_clear_pointer (&change->path, g_free);
+}
+
+static void
+gb_file_search_provider_apply (GbFileSearchIndex *index,
+                               const gchar       *path,
+                               gboolean           insert)
+{
+  g_assert (GB_IS_FILE_SEARCH_INDEX (index));
+  g_assert (path != NULL);
+
+  if (!insert)
+    gb_file_search_index_remove (index, path);
+  else if (!gb_file_search_index_contains (index, path))
+    gb_file_search_index_insert (index, path);
+}
+
+static void
+gb_file_search_provider_change (GbFileSearchProvider *self,
+                                const gchar          *path,
+                                gboolean              insert)
+{
+  g_assert (GB_IS_FILE_SEARCH_PROVIDER (self));
+  g_assert (path != NULL);
+
+  if (self->index != NULL)
+    gb_file_search_provider_apply (self->index, path, insert);
+
+  if (self->n_building > 0)
+    {
+      IndexChange change = { g_strdup (path), !!insert };
+
+      g_array_append_val (self->changes, change);
+    }
+}
+
+static void
+gb_file_search_provider_build (GbFileSearchProvider *self,
+                               gboolean              use_cache);
+
 static void
 on_buffer_loaded (GbFileSearchProvider *self,
                   IdeBuffer            *buffer,
@@ -79,19 +138,14 @@ on_buffer_loaded (GbFileSearchProvider *self,
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (IDE_IS_BUFFER_MANAGER (bufmgr));
 
-  if (self->index == NULL)
-    return;
-
   file = ide_file_get_file (ide_buffer_get_file (buffer));
   context = ide_buffer_get_context (buffer);
   vcs = ide_context_get_vcs (context);
   workdir = ide_vcs_get_working_directory (vcs);
   relative_path = g_file_get_relative_path (workdir, file);
 
-  if ((relative_path != NULL) &&
-      !ide_vcs_is_ignored (vcs, file, NULL) &&
-      !gb_file_search_index_contains (self->index, relative_path))
-    gb_file_search_index_insert (self->index, relative_path);
+  if ((relative_path != NULL) && !ide_vcs_is_ignored (vcs, file, NULL))
+    gb_file_search_provider_change (self, relative_path, TRUE);
 }
 
 static void
@@ -110,17 +164,16 @@ on_file_renamed (GbFileSearchProvider *self,
   g_assert (G_IS_FILE (src_file));
   g_assert (G_IS_FILE (dst_file));
   g_assert (IDE_IS_PROJECT (project));
-  g_assert (GB_IS_FILE_SEARCH_INDEX (self->index));
 
   context = ide_object_get_context (IDE_OBJECT (project));
   vcs = ide_context_get_vcs (context);
   workdir = ide_vcs_get_working_directory (vcs);
 
   if (NULL != (old_path = g_file_get_relative_path (workdir, src_file)))
-    gb_file_search_index_remove (self->index, old_path);
+    gb_file_search_provider_change (self, old_path, FALSE);
 
   if (NULL != (new_path = g_file_get_relative_path (workdir, dst_file)))
-    gb_file_search_index_insert (self->index, new_path);
+    gb_file_search_provider_change (self, new_path, TRUE);
 }
 
 static void
@@ -136,14 +189,13 @@ on_file_trashed (GbFileSearchProvider *self,
   g_assert (GB_IS_FILE_SEARCH_PROVIDER (self));
   g_assert (G_IS_FILE (file));
   g_assert (IDE_IS_PROJECT (project));
-  g_assert (GB_IS_FILE_SEARCH_INDEX (self->index));
 
   context = ide_object_get_context (IDE_OBJECT (project));
   vcs = ide_context_get_vcs (context);
   workdir = ide_vcs_get_working_directory (vcs);
 
   if (NULL != (path = g_file_get_relative_path (workdir, file)))
-    gb_file_search_index_remove (self->index, path);
+    gb_file_search_provider_change (self, path, FALSE);
 }
 
 static void
@@ -154,17 +206,82 @@ gb_file_search_provider_build_cb (GObject      *object,
   GbFileSearchIndex *index = (GbFileSearchIndex *)object;
   g_autoptr(GbFileSearchProvider) self = user_data;
   g_autoptr(GError) error = NULL;
+  gboolean ret;
+  guint i;
 
   g_assert (GB_IS_FILE_SEARCH_INDEX (index));
   g_assert (GB_IS_FILE_SEARCH_PROVIDER (self));
+  g_assert (self->n_building > 0);
 
-  if (!gb_file_search_index_build_finish (index, result, &error))
+  ret = gb_file_search_index_build_finish (index, result, &error);
+
+  if (ret)
+    {
+      for (i = 0; i < self->changes->len; i++)
+        {
+          const IndexChange *change = &g_array_index (self->changes, IndexChange, i);
+
+          gb_file_search_provider_apply (index, change->path, change->insert);
+        }
+    }
+
+  if (--self->n_building == 0)
+    g_array_set_size (self->changes, 0);
+
+  if (!ret)
     {
       g_warning ("%s", error->message);
       return;
     }
 
+  /*
+   * Drop a pending save of the replaced index rather than letting it flush
+   * when finalized, where it could overwrite the cache of the new index.
+   */
+  if (self->index != NULL && self->index != index)
+    gb_file_search_index_cancel_save (self->index);
+
   g_set_object (&self->index, index);
+
+  /*
+   * The cached index gives us results right away, but files may have been
+   * added or removed while the project was closed. Walk the tree again in
+   * the background and swap in the fresh index when it completes.
+   */
+  if (gb_file_search_index_get_from_cache (index))
+    gb_file_search_provider_build (self, FALSE);
+}
+
+static void
+gb_file_search_provider_build (GbFileSearchProvider *self,
+                               gboolean              use_cache)
+{
+  g_autoptr(GbFileSearchIndex) index = NULL;
+  IdeContext *context;
+  IdeVcs *vcs;
+
+  g_assert (GB_IS_FILE_SEARCH_PROVIDER (self));
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  vcs = ide_context_get_vcs (context);
+
+  index = g_object_new (GB_TYPE_FILE_SEARCH_INDEX,
+                        "context", context,
+                        "root-directory", ide_vcs_get_working_directory (vcs),
+                        NULL);
+
+  self->n_building++;
+
+  if (use_cache)
+    gb_file_search_index_load_async (index,
+                                     NULL,
+                                     gb_file_search_provider_build_cb,
+                                     g_object_ref (self));
+  else
+    gb_file_search_index_build_async (index,
+                                      NULL,
+                                      gb_file_search_provider_build_cb,
+                                      g_object_ref (self));
 }
 
 static GtkWidget *
@@ -229,27 +346,12 @@ static void
 gb_file_search_provider_vcs_changed_cb (GbFileSearchProvider *self,
                                         IdeVcs               *vcs)
 {
-  g_autoptr(GbFileSearchIndex) index = NULL;
-  IdeContext *context;
-  GFile *workdir;
-
   IDE_ENTRY;
 
   g_return_if_fail (GB_IS_FILE_SEARCH_PROVIDER (self));
   g_return_if_fail (IDE_IS_VCS (vcs));
 
-  context = ide_object_get_context (IDE_OBJECT (self));
-  workdir = ide_vcs_get_working_directory (vcs);
-
-  index = g_object_new (GB_TYPE_FILE_SEARCH_INDEX,
-                        "context", context,
-                        "root-directory", workdir,
-                        NULL);
-
-  gb_file_search_index_build_async (index,
-                                    NULL,
-                                    gb_file_search_provider_build_cb,
-                                    g_object_ref (self));
+  gb_file_search_provider_build (self, FALSE);
 
   IDE_EXIT;
 }
@@ -258,12 +360,10 @@ static void
 gb_file_search_provider_constructed (GObject *object)
 {
   GbFileSearchProvider *self = (GbFileSearchProvider *)object;
-  g_autoptr(GbFileSearchIndex) index = NULL;
   IdeBufferManager *bufmgr;
   IdeContext *context;
   IdeProject *project;
   IdeVcs *vcs;
-  GFile *workdir;
 
   context = ide_object_get_context (IDE_OBJECT (self));
 
@@ -271,8 +371,6 @@ gb_file_search_provider_constructed (GObject *object)
   project = ide_context_get_project (context);
   vcs = ide_context_get_vcs (context);
 
-  workdir = ide_vcs_get_working_directory (vcs);
-
   g_signal_connect_object (vcs,
                            "changed",
                            G_CALLBACK (gb_file_search_provider_vcs_changed_cb),
@@ -297,15 +395,7 @@ gb_file_search_provider_constructed (GObject *object)
                            self,
                            G_CONNECT_SWAPPED);
 
-  index = g_object_new (GB_TYPE_FILE_SEARCH_INDEX,
-                        "context", context,
-                        "root-directory", workdir,
-                        NULL);
-
-  gb_file_search_index_build_async (index,
-                                    NULL,
-                                    gb_file_search_provider_build_cb,
-                                    g_object_ref (self));
+  gb_file_search_provider_build (self, TRUE);
 
   G_OBJECT_CLASS (gb_file_search_provider_parent_class)->constructed (object);
 }
@@ -316,6 +406,7 @@ gb_file_search_provider_finalize (GObject *object)
   GbFileSearchProvider *self = (GbFileSearchProvider *)object;
 
   g_clear_object (&self->index);
+  g_clear_pointer (&self->changes, g_array_unref);
 
   G_OBJECT_CLASS (gb_file_search_provider_parent_class)->finalize (object);
 }
@@ -337,6 +428,8 @@ gb_file_search_provider_class_finalize (GbFileSearchProviderClass *klass)
 static void
 gb_file_search_provider_init (GbFileSearchProvider *self)
 {
+  self->changes = g_array_new (FALSE, FALSE, sizeof (IndexChange));
+  g_array_set_clear_func (self->changes, index_change_clear);
 }
 
 static void
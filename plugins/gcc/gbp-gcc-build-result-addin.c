@@ -16,215 +16,242 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <string.h>
-
 #include "egg-signal-group.h"
 
 #include "gbp-gcc-build-result-addin.h"
+#include "gbp-gcc-parser.h"
 
+/*
+ * The number of lines scanned while holding the lock of the build log. The
+ * scanner is cheap enough per line that this is a few microseconds.
+ */
+#define SCAN_BATCH_SIZE 1024
 
-#define ERROR_FORMAT_REGEX           \
-  "(?<filename>[a-zA-Z0-9\\-\\.]+):" \
-  "(?<line>\\d+):"                   \
-  "(?<column>\\d+): "                \
-  "(?<level>[\\w\\s]+): "            \
-  "(?<message>.*)"
+/*
+ * The state of the scanner is only used by one thread at a time. It is
+ * owned by the addin while idle, and by the worker while scanning.
+ */
+typedef struct
+{
+  IdeBuildLog  *log;
+  GbpGccParser *parser;
+  guint64       next_line;
+} Scanner;
+
+typedef struct
+{
+  Scanner   *scanner;
+  GPtrArray *diagnostics;
+} ScanState;
 
 struct _GbpGccBuildResultAddin
 {
   IdeObject       parent_instance;
 
   EggSignalGroup *signals;
-  gchar          *current_dir;
-  gchar          *top_dir;
+  IdeBuildResult *result;
+  GCancellable   *cancellable;
+
+  /* NULL while a scan is in flight */
+  Scanner        *scanner;
+
+  guint           needs_scan : 1;
 };
 
 static void build_result_addin_iface_init (IdeBuildResultAddinInterface *iface);
+static void gbp_gcc_build_result_addin_queue_scan (GbpGccBuildResultAddin *self);
 
 G_DEFINE_TYPE_EXTENDED (GbpGccBuildResultAddin, gbp_gcc_build_result_addin, IDE_TYPE_OBJECT, 0,
                         G_IMPLEMENT_INTERFACE (IDE_TYPE_BUILD_RESULT_ADDIN,
                                                build_result_addin_iface_init))
 
-static GRegex *errfmt;
+static Scanner *
+scanner_new (IdeBuildLog *log,
+             GFile       *workdir)
+{
+  Scanner *scanner;
+
+  scanner = g_slice_new0 (Scanner);
+  scanner->log = ide_build_log_ref (log);
+  scanner->parser = gbp_gcc_parser_new (workdir);
+
+  return scanner;
+}
+
+static void
+scanner_free (Scanner *scanner)
+{
+  g_clear_pointer (&scanner->log, ide_build_log_unref);
+  g_clear_pointer (&scanner->parser, gbp_gcc_parser_free);
+  g_slice_free (Scanner, scanner);
+}
 
-static IdeDiagnosticSeverity
-parse_severity (const gchar *str)
+static gboolean
+scan_line (guint64            line_number,
+           IdeBuildResultLog  log,
+           const gchar       *text,
+           gsize              len,
+           gpointer           user_data)
 {
-  g_autofree gchar *lower = NULL;
+  ScanState *state = user_data;
+  GbpGccDiagnostic *diag;
 
-  if (str == NULL)
-    return IDE_DIAGNOSTIC_WARNING;
+  if (NULL != (diag = gbp_gcc_parser_parse_line (state->scanner->parser, text, len)))
+    g_ptr_array_add (state->diagnostics, diag);
+
+  return FALSE;
+}
+
+static void
+gbp_gcc_build_result_addin_scan_worker (GTask        *task,
+                                        gpointer      source_object,
+                                        gpointer      task_data,
+                                        GCancellable *cancellable)
+{
+  ScanState state;
+  guint64 end;
 
-  lower = g_utf8_strdown (str, -1);
+  g_assert (G_IS_TASK (task));
+  g_assert (GBP_IS_GCC_BUILD_RESULT_ADDIN (source_object));
+  g_assert (task_data != NULL);
 
-  if (strstr (lower, "fatal") != NULL)
-    return IDE_DIAGNOSTIC_FATAL;
+  state.scanner = task_data;
+  state.diagnostics = g_ptr_array_new_with_free_func ((GDestroyNotify)gbp_gcc_diagnostic_free);
 
-  if (strstr (lower, "error") != NULL)
-    return IDE_DIAGNOSTIC_ERROR;
+  ide_build_log_get_bounds (state.scanner->log, NULL, &end);
 
-  if (strstr (lower, "warning") != NULL)
-    return IDE_DIAGNOSTIC_WARNING;
+  /*
+   * Lines dropped from the log before we got to them are simply skipped by
+   * ide_build_log_foreach(), so we always advance by a whole batch.
+   */
+  while (state.scanner->next_line < end)
+    {
+      guint64 batch_end = MIN (end, state.scanner->next_line + SCAN_BATCH_SIZE);
 
-  if (strstr (lower, "ignored") != NULL)
-    return IDE_DIAGNOSTIC_IGNORED;
+      if (g_cancellable_is_cancelled (cancellable))
+        break;
 
-  if (strstr (lower, "deprecated") != NULL)
-    return IDE_DIAGNOSTIC_DEPRECATED;
+      ide_build_log_foreach (state.scanner->log,
+                             state.scanner->next_line,
+                             batch_end,
+                             scan_line,
+                             &state);
 
-  if (strstr (lower, "note") != NULL)
-    return IDE_DIAGNOSTIC_NOTE;
+      state.scanner->next_line = batch_end;
+    }
 
-  return IDE_DIAGNOSTIC_WARNING;
+  g_task_return_pointer (task, state.diagnostics, (GDestroyNotify)g_ptr_array_unref);
 }
 
-static IdeDiagnostic *
-create_diagnostic (GbpGccBuildResultAddin *self,
-                   GMatchInfo             *match_info)
+static void
+gbp_gcc_build_result_addin_scan_cb (GObject      *object,
+                                    GAsyncResult *result,
+                                    gpointer      user_data)
 {
-  g_autofree gchar *filename = NULL;
-  g_autofree gchar *line = NULL;
-  g_autofree gchar *column = NULL;
-  g_autofree gchar *message = NULL;
-  g_autofree gchar *level = NULL;
-  g_autoptr(IdeFile) file = NULL;
-  g_autoptr(IdeSourceLocation) location = NULL;
-  IdeDiagnostic *diagnostic;
+  GbpGccBuildResultAddin *self = (GbpGccBuildResultAddin *)object;
+  g_autoptr(GPtrArray) diagnostics = NULL;
+  GTask *task = (GTask *)result;
+  Scanner *scanner;
   IdeContext *context;
-  struct {
-    gint64 line;
-    gint64 column;
-    IdeDiagnosticSeverity severity;
-  } parsed;
 
   g_assert (GBP_IS_GCC_BUILD_RESULT_ADDIN (self));
-  g_assert (match_info != NULL);
-
-  message = g_match_info_fetch_named (match_info, "message");
-
-  /* Ignore _FORTIFY_SOURCE warnings which require optimization */
-  if (message != NULL && (strncmp (message, "#warning _FORTIFY_SOURCE requires compiling with optimization", 61) == 0))
-    return NULL;
+  g_assert (G_IS_TASK (task));
 
-  filename = g_match_info_fetch_named (match_info, "filename");
-  line = g_match_info_fetch_named (match_info, "line");
-  column = g_match_info_fetch_named (match_info, "column");
-  level = g_match_info_fetch_named (match_info, "level");
+  scanner = g_task_get_task_data (task);
+  diagnostics = g_task_propagate_pointer (task, NULL);
 
-  parsed.line = g_ascii_strtoll (line, NULL, 10);
-  if (parsed.line < 1 || parsed.line > G_MAXINT32)
-    return NULL;
-  parsed.line--;
+  /* We were unloaded while scanning, the scanner belongs to a stale result */
+  if (g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+    {
+      scanner_free (scanner);
+      return;
+    }
 
-  parsed.column = g_ascii_strtoll (column, NULL, 10);
-  if (parsed.column < 1 || parsed.column > G_MAXINT32)
-    return NULL;
-  parsed.column--;
+  g_assert (self->scanner == NULL);
+  g_assert (self->result != NULL);
 
-  parsed.severity = parse_severity (level);
+  self->scanner = scanner;
 
   context = ide_object_get_context (IDE_OBJECT (self));
 
-  if (!g_path_is_absolute (filename) && self->current_dir != NULL)
+  for (guint i = 0; diagnostics != NULL && i < diagnostics->len; i++)
     {
-      const gchar *basedir = self->current_dir;
-      gchar *path;
-
-      if (g_str_has_prefix (basedir, self->top_dir))
-        {
-          basedir += strlen (self->top_dir);
-          if (*basedir == '/')
-            basedir++;
-        }
-
-      path = g_build_filename (basedir, filename, NULL);
-      g_free (filename);
-      filename = path;
+      const GbpGccDiagnostic *diag = g_ptr_array_index (diagnostics, i);
+      g_autoptr(IdeFile) file = NULL;
+      g_autoptr(IdeSourceLocation) location = NULL;
+      g_autoptr(IdeDiagnostic) diagnostic = NULL;
+
+      file = ide_file_new_for_path (context, diag->path);
+      location = ide_source_location_new (file, diag->line, diag->column, 0);
+      diagnostic = ide_diagnostic_new (diag->severity, diag->message, location);
+
+      ide_build_result_emit_diagnostic (self->result, diagnostic);
     }
 
-  if (!g_path_is_absolute (filename))
-    {
-      g_autoptr(GFile) child = NULL;
-      IdeVcs *vcs;
-      GFile *workdir;
-      gchar *path;
+  if (self->needs_scan)
+    gbp_gcc_build_result_addin_queue_scan (self);
+}
 
-      vcs = ide_context_get_vcs (context);
-      workdir = ide_vcs_get_working_directory (vcs);
+static void
+gbp_gcc_build_result_addin_queue_scan (GbpGccBuildResultAddin *self)
+{
+  g_autoptr(GTask) task = NULL;
 
-      child = g_file_get_child (workdir, filename);
-      path = g_file_get_path (child);
+  g_assert (GBP_IS_GCC_BUILD_RESULT_ADDIN (self));
 
-      g_free (filename);
-      filename = path;
+  /* Lines logged during a scan are picked up by the next one */
+  if (self->scanner == NULL)
+    {
+      self->needs_scan = TRUE;
+      return;
     }
 
-  file = ide_file_new_for_path (context, filename);
-  location = ide_source_location_new (file, parsed.line, parsed.column, 0);
-  diagnostic = ide_diagnostic_new (parsed.severity, message, location);
+  self->needs_scan = FALSE;
 
-  return diagnostic;
+  task = g_task_new (self, self->cancellable, gbp_gcc_build_result_addin_scan_cb, NULL);
+  g_task_set_source_tag (task, gbp_gcc_build_result_addin_queue_scan);
+  g_task_set_task_data (task, g_steal_pointer (&self->scanner), NULL);
+  ide_thread_pool_push_task (IDE_THREAD_POOL_COMPILER,
+                             task,
+                             gbp_gcc_build_result_addin_scan_worker);
 }
 
 static void
-gbp_gcc_build_result_addin_log (GbpGccBuildResultAddin *self,
-                                IdeBuildResultLog       log,
-                                const gchar            *message,
-                                IdeBuildResult         *result)
+gbp_gcc_build_result_addin_log_lines (GbpGccBuildResultAddin *self,
+                                      guint64                 begin,
+                                      guint64                 end,
+                                      IdeBuildResult         *result)
 {
-  GMatchInfo *match_info = NULL;
-  const gchar *enterdir;
-
   g_assert (GBP_IS_GCC_BUILD_RESULT_ADDIN (self));
   g_assert (IDE_IS_BUILD_RESULT (result));
 
-#define ENTERING_DIRECTORY_BEGIN "Entering directory '"
-#define ENTERING_DIRECTORY_END   "'\n"
-
   /*
-   * This expects LANG=C, which is defined in the autotools Builder.
-   * Not the most ideal decoupling of logic, but we don't have a whole
-   * lot to work with here.
+   * The lines are already in the build log, which we scan from a worker
+   * thread so that parsing does not compete with the main loop.
    */
-  if (NULL != (enterdir = strstr (message, ENTERING_DIRECTORY_BEGIN)) &&
-      g_str_has_suffix (enterdir, ENTERING_DIRECTORY_END))
-    {
-      gssize len;
-
-      enterdir += IDE_LITERAL_LENGTH (ENTERING_DIRECTORY_BEGIN);
-      len = strlen (enterdir) - IDE_LITERAL_LENGTH (ENTERING_DIRECTORY_END);
-
-      if (len > 0)
-        {
-          g_free (self->current_dir);
-          self->current_dir = g_strndup (enterdir, len);
-          if (self->top_dir == NULL)
-            self->top_dir = g_strndup (enterdir, len);
-        }
-    }
-
-  if (g_regex_match (errfmt, message, 0, &match_info))
-    {
-      IdeDiagnostic *diagnostic;
+  if (!self->needs_scan)
+    gbp_gcc_build_result_addin_queue_scan (self);
+}
 
-      if (NULL != (diagnostic = create_diagnostic (self, match_info)))
-        {
-          ide_build_result_emit_diagnostic (result, diagnostic);
-          ide_diagnostic_unref (diagnostic);
-        }
-    }
+static void
+gbp_gcc_build_result_addin_finalize (GObject *object)
+{
+  GbpGccBuildResultAddin *self = (GbpGccBuildResultAddin *)object;
 
-  g_match_info_free (match_info);
+  g_clear_object (&self->signals);
+  g_clear_object (&self->result);
+  g_clear_object (&self->cancellable);
+  g_clear_pointer (&self->scanner, scanner_free);
 
-#undef ENTERING_DIRECTORY_BEGIN
-#undef ENTERING_DIRECTORY_END
+  G_OBJECT_CLASS (gbp_gcc_build_result_addin_parent_class)->finalize (object);
 }
 
 static void
 gbp_gcc_build_result_addin_class_init (GbpGccBuildResultAddinClass *klass)
 {
-  errfmt = g_regex_new (ERROR_FORMAT_REGEX, G_REGEX_OPTIMIZE | G_REGEX_CASELESS, 0, NULL);
-  g_assert (errfmt != NULL);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gbp_gcc_build_result_addin_finalize;
 }
 
 static void
@@ -233,8 +260,8 @@ gbp_gcc_build_result_addin_init (GbpGccBuildResultAddin *self)
   self->signals = egg_signal_group_new (IDE_TYPE_BUILD_RESULT);
 
   egg_signal_group_connect_object (self->signals,
-                                   "log",
-                                   G_CALLBACK (gbp_gcc_build_result_addin_log),
+                                   "log-lines",
+                                   G_CALLBACK (gbp_gcc_build_result_addin_log_lines),
                                    self,
                                    G_CONNECT_SWAPPED);
 }
@@ -244,8 +271,20 @@ gbp_gcc_build_result_addin_load (IdeBuildResultAddin *addin,
                                  IdeBuildResult      *result)
 {
   GbpGccBuildResultAddin *self = (GbpGccBuildResultAddin *)addin;
+  IdeContext *context;
+  IdeVcs *vcs;
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  vcs = ide_context_get_vcs (context);
+
+  self->result = g_object_ref (result);
+  self->cancellable = g_cancellable_new ();
+  self->scanner = scanner_new (ide_build_result_get_log (result),
+                               ide_vcs_get_working_directory (vcs));
 
   egg_signal_group_set_target (self->signals, result);
+
+  gbp_gcc_build_result_addin_queue_scan (self);
 }
 
 static void
@@ -255,8 +294,14 @@ gbp_gcc_build_result_addin_unload (IdeBuildResultAddin *addin,
   GbpGccBuildResultAddin *self = (GbpGccBuildResultAddin *)addin;
 
   egg_signal_group_set_target (self->signals, NULL);
-  g_clear_pointer (&self->current_dir, g_free);
-  g_clear_pointer (&self->top_dir, g_free);
+
+  /* An in-flight scan frees its scanner when it completes */
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+  g_clear_pointer (&self->scanner, scanner_free);
+  g_clear_object (&self->result);
+
+  self->needs_scan = FALSE;
 }
 
 static void
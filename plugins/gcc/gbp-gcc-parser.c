@@ -0,0 +1,358 @@
+/* gbp-gcc-parser.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "gbp-gcc-parser.h"
+
+/*
+ * These expect LANG=C, which is defined in the autotools Builder. Older
+ * versions of make quote the directory as `dir' rather than 'dir'.
+ */
+#define ENTERING_DIRECTORY "Entering directory "
+#define LEAVING_DIRECTORY  "Leaving directory "
+
+#define FORTIFY_SOURCE_WARNING "#warning _FORTIFY_SOURCE requires compiling with optimization"
+
+/*
+ * Parses diagnostics from the output of gcc and clang, one line at a time.
+ * Paths are relative to the directory make was in when it ran the
+ * compiler, so the directories it enters and leaves are tracked as well.
+ */
+struct _GbpGccParser
+{
+  GFile     *workdir;
+
+  /* The first directory make entered */
+  gchar     *top_dir;
+
+  /* The directories make entered and did not leave yet, innermost last */
+  GPtrArray *dirs;
+};
+
+GbpGccParser *
+gbp_gcc_parser_new (GFile *workdir)
+{
+  GbpGccParser *self;
+
+  g_return_val_if_fail (G_IS_FILE (workdir), NULL);
+
+  self = g_slice_new0 (GbpGccParser);
+  self->workdir = g_object_ref (workdir);
+  self->dirs = g_ptr_array_new_with_free_func (g_free);
+
+  return self;
+}
+
+void
+gbp_gcc_parser_free (GbpGccParser *self)
+{
+  if (self == NULL)
+    return;
+
+  g_clear_object (&self->workdir);
+  g_clear_pointer (&self->top_dir, g_free);
+  g_clear_pointer (&self->dirs, g_ptr_array_unref);
+  g_slice_free (GbpGccParser, self);
+}
+
+void
+gbp_gcc_diagnostic_free (GbpGccDiagnostic *diag)
+{
+  if (diag == NULL)
+    return;
+
+  g_free (diag->path);
+  g_free (diag->message);
+  g_slice_free (GbpGccDiagnostic, diag);
+}
+
+static gboolean
+level_contains (const gchar *level,
+                gsize        len,
+                const gchar *needle)
+{
+  gsize needle_len = strlen (needle);
+
+  for (gsize i = 0; i + needle_len <= len; i++)
+    {
+      if (g_ascii_strncasecmp (&level [i], needle, needle_len) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static IdeDiagnosticSeverity
+parse_severity (const gchar *level,
+                gsize        len)
+{
+  if (level_contains (level, len, "fatal"))
+    return IDE_DIAGNOSTIC_FATAL;
+
+  if (level_contains (level, len, "error"))
+    return IDE_DIAGNOSTIC_ERROR;
+
+  if (level_contains (level, len, "warning"))
+    return IDE_DIAGNOSTIC_WARNING;
+
+  if (level_contains (level, len, "ignored"))
+    return IDE_DIAGNOSTIC_IGNORED;
+
+  if (level_contains (level, len, "deprecated"))
+    return IDE_DIAGNOSTIC_DEPRECATED;
+
+  if (level_contains (level, len, "note"))
+    return IDE_DIAGNOSTIC_NOTE;
+
+  return IDE_DIAGNOSTIC_WARNING;
+}
+
+static inline gboolean
+parse_number (const gchar **iter,
+              const gchar  *end,
+              guint        *value)
+{
+  const gchar *p = *iter;
+  guint64 v = 0;
+
+  if (p >= end || !g_ascii_isdigit (*p))
+    return FALSE;
+
+  for (; p < end && g_ascii_isdigit (*p); p++)
+    {
+      v = v * 10 + (*p - '0');
+      if (v > G_MAXINT32)
+        return FALSE;
+    }
+
+  *iter = p;
+  *value = v;
+
+  return TRUE;
+}
+
+/*
+ * Parses a line in the form of "file:line:column: level: message" as
+ * produced by gcc and clang. Most lines of build output have no colon
+ * followed by a digit, so they are rejected after a single memchr() and
+ * without any allocation.
+ */
+static gboolean
+parse_line (const gchar  *text,
+            gsize         len,
+            const gchar **filename,
+            gsize        *filename_len,
+            guint        *line,
+            guint        *column,
+            const gchar **level,
+            gsize        *level_len,
+            const gchar **message)
+{
+  const gchar *end = text + len;
+  const gchar *colon;
+
+  for (colon = memchr (text, ':', len);
+       colon != NULL;
+       colon = memchr (colon + 1, ':', end - colon - 1))
+    {
+      const gchar *iter = colon + 1;
+      const gchar *begin;
+      const gchar *level_begin;
+
+      if (!parse_number (&iter, end, line) || iter >= end || *iter != ':')
+        continue;
+      iter++;
+
+      if (!parse_number (&iter, end, column) || end - iter < 2 || iter [0] != ':' || iter [1] != ' ')
+        continue;
+      iter += 2;
+
+      /* The file name is the word before the line number */
+      for (begin = colon; begin > text && !g_ascii_isspace (begin [-1]); begin--) { }
+      if (begin == colon)
+        continue;
+
+      for (level_begin = iter;
+           iter < end && (g_ascii_isalnum (*iter) || g_ascii_isspace (*iter) || *iter == '_');
+           iter++) { }
+      if (iter == level_begin || end - iter < 2 || iter [0] != ':' || iter [1] != ' ')
+        continue;
+
+      if (*line < 1 || *column < 1)
+        continue;
+
+      *filename = begin;
+      *filename_len = colon - begin;
+      *level = level_begin;
+      *level_len = iter - level_begin;
+      *message = iter + 2;
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gchar *
+find_directory (const gchar *text,
+                gsize        len,
+                const gchar *prefix)
+{
+  const gchar *end = text + len;
+  const gchar *dir;
+
+  if (NULL == (dir = g_strstr_len (text, len, prefix)))
+    return NULL;
+
+  dir += strlen (prefix);
+
+  if (end - dir < 3 || (dir [0] != '\'' && dir [0] != '`') || end [-1] != '\'')
+    return NULL;
+
+  return g_strndup (dir + 1, end - dir - 2);
+}
+
+/*
+ * Tracks the directory make is in from lines such as
+ * "make[1]: Entering directory '/path'". Returns %TRUE if @text was
+ * such a line.
+ */
+static gboolean
+gbp_gcc_parser_change_directory (GbpGccParser *self,
+                                 const gchar  *text,
+                                 gsize         len)
+{
+  gchar *dir;
+
+  g_assert (self != NULL);
+
+  if (NULL != (dir = find_directory (text, len, ENTERING_DIRECTORY)))
+    {
+      if (self->top_dir == NULL)
+        self->top_dir = g_strdup (dir);
+      g_ptr_array_add (self->dirs, dir);
+      return TRUE;
+    }
+
+  if (NULL != (dir = find_directory (text, len, LEAVING_DIRECTORY)))
+    {
+      if (self->dirs->len > 0)
+        g_ptr_array_remove_index (self->dirs, self->dirs->len - 1);
+      g_free (dir);
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gchar *
+gbp_gcc_parser_resolve_path (GbpGccParser *self,
+                             const gchar  *filename,
+                             gsize         filename_len)
+{
+  g_autofree gchar *path = NULL;
+
+  g_assert (self != NULL);
+
+  path = g_strndup (filename, filename_len);
+
+  if (!g_path_is_absolute (path) && self->dirs->len > 0)
+    {
+      const gchar *basedir = g_ptr_array_index (self->dirs, self->dirs->len - 1);
+      gchar *joined;
+
+      if (g_str_has_prefix (basedir, self->top_dir))
+        {
+          basedir += strlen (self->top_dir);
+          if (*basedir == '/')
+            basedir++;
+        }
+
+      joined = g_build_filename (basedir, path, NULL);
+      g_free (path);
+      path = joined;
+    }
+
+  if (!g_path_is_absolute (path))
+    {
+      g_autoptr(GFile) child = NULL;
+
+      child = g_file_get_child (self->workdir, path);
+      g_free (path);
+      path = g_file_get_path (child);
+    }
+
+  return g_steal_pointer (&path);
+}
+
+/**
+ * gbp_gcc_parser_parse_line:
+ * @text: a line of build output, without the newline
+ * @len: the length of @text
+ *
+ * Parses a line of build output. Lines must be given in order, since
+ * lines telling which directory make is in change how relative paths are
+ * resolved.
+ *
+ * Returns: (transfer full) (nullable): a #GbpGccDiagnostic or %NULL.
+ */
+GbpGccDiagnostic *
+gbp_gcc_parser_parse_line (GbpGccParser *self,
+                           const gchar  *text,
+                           gsize         len)
+{
+  GbpGccDiagnostic *diag;
+  const gchar *filename;
+  const gchar *level;
+  const gchar *message;
+  gsize filename_len;
+  gsize level_len;
+  gsize message_len;
+  guint line;
+  guint column;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (text != NULL, NULL);
+
+  /*
+   * Match anywhere in the line, since the prefix depends on how make was
+   * invoked ("gmake[1]:", "/usr/bin/make[1]:", etc).
+   */
+  if G_UNLIKELY (gbp_gcc_parser_change_directory (self, text, len))
+    return NULL;
+
+  if G_LIKELY (!parse_line (text, len, &filename, &filename_len, &line, &column, &level, &level_len, &message))
+    return NULL;
+
+  message_len = (text + len) - message;
+
+  /* Ignore _FORTIFY_SOURCE warnings which require optimization */
+  if (message_len >= IDE_LITERAL_LENGTH (FORTIFY_SOURCE_WARNING) &&
+      strncmp (message, FORTIFY_SOURCE_WARNING, IDE_LITERAL_LENGTH (FORTIFY_SOURCE_WARNING)) == 0)
+    return NULL;
+
+  diag = g_slice_new0 (GbpGccDiagnostic);
+  diag->path = gbp_gcc_parser_resolve_path (self, filename, filename_len);
+  diag->message = g_strndup (message, message_len);
+  diag->line = line - 1;
+  diag->column = column - 1;
+  diag->severity = parse_severity (level, level_len);
+
+  return diag;
+}
@@ -0,0 +1,57 @@
+/* gbp-gcc-parser.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GBP_GCC_PARSER_H
+#define GBP_GCC_PARSER_H
+
+#include <ide.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GbpGccParser GbpGccParser;
+
+/**
+ * GbpGccDiagnostic:
+ * @path: the absolute path of the file
+ * @message: the message, without the location and level
+ * @line: the line, starting from zero
+ * @column: the column, starting from zero
+ * @severity: the severity, parsed from the level
+ *
+ * A diagnostic found in the build output. It is plain data, so that it
+ * can be created from a worker thread.
+ */
+typedef struct
+{
+  gchar                 *path;
+  gchar                 *message;
+  guint                  line;
+  guint                  column;
+  IdeDiagnosticSeverity  severity;
+} GbpGccDiagnostic;
+
+GbpGccParser     *gbp_gcc_parser_new        (GFile            *workdir);
+void              gbp_gcc_parser_free       (GbpGccParser     *self);
+GbpGccDiagnostic *gbp_gcc_parser_parse_line (GbpGccParser     *self,
+                                             const gchar      *text,
+                                             gsize             len);
+void              gbp_gcc_diagnostic_free   (GbpGccDiagnostic *diag);
+
+G_END_DECLS
+
+#endif /* GBP_GCC_PARSER_H */
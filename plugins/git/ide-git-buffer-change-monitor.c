@@ -22,8 +22,10 @@
 #include <egg-signal-group.h>
 #include <glib/gi18n.h>
 #include <libgit2-glib/ggit.h>
+#include <string.h>
 
 #include "ide-git-buffer-change-monitor.h"
+#include "ide-git-line-diff.h"
 #include "ide-git-vcs.h"
 
 /**
@@ -35,13 +37,17 @@
  *
  * To enable us to avoid blocking the main loop, the actual diff is performed in a background
  * thread. To avoid threading issues with the rest of LibIDE, this module creates a copy of the
- * loaded repository. A single thread will be dispatched for the context and all reload tasks
- * will be performed from that thread.
+ * loaded repository. Diffs are performed on the compiler thread pool so that multiple open
+ * buffers may be diffed concurrently.
+ *
+ * Both the file found in HEAD and the buffer are kept split into hashed lines between runs.
+ * As the buffer is edited, we track the range of lines that were touched so that only those
+ * lines need to be copied out of the buffer and rehashed. The diff itself trims the common
+ * lines at the beginning and end of the file, so only the window containing changes is
+ * searched.
  *
  * Upon completion of the diff, the results will be passed back to the primary thread and the
  * state updated for use by line change renderer in the source view.
- *
- * TODO: Move the thread work into ide_thread_pool?
  */
 
 struct _IdeGitBufferChangeMonitor
@@ -54,9 +60,19 @@ struct _IdeGitBufferChangeMonitor
   IdeBuffer              *buffer;
 
   GgitRepository         *repository;
-  GHashTable             *state;
+  GByteArray             *state;
 
   GgitBlob               *cached_blob;
+  GArray                 *cached_blob_lines;
+  guint                   blob_serial;
+
+  /*
+   * Hashes of each line in the buffer as of the last diff, or NULL if a
+   * diff is in flight or they are unknown. Lines edited since then are
+   * tracked in dirty_lines.
+   */
+  GArray                 *line_hashes;
+  IdeGitDirtyLines        dirty_lines;
 
   guint                   changed_timeout;
 
@@ -68,12 +84,22 @@ struct _IdeGitBufferChangeMonitor
 
 typedef struct
 {
-  GgitRepository *repository;
-  GHashTable     *state;
-  GFile          *file;
-  GBytes         *content;
-  GgitBlob       *blob;
-  guint           is_child_of_workdir : 1;
+  GgitRepository    *repository;
+  GByteArray        *state;
+  GFile             *file;
+  /* Full buffer contents, if line_hashes is NULL */
+  IdeBufferSnapshot *snapshot;
+  /* Or, the previous line hashes and the replacement for edited lines */
+  GArray            *line_hashes;
+  GArray            *patch;
+  guint              patch_prefix;
+  guint              patch_suffix;
+  guint              n_lines;
+  GgitBlob          *blob;
+  GArray            *blob_lines;
+  guint              blob_serial;
+  guint              implicit_trailing_newline : 1;
+  guint              is_child_of_workdir : 1;
 } DiffTask;
 
 G_DEFINE_TYPE (IdeGitBufferChangeMonitor,
@@ -89,9 +115,15 @@ enum {
   LAST_PROP
 };
 
-static GParamSpec  *properties [LAST_PROP];
-static GAsyncQueue *work_queue;
-static GThread     *work_thread;
+static GParamSpec *properties [LAST_PROP];
+
+static void ide_git_buffer_change_monitor_worker (GTask        *task,
+                                                  gpointer      source_object,
+                                                  gpointer      task_data,
+                                                  GCancellable *cancellable);
+
+/* libgit2 object lookups are serialized, the diffs themselves are not */
+G_LOCK_DEFINE_STATIC (lookup_lock);
 
 static void
 diff_task_free (gpointer data)
@@ -103,12 +135,16 @@ diff_task_free (gpointer data)
       g_clear_object (&diff->file);
       g_clear_object (&diff->blob);
       g_clear_object (&diff->repository);
-      g_clear_pointer (&diff->state, g_hash_table_unref);
-      g_clear_pointer (&diff->content, g_bytes_unref);
+      g_clear_pointer (&diff->state, g_byte_array_unref);
+      g_clear_pointer (&diff->snapshot, ide_buffer_snapshot_unref);
+      g_clear_pointer (&diff->line_hashes, g_array_unref);
+      g_clear_pointer (&diff->patch, g_array_unref);
+      g_clear_pointer (&diff->blob_lines, g_array_unref);
+      g_slice_free (DiffTask, diff);
     }
 }
 
-static GHashTable *
+static GByteArray *
 ide_git_buffer_change_monitor_calculate_finish (IdeGitBufferChangeMonitor  *self,
                                                 GAsyncResult               *result,
                                                 GError                    **error)
@@ -121,9 +157,29 @@ ide_git_buffer_change_monitor_calculate_finish (IdeGitBufferChangeMonitor  *self
 
   diff = g_task_get_task_data (task);
 
-  /* Keep the blob around for future use */
-  if (diff->blob != self->cached_blob)
-    g_set_object (&self->cached_blob, diff->blob);
+  /*
+   * Keep the blob and its lines around for future use, unless we were
+   * reloaded while the diff was in flight.
+   */
+  if (diff->blob_serial == self->blob_serial)
+    {
+      if (diff->blob != self->cached_blob)
+        g_set_object (&self->cached_blob, diff->blob);
+
+      if (diff->blob_lines != self->cached_blob_lines)
+        {
+          g_clear_pointer (&self->cached_blob_lines, g_array_unref);
+          if (diff->blob_lines != NULL)
+            self->cached_blob_lines = g_array_ref (diff->blob_lines);
+        }
+    }
+
+  /*
+   * Take back the line hashes, which now match the buffer as it was when
+   * the diff was requested. Edits since then are tracked as dirty lines.
+   */
+  g_clear_pointer (&self->line_hashes, g_array_unref);
+  self->line_hashes = g_steal_pointer (&diff->line_hashes);
 
   /* If the file is a child of the working directory, we need to know */
   self->is_child_of_workdir = diff->is_child_of_workdir;
@@ -131,6 +187,43 @@ ide_git_buffer_change_monitor_calculate_finish (IdeGitBufferChangeMonitor  *self
   return g_task_propagate_pointer (task, error);
 }
 
+/*
+ * Hashes lines @begin_line up to (but not including) @end_line of the
+ * buffer. Returns NULL if the buffer splits lines in a way we do not
+ * (such as a lone \r), in which case the whole buffer must be hashed.
+ */
+static GArray *
+ide_git_buffer_change_monitor_hash_lines (IdeGitBufferChangeMonitor *self,
+                                          guint                      begin_line,
+                                          guint                      end_line)
+{
+  g_autoptr(GArray) hashes = NULL;
+  g_autofree gchar *text = NULL;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+  g_assert (begin_line <= end_line);
+
+  hashes = g_array_sized_new (FALSE, FALSE, sizeof (guint64), end_line - begin_line);
+
+  if (begin_line == end_line)
+    return g_steal_pointer (&hashes);
+
+  gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self->buffer), &begin, begin_line);
+  gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self->buffer), &end, end_line - 1);
+  if (!gtk_text_iter_ends_line (&end))
+    gtk_text_iter_forward_to_line_end (&end);
+
+  text = gtk_text_iter_get_text (&begin, &end);
+  ide_git_line_hashes_add (hashes, text, strlen (text));
+
+  if (hashes->len != end_line - begin_line)
+    return NULL;
+
+  return g_steal_pointer (&hashes);
+}
+
 static void
 ide_git_buffer_change_monitor_calculate_async (IdeGitBufferChangeMonitor *self,
                                                GCancellable              *cancellable,
@@ -166,15 +259,50 @@ ide_git_buffer_change_monitor_calculate_async (IdeGitBufferChangeMonitor *self,
   diff = g_slice_new0 (DiffTask);
   diff->file = g_object_ref (gfile);
   diff->repository = g_object_ref (self->repository);
-  diff->state = g_hash_table_new (g_direct_hash, g_direct_equal);
-  diff->content = ide_buffer_get_content (self->buffer);
   diff->blob = self->cached_blob ? g_object_ref (self->cached_blob) : NULL;
+  diff->blob_lines = self->cached_blob_lines ? g_array_ref (self->cached_blob_lines) : NULL;
+  diff->blob_serial = self->blob_serial;
+  diff->n_lines = gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (self->buffer));
+  diff->implicit_trailing_newline =
+    gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (self->buffer));
+
+  if (self->line_hashes != NULL)
+    {
+      diff->line_hashes = g_steal_pointer (&self->line_hashes);
+
+      if (self->dirty_lines.is_dirty &&
+          (self->dirty_lines.prefix + self->dirty_lines.suffix > diff->n_lines ||
+           self->dirty_lines.prefix + self->dirty_lines.suffix > diff->line_hashes->len))
+        {
+          /* Should not happen, but be safe and hash the whole buffer */
+          g_clear_pointer (&diff->line_hashes, g_array_unref);
+        }
+      else if (self->dirty_lines.is_dirty)
+        {
+          diff->patch_prefix = self->dirty_lines.prefix;
+          diff->patch_suffix = self->dirty_lines.suffix;
+          diff->patch = ide_git_buffer_change_monitor_hash_lines (self,
+                                                                  self->dirty_lines.prefix,
+                                                                  diff->n_lines - self->dirty_lines.suffix);
+
+          if (diff->patch == NULL)
+            g_clear_pointer (&diff->line_hashes, g_array_unref);
+        }
+    }
+
+  /* Without the previous line hashes, we need to hash the whole buffer */
+  if (diff->line_hashes == NULL)
+    diff->snapshot = ide_buffer_get_snapshot (self->buffer);
+
+  self->dirty_lines.is_dirty = FALSE;
 
   g_task_set_task_data (task, diff, diff_task_free);
 
   self->in_calculation = TRUE;
 
-  g_async_queue_push (work_queue, g_object_ref (task));
+  ide_thread_pool_push_task (IDE_THREAD_POOL_COMPILER,
+                             task,
+                             ide_git_buffer_change_monitor_worker);
 }
 
 static IdeBufferLineChange
@@ -182,8 +310,7 @@ ide_git_buffer_change_monitor_get_change (IdeBufferChangeMonitor *monitor,
                                           const GtkTextIter      *iter)
 {
   IdeGitBufferChangeMonitor *self = (IdeGitBufferChangeMonitor *)monitor;
-  gpointer key;
-  gpointer value;
+  guint line;
 
   g_return_val_if_fail (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self), IDE_BUFFER_LINE_CHANGE_NONE);
   g_return_val_if_fail (iter, IDE_BUFFER_LINE_CHANGE_NONE);
@@ -198,10 +325,12 @@ ide_git_buffer_change_monitor_get_change (IdeBufferChangeMonitor *monitor,
       return IDE_BUFFER_LINE_CHANGE_NONE;
     }
 
-  key = GINT_TO_POINTER (gtk_text_iter_get_line (iter) + 1);
-  value = g_hash_table_lookup (self->state, key);
+  line = gtk_text_iter_get_line (iter);
 
-  return GPOINTER_TO_INT (value);
+  if (line < self->state->len)
+    return self->state->data [line];
+
+  return IDE_BUFFER_LINE_CHANGE_NONE;
 }
 
 static void
@@ -220,7 +349,7 @@ ide_git_buffer_change_monitor__calculate_cb (GObject      *object,
                                              gpointer      user_data_unused)
 {
   IdeGitBufferChangeMonitor *self = (IdeGitBufferChangeMonitor *)object;
-  g_autoptr(GHashTable) ret = NULL;
+  g_autoptr(GByteArray) ret = NULL;
   g_autoptr(GError) error = NULL;
 
   g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
@@ -236,8 +365,8 @@ ide_git_buffer_change_monitor__calculate_cb (GObject      *object,
     }
   else
     {
-      g_clear_pointer (&self->state, g_hash_table_unref);
-      self->state = g_hash_table_ref (ret);
+      g_clear_pointer (&self->state, g_byte_array_unref);
+      self->state = g_steal_pointer (&ret);
     }
 
   ide_buffer_change_monitor_emit_changed (IDE_BUFFER_CHANGE_MONITOR (self));
@@ -305,6 +434,11 @@ ide_git_buffer_change_monitor__buffer_delete_range_cb (IdeGitBufferChangeMonitor
   g_assert (end);
   g_assert (IDE_IS_BUFFER (buffer));
 
+  ide_git_dirty_lines_mark (&self->dirty_lines,
+                            gtk_text_iter_get_line (begin),
+                            gtk_text_iter_get_line (end),
+                            gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (buffer)));
+
   /*
    * We need to recalculate the diff when text is deleted if:
    *
@@ -335,6 +469,27 @@ recalculate:
   IDE_EXIT;
 }
 
+static void
+ide_git_buffer_change_monitor__buffer_insert_text_cb (IdeGitBufferChangeMonitor *self,
+                                                      GtkTextIter               *location,
+                                                      gchar                     *text,
+                                                      gint                       len,
+                                                      IdeBuffer                 *buffer)
+{
+  guint line;
+
+  g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+  g_assert (location);
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  line = gtk_text_iter_get_line (location);
+
+  ide_git_dirty_lines_mark (&self->dirty_lines,
+                            line,
+                            line,
+                            gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (buffer)));
+}
+
 static void
 ide_git_buffer_change_monitor__buffer_insert_text_after_cb (IdeGitBufferChangeMonitor *self,
                                                             GtkTextIter               *location,
@@ -424,6 +579,9 @@ ide_git_buffer_change_monitor_reload (IdeBufferChangeMonitor *monitor)
   g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
 
   g_clear_object (&self->cached_blob);
+  g_clear_pointer (&self->cached_blob_lines, g_array_unref);
+  self->blob_serial++;
+
   ide_git_buffer_change_monitor_recalculate (self);
 
   IDE_EXIT;
@@ -471,93 +629,107 @@ ide_git_buffer_change_monitor_set_buffer (IdeBufferChangeMonitor *monitor,
   IDE_EXIT;
 }
 
-static gint
-diff_line_cb (GgitDiffDelta *delta,
-              GgitDiffHunk  *hunk,
-              GgitDiffLine  *line,
-              gpointer       user_data)
+static void
+ide_git_buffer_change_monitor_diff_cb (guint    old_begin,
+                                       guint    old_len,
+                                       guint    new_begin,
+                                       guint    new_len,
+                                       gpointer user_data)
 {
-  GgitDiffLineType type;
-  GHashTable *hash = user_data;
-  gint new_lineno;
-  gint old_lineno;
-  gint adjust;
-
-  g_return_val_if_fail (delta, GGIT_ERROR_GIT_ERROR);
-  g_return_val_if_fail (hunk, GGIT_ERROR_GIT_ERROR);
-  g_return_val_if_fail (line, GGIT_ERROR_GIT_ERROR);
-  g_return_val_if_fail (hash, GGIT_ERROR_GIT_ERROR);
+  GByteArray *state = user_data;
 
-  type = ggit_diff_line_get_origin (line);
+  g_assert (state != NULL);
 
-  if ((type != GGIT_DIFF_LINE_ADDITION) && (type != GGIT_DIFF_LINE_DELETION))
-    return 0;
-
-  new_lineno = ggit_diff_line_get_new_lineno (line);
-  old_lineno = ggit_diff_line_get_old_lineno (line);
+  /*
+   * Lines replacing old lines are changed, the rest are added. If more
+   * lines were removed than added, we mark the lines following the change
+   * as having deletions, like git does with its per-hunk offsets.
+   */
 
-  switch (type)
+  for (guint i = 0; i < new_len; i++)
     {
-    case GGIT_DIFF_LINE_ADDITION:
-      if (g_hash_table_lookup (hash, GINT_TO_POINTER (new_lineno)))
-        g_hash_table_replace (hash,
-                              GINT_TO_POINTER (new_lineno),
-                              GINT_TO_POINTER (IDE_BUFFER_LINE_CHANGE_CHANGED));
-      else
-        g_hash_table_insert (hash,
-                             GINT_TO_POINTER (new_lineno),
-                             GINT_TO_POINTER (IDE_BUFFER_LINE_CHANGE_ADDED));
-      break;
+      guint line = new_begin + i;
 
-    case GGIT_DIFF_LINE_DELETION:
-      adjust = (ggit_diff_hunk_get_new_start (hunk) - ggit_diff_hunk_get_old_start (hunk));
-      old_lineno += adjust;
-      if (g_hash_table_lookup (hash, GINT_TO_POINTER (old_lineno)))
-        g_hash_table_replace (hash,
-                              GINT_TO_POINTER (old_lineno),
-                              GINT_TO_POINTER (IDE_BUFFER_LINE_CHANGE_CHANGED));
+      g_assert (line < state->len);
+
+      if (i < old_len || state->data [line] != IDE_BUFFER_LINE_CHANGE_NONE)
+        state->data [line] = IDE_BUFFER_LINE_CHANGE_CHANGED;
       else
-        g_hash_table_insert (hash,
-                             GINT_TO_POINTER (old_lineno),
-                             GINT_TO_POINTER (IDE_BUFFER_LINE_CHANGE_DELETED));
-      break;
+        state->data [line] = IDE_BUFFER_LINE_CHANGE_ADDED;
+    }
 
-    case GGIT_DIFF_LINE_CONTEXT:
-    case GGIT_DIFF_LINE_CONTEXT_EOFNL:
-    case GGIT_DIFF_LINE_ADD_EOFNL:
-    case GGIT_DIFF_LINE_DEL_EOFNL:
-    case GGIT_DIFF_LINE_FILE_HDR:
-    case GGIT_DIFF_LINE_BINARY:
-    default:
-      break;
+  for (guint i = new_len; i < old_len && new_begin + i < state->len; i++)
+    {
+      guint line = new_begin + i;
 
-    case GGIT_DIFF_LINE_HUNK_HDR:
-      g_assert_not_reached ();
+      if (state->data [line] == IDE_BUFFER_LINE_CHANGE_NONE)
+        state->data [line] = IDE_BUFFER_LINE_CHANGE_DELETED;
     }
+}
 
-  return 0;
+static gboolean
+hash_chunk (const gchar *text,
+            gsize        len,
+            gpointer     user_data)
+{
+  ide_git_line_hasher_add (user_data, text, len);
+  return FALSE;
 }
 
 static gboolean
-ide_git_buffer_change_monitor_calculate_threaded (IdeGitBufferChangeMonitor  *self,
-                                                  DiffTask                   *diff,
-                                                  GError                    **error)
+ide_git_buffer_change_monitor_calculate_threaded (DiffTask  *diff,
+                                                  GError   **error)
 {
   g_autofree gchar *relative_path = NULL;
   g_autoptr(GFile) workdir = NULL;
-  const guint8 *data;
-  gsize data_len = 0;
+  guint n_new;
 
-  g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (self));
   g_assert (diff);
   g_assert (G_IS_FILE (diff->file));
-  g_assert (diff->state);
   g_assert (GGIT_IS_REPOSITORY (diff->repository));
-  g_assert (diff->content);
+  g_assert (diff->snapshot || diff->line_hashes);
   g_assert (!diff->blob || GGIT_IS_BLOB (diff->blob));
   g_assert (error);
   g_assert (!*error);
 
+  /*
+   * Bring our line hashes up to date with the buffer first. The main thread
+   * takes them back even if we fail below, so they must be valid.
+   */
+  if (diff->line_hashes == NULL)
+    {
+      IdeGitLineHasher hasher;
+
+      diff->line_hashes = g_array_sized_new (FALSE, FALSE, sizeof (guint64), diff->n_lines + 1);
+
+      ide_git_line_hasher_init (&hasher, diff->line_hashes);
+      ide_buffer_snapshot_foreach_chunk (diff->snapshot, 0, G_MAXSIZE, hash_chunk, &hasher);
+      ide_git_line_hasher_finish (&hasher);
+
+      /* The snapshot includes the implicit trailing newline */
+      if (diff->implicit_trailing_newline && diff->line_hashes->len > 1)
+        g_array_set_size (diff->line_hashes, diff->line_hashes->len - 1);
+    }
+  else if (diff->patch != NULL)
+    {
+      ide_git_line_hashes_splice (diff->line_hashes,
+                                  diff->patch_prefix,
+                                  diff->patch_suffix,
+                                  diff->patch);
+    }
+
+  n_new = diff->line_hashes->len;
+
+  /* A final empty line is just the trailing newline of the file */
+  if (!diff->implicit_trailing_newline &&
+      n_new > 0 &&
+      g_array_index (diff->line_hashes, guint64, n_new - 1) == ide_git_line_hash ("", 0))
+    n_new--;
+
+  diff->state = g_byte_array_sized_new (n_new + 1);
+  g_byte_array_set_size (diff->state, n_new + 1);
+  memset (diff->state->data, 0, diff->state->len);
+
   workdir = ggit_repository_get_workdir (diff->repository);
 
   if (!workdir)
@@ -596,6 +768,8 @@ ide_git_buffer_change_monitor_calculate_threaded (IdeGitBufferChangeMonitor  *se
       GgitTree *tree = NULL;
       GgitTreeEntry *entry = NULL;
 
+      G_LOCK (lookup_lock);
+
       head = ggit_repository_get_head (diff->repository, error);
       if (!head)
         goto cleanup;
@@ -627,6 +801,8 @@ ide_git_buffer_change_monitor_calculate_threaded (IdeGitBufferChangeMonitor  *se
       diff->blob = g_object_ref (blob);
 
     cleanup:
+      G_UNLOCK (lookup_lock);
+
       g_clear_object (&blob);
       g_clear_pointer (&entry_oid, ggit_oid_free);
       g_clear_pointer (&entry, ggit_tree_entry_unref);
@@ -646,41 +822,64 @@ ide_git_buffer_change_monitor_calculate_threaded (IdeGitBufferChangeMonitor  *se
       return FALSE;
     }
 
-  data = g_bytes_get_data (diff->content, &data_len);
+  if (!diff->blob_lines)
+    {
+      const guchar *raw;
+      gsize raw_len = 0;
 
-  ggit_diff_blob_to_buffer (diff->blob, relative_path, data, data_len, relative_path,
-                            NULL, NULL, NULL, NULL, diff_line_cb, (gpointer)diff->state, error);
+      raw = ggit_blob_get_raw_content (diff->blob, &raw_len);
 
-  return ((*error) == NULL);
-}
+      diff->blob_lines = g_array_new (FALSE, FALSE, sizeof (guint64));
 
-static gpointer
-ide_git_buffer_change_monitor_worker (gpointer data)
-{
-  GAsyncQueue *queue = data;
-  GTask *task;
+      if (raw_len > 0)
+        {
+          ide_git_line_hashes_add (diff->blob_lines, (const gchar *)raw, raw_len);
 
-  g_assert (queue);
+          if (raw [raw_len - 1] == '\n')
+            g_array_set_size (diff->blob_lines, diff->blob_lines->len - 1);
+        }
+    }
 
-  while ((task = g_async_queue_pop (queue)))
-    {
-      IdeGitBufferChangeMonitor *self;
-      DiffTask *diff;
-      GError *error = NULL;
+  ide_git_line_diff ((const guint64 *)(gpointer)diff->blob_lines->data,
+                     diff->blob_lines->len,
+                     (const guint64 *)(gpointer)diff->line_hashes->data,
+                     n_new,
+                     ide_git_buffer_change_monitor_diff_cb,
+                     diff->state);
 
-      self = g_task_get_source_object (task);
-      diff = g_task_get_task_data (task);
+  return TRUE;
+}
 
-      if (!ide_git_buffer_change_monitor_calculate_threaded (self, diff, &error))
-        g_task_return_error (task, error);
-      else
-        g_task_return_pointer (task, g_hash_table_ref (diff->state),
-                               (GDestroyNotify)g_hash_table_unref);
+static void
+ide_git_buffer_change_monitor_worker (GTask        *task,
+                                      gpointer      source_object,
+                                      gpointer      task_data,
+                                      GCancellable *cancellable)
+{
+  DiffTask *diff = task_data;
+  GError *error = NULL;
+  gboolean ret;
 
-      g_object_unref (task);
-    }
+  g_assert (G_IS_TASK (task));
+  g_assert (IDE_IS_GIT_BUFFER_CHANGE_MONITOR (source_object));
+  g_assert (diff != NULL);
 
-  return NULL;
+  ret = ide_git_buffer_change_monitor_calculate_threaded (diff, &error);
+
+  /*
+   * Don't hand back line hashes that do not match the buffer line count.
+   * This must happen before returning, as the task data belongs to the
+   * main thread after that.
+   */
+  if (diff->line_hashes != NULL && diff->line_hashes->len != diff->n_lines)
+    g_clear_pointer (&diff->line_hashes, g_array_unref);
+
+  if (!ret)
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task,
+                           g_byte_array_ref (diff->state),
+                           (GDestroyNotify)g_byte_array_unref);
 }
 
 static void
@@ -701,6 +900,10 @@ ide_git_buffer_change_monitor_dispose (GObject *object)
   g_clear_object (&self->cached_blob);
   g_clear_object (&self->repository);
 
+  g_clear_pointer (&self->cached_blob_lines, g_array_unref);
+  g_clear_pointer (&self->line_hashes, g_array_unref);
+  g_clear_pointer (&self->state, g_byte_array_unref);
+
   G_OBJECT_CLASS (ide_git_buffer_change_monitor_parent_class)->dispose (object);
 }
 
@@ -753,11 +956,6 @@ ide_git_buffer_change_monitor_class_init (IdeGitBufferChangeMonitorClass *klass)
                          (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_properties (object_class, LAST_PROP, properties);
-
-  work_queue = g_async_queue_new ();
-  work_thread = g_thread_new ("IdeGitBufferChangeMonitorWorker",
-                              ide_git_buffer_change_monitor_worker,
-                              work_queue);
 }
 
 static void
@@ -766,6 +964,11 @@ ide_git_buffer_change_monitor_init (IdeGitBufferChangeMonitor *self)
   EGG_COUNTER_INC (instances);
 
   self->signal_group = egg_signal_group_new (IDE_TYPE_BUFFER);
+  egg_signal_group_connect_object (self->signal_group,
+                                   "insert-text",
+                                   G_CALLBACK (ide_git_buffer_change_monitor__buffer_insert_text_cb),
+                                   self,
+                                   G_CONNECT_SWAPPED);
   egg_signal_group_connect_object (self->signal_group,
                                    "insert-text",
                                    G_CALLBACK (ide_git_buffer_change_monitor__buffer_insert_text_after_cb),
@@ -0,0 +1,560 @@
+/* ide-git-ignore-cache.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define G_LOG_DOMAIN "ide-git-ignore-cache"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "ide-git-ignore-cache.h"
+
+#define MAX_IGNORED_CACHE_SIZE 100000
+
+/*
+ * Ignore queries arrive from many threads, often for the same paths, so the
+ * answers are cached by relative path.
+ *
+ * Every answer is stored along with a stamp of the ignore files that could
+ * affect it: .git/info/exclude and each .gitignore from the toplevel down to
+ * the directory containing the path. When one of them is created, removed
+ * or modified the stamp changes and the answer is computed again. This
+ * covers nested .gitignore files without monitoring every directory of the
+ * project. Stamps are only computed once per directory and query, so a
+ * batch of files from the same directory costs a handful of stat() calls.
+ *
+ * With a status function, the first batch query lists the ignored paths of
+ * the whole working tree in one libgit2 pass, and later misses are answered
+ * from that list instead of asking libgit2 about each path. A path is only
+ * answered from the list if neither it nor the ignore files applying to it
+ * changed since the list was made, and the list is dropped once the ignore
+ * files of a directory it answered for change. Like git status, the list does not consider tracked files to be
+ * ignored, even when they match an ignore rule.
+ */
+
+struct _IdeGitIgnoreCache
+{
+  volatile gint     ref_count;
+
+  /* Serializes access to @entries and @status, and calls to the funcs */
+  GMutex            mutex;
+
+  GFile            *workdir;
+  gchar            *workdir_path;
+  gchar            *exclude_path;
+
+  IdeGitIgnoreFunc  func;
+  gpointer          func_data;
+  GDestroyNotify    func_data_destroy;
+
+  /* Relative path to IdeGitIgnoreEntry */
+  GHashTable       *entries;
+
+  IdeGitIgnoreStatusFunc status_func;
+
+  /* The ignored relative paths as of @status_time, in seconds */
+  GHashTable       *status;
+  gint64            status_time;
+
+  /* Relative directory to IdeGitIgnoreStatusDir */
+  GHashTable       *status_stamps;
+
+  guint             status_failed : 1;
+};
+
+typedef struct
+{
+  guint64  stamp;
+  gboolean ignored;
+} IdeGitIgnoreEntry;
+
+static void
+ide_git_ignore_entry_free (gpointer data)
+{
+  g_slice_free (IdeGitIgnoreEntry, data);
+}
+
+typedef struct
+{
+  /* The stamp of the directory when @status was first used for it */
+  guint64  stamp;
+  /* If its ignore files did not change between the walk and that time */
+  gboolean covered;
+} IdeGitIgnoreStatusDir;
+
+static void
+ide_git_ignore_status_dir_free (gpointer data)
+{
+  g_slice_free (IdeGitIgnoreStatusDir, data);
+}
+
+IdeGitIgnoreCache *
+ide_git_ignore_cache_new (GFile            *workdir,
+                          GFile            *gitdir,
+                          IdeGitIgnoreFunc  func,
+                          gpointer          func_data,
+                          GDestroyNotify    func_data_destroy)
+{
+  g_autofree gchar *gitdir_path = NULL;
+  IdeGitIgnoreCache *self;
+
+  g_return_val_if_fail (G_IS_FILE (workdir), NULL);
+  g_return_val_if_fail (G_IS_FILE (gitdir), NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+
+  gitdir_path = g_file_get_path (gitdir);
+
+  self = g_slice_new0 (IdeGitIgnoreCache);
+  self->ref_count = 1;
+  g_mutex_init (&self->mutex);
+  self->workdir = g_object_ref (workdir);
+  self->workdir_path = g_file_get_path (workdir);
+  self->exclude_path = g_build_filename (gitdir_path, "info", "exclude", NULL);
+  self->func = func;
+  self->func_data = func_data;
+  self->func_data_destroy = func_data_destroy;
+  self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, ide_git_ignore_entry_free);
+
+  return self;
+}
+
+IdeGitIgnoreCache *
+ide_git_ignore_cache_ref (IdeGitIgnoreCache *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+ide_git_ignore_cache_unref (IdeGitIgnoreCache *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      if (self->func_data_destroy != NULL)
+        self->func_data_destroy (self->func_data);
+
+      g_clear_pointer (&self->entries, g_hash_table_unref);
+      g_clear_pointer (&self->status, g_hash_table_unref);
+      g_clear_pointer (&self->status_stamps, g_hash_table_unref);
+      g_clear_pointer (&self->workdir_path, g_free);
+      g_clear_pointer (&self->exclude_path, g_free);
+      g_clear_object (&self->workdir);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (IdeGitIgnoreCache, self);
+    }
+}
+
+/**
+ * ide_git_ignore_cache_clear:
+ *
+ * Drops every cached answer, such as when the repository state changed in
+ * a way that is not covered by the stamps of the ignore files.
+ */
+void
+ide_git_ignore_cache_clear (IdeGitIgnoreCache *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  g_hash_table_remove_all (self->entries);
+  g_clear_pointer (&self->status, g_hash_table_unref);
+  g_clear_pointer (&self->status_stamps, g_hash_table_unref);
+  self->status_failed = FALSE;
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * ide_git_ignore_cache_set_status_func:
+ * @status_func: (nullable): an #IdeGitIgnoreStatusFunc
+ *
+ * Sets the function used to list the ignored paths of the whole working
+ * tree at once. It is called with the closure data of the cache.
+ */
+void
+ide_git_ignore_cache_set_status_func (IdeGitIgnoreCache      *self,
+                                      IdeGitIgnoreStatusFunc  status_func)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->status_func = status_func;
+  g_clear_pointer (&self->status, g_hash_table_unref);
+  g_clear_pointer (&self->status_stamps, g_hash_table_unref);
+  self->status_failed = FALSE;
+  g_mutex_unlock (&self->mutex);
+}
+
+/*
+ * Must be called with mutex held.
+ */
+static void
+ide_git_ignore_cache_load_status (IdeGitIgnoreCache *self)
+{
+  g_autoptr(GHashTable) status = NULL;
+  g_autoptr(GError) error = NULL;
+  gint64 status_time;
+
+  g_assert (self != NULL);
+  g_assert (self->status_func != NULL);
+  g_assert (self->status == NULL);
+
+  /* Anything changed during the second of the walk is checked again */
+  status_time = g_get_real_time () / G_USEC_PER_SEC;
+  status = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  if (!self->status_func (status, self->func_data, &error))
+    {
+      /* Don't walk the tree for every batch, the cache works without it */
+      g_warning ("Failed to list ignored files: %s", error->message);
+      self->status_failed = TRUE;
+      return;
+    }
+
+  self->status = g_steal_pointer (&status);
+  self->status_time = status_time;
+  self->status_stamps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, ide_git_ignore_status_dir_free);
+}
+
+static inline guint64
+mix_stamp (guint64 stamp,
+           guint64 value)
+{
+  /* FNV-1a style mixing, order matters */
+  return (stamp ^ value) * G_GUINT64_CONSTANT (1099511628211);
+}
+
+static guint64
+get_file_stamp (const gchar *path)
+{
+  GStatBuf st;
+
+  if (g_stat (path, &st) != 0)
+    return 0;
+
+  /* Editors often save by renaming over the file, changing the inode */
+  return mix_stamp (mix_stamp (mix_stamp (mix_stamp (1, st.st_mtime), st.st_ctime), st.st_size), st.st_ino);
+}
+
+/*
+ * Gets the stamp of the ignore files applying to the contents of @reldir.
+ * Stamps are memoized in @stamps for the duration of a query.
+ */
+static guint64
+ide_git_ignore_cache_get_stamp (IdeGitIgnoreCache *self,
+                                GHashTable        *stamps,
+                                const gchar       *reldir)
+{
+  g_autofree gchar *gitignore = NULL;
+  guint64 *memo;
+  guint64 stamp;
+
+  g_assert (self != NULL);
+  g_assert (stamps != NULL);
+  g_assert (reldir != NULL);
+
+  if ((memo = g_hash_table_lookup (stamps, reldir)))
+    return *memo;
+
+  if (g_str_equal (reldir, "."))
+    {
+      gitignore = g_build_filename (self->workdir_path, ".gitignore", NULL);
+      stamp = mix_stamp (get_file_stamp (self->exclude_path), get_file_stamp (gitignore));
+    }
+  else
+    {
+      g_autofree gchar *parent = g_path_get_dirname (reldir);
+
+      gitignore = g_build_filename (self->workdir_path, reldir, ".gitignore", NULL);
+      stamp = mix_stamp (ide_git_ignore_cache_get_stamp (self, stamps, parent),
+                         get_file_stamp (gitignore));
+    }
+
+  memo = g_new (guint64, 1);
+  *memo = stamp;
+  g_hash_table_insert (stamps, g_strdup (reldir), memo);
+
+  return stamp;
+}
+
+/*
+ * Checks that @path was not created, modified or removed at or after
+ * @time. A missing file relies on its directory, which changes when the
+ * file is removed.
+ */
+static gboolean
+unchanged_since (const gchar *path,
+                 gint64       time)
+{
+  g_autofree gchar *parent = NULL;
+  GStatBuf st;
+
+  if (g_lstat (path, &st) == 0)
+    return st.st_ctime < time;
+
+  parent = g_path_get_dirname (path);
+
+  return g_lstat (parent, &st) == 0 && st.st_ctime < time;
+}
+
+/*
+ * Checks if the list of ignored paths is still accurate for the contents
+ * of @reldir, whose stamp is @stamp. Once a directory is checked, further
+ * changes to its ignore files are caught by the stamp.
+ *
+ * Must be called with mutex held.
+ */
+static gboolean
+ide_git_ignore_cache_status_covers (IdeGitIgnoreCache *self,
+                                    GHashTable        *stamps,
+                                    const gchar       *reldir,
+                                    guint64            stamp)
+{
+  g_autofree gchar *gitignore = NULL;
+  IdeGitIgnoreStatusDir *dir;
+  gboolean covered;
+
+  g_assert (self != NULL);
+  g_assert (self->status != NULL);
+  g_assert (stamps != NULL);
+  g_assert (reldir != NULL);
+
+  if ((dir = g_hash_table_lookup (self->status_stamps, reldir)))
+    {
+      if (dir->stamp == stamp)
+        return dir->covered;
+
+      /* The rules changed since, the next batch walks again */
+      g_clear_pointer (&self->status, g_hash_table_unref);
+      g_clear_pointer (&self->status_stamps, g_hash_table_unref);
+
+      return FALSE;
+    }
+
+  gitignore = g_build_filename (self->workdir_path, reldir, ".gitignore", NULL);
+  covered = unchanged_since (gitignore, self->status_time);
+
+  if (covered && g_str_equal (reldir, "."))
+    covered = unchanged_since (self->exclude_path, self->status_time);
+  else if (covered)
+    {
+      g_autofree gchar *parent = g_path_get_dirname (reldir);
+
+      covered = ide_git_ignore_cache_status_covers (self,
+                                                    stamps,
+                                                    parent,
+                                                    ide_git_ignore_cache_get_stamp (self, stamps, parent));
+
+      /* Checking the parent may have dropped the list */
+      if (self->status == NULL)
+        return FALSE;
+    }
+
+  dir = g_slice_new (IdeGitIgnoreStatusDir);
+  dir->stamp = stamp;
+  dir->covered = covered;
+  g_hash_table_insert (self->status_stamps, g_strdup (reldir), dir);
+
+  return covered;
+}
+
+/*
+ * Answers @relpath from the list of ignored paths, if it is still
+ * accurate for @relpath. @stamp is the stamp of @parent.
+ *
+ * Must be called with mutex held.
+ */
+static gboolean
+ide_git_ignore_cache_lookup_status (IdeGitIgnoreCache *self,
+                                    GHashTable        *stamps,
+                                    const gchar       *relpath,
+                                    const gchar       *parent,
+                                    guint64            stamp,
+                                    gboolean          *ignored)
+{
+  g_autofree gchar *path = NULL;
+
+  g_assert (self != NULL);
+  g_assert (stamps != NULL);
+  g_assert (relpath != NULL);
+  g_assert (parent != NULL);
+  g_assert (ignored != NULL);
+
+  if (self->status == NULL)
+    return FALSE;
+
+  if (!ide_git_ignore_cache_status_covers (self, stamps, parent, stamp))
+    return FALSE;
+
+  /* Files created or replaced after the walk are not part of it */
+  path = g_build_filename (self->workdir_path, relpath, NULL);
+  if (!unchanged_since (path, self->status_time))
+    return FALSE;
+
+  *ignored = g_hash_table_contains (self->status, relpath);
+
+  return TRUE;
+}
+
+/*
+ * Must be called with mutex held.
+ */
+static gboolean
+ide_git_ignore_cache_lookup (IdeGitIgnoreCache  *self,
+                             GHashTable         *stamps,
+                             const gchar        *relpath,
+                             GError            **error)
+{
+  g_autofree gchar *parent = NULL;
+  IdeGitIgnoreEntry *entry;
+  guint64 stamp;
+  gboolean ret;
+
+  g_assert (self != NULL);
+  g_assert (stamps != NULL);
+  g_assert (relpath != NULL);
+
+  if (g_str_equal (relpath, ".git") || g_str_has_prefix (relpath, ".git"G_DIR_SEPARATOR_S))
+    return TRUE;
+
+  parent = g_path_get_dirname (relpath);
+  stamp = ide_git_ignore_cache_get_stamp (self, stamps, parent);
+
+  entry = g_hash_table_lookup (self->entries, relpath);
+
+  if (entry != NULL && entry->stamp == stamp)
+    return entry->ignored;
+
+  /*
+   * Git cannot re-include a file when one of its parent directories is
+   * excluded, so a cached (or freshly computed) answer for the parent lets
+   * whole subtrees skip @func, which is expensive with libgit2 since it
+   * reloads the ignore rules for every query.
+   */
+  if (!g_str_equal (parent, ".") && ide_git_ignore_cache_lookup (self, stamps, parent, NULL))
+    ret = TRUE;
+  else if (ide_git_ignore_cache_lookup_status (self, stamps, relpath, parent, stamp, &ret))
+    {
+      /* Answered from the list of ignored paths */
+    }
+  else
+    {
+      GError *local_error = NULL;
+
+      ret = self->func (relpath, self->func_data, &local_error);
+
+      if (local_error != NULL)
+        {
+          g_propagate_error (error, local_error);
+          return FALSE;
+        }
+    }
+
+  if (entry == NULL)
+    {
+      if (g_hash_table_size (self->entries) >= MAX_IGNORED_CACHE_SIZE)
+        g_hash_table_remove_all (self->entries);
+
+      entry = g_slice_new (IdeGitIgnoreEntry);
+      g_hash_table_insert (self->entries, g_strdup (relpath), entry);
+    }
+
+  entry->stamp = stamp;
+  entry->ignored = ret;
+
+  return ret;
+}
+
+/**
+ * ide_git_ignore_cache_is_ignored_many:
+ * @self: An #IdeGitIgnoreCache
+ * @files: (array length=n_files): An array of #GFile
+ * @n_files: The number of elements in @files
+ * @ignored: A bitmap of at least IDE_VCS_IGNORED_BITMAP_SIZE(@n_files) bytes
+ * @error: A location for a #GError, or %NULL
+ *
+ * Fills @ignored like ide_vcs_is_ignored_many(). Files outside of the
+ * working directory are not ignored.
+ *
+ * A failure for one file does not stop the query. That file is reported as
+ * not ignored, the remaining files are still answered, and the first error
+ * is returned.
+ *
+ * Returns: %TRUE if every file could be checked.
+ */
+gboolean
+ide_git_ignore_cache_is_ignored_many (IdeGitIgnoreCache  *self,
+                                      GFile             **files,
+                                      guint               n_files,
+                                      guint8             *ignored,
+                                      GError            **error)
+{
+  g_autoptr(GHashTable) stamps = NULL;
+  gboolean ret = TRUE;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (files != NULL || n_files == 0, FALSE);
+  g_return_val_if_fail (ignored != NULL || n_files == 0, FALSE);
+
+  if (n_files == 0)
+    return TRUE;
+
+  memset (ignored, 0, (n_files + 7) / 8);
+
+  stamps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  g_mutex_lock (&self->mutex);
+
+  /* Single queries are cheaper to answer one at a time than a walk */
+  if (n_files > 1 && self->status == NULL && self->status_func != NULL && !self->status_failed)
+    ide_git_ignore_cache_load_status (self);
+
+  for (i = 0; i < n_files; i++)
+    {
+      g_autofree gchar *name = NULL;
+      GError *local_error = NULL;
+
+      g_assert (G_IS_FILE (files [i]));
+
+      name = g_file_get_relative_path (self->workdir, files [i]);
+
+      if (name == NULL)
+        continue;
+
+      if (ide_git_ignore_cache_lookup (self, stamps, name, &local_error))
+        ignored [i / 8] |= 1 << (i % 8);
+      else if (local_error != NULL)
+        {
+          if (ret)
+            g_propagate_error (error, local_error);
+          else
+            g_error_free (local_error);
+          ret = FALSE;
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
@@ -0,0 +1,80 @@
+/* ide-git-ignore-cache.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_GIT_IGNORE_CACHE_H
+#define IDE_GIT_IGNORE_CACHE_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/**
+ * IdeGitIgnoreFunc:
+ * @relpath: a path relative to the working directory
+ * @user_data: closure data
+ * @error: a location for a #GError
+ *
+ * Checks if @relpath is ignored, such as with ggit_repository_path_is_ignored().
+ * Calls are serialized by the cache.
+ *
+ * Returns: %TRUE if @relpath is ignored. If %FALSE is returned with @error
+ *   set, the answer is not cached.
+ */
+typedef gboolean (*IdeGitIgnoreFunc) (const gchar  *relpath,
+                                      gpointer      user_data,
+                                      GError      **error);
+
+/**
+ * IdeGitIgnoreStatusFunc:
+ * @ignored: a set of paths relative to the working directory
+ * @user_data: closure data
+ * @error: a location for a #GError
+ *
+ * Adds every ignored path of the working tree to @ignored in a single pass,
+ * such as with ggit_repository_file_status_foreach(). Ignored directories
+ * are added without their contents. Calls are serialized by the cache.
+ *
+ * Returns: %TRUE if successful.
+ */
+typedef gboolean (*IdeGitIgnoreStatusFunc) (GHashTable  *ignored,
+                                            gpointer     user_data,
+                                            GError     **error);
+
+typedef struct _IdeGitIgnoreCache IdeGitIgnoreCache;
+
+IdeGitIgnoreCache *ide_git_ignore_cache_new             (GFile              *workdir,
+                                                         GFile              *gitdir,
+                                                         IdeGitIgnoreFunc    func,
+                                                         gpointer            func_data,
+                                                         GDestroyNotify      func_data_destroy);
+IdeGitIgnoreCache *ide_git_ignore_cache_ref             (IdeGitIgnoreCache  *self);
+void               ide_git_ignore_cache_unref           (IdeGitIgnoreCache  *self);
+void               ide_git_ignore_cache_clear           (IdeGitIgnoreCache  *self);
+void               ide_git_ignore_cache_set_status_func (IdeGitIgnoreCache  *self,
+                                                         IdeGitIgnoreStatusFunc status_func);
+gboolean           ide_git_ignore_cache_is_ignored_many (IdeGitIgnoreCache  *self,
+                                                         GFile             **files,
+                                                         guint               n_files,
+                                                         guint8             *ignored,
+                                                         GError            **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeGitIgnoreCache, ide_git_ignore_cache_unref)
+
+G_END_DECLS
+
+#endif /* IDE_GIT_IGNORE_CACHE_H */
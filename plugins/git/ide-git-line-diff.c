@@ -0,0 +1,495 @@
+/* ide-git-line-diff.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "ide-git-line-diff.h"
+
+/*
+ * This is a line based implementation of the Myers O(ND) difference
+ * algorithm using the linear space refinement. Lines are compared by a
+ * 64-bit hash, which lets callers keep the lines of the file in HEAD (and
+ * of the buffer) hashed between runs and only rehash what was edited.
+ *
+ * Common prefix and suffix lines are trimmed before searching for the
+ * middle snake, so the cost of a diff is mostly proportional to the size
+ * of the window containing changes rather than the size of the file.
+ */
+
+/*
+ * If we need more than this many edits to find the middle snake of a
+ * range, we stop searching and report the whole range as changed. This
+ * bounds the cost of diffing files which have been mostly rewritten.
+ */
+#define MAX_COST 4096
+
+typedef struct
+{
+  const guint64      *a;
+  const guint64      *b;
+  IdeGitLineDiffFunc  func;
+  gpointer            user_data;
+  gint               *v;
+  gsize               v_len;
+  /* The change being accumulated so adjacent changes are merged */
+  guint               old_begin;
+  guint               old_len;
+  guint               new_begin;
+  guint               new_len;
+  guint               has_pending : 1;
+} DiffContext;
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME        0x100000001b3ULL
+
+static inline guint64
+line_hash_update (guint64      hash,
+                  const gchar *text,
+                  gsize        len)
+{
+  for (gsize i = 0; i < len; i++)
+    {
+      hash ^= (guchar)text[i];
+      hash *= FNV_PRIME;
+    }
+
+  return hash;
+}
+
+guint64
+ide_git_line_hash (const gchar *line,
+                   gsize        len)
+{
+  /* Treat \r\n the same as \n */
+  if (len > 0 && line[len - 1] == '\r')
+    len--;
+
+  return line_hash_update (FNV_OFFSET_BASIS, line, len);
+}
+
+/**
+ * ide_git_line_hashes_add:
+ * @hashes: a #GArray of #guint64
+ * @text: the text to split into lines
+ * @len: the length of @text in bytes
+ *
+ * Appends the hash of each line in @text to @hashes. Like #GtkTextBuffer,
+ * a trailing newline results in a final empty line, so this always adds
+ * one more line than there are newlines in @text.
+ */
+void
+ide_git_line_hashes_add (GArray      *hashes,
+                         const gchar *text,
+                         gsize        len)
+{
+  IdeGitLineHasher hasher;
+
+  g_assert (hashes != NULL);
+  g_assert (text != NULL || len == 0);
+
+  ide_git_line_hasher_init (&hasher, hashes);
+  ide_git_line_hasher_add (&hasher, text, len);
+  ide_git_line_hasher_finish (&hasher);
+}
+
+void
+ide_git_line_hasher_init (IdeGitLineHasher *hasher,
+                          GArray           *hashes)
+{
+  g_assert (hasher != NULL);
+  g_assert (hashes != NULL);
+
+  hasher->hashes = hashes;
+  hasher->hash = FNV_OFFSET_BASIS;
+  hasher->pending_cr = FALSE;
+}
+
+/**
+ * ide_git_line_hasher_add:
+ * @hasher: an #IdeGitLineHasher
+ * @text: the next chunk of text
+ * @len: the length of @text in bytes
+ *
+ * Hashes the next chunk of text, appending the hash of each line that is
+ * completed by it. Lines may span any number of chunks.
+ */
+void
+ide_git_line_hasher_add (IdeGitLineHasher *hasher,
+                         const gchar      *text,
+                         gsize             len)
+{
+  const gchar *end = text + len;
+
+  g_assert (hasher != NULL);
+  g_assert (text != NULL || len == 0);
+
+  while (text < end)
+    {
+      const gchar *eol = memchr (text, '\n', end - text);
+      const gchar *seg_end = eol ? eol : end;
+      gsize seg_len = seg_end - text;
+
+      if (seg_len > 0)
+        {
+          /*
+           * A \r is only part of the line if it is not followed by \n, which
+           * we might not know until the next chunk.
+           */
+          if (hasher->pending_cr)
+            hasher->hash = line_hash_update (hasher->hash, "\r", 1);
+
+          hasher->pending_cr = (text[seg_len - 1] == '\r');
+          hasher->hash = line_hash_update (hasher->hash, text, seg_len - hasher->pending_cr);
+        }
+
+      if (eol == NULL)
+        break;
+
+      g_array_append_val (hasher->hashes, hasher->hash);
+      hasher->hash = FNV_OFFSET_BASIS;
+      hasher->pending_cr = FALSE;
+
+      text = eol + 1;
+    }
+}
+
+/**
+ * ide_git_line_hasher_finish:
+ * @hasher: an #IdeGitLineHasher
+ *
+ * Appends the hash of the final line.
+ */
+void
+ide_git_line_hasher_finish (IdeGitLineHasher *hasher)
+{
+  g_assert (hasher != NULL);
+
+  g_array_append_val (hasher->hashes, hasher->hash);
+  hasher->hash = FNV_OFFSET_BASIS;
+  hasher->pending_cr = FALSE;
+}
+
+/**
+ * ide_git_line_hashes_splice:
+ * @hashes: the hashes of the lines before they were edited
+ * @prefix: the number of lines before the edited lines
+ * @suffix: the number of lines after the edited lines
+ * @patch: the hashes of the edited lines, as they are now
+ *
+ * Replaces everything but the first @prefix and last @suffix lines of
+ * @hashes with @patch, which brings @hashes up to date without hashing
+ * the lines which were not edited again.
+ */
+void
+ide_git_line_hashes_splice (GArray       *hashes,
+                            guint         prefix,
+                            guint         suffix,
+                            const GArray *patch)
+{
+  g_return_if_fail (hashes != NULL);
+  g_return_if_fail (patch != NULL);
+  g_return_if_fail (prefix <= hashes->len && suffix <= hashes->len - prefix);
+
+  g_array_remove_range (hashes, prefix, hashes->len - prefix - suffix);
+  g_array_insert_vals (hashes, prefix, patch->data, patch->len);
+}
+
+/**
+ * ide_git_dirty_lines_mark:
+ * @dirty: an #IdeGitDirtyLines
+ * @begin_line: the first line about to be edited
+ * @end_line: the last line about to be edited, inclusive
+ * @n_lines: the number of lines before the edit
+ *
+ * Records that lines @begin_line through @end_line are about to be
+ * edited. The prefix and suffix are counted from either end, so they stay
+ * valid while lines are added or removed in between.
+ */
+void
+ide_git_dirty_lines_mark (IdeGitDirtyLines *dirty,
+                          guint             begin_line,
+                          guint             end_line,
+                          guint             n_lines)
+{
+  guint suffix;
+
+  g_return_if_fail (dirty != NULL);
+  g_return_if_fail (begin_line <= end_line);
+  g_return_if_fail (end_line < n_lines);
+
+  suffix = n_lines - 1 - end_line;
+
+  if (!dirty->is_dirty)
+    {
+      dirty->prefix = begin_line;
+      dirty->suffix = suffix;
+      dirty->is_dirty = TRUE;
+    }
+  else
+    {
+      dirty->prefix = MIN (dirty->prefix, begin_line);
+      dirty->suffix = MIN (dirty->suffix, suffix);
+    }
+}
+
+static void
+diff_context_emit (DiffContext *ctx,
+                   guint        old_begin,
+                   guint        old_len,
+                   guint        new_begin,
+                   guint        new_len)
+{
+  if (ctx->has_pending &&
+      ctx->old_begin + ctx->old_len == old_begin &&
+      ctx->new_begin + ctx->new_len == new_begin)
+    {
+      ctx->old_len += old_len;
+      ctx->new_len += new_len;
+      return;
+    }
+
+  if (ctx->has_pending)
+    ctx->func (ctx->old_begin, ctx->old_len, ctx->new_begin, ctx->new_len, ctx->user_data);
+
+  ctx->old_begin = old_begin;
+  ctx->old_len = old_len;
+  ctx->new_begin = new_begin;
+  ctx->new_len = new_len;
+  ctx->has_pending = TRUE;
+}
+
+/*
+ * Finds the middle snake of a[a_begin:a_end] and b[b_begin:b_end] and
+ * stores the point at which to split the problem in @x and @y. Returns
+ * FALSE if that would cost more than MAX_COST edits.
+ */
+static gboolean
+diff_context_bisect (DiffContext *ctx,
+                     gint         a_begin,
+                     gint         a_end,
+                     gint         b_begin,
+                     gint         b_end,
+                     gint        *x,
+                     gint        *y)
+{
+  const guint64 *a = ctx->a + a_begin;
+  const guint64 *b = ctx->b + b_begin;
+  gint n = a_end - a_begin;
+  gint m = b_end - b_begin;
+  gint max_d = (n + m + 1) / 2;
+  gint v_offset = max_d;
+  gint v_length = 2 * max_d + 2;
+  gint delta = n - m;
+  gboolean front = (delta % 2) != 0;
+  gint k1start = 0;
+  gint k1end = 0;
+  gint k2start = 0;
+  gint k2end = 0;
+  gint limit = MIN (max_d, MAX_COST);
+  gint *v1;
+  gint *v2;
+
+  if (ctx->v_len < (gsize)v_length * 2)
+    {
+      g_free (ctx->v);
+      ctx->v_len = v_length * 2;
+      ctx->v = g_new (gint, ctx->v_len);
+    }
+
+  v1 = ctx->v;
+  v2 = ctx->v + v_length;
+
+  for (gint i = 0; i < v_length; i++)
+    v1[i] = v2[i] = -1;
+
+  v1[v_offset + 1] = 0;
+  v2[v_offset + 1] = 0;
+
+  for (gint d = 0; d < limit; d++)
+    {
+      /* Walk the front path one step */
+      for (gint k1 = -d + k1start; k1 <= d - k1end; k1 += 2)
+        {
+          gint k1_offset = v_offset + k1;
+          gint x1;
+          gint y1;
+
+          if (k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1]))
+            x1 = v1[k1_offset + 1];
+          else
+            x1 = v1[k1_offset - 1] + 1;
+
+          y1 = x1 - k1;
+
+          while (x1 < n && y1 < m && a[x1] == b[y1])
+            {
+              x1++;
+              y1++;
+            }
+
+          v1[k1_offset] = x1;
+
+          if (x1 > n)
+            k1end += 2;
+          else if (y1 > m)
+            k1start += 2;
+          else if (front)
+            {
+              gint k2_offset = v_offset + delta - k1;
+
+              if (k2_offset >= 0 && k2_offset < v_length && v2[k2_offset] != -1)
+                {
+                  if (x1 >= n - v2[k2_offset])
+                    {
+                      *x = a_begin + x1;
+                      *y = b_begin + y1;
+                      return TRUE;
+                    }
+                }
+            }
+        }
+
+      /* Walk the reverse path one step */
+      for (gint k2 = -d + k2start; k2 <= d - k2end; k2 += 2)
+        {
+          gint k2_offset = v_offset + k2;
+          gint x2;
+          gint y2;
+
+          if (k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1]))
+            x2 = v2[k2_offset + 1];
+          else
+            x2 = v2[k2_offset - 1] + 1;
+
+          y2 = x2 - k2;
+
+          while (x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1])
+            {
+              x2++;
+              y2++;
+            }
+
+          v2[k2_offset] = x2;
+
+          if (x2 > n)
+            k2end += 2;
+          else if (y2 > m)
+            k2start += 2;
+          else if (!front)
+            {
+              gint k1_offset = v_offset + delta - k2;
+
+              if (k1_offset >= 0 && k1_offset < v_length && v1[k1_offset] != -1)
+                {
+                  gint x1 = v1[k1_offset];
+                  gint y1 = v_offset + x1 - k1_offset;
+
+                  if (x1 >= n - x2)
+                    {
+                      *x = a_begin + x1;
+                      *y = b_begin + y1;
+                      return TRUE;
+                    }
+                }
+            }
+        }
+    }
+
+  return FALSE;
+}
+
+static void
+diff_context_diff (DiffContext *ctx,
+                   gint         a_begin,
+                   gint         a_end,
+                   gint         b_begin,
+                   gint         b_end)
+{
+  gint x;
+  gint y;
+
+  while (a_begin < a_end && b_begin < b_end && ctx->a[a_begin] == ctx->b[b_begin])
+    {
+      a_begin++;
+      b_begin++;
+    }
+
+  while (a_begin < a_end && b_begin < b_end && ctx->a[a_end - 1] == ctx->b[b_end - 1])
+    {
+      a_end--;
+      b_end--;
+    }
+
+  if (a_begin == a_end && b_begin == b_end)
+    return;
+
+  if (a_begin == a_end || b_begin == b_end ||
+      !diff_context_bisect (ctx, a_begin, a_end, b_begin, b_end, &x, &y) ||
+      (x == a_begin && y == b_begin) ||
+      (x == a_end && y == b_end))
+    {
+      diff_context_emit (ctx, a_begin, a_end - a_begin, b_begin, b_end - b_begin);
+      return;
+    }
+
+  diff_context_diff (ctx, a_begin, x, b_begin, y);
+  diff_context_diff (ctx, x, a_end, y, b_end);
+}
+
+/**
+ * ide_git_line_diff:
+ * @old_lines: the hashes of the old lines
+ * @n_old: the number of old lines
+ * @new_lines: the hashes of the new lines
+ * @n_new: the number of new lines
+ * @func: a function to call for each group of changed lines
+ * @user_data: closure data for @func
+ *
+ * Calculates the differences between two sets of lines, as produced by
+ * ide_git_line_hashes_add(). Adjacent changes are merged so that a line
+ * which was replaced is reported as a single change with both old and
+ * new lines.
+ */
+void
+ide_git_line_diff (const guint64      *old_lines,
+                   guint               n_old,
+                   const guint64      *new_lines,
+                   guint               n_new,
+                   IdeGitLineDiffFunc  func,
+                   gpointer            user_data)
+{
+  DiffContext ctx = { 0 };
+
+  g_return_if_fail (old_lines != NULL || n_old == 0);
+  g_return_if_fail (new_lines != NULL || n_new == 0);
+  g_return_if_fail (n_old <= G_MAXINT / 2);
+  g_return_if_fail (n_new <= G_MAXINT / 2);
+  g_return_if_fail (func != NULL);
+
+  ctx.a = old_lines;
+  ctx.b = new_lines;
+  ctx.func = func;
+  ctx.user_data = user_data;
+
+  diff_context_diff (&ctx, 0, n_old, 0, n_new);
+
+  if (ctx.has_pending)
+    func (ctx.old_begin, ctx.old_len, ctx.new_begin, ctx.new_len, user_data);
+
+  g_free (ctx.v);
+}
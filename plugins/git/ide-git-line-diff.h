@@ -0,0 +1,99 @@
+/* ide-git-line-diff.h
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_GIT_LINE_DIFF_H
+#define IDE_GIT_LINE_DIFF_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * IdeGitLineDiffFunc:
+ * @old_begin: the first line of the change in the old lines
+ * @old_len: the number of old lines replaced
+ * @new_begin: the first line of the change in the new lines
+ * @new_len: the number of new lines inserted
+ * @user_data: closure data
+ *
+ * Called for each group of changed lines, in order. Lines are 0-based.
+ */
+typedef void (*IdeGitLineDiffFunc) (guint    old_begin,
+                                    guint    old_len,
+                                    guint    new_begin,
+                                    guint    new_len,
+                                    gpointer user_data);
+
+/**
+ * IdeGitLineHasher:
+ *
+ * Hashes lines like ide_git_line_hashes_add() for text which is not
+ * contiguous in memory, such as the chunks of an #IdeBufferSnapshot.
+ */
+typedef struct
+{
+  GArray  *hashes;
+  guint64  hash;
+  guint    pending_cr : 1;
+} IdeGitLineHasher;
+
+/**
+ * IdeGitDirtyLines:
+ * @prefix: the number of lines before the first edited line
+ * @suffix: the number of lines after the last edited line
+ * @is_dirty: if any line was edited
+ *
+ * Tracks which lines were edited since they were last hashed, so that
+ * only those need to be hashed again.
+ */
+typedef struct
+{
+  guint prefix;
+  guint suffix;
+  guint is_dirty : 1;
+} IdeGitDirtyLines;
+
+guint64 ide_git_line_hash          (const gchar        *line,
+                                    gsize               len);
+void    ide_git_line_hashes_add    (GArray             *hashes,
+                                    const gchar        *text,
+                                    gsize               len);
+void    ide_git_line_hasher_init   (IdeGitLineHasher   *hasher,
+                                    GArray             *hashes);
+void    ide_git_line_hasher_add    (IdeGitLineHasher   *hasher,
+                                    const gchar        *text,
+                                    gsize               len);
+void    ide_git_line_hasher_finish (IdeGitLineHasher   *hasher);
+void    ide_git_line_hashes_splice (GArray             *hashes,
+                                    guint               prefix,
+                                    guint               suffix,
+                                    const GArray       *patch);
+void    ide_git_dirty_lines_mark   (IdeGitDirtyLines   *dirty,
+                                    guint               begin_line,
+                                    guint               end_line,
+                                    guint               n_lines);
+void    ide_git_line_diff          (const guint64      *old_lines,
+                                    guint               n_old,
+                                    const guint64      *new_lines,
+                                    guint               n_new,
+                                    IdeGitLineDiffFunc  func,
+                                    gpointer            user_data);
+
+G_END_DECLS
+
+#endif /* IDE_GIT_LINE_DIFF_H */
@@ -21,8 +21,10 @@
 #include <git2.h>
 #include <glib/gi18n.h>
 #include <libgit2-glib/ggit.h>
+#include <string.h>
 
 #include "ide-git-buffer-change-monitor.h"
+#include "ide-git-ignore-cache.h"
 #include "ide-git-vcs.h"
 #include "ide-git-vcs-config.h"
 
@@ -38,6 +40,13 @@ struct _IdeGitVcs
   GFile          *working_directory;
   GFileMonitor   *monitor;
 
+  /*
+   * Answers ignore queries from any thread. It is replaced along with
+   * @repository on reload, so the mutex only guards the pointer.
+   */
+  GMutex             ignore_cache_mutex;
+  IdeGitIgnoreCache *ignore_cache;
+
   guint           changed_timeout;
 
   guint           reloading : 1;
@@ -281,6 +290,88 @@ ide_git_vcs__changed_timeout_cb (gpointer user_data)
   IDE_RETURN (G_SOURCE_REMOVE);
 }
 
+static IdeGitIgnoreCache *
+ide_git_vcs_ref_ignore_cache (IdeGitVcs *self)
+{
+  IdeGitIgnoreCache *ret = NULL;
+
+  g_assert (IDE_IS_GIT_VCS (self));
+
+  g_mutex_lock (&self->ignore_cache_mutex);
+  if (self->ignore_cache != NULL)
+    ret = ide_git_ignore_cache_ref (self->ignore_cache);
+  g_mutex_unlock (&self->ignore_cache_mutex);
+
+  return ret;
+}
+
+static void
+ide_git_vcs_clear_ignored_cache (IdeGitVcs *self)
+{
+  g_autoptr(IdeGitIgnoreCache) cache = NULL;
+
+  g_assert (IDE_IS_GIT_VCS (self));
+
+  if ((cache = ide_git_vcs_ref_ignore_cache (self)))
+    ide_git_ignore_cache_clear (cache);
+}
+
+static gboolean
+ide_git_vcs_path_is_ignored (const gchar  *relpath,
+                             gpointer      user_data,
+                             GError      **error)
+{
+  GgitRepository *repository = user_data;
+
+  return ggit_repository_path_is_ignored (repository, relpath, error);
+}
+
+static gint
+ide_git_vcs_list_ignored_cb (const gchar     *path,
+                             GgitStatusFlags  status,
+                             gpointer         user_data)
+{
+  GHashTable *ignored = user_data;
+
+  if ((status & GGIT_STATUS_IGNORED) != 0)
+    {
+      gsize len = strlen (path);
+
+      /* Ignored directories are reported once, with a trailing slash */
+      if (len > 0 && path [len - 1] == '/')
+        len--;
+
+      g_hash_table_add (ignored, g_strndup (path, len));
+    }
+
+  return 0;
+}
+
+static gboolean
+ide_git_vcs_list_ignored (GHashTable  *ignored,
+                          gpointer     user_data,
+                          GError     **error)
+{
+  GgitRepository *repository = user_data;
+  GgitStatusOptions *options;
+  gboolean ret;
+
+  options = ggit_status_options_new (GGIT_STATUS_OPTION_INCLUDE_UNTRACKED |
+                                     GGIT_STATUS_OPTION_RECURSE_UNTRACKED_DIRS |
+                                     GGIT_STATUS_OPTION_INCLUDE_IGNORED |
+                                     GGIT_STATUS_OPTION_EXCLUDE_SUBMODULES,
+                                     GGIT_STATUS_SHOW_WORKDIR_ONLY,
+                                     NULL);
+  ret = ggit_repository_file_status_foreach (repository,
+                                             options,
+                                             ide_git_vcs_list_ignored_cb,
+                                             ignored,
+                                             error);
+  ggit_status_options_free (options);
+
+  return ret;
+}
+
 static void
 ide_git_vcs__monitor_changed_cb (IdeGitVcs         *self,
                                  GFile             *file,
@@ -292,6 +383,8 @@ ide_git_vcs__monitor_changed_cb (IdeGitVcs         *self,
 
   g_assert (IDE_IS_GIT_VCS (self));
 
+  ide_git_vcs_clear_ignored_cache (self);
+
   if (self->changed_timeout != 0)
     g_source_remove (self->changed_timeout);
 
@@ -351,6 +444,7 @@ ide_git_vcs_reload_worker (GTask        *task,
   IdeGitVcs *self = source_object;
   g_autoptr(GgitRepository) repository1 = NULL;
   g_autoptr(GgitRepository) repository2 = NULL;
+  g_autoptr(IdeGitIgnoreCache) ignore_cache = NULL;
   GError *error = NULL;
 
   IDE_ENTRY;
@@ -367,7 +461,25 @@ ide_git_vcs_reload_worker (GTask        *task,
       IDE_EXIT;
     }
 
+  /* .gitignore files are tracked by the cache, but not the repository */
+  if (self->working_directory != NULL)
+    {
+      g_autoptr(GFile) location = ggit_repository_get_location (repository1);
+
+      ignore_cache = ide_git_ignore_cache_new (self->working_directory,
+                                               location,
+                                               ide_git_vcs_path_is_ignored,
+                                               g_object_ref (repository1),
+                                               g_object_unref);
+      ide_git_ignore_cache_set_status_func (ignore_cache, ide_git_vcs_list_ignored);
+    }
+
+  g_mutex_lock (&self->ignore_cache_mutex);
   g_set_object (&self->repository, repository1);
+  g_clear_pointer (&self->ignore_cache, ide_git_ignore_cache_unref);
+  self->ignore_cache = g_steal_pointer (&ignore_cache);
+  g_mutex_unlock (&self->ignore_cache_mutex);
+
   g_set_object (&self->change_monitor_repository, repository2);
 
   if (!ide_git_vcs_load_monitor (self, &error))
@@ -428,21 +540,38 @@ ide_git_vcs_is_ignored (IdeVcs  *vcs,
                         GFile   *file,
                         GError **error)
 {
-  g_autofree gchar *name = NULL;
+  g_autoptr(IdeGitIgnoreCache) cache = NULL;
   IdeGitVcs *self = (IdeGitVcs *)vcs;
-  gboolean ret = FALSE;
+  guint8 ignored = 0;
 
   g_assert (IDE_IS_GIT_VCS (self));
   g_assert (G_IS_FILE (file));
 
-  name = g_file_get_relative_path (self->working_directory, file);
-  if (g_strcmp0 (name, ".git") == 0)
-    return TRUE;
+  if ((cache = ide_git_vcs_ref_ignore_cache (self)) &&
+      ide_git_ignore_cache_is_ignored_many (cache, &file, 1, &ignored, error))
+    return ignored != 0;
+
+  return FALSE;
+}
+
+static gboolean
+ide_git_vcs_is_ignored_many (IdeVcs  *vcs,
+                             GFile  **files,
+                             guint    n_files,
+                             guint8  *ignored,
+                             GError **error)
+{
+  g_autoptr(IdeGitIgnoreCache) cache = NULL;
+  IdeGitVcs *self = (IdeGitVcs *)vcs;
 
-  if (name != NULL)
-    return ggit_repository_path_is_ignored (self->repository, name, error);
+  g_assert (IDE_IS_GIT_VCS (self));
+  g_assert (files != NULL);
+  g_assert (ignored != NULL);
 
-  return ret;
+  if (!(cache = ide_git_vcs_ref_ignore_cache (self)))
+    return TRUE;
+
+  return ide_git_ignore_cache_is_ignored_many (cache, files, n_files, ignored, error);
 }
 
 static gchar *
@@ -509,6 +638,17 @@ ide_git_vcs_dispose (GObject *object)
   IDE_EXIT;
 }
 
+static void
+ide_git_vcs_finalize (GObject *object)
+{
+  IdeGitVcs *self = (IdeGitVcs *)object;
+
+  g_clear_pointer (&self->ignore_cache, ide_git_ignore_cache_unref);
+  g_mutex_clear (&self->ignore_cache_mutex);
+
+  G_OBJECT_CLASS (ide_git_vcs_parent_class)->finalize (object);
+}
+
 static void
 ide_git_vcs_get_property (GObject    *object,
                           guint       prop_id,
@@ -542,6 +682,7 @@ ide_git_vcs_init_iface (IdeVcsInterface *iface)
   iface->get_working_directory = ide_git_vcs_get_working_directory;
   iface->get_buffer_change_monitor = ide_git_vcs_get_buffer_change_monitor;
   iface->is_ignored = ide_git_vcs_is_ignored;
+  iface->is_ignored_many = ide_git_vcs_is_ignored_many;
   iface->get_config = ide_git_vcs_get_config;
   iface->get_branch_name = ide_git_vcs_get_branch_name;
 }
@@ -552,6 +693,7 @@ ide_git_vcs_class_init (IdeGitVcsClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->dispose = ide_git_vcs_dispose;
+  object_class->finalize = ide_git_vcs_finalize;
   object_class->get_property = ide_git_vcs_get_property;
 
   g_object_class_override_property (object_class, PROP_BRANCH_NAME, "branch-name");
@@ -601,6 +743,7 @@ ide_git_vcs_class_init (IdeGitVcsClass *klass)
 static void
 ide_git_vcs_init (IdeGitVcs *self)
 {
+  g_mutex_init (&self->ignore_cache_mutex);
 }
 
 static void
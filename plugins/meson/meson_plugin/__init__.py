@@ -34,6 +34,15 @@ from gi.repository import (
 _ = Ide.gettext
 
 ninja = None
+compile_commands = {}
+
+
+def _get_compile_commands(file):
+    # Share the parsed database between builders, they are short lived
+    key = file.get_path()
+    if key not in compile_commands:
+        compile_commands[key] = Ide.CompileCommands.new(file)
+    return compile_commands[key]
 
 
 class MesonBuildSystem(Ide.Object, Ide.BuildSystem, Gio.AsyncInitable):
@@ -165,45 +174,23 @@ class MesonBuilder(Ide.Builder):
         task = Gio.Task.new(self, cancellable, callback)
         task.build_flags = []
 
-        def extract_flags(command: str):
-            flags = GLib.shell_parse_argv(command)[1] # Raises on failure
-            build_dir = self._get_build_dir().get_path()
-            wanted_flags = []
-            for flag in flags:
-                if flag.startswith('-I'):
-                    # All paths are relative to build
-                    abspath = path.normpath(path.join(build_dir, flag[2:]))
-                    wanted_flags.append('-I' + abspath)
-                elif flag.startswith(('-isystem', '-W', '-D')):
-                    wanted_flags.append(flag)
-            return wanted_flags
-
-        def build_flags_thread():
-            commands_file = path.join(self._get_build_dir().get_path(), 'compile_commands.json')
-            try:
-                with open(commands_file) as f:
-                    commands = json.loads(f.read(), encoding='utf-8')
-            except (json.JSONDecodeError, FileNotFoundError, UnicodeDecodeError) as e:
-                task.return_error(GLib.Error('Failed to decode meson json: {}'.format(e)))
-                return
-
-            infile = ifile.get_path()
-            for c in commands:
-                filepath = path.normpath(path.join(c['directory'], c['file']))
-                if filepath == infile:
-                    try:
-                        task.build_flags = extract_flags(c['command'])
-                    except GLib.Error as e:
-                        task.return_error(e)
-                        return
-                    break
-            else:
-                print('Meson: Warning: No flags found')
+        commands_file = self._get_build_dir().get_child('compile_commands.json')
+        commands = _get_compile_commands(commands_file)
 
+        def load_finish(commands, result):
+            try:
+                commands.load_finish(result)
+                task.build_flags, _directory = commands.lookup(ifile.get_file())
+            except GLib.Error as e:
+                if e.matches(Gio.io_error_quark(), Gio.IOErrorEnum.NOT_FOUND):
+                    print('Meson: Warning: No flags found')
+                else:
+                    task.return_error(e)
+                    return
             task.return_boolean(True)
 
-        thread = threading.Thread(target=build_flags_thread)
-        thread.start()
+        # This only re-parses the database when it has changed
+        commands.load_async(cancellable, load_finish)
 
     def do_get_build_flags_finish(self, result):
         if result.propagate_boolean():
@@ -18,10 +18,22 @@
 
 #include <glib/gi18n.h>
 #include <ide.h>
+#include <string.h>
 
 #include "gb-project-file.h"
 #include "gb-project-tree.h"
 #include "gb-project-tree-builder.h"
+#include "gb-project-tree-private.h"
+
+#include "tree/ide-tree-private.h"
+
+/*
+ * The GTask of the background load of a directory node. Dropping it cancels
+ * the load, which happens when the row is collapsed, when the node is built
+ * again, and when the node is disposed of because the tree was rebuilt or
+ * destroyed. The load only holds a weak reference to the node for that.
+ */
+#define PENDING_LOAD_KEY "GB_PROJECT_TREE_BUILDER_PENDING_LOAD"
 
 struct _GbProjectTreeBuilder
 {
@@ -32,6 +44,24 @@ struct _GbProjectTreeBuilder
   guint           sort_directories_first : 1;
 };
 
+typedef struct
+{
+  GWeakRef     node;
+  IdeTreeNode *placeholder;
+  IdeVcs      *vcs;
+  GFile       *directory;
+  guint        show_ignored_files : 1;
+  guint        sort_directories_first : 1;
+} LoadRequest;
+
+typedef struct
+{
+  GbProjectFile *item;
+  gchar         *collate_key;
+  guint          is_directory : 1;
+  guint          ignored : 1;
+} LoadEntry;
+
 G_DEFINE_TYPE (GbProjectTreeBuilder, gb_project_tree_builder, IDE_TYPE_TREE_BUILDER)
 
 IdeTreeBuilder *
@@ -98,117 +128,419 @@ get_vcs (IdeTreeNode *node)
   return ide_context_get_vcs (context);
 }
 
-static gint
-compare_nodes_func (IdeTreeNode *a,
-                    IdeTreeNode *b,
-                    gpointer     user_data)
+static void
+cancel_pending_load (gpointer data)
 {
-  GbProjectFile *file_a = GB_PROJECT_FILE (ide_tree_node_get_item (a));
-  GbProjectFile *file_b = GB_PROJECT_FILE (ide_tree_node_get_item (b));
-  GbProjectTreeBuilder *self = user_data;
-
-  if (self->sort_directories_first)
-    return gb_project_file_compare_directories_first (file_a, file_b);
-  else
-    return gb_project_file_compare (file_a, file_b);
+  GTask *task = data;
+
+  g_assert (G_IS_TASK (task));
+
+  g_cancellable_cancel (g_task_get_cancellable (task));
+  g_object_unref (task);
 }
 
 static void
-build_file (GbProjectTreeBuilder *self,
-            IdeTreeNode          *node)
+load_request_free (gpointer data)
 {
-  g_autoptr(GFileEnumerator) enumerator = NULL;
-  GbProjectFile *project_file;
-  gpointer file_info_ptr;
-  IdeVcs *vcs;
-  GFile *file;
-  IdeTree *tree;
-  gint count = 0;
-  gboolean show_ignored_files;
+  LoadRequest *request = data;
 
-  g_return_if_fail (GB_IS_PROJECT_TREE_BUILDER (self));
-  g_return_if_fail (IDE_IS_TREE_NODE (node));
+  g_weak_ref_clear (&request->node);
+  g_clear_object (&request->placeholder);
+  g_clear_object (&request->vcs);
+  g_clear_object (&request->directory);
+  g_slice_free (LoadRequest, request);
+}
 
-  project_file = GB_PROJECT_FILE (ide_tree_node_get_item (node));
+static void
+load_entry_clear (gpointer data)
+{
+  LoadEntry *entry = data;
 
-  tree = ide_tree_builder_get_tree (IDE_TREE_BUILDER (self));
-  show_ignored_files = gb_project_tree_get_show_ignored_files (GB_PROJECT_TREE (tree));
+  g_clear_object (&entry->item);
+  g_clear_pointer (&entry->collate_key, g_free);
+}
 
-  vcs = get_vcs (node);
+static gint
+load_entry_compare (gconstpointer a,
+                    gconstpointer b,
+                    gpointer      user_data)
+{
+  const LoadEntry *entry_a = a;
+  const LoadEntry *entry_b = b;
+  const LoadRequest *request = user_data;
 
-  /*
-   * TODO: Make this all async.
-   */
+  /* Mirrors gb_project_file_compare_directories_first() */
+  if (request->sort_directories_first && entry_a->is_directory != entry_b->is_directory)
+    return (gint)entry_b->is_directory - (gint)entry_a->is_directory;
 
-  if (!gb_project_file_get_is_directory (project_file))
-    return;
+  return strcmp (entry_a->collate_key, entry_b->collate_key);
+}
 
-  file = gb_project_file_get_file (project_file);
+/*
+ * Enumerates the directory described by @request, returning the visible
+ * children sorted the same way as the tree. This may be called from a
+ * worker thread, so it must not touch the tree or the builder.
+ */
+static GArray *
+load_entries (LoadRequest  *request,
+              GCancellable *cancellable)
+{
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+  g_autoptr(GPtrArray) infos = NULL;
+  g_autoptr(GPtrArray) files = NULL;
+  g_autofree guint8 *ignored = NULL;
+  GArray *entries;
+  gpointer file_info_ptr;
+  guint i;
+
+  g_assert (request != NULL);
+  g_assert (G_IS_FILE (request->directory));
 
-  enumerator = g_file_enumerate_children (file,
+  entries = g_array_new (FALSE, FALSE, sizeof (LoadEntry));
+  g_array_set_clear_func (entries, load_entry_clear);
+
+  enumerator = g_file_enumerate_children (request->directory,
                                           G_FILE_ATTRIBUTE_STANDARD_NAME","
                                           G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME","
                                           G_FILE_ATTRIBUTE_STANDARD_TYPE,
                                           G_FILE_QUERY_INFO_NONE,
-                                          NULL,
+                                          cancellable,
                                           NULL);
 
   if (enumerator == NULL)
-    return;
+    return entries;
 
-  while ((file_info_ptr = g_file_enumerator_next_file (enumerator, NULL, NULL)))
+  infos = g_ptr_array_new_with_free_func (g_object_unref);
+  files = g_ptr_array_new_with_free_func (g_object_unref);
+
+  while ((file_info_ptr = g_file_enumerator_next_file (enumerator, cancellable, NULL)))
     {
-      g_autoptr(GFileInfo) item_file_info = file_info_ptr;
-      g_autoptr(GFile) item_file = NULL;
-      g_autoptr(GbProjectFile) item = NULL;
-      IdeTreeNode *child;
-      const gchar *name;
-      const gchar *display_name;
-      const gchar *icon_name;
-      gboolean ignored;
+      GFileInfo *item_file_info = file_info_ptr;
 
-      name = g_file_info_get_name (item_file_info);
-      item_file = g_file_get_child (file, name);
+      g_ptr_array_add (infos, item_file_info);
+      g_ptr_array_add (files, g_file_get_child (request->directory,
+                                                g_file_info_get_name (item_file_info)));
+    }
+
+  /* Ask the VCS about the whole directory at once */
+  ignored = g_malloc0 (IDE_VCS_IGNORED_BITMAP_SIZE (files->len));
+  ide_vcs_is_ignored_many (request->vcs, (GFile **)files->pdata, files->len, ignored, NULL);
 
-      ignored = ide_vcs_is_ignored (vcs, item_file, NULL);
-      if (ignored && !show_ignored_files)
+  for (i = 0; i < infos->len; i++)
+    {
+      GFileInfo *item_file_info = g_ptr_array_index (infos, i);
+      GFile *item_file = g_ptr_array_index (files, i);
+      LoadEntry entry = { 0 };
+      gboolean is_ignored;
+
+      is_ignored = IDE_VCS_IGNORED_BITMAP_GET (ignored, i);
+
+      if (is_ignored && !request->show_ignored_files)
         continue;
 
-      item = gb_project_file_new (item_file, item_file_info);
+      entry.item = gb_project_file_new (item_file, item_file_info);
+      entry.collate_key = g_utf8_collate_key_for_filename (g_file_info_get_display_name (item_file_info), -1);
+      entry.is_directory = (g_file_info_get_file_type (item_file_info) == G_FILE_TYPE_DIRECTORY);
+      entry.ignored = is_ignored;
+
+      g_array_append_val (entries, entry);
+    }
+
+  g_array_sort_with_data (entries, load_entry_compare, request);
 
-      display_name = gb_project_file_get_display_name (item);
-      icon_name = gb_project_file_get_icon_name (item);
+  return entries;
+}
+
+static void
+gb_project_tree_builder_load_worker (GTask        *task,
+                                     gpointer      source_object,
+                                     gpointer      task_data,
+                                     GCancellable *cancellable)
+{
+  LoadRequest *request = task_data;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (GB_IS_PROJECT_TREE_BUILDER (source_object));
+  g_assert (request != NULL);
+
+  g_task_return_pointer (task,
+                         load_entries (request, cancellable),
+                         (GDestroyNotify)g_array_unref);
+}
+
+static void
+gb_project_tree_builder_populate (GbProjectTreeBuilder *self,
+                                  IdeTreeNode          *node,
+                                  LoadRequest          *request,
+                                  GArray               *entries)
+{
+  g_autoptr(GPtrArray) children = NULL;
+  guint i;
+
+  g_assert (GB_IS_PROJECT_TREE_BUILDER (self));
+  g_assert (IDE_IS_TREE_NODE (node));
+  g_assert (request != NULL);
+  g_assert (entries != NULL);
+
+  children = g_ptr_array_sized_new (MAX (entries->len, 1));
+
+  for (i = 0; i < entries->len; i++)
+    {
+      const LoadEntry *entry = &g_array_index (entries, LoadEntry, i);
+      IdeTreeNode *child;
 
       child = g_object_new (IDE_TYPE_TREE_NODE,
-                            "icon-name", icon_name,
-                            "text", display_name,
-                            "item", item,
-                            "use-dim-label", ignored,
+                            "icon-name", gb_project_file_get_icon_name (entry->item),
+                            "text", gb_project_file_get_display_name (entry->item),
+                            "item", entry->item,
+                            "use-dim-label", entry->ignored,
                             NULL);
 
-      ide_tree_node_insert_sorted (node, child, compare_nodes_func, self);
-
-      if (g_file_info_get_file_type (item_file_info) == G_FILE_TYPE_DIRECTORY)
+      if (entry->is_directory)
         ide_tree_node_set_children_possible (child, TRUE);
 
-      count++;
+      g_ptr_array_add (children, child);
     }
 
   /*
    * If we didn't add any children to this node, insert an empty node to
    * notify the user that nothing was found.
    */
-  if (count == 0)
+  if (children->len == 0)
+    g_ptr_array_add (children,
+                     g_object_new (IDE_TYPE_TREE_NODE,
+                                   "icon-name", NULL,
+                                   "text", _("Empty"),
+                                   "use-dim-label", TRUE,
+                                   NULL));
+
+  ide_tree_node_append_all (node, children);
+
+  /* Remove the placeholder last so that an expanded row stays expanded */
+  if (request->placeholder != NULL)
+    ide_tree_node_remove (node, request->placeholder);
+}
+
+static void
+gb_project_tree_builder_load_cb (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  GbProjectTreeBuilder *self = (GbProjectTreeBuilder *)object;
+  g_autoptr(IdeTreeNode) node = NULL;
+  g_autoptr(GArray) entries = NULL;
+  GTask *task = (GTask *)result;
+  LoadRequest *request;
+  GtkTreeIter iter;
+
+  g_assert (GB_IS_PROJECT_TREE_BUILDER (self));
+  g_assert (G_IS_TASK (task));
+
+  request = g_task_get_task_data (task);
+  entries = g_task_propagate_pointer (task, NULL);
+
+  /*
+   * The node may have been disposed, rebuilt, collapsed, or loaded
+   * synchronously while we were running. Only the latest load may touch it.
+   */
+  if (NULL == (node = g_weak_ref_get (&request->node)) ||
+      g_object_get_data (G_OBJECT (node), PENDING_LOAD_KEY) != (gpointer)task)
+    return;
+
+  g_object_set_data (G_OBJECT (node), PENDING_LOAD_KEY, NULL);
+
+  if (entries == NULL || !ide_tree_node_get_iter (request->placeholder, &iter))
+    return;
+
+  gb_project_tree_builder_populate (self, node, request, entries);
+}
+
+static LoadRequest *
+load_request_new (GbProjectTreeBuilder *self,
+                  IdeTreeNode          *node)
+{
+  GbProjectFile *project_file;
+  LoadRequest *request;
+  IdeTree *tree;
+
+  g_assert (GB_IS_PROJECT_TREE_BUILDER (self));
+  g_assert (IDE_IS_TREE_NODE (node));
+
+  project_file = GB_PROJECT_FILE (ide_tree_node_get_item (node));
+  tree = ide_tree_builder_get_tree (IDE_TREE_BUILDER (self));
+
+  request = g_slice_new0 (LoadRequest);
+  g_weak_ref_init (&request->node, node);
+  request->vcs = g_object_ref (get_vcs (node));
+  request->directory = g_object_ref (gb_project_file_get_file (project_file));
+  request->show_ignored_files = gb_project_tree_get_show_ignored_files (GB_PROJECT_TREE (tree));
+  request->sort_directories_first = self->sort_directories_first;
+
+  return request;
+}
+
+static void
+build_file (GbProjectTreeBuilder *self,
+            IdeTreeNode          *node)
+{
+  g_autoptr(GCancellable) cancellable = NULL;
+  g_autoptr(GTask) task = NULL;
+  GbProjectFile *project_file;
+  LoadRequest *request;
+  IdeTree *tree;
+
+  g_return_if_fail (GB_IS_PROJECT_TREE_BUILDER (self));
+  g_return_if_fail (IDE_IS_TREE_NODE (node));
+
+  project_file = GB_PROJECT_FILE (ide_tree_node_get_item (node));
+
+  if (!gb_project_file_get_is_directory (project_file))
+    return;
+
+  tree = ide_tree_builder_get_tree (IDE_TREE_BUILDER (self));
+  request = load_request_new (self, node);
+
+  /*
+   * Revealing a file walks the tree one level at a time, so it needs the
+   * children right away.
+   */
+  if (GB_PROJECT_TREE (tree)->revealing)
     {
-      IdeTreeNode *child;
+      g_autoptr(GArray) entries = load_entries (request, NULL);
 
-      child = g_object_new (IDE_TYPE_TREE_NODE,
-                            "icon-name", NULL,
-                            "text", _("Empty"),
-                            "use-dim-label", TRUE,
-                            NULL);
-      ide_tree_node_append (node, child);
+      gb_project_tree_builder_populate (self, node, request, entries);
+      load_request_free (request);
+
+      return;
     }
+
+  /*
+   * Enumerating large directories and asking the VCS about each child is
+   * far too slow for the main loop. Show a placeholder while a worker does
+   * that, and then insert all of the children at once.
+   */
+  request->placeholder = g_object_new (IDE_TYPE_TREE_NODE,
+                                       "icon-name", NULL,
+                                       "text", _("Loading…"),
+                                       "use-dim-label", TRUE,
+                                       NULL);
+  g_object_ref_sink (request->placeholder);
+  ide_tree_node_append (node, request->placeholder);
+
+  cancellable = g_cancellable_new ();
+
+  task = g_task_new (self, cancellable, gb_project_tree_builder_load_cb, NULL);
+  g_task_set_source_tag (task, build_file);
+  g_task_set_task_data (task, request, load_request_free);
+
+  /* Replacing an earlier load of this node cancels it */
+  g_object_set_data_full (G_OBJECT (node),
+                          PENDING_LOAD_KEY,
+                          g_object_ref (task),
+                          cancel_pending_load);
+
+  /* Someone is waiting on the expanded row, don't queue behind indexing */
+  ide_thread_pool_push_task_with_priority (IDE_THREAD_POOL_COMPILER,
+                                           IDE_THREAD_PRIORITY_INTERACTIVE,
+                                           task,
+                                           gb_project_tree_builder_load_worker);
+}
+
+/**
+ * gb_project_tree_builder_complete_load:
+ * @node: an #IdeTreeNode for a directory
+ *
+ * If the children of @node are still being loaded in the background, the
+ * background load is cancelled and the children are loaded immediately.
+ */
+void
+gb_project_tree_builder_complete_load (IdeTreeNode *node)
+{
+  g_autoptr(GArray) entries = NULL;
+  GbProjectTreeBuilder *self;
+  LoadRequest *pending;
+  LoadRequest *request;
+  GTask *task;
+
+  g_return_if_fail (IDE_IS_TREE_NODE (node));
+
+  if (!(task = g_object_get_data (G_OBJECT (node), PENDING_LOAD_KEY)))
+    return;
+
+  /* Clearing the pending load cancels it */
+  g_object_ref (task);
+  g_object_set_data (G_OBJECT (node), PENDING_LOAD_KEY, NULL);
+
+  self = g_task_get_source_object (task);
+  pending = g_task_get_task_data (task);
+
+  /* The worker may still be using the pending request, so use a new one */
+  request = load_request_new (self, node);
+  request->placeholder = g_object_ref (pending->placeholder);
+
+  entries = load_entries (request, NULL);
+  gb_project_tree_builder_populate (self, node, request, entries);
+
+  load_request_free (request);
+  g_object_unref (task);
+}
+
+static void
+gb_project_tree_builder_row_collapsed (GbProjectTreeBuilder *self,
+                                       GtkTreeIter          *iter,
+                                       GtkTreePath          *path,
+                                       IdeTree              *tree)
+{
+  g_autoptr(IdeTreeNode) placeholder = NULL;
+  g_autoptr(IdeTreeNode) node = NULL;
+  LoadRequest *request;
+  GTask *task;
+
+  g_assert (GB_IS_PROJECT_TREE_BUILDER (self));
+  g_assert (iter != NULL);
+  g_assert (IDE_IS_TREE (tree));
+
+  gtk_tree_model_get (gtk_tree_view_get_model (GTK_TREE_VIEW (tree)), iter, 0, &node, -1);
+
+  if (node == NULL || !(task = g_object_get_data (G_OBJECT (node), PENDING_LOAD_KEY)))
+    return;
+
+  request = g_task_get_task_data (task);
+  placeholder = g_object_ref (request->placeholder);
+
+  /* Nobody is waiting for the children anymore, so stop loading them */
+  g_object_set_data (G_OBJECT (node), PENDING_LOAD_KEY, NULL);
+
+  /* Start over once the row is expanded again */
+  ide_tree_node_remove (node, placeholder);
+  _ide_tree_node_add_dummy_child (node);
+  _ide_tree_node_set_needs_build (node, TRUE);
+}
+
+static void
+gb_project_tree_builder_added (IdeTreeBuilder *builder,
+                               GtkWidget      *tree)
+{
+  g_assert (GB_IS_PROJECT_TREE_BUILDER (builder));
+  g_assert (IDE_IS_TREE (tree));
+
+  g_signal_connect_object (tree,
+                           "row-collapsed",
+                           G_CALLBACK (gb_project_tree_builder_row_collapsed),
+                           builder,
+                           G_CONNECT_SWAPPED);
+}
+
+static void
+gb_project_tree_builder_removed (IdeTreeBuilder *builder,
+                                 GtkWidget      *tree)
+{
+  g_assert (GB_IS_PROJECT_TREE_BUILDER (builder));
+  g_assert (IDE_IS_TREE (tree));
+
+  g_signal_handlers_disconnect_by_func (tree,
+                                        G_CALLBACK (gb_project_tree_builder_row_collapsed),
+                                        builder);
 }
 
 static void
@@ -397,6 +729,8 @@ gb_project_tree_builder_class_init (GbProjectTreeBuilderClass *klass)
 
   object_class->finalize = gb_project_tree_builder_finalize;
 
+  tree_builder_class->added = gb_project_tree_builder_added;
+  tree_builder_class->removed = gb_project_tree_builder_removed;
   tree_builder_class->build_node = gb_project_tree_builder_build_node;
   tree_builder_class->node_activated = gb_project_tree_builder_node_activated;
   tree_builder_class->node_popup = gb_project_tree_builder_node_popup;
@@ -31,6 +31,7 @@ struct _GbProjectTree
 
   guint      expanded_in_new : 1;
   guint      show_ignored_files : 1;
+  guint      revealing : 1;
 };
 
 G_END_DECLS
@@ -463,9 +463,13 @@ gb_project_tree_reveal (GbProjectTree *self,
 
       parts = g_strsplit (relpath, G_DIR_SEPARATOR_S, 0);
 
+      /* Directories along the way must be loaded synchronously */
+      self->revealing = TRUE;
+
       last_node = node;
       for (i = 0; parts [i]; i++)
         {
+          gb_project_tree_builder_complete_load (node);
           node = ide_tree_find_child_node (IDE_TREE (self), node, find_child_node, parts [i]);
           if (node == NULL)
             {
@@ -478,6 +482,8 @@ gb_project_tree_reveal (GbProjectTree *self,
               last_node = node;
             }
         }
+
+      self->revealing = FALSE;
     }
 
   /* If the specified node wasn't found, still expand its ancestor */
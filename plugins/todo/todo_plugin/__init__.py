@@ -30,19 +30,13 @@ from gi.repository import GObject
 from gi.repository import Gtk
 from gi.repository import Pnl
 
-import re
-import subprocess
-import threading
-
 _ = Ide.gettext
 
-LINE1 = re.compile('(.*):(\d+):(.*)')
-LINE2 = re.compile('(.*)-(\d+)-(.*)')
-KEYWORDS = ['FIXME:', 'XXX:', 'TODO:']
-
 class TodoWorkbenchAddin(GObject.Object, Ide.WorkbenchAddin):
     workbench = None
     panel = None
+    miner = None
+    cancellable = None
 
     def do_load(self, workbench):
         self.workbench = workbench
@@ -63,6 +57,10 @@ class TodoWorkbenchAddin(GObject.Object, Ide.WorkbenchAddin):
         bufmgr = context.get_buffer_manager()
         self.buffer_saved_handler = bufmgr.connect('buffer-saved', self.on_buffer_saved)
 
+        # The miner caches results, so only changed files are scanned
+        self.miner = Ide.TodoMiner(context=context)
+        self.cancellable = Gio.Cancellable()
+
         # Mine the directory in a background thread
         self.mine(workdir)
 
@@ -72,6 +70,10 @@ class TodoWorkbenchAddin(GObject.Object, Ide.WorkbenchAddin):
         bufmgr = context.get_buffer_manager()
         bufmgr.disconnect(self.buffer_saved_handler)
 
+        self.cancellable.cancel()
+        self.cancellable = None
+        self.miner = None
+
         self.panel.destroy()
         self.panel = None
 
@@ -81,107 +83,35 @@ class TodoWorkbenchAddin(GObject.Object, Ide.WorkbenchAddin):
         # Get the underline GFile
         file = buf.get_file().get_file()
 
-        # Clear any existing items matching this file
-        self.panel.clear_file(file)
-
         # Mine the file for todo items.
         # We place just updated files at the top so they
         # can be navigated to quickly.
         self.mine(file, prepend=True)
 
-    def _post_from_main(self, args):
-        items, prepend = args
+    def _on_mined(self, miner, result, args):
+        file, prepend = args
 
-        context = self.workbench.get_context()
-        vcs = context.get_vcs()
+        try:
+            items = miner.mine_finish(result)
+        except GLib.Error as ex:
+            if not ex.matches(Gio.io_error_quark(), Gio.IOErrorEnum.CANCELLED):
+                print(repr(ex))
+            return
+
+        # Clear any existing items matching this file
+        if prepend:
+            self.panel.clear_file(file)
 
         for item in items:
-            file = item.props.file
-            if vcs.is_ignored(file) or file.get_basename().endswith('.m4'):
-                continue
             self.panel.add_item(item, prepend=prepend)
 
-        return GLib.SOURCE_REMOVE
-
-    def should_skip(self, filename):
-        return (filename.endswith('libtool.m4') # Ignore libtool.m4
-             or filename.endswith(".po"))       # Ignore translations
-
     def mine(self, file, prepend=False):
         """
         Mine a file or directory.
 
-        We use a simple grep command to do the work for us rather than
-        trying to write anything too complex that would just approximate
-        the same thing anyway.
+        The work is done by Ide.TodoMiner in a background thread.
         """
-        args = ['grep', '-A', '5', '-I', '-H', '-n', '-r']
-        for keyword in KEYWORDS:
-            args.append('-e')
-            args.append(keyword)
-        args.append(file.get_path())
-        p = subprocess.Popen(args, stdout=subprocess.PIPE)
-
-        def communicate(proc):
-            stdout, _ = proc.communicate()
-            lines = stdout.decode('utf-8').splitlines()
-            stdout = None
-            skip = False
-
-            items = []
-            item = TodoItem()
-
-            for line in lines:
-                # Skip long lines, like from SVG files
-                if not line.strip() or len(line) > 1024:
-                    continue
-
-                if line.startswith('--'):
-                    if item.props.file and not skip:
-                        items.append(item)
-                    item = TodoItem()
-                    skip = False
-                    continue
-
-                # If there is no file, then we haven't reached the x:x: line
-                regex = LINE1 if not item.props.file else LINE2
-                try:
-                    (filename, line, message) = regex.match(line).groups()
-                    skip = self.should_skip(filename)
-                except Exception as ex:
-                    continue
-
-                if not item.props.file:
-                    item.props.file = Gio.File.new_for_path(filename)
-                    item.props.line = int(line)
-
-                # XXX: not efficient use of roundtrips to/from pygobject
-                if item.props.message:
-                    item.props.message += '\n' + message
-                else:
-                    item.props.message = message
-
-            if item.props.file and not skip:
-                items.append(item)
-
-            GLib.idle_add(self._post_from_main, (items, prepend))
-
-        threading.Thread(target=communicate, args=[p], name='todo-thread').start()
-
-class TodoItem(GObject.Object):
-    message = GObject.Property(type=str)
-    line = GObject.Property(type=int)
-    file = GObject.Property(type=Gio.File)
-
-    def __repr__(self):
-        return u'<TodoItem(%s:%d)>' % (self.props.file.get_path(), self.props.line)
-
-    @property
-    def shortdesc(self):
-        msg = self.props.message
-        if '\n' in msg:
-            return msg[:msg.index('\n')].strip()
-        return msg.strip()
+        self.miner.mine_async(file, self.cancellable, self._on_mined, (file, prepend))
 
 class TodoPanel(Pnl.DockWidget):
     def __init__(self, basedir, *args, **kwargs):
@@ -191,7 +121,7 @@ class TodoPanel(Pnl.DockWidget):
         self.props.expand = True
 
         self.basedir = basedir
-        self.model = Gtk.ListStore(TodoItem)
+        self.model = Gtk.ListStore(Ide.TodoItem)
 
         scroller = Gtk.ScrolledWindow(visible=True)
         self.add(scroller)
@@ -224,7 +154,7 @@ class TodoPanel(Pnl.DockWidget):
 
     def _message_data_func(self, column, cell, model, iter, data):
         item, = model.get(iter, 0)
-        cell.props.text = item.shortdesc
+        cell.props.text = item.get_summary()
 
     def add_item(self, item, prepend=False):
         if prepend:
@@ -58,11 +58,89 @@ test_task_cache (void)
   g_assert (foo == NULL);
 }
 
+static void
+dummy_populate_callback (EggTaskCache  *self,
+                         gconstpointer  key,
+                         GTask         *task,
+                         gpointer       user_data)
+{
+  g_assert_not_reached ();
+}
+
+static gsize
+get_cost (gconstpointer value)
+{
+  return 10;
+}
+
+static void
+insert_object (EggTaskCache *self,
+               const gchar  *key)
+{
+  GObject *obj = g_object_new (G_TYPE_OBJECT, NULL);
+
+  egg_task_cache_insert (self, key, obj);
+  g_object_unref (obj);
+}
+
+static void
+test_task_cache_budget (void)
+{
+  EggTaskCache *self;
+
+  self = egg_task_cache_new (g_str_hash,
+                             g_str_equal,
+                             (GBoxedCopyFunc)g_strdup,
+                             (GBoxedFreeFunc)g_free,
+                             g_object_ref,
+                             g_object_unref,
+                             0,
+                             dummy_populate_callback, NULL, NULL);
+  egg_task_cache_set_cost_func (self, get_cost);
+  egg_task_cache_set_max_cost (self, 25);
+
+  insert_object (self, "a");
+  insert_object (self, "b");
+  g_assert_cmpint (egg_task_cache_get_cost (self), ==, 20);
+
+  /* Touching "a" makes "b" the least recently used item */
+  g_assert (egg_task_cache_peek (self, "a"));
+  insert_object (self, "c");
+  g_assert (egg_task_cache_peek (self, "a"));
+  g_assert (!egg_task_cache_peek (self, "b"));
+  g_assert (egg_task_cache_peek (self, "c"));
+  g_assert_cmpint (egg_task_cache_get_cost (self), ==, 20);
+
+  /* Pinned items are skipped, even when least recently used */
+  egg_task_cache_pin (self, "c");
+  g_assert (egg_task_cache_peek (self, "a"));
+  insert_object (self, "d");
+  g_assert (!egg_task_cache_peek (self, "a"));
+  g_assert (egg_task_cache_peek (self, "c"));
+  g_assert (egg_task_cache_peek (self, "d"));
+
+  /* The global budget applies across caches */
+  egg_task_cache_set_global_max_cost (10);
+  g_assert (egg_task_cache_peek (self, "c"));
+  g_assert (!egg_task_cache_peek (self, "d"));
+  g_assert_cmpint (egg_task_cache_get_global_cost (), ==, 10);
+  egg_task_cache_set_global_max_cost (0);
+
+  egg_task_cache_unpin (self, "c");
+  egg_task_cache_trim_all ();
+  g_assert (!egg_task_cache_peek (self, "c"));
+  g_assert_cmpint (egg_task_cache_get_cost (self), ==, 0);
+  g_assert_cmpint (egg_task_cache_get_global_cost (), ==, 0);
+
+  g_object_unref (self);
+}
+
 gint
 main (gint   argc,
       gchar *argv[])
 {
   g_test_init (&argc, &argv, NULL);
   g_test_add_func ("/Egg/TaskCache/basic", test_task_cache);
+  g_test_add_func ("/Egg/TaskCache/budget", test_task_cache_budget);
   return g_test_run ();
 }
@@ -1,14 +1,374 @@
 #include <fuzzy.h>
+#include <fuzzy-private.h>
+#include <glib/gstdio.h>
 #include <ide-line-reader.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-int
-main (int argc,
-      char *argv[])
+static const gchar *paths[] = {
+  "Makefile.am",
+  "configure.ac",
+  "libide/ide-context.c",
+  "libide/ide-context.h",
+  "libide/buffers/ide-buffer.c",
+  "libide/buffers/ide-buffer-manager.c",
+  "plugins/ctags/ide-ctags-index.c",
+  "plugins/ctags/ide-ctags-service.c",
+  "plugins/file-search/gb-file-search-index.c",
+  "tests/test-fuzzy.c",
+};
+
+static Fuzzy *
+create_fuzzy (const gchar * const *keys,
+              guint                n_keys)
+{
+  Fuzzy *fuzzy;
+  guint i;
+
+  fuzzy = fuzzy_new (FALSE);
+
+  fuzzy_begin_bulk_insert (fuzzy);
+  for (i = 0; i < n_keys; i++)
+    fuzzy_insert (fuzzy, keys [i], NULL);
+  fuzzy_end_bulk_insert (fuzzy);
+
+  return fuzzy;
+}
+
+static gchar *
+save_fuzzy (Fuzzy *fuzzy)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) error = NULL;
+  gchar *tmpfile = NULL;
+  gint fd;
+
+  bytes = fuzzy_serialize (fuzzy);
+  fd = g_file_open_tmp ("test-fuzzy-XXXXXX", &tmpfile, &error);
+  g_assert_no_error (error);
+  close (fd);
+
+  g_file_set_contents (tmpfile,
+                       g_bytes_get_data (bytes, NULL),
+                       g_bytes_get_size (bytes),
+                       &error);
+  g_assert_no_error (error);
+
+  return tmpfile;
+}
+
+static void
+assert_matches_equal (GArray *a,
+                      GArray *b)
+{
+  guint i;
+
+  g_assert (a != NULL);
+  g_assert (b != NULL);
+  g_assert_cmpint (a->len, ==, b->len);
+
+  for (i = 0; i < a->len; i++)
+    {
+      const FuzzyMatch *ma = &g_array_index (a, FuzzyMatch, i);
+      const FuzzyMatch *mb = &g_array_index (b, FuzzyMatch, i);
+
+      g_assert_cmpstr (ma->key, ==, mb->key);
+      g_assert_cmpfloat (ma->score, ==, mb->score);
+    }
+}
+
+static gboolean
+matches_contain (GArray      *ar,
+                 const gchar *key)
+{
+  guint i;
+
+  for (i = 0; i < ar->len; i++)
+    {
+      if (g_strcmp0 (g_array_index (ar, FuzzyMatch, i).key, key) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Same order as fuzzy_match() sorts its results */
+static gint
+compare_matches (gconstpointer a,
+                 gconstpointer b)
+{
+  const FuzzyMatch *ma = a;
+  const FuzzyMatch *mb = b;
+
+  if (ma->score < mb->score)
+    return 1;
+  else if (ma->score > mb->score)
+    return -1;
+
+  return strcmp (ma->key, mb->key);
+}
+
+static GArray *
+match_sorted (Fuzzy       *fuzzy,
+              const gchar *needle,
+              gsize        max_matches)
+{
+  GArray *ar = fuzzy_match (fuzzy, needle, max_matches);
+
+  g_array_sort (ar, compare_matches);
+
+  return ar;
+}
+
+/* Paths made of a few characters, so that needles match many of them */
+static Fuzzy *
+create_random_fuzzy (guint n_keys)
+{
+  static const gchar alphabet[] = "abcde/._";
+  GPtrArray *keys = g_ptr_array_new_with_free_func (g_free);
+  GRand *rand = g_rand_new_with_seed (1234);
+  Fuzzy *fuzzy;
+  guint i;
+
+  for (i = 0; i < n_keys; i++)
+    {
+      GString *str = g_string_new (NULL);
+      guint len = g_rand_int_range (rand, 1, 24);
+
+      while (len-- > 0)
+        g_string_append_c (str, alphabet [g_rand_int_range (rand, 0, sizeof alphabet - 1)]);
+
+      g_ptr_array_add (keys, g_string_free (str, FALSE));
+    }
+
+  fuzzy = create_fuzzy ((const gchar * const *)keys->pdata, keys->len);
+
+  g_ptr_array_unref (keys);
+  g_rand_free (rand);
+
+  return fuzzy;
+}
+
+static const gchar *random_needles[] = { "a", "ab", "abc", "a/b", "eda", "e.c_", "aaaa", "z" };
+
+static void
+test_fuzzy_top_k (void)
+{
+  static const gsize max_matches[] = { 1, 2, 7, 100 };
+  Fuzzy *fuzzy;
+  guint i;
+  guint j;
+
+  fuzzy = create_random_fuzzy (3000);
+
+  for (i = 0; i < G_N_ELEMENTS (random_needles); i++)
+    {
+      g_autoptr(GArray) all = match_sorted (fuzzy, random_needles [i], 0);
+
+      for (j = 0; j < G_N_ELEMENTS (max_matches); j++)
+        {
+          g_autoptr(GArray) ar = fuzzy_match (fuzzy, random_needles [i], max_matches [j]);
+          g_autoptr(GArray) best = g_array_new (FALSE, FALSE, sizeof (FuzzyMatch));
+
+          /* The best matches, in order, as if all matches were sorted */
+          g_array_append_vals (best, all->data, MIN (all->len, max_matches [j]));
+
+          assert_matches_equal (ar, best);
+        }
+    }
+
+  fuzzy_unref (fuzzy);
+}
+
+static void
+test_fuzzy_workers (void)
+{
+  static const gsize max_matches[] = { 0, 1, 10, 100 };
+  static const guint n_workers[] = { 2, 3, 8, 64 };
+  Fuzzy *fuzzy;
+  guint i;
+  guint j;
+  guint k;
+
+  fuzzy = create_random_fuzzy (3000);
+
+  /* Splitting the root table must not change the results */
+  for (i = 0; i < G_N_ELEMENTS (random_needles); i++)
+    {
+      for (j = 0; j < G_N_ELEMENTS (max_matches); j++)
+        {
+          g_autoptr(GArray) serial = NULL;
+
+          _fuzzy_set_n_workers (1);
+          serial = match_sorted (fuzzy, random_needles [i], max_matches [j]);
+
+          for (k = 0; k < G_N_ELEMENTS (n_workers); k++)
+            {
+              g_autoptr(GArray) ar = NULL;
+
+              _fuzzy_set_n_workers (n_workers [k]);
+              ar = match_sorted (fuzzy, random_needles [i], max_matches [j]);
+
+              assert_matches_equal (ar, serial);
+            }
+        }
+    }
+
+  _fuzzy_set_n_workers (0);
+
+  fuzzy_unref (fuzzy);
+}
+
+static void
+test_fuzzy_tombstones (void)
+{
+  static const gchar *keys[] = { "foo", "foo1", "foo12", "foo123", "bar", "fxoxo" };
+  static const guint n_workers[] = { 1, 4 };
+  Fuzzy *fuzzy;
+  guint i;
+
+  fuzzy = create_fuzzy (keys, G_N_ELEMENTS (keys));
+  fuzzy_remove (fuzzy, "foo");
+  fuzzy_remove (fuzzy, "foo12");
+
+  for (i = 0; i < G_N_ELEMENTS (n_workers); i++)
+    {
+      g_autoptr(GArray) all = NULL;
+      g_autoptr(GArray) ar = NULL;
+
+      _fuzzy_set_n_workers (n_workers [i]);
+
+      all = match_sorted (fuzzy, "foo", 0);
+      g_assert_cmpint (all->len, ==, 3);
+      g_assert_cmpstr (g_array_index (all, FuzzyMatch, 0).key, ==, "foo1");
+      g_assert_cmpstr (g_array_index (all, FuzzyMatch, 1).key, ==, "foo123");
+      g_assert_cmpstr (g_array_index (all, FuzzyMatch, 2).key, ==, "fxoxo");
+
+      /* Removed keys must not take up any of the requested slots */
+      ar = fuzzy_match (fuzzy, "foo", 2);
+      g_assert_cmpint (ar->len, ==, 2);
+      g_assert_cmpstr (g_array_index (ar, FuzzyMatch, 0).key, ==, "foo1");
+      g_assert_cmpstr (g_array_index (ar, FuzzyMatch, 1).key, ==, "foo123");
+    }
+
+  _fuzzy_set_n_workers (0);
+
+  fuzzy_unref (fuzzy);
+}
+
+static void
+test_fuzzy_serialize (void)
+{
+  static const gchar *queries[] = { "ctx", "ide", "buf", "ctags", "mk", "zzz" };
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpfile = NULL;
+  Fuzzy *fuzzy;
+  Fuzzy *copy;
+  guint i;
+
+  fuzzy = create_fuzzy (paths, G_N_ELEMENTS (paths));
+  tmpfile = save_fuzzy (fuzzy);
+
+  copy = fuzzy_new_from_file (tmpfile, &error);
+  g_assert_no_error (error);
+  g_assert (copy != NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (queries); i++)
+    {
+      g_autoptr(GArray) ar = fuzzy_match (fuzzy, queries [i], 5);
+      g_autoptr(GArray) ar2 = fuzzy_match (copy, queries [i], 5);
+
+      assert_matches_equal (ar, ar2);
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (paths); i++)
+    g_assert (fuzzy_contains (copy, paths [i]));
+
+  fuzzy_unref (copy);
+  fuzzy_unref (fuzzy);
+  g_unlink (tmpfile);
+}
+
+static void
+test_fuzzy_serialize_stale (void)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpfile = NULL;
+  g_autofree gchar *tmpfile2 = NULL;
+  g_autoptr(GArray) ar = NULL;
+  Fuzzy *fuzzy;
+  Fuzzy *copy;
+
+  fuzzy = create_fuzzy (paths, G_N_ELEMENTS (paths));
+  tmpfile = save_fuzzy (fuzzy);
+  fuzzy_unref (fuzzy);
+
+  /*
+   * Simulate files that were added and removed while the cache was on
+   * disk. The reopened index must accept the changes on top of the
+   * mapped tables and persist them again.
+   */
+  copy = fuzzy_new_from_file (tmpfile, &error);
+  g_assert_no_error (error);
+
+  fuzzy_insert (copy, "libide/ide-context-addin.c", NULL);
+  fuzzy_remove (copy, "libide/ide-context.h");
+
+  ar = fuzzy_match (copy, "idecontext", 0);
+  g_assert (matches_contain (ar, "libide/ide-context.c"));
+  g_assert (matches_contain (ar, "libide/ide-context-addin.c"));
+  g_assert (!matches_contain (ar, "libide/ide-context.h"));
+  g_clear_pointer (&ar, g_array_unref);
+
+  tmpfile2 = save_fuzzy (copy);
+  fuzzy_unref (copy);
+
+  copy = fuzzy_new_from_file (tmpfile2, &error);
+  g_assert_no_error (error);
+
+  ar = fuzzy_match (copy, "idecontext", 0);
+  g_assert_cmpint (ar->len, ==, 2);
+  g_assert (matches_contain (ar, "libide/ide-context.c"));
+  g_assert (matches_contain (ar, "libide/ide-context-addin.c"));
+
+  fuzzy_unref (copy);
+  g_unlink (tmpfile);
+  g_unlink (tmpfile2);
+}
+
+static void
+test_fuzzy_serialize_corrupt (void)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *tmpfile = NULL;
+  g_autofree gchar *contents = NULL;
+  Fuzzy *fuzzy;
+  gsize len;
+
+  fuzzy = create_fuzzy (paths, G_N_ELEMENTS (paths));
+  tmpfile = save_fuzzy (fuzzy);
+  fuzzy_unref (fuzzy);
+
+  g_file_get_contents (tmpfile, &contents, &len, &error);
+  g_assert_no_error (error);
+
+  /* Truncate the file in the middle of the tables */
+  g_file_set_contents (tmpfile, contents, len / 2, &error);
+  g_assert_no_error (error);
+
+  fuzzy = fuzzy_new_from_file (tmpfile, &error);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+  g_assert (fuzzy == NULL);
+
+  g_unlink (tmpfile);
+}
+
+static gint
+run_query (const gchar *filename,
+           const gchar *param)
 {
   IdeLineReader reader;
-  const gchar *param;
   Fuzzy *fuzzy;
   GArray *ar;
   gchar *contents;
@@ -16,16 +376,10 @@ main (int argc,
   gsize len;
   gsize line_len;
 
-  if (argc < 3)
-    {
-      g_printerr ("usage: %s FILENAME QUERY\n", argv[0]);
-      return 1;
-    }
-
   fuzzy = fuzzy_new (FALSE);
 
   g_print ("Loading contents\n");
-  g_file_get_contents (argv [1], &contents, &len, NULL);
+  g_file_get_contents (filename, &contents, &len, NULL);
   g_print ("Loaded\n");
 
   ide_line_reader_init (&reader, contents, len);
@@ -43,20 +397,18 @@ main (int argc,
 
   g_free (contents);
 
-  if (!g_utf8_validate (argv[2], -1, NULL))
+  if (!g_utf8_validate (param, -1, NULL))
     {
       g_critical ("Invalid UTF-8 discovered, aborting.");
       return EXIT_FAILURE;
     }
 
-  if (strlen (argv[2]) > 256)
+  if (strlen (param) > 256)
     {
       g_critical ("Only supports searching of up to 256 characters.");
       return EXIT_FAILURE;
     }
 
-  param = (const gchar *)argv[2];
-
   ar = fuzzy_match (fuzzy, param, 0);
 
   for (guint i = 0; i < ar->len; i++)
@@ -68,22 +420,26 @@ main (int argc,
 
   g_print ("%d matches\n", ar->len);
 
-  g_print ("Testing removal\n");
-
-  for (guint i = 0; i < ar->len; i++)
-    {
-      FuzzyMatch *m = &g_array_index (ar, FuzzyMatch, i);
-      fuzzy_remove (fuzzy, m->key);
-    }
-
   g_array_unref (ar);
+  fuzzy_unref (fuzzy);
 
-  ar = fuzzy_match (fuzzy, param, 0);
-  g_assert (ar == NULL || ar->len == 0);
-  g_clear_pointer (&ar, g_array_unref);
-  g_print ("success.\n");
+  return EXIT_SUCCESS;
+}
 
-  fuzzy_unref (fuzzy);
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  /* Allow running a query against a file of keys, one per line. */
+  if (argc == 3 && argv [1][0] != '-')
+    return run_query (argv [1], argv [2]);
 
-  return 0;
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Fuzzy/top-k", test_fuzzy_top_k);
+  g_test_add_func ("/Fuzzy/workers", test_fuzzy_workers);
+  g_test_add_func ("/Fuzzy/tombstones", test_fuzzy_tombstones);
+  g_test_add_func ("/Fuzzy/serialize", test_fuzzy_serialize);
+  g_test_add_func ("/Fuzzy/serialize/stale", test_fuzzy_serialize_stale);
+  g_test_add_func ("/Fuzzy/serialize/corrupt", test_fuzzy_serialize_corrupt);
+  return g_test_run ();
 }
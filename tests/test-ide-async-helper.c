@@ -0,0 +1,316 @@
+/* test-ide-async-helper.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+
+#include "util/ide-async-helper.h"
+
+/*
+ * Every step appends its name to "started". Steps named in "waiting" are
+ * kept pending until complete_step() is called, the step named by
+ * "failing" fails, and all of the others succeed right away.
+ */
+static GString    *started;
+static GHashTable *waiting;
+static GHashTable *pending;
+static const gchar *failing;
+
+static void
+run_step (const gchar         *name,
+          gpointer             source_object,
+          GCancellable        *cancellable,
+          GAsyncReadyCallback  callback,
+          gpointer             user_data)
+{
+  g_autoptr(GTask) task = g_task_new (source_object, cancellable, callback, user_data);
+
+  g_string_append (started, name);
+
+  if (g_hash_table_contains (waiting, name))
+    g_hash_table_insert (pending, (gchar *)name, g_object_ref (task));
+  else if (g_strcmp0 (name, failing) == 0)
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "%s failed", name);
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+#define DEFINE_STEP(name)                                         \
+  static void                                                     \
+  step_##name (gpointer             source_object,                \
+               GCancellable        *cancellable,                  \
+               GAsyncReadyCallback  callback,                     \
+               gpointer             user_data)                    \
+  {                                                               \
+    run_step (#name, source_object, cancellable, callback, user_data); \
+  }
+
+DEFINE_STEP (a)
+DEFINE_STEP (b)
+DEFINE_STEP (c)
+DEFINE_STEP (d)
+DEFINE_STEP (x)
+
+static void
+setup (const gchar *waiting_steps,
+       const gchar *failing_step)
+{
+  g_string_truncate (started, 0);
+  g_hash_table_remove_all (waiting);
+  g_hash_table_remove_all (pending);
+
+  for (; waiting_steps != NULL && *waiting_steps; waiting_steps++)
+    g_hash_table_add (waiting, g_strndup (waiting_steps, 1));
+
+  failing = failing_step;
+}
+
+static void
+flush (void)
+{
+  while (g_main_context_iteration (NULL, FALSE))
+    { }
+}
+
+static void
+complete_step (const gchar *name)
+{
+  GTask *task;
+
+  task = g_hash_table_lookup (pending, name);
+  g_assert (task != NULL);
+
+  g_task_return_boolean (task, TRUE);
+  g_hash_table_remove (pending, name);
+
+  flush ();
+}
+
+static void
+run_graph_cb (GObject      *object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  GTask **ret = user_data;
+
+  g_assert (G_IS_TASK (result));
+  g_assert (*ret == NULL);
+
+  *ret = g_object_ref (G_TASK (result));
+}
+
+static GTask *
+run_graph (const IdeAsyncGraphStep *steps,
+           guint                    n_steps,
+           GCancellable            *cancellable)
+{
+  GTask *ret = NULL;
+
+  ide_async_helper_run_graph (NULL, steps, n_steps, cancellable, run_graph_cb, &ret);
+  flush ();
+
+  return ret;
+}
+
+static void
+test_async_graph_concurrent (void)
+{
+  static const IdeAsyncGraphStep steps[] = {
+    { "c", step_c, { "a", "b" } },
+    { "a", step_a },
+    { "b", step_b },
+  };
+  g_autoptr(GTask) result = NULL;
+
+  setup ("ab", NULL);
+
+  /* Both independent steps are running before either one completes */
+  result = run_graph (steps, G_N_ELEMENTS (steps), NULL);
+  g_assert (result == NULL);
+  g_assert_cmpstr (started->str, ==, "ab");
+  g_assert_cmpint (g_hash_table_size (pending), ==, 2);
+
+  complete_step ("b");
+  g_assert_cmpstr (started->str, ==, "ab");
+
+  complete_step ("a");
+  g_assert_cmpstr (started->str, ==, "abc");
+
+  g_assert (result != NULL);
+  g_assert_true (g_task_propagate_boolean (result, NULL));
+}
+
+static void
+test_async_graph_order (void)
+{
+  static const IdeAsyncGraphStep steps[] = {
+    { "d", step_d, { "b", "c" } },
+    { "c", step_c, { "a" } },
+    { "b", step_b, { "a" } },
+    { "a", step_a },
+  };
+  g_autoptr(GTask) result = NULL;
+  g_autoptr(GError) error = NULL;
+
+  setup (NULL, NULL);
+
+  result = run_graph (steps, G_N_ELEMENTS (steps), NULL);
+  g_assert (result != NULL);
+  g_assert_true (g_task_propagate_boolean (result, &error));
+  g_assert_no_error (error);
+
+  /* b and c only wait for a, so they are started in table order */
+  g_assert_cmpstr (started->str, ==, "acbd");
+}
+
+static void
+test_async_graph_failure (void)
+{
+  static const IdeAsyncGraphStep steps[] = {
+    { "a", step_a },
+    { "b", step_b, { "a" } },
+    { "c", step_c, { "b" } },
+    { "x", step_x },
+  };
+  g_autoptr(GTask) result = NULL;
+  g_autoptr(GError) error = NULL;
+
+  setup ("x", "a");
+
+  /* x is already running when a fails, so the graph waits for it */
+  result = run_graph (steps, G_N_ELEMENTS (steps), NULL);
+  g_assert (result == NULL);
+  g_assert_cmpstr (started->str, ==, "ax");
+
+  complete_step ("x");
+  g_assert (result != NULL);
+  g_assert_false (g_task_propagate_boolean (result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_cmpstr (error->message, ==, "a failed");
+
+  /* The dependents of a were skipped */
+  g_assert_cmpstr (started->str, ==, "ax");
+}
+
+static void
+test_async_graph_cycle (void)
+{
+  static const IdeAsyncGraphStep steps[] = {
+    { "a", step_a, { "b" } },
+    { "b", step_b, { "a" } },
+    { "x", step_x },
+  };
+  g_autoptr(GTask) result = NULL;
+  g_autoptr(GError) error = NULL;
+
+  setup (NULL, NULL);
+
+  result = run_graph (steps, G_N_ELEMENTS (steps), NULL);
+  g_assert (result != NULL);
+  g_assert_false (g_task_propagate_boolean (result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_cmpstr (started->str, ==, "x");
+}
+
+static void
+test_async_graph_unknown (void)
+{
+  static const IdeAsyncGraphStep steps[] = {
+    { "a", step_a },
+    { "b", step_b, { "a", "missing" } },
+  };
+  g_autoptr(GTask) result = NULL;
+  g_autoptr(GError) error = NULL;
+
+  setup (NULL, NULL);
+
+  g_test_expect_message ("ide-async-helper", G_LOG_LEVEL_CRITICAL, "*requires unknown step*");
+  result = run_graph (steps, G_N_ELEMENTS (steps), NULL);
+  g_test_assert_expected_messages ();
+
+  g_assert (result != NULL);
+  g_assert_false (g_task_propagate_boolean (result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_cmpstr (started->str, ==, "a");
+}
+
+static void
+test_async_graph_cancel (void)
+{
+  static const IdeAsyncGraphStep steps[] = {
+    { "a", step_a },
+    { "b", step_b, { "a" } },
+  };
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  g_autoptr(GTask) result = NULL;
+  g_autoptr(GError) error = NULL;
+
+  setup ("a", NULL);
+
+  result = run_graph (steps, G_N_ELEMENTS (steps), cancellable);
+  g_assert (result == NULL);
+  g_assert_cmpstr (started->str, ==, "a");
+
+  /* The running step still completes, but nothing is started after it */
+  g_cancellable_cancel (cancellable);
+  complete_step ("a");
+
+  g_assert (result != NULL);
+  g_assert_false (g_task_propagate_boolean (result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpstr (started->str, ==, "a");
+}
+
+static void
+test_async_graph_cancel_before (void)
+{
+  static const IdeAsyncGraphStep steps[] = {
+    { "a", step_a },
+  };
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  g_autoptr(GTask) result = NULL;
+  g_autoptr(GError) error = NULL;
+
+  setup (NULL, NULL);
+
+  g_cancellable_cancel (cancellable);
+  result = run_graph (steps, G_N_ELEMENTS (steps), cancellable);
+
+  g_assert (result != NULL);
+  g_assert_false (g_task_propagate_boolean (result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpstr (started->str, ==, "");
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  started = g_string_new (NULL);
+  waiting = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  pending = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/AsyncHelper/graph/concurrent", test_async_graph_concurrent);
+  g_test_add_func ("/Ide/AsyncHelper/graph/order", test_async_graph_order);
+  g_test_add_func ("/Ide/AsyncHelper/graph/failure", test_async_graph_failure);
+  g_test_add_func ("/Ide/AsyncHelper/graph/cycle", test_async_graph_cycle);
+  g_test_add_func ("/Ide/AsyncHelper/graph/unknown", test_async_graph_unknown);
+  g_test_add_func ("/Ide/AsyncHelper/graph/cancel", test_async_graph_cancel);
+  g_test_add_func ("/Ide/AsyncHelper/graph/cancel-before", test_async_graph_cancel_before);
+  return g_test_run ();
+}
@@ -0,0 +1,262 @@
+/* test-ide-buffer-snapshot.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <string.h>
+
+#include "ide-internal.h"
+
+static const gchar *words[] = {
+  "a", "bc", "\n", "def\n", "\r\n", "ghij", "\n\n", "k", "λ", "日本語\n",
+  "\r", "x\r", "\xe2\x80\xa8", "\xe2\x80\xa9",
+};
+
+/* The length of the line break at @str, like pango_find_paragraph_boundary() */
+static gsize
+line_break_len (const gchar *str)
+{
+  if (str[0] == '\n')
+    return 1;
+  if (str[0] == '\r')
+    return str[1] == '\n' ? 2 : 1;
+  if (g_str_has_prefix (str, "\xe2\x80\xa8") || g_str_has_prefix (str, "\xe2\x80\xa9"))
+    return 3;
+  return 0;
+}
+
+static void
+assert_snapshot_matches (IdeBufferSnapshot *snapshot,
+                         GString           *model)
+{
+  g_autofree gchar *text = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  guint n_lines = 1;
+  guint line = 0;
+  gsize offset;
+  gsize len = 0;
+  gsize i;
+
+  g_assert_cmpint (ide_buffer_snapshot_get_length (snapshot), ==, model->len);
+
+  text = ide_buffer_snapshot_get_text (snapshot, 0, -1);
+  g_assert_cmpstr (text, ==, model->str);
+
+  bytes = ide_buffer_snapshot_get_bytes (snapshot);
+  g_assert_cmpint (g_bytes_get_size (bytes), ==, model->len);
+  g_assert (memcmp (g_bytes_get_data (bytes, NULL), model->str, model->len) == 0);
+  g_assert (((const gchar *)g_bytes_get_data (bytes, NULL))[model->len] == '\0');
+
+  for (i = 0; i < model->len; i += MAX (len, 1))
+    {
+      gsize j;
+
+      len = line_break_len (&model->str[i]);
+
+      /* The bytes of a line break belong to the line it ends */
+      for (j = i; j < i + MAX (len, 1); j++)
+        g_assert_cmpint (ide_buffer_snapshot_get_line_at_offset (snapshot, j), ==, line);
+
+      if (len > 0)
+        {
+          line++;
+          n_lines++;
+          g_assert (ide_buffer_snapshot_get_line_offset (snapshot, line, &offset));
+          g_assert_cmpint (offset, ==, i + len);
+        }
+    }
+
+  g_assert_cmpint (ide_buffer_snapshot_get_line_count (snapshot), ==, n_lines);
+  g_assert (!ide_buffer_snapshot_get_line_offset (snapshot, n_lines, &offset));
+}
+
+static void
+test_snapshot_edits (void)
+{
+  g_autoptr(GString) model = g_string_new (NULL);
+  IdeBufferSnapshot *snapshot;
+  GRand *rand;
+  guint i;
+
+  rand = g_rand_new_with_seed (1234);
+  snapshot = _ide_buffer_snapshot_new (FALSE);
+
+  for (i = 0; i < 5000; i++)
+    {
+      IdeBufferSnapshot *next;
+      glong n_chars = g_utf8_strlen (model->str, model->len);
+
+      if (n_chars > 0 && g_rand_int_range (rand, 0, 3) == 0)
+        {
+          gint begin = g_rand_int_range (rand, 0, n_chars);
+          gint len = g_rand_int_range (rand, 0, 40);
+          gint end = MIN (n_chars, begin + len);
+          const gchar *begin_ptr = g_utf8_offset_to_pointer (model->str, begin);
+          const gchar *end_ptr = g_utf8_offset_to_pointer (model->str, end);
+
+          g_string_erase (model, begin_ptr - model->str, end_ptr - begin_ptr);
+          next = _ide_buffer_snapshot_delete (snapshot, begin, end);
+        }
+      else
+        {
+          gint offset = g_rand_int_range (rand, 0, n_chars + 1);
+          const gchar *word = words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))];
+          const gchar *ptr = g_utf8_offset_to_pointer (model->str, offset);
+
+          g_string_insert (model, ptr - model->str, word);
+          next = _ide_buffer_snapshot_insert (snapshot, offset, word, strlen (word));
+        }
+
+      ide_buffer_snapshot_unref (snapshot);
+      snapshot = next;
+
+      if (i % 250 == 0)
+        assert_snapshot_matches (snapshot, model);
+    }
+
+  assert_snapshot_matches (snapshot, model);
+
+  ide_buffer_snapshot_unref (snapshot);
+  g_rand_free (rand);
+}
+
+static void
+test_snapshot_large_insert (void)
+{
+  g_autoptr(GString) model = g_string_new (NULL);
+  IdeBufferSnapshot *snapshot;
+  IdeBufferSnapshot *next;
+  guint i;
+
+  for (i = 0; i < 10000; i++)
+    g_string_append_printf (model, "line %u: ünïcödé\n", i);
+
+  snapshot = _ide_buffer_snapshot_new (FALSE);
+  next = _ide_buffer_snapshot_insert (snapshot, 0, model->str, model->len);
+  ide_buffer_snapshot_unref (snapshot);
+  snapshot = next;
+
+  assert_snapshot_matches (snapshot, model);
+
+  /* Earlier snapshots are not affected by later edits */
+  next = _ide_buffer_snapshot_delete (snapshot, 10, 100000);
+  assert_snapshot_matches (snapshot, model);
+  ide_buffer_snapshot_unref (snapshot);
+
+  g_string_truncate (model, g_utf8_offset_to_pointer (model->str, 10) - model->str);
+  assert_snapshot_matches (next, model);
+
+  ide_buffer_snapshot_unref (next);
+}
+
+static void
+test_snapshot_implicit_newline (void)
+{
+  IdeBufferSnapshot *snapshot;
+  IdeBufferSnapshot *next;
+  g_autofree gchar *text = NULL;
+
+  snapshot = _ide_buffer_snapshot_new (TRUE);
+  next = _ide_buffer_snapshot_insert (snapshot, 0, "abc", 3);
+  ide_buffer_snapshot_unref (snapshot);
+  snapshot = next;
+
+  text = ide_buffer_snapshot_get_text (snapshot, 0, -1);
+  g_assert_cmpstr (text, ==, "abc\n");
+  g_assert_cmpint (ide_buffer_snapshot_get_length (snapshot), ==, 4);
+  g_assert_cmpint (ide_buffer_snapshot_get_line_count (snapshot), ==, 1);
+
+  next = _ide_buffer_snapshot_set_implicit_trailing_newline (snapshot, FALSE);
+  g_assert_cmpint (ide_buffer_snapshot_get_length (next), ==, 3);
+
+  ide_buffer_snapshot_unref (snapshot);
+  ide_buffer_snapshot_unref (next);
+}
+
+static void
+test_snapshot_line_breaks (void)
+{
+  static const struct {
+    const gchar *text;
+    guint        n_lines;
+  } cases[] = {
+    { "", 1 },
+    { "a\nb", 2 },
+    { "a\rb", 2 },
+    { "a\r\nb", 2 },
+    { "a\n\rb", 3 },
+    { "a\r\r\nb\n", 4 },
+    { "a\xe2\x80\xa8" "b\xe2\x80\xa9" "c", 3 },
+    { "\xe2\x80\xa9\r\n", 3 },
+  };
+  g_autoptr(GString) model = g_string_new (NULL);
+  IdeBufferSnapshot *snapshot;
+  IdeBufferSnapshot *next;
+  guint i;
+
+  /* Expected line counts are those of GtkTextBuffer */
+  for (i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+      snapshot = _ide_buffer_snapshot_new (FALSE);
+      next = _ide_buffer_snapshot_insert (snapshot, 0, cases[i].text, strlen (cases[i].text));
+      ide_buffer_snapshot_unref (snapshot);
+
+      g_string_assign (model, cases[i].text);
+      assert_snapshot_matches (next, model);
+      g_assert_cmpint (ide_buffer_snapshot_get_line_count (next), ==, cases[i].n_lines);
+
+      ide_buffer_snapshot_unref (next);
+    }
+
+  /* Place "\r\n" across leaf boundaries, which are every 1024 bytes */
+  g_string_truncate (model, 0);
+  for (i = 0; i < 50; i++)
+    {
+      while (model->len % 1024 != 1023)
+        g_string_append_c (model, 'x');
+      g_string_append (model, "\r\n");
+    }
+
+  snapshot = _ide_buffer_snapshot_new (FALSE);
+  next = _ide_buffer_snapshot_insert (snapshot, 0, model->str, model->len);
+  ide_buffer_snapshot_unref (snapshot);
+  snapshot = next;
+
+  assert_snapshot_matches (snapshot, model);
+  g_assert_cmpint (ide_buffer_snapshot_get_line_count (snapshot), ==, 51);
+
+  /* And split one in two with an edit */
+  next = _ide_buffer_snapshot_insert (snapshot, 1024, "y", 1);
+  g_string_insert_c (model, 1024, 'y');
+  assert_snapshot_matches (next, model);
+  g_assert_cmpint (ide_buffer_snapshot_get_line_count (next), ==, 52);
+
+  ide_buffer_snapshot_unref (snapshot);
+  ide_buffer_snapshot_unref (next);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/BufferSnapshot/edits", test_snapshot_edits);
+  g_test_add_func ("/Ide/BufferSnapshot/large_insert", test_snapshot_large_insert);
+  g_test_add_func ("/Ide/BufferSnapshot/implicit_newline", test_snapshot_implicit_newline);
+  g_test_add_func ("/Ide/BufferSnapshot/line_breaks", test_snapshot_line_breaks);
+  return g_test_run ();
+}
@@ -0,0 +1,165 @@
+/* test-ide-build-log.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+
+typedef struct
+{
+  guint64 next;
+  guint   count;
+} ForeachState;
+
+static gboolean
+check_line (guint64            line,
+            IdeBuildResultLog  log,
+            const gchar       *text,
+            gsize              len,
+            gpointer           user_data)
+{
+  ForeachState *state = user_data;
+  g_autofree gchar *expected = NULL;
+
+  g_assert_cmpint (line, ==, state->next);
+
+  expected = g_strdup_printf ("line %"G_GUINT64_FORMAT, line);
+  g_assert_cmpint (len, ==, strlen (expected));
+  g_assert_cmpint (memcmp (text, expected, len), ==, 0);
+  g_assert_cmpint (text [len], ==, '\0');
+  g_assert_cmpint (log, ==, (line % 3) ? IDE_BUILD_RESULT_LOG_STDOUT : IDE_BUILD_RESULT_LOG_STDERR);
+
+  state->next++;
+  state->count++;
+
+  return FALSE;
+}
+
+static void
+append_lines (IdeBuildLog *log,
+              guint64      begin,
+              guint64      end)
+{
+  for (guint64 i = begin; i < end; i++)
+    {
+      g_autofree gchar *text = g_strdup_printf ("line %"G_GUINT64_FORMAT"\n", i);
+
+      ide_build_log_append (log,
+                            (i % 3) ? IDE_BUILD_RESULT_LOG_STDOUT : IDE_BUILD_RESULT_LOG_STDERR,
+                            text,
+                            -1);
+    }
+}
+
+static void
+test_build_log_basic (void)
+{
+  g_autoptr(IdeBuildLog) log = NULL;
+  IdeBuildResultLog stream;
+  ForeachState state = { 0 };
+  guint64 begin;
+  guint64 end;
+  gchar *text;
+
+  log = ide_build_log_new (0);
+
+  ide_build_log_get_bounds (log, &begin, &end);
+  g_assert_cmpint (begin, ==, 0);
+  g_assert_cmpint (end, ==, 0);
+  g_assert (ide_build_log_get_line (log, 0, NULL) == NULL);
+
+  append_lines (log, 0, 100000);
+
+  ide_build_log_get_bounds (log, &begin, &end);
+  g_assert_cmpint (begin, ==, 0);
+  g_assert_cmpint (end, ==, 100000);
+  g_assert_cmpint (ide_build_log_get_n_dropped (log), ==, 0);
+
+  text = ide_build_log_get_line (log, 12345, &stream);
+  g_assert_cmpstr (text, ==, "line 12345");
+  g_assert_cmpint (stream, ==, IDE_BUILD_RESULT_LOG_STDOUT);
+  g_free (text);
+
+  text = ide_build_log_get_line (log, 99999, &stream);
+  g_assert_cmpstr (text, ==, "line 99999");
+  g_assert_cmpint (stream, ==, IDE_BUILD_RESULT_LOG_STDERR);
+  g_free (text);
+
+  g_assert (ide_build_log_get_line (log, 100000, NULL) == NULL);
+
+  /* A range spanning several chunks */
+  state.next = 500;
+  ide_build_log_foreach (log, 500, 90000, check_line, &state);
+  g_assert_cmpint (state.count, ==, 89500);
+
+  /* The range is clamped to the available lines */
+  state.next = 99990;
+  state.count = 0;
+  ide_build_log_foreach (log, 99990, G_MAXUINT64, check_line, &state);
+  g_assert_cmpint (state.count, ==, 10);
+}
+
+static void
+test_build_log_drop (void)
+{
+  g_autoptr(IdeBuildLog) log = NULL;
+  ForeachState state = { 0 };
+  guint64 begin;
+  guint64 end;
+
+  /* Room for two chunks */
+  log = ide_build_log_new (128 * 1024);
+
+  append_lines (log, 0, 200000);
+
+  g_assert_cmpint (ide_build_log_get_size (log), <=, 128 * 1024);
+
+  ide_build_log_get_bounds (log, &begin, &end);
+  g_assert_cmpint (end, ==, 200000);
+  g_assert_cmpint (begin, >, 0);
+  g_assert_cmpint (begin, ==, ide_build_log_get_n_dropped (log));
+
+  g_assert (ide_build_log_get_line (log, begin - 1, NULL) == NULL);
+
+  /* Every line that was not dropped is intact */
+  state.next = begin;
+  ide_build_log_foreach (log, 0, end, check_line, &state);
+  g_assert_cmpint (state.count, ==, end - begin);
+
+  /* A line larger than a chunk gets a chunk of its own */
+  {
+    g_autofree gchar *large = g_strnfill (200 * 1024, 'x');
+    g_autofree gchar *copy = NULL;
+
+    ide_build_log_append (log, IDE_BUILD_RESULT_LOG_STDOUT, large, -1);
+
+    ide_build_log_get_bounds (log, &begin, &end);
+    g_assert_cmpint (begin, ==, end - 1);
+
+    copy = ide_build_log_get_line (log, end - 1, NULL);
+    g_assert_cmpstr (copy, ==, large);
+  }
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/BuildLog/basic", test_build_log_basic);
+  g_test_add_func ("/Ide/BuildLog/drop", test_build_log_drop);
+  return g_test_run ();
+}
@@ -0,0 +1,189 @@
+/* test-ide-clang-diagnostics-variant.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+
+#include "ide-internal.h"
+
+#include "ide-clang-diagnostics-variant.h"
+
+static IdeFile *
+create_file (IdeContext  *context,
+             const gchar *path)
+{
+  g_autoptr(GFile) gfile = g_file_new_for_path (path);
+
+  return g_object_new (IDE_TYPE_FILE,
+                       "context", context,
+                       "file", gfile,
+                       "path", path,
+                       NULL);
+}
+
+static IdeSourceRange *
+create_range (IdeFile *file,
+              guint    begin_line,
+              guint    begin_column,
+              guint    end_line,
+              guint    end_column)
+{
+  g_autoptr(IdeSourceLocation) begin = NULL;
+  g_autoptr(IdeSourceLocation) end = NULL;
+
+  begin = ide_source_location_new (file, begin_line, begin_column, 0);
+  end = ide_source_location_new (file, end_line, end_column, 0);
+
+  return ide_source_range_new (begin, end);
+}
+
+static void
+assert_range (IdeSourceRange *range,
+              IdeFile        *file,
+              guint           begin_line,
+              guint           begin_column,
+              guint           end_line,
+              guint           end_column)
+{
+  IdeSourceLocation *begin = ide_source_range_get_begin (range);
+  IdeSourceLocation *end = ide_source_range_get_end (range);
+
+  g_assert (ide_source_location_get_file (begin) == file);
+  g_assert (ide_source_location_get_file (end) == file);
+  g_assert_cmpint (ide_source_location_get_line (begin), ==, begin_line);
+  g_assert_cmpint (ide_source_location_get_line_offset (begin), ==, begin_column);
+  g_assert_cmpint (ide_source_location_get_line (end), ==, end_line);
+  g_assert_cmpint (ide_source_location_get_line_offset (end), ==, end_column);
+}
+
+static void
+test_diagnostics_variant_round_trip (void)
+{
+  g_autoptr(IdeContext) context = NULL;
+  g_autoptr(IdeFile) source = NULL;
+  g_autoptr(IdeFile) target = NULL;
+  g_autoptr(IdeDiagnostics) diagnostics = NULL;
+  g_autoptr(IdeDiagnostics) copy = NULL;
+  g_autoptr(IdeSourceLocation) location = NULL;
+  g_autoptr(IdeSourceRange) fixit_range = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  IdeSourceLocation *copy_location;
+  IdeDiagnostic *diag;
+  IdeFixit *fixit;
+  GPtrArray *ar;
+
+  context = g_object_new (IDE_TYPE_CONTEXT, NULL);
+  source = create_file (context, "test.c");
+  target = create_file (context, "test.c");
+
+  ar = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_diagnostic_unref);
+
+  /* An error with a range and a fixit */
+  location = ide_source_location_new (source, 10, 4, 123);
+  diag = ide_diagnostic_new (IDE_DIAGNOSTIC_ERROR, "use of undeclared identifier 'fo'", location);
+  ide_diagnostic_take_range (diag, create_range (source, 10, 4, 10, 6));
+  fixit_range = create_range (source, 10, 4, 10, 6);
+  ide_diagnostic_take_fixit (diag, _ide_fixit_new (fixit_range, "foo"));
+  g_ptr_array_add (ar, diag);
+  g_clear_pointer (&location, ide_source_location_unref);
+
+  /* A deprecation without ranges or fixits */
+  location = ide_source_location_new (source, 0, 0, 0);
+  diag = ide_diagnostic_new (IDE_DIAGNOSTIC_DEPRECATED, "'gtk_widget_reparent' is deprecated", location);
+  g_ptr_array_add (ar, diag);
+
+  diagnostics = ide_diagnostics_new (ar);
+
+  variant = g_variant_ref_sink (ide_clang_diagnostics_to_variant (diagnostics));
+  g_assert (g_variant_is_of_type (variant, IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE));
+
+  copy = ide_clang_diagnostics_new_from_variant (target, variant);
+  g_assert_cmpint (ide_diagnostics_get_size (copy), ==, 2);
+
+  diag = ide_diagnostics_index (copy, 0);
+  g_assert_cmpint (ide_diagnostic_get_severity (diag), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpstr (ide_diagnostic_get_text (diag), ==, "use of undeclared identifier 'fo'");
+  copy_location = ide_diagnostic_get_location (diag);
+  g_assert (ide_source_location_get_file (copy_location) == target);
+  g_assert_cmpint (ide_source_location_get_line (copy_location), ==, 10);
+  g_assert_cmpint (ide_source_location_get_line_offset (copy_location), ==, 4);
+  g_assert_cmpint (ide_source_location_get_offset (copy_location), ==, 123);
+  g_assert_cmpint (ide_diagnostic_get_num_ranges (diag), ==, 1);
+  assert_range (ide_diagnostic_get_range (diag, 0), target, 10, 4, 10, 6);
+  g_assert_cmpint (ide_diagnostic_get_num_fixits (diag), ==, 1);
+  fixit = ide_diagnostic_get_fixit (diag, 0);
+  g_assert_cmpstr (ide_fixit_get_text (fixit), ==, "foo");
+  assert_range (ide_fixit_get_range (fixit), target, 10, 4, 10, 6);
+
+  diag = ide_diagnostics_index (copy, 1);
+  g_assert_cmpint (ide_diagnostic_get_severity (diag), ==, IDE_DIAGNOSTIC_DEPRECATED);
+  g_assert_cmpstr (ide_diagnostic_get_text (diag), ==, "'gtk_widget_reparent' is deprecated");
+  copy_location = ide_diagnostic_get_location (diag);
+  g_assert_cmpint (ide_source_location_get_line (copy_location), ==, 0);
+  g_assert_cmpint (ide_source_location_get_line_offset (copy_location), ==, 0);
+  g_assert_cmpint (ide_diagnostic_get_num_ranges (diag), ==, 0);
+  g_assert_cmpint (ide_diagnostic_get_num_fixits (diag), ==, 0);
+}
+
+static void
+test_diagnostics_variant_worker_format (void)
+{
+  g_autoptr(IdeContext) context = NULL;
+  g_autoptr(IdeFile) target = NULL;
+  g_autoptr(IdeDiagnostics) diagnostics = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariant) encoded = NULL;
+  IdeDiagnostic *diag;
+
+  context = g_object_new (IDE_TYPE_CONTEXT, NULL);
+  target = create_file (context, "test.h");
+
+  /* Built like ide_clang_worker_build_diagnostics() does */
+  variant = g_variant_parse (IDE_CLANG_DIAGNOSTICS_VARIANT_TYPE,
+                             "[(3, 'unused variable', (2, 7, 40), [(2, 7, 2, 12)], []),"
+                             " (4, 'expected ;', (5, 0, 80), [], [(5, 0, 5, 0, ';')])]",
+                             NULL, NULL, NULL);
+  g_assert (variant != NULL);
+  g_variant_ref_sink (variant);
+
+  diagnostics = ide_clang_diagnostics_new_from_variant (target, variant);
+  g_assert_cmpint (ide_diagnostics_get_size (diagnostics), ==, 2);
+
+  diag = ide_diagnostics_index (diagnostics, 0);
+  g_assert_cmpint (ide_diagnostic_get_severity (diag), ==, IDE_DIAGNOSTIC_WARNING);
+  g_assert_cmpint (ide_diagnostic_get_num_ranges (diag), ==, 1);
+  assert_range (ide_diagnostic_get_range (diag, 0), target, 2, 7, 2, 12);
+
+  diag = ide_diagnostics_index (diagnostics, 1);
+  g_assert_cmpint (ide_diagnostic_get_severity (diag), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (ide_diagnostic_get_num_fixits (diag), ==, 1);
+  g_assert_cmpstr (ide_fixit_get_text (ide_diagnostic_get_fixit (diag, 0)), ==, ";");
+
+  /* Encoding the decoded diagnostics gives back the same message */
+  encoded = g_variant_ref_sink (ide_clang_diagnostics_to_variant (diagnostics));
+  g_assert (g_variant_equal (encoded, variant));
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/Clang/DiagnosticsVariant/round-trip", test_diagnostics_variant_round_trip);
+  g_test_add_func ("/Ide/Clang/DiagnosticsVariant/worker-format", test_diagnostics_variant_worker_format);
+  return g_test_run ();
+}
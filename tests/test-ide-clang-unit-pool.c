@@ -0,0 +1,223 @@
+/* test-ide-clang-unit-pool.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+
+#include "ide-clang-unit-pool.h"
+
+static const gchar *args_a[] = { "-I.", "-DFOO", NULL };
+static const gchar *args_b[] = { "-I.", NULL };
+
+static GPtrArray *freed;
+
+/* Stands in for clang_disposeTranslationUnit() */
+static void
+fake_tu_free (gpointer tu)
+{
+  g_ptr_array_add (freed, tu);
+}
+
+static gpointer
+fake_tu_new (void)
+{
+  static guint8 tus [32];
+  static guint n_tus;
+
+  g_assert_cmpint (n_tus, <, G_N_ELEMENTS (tus));
+
+  return &tus [n_tus++];
+}
+
+static IdeClangUnitPool *
+setup (guint max_spares)
+{
+  if (freed == NULL)
+    freed = g_ptr_array_new ();
+  g_ptr_array_set_size (freed, 0);
+
+  return ide_clang_unit_pool_new (max_spares, fake_tu_free);
+}
+
+static void
+teardown (IdeClangUnitPool *pool)
+{
+  ide_clang_unit_pool_dispose (pool);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 0);
+  ide_clang_unit_pool_unref (pool);
+}
+
+static IdeClangUnit *
+parse (IdeClangUnitPool    *pool,
+       const gchar         *filename,
+       const gchar * const *args)
+{
+  IdeClangUnit *unit;
+
+  unit = ide_clang_unit_new (pool, fake_tu_new (), filename, args);
+  ide_clang_unit_pool_publish (pool, unit);
+
+  return unit;
+}
+
+static void
+test_unit_pool_reuse (void)
+{
+  IdeClangUnitPool *pool = setup (4);
+  IdeClangUnit *unit;
+  IdeClangUnit *taken;
+  gpointer tu;
+
+  unit = parse (pool, "/a.c", args_a);
+  tu = unit->tu;
+
+  /* Nothing for a file that was never released */
+  g_assert (ide_clang_unit_pool_take (pool, "/a.c", args_a) == NULL);
+
+  ide_clang_unit_pool_release (pool, unit);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 1);
+  g_assert_cmpint (freed->len, ==, 0);
+
+  /* Another file does not get it */
+  g_assert (ide_clang_unit_pool_take (pool, "/b.c", args_a) == NULL);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 1);
+
+  /* The same unit is handed back to be reparsed in place */
+  taken = ide_clang_unit_pool_take (pool, "/a.c", args_a);
+  g_assert (taken == unit);
+  g_assert (taken->tu == tu);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 0);
+
+  /* Reparsed and released again, it is still the current unit */
+  ide_clang_unit_pool_publish (pool, taken);
+  ide_clang_unit_pool_release (pool, taken);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 1);
+
+  /* The flags changed, so it cannot be reparsed */
+  g_assert (ide_clang_unit_pool_take (pool, "/a.c", args_b) == NULL);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 0);
+  g_assert_cmpint (freed->len, ==, 1);
+  g_assert (g_ptr_array_index (freed, 0) == tu);
+
+  teardown (pool);
+}
+
+static void
+test_unit_pool_superseded (void)
+{
+  IdeClangUnitPool *pool = setup (4);
+  IdeClangUnit *held;
+  IdeClangUnit *newer;
+
+  /*
+   * A consumer still holds the unit when the file is parsed again, so a
+   * second unit exists for a while. Only the newer one may be kept.
+   */
+  held = parse (pool, "/a.c", args_a);
+  newer = parse (pool, "/a.c", args_a);
+
+  ide_clang_unit_pool_release (pool, held);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 0);
+  g_assert_cmpint (freed->len, ==, 1);
+
+  ide_clang_unit_pool_release (pool, newer);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 1);
+  g_assert (ide_clang_unit_pool_take (pool, "/a.c", args_a) == newer);
+
+  /* Same thing when the newer unit is released first */
+  held = newer;
+  newer = parse (pool, "/a.c", args_a);
+
+  ide_clang_unit_pool_release (pool, newer);
+  ide_clang_unit_pool_release (pool, held);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 1);
+  g_assert_cmpint (freed->len, ==, 2);
+  g_assert (ide_clang_unit_pool_take (pool, "/a.c", args_a) == newer);
+
+  ide_clang_unit_free (newer);
+
+  teardown (pool);
+}
+
+static void
+test_unit_pool_eviction (void)
+{
+  IdeClangUnitPool *pool = setup (2);
+  IdeClangUnit *a = parse (pool, "/a.c", args_a);
+  IdeClangUnit *b = parse (pool, "/b.c", args_a);
+  IdeClangUnit *c = parse (pool, "/c.c", args_a);
+  IdeClangUnit *taken;
+  gpointer a_tu = a->tu;
+
+  ide_clang_unit_pool_release (pool, a);
+  ide_clang_unit_pool_release (pool, b);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 2);
+  g_assert_cmpint (freed->len, ==, 0);
+
+  /* The least recently released spare makes room */
+  ide_clang_unit_pool_release (pool, c);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 2);
+  g_assert_cmpint (freed->len, ==, 1);
+  g_assert (g_ptr_array_index (freed, 0) == a_tu);
+  g_assert (ide_clang_unit_pool_take (pool, "/a.c", args_a) == NULL);
+
+  /* Taking a spare and releasing it again makes it the most recent */
+  taken = ide_clang_unit_pool_take (pool, "/b.c", args_a);
+  g_assert (taken == b);
+  ide_clang_unit_pool_release (pool, taken);
+
+  a = parse (pool, "/a.c", args_a);
+  ide_clang_unit_pool_release (pool, a);
+  g_assert_cmpint (freed->len, ==, 2);
+  g_assert (ide_clang_unit_pool_take (pool, "/c.c", args_a) == NULL);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 2);
+
+  teardown (pool);
+  g_assert_cmpint (freed->len, ==, 4);
+}
+
+static void
+test_unit_pool_dispose (void)
+{
+  IdeClangUnitPool *pool = setup (4);
+  IdeClangUnit *spare = parse (pool, "/a.c", args_a);
+  IdeClangUnit *held = parse (pool, "/b.c", args_a);
+
+  ide_clang_unit_pool_release (pool, spare);
+  ide_clang_unit_pool_dispose (pool);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 0);
+  g_assert_cmpint (freed->len, ==, 1);
+
+  /* Units still in use when the service shut down are not kept */
+  ide_clang_unit_pool_release (pool, held);
+  g_assert_cmpint (ide_clang_unit_pool_get_n_spares (pool), ==, 0);
+  g_assert_cmpint (freed->len, ==, 2);
+
+  ide_clang_unit_pool_unref (pool);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/Clang/UnitPool/reuse", test_unit_pool_reuse);
+  g_test_add_func ("/Ide/Clang/UnitPool/superseded", test_unit_pool_superseded);
+  g_test_add_func ("/Ide/Clang/UnitPool/eviction", test_unit_pool_eviction);
+  g_test_add_func ("/Ide/Clang/UnitPool/dispose", test_unit_pool_dispose);
+  return g_test_run ();
+}
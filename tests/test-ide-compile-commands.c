@@ -0,0 +1,165 @@
+/* test-ide-compile-commands.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <unistd.h>
+
+static const gchar *database =
+  "[\n"
+  "  {\n"
+  "    \"directory\": \"/build\",\n"
+  "    \"command\": \"cc -I../src -Iinclude -isystem /usr/include/foo '-DFOO=\\\"bar baz\\\"' -Wall -std=gnu11 -MD -MF foo.d -o foo.o -c ../src/foo.c\",\n"
+  "    \"file\": \"../src/foo.c\",\n"
+  "    \"output\": { \"ignored\": [1, 2.5e3, true, null] }\n"
+  "  },\n"
+  "  {\n"
+  "    \"directory\": \"/build/sub\",\n"
+  "    \"arguments\": [\"c++\", \"-I\", \"..\", \"-D\", \"A\\u00e9\", \"-o\", \"bar.o\", \"-c\", \"bar.cc\"],\n"
+  "    \"file\": \"bar.cc\"\n"
+  "  },\n"
+  "  {\n"
+  "    \"directory\": \"/build\",\n"
+  "    \"command\": \"cc -DSECOND -c ../src/foo.c\",\n"
+  "    \"file\": \"/src/foo.c\"\n"
+  "  }\n"
+  "]\n";
+
+static void
+assert_strv (gchar       **strv,
+             const gchar  *first,
+             ...)
+{
+  const gchar *expected = first;
+  va_list args;
+  guint i;
+
+  va_start (args, first);
+  for (i = 0; expected != NULL; i++, expected = va_arg (args, const gchar *))
+    g_assert_cmpstr (strv [i], ==, expected);
+  va_end (args);
+
+  g_assert (strv [i] == NULL);
+}
+
+static GFile *
+write_database (const gchar *contents)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = NULL;
+  gint fd;
+
+  fd = g_file_open_tmp ("compile_commands-XXXXXX.json", &path, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (fd, !=, -1);
+  close (fd);
+
+  g_file_set_contents (path, contents, -1, &error);
+  g_assert_no_error (error);
+
+  return g_file_new_for_path (path);
+}
+
+static void
+test_compile_commands_basic (void)
+{
+  g_autoptr(IdeCompileCommands) commands = NULL;
+  g_autoptr(GFile) file = NULL;
+  g_autoptr(GFile) source = NULL;
+  g_autoptr(GFile) directory = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = NULL;
+  g_auto(GStrv) flags = NULL;
+  gboolean r;
+
+  file = write_database (database);
+  commands = ide_compile_commands_new (file);
+
+  source = g_file_new_for_path ("/src/foo.c");
+  flags = ide_compile_commands_lookup (commands, source, NULL, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED);
+  g_assert (flags == NULL);
+  g_clear_error (&error);
+
+  r = ide_compile_commands_load (commands, NULL, &error);
+  g_assert_no_error (error);
+  g_assert (r);
+
+  /* Relative paths are resolved and the first entry wins */
+  flags = ide_compile_commands_lookup (commands, source, &directory, &error);
+  g_assert_no_error (error);
+  assert_strv (flags,
+               "-I/src",
+               "-I/build/include",
+               "-isystem", "/usr/include/foo",
+               "-DFOO=\"bar baz\"",
+               "-Wall",
+               "-std=gnu11",
+               NULL);
+  path = g_file_get_path (directory);
+  g_assert_cmpstr (path, ==, "/build");
+  g_clear_pointer (&flags, g_strfreev);
+  g_clear_object (&source);
+
+  source = g_file_new_for_path ("/build/sub/bar.cc");
+  flags = ide_compile_commands_lookup (commands, source, NULL, &error);
+  g_assert_no_error (error);
+  assert_strv (flags, "-I", "/build", "-D", "A\xc3\xa9", NULL);
+  g_clear_pointer (&flags, g_strfreev);
+  g_clear_object (&source);
+
+  source = g_file_new_for_path ("/src/missing.c");
+  flags = ide_compile_commands_lookup (commands, source, NULL, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_assert (flags == NULL);
+  g_clear_error (&error);
+
+  /* Loading again without changes keeps the database */
+  r = ide_compile_commands_load (commands, NULL, &error);
+  g_assert_no_error (error);
+  g_assert (r);
+
+  g_file_delete (file, NULL, NULL);
+}
+
+static void
+test_compile_commands_invalid (void)
+{
+  g_autoptr(IdeCompileCommands) commands = NULL;
+  g_autoptr(GFile) file = NULL;
+  g_autoptr(GError) error = NULL;
+  gboolean r;
+
+  file = write_database ("[ { \"directory\": \"/build\", \"file\": ");
+  commands = ide_compile_commands_new (file);
+
+  r = ide_compile_commands_load (commands, NULL, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert (!r);
+
+  g_file_delete (file, NULL, NULL);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/CompileCommands/basic", test_compile_commands_basic);
+  g_test_add_func ("/Ide/CompileCommands/invalid", test_compile_commands_invalid);
+  return g_test_run ();
+}
@@ -17,92 +17,728 @@
  */
 
 #include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
 
 #include "ctags/ide-ctags-index.h"
 
-static GMainLoop *main_loop;
+/* Offsets within the header of a compiled index, see ide-ctags-index.c */
+#define HEADER_MAGIC          0
+#define HEADER_N_ENTRIES      32
+#define HEADER_N_NODES        36
+#define HEADER_NODES_OFFSET   64
+#define HEADER_EDGES_OFFSET   72
+#define HEADER_STRINGS_OFFSET 88
+#define HEADER_STRINGS_LEN    96
+#define NODE_SIZE             8
+#define EDGE_SIZE             16
+
+void _ide_ctags_index_register_type (GTypeModule *module);
+
+typedef struct { GTypeModule parent_instance; } TestModule;
+typedef struct { GTypeModuleClass parent_class; } TestModuleClass;
+
+static GType test_module_get_type (void);
+
+G_DEFINE_TYPE (TestModule, test_module, G_TYPE_TYPE_MODULE)
+
+static gboolean
+test_module_load (GTypeModule *module)
+{
+  return TRUE;
+}
+
+static void
+test_module_unload (GTypeModule *module)
+{
+}
+
+static void
+test_module_class_init (TestModuleClass *klass)
+{
+  GTypeModuleClass *module_class = G_TYPE_MODULE_CLASS (klass);
+
+  module_class->load = test_module_load;
+  module_class->unload = test_module_unload;
+}
+
+static void
+test_module_init (TestModule *self)
+{
+}
+
+static gchar *tmpdir;
 
 static void
 init_cb (GObject      *object,
          GAsyncResult *result,
          gpointer      user_data)
 {
-  GAsyncInitable *initable = (GAsyncInitable *)object;
-  IdeCtagsIndex *index = (IdeCtagsIndex *)object;
-  const IdeCtagsIndexEntry *entries;
-  gsize n_entries = 0xFFFFFFFF;
+  GMainLoop *main_loop = user_data;
   GError *error = NULL;
   gboolean ret;
-  gsize i;
-
-  g_assert (G_IS_ASYNC_INITABLE (initable));
-  g_assert (G_IS_ASYNC_RESULT (result));
 
-  ret = g_async_initable_init_finish (initable, result, &error);
+  ret = g_async_initable_init_finish (G_ASYNC_INITABLE (object), result, &error);
   g_assert_no_error (error);
   g_assert_true (ret);
-  g_assert (index != NULL);
-  g_assert (IDE_IS_CTAGS_INDEX (index));
 
-  g_assert_cmpint (815, ==, ide_ctags_index_get_size (index));
+  g_main_loop_quit (main_loop);
+}
+
+static IdeCtagsIndex *
+load_index (GFile *file)
+{
+  g_autoptr(GMainLoop) main_loop = g_main_loop_new (NULL, FALSE);
+  IdeCtagsIndex *index;
+
+  index = ide_ctags_index_new (file, NULL, 0);
+  g_async_initable_init_async (G_ASYNC_INITABLE (index),
+                               G_PRIORITY_DEFAULT,
+                               NULL,
+                               init_cb,
+                               main_loop);
+  g_main_loop_run (main_loop);
 
-  entries = ide_ctags_index_lookup (index, "__NOTHING_SHOULD_MATCH_THIS__", &n_entries);
-  g_assert_cmpint (n_entries, ==, 0);
-  g_assert (entries == NULL);
+  return index;
+}
 
-  entries = ide_ctags_index_lookup (index, "IdeBuildResult", &n_entries);
-  g_assert_cmpint (n_entries, ==, 2);
-  g_assert (entries != NULL);
-  for (i = 0; i < 2; i++)
-    g_assert_cmpstr (entries [i].name, ==, "IdeBuildResult");
+/* Copies the test tags file so that tests may modify it */
+static GFile *
+copy_tags (const gchar *name)
+{
+  g_autofree gchar *src_path = NULL;
+  g_autofree gchar *dst_path = NULL;
+  g_autofree gchar *contents = NULL;
+  g_autoptr(GError) error = NULL;
+  gsize len;
 
-  entries = ide_ctags_index_lookup (index, "IdeDiagnosticProvider.functions", &n_entries);
-  g_assert_cmpint (n_entries, ==, 1);
-  g_assert (entries != NULL);
-  g_assert_cmpstr (entries->name, ==, "IdeDiagnosticProvider.functions");
-  g_assert_cmpint (entries->kind, ==, IDE_CTAGS_INDEX_ENTRY_ANCHOR);
+  src_path = g_build_filename (TEST_DATA_DIR, "project1", "tags", NULL);
+  dst_path = g_build_filename (tmpdir, name, NULL);
 
-  entries = ide_ctags_index_lookup_prefix (index, "Ide", &n_entries);
-  g_assert_cmpint (n_entries, ==, 815);
-  g_assert (entries != NULL);
-  for (i = 0; i < 815; i++)
-    g_assert (g_str_has_prefix (entries [i].name, "Ide"));
+  g_file_get_contents (src_path, &contents, &len, &error);
+  g_assert_no_error (error);
+  g_file_set_contents (dst_path, contents, len, &error);
+  g_assert_no_error (error);
 
-  g_main_loop_quit (main_loop);
+  return g_file_new_for_path (dst_path);
+}
+
+static gchar *
+get_compiled_path (GFile       *file,
+                   const gchar *suffix)
+{
+  g_autofree gchar *uri = g_file_get_uri (file);
+  g_autofree gchar *checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+  g_autofree gchar *name = g_strconcat (checksum, suffix, NULL);
+
+  return g_build_filename (g_get_user_cache_dir (),
+                           ide_get_program_name (),
+                           "tags",
+                           "compiled",
+                           name,
+                           NULL);
+}
+
+static GArray *
+get_all_entries (IdeCtagsIndex *index)
+{
+  GArray *all = ide_ctags_index_lookup_prefix (index, "");
+  guint i;
+
+  for (i = 1; i < all->len; i++)
+    g_assert_cmpint (ide_ctags_index_entry_compare (&g_array_index (all, IdeCtagsIndexEntry, i - 1),
+                                                    &g_array_index (all, IdeCtagsIndexEntry, i)), <=, 0);
+
+  return all;
+}
+
+static void
+assert_lookup (IdeCtagsIndex *index,
+               GArray        *all,
+               const gchar   *keyword,
+               gboolean       is_prefix)
+{
+  IdeCtagsIndexIter iter;
+  IdeCtagsIndexEntry entry;
+  gsize len = strlen (keyword);
+  guint expected_begin = G_MAXUINT;
+  guint n_expected = 0;
+  guint n_found = 0;
+  guint i;
+
+  for (i = 0; i < all->len; i++)
+    {
+      const IdeCtagsIndexEntry *e = &g_array_index (all, IdeCtagsIndexEntry, i);
+
+      if (is_prefix ? strncmp (e->name, keyword, len) == 0 : strcmp (e->name, keyword) == 0)
+        {
+          if (expected_begin == G_MAXUINT)
+            expected_begin = i;
+          n_expected++;
+        }
+    }
+
+  if (!ide_ctags_index_lookup_full (index, keyword, is_prefix, &iter))
+    {
+      g_assert_cmpint (n_expected, ==, 0);
+      return;
+    }
+
+  /* Matches are contiguous in the sorted index, so compare them in order */
+  while (ide_ctags_index_iter_next (&iter, &entry))
+    {
+      const IdeCtagsIndexEntry *e;
+
+      g_assert_cmpint (n_found, <, n_expected);
+      e = &g_array_index (all, IdeCtagsIndexEntry, expected_begin + n_found);
+      g_assert_cmpint (ide_ctags_index_entry_compare (e, &entry), ==, 0);
+      n_found++;
+    }
+
+  g_assert_cmpint (n_found, ==, n_expected);
+}
+
+static void
+assert_project1 (IdeCtagsIndex *index)
+{
+  g_autoptr(GArray) entries = NULL;
+  guint i;
+
+  g_assert_cmpint (815, ==, ide_ctags_index_get_size (index));
+
+  entries = ide_ctags_index_lookup (index, "__NOTHING_SHOULD_MATCH_THIS__");
+  g_assert_cmpint (entries->len, ==, 0);
+  g_clear_pointer (&entries, g_array_unref);
+
+  entries = ide_ctags_index_lookup (index, "IdeBuildResult");
+  g_assert_cmpint (entries->len, ==, 2);
+  for (i = 0; i < entries->len; i++)
+    g_assert_cmpstr (g_array_index (entries, IdeCtagsIndexEntry, i).name, ==, "IdeBuildResult");
+  g_clear_pointer (&entries, g_array_unref);
+
+  entries = ide_ctags_index_lookup (index, "IdeDiagnosticProvider.functions");
+  g_assert_cmpint (entries->len, ==, 1);
+  g_assert_cmpstr (g_array_index (entries, IdeCtagsIndexEntry, 0).name, ==, "IdeDiagnosticProvider.functions");
+  g_assert_cmpint (g_array_index (entries, IdeCtagsIndexEntry, 0).kind, ==, IDE_CTAGS_INDEX_ENTRY_ANCHOR);
+  g_clear_pointer (&entries, g_array_unref);
+
+  entries = ide_ctags_index_lookup_prefix (index, "Ide");
+  g_assert_cmpint (entries->len, ==, 815);
+  for (i = 0; i < entries->len; i++)
+    g_assert (g_str_has_prefix (g_array_index (entries, IdeCtagsIndexEntry, i).name, "Ide"));
 }
 
 static void
 test_ctags_basic (void)
 {
+  g_autoptr(GFile) file = copy_tags ("basic.tags");
+  g_autofree gchar *compiled_path = get_compiled_path (file, ".idx");
   IdeCtagsIndex *index;
-  GFile *test_file;
-  gchar *path;
 
-  main_loop = g_main_loop_new (NULL, FALSE);
+  index = load_index (file);
+  assert_project1 (index);
+  g_assert (g_file_test (compiled_path, G_FILE_TEST_IS_REGULAR));
+  g_object_unref (index);
+}
 
-  path = g_build_filename (TEST_DATA_DIR, "project1", "tags", NULL);
-  test_file = g_file_new_for_path (path);
+static void
+test_ctags_compiled (void)
+{
+  static const gchar line[] = "zzz\tzzz.c\t/^zzz$/;\"\tf\n";
+  g_autoptr(GFile) file = copy_tags ("compiled.tags");
+  g_autofree gchar *compiled_path = get_compiled_path (file, ".idx");
+  g_autofree gchar *first = NULL;
+  g_autofree gchar *second = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GFileOutputStream) stream = NULL;
+  IdeCtagsIndex *index;
+  gsize first_len;
+  gsize second_len;
 
-  index = ide_ctags_index_new (test_file);
+  index = load_index (file);
+  g_object_unref (index);
 
-  g_async_initable_init_async (G_ASYNC_INITABLE (index),
-                               G_PRIORITY_DEFAULT,
-                               NULL,
-                               init_cb,
-                               NULL);
+  g_file_get_contents (compiled_path, &first, &first_len, &error);
+  g_assert_no_error (error);
 
-  g_main_loop_run (main_loop);
+  /* An up to date compiled index is mapped as is */
+  index = load_index (file);
+  assert_project1 (index);
+  g_object_unref (index);
+
+  g_file_get_contents (compiled_path, &second, &second_len, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (first_len, ==, second_len);
+  g_assert (memcmp (first, second, first_len) == 0);
+  g_clear_pointer (&second, g_free);
+
+  /* A changed tags file is compiled again */
+  stream = g_file_append_to (file, G_FILE_CREATE_NONE, NULL, &error);
+  g_assert_no_error (error);
+  g_output_stream_write_all (G_OUTPUT_STREAM (stream), line, strlen (line), NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error);
+  g_assert_no_error (error);
 
+  index = load_index (file);
+  g_assert_cmpint (ide_ctags_index_get_size (index), ==, 816);
   g_object_unref (index);
-  g_free (path);
-  g_object_unref (test_file);
+
+  g_file_get_contents (compiled_path, &second, &second_len, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (first_len, !=, second_len);
+}
+
+static void
+test_ctags_prefix (void)
+{
+  static const gchar *keywords[] = {
+    "", "I", "Id", "Ide", "IdeB", "IdeBu", "IdeBuild", "IdeBuildResult",
+    "IdeBuildResultX", "IdeZ", "Idf", "J", "a", "\xff",
+  };
+  g_autoptr(GFile) file = copy_tags ("prefix.tags");
+  g_autoptr(GArray) all = NULL;
+  IdeCtagsIndex *index;
+  guint i;
+
+  index = load_index (file);
+  all = get_all_entries (index);
+  g_assert_cmpint (all->len, ==, 815);
+
+  for (i = 0; i < G_N_ELEMENTS (keywords); i++)
+    {
+      assert_lookup (index, all, keywords [i], TRUE);
+      assert_lookup (index, all, keywords [i], FALSE);
+    }
+
+  /* Every prefix of every name, which walks each level of the trie */
+  for (i = 0; i < all->len; i++)
+    {
+      const gchar *name = g_array_index (all, IdeCtagsIndexEntry, i).name;
+      gsize len = strlen (name);
+      gsize j;
+
+      assert_lookup (index, all, name, FALSE);
+
+      for (j = 0; j <= len; j++)
+        {
+          g_autofree gchar *prefix = g_strndup (name, j);
+          assert_lookup (index, all, prefix, TRUE);
+        }
+    }
+
+  g_object_unref (index);
+}
+
+static guint32
+read_u32 (const gchar *data,
+          gsize        offset)
+{
+  guint32 value;
+  memcpy (&value, data + offset, sizeof value);
+  return value;
+}
+
+static guint64
+read_u64 (const gchar *data,
+          gsize        offset)
+{
+  guint64 value;
+  memcpy (&value, data + offset, sizeof value);
+  return value;
+}
+
+static void
+write_u32 (gchar   *data,
+           gsize    offset,
+           guint32  value)
+{
+  memcpy (data + offset, &value, sizeof value);
+}
+
+typedef void (*CorruptFunc) (gchar *data, gsize *len);
+
+static void
+corrupt_truncate (gchar *data,
+                  gsize *len)
+{
+  *len = *len / 2;
+}
+
+static void
+corrupt_magic (gchar *data,
+               gsize *len)
+{
+  write_u32 (data, HEADER_MAGIC, 0x12345678);
+}
+
+static void
+corrupt_edge_range (gchar *data,
+                    gsize *len)
+{
+  guint64 edges_offset = read_u64 (data, HEADER_EDGES_OFFSET);
+  guint32 n_entries = read_u32 (data, HEADER_N_ENTRIES);
+
+  /* The end of the first edge of the root */
+  write_u32 (data, edges_offset + 4, n_entries + 1);
+}
+
+static void
+corrupt_edge_cycle (gchar *data,
+                    gsize *len)
+{
+  guint64 nodes_offset = read_u64 (data, HEADER_NODES_OFFSET);
+  guint64 edges_offset = read_u64 (data, HEADER_EDGES_OFFSET);
+  guint32 n_nodes = read_u32 (data, HEADER_N_NODES);
+  guint32 i;
+
+  /* Point the first edge with a child of any non-root node back at itself */
+  for (i = 1; i < n_nodes; i++)
+    {
+      guint32 first_edge = read_u32 (data, nodes_offset + i * NODE_SIZE);
+      guint32 n_edges = read_u32 (data, nodes_offset + i * NODE_SIZE + 4);
+      guint32 j;
+
+      for (j = 0; j < n_edges; j++)
+        {
+          gsize child_offset = edges_offset + (first_edge + j) * EDGE_SIZE + 8;
+
+          if (read_u32 (data, child_offset) != 0)
+            {
+              write_u32 (data, child_offset, i);
+              return;
+            }
+        }
+    }
+
+  g_assert_not_reached ();
+}
+
+static void
+corrupt_strings (gchar *data,
+                 gsize *len)
+{
+  guint64 strings_offset = read_u64 (data, HEADER_STRINGS_OFFSET);
+  guint64 strings_len = read_u64 (data, HEADER_STRINGS_LEN);
+
+  data [strings_offset + strings_len - 1] = 'x';
+}
+
+static void
+test_ctags_corrupt (void)
+{
+  static const CorruptFunc corrupt[] = {
+    corrupt_truncate,
+    corrupt_magic,
+    corrupt_edge_range,
+    corrupt_edge_cycle,
+    corrupt_strings,
+  };
+  g_autoptr(GFile) file = copy_tags ("corrupt.tags");
+  g_autofree gchar *compiled_path = get_compiled_path (file, ".idx");
+  g_autofree gchar *valid = NULL;
+  g_autoptr(GError) error = NULL;
+  IdeCtagsIndex *index;
+  gsize valid_len;
+  guint i;
+
+  index = load_index (file);
+  g_object_unref (index);
+
+  g_file_get_contents (compiled_path, &valid, &valid_len, &error);
+  g_assert_no_error (error);
+
+  for (i = 0; i < G_N_ELEMENTS (corrupt); i++)
+    {
+      g_autofree gchar *data = g_memdup (valid, valid_len);
+      g_autofree gchar *contents = NULL;
+      gsize len = valid_len;
+      gsize contents_len;
+
+      corrupt [i] (data, &len);
+      g_file_set_contents (compiled_path, data, len, &error);
+      g_assert_no_error (error);
+
+      /* The corrupt index is rejected and compiled again from the tags file */
+      index = load_index (file);
+      assert_project1 (index);
+      g_object_unref (index);
+
+      g_file_get_contents (compiled_path, &contents, &contents_len, &error);
+      g_assert_no_error (error);
+      g_assert_cmpint (contents_len, ==, valid_len);
+      g_assert (contents_len != len || memcmp (contents, data, len) != 0);
+    }
+}
+
+static IdeCtagsIndex *
+apply_delta (IdeCtagsIndex *index,
+             const gchar   *path,
+             const gchar   *name)
+{
+  g_autofree gchar *contents = NULL;
+  g_autoptr(GBytes) delta = NULL;
+  g_autoptr(GError) error = NULL;
+  const gchar *paths[] = { path, NULL };
+  IdeCtagsIndex *ret;
+
+  contents = g_strdup_printf ("%s\t%s\t/^%s$/;\"\tf\n", name, path, name);
+  delta = g_bytes_new_take (contents, strlen (contents));
+  contents = NULL;
+
+  ret = ide_ctags_index_new_with_delta (index, delta, paths, &error);
+  g_assert_no_error (error);
+  g_assert (IDE_IS_CTAGS_INDEX (ret));
+
+  return ret;
+}
+
+static guint
+count_path (IdeCtagsIndex *index,
+            const gchar   *path)
+{
+  g_autoptr(GArray) entries = ide_ctags_index_find_with_path (index, path);
+
+  return entries->len;
+}
+
+static guint
+count_name (IdeCtagsIndex *index,
+            const gchar   *name)
+{
+  g_autoptr(GArray) entries = ide_ctags_index_lookup (index, name);
+
+  return entries->len;
+}
+
+static void
+assert_same_entries (IdeCtagsIndex *a,
+                     IdeCtagsIndex *b)
+{
+  g_autoptr(GArray) all_a = get_all_entries (a);
+  g_autoptr(GArray) all_b = get_all_entries (b);
+  guint i;
+
+  g_assert_cmpint (all_a->len, ==, all_b->len);
+
+  for (i = 0; i < all_a->len; i++)
+    g_assert_cmpint (ide_ctags_index_entry_compare (&g_array_index (all_a, IdeCtagsIndexEntry, i),
+                                                    &g_array_index (all_b, IdeCtagsIndexEntry, i)), ==, 0);
+}
+
+static void
+test_ctags_delta (void)
+{
+  static const gchar *path1 = "libide/ide-types.h";
+  static const gchar *path2 = "data/keybindings/vim.css";
+  g_autoptr(GFile) file = copy_tags ("delta.tags");
+  g_autoptr(GArray) all = NULL;
+  IdeCtagsIndex *index;
+  IdeCtagsIndex *delta1;
+  IdeCtagsIndex *delta2;
+  IdeCtagsIndex *delta3;
+  guint n_path1;
+  guint n_path2;
+
+  index = load_index (file);
+  n_path1 = count_path (index, path1);
+  n_path2 = count_path (index, path2);
+  g_assert_cmpint (n_path1, >, 0);
+  g_assert_cmpint (n_path2, >, 0);
+  g_assert_cmpint (ide_ctags_index_get_n_deltas (index), ==, 0);
+
+  /* The entries of the re-tagged file are shadowed by the delta */
+  delta1 = apply_delta (index, path1, "IdeDeltaOne");
+  g_assert_cmpint (ide_ctags_index_get_n_deltas (delta1), ==, 1);
+  g_assert_cmpint (count_name (delta1, "IdeDeltaOne"), ==, 1);
+  g_assert_cmpint (count_path (delta1, path1), ==, 1);
+  g_assert_cmpint (count_path (delta1, path2), ==, n_path2);
+  all = get_all_entries (delta1);
+  g_assert_cmpint (all->len, ==, 815 - n_path1 + 1);
+  g_clear_pointer (&all, g_array_unref);
+
+  /* The base is left untouched */
+  g_assert_cmpint (count_name (index, "IdeDeltaOne"), ==, 0);
+  g_assert_cmpint (count_path (index, path1), ==, n_path1);
+
+  /* Previous deltas for other files are kept */
+  delta2 = apply_delta (delta1, path2, "IdeDeltaTwo");
+  g_assert_cmpint (ide_ctags_index_get_n_deltas (delta2), ==, 2);
+  g_assert_cmpint (count_name (delta2, "IdeDeltaOne"), ==, 1);
+  g_assert_cmpint (count_name (delta2, "IdeDeltaTwo"), ==, 1);
+  all = get_all_entries (delta2);
+  g_assert_cmpint (all->len, ==, 815 - n_path1 - n_path2 + 2);
+  g_clear_pointer (&all, g_array_unref);
+
+  /* Re-tagging a file again replaces its previous delta */
+  delta3 = apply_delta (delta2, path1, "IdeDeltaThree");
+  g_assert_cmpint (ide_ctags_index_get_n_deltas (delta3), ==, 3);
+  g_assert_cmpint (count_name (delta3, "IdeDeltaOne"), ==, 0);
+  g_assert_cmpint (count_name (delta3, "IdeDeltaTwo"), ==, 1);
+  g_assert_cmpint (count_name (delta3, "IdeDeltaThree"), ==, 1);
+  g_assert_cmpint (count_path (delta3, path1), ==, 1);
+  g_assert_cmpint (count_path (delta3, path2), ==, 1);
+
+  /* Prefix lookups merge the base and the overlay in order */
+  all = get_all_entries (delta3);
+  assert_lookup (delta3, all, "IdeDelta", TRUE);
+  assert_lookup (delta3, all, "IdeDeltaT", TRUE);
+  assert_lookup (delta3, all, "IdeDeltaTwo", FALSE);
+  assert_lookup (delta3, all, "Ide", TRUE);
+
+  g_object_unref (delta3);
+  g_object_unref (delta2);
+  g_object_unref (delta1);
+  g_object_unref (index);
+}
+
+static void
+test_ctags_delta_persist (void)
+{
+  static const gchar line[] = "zzz\tzzz.c\t/^zzz$/;\"\tf\n";
+  g_autoptr(GFile) file = copy_tags ("persist.tags");
+  g_autofree gchar *delta_path = get_compiled_path (file, ".delta");
+  g_autoptr(GFileOutputStream) stream = NULL;
+  g_autoptr(GError) error = NULL;
+  IdeCtagsIndex *index;
+  IdeCtagsIndex *delta1;
+  IdeCtagsIndex *delta2;
+
+  index = load_index (file);
+  delta1 = apply_delta (index, "libide/ide-types.h", "IdeDeltaOne");
+  delta2 = apply_delta (delta1, "data/keybindings/vim.css", "IdeDeltaTwo");
+  g_assert (g_file_test (delta_path, G_FILE_TEST_IS_REGULAR));
+  g_object_unref (delta1);
+  g_object_unref (index);
+
+  /* Loading the tags file again applies the persisted delta */
+  index = load_index (file);
+  g_assert_cmpint (ide_ctags_index_get_n_deltas (index), ==, 2);
+  g_assert_cmpint (count_name (index, "IdeDeltaOne"), ==, 1);
+  g_assert_cmpint (count_name (index, "IdeDeltaTwo"), ==, 1);
+  assert_same_entries (index, delta2);
+  g_object_unref (index);
+  g_object_unref (delta2);
+
+  /* But not once the tags file changed */
+  stream = g_file_append_to (file, G_FILE_CREATE_NONE, NULL, &error);
+  g_assert_no_error (error);
+  g_output_stream_write_all (G_OUTPUT_STREAM (stream), line, strlen (line), NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error);
+  g_assert_no_error (error);
+
+  index = load_index (file);
+  g_assert_cmpint (ide_ctags_index_get_n_deltas (index), ==, 0);
+  g_assert_cmpint (count_name (index, "IdeDeltaOne"), ==, 0);
+  g_assert_cmpint (ide_ctags_index_get_size (index), ==, 816);
+  g_assert (!g_file_test (delta_path, G_FILE_TEST_EXISTS));
+  g_object_unref (index);
+}
+
+static void
+test_ctags_compact (void)
+{
+  g_autoptr(GFile) file = copy_tags ("compact.tags");
+  g_autofree gchar *delta_path = get_compiled_path (file, ".delta");
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GArray) all = NULL;
+  IdeCtagsIndex *index;
+  IdeCtagsIndex *delta1;
+  IdeCtagsIndex *delta2;
+  IdeCtagsIndex *compacted;
+  IdeCtagsIndex *stale;
+
+  index = load_index (file);
+  delta1 = apply_delta (index, "libide/ide-types.h", "IdeDeltaOne");
+  delta2 = apply_delta (delta1, "data/keybindings/vim.css", "IdeDeltaTwo");
+
+  compacted = ide_ctags_index_compact (delta2, &error);
+  g_assert_no_error (error);
+  g_assert (IDE_IS_CTAGS_INDEX (compacted));
+  g_assert_cmpint (ide_ctags_index_get_n_deltas (compacted), ==, 0);
+  g_assert (!g_file_test (delta_path, G_FILE_TEST_EXISTS));
+
+  /* Nothing is shadowed anymore, so every entry is a real one */
+  all = get_all_entries (compacted);
+  g_assert_cmpint (all->len, ==, ide_ctags_index_get_size (compacted));
+  assert_lookup (compacted, all, "IdeDelta", TRUE);
+  assert_same_entries (compacted, delta2);
+
+  /* Deltas against the previous compiled index are never applied to it */
+  stale = apply_delta (delta1, "libide/ide-types.h", "IdeDeltaStale");
+  g_assert (g_file_test (delta_path, G_FILE_TEST_IS_REGULAR));
+  g_object_unref (stale);
+
+  /* The merged entries are loaded from the compiled index from now on */
+  g_object_unref (index);
+  index = load_index (file);
+  g_assert_cmpint (ide_ctags_index_get_n_deltas (index), ==, 0);
+  g_assert_cmpint (count_name (index, "IdeDeltaStale"), ==, 0);
+  g_assert (!g_file_test (delta_path, G_FILE_TEST_EXISTS));
+  assert_same_entries (index, compacted);
+
+  g_object_unref (index);
+  g_object_unref (compacted);
+  g_object_unref (delta2);
+  g_object_unref (delta1);
+}
+
+static void
+remove_recursive (const gchar *path)
+{
+  GDir *dir;
+
+  if ((dir = g_dir_open (path, 0, NULL)))
+    {
+      const gchar *name;
+
+      while ((name = g_dir_read_name (dir)))
+        {
+          g_autofree gchar *child = g_build_filename (path, name, NULL);
+          remove_recursive (child);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_remove (path);
 }
 
 gint
 main (gint   argc,
       gchar *argv[])
 {
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *cache_dir = NULL;
+  GTypeModule *module;
+  gint ret;
+
+  tmpdir = g_dir_make_tmp ("test-ide-ctags-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  /* Keep compiled indexes out of the real cache directory */
+  cache_dir = g_build_filename (tmpdir, "cache", NULL);
+  g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
   g_test_init (&argc, &argv, NULL);
+
+  module = g_object_new (test_module_get_type (), NULL);
+  g_type_module_use (module);
+  _ide_ctags_index_register_type (module);
+
   g_test_add_func ("/Ide/CTags/basic", test_ctags_basic);
-  return g_test_run ();
+  g_test_add_func ("/Ide/CTags/compiled", test_ctags_compiled);
+  g_test_add_func ("/Ide/CTags/prefix", test_ctags_prefix);
+  g_test_add_func ("/Ide/CTags/corrupt", test_ctags_corrupt);
+  g_test_add_func ("/Ide/CTags/delta", test_ctags_delta);
+  g_test_add_func ("/Ide/CTags/delta/persist", test_ctags_delta_persist);
+  g_test_add_func ("/Ide/CTags/compact", test_ctags_compact);
+
+  ret = g_test_run ();
+
+  remove_recursive (tmpdir);
+  g_free (tmpdir);
+
+  return ret;
 }
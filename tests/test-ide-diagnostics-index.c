@@ -0,0 +1,160 @@
+/* test-ide-diagnostics-index.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+
+#include "diagnostics/ide-diagnostics-index.h"
+
+#define N_LINES 500
+
+/* The index never dereferences the diagnostics, so fake them */
+#define FAKE_DIAGNOSTIC(n) ((IdeDiagnostic *)GUINT_TO_POINTER ((n) + 1))
+
+typedef struct
+{
+  guint begin_line;
+  guint end_line;
+  guint severity;
+} Model;
+
+static void
+test_diagnostics_index_severities (void)
+{
+  IdeDiagnosticsIndex *index;
+  Model model [300];
+  guint8 severities [N_LINES];
+  GRand *rand;
+  guint i;
+  guint j;
+
+  rand = g_rand_new_with_seed (4321);
+  index = ide_diagnostics_index_new ();
+
+  for (i = 0; i < G_N_ELEMENTS (model); i++)
+    {
+      model [i].begin_line = g_rand_int_range (rand, 0, N_LINES);
+      model [i].end_line = MIN (N_LINES - 1, model [i].begin_line + g_rand_int_range (rand, 0, 5));
+      model [i].severity = g_rand_int_range (rand, IDE_DIAGNOSTIC_NOTE, IDE_DIAGNOSTIC_FATAL + 1);
+
+      ide_diagnostics_index_add (index,
+                                 model [i].begin_line, 0,
+                                 model [i].end_line, 0,
+                                 model [i].severity,
+                                 FAKE_DIAGNOSTIC (i));
+    }
+
+  g_assert_cmpint (ide_diagnostics_index_get_size (index), ==, G_N_ELEMENTS (model));
+
+  ide_diagnostics_index_get_severities (index, 0, N_LINES - 1, severities);
+
+  for (i = 0; i < N_LINES; i++)
+    {
+      guint expected = IDE_DIAGNOSTIC_IGNORED;
+
+      for (j = 0; j < G_N_ELEMENTS (model); j++)
+        {
+          if (model [j].begin_line <= i && model [j].end_line >= i)
+            expected = MAX (expected, model [j].severity);
+        }
+
+      g_assert_cmpint (ide_diagnostics_index_get_severity (index, i), ==, expected);
+      g_assert_cmpint (severities [i], ==, expected);
+    }
+
+  ide_diagnostics_index_clear (index);
+  g_assert_cmpint (ide_diagnostics_index_get_size (index), ==, 0);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 10), ==, IDE_DIAGNOSTIC_IGNORED);
+
+  ide_diagnostics_index_free (index);
+  g_rand_free (rand);
+}
+
+static void
+test_diagnostics_index_nearest (void)
+{
+  IdeDiagnosticsIndex *index;
+
+  index = ide_diagnostics_index_new ();
+
+  ide_diagnostics_index_add (index, 3, 4, 3, 4, IDE_DIAGNOSTIC_WARNING, FAKE_DIAGNOSTIC (0));
+  ide_diagnostics_index_add (index, 3, 20, 3, 25, IDE_DIAGNOSTIC_ERROR, FAKE_DIAGNOSTIC (1));
+  ide_diagnostics_index_add (index, 1, 0, 5, 2, IDE_DIAGNOSTIC_NOTE, FAKE_DIAGNOSTIC (2));
+
+  /* The multi-line range covers the whole of line 3 */
+  g_assert (ide_diagnostics_index_get_nearest (index, 3, 10) == FAKE_DIAGNOSTIC (2));
+  g_assert (ide_diagnostics_index_get_nearest (index, 4, 10) == FAKE_DIAGNOSTIC (2));
+  g_assert (ide_diagnostics_index_get_nearest (index, 6, 0) == NULL);
+
+  ide_diagnostics_index_clear (index);
+
+  ide_diagnostics_index_add (index, 3, 4, 3, 4, IDE_DIAGNOSTIC_WARNING, FAKE_DIAGNOSTIC (0));
+  ide_diagnostics_index_add (index, 3, 20, 3, 25, IDE_DIAGNOSTIC_ERROR, FAKE_DIAGNOSTIC (1));
+
+  g_assert (ide_diagnostics_index_get_nearest (index, 3, 0) == FAKE_DIAGNOSTIC (0));
+  g_assert (ide_diagnostics_index_get_nearest (index, 3, 10) == FAKE_DIAGNOSTIC (0));
+  g_assert (ide_diagnostics_index_get_nearest (index, 3, 15) == FAKE_DIAGNOSTIC (1));
+  g_assert (ide_diagnostics_index_get_nearest (index, 3, 22) == FAKE_DIAGNOSTIC (1));
+  g_assert (ide_diagnostics_index_get_nearest (index, 2, 4) == NULL);
+
+  ide_diagnostics_index_free (index);
+}
+
+static void
+test_diagnostics_index_shift (void)
+{
+  IdeDiagnosticsIndex *index;
+
+  index = ide_diagnostics_index_new ();
+
+  ide_diagnostics_index_add (index, 2, 0, 2, 0, IDE_DIAGNOSTIC_WARNING, FAKE_DIAGNOSTIC (0));
+  ide_diagnostics_index_add (index, 10, 0, 12, 0, IDE_DIAGNOSTIC_ERROR, FAKE_DIAGNOSTIC (1));
+
+  /* Insert three lines before line 10 */
+  ide_diagnostics_index_insert_lines (index, 5, 3);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 2), ==, IDE_DIAGNOSTIC_WARNING);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 10), ==, IDE_DIAGNOSTIC_IGNORED);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 13), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 15), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 16), ==, IDE_DIAGNOSTIC_IGNORED);
+
+  /* Inserting within a range grows it */
+  ide_diagnostics_index_insert_lines (index, 14, 2);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 17), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 18), ==, IDE_DIAGNOSTIC_IGNORED);
+
+  /* Join lines 1 through 4 into line 0, collapsing the warning onto line 0 */
+  ide_diagnostics_index_remove_lines (index, 0, 4);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 0), ==, IDE_DIAGNOSTIC_WARNING);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 2), ==, IDE_DIAGNOSTIC_IGNORED);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 9), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 13), ==, IDE_DIAGNOSTIC_ERROR);
+  g_assert_cmpint (ide_diagnostics_index_get_severity (index, 14), ==, IDE_DIAGNOSTIC_IGNORED);
+
+  ide_diagnostics_index_free (index);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/DiagnosticsIndex/severities", test_diagnostics_index_severities);
+  g_test_add_func ("/Ide/DiagnosticsIndex/nearest", test_diagnostics_index_nearest);
+  g_test_add_func ("/Ide/DiagnosticsIndex/shift", test_diagnostics_index_shift);
+  return g_test_run ();
+}
@@ -0,0 +1,529 @@
+/* test-ide-diagnostics-manager.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include <ide.h>
+#include <libpeas/peas.h>
+
+#include "application/ide-application-tests.h"
+#include "ide-internal.h"
+
+/* Must match ide-diagnostics-manager.c */
+#define MAX_IN_FLIGHT_PER_PROVIDER 2
+
+#define WAIT_TIMEOUT_SECONDS 10
+
+/*
+ * A diagnostic provider whose diagnoses only complete when the test says
+ * so. It is registered by test-diagnostics.plugin for "ini" files, which
+ * no other diagnostic provider handles.
+ */
+#define TEST_TYPE_DIAGNOSTIC_PROVIDER (test_diagnostic_provider_get_type())
+
+G_DECLARE_FINAL_TYPE (TestDiagnosticProvider, test_diagnostic_provider, TEST, DIAGNOSTIC_PROVIDER, IdeObject)
+
+struct _TestDiagnosticProvider
+{
+  IdeObject parent_instance;
+};
+
+static void diagnostic_provider_iface_init (IdeDiagnosticProviderInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestDiagnosticProvider, test_diagnostic_provider, IDE_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (IDE_TYPE_DIAGNOSTIC_PROVIDER,
+                                                diagnostic_provider_iface_init))
+
+/* Every diagnosis in the order it was started, and those not completed */
+static GPtrArray *started;
+static GPtrArray *running;
+static guint      max_running;
+
+static void
+test_diagnostic_provider_diagnose_async (IdeDiagnosticProvider *provider,
+                                         IdeFile               *file,
+                                         GCancellable          *cancellable,
+                                         GAsyncReadyCallback    callback,
+                                         gpointer               user_data)
+{
+  GTask *task;
+
+  task = g_task_new (provider, cancellable, callback, user_data);
+  g_task_set_task_data (task, g_object_ref (ide_file_get_file (file)), g_object_unref);
+
+  g_ptr_array_add (started, g_object_ref (task));
+  g_ptr_array_add (running, task);
+
+  max_running = MAX (max_running, running->len);
+}
+
+static IdeDiagnostics *
+test_diagnostic_provider_diagnose_finish (IdeDiagnosticProvider  *provider,
+                                          GAsyncResult           *result,
+                                          GError                **error)
+{
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+diagnostic_provider_iface_init (IdeDiagnosticProviderInterface *iface)
+{
+  iface->diagnose_async = test_diagnostic_provider_diagnose_async;
+  iface->diagnose_finish = test_diagnostic_provider_diagnose_finish;
+}
+
+static void
+test_diagnostic_provider_class_init (TestDiagnosticProviderClass *klass)
+{
+}
+
+static void
+test_diagnostic_provider_init (TestDiagnosticProvider *self)
+{
+}
+
+void test_diagnostics_register_types (PeasObjectModule *module);
+
+G_MODULE_EXPORT void
+test_diagnostics_register_types (PeasObjectModule *module)
+{
+  peas_object_module_register_extension_type (module,
+                                              IDE_TYPE_DIAGNOSTIC_PROVIDER,
+                                              TEST_TYPE_DIAGNOSTIC_PROVIDER);
+}
+
+static void
+load_test_plugin (void)
+{
+  PeasEngine *engine = peas_engine_get_default ();
+  PeasPluginInfo *plugin_info;
+
+  peas_engine_prepend_search_path (engine, TEST_DATA_DIR"/plugins", NULL);
+  peas_engine_rescan_plugins (engine);
+
+  plugin_info = peas_engine_get_plugin_info (engine, "test-diagnostics");
+  g_assert (plugin_info != NULL);
+
+  if (!peas_plugin_info_is_loaded (plugin_info))
+    g_assert (peas_engine_load_plugin (engine, plugin_info));
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+  gboolean *timed_out = user_data;
+
+  *timed_out = TRUE;
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs the main loop until @n_started diagnoses were started */
+static void
+wait_for_started (guint n_started)
+{
+  gboolean timed_out = FALSE;
+  guint source;
+
+  source = g_timeout_add_seconds (WAIT_TIMEOUT_SECONDS, timeout_cb, &timed_out);
+
+  while (started->len < n_started)
+    {
+      gtk_main_iteration ();
+
+      if (timed_out)
+        g_error ("Timed out waiting for %u diagnoses, got %u", n_started, started->len);
+    }
+
+  g_source_remove (source);
+}
+
+/* Gives the manager a chance to (wrongly) start more diagnoses */
+static void
+settle (void)
+{
+  gboolean timed_out = FALSE;
+
+  g_timeout_add (100, timeout_cb, &timed_out);
+
+  while (!timed_out)
+    gtk_main_iteration ();
+}
+
+static GFile *
+get_started_file (guint index)
+{
+  return g_task_get_task_data (g_ptr_array_index (started, index));
+}
+
+static gboolean
+was_started (IdeBuffer *buffer)
+{
+  GFile *file = ide_file_get_file (ide_buffer_get_file (buffer));
+  guint i;
+
+  for (i = 0; i < started->len; i++)
+    {
+      if (g_file_equal (get_started_file (i), file))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static GTask *
+find_running (IdeBuffer *buffer)
+{
+  GFile *file = ide_file_get_file (ide_buffer_get_file (buffer));
+  guint i;
+
+  for (i = 0; i < running->len; i++)
+    {
+      GTask *task = g_ptr_array_index (running, i);
+
+      if (g_file_equal (g_task_get_task_data (task), file))
+        return task;
+    }
+
+  return NULL;
+}
+
+/* Completes @task like a provider would, cancelled or not */
+static void
+complete (GTask *task)
+{
+  g_object_ref (task);
+  g_assert (g_ptr_array_remove (running, task));
+
+  if (g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Operation was cancelled");
+  else
+    g_task_return_pointer (task, ide_diagnostics_new (NULL), (GDestroyNotify)ide_diagnostics_unref);
+
+  g_object_unref (task);
+}
+
+static void
+load_file_cb (GObject      *object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  IdeBuffer **buffer = user_data;
+  GError *error = NULL;
+
+  *buffer = ide_buffer_manager_load_file_finish (IDE_BUFFER_MANAGER (object), result, &error);
+  g_assert_no_error (error);
+  g_assert (IDE_IS_BUFFER (*buffer));
+}
+
+/*
+ * Loads @n_buffers ini files one after another, each of which queues a
+ * diagnosis with the test provider.
+ */
+static GPtrArray *
+load_buffers (IdeContext  *context,
+              const gchar *tmpdir,
+              guint        n_buffers)
+{
+  IdeBufferManager *buffer_manager = ide_context_get_buffer_manager (context);
+  IdeProject *project = ide_context_get_project (context);
+  GPtrArray *buffers = g_ptr_array_new_with_free_func (g_object_unref);
+  guint i;
+
+  for (i = 0; i < n_buffers; i++)
+    {
+      g_autofree gchar *name = g_strdup_printf ("%u.ini", i);
+      g_autofree gchar *path = g_build_filename (tmpdir, name, NULL);
+      g_autoptr(IdeFile) file = NULL;
+      IdeBuffer *buffer = NULL;
+      GError *error = NULL;
+
+      g_file_set_contents (path, "[Group]\nKey=Value\n", -1, &error);
+      g_assert_no_error (error);
+
+      file = ide_project_get_file_for_path (project, path);
+
+      ide_buffer_manager_load_file_async (buffer_manager,
+                                          file,
+                                          FALSE,
+                                          IDE_WORKBENCH_OPEN_FLAGS_NONE,
+                                          NULL,
+                                          NULL,
+                                          load_file_cb,
+                                          &buffer);
+
+      while (buffer == NULL)
+        gtk_main_iteration ();
+
+      g_ptr_array_add (buffers, buffer);
+    }
+
+  return buffers;
+}
+
+static void
+remove_files (const gchar *tmpdir,
+              GPtrArray   *buffers)
+{
+  guint i;
+
+  for (i = 0; i < buffers->len; i++)
+    {
+      IdeBuffer *buffer = g_ptr_array_index (buffers, i);
+
+      g_unlink (ide_file_get_path (ide_buffer_get_file (buffer)));
+    }
+
+  g_rmdir (tmpdir);
+}
+
+static void
+reset (void)
+{
+  g_ptr_array_set_size (started, 0);
+  g_ptr_array_set_size (running, 0);
+  max_running = 0;
+}
+
+static void
+test_priority_cb (GObject      *object,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(IdeContext) context = NULL;
+  g_autoptr(GPtrArray) buffers = NULL;
+  g_autoptr(GPtrArray) pending = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  IdeBufferManager *buffer_manager;
+  IdeBuffer *focus;
+  IdeBuffer *visible;
+  IdeBuffer *open;
+  GError *error = NULL;
+  guint i;
+
+  context = ide_context_new_finish (result, &error);
+  g_assert_no_error (error);
+  g_assert (IDE_IS_CONTEXT (context));
+
+  buffer_manager = ide_context_get_buffer_manager (context);
+
+  tmpdir = g_dir_make_tmp ("test-diagnostics-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  reset ();
+
+  /* Only as many diagnoses as the provider type allows are started */
+  buffers = load_buffers (context, tmpdir, 5);
+  wait_for_started (MAX_IN_FLIGHT_PER_PROVIDER);
+  settle ();
+
+  g_assert_cmpint (started->len, ==, MAX_IN_FLIGHT_PER_PROVIDER);
+  g_assert_cmpint (running->len, ==, MAX_IN_FLIGHT_PER_PROVIDER);
+
+  pending = g_ptr_array_new ();
+  for (i = 0; i < buffers->len; i++)
+    {
+      if (!was_started (g_ptr_array_index (buffers, i)))
+        g_ptr_array_add (pending, g_ptr_array_index (buffers, i));
+    }
+  g_assert_cmpint (pending->len, ==, 3);
+
+  /*
+   * Priorities are looked up when a slot frees up, so they apply to jobs
+   * which are already queued. Pick them against the order the jobs were
+   * queued in so that FIFO order would fail.
+   */
+  open = g_ptr_array_index (pending, 0);
+  focus = g_ptr_array_index (pending, 1);
+  visible = g_ptr_array_index (pending, 2);
+
+  ide_buffer_manager_set_focus_buffer (buffer_manager, focus);
+
+  /* Only a view on screen makes a buffer visible, holding it is not enough */
+  ide_buffer_hold (open);
+  _ide_buffer_set_view_mapped (visible, TRUE);
+
+  complete (g_ptr_array_index (running, 0));
+  wait_for_started (3);
+  settle ();
+  g_assert_cmpint (started->len, ==, 3);
+  g_assert (g_file_equal (get_started_file (2), ide_file_get_file (ide_buffer_get_file (focus))));
+
+  complete (g_ptr_array_index (running, 0));
+  wait_for_started (4);
+  settle ();
+  g_assert_cmpint (started->len, ==, 4);
+  g_assert (g_file_equal (get_started_file (3), ide_file_get_file (ide_buffer_get_file (visible))));
+
+  complete (g_ptr_array_index (running, 0));
+  wait_for_started (5);
+  g_assert (g_file_equal (get_started_file (4), ide_file_get_file (ide_buffer_get_file (open))));
+
+  while (running->len > 0)
+    complete (g_ptr_array_index (running, 0));
+  settle ();
+
+  g_assert_cmpint (started->len, ==, 5);
+  g_assert_cmpint (max_running, ==, MAX_IN_FLIGHT_PER_PROVIDER);
+
+  _ide_buffer_set_view_mapped (visible, FALSE);
+  ide_buffer_release (open);
+  remove_files (tmpdir, buffers);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+test_priority (GCancellable        *cancellable,
+               GAsyncReadyCallback  callback,
+               gpointer             user_data)
+{
+  g_autoptr(GFile) project_file = NULL;
+  GTask *task;
+
+  load_test_plugin ();
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  project_file = g_file_new_for_path (TEST_DATA_DIR"/project1/configure.ac");
+  ide_context_new_async (project_file, NULL, test_priority_cb, task);
+}
+
+static void
+test_cancel_cb (GObject      *object,
+                GAsyncResult *result,
+                gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(IdeContext) context = NULL;
+  g_autoptr(GPtrArray) buffers = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  IdeBuffer *changed = NULL;
+  IdeBuffer *other = NULL;
+  IdeBuffer *waiting = NULL;
+  GTask *superseded;
+  GError *error = NULL;
+  guint i;
+
+  context = ide_context_new_finish (result, &error);
+  g_assert_no_error (error);
+  g_assert (IDE_IS_CONTEXT (context));
+
+  tmpdir = g_dir_make_tmp ("test-diagnostics-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  reset ();
+
+  buffers = load_buffers (context, tmpdir, 3);
+  wait_for_started (MAX_IN_FLIGHT_PER_PROVIDER);
+  settle ();
+
+  for (i = 0; i < buffers->len; i++)
+    {
+      IdeBuffer *buffer = g_ptr_array_index (buffers, i);
+
+      if (!was_started (buffer))
+        waiting = buffer;
+      else if (changed == NULL)
+        changed = buffer;
+      else
+        other = buffer;
+    }
+
+  g_assert (changed != NULL);
+  g_assert (other != NULL);
+  g_assert (waiting != NULL);
+
+  /* Editing a buffer cancels the diagnosis of its previous contents */
+  superseded = find_running (changed);
+  g_assert (superseded != NULL);
+  g_assert (!g_cancellable_is_cancelled (g_task_get_cancellable (superseded)));
+
+  gtk_text_buffer_insert_at_cursor (GTK_TEXT_BUFFER (changed), "Other=Value\n", -1);
+
+  g_assert (g_cancellable_is_cancelled (g_task_get_cancellable (superseded)));
+  g_assert (!g_cancellable_is_cancelled (g_task_get_cancellable (find_running (other))));
+
+  /* The cancelled diagnosis keeps its slot until the provider completes it */
+  settle ();
+  g_assert_cmpint (started->len, ==, MAX_IN_FLIGHT_PER_PROVIDER);
+
+  /*
+   * Once it does, the job that was already waiting goes first, and the
+   * edited buffer is diagnosed again when the next slot frees up.
+   */
+  complete (superseded);
+  wait_for_started (3);
+  settle ();
+  g_assert_cmpint (started->len, ==, 3);
+  g_assert (g_file_equal (get_started_file (2), ide_file_get_file (ide_buffer_get_file (waiting))));
+
+  complete (find_running (other));
+  wait_for_started (4);
+  g_assert (g_file_equal (get_started_file (3), ide_file_get_file (ide_buffer_get_file (changed))));
+  g_assert (!g_cancellable_is_cancelled (g_task_get_cancellable (find_running (changed))));
+
+  while (running->len > 0)
+    complete (g_ptr_array_index (running, 0));
+  settle ();
+
+  g_assert_cmpint (started->len, ==, 4);
+  g_assert_cmpint (max_running, ==, MAX_IN_FLIGHT_PER_PROVIDER);
+
+  remove_files (tmpdir, buffers);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+test_cancel (GCancellable        *cancellable,
+             GAsyncReadyCallback  callback,
+             gpointer             user_data)
+{
+  g_autoptr(GFile) project_file = NULL;
+  GTask *task;
+
+  load_test_plugin ();
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  project_file = g_file_new_for_path (TEST_DATA_DIR"/project1/configure.ac");
+  ide_context_new_async (project_file, NULL, test_cancel_cb, task);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  IdeApplication *app;
+  gint ret;
+
+  g_test_init (&argc, &argv, NULL);
+
+  ide_log_init (TRUE, NULL);
+  ide_log_set_verbosity (4);
+
+  started = g_ptr_array_new_with_free_func (g_object_unref);
+  running = g_ptr_array_new_with_free_func (g_object_unref);
+
+  app = ide_application_new ();
+  ide_application_add_test (app, "/Ide/DiagnosticsManager/priority", test_priority, NULL);
+  ide_application_add_test (app, "/Ide/DiagnosticsManager/cancel", test_cancel, NULL);
+  ret = g_application_run (G_APPLICATION (app), argc, argv);
+  g_object_unref (app);
+
+  return ret;
+}
@@ -0,0 +1,209 @@
+/* test-ide-gcc-parser.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "gbp-gcc-parser.h"
+
+#define WORKDIR "/work/build"
+
+typedef struct
+{
+  const gchar           *text;
+
+  /* NULL if no diagnostic is expected */
+  const gchar           *path;
+  const gchar           *message;
+  guint                  line;
+  guint                  column;
+  IdeDiagnosticSeverity  severity;
+} ParseCase;
+
+static const ParseCase parse_cases[] = {
+  { "foo.c:10:5: warning: unused variable 'x' [-Wunused-variable]",
+    WORKDIR"/foo.c", "unused variable 'x' [-Wunused-variable]", 9, 4, IDE_DIAGNOSTIC_WARNING },
+  { "src/util/foo.c:1:1: error: expected ';' before '}' token",
+    WORKDIR"/src/util/foo.c", "expected ';' before '}' token", 0, 0, IDE_DIAGNOSTIC_ERROR },
+  { "../lib/ide.c:3:7: note: declared here",
+    "/work/lib/ide.c", "declared here", 2, 6, IDE_DIAGNOSTIC_NOTE },
+  { "/usr/include/glib.h:30:10: fatal error: foo.h: No such file or directory",
+    "/usr/include/glib.h", "foo.h: No such file or directory", 29, 9, IDE_DIAGNOSTIC_FATAL },
+  { "  CCLD     foo.c:12:3: Warning: odd",
+    WORKDIR"/foo.c", "odd", 11, 2, IDE_DIAGNOSTIC_WARNING },
+  { "foo.c:4:2: warning: 'g_type_class_add_private' is deprecated [-Wdeprecated-declarations]",
+    WORKDIR"/foo.c", "'g_type_class_add_private' is deprecated [-Wdeprecated-declarations]", 3, 1, IDE_DIAGNOSTIC_WARNING },
+
+  /* Context lines preceding a diagnostic */
+  { "In file included from foo.c:10:0:" },
+  { "In file included from /usr/include/stdio.h:27:0," },
+  { "                 from main.c:3:" },
+  { "foo.c: In function 'main':" },
+
+  /* Lines without a column */
+  { "foo.c:12: error: no column" },
+  { "foo.c:12:: error: empty column" },
+
+  /* Lines and columns start from one */
+  { "foo.c:0:1: error: no line" },
+  { "foo.c:1:0: error: no column" },
+
+  /* Requires compiling with optimization, which is on purpose */
+  { "/usr/include/features.h:330:4: warning: #warning _FORTIFY_SOURCE requires compiling with optimization (-O) [-Wcpp]" },
+
+  { "" },
+  { "  CC       libfoo_la-foo.lo" },
+  { ":1:1: error: no file name" },
+  { "make[1]: Nothing to be done for 'all'." },
+};
+
+static GbpGccParser *
+parser_new (void)
+{
+  g_autoptr(GFile) workdir = g_file_new_for_path (WORKDIR);
+
+  return gbp_gcc_parser_new (workdir);
+}
+
+static void
+assert_parses_to (GbpGccParser    *parser,
+                  const gchar     *text,
+                  gsize            len,
+                  const ParseCase *expected)
+{
+  GbpGccDiagnostic *diag;
+
+  diag = gbp_gcc_parser_parse_line (parser, text, len);
+
+  if (expected->path == NULL)
+    {
+      if (diag != NULL)
+        g_error ("\"%s\" should not be a diagnostic, got %s", text, diag->path);
+      return;
+    }
+
+  if (diag == NULL)
+    g_error ("\"%s\" should be a diagnostic", text);
+
+  g_assert_cmpstr (diag->path, ==, expected->path);
+  g_assert_cmpstr (diag->message, ==, expected->message);
+  g_assert_cmpint (diag->line, ==, expected->line);
+  g_assert_cmpint (diag->column, ==, expected->column);
+  g_assert_cmpint (diag->severity, ==, expected->severity);
+
+  gbp_gcc_diagnostic_free (diag);
+}
+
+static void
+test_gcc_parser_lines (void)
+{
+  GbpGccParser *parser = parser_new ();
+
+  for (guint i = 0; i < G_N_ELEMENTS (parse_cases); i++)
+    {
+      const ParseCase *c = &parse_cases [i];
+
+      assert_parses_to (parser, c->text, strlen (c->text), c);
+    }
+
+  gbp_gcc_parser_free (parser);
+}
+
+static void
+test_gcc_parser_length (void)
+{
+  static const ParseCase expected = {
+    NULL, WORKDIR"/foo.c", "first", 0, 1, IDE_DIAGNOSTIC_ERROR
+  };
+  static const ParseCase none = { NULL };
+  const gchar *text = "foo.c:1:2: error: first\nbar.c:3:4: error: second";
+  const gchar *newline = strchr (text, '\n');
+  GbpGccParser *parser = parser_new ();
+
+  /* The log hands out lines which are not terminated */
+  assert_parses_to (parser, text, newline - text, &expected);
+
+  /* Cut before the message */
+  assert_parses_to (parser, text, strlen ("foo.c:1:2: error"), &none);
+
+  gbp_gcc_parser_free (parser);
+}
+
+typedef struct
+{
+  const gchar *text;
+
+  /* Where "foo.c" resolves after @text */
+  const gchar *resolved;
+} DirectoryCase;
+
+static const DirectoryCase directory_cases[] = {
+  { "make  all-recursive", WORKDIR"/foo.c" },
+  { "make[1]: Entering directory '/build'", WORKDIR"/foo.c" },
+  { "make[2]: Entering directory '/build/src'", WORKDIR"/src/foo.c" },
+  { "make[3]: Entering directory '/build/src/sub'", WORKDIR"/src/sub/foo.c" },
+
+  /* make goes back to the parent without entering it again */
+  { "make[3]: Leaving directory '/build/src/sub'", WORKDIR"/src/foo.c" },
+  { "make[2]: Leaving directory '/build/src'", WORKDIR"/foo.c" },
+
+  /* Older versions of make */
+  { "make[2]: Entering directory `/build/tests'", WORKDIR"/tests/foo.c" },
+  { "make[2]: Leaving directory `/build/tests'", WORKDIR"/foo.c" },
+
+  /* make invoked under another name, such as on the BSDs */
+  { "gmake[2]: Entering directory '/build/lib'", WORKDIR"/lib/foo.c" },
+  { "gmake[2]: Leaving directory '/build/lib'", WORKDIR"/foo.c" },
+
+  /* Not quoted, so not a directory change */
+  { "make[2]: Entering directory /build/po", WORKDIR"/foo.c" },
+
+  { "make[1]: Leaving directory '/build'", WORKDIR"/foo.c" },
+  { "make[1]: Leaving directory '/build'", WORKDIR"/foo.c" },
+};
+
+static void
+test_gcc_parser_directories (void)
+{
+  GbpGccParser *parser = parser_new ();
+
+  for (guint i = 0; i < G_N_ELEMENTS (directory_cases); i++)
+    {
+      const DirectoryCase *c = &directory_cases [i];
+      const ParseCase expected = {
+        NULL, c->resolved, "e", 0, 0, IDE_DIAGNOSTIC_ERROR
+      };
+      static const ParseCase none = { NULL };
+      const gchar *line = "foo.c:1:1: error: e";
+
+      assert_parses_to (parser, c->text, strlen (c->text), &none);
+      assert_parses_to (parser, line, strlen (line), &expected);
+    }
+
+  gbp_gcc_parser_free (parser);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/Gcc/Parser/lines", test_gcc_parser_lines);
+  g_test_add_func ("/Ide/Gcc/Parser/length", test_gcc_parser_length);
+  g_test_add_func ("/Ide/Gcc/Parser/directories", test_gcc_parser_directories);
+  return g_test_run ();
+}
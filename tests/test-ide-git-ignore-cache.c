@@ -0,0 +1,377 @@
+/* test-ide-git-ignore-cache.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include <libgit2-glib/ggit.h>
+#include <string.h>
+
+#include "ide-git-ignore-cache.h"
+
+typedef struct
+{
+  gchar             *root;
+  GFile             *workdir;
+  GgitRepository    *repository;
+  IdeGitIgnoreCache *cache;
+  guint              n_queries;
+  guint              n_walks;
+  const gchar       *failing_path;
+} Repo;
+
+static void
+write_file (const gchar *dir,
+            const gchar *name,
+            const gchar *contents)
+{
+  g_autofree gchar *path = g_build_filename (dir, name, NULL);
+  g_autofree gchar *parent = g_path_get_dirname (path);
+  g_autoptr(GError) error = NULL;
+
+  g_assert_cmpint (g_mkdir_with_parents (parent, 0750), ==, 0);
+  g_file_set_contents (path, contents, -1, &error);
+  g_assert_no_error (error);
+}
+
+static void
+remove_recursive (const gchar *path)
+{
+  GDir *dir;
+
+  if ((dir = g_dir_open (path, 0, NULL)))
+    {
+      const gchar *name;
+
+      while ((name = g_dir_read_name (dir)))
+        {
+          g_autofree gchar *child = g_build_filename (path, name, NULL);
+          remove_recursive (child);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_remove (path);
+}
+
+/* Counts the queries that reach libgit2 */
+static gboolean
+path_is_ignored (const gchar  *relpath,
+                 gpointer      user_data,
+                 GError      **error)
+{
+  Repo *repo = user_data;
+
+  repo->n_queries++;
+
+  if (g_strcmp0 (relpath, repo->failing_path) == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to check %s", relpath);
+      return FALSE;
+    }
+
+  return ggit_repository_path_is_ignored (repo->repository, relpath, error);
+}
+
+static gint
+list_ignored_cb (const gchar     *path,
+                 GgitStatusFlags  status,
+                 gpointer         user_data)
+{
+  GHashTable *ignored = user_data;
+
+  if ((status & GGIT_STATUS_IGNORED) != 0)
+    {
+      if (g_str_has_suffix (path, "/"))
+        g_hash_table_add (ignored, g_strndup (path, strlen (path) - 1));
+      else
+        g_hash_table_add (ignored, g_strdup (path));
+    }
+
+  return 0;
+}
+
+/* Counts the walks of the working tree */
+static gboolean
+list_ignored (GHashTable  *ignored,
+              gpointer     user_data,
+              GError     **error)
+{
+  Repo *repo = user_data;
+  GgitStatusOptions *options;
+  gboolean ret;
+
+  repo->n_walks++;
+
+  options = ggit_status_options_new (GGIT_STATUS_OPTION_INCLUDE_UNTRACKED |
+                                     GGIT_STATUS_OPTION_RECURSE_UNTRACKED_DIRS |
+                                     GGIT_STATUS_OPTION_INCLUDE_IGNORED,
+                                     GGIT_STATUS_SHOW_WORKDIR_ONLY,
+                                     NULL);
+  ret = ggit_repository_file_status_foreach (repo->repository, options, list_ignored_cb, ignored, error);
+  ggit_status_options_free (options);
+
+  return ret;
+}
+
+static void
+repo_init (Repo *repo)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GFile) location = NULL;
+
+  memset (repo, 0, sizeof *repo);
+
+  repo->root = g_dir_make_tmp ("test-git-ignore-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  write_file (repo->root, ".gitignore", "build/\n*.o\n");
+  write_file (repo->root, "build/out/a.c", "");
+  write_file (repo->root, "build/x.c", "");
+  write_file (repo->root, "src/main.c", "");
+  write_file (repo->root, "src/main.o", "");
+  write_file (repo->root, "sub/data.txt", "");
+  write_file (repo->root, "sub/deep/more.txt", "");
+
+  repo->workdir = g_file_new_for_path (repo->root);
+  repo->repository = ggit_repository_init_repository (repo->workdir, FALSE, &error);
+  g_assert_no_error (error);
+  g_assert (GGIT_IS_REPOSITORY (repo->repository));
+
+  location = ggit_repository_get_location (repo->repository);
+  repo->cache = ide_git_ignore_cache_new (repo->workdir, location, path_is_ignored, repo, NULL);
+}
+
+static void
+repo_clear (Repo *repo)
+{
+  g_clear_pointer (&repo->cache, ide_git_ignore_cache_unref);
+  g_clear_object (&repo->repository);
+  g_clear_object (&repo->workdir);
+  remove_recursive (repo->root);
+  g_clear_pointer (&repo->root, g_free);
+}
+
+/*
+ * Checks @paths in one batch and compares with @expected, a string of 'y'
+ * and 'n'. Returns the number of queries that reached libgit2.
+ */
+static guint
+check (Repo         *repo,
+       const gchar **paths,
+       const gchar  *expected,
+       GError      **error)
+{
+  g_autoptr(GPtrArray) files = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autofree guint8 *ignored = NULL;
+  guint n_queries = repo->n_queries;
+  guint i;
+
+  for (i = 0; paths [i]; i++)
+    g_ptr_array_add (files, g_file_get_child (repo->workdir, paths [i]));
+
+  g_assert_cmpint (strlen (expected), ==, files->len);
+
+  /* Garbage in the bitmap must be overwritten */
+  ignored = g_malloc (files->len / 8 + 1);
+  memset (ignored, 0xff, files->len / 8 + 1);
+
+  ide_git_ignore_cache_is_ignored_many (repo->cache, (GFile **)files->pdata, files->len, ignored, error);
+
+  for (i = 0; i < files->len; i++)
+    {
+      gboolean is_ignored = (ignored [i / 8] >> (i % 8)) & 1;
+
+      if (is_ignored != (expected [i] == 'y'))
+        g_error ("%s should %sbe ignored", paths [i], is_ignored ? "not " : "");
+    }
+
+  return repo->n_queries - n_queries;
+}
+
+static void
+test_ignore_parent_pruning (void)
+{
+  /* Deepest first, so that the lookup recurses to the parents */
+  const gchar *paths[] = { "build/out/a.c", "build/out", "build/x.c", "build", NULL };
+  const gchar *git_paths[] = { ".git", ".git/HEAD", ".git/objects/info", NULL };
+  Repo repo;
+
+  repo_init (&repo);
+
+  /* Only "build" reaches libgit2, its subtree is answered from the cache */
+  g_assert_cmpint (check (&repo, paths, "yyyy", NULL), ==, 1);
+
+  /* Nothing below .git is ever asked */
+  g_assert_cmpint (check (&repo, git_paths, "yyy", NULL), ==, 0);
+
+  repo_clear (&repo);
+}
+
+static void
+test_ignore_batch (void)
+{
+  const gchar *paths[] = { "src/main.c", "src/main.o", "sub/data.txt", "sub/deep/more.txt", NULL };
+  const gchar *outside[] = { "../elsewhere.o", NULL };
+  Repo repo;
+
+  repo_init (&repo);
+
+  /* src, src/main.c, src/main.o, sub, sub/data.txt, sub/deep, sub/deep/more.txt */
+  g_assert_cmpint (check (&repo, paths, "nynn", NULL), ==, 7);
+
+  /* The second batch is answered from the cache */
+  g_assert_cmpint (check (&repo, paths, "nynn", NULL), ==, 0);
+
+  /* Files outside of the working directory are never ignored */
+  g_assert_cmpint (check (&repo, outside, "n", NULL), ==, 0);
+
+  /* An explicit clear drops every answer */
+  ide_git_ignore_cache_clear (repo.cache);
+  g_assert_cmpint (check (&repo, paths, "nynn", NULL), ==, 7);
+
+  repo_clear (&repo);
+}
+
+static void
+test_ignore_invalidation (void)
+{
+  const gchar *paths[] = { "src/main.c", "src/main.o", "sub/data.txt", "sub/deep/more.txt", NULL };
+  const gchar *src_paths[] = { "src/main.c", NULL };
+  g_autofree gchar *sub_gitignore = NULL;
+  Repo repo;
+
+  repo_init (&repo);
+  sub_gitignore = g_build_filename (repo.root, "sub", ".gitignore", NULL);
+
+  g_assert_cmpint (check (&repo, paths, "nynn", NULL), ==, 7);
+
+  /* A new nested .gitignore only invalidates the paths below it */
+  write_file (repo.root, "sub/.gitignore", "*.txt\n");
+  g_assert_cmpint (check (&repo, paths, "nyyy", NULL), ==, 3);
+  g_assert_cmpint (check (&repo, src_paths, "n", NULL), ==, 0);
+
+  /* Modifying it, "sub/deep" now prunes its contents */
+  write_file (repo.root, "sub/.gitignore", "deep/\n");
+  g_assert_cmpint (check (&repo, paths, "nyny", NULL), ==, 2);
+
+  /* Removing it */
+  g_assert_cmpint (g_unlink (sub_gitignore), ==, 0);
+  g_assert_cmpint (check (&repo, paths, "nynn", NULL), ==, 3);
+
+  /* The toplevel .gitignore applies to everything */
+  write_file (repo.root, ".gitignore", "build/\n");
+  g_assert_cmpint (check (&repo, paths, "nnnn", NULL), ==, 7);
+
+  /* And so does .git/info/exclude */
+  write_file (repo.root, ".git/info/exclude", "main.c\n");
+  g_assert_cmpint (check (&repo, paths, "ynnn", NULL), ==, 7);
+
+  repo_clear (&repo);
+}
+
+static void
+test_ignore_status (void)
+{
+  const gchar *paths[] = { "src/main.c", "src/main.o", "sub/data.txt", "sub/deep/more.txt", NULL };
+  const gchar *new_paths[] = { "src/new.o", "src/new.c", NULL };
+  const gchar *single[] = { "build/x.c", NULL };
+  const gchar *src_paths[] = { "src/main.c", "src/main.o", NULL };
+  Repo repo;
+
+  repo_init (&repo);
+  ide_git_ignore_cache_set_status_func (repo.cache, list_ignored);
+
+  /* Files changed within the second of the walk are never trusted to it */
+  g_usleep (G_USEC_PER_SEC + G_USEC_PER_SEC / 10);
+
+  /* A single path does not walk the tree */
+  g_assert_cmpint (check (&repo, single, "y", NULL), ==, 1);
+  g_assert_cmpint (repo.n_walks, ==, 0);
+
+  /* A batch walks it once, and no path reaches libgit2 */
+  g_assert_cmpint (check (&repo, paths, "nynn", NULL), ==, 0);
+  g_assert_cmpint (repo.n_walks, ==, 1);
+  g_assert_cmpint (check (&repo, paths, "nynn", NULL), ==, 0);
+  g_assert_cmpint (repo.n_walks, ==, 1);
+
+  /* Files created after the walk are asked about */
+  write_file (repo.root, "src/new.o", "");
+  write_file (repo.root, "src/new.c", "");
+  g_assert_cmpint (check (&repo, new_paths, "yn", NULL), ==, 2);
+  g_assert_cmpint (repo.n_walks, ==, 1);
+
+  /* New rules drop the walk, the paths below them are asked about */
+  write_file (repo.root, "sub/.gitignore", "*.txt\n");
+  g_assert_cmpint (check (&repo, paths, "nyyy", NULL), ==, 3);
+  g_assert_cmpint (repo.n_walks, ==, 1);
+
+  /* And the next batch walks again */
+  ide_git_ignore_cache_clear (repo.cache);
+  g_usleep (G_USEC_PER_SEC + G_USEC_PER_SEC / 10);
+  g_assert_cmpint (check (&repo, src_paths, "ny", NULL), ==, 0);
+  g_assert_cmpint (repo.n_walks, ==, 2);
+
+  /* Rules changed after the walk, before a directory is first used */
+  write_file (repo.root, "sub/deep/.gitignore", "!more.txt\n");
+  g_assert_cmpint (check (&repo, paths, "nyyn", NULL), ==, 1);
+  g_assert_cmpint (repo.n_walks, ==, 2);
+
+  repo_clear (&repo);
+}
+
+static void
+test_ignore_error (void)
+{
+  const gchar *paths[] = { "src/main.o", "src/main.c", "build/x.c", "sub/data.txt", NULL };
+  g_autoptr(GError) error = NULL;
+  Repo repo;
+
+  repo_init (&repo);
+  repo.failing_path = "src/main.c";
+
+  /* The failure does not stop the batch, and the bitmap is complete */
+  check (&repo, paths, "ynyn", &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_clear_error (&error);
+
+  /* Failures are not cached */
+  g_assert_cmpint (check (&repo, paths, "ynyn", &error), ==, 1);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_clear_error (&error);
+
+  repo.failing_path = NULL;
+  g_assert_cmpint (check (&repo, paths, "ynyn", &error), ==, 1);
+  g_assert_no_error (error);
+
+  repo_clear (&repo);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  ggit_init ();
+
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/Git/IgnoreCache/parent-pruning", test_ignore_parent_pruning);
+  g_test_add_func ("/Ide/Git/IgnoreCache/batch", test_ignore_batch);
+  g_test_add_func ("/Ide/Git/IgnoreCache/invalidation", test_ignore_invalidation);
+  g_test_add_func ("/Ide/Git/IgnoreCache/status", test_ignore_status);
+  g_test_add_func ("/Ide/Git/IgnoreCache/error", test_ignore_error);
+  return g_test_run ();
+}
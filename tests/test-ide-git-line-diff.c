@@ -0,0 +1,485 @@
+/* test-ide-git-line-diff.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "ide-git-line-diff.h"
+
+typedef struct
+{
+  guint old_begin;
+  guint old_len;
+  guint new_begin;
+  guint new_len;
+} Change;
+
+/* Each character is a line */
+static GArray *
+lines_new (const gchar *str)
+{
+  GArray *lines = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  for (; *str; str++)
+    {
+      guint64 hash = ide_git_line_hash (str, 1);
+      g_array_append_val (lines, hash);
+    }
+
+  return lines;
+}
+
+static void
+collect_change (guint    old_begin,
+                guint    old_len,
+                guint    new_begin,
+                guint    new_len,
+                gpointer user_data)
+{
+  GArray *changes = user_data;
+  Change change = { old_begin, old_len, new_begin, new_len };
+
+  g_array_append_val (changes, change);
+}
+
+static GArray *
+diff (const gchar *old_str,
+      const gchar *new_str)
+{
+  GArray *old_lines = lines_new (old_str);
+  GArray *new_lines = lines_new (new_str);
+  GArray *changes = g_array_new (FALSE, FALSE, sizeof (Change));
+
+  ide_git_line_diff ((const guint64 *)(gpointer)old_lines->data, old_lines->len,
+                     (const guint64 *)(gpointer)new_lines->data, new_lines->len,
+                     collect_change, changes);
+
+  g_array_unref (old_lines);
+  g_array_unref (new_lines);
+
+  return changes;
+}
+
+/*
+ * Checks that the changes are in order, do not touch, and turn @old_str
+ * into @new_str. Returns the number of lines inserted and removed.
+ */
+static guint
+assert_changes_apply (const gchar *old_str,
+                      const gchar *new_str,
+                      GArray      *changes)
+{
+  g_autoptr(GString) str = g_string_new (NULL);
+  guint old_pos = 0;
+  guint new_pos = 0;
+  guint cost = 0;
+  guint i;
+
+  for (i = 0; i < changes->len; i++)
+    {
+      const Change *change = &g_array_index (changes, Change, i);
+
+      g_assert_cmpint (change->old_len + change->new_len, >, 0);
+
+      /* Adjacent changes are merged, so there is always a line between */
+      if (i > 0)
+        g_assert_cmpint (change->old_begin, >, old_pos);
+      g_assert_cmpint (change->old_begin - old_pos, ==, change->new_begin - new_pos);
+
+      g_string_append_len (str, old_str + old_pos, change->old_begin - old_pos);
+      g_string_append_len (str, new_str + change->new_begin, change->new_len);
+
+      old_pos = change->old_begin + change->old_len;
+      new_pos = change->new_begin + change->new_len;
+      cost += change->old_len + change->new_len;
+    }
+
+  g_assert_cmpint (strlen (old_str) - old_pos, ==, strlen (new_str) - new_pos);
+  g_string_append (str, old_str + old_pos);
+
+  g_assert_cmpstr (str->str, ==, new_str);
+
+  return cost;
+}
+
+static void
+assert_diff (const gchar  *old_str,
+             const gchar  *new_str,
+             const Change *expected,
+             guint         n_expected)
+{
+  g_autoptr(GArray) changes = diff (old_str, new_str);
+  guint i;
+
+  assert_changes_apply (old_str, new_str, changes);
+
+  g_assert_cmpint (changes->len, ==, n_expected);
+
+  for (i = 0; i < n_expected; i++)
+    {
+      const Change *change = &g_array_index (changes, Change, i);
+
+      g_assert_cmpint (change->old_begin, ==, expected [i].old_begin);
+      g_assert_cmpint (change->old_len, ==, expected [i].old_len);
+      g_assert_cmpint (change->new_begin, ==, expected [i].new_begin);
+      g_assert_cmpint (change->new_len, ==, expected [i].new_len);
+    }
+}
+
+static void
+test_line_diff_empty (void)
+{
+  static const Change all_new[] = { { 0, 0, 0, 3 } };
+  static const Change all_old[] = { { 0, 3, 0, 0 } };
+
+  assert_diff ("", "", NULL, 0);
+  assert_diff ("abc", "abc", NULL, 0);
+  assert_diff ("", "abc", all_new, G_N_ELEMENTS (all_new));
+  assert_diff ("abc", "", all_old, G_N_ELEMENTS (all_old));
+}
+
+static void
+test_line_diff_insert (void)
+{
+  static const Change first[] = { { 0, 0, 0, 1 } };
+  static const Change middle[] = { { 2, 0, 2, 2 } };
+  static const Change last[] = { { 3, 0, 3, 1 } };
+  static const Change several[] = { { 1, 0, 1, 1 }, { 3, 0, 4, 1 } };
+
+  assert_diff ("abc", "Xabc", first, G_N_ELEMENTS (first));
+  assert_diff ("abcd", "abXYcd", middle, G_N_ELEMENTS (middle));
+  assert_diff ("abc", "abcX", last, G_N_ELEMENTS (last));
+  assert_diff ("abcd", "aXbcYd", several, G_N_ELEMENTS (several));
+}
+
+static void
+test_line_diff_delete (void)
+{
+  static const Change first[] = { { 0, 1, 0, 0 } };
+  static const Change middle[] = { { 1, 2, 1, 0 } };
+  static const Change last[] = { { 3, 1, 3, 0 } };
+  static const Change several[] = { { 1, 1, 1, 0 }, { 4, 1, 3, 0 } };
+
+  assert_diff ("abc", "bc", first, G_N_ELEMENTS (first));
+  assert_diff ("abcd", "ad", middle, G_N_ELEMENTS (middle));
+  assert_diff ("abcd", "abc", last, G_N_ELEMENTS (last));
+  assert_diff ("abcdef", "acdf", several, G_N_ELEMENTS (several));
+}
+
+static void
+test_line_diff_change (void)
+{
+  static const Change one[] = { { 2, 1, 2, 1 } };
+  static const Change grow[] = { { 1, 1, 1, 3 } };
+  static const Change shrink[] = { { 1, 3, 1, 1 } };
+  static const Change several[] = { { 0, 1, 0, 1 }, { 3, 1, 3, 1 }, { 6, 1, 6, 1 } };
+
+  assert_diff ("abcd", "abXd", one, G_N_ELEMENTS (one));
+  assert_diff ("abc", "aXYZc", grow, G_N_ELEMENTS (grow));
+  assert_diff ("abcde", "aXe", shrink, G_N_ELEMENTS (shrink));
+  assert_diff ("abcdefg", "XbcYefZ", several, G_N_ELEMENTS (several));
+}
+
+static guint
+lcs_length (const gchar *a,
+            const gchar *b)
+{
+  guint n = strlen (a);
+  guint m = strlen (b);
+  guint *table = g_new0 (guint, (n + 1) * (m + 1));
+  guint ret;
+  guint i;
+  guint j;
+
+  for (i = 1; i <= n; i++)
+    {
+      for (j = 1; j <= m; j++)
+        {
+          if (a [i - 1] == b [j - 1])
+            table [i * (m + 1) + j] = table [(i - 1) * (m + 1) + j - 1] + 1;
+          else
+            table [i * (m + 1) + j] = MAX (table [(i - 1) * (m + 1) + j],
+                                           table [i * (m + 1) + j - 1]);
+        }
+    }
+
+  ret = table [n * (m + 1) + m];
+  g_free (table);
+
+  return ret;
+}
+
+static gchar *
+random_lines (GRand *rand,
+              guint  max_len)
+{
+  guint len = g_rand_int_range (rand, 0, max_len + 1);
+  gchar *str = g_malloc (len + 1);
+  guint i;
+
+  for (i = 0; i < len; i++)
+    str [i] = 'a' + g_rand_int_range (rand, 0, 4);
+  str [len] = '\0';
+
+  return str;
+}
+
+static void
+test_line_diff_minimal (void)
+{
+  GRand *rand = g_rand_new_with_seed (0x1de);
+  g_autoptr(GArray) changes = NULL;
+  guint i;
+
+  /* From the paper, which needs 5 edits */
+  changes = diff ("abcabba", "cbabac");
+  g_assert_cmpint (assert_changes_apply ("abcabba", "cbabac", changes), ==, 5);
+
+  for (i = 0; i < 2000; i++)
+    {
+      g_autofree gchar *a = random_lines (rand, 40);
+      g_autofree gchar *b = random_lines (rand, 40);
+      g_autoptr(GArray) random_changes = diff (a, b);
+      guint cost = assert_changes_apply (a, b, random_changes);
+
+      g_assert_cmpint (cost, ==, strlen (a) + strlen (b) - 2 * lcs_length (a, b));
+    }
+
+  g_rand_free (rand);
+}
+
+static void
+test_line_hashes (void)
+{
+  g_autoptr(GArray) hashes = g_array_new (FALSE, FALSE, sizeof (guint64));
+  g_autoptr(GArray) chunked = g_array_new (FALSE, FALSE, sizeof (guint64));
+  const gchar *text = "one\r\ntwo\n\nthree\rfour\n";
+  IdeGitLineHasher hasher;
+  gsize i;
+
+  ide_git_line_hashes_add (hashes, text, strlen (text));
+
+  /* A trailing newline results in a final empty line */
+  g_assert_cmpint (hashes->len, ==, 5);
+  g_assert (g_array_index (hashes, guint64, 0) == ide_git_line_hash ("one", 3));
+  g_assert (g_array_index (hashes, guint64, 1) == ide_git_line_hash ("two", 3));
+  g_assert (g_array_index (hashes, guint64, 2) == ide_git_line_hash ("", 0));
+  g_assert (g_array_index (hashes, guint64, 3) == ide_git_line_hash ("three\rfour", 10));
+  g_assert (g_array_index (hashes, guint64, 4) == ide_git_line_hash ("", 0));
+
+  /* Chunks split anywhere, including between \r and \n, hash the same */
+  ide_git_line_hasher_init (&hasher, chunked);
+  for (i = 0; text [i]; i++)
+    ide_git_line_hasher_add (&hasher, &text [i], 1);
+  ide_git_line_hasher_finish (&hasher);
+
+  g_assert_cmpint (chunked->len, ==, hashes->len);
+  g_assert (memcmp (chunked->data, hashes->data, hashes->len * sizeof (guint64)) == 0);
+}
+
+static guint
+line_at_offset (const gchar *text,
+                gsize        offset)
+{
+  guint line = 0;
+  gsize i;
+
+  for (i = 0; i < offset; i++)
+    line += (text [i] == '\n');
+
+  return line;
+}
+
+static guint
+count_lines (const gchar *text)
+{
+  return line_at_offset (text, strlen (text)) + 1;
+}
+
+static const gchar *
+line_start (const gchar *text,
+            guint        line)
+{
+  for (; line > 0; line--)
+    text = strchr (text, '\n') + 1;
+
+  return text;
+}
+
+/*
+ * Hashes lines @begin_line up to (but not including) @end_line, the way
+ * the buffer change monitor hashes the dirty lines of a buffer.
+ */
+static GArray *
+hash_lines (const gchar *text,
+            guint        begin_line,
+            guint        end_line)
+{
+  GArray *hashes = g_array_new (FALSE, FALSE, sizeof (guint64));
+  const gchar *begin;
+  const gchar *end;
+
+  if (begin_line == end_line)
+    return hashes;
+
+  begin = line_start (text, begin_line);
+  end = line_start (text, end_line - 1);
+  end = strchr (end, '\n') ? strchr (end, '\n') : end + strlen (end);
+
+  ide_git_line_hashes_add (hashes, begin, end - begin);
+  g_assert_cmpint (hashes->len, ==, end_line - begin_line);
+
+  return hashes;
+}
+
+static void
+edit (GString          *text,
+      IdeGitDirtyLines *dirty,
+      gsize             offset,
+      gsize             n_deleted,
+      const gchar      *inserted)
+{
+  guint n_lines = count_lines (text->str);
+
+  /* Like the buffer, deletions and insertions are separate edits */
+  if (n_deleted > 0)
+    {
+      ide_git_dirty_lines_mark (dirty,
+                                line_at_offset (text->str, offset),
+                                line_at_offset (text->str, offset + n_deleted),
+                                n_lines);
+      g_string_erase (text, offset, n_deleted);
+      n_lines = count_lines (text->str);
+    }
+
+  if (*inserted)
+    {
+      guint line = line_at_offset (text->str, offset);
+
+      ide_git_dirty_lines_mark (dirty, line, line, n_lines);
+      g_string_insert (text, offset, inserted);
+    }
+}
+
+/* Checks that rehashing only the dirty lines matches hashing everything */
+static void
+assert_splice_matches (const gchar      *old_text,
+                       const gchar      *new_text,
+                       IdeGitDirtyLines *dirty)
+{
+  g_autoptr(GArray) hashes = g_array_new (FALSE, FALSE, sizeof (guint64));
+  g_autoptr(GArray) expected = g_array_new (FALSE, FALSE, sizeof (guint64));
+  g_autoptr(GArray) patch = NULL;
+  guint n_lines = count_lines (new_text);
+
+  ide_git_line_hashes_add (hashes, old_text, strlen (old_text));
+  ide_git_line_hashes_add (expected, new_text, strlen (new_text));
+
+  if (dirty->is_dirty)
+    {
+      g_assert_cmpint (dirty->prefix + dirty->suffix, <=, n_lines);
+
+      patch = hash_lines (new_text, dirty->prefix, n_lines - dirty->suffix);
+      ide_git_line_hashes_splice (hashes, dirty->prefix, dirty->suffix, patch);
+    }
+
+  g_assert_cmpint (hashes->len, ==, expected->len);
+  g_assert (memcmp (hashes->data, expected->data, hashes->len * sizeof (guint64)) == 0);
+}
+
+static void
+test_line_hashes_dirty (void)
+{
+  static const struct {
+    gsize        offset;
+    gsize        n_deleted;
+    const gchar *inserted;
+  } edits[] = {
+    { 0, 0, "new\n" },       /* insert a line before the first */
+    { 8, 1, "X" },           /* change a character */
+    { 5, 4, "" },            /* join two lines */
+    { 12, 0, "a\nb\nc\n" },  /* split a line */
+    { 0, 6, "" },            /* delete the first lines */
+    { 0, 0, "" },
+  };
+  const gchar *original = "one\ntwo\nthree\nfour\nfive\n";
+  GRand *rand = g_rand_new_with_seed (0x91f);
+  guint i;
+
+  /* Nothing edited */
+  {
+    IdeGitDirtyLines dirty = { 0 };
+
+    assert_splice_matches (original, original, &dirty);
+  }
+
+  /* Each edit on its own, then all of them before rehashing */
+  {
+    g_autoptr(GString) all = g_string_new (original);
+    IdeGitDirtyLines all_dirty = { 0 };
+
+    for (i = 0; i < G_N_ELEMENTS (edits); i++)
+      {
+        g_autoptr(GString) text = g_string_new (all->str);
+        IdeGitDirtyLines dirty = { 0 };
+
+        edit (text, &dirty, edits [i].offset, edits [i].n_deleted, edits [i].inserted);
+        assert_splice_matches (all->str, text->str, &dirty);
+
+        edit (all, &all_dirty, edits [i].offset, edits [i].n_deleted, edits [i].inserted);
+        assert_splice_matches (original, all->str, &all_dirty);
+      }
+  }
+
+  /* Runs of random edits, including at the very start and end */
+  for (i = 0; i < 500; i++)
+    {
+      g_autoptr(GString) text = g_string_new (original);
+      IdeGitDirtyLines dirty = { 0 };
+      guint n_edits = g_rand_int_range (rand, 1, 6);
+      guint j;
+
+      for (j = 0; j < n_edits; j++)
+        {
+          static const gchar *insertions[] = { "", "x", "\n", "y\n", "\nz", "p\nq\n" };
+          gsize offset = g_rand_int_range (rand, 0, text->len + 1);
+          gsize n_deleted = g_rand_int_range (rand, 0, MIN (text->len - offset, 8) + 1);
+          const gchar *inserted = insertions [g_rand_int_range (rand, 0, G_N_ELEMENTS (insertions))];
+
+          edit (text, &dirty, offset, n_deleted, inserted);
+        }
+
+      assert_splice_matches (original, text->str, &dirty);
+    }
+
+  g_rand_free (rand);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/Git/LineDiff/empty", test_line_diff_empty);
+  g_test_add_func ("/Ide/Git/LineDiff/insert", test_line_diff_insert);
+  g_test_add_func ("/Ide/Git/LineDiff/delete", test_line_diff_delete);
+  g_test_add_func ("/Ide/Git/LineDiff/change", test_line_diff_change);
+  g_test_add_func ("/Ide/Git/LineDiff/minimal", test_line_diff_minimal);
+  g_test_add_func ("/Ide/Git/LineHashes/chunks", test_line_hashes);
+  g_test_add_func ("/Ide/Git/LineHashes/dirty", test_line_hashes_dirty);
+  return g_test_run ();
+}
@@ -0,0 +1,461 @@
+/* test-ide-highlight-engine.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <string.h>
+
+#include "ide-internal.h"
+
+static void
+test_highlight_rebase_cases (void)
+{
+  static const struct {
+    guint    span_begin;
+    guint    span_end;
+    guint    stale_begin;
+    guint    stale_end;
+    gint     delta;
+    gboolean kept;
+    guint    begin;
+    guint    end;
+  } cases[] = {
+    /* Nothing changed */
+    { 10, 20, 100, 100,   0, TRUE,  10, 20 },
+
+    /* Before the stale range, touching it */
+    {  0,  5,  10,  15,   3, TRUE,   0,  5 },
+    {  5, 10,  10,  15,   3, TRUE,   5, 10 },
+
+    /* After 3 inserted characters, [10,12) was [10,15) */
+    { 12, 15,  10,  15,   3, TRUE,  15, 18 },
+    { 20, 25,  10,  15,   3, TRUE,  23, 28 },
+    { 11, 13,  10,  15,   3, FALSE,  0,  0 },
+
+    /* After 4 deleted characters, [10,18) was [10,14) */
+    { 14, 20,  10,  14,  -4, FALSE,  0,  0 },
+    { 18, 20,  10,  14,  -4, TRUE,  14, 16 },
+    { 30, 31,  10,  14,  -4, TRUE,  26, 27 },
+
+    /* Straddling either end */
+    {  8, 12,  10,  20,   0, FALSE,  0,  0 },
+    { 18, 22,  10,  20,   0, FALSE,  0,  0 },
+    {  0, 30,  10,  20,   0, FALSE,  0,  0 },
+
+    /* Everything was deleted */
+    {  0,  5,   0,   0, -40, FALSE,  0,  0 },
+    { 39, 40,   0,   0, -40, FALSE,  0,  0 },
+
+    /* Invalidated without edits */
+    { 10, 20,  10,  20,   0, FALSE,  0,  0 },
+    { 20, 25,  10,  20,   0, TRUE,  20, 25 },
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+      IdeHighlightSpan span = { cases [i].span_begin, cases [i].span_end, "def:keyword", 0 };
+      guint begin = 0;
+      guint end = 0;
+      gboolean kept;
+
+      kept = _ide_highlight_span_rebase (&span,
+                                         cases [i].stale_begin,
+                                         cases [i].stale_end,
+                                         cases [i].delta,
+                                         &begin,
+                                         &end);
+
+      g_assert_cmpint (kept, ==, cases [i].kept);
+
+      if (kept)
+        {
+          g_assert_cmpint (begin, ==, cases [i].begin);
+          g_assert_cmpint (end, ==, cases [i].end);
+        }
+    }
+}
+
+/* Words, like a highlighter would find them */
+static GArray *
+compute_spans (const gchar *text)
+{
+  GArray *spans = g_array_new (FALSE, FALSE, sizeof (IdeHighlightSpan));
+  guint i = 0;
+
+  while (text [i])
+    {
+      IdeHighlightSpan span = { i, i, "def:identifier", 0 };
+
+      while (g_ascii_isalpha (text [span.end]))
+        span.end++;
+
+      if (span.end > span.begin)
+        g_array_append_val (spans, span);
+
+      i = MAX (span.end, i + 1);
+    }
+
+  return spans;
+}
+
+static guint
+move_offset (guint    offset,
+             gboolean left_gravity,
+             guint    pos,
+             gint     inserted,
+             guint    deleted)
+{
+  if (inserted > 0)
+    return (offset > pos || (offset == pos && !left_gravity)) ? offset + inserted : offset;
+  else if (offset >= pos + deleted)
+    return offset - deleted;
+  else
+    return MIN (offset, pos);
+}
+
+/*
+ * Edits a copy of the text while tracking the stale range like the marks
+ * of the engine would. Spans computed for the original text must match the
+ * same text after being rebased.
+ */
+static void
+test_highlight_rebase_edits (void)
+{
+  static const gchar *words[] = { "foo", " ", "bar", "\n", "(", "x", "baz qux", "\n\n" };
+  GRand *rand = g_rand_new_with_seed (4321);
+  guint round;
+
+  for (round = 0; round < 500; round++)
+    {
+      g_autoptr(GString) old_text = g_string_new (NULL);
+      g_autoptr(GString) text = NULL;
+      g_autoptr(GArray) spans = NULL;
+      guint stale_begin = 0;
+      guint stale_end = 0;
+      gboolean has_stale = FALSE;
+      guint n_edits;
+      guint i;
+
+      for (i = g_rand_int_range (rand, 0, 40); i > 0; i--)
+        g_string_append (old_text, words [g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+
+      text = g_string_new (old_text->str);
+      spans = compute_spans (old_text->str);
+
+      for (n_edits = g_rand_int_range (rand, 0, 4); n_edits > 0; n_edits--)
+        {
+          guint pos = g_rand_int_range (rand, 0, text->len + 1);
+          guint edit_end = pos;
+
+          if (text->len == 0 || g_rand_boolean (rand))
+            {
+              const gchar *word = words [g_rand_int_range (rand, 0, G_N_ELEMENTS (words))];
+              guint len = strlen (word);
+
+              g_string_insert (text, pos, word);
+              stale_begin = move_offset (stale_begin, TRUE, pos, len, 0);
+              stale_end = move_offset (stale_end, FALSE, pos, len, 0);
+              edit_end = pos + len;
+            }
+          else
+            {
+              guint len = g_rand_int_range (rand, 0, text->len - pos + 1);
+
+              g_string_erase (text, pos, len);
+              stale_begin = move_offset (stale_begin, TRUE, pos, 0, len);
+              stale_end = move_offset (stale_end, FALSE, pos, 0, len);
+            }
+
+          if (!has_stale)
+            {
+              stale_begin = pos;
+              stale_end = edit_end;
+              has_stale = TRUE;
+            }
+          else
+            {
+              stale_begin = MIN (stale_begin, pos);
+              stale_end = MAX (stale_end, edit_end);
+            }
+        }
+
+      if (!has_stale)
+        stale_begin = stale_end = text->len;
+
+      for (i = 0; i < spans->len; i++)
+        {
+          const IdeHighlightSpan *span = &g_array_index (spans, IdeHighlightSpan, i);
+          gint delta = (gint)text->len - (gint)old_text->len;
+          guint begin;
+          guint end;
+
+          if (!_ide_highlight_span_rebase (span, stale_begin, stale_end, delta, &begin, &end))
+            {
+              g_assert (has_stale);
+              continue;
+            }
+
+          g_assert_cmpint (end - begin, ==, span->end - span->begin);
+          g_assert_cmpint (end, <=, text->len);
+          g_assert (strncmp (text->str + begin, old_text->str + span->begin, end - begin) == 0);
+        }
+    }
+
+  g_rand_free (rand);
+}
+
+#define N_CHARS 1000
+
+/*
+ * Highlights [range->begin,range->end) like a highlighter running out of
+ * time would, stopping after at most @max_chars characters.
+ */
+static void
+highlight_range (IdeHighlightProgress *progress,
+                 IdeHighlightRange    *range,
+                 gboolean              priority,
+                 guint                 max_chars,
+                 guint8               *counts)
+{
+  guint i;
+
+  g_assert_cmpint (range->begin, <, range->end);
+  g_assert_cmpint (range->end, <=, N_CHARS);
+
+  range->end = MIN (range->end, range->begin + max_chars);
+
+  for (i = range->begin; i < range->end; i++)
+    counts [i]++;
+
+  _ide_highlight_progress_done (progress, range, priority);
+}
+
+static gboolean
+has_unhighlighted (const guint8            *counts,
+                   const IdeHighlightRange *window)
+{
+  guint i;
+
+  for (i = window->begin; i < window->end; i++)
+    {
+      if (counts [i] == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+test_highlight_progress_viewport (void)
+{
+  static const IdeHighlightRange windows[] = { { 500, 550 }, { 450, 600 } };
+  IdeHighlightProgress progress = { 0, N_CHARS, NULL };
+  IdeHighlightRange range;
+  guint8 counts [N_CHARS] = { 0 };
+  gboolean priority;
+  guint n_done = 0;
+  guint i;
+
+  progress.done = g_array_new (FALSE, FALSE, sizeof (IdeHighlightRange));
+
+  while (_ide_highlight_progress_next (&progress, windows, G_N_ELEMENTS (windows), &range, &priority))
+    {
+      /* The viewport, then the lines around it, then everything else */
+      if (n_done < 50)
+        {
+          g_assert (priority);
+          g_assert_cmpint (range.begin, >=, 500);
+          g_assert_cmpint (range.end, <=, 550);
+        }
+      else if (n_done < 150)
+        {
+          g_assert (priority);
+          g_assert_cmpint (range.begin, >=, 450);
+          g_assert_cmpint (range.end, <=, 600);
+        }
+      else
+        g_assert (!priority);
+
+      /* Stops short of the viewport when highlighting the lines above it */
+      highlight_range (&progress, &range, priority, 7, counts);
+      n_done += range.end - range.begin;
+
+      g_assert_cmpint (n_done, <=, N_CHARS);
+    }
+
+  for (i = 0; i < N_CHARS; i++)
+    g_assert_cmpint (counts [i], ==, 1);
+
+  g_assert_cmpint (progress.done->len, ==, 0);
+  g_assert_cmpint (progress.invalid_begin, >=, progress.invalid_end);
+
+  g_array_unref (progress.done);
+}
+
+/*
+ * Scrolls around while highlighting. Whatever is on screen must be
+ * highlighted first, and nothing may be highlighted twice.
+ */
+static void
+test_highlight_progress_scroll (void)
+{
+  GRand *rand = g_rand_new_with_seed (1234);
+  guint round;
+
+  for (round = 0; round < 200; round++)
+    {
+      IdeHighlightProgress progress;
+      IdeHighlightRange windows[2];
+      IdeHighlightRange range;
+      guint8 counts [N_CHARS] = { 0 };
+      gboolean priority;
+      guint n_windows = 0;
+      guint n_steps = 0;
+      guint i;
+
+      progress.invalid_begin = g_rand_int_range (rand, 0, N_CHARS);
+      progress.invalid_end = g_rand_int_range (rand, progress.invalid_begin, N_CHARS + 1);
+      progress.done = g_array_new (FALSE, FALSE, sizeof (IdeHighlightRange));
+
+      /* Outside of the invalid region is already highlighted */
+      for (i = 0; i < N_CHARS; i++)
+        counts [i] = (i < progress.invalid_begin || i >= progress.invalid_end);
+
+      for (;;)
+        {
+          if (g_rand_int_range (rand, 0, 5) == 0)
+            {
+              guint page = g_rand_int_range (rand, 1, 100);
+              guint begin = g_rand_int_range (rand, 0, N_CHARS - page + 1);
+
+              windows [0].begin = begin;
+              windows [0].end = begin + page;
+              windows [1].begin = begin - MIN (begin, page);
+              windows [1].end = MIN (N_CHARS, begin + 2 * page);
+              n_windows = g_rand_int_range (rand, 1, 3);
+            }
+
+          if (!_ide_highlight_progress_next (&progress, windows, n_windows, &range, &priority))
+            break;
+
+          g_assert_cmpint (range.begin, >=, progress.invalid_begin);
+          g_assert_cmpint (range.end, <=, progress.invalid_end);
+
+          for (i = 0; i < n_windows; i++)
+            {
+              if (has_unhighlighted (counts, &windows [i]))
+                {
+                  g_assert (priority);
+                  g_assert_cmpint (range.begin, >=, windows [i].begin);
+                  g_assert_cmpint (range.end, <=, windows [i].end);
+                  break;
+                }
+            }
+
+          highlight_range (&progress, &range, priority, g_rand_int_range (rand, 1, 50), counts);
+
+          g_assert_cmpint (++n_steps, <=, N_CHARS);
+        }
+
+      for (i = 0; i < N_CHARS; i++)
+        g_assert_cmpint (counts [i], ==, 1);
+
+      g_array_unref (progress.done);
+    }
+
+  g_rand_free (rand);
+}
+
+/*
+ * Edits while highlighting. Only the edited text may be highlighted again,
+ * the rest of what was done before the edit is kept.
+ */
+static void
+test_highlight_progress_edit (void)
+{
+  static const IdeHighlightRange windows[] = { { 400, 500 }, { 300, 600 } };
+  GRand *rand = g_rand_new_with_seed (4321);
+  guint round;
+
+  for (round = 0; round < 200; round++)
+    {
+      IdeHighlightProgress progress;
+      IdeHighlightRange range;
+      guint8 counts [N_CHARS] = { 0 };
+      gboolean priority;
+      guint n_steps = 0;
+      guint i;
+
+      progress.invalid_begin = g_rand_int_range (rand, 0, N_CHARS);
+      progress.invalid_end = g_rand_int_range (rand, progress.invalid_begin, N_CHARS + 1);
+      progress.done = g_array_new (FALSE, FALSE, sizeof (IdeHighlightRange));
+
+      for (i = 0; i < N_CHARS; i++)
+        counts [i] = (i < progress.invalid_begin || i >= progress.invalid_end);
+
+      for (;;)
+        {
+          if (g_rand_int_range (rand, 0, 4) == 0)
+            {
+              IdeHighlightRange edit;
+
+              edit.begin = g_rand_int_range (rand, 0, N_CHARS);
+              edit.end = MIN (N_CHARS, edit.begin + g_rand_int_range (rand, 1, 30));
+
+              for (i = edit.begin; i < edit.end; i++)
+                counts [i] = 0;
+
+              _ide_highlight_progress_invalidate (&progress, &edit);
+
+              g_assert_cmpint (progress.invalid_begin, <=, edit.begin);
+              g_assert_cmpint (progress.invalid_end, >=, edit.end);
+            }
+
+          if (!_ide_highlight_progress_next (&progress, windows, G_N_ELEMENTS (windows), &range, &priority))
+            break;
+
+          /* Nothing highlighted since the last edit is done again */
+          for (i = range.begin; i < range.end; i++)
+            g_assert_cmpint (counts [i], ==, 0);
+
+          highlight_range (&progress, &range, priority, g_rand_int_range (rand, 1, 50), counts);
+
+          g_assert_cmpint (++n_steps, <=, 10 * N_CHARS);
+        }
+
+      for (i = 0; i < N_CHARS; i++)
+        g_assert_cmpint (counts [i], ==, 1);
+
+      g_array_unref (progress.done);
+    }
+
+  g_rand_free (rand);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/HighlightEngine/rebase/cases", test_highlight_rebase_cases);
+  g_test_add_func ("/Ide/HighlightEngine/rebase/edits", test_highlight_rebase_edits);
+  g_test_add_func ("/Ide/HighlightEngine/progress/viewport", test_highlight_progress_viewport);
+  g_test_add_func ("/Ide/HighlightEngine/progress/scroll", test_highlight_progress_scroll);
+  g_test_add_func ("/Ide/HighlightEngine/progress/edit", test_highlight_progress_edit);
+  return g_test_run ();
+}
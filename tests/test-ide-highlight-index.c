@@ -0,0 +1,95 @@
+/* test-ide-highlight-index.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+
+static const struct {
+  const gchar *word;
+  const gchar *tag;
+} words[] = {
+  { "GObject", "c:type" },
+  { "GtkWidget", "c:type" },
+  { "gtk_widget_show", "def:function" },
+  { "g_object_ref", "def:function" },
+  { "G_TYPE_OBJECT", "def:preprocessor" },
+  { "IDE_ENTRY", "def:preprocessor" },
+  { "IDE_EXIT", "def:preprocessor" },
+};
+
+static void
+test_highlight_index_round_trip (void)
+{
+  g_autoptr(IdeHighlightIndex) index = NULL;
+  g_autoptr(IdeHighlightIndex) copy = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  guint i;
+
+  index = ide_highlight_index_new ();
+
+  /* Tags only need to be equal strings, they are not interned here */
+  for (i = 0; i < G_N_ELEMENTS (words); i++)
+    ide_highlight_index_insert (index, words[i].word, g_strdup (words[i].tag));
+
+  variant = g_variant_ref_sink (ide_highlight_index_to_variant (index));
+  g_assert (g_variant_is_of_type (variant, G_VARIANT_TYPE ("a{sas}")));
+
+  /* Words are grouped by tag */
+  g_assert_cmpint (g_variant_n_children (variant), ==, 3);
+
+  copy = ide_highlight_index_new_from_variant (variant);
+
+  for (i = 0; i < G_N_ELEMENTS (words); i++)
+    {
+      const gchar *tag = ide_highlight_index_lookup (copy, words[i].word);
+
+      g_assert_cmpstr (tag, ==, words[i].tag);
+      g_assert (tag == g_intern_string (words[i].tag));
+    }
+
+  g_assert (ide_highlight_index_lookup (copy, "GtkWindow") == NULL);
+  g_assert_cmpint (ide_highlight_index_get_size (copy), ==, ide_highlight_index_get_size (index));
+
+  for (i = 0; i < G_N_ELEMENTS (words); i++)
+    g_free (ide_highlight_index_lookup (index, words[i].word));
+}
+
+static void
+test_highlight_index_round_trip_empty (void)
+{
+  g_autoptr(IdeHighlightIndex) index = NULL;
+  g_autoptr(IdeHighlightIndex) copy = NULL;
+  g_autoptr(GVariant) variant = NULL;
+
+  index = ide_highlight_index_new ();
+  variant = g_variant_ref_sink (ide_highlight_index_to_variant (index));
+  g_assert_cmpint (g_variant_n_children (variant), ==, 0);
+
+  copy = ide_highlight_index_new_from_variant (variant);
+  g_assert (ide_highlight_index_lookup (copy, "GObject") == NULL);
+  g_assert_cmpint (ide_highlight_index_get_size (copy), ==, ide_highlight_index_get_size (index));
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/HighlightIndex/round-trip", test_highlight_index_round_trip);
+  g_test_add_func ("/Ide/HighlightIndex/round-trip-empty", test_highlight_index_round_trip_empty);
+  return g_test_run ();
+}
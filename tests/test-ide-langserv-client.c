@@ -0,0 +1,489 @@
+/* test-ide-langserv-client.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gio/gunixinputstream.h>
+#include <gio/gunixoutputstream.h>
+#include <glib/gstdio.h>
+#include <ide.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "application/ide-application-tests.h"
+
+#define WAIT_TIMEOUT_SECONDS 10
+
+/*
+ * Large enough that the edits made by the tests stay well below the size
+ * of the document, which would make the client fall back to a full sync.
+ */
+#define N_LINES 100
+
+/*
+ * The language server, which runs in a thread so that it may block while
+ * reading. It replies to every call and hands every message it received
+ * to the main thread.
+ */
+typedef struct
+{
+  GDataInputStream *input;
+  GOutputStream    *output;
+  GAsyncQueue      *messages;
+  GThread          *thread;
+  volatile gint     done;
+} Peer;
+
+static JsonNode *
+peer_read_message (Peer *peer)
+{
+  g_autofree gchar *body = NULL;
+  gsize content_length = 0;
+  gsize n_read = 0;
+
+  for (;;)
+    {
+      g_autofree gchar *line = NULL;
+
+      line = g_data_input_stream_read_line (peer->input, NULL, NULL, NULL);
+
+      if (line == NULL)
+        return NULL;
+
+      if (line [0] == '\0' || line [0] == '\r')
+        break;
+
+      if (g_ascii_strncasecmp (line, "Content-Length:", 15) == 0)
+        content_length = g_ascii_strtoull (line + 15, NULL, 10);
+    }
+
+  g_assert_cmpint (content_length, >, 0);
+
+  body = g_malloc (content_length + 1);
+
+  if (!g_input_stream_read_all (G_INPUT_STREAM (peer->input), body, content_length, &n_read, NULL, NULL) ||
+      n_read != content_length)
+    return NULL;
+
+  body [content_length] = '\0';
+
+  return json_from_string (body, NULL);
+}
+
+static void
+peer_reply (Peer   *peer,
+            gint64  id)
+{
+  g_autofree gchar *body = NULL;
+  g_autofree gchar *header = NULL;
+
+  body = g_strdup_printf ("{\"jsonrpc\":\"2.0\",\"id\":%"G_GINT64_FORMAT",\"result\":{}}", id);
+  header = g_strdup_printf ("Content-Length: %"G_GSIZE_FORMAT"\r\n\r\n", strlen (body));
+
+  g_output_stream_write_all (peer->output, header, strlen (header), NULL, NULL, NULL);
+  g_output_stream_write_all (peer->output, body, strlen (body), NULL, NULL, NULL);
+}
+
+static gpointer
+peer_thread (gpointer data)
+{
+  Peer *peer = data;
+  JsonNode *message;
+
+  while (NULL != (message = peer_read_message (peer)))
+    {
+      JsonObject *object = json_node_get_object (message);
+
+      if (json_object_has_member (object, "id"))
+        peer_reply (peer, json_object_get_int_member (object, "id"));
+
+      g_async_queue_push (peer->messages, message);
+      g_main_context_wakeup (NULL);
+    }
+
+  g_atomic_int_set (&peer->done, TRUE);
+  g_main_context_wakeup (NULL);
+
+  return NULL;
+}
+
+static Peer *
+peer_new (GIOStream **client_stream)
+{
+  g_autoptr(GInputStream) client_input = NULL;
+  g_autoptr(GOutputStream) client_output = NULL;
+  g_autoptr(GInputStream) peer_input = NULL;
+  gint to_peer [2];
+  gint to_client [2];
+  Peer *peer;
+
+  g_assert_cmpint (pipe (to_peer), ==, 0);
+  g_assert_cmpint (pipe (to_client), ==, 0);
+
+  client_input = g_unix_input_stream_new (to_client [0], TRUE);
+  client_output = g_unix_output_stream_new (to_peer [1], TRUE);
+  *client_stream = g_simple_io_stream_new (client_input, client_output);
+
+  peer_input = g_unix_input_stream_new (to_peer [0], TRUE);
+
+  peer = g_slice_new0 (Peer);
+  peer->input = g_data_input_stream_new (peer_input);
+  peer->output = g_unix_output_stream_new (to_client [1], TRUE);
+  peer->messages = g_async_queue_new_full ((GDestroyNotify)json_node_unref);
+  peer->thread = g_thread_new ("test-langserv-peer", peer_thread, peer);
+
+  return peer;
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+  gboolean *timed_out = user_data;
+
+  *timed_out = TRUE;
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Waits until the client closed its side, which ends the peer thread */
+static void
+peer_free (Peer *peer)
+{
+  gboolean timed_out = FALSE;
+  guint source;
+
+  source = g_timeout_add_seconds (WAIT_TIMEOUT_SECONDS, timeout_cb, &timed_out);
+
+  while (!g_atomic_int_get (&peer->done))
+    {
+      gtk_main_iteration ();
+
+      if (timed_out)
+        g_error ("Timed out waiting for the client to close the stream");
+    }
+
+  g_source_remove (source);
+
+  g_thread_join (peer->thread);
+  g_clear_object (&peer->input);
+  g_clear_object (&peer->output);
+  g_async_queue_unref (peer->messages);
+  g_slice_free (Peer, peer);
+}
+
+/* Returns the params of the next message for @method, skipping others */
+static JsonNode *
+peer_wait_for (Peer        *peer,
+               const gchar *method)
+{
+  gboolean timed_out = FALSE;
+  guint source;
+
+  source = g_timeout_add_seconds (WAIT_TIMEOUT_SECONDS, timeout_cb, &timed_out);
+
+  for (;;)
+    {
+      JsonNode *message;
+
+      while (NULL != (message = g_async_queue_try_pop (peer->messages)))
+        {
+          JsonObject *object = json_node_get_object (message);
+
+          if (g_strcmp0 (json_object_get_string_member (object, "method"), method) == 0)
+            {
+              JsonNode *params = json_node_copy (json_object_get_member (object, "params"));
+
+              g_source_remove (source);
+              json_node_unref (message);
+
+              return params;
+            }
+
+          json_node_unref (message);
+        }
+
+      gtk_main_iteration ();
+
+      if (timed_out)
+        g_error ("Timed out waiting for %s", method);
+    }
+}
+
+/* Checks that nothing else for @method shows up for a while */
+static void
+peer_assert_no_more (Peer        *peer,
+                     const gchar *method)
+{
+  gboolean timed_out = FALSE;
+  JsonNode *message;
+
+  g_timeout_add (200, timeout_cb, &timed_out);
+
+  while (!timed_out)
+    gtk_main_iteration ();
+
+  while (NULL != (message = g_async_queue_try_pop (peer->messages)))
+    {
+      JsonObject *object = json_node_get_object (message);
+
+      g_assert_cmpstr (json_object_get_string_member (object, "method"), !=, method);
+      json_node_unref (message);
+    }
+}
+
+static JsonArray *
+get_content_changes (JsonNode *params,
+                     gint64   *version)
+{
+  JsonObject *object = json_node_get_object (params);
+  JsonObject *text_document = json_object_get_object_member (object, "textDocument");
+
+  *version = json_object_get_int_member (text_document, "version");
+
+  return json_object_get_array_member (object, "contentChanges");
+}
+
+static void
+assert_change (JsonArray   *changes,
+               guint        index,
+               gint         start_line,
+               gint         start_character,
+               gint         end_line,
+               gint         end_character,
+               gint         range_length,
+               const gchar *text)
+{
+  JsonObject *change = json_array_get_object_element (changes, index);
+  JsonObject *range = json_object_get_object_member (change, "range");
+  JsonObject *start = json_object_get_object_member (range, "start");
+  JsonObject *end = json_object_get_object_member (range, "end");
+
+  g_assert_cmpint (json_object_get_int_member (start, "line"), ==, start_line);
+  g_assert_cmpint (json_object_get_int_member (start, "character"), ==, start_character);
+  g_assert_cmpint (json_object_get_int_member (end, "line"), ==, end_line);
+  g_assert_cmpint (json_object_get_int_member (end, "character"), ==, end_character);
+  g_assert_cmpint (json_object_get_int_member (change, "rangeLength"), ==, range_length);
+  g_assert_cmpstr (json_object_get_string_member (change, "text"), ==, text);
+}
+
+static void
+insert_at (IdeBuffer   *buffer,
+           gint         line,
+           gint         line_offset,
+           const gchar *text)
+{
+  GtkTextIter iter;
+
+  gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &iter, line, line_offset);
+  gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, text, -1);
+}
+
+static void
+delete_at (IdeBuffer *buffer,
+           gint       begin_line,
+           gint       begin_offset,
+           gint       end_line,
+           gint       end_offset)
+{
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &begin, begin_line, begin_offset);
+  gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &end, end_line, end_offset);
+  gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &begin, &end);
+}
+
+static void
+load_file_cb (GObject      *object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  IdeBuffer **buffer = user_data;
+  GError *error = NULL;
+
+  *buffer = ide_buffer_manager_load_file_finish (IDE_BUFFER_MANAGER (object), result, &error);
+  g_assert_no_error (error);
+  g_assert (IDE_IS_BUFFER (*buffer));
+}
+
+static IdeBuffer *
+load_buffer (IdeContext  *context,
+             const gchar *path)
+{
+  IdeBufferManager *buffer_manager = ide_context_get_buffer_manager (context);
+  IdeProject *project = ide_context_get_project (context);
+  g_autoptr(GString) contents = g_string_new (NULL);
+  g_autoptr(IdeFile) file = NULL;
+  IdeBuffer *buffer = NULL;
+  GError *error = NULL;
+  guint i;
+
+  for (i = 0; i < N_LINES; i++)
+    g_string_append_printf (contents, "key_%02u=value\n", i);
+
+  g_file_set_contents (path, contents->str, contents->len, &error);
+  g_assert_no_error (error);
+
+  file = ide_project_get_file_for_path (project, path);
+
+  ide_buffer_manager_load_file_async (buffer_manager,
+                                      file,
+                                      FALSE,
+                                      IDE_WORKBENCH_OPEN_FLAGS_NONE,
+                                      NULL,
+                                      NULL,
+                                      load_file_cb,
+                                      &buffer);
+
+  while (buffer == NULL)
+    gtk_main_iteration ();
+
+  return buffer;
+}
+
+static void
+test_coalesce_cb (GObject      *object,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(IdeContext) context = NULL;
+  g_autoptr(IdeLangservClient) client = NULL;
+  g_autoptr(GIOStream) stream = NULL;
+  g_autoptr(IdeBuffer) buffer = NULL;
+  g_autoptr(JsonNode) params = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  g_autofree gchar *path = NULL;
+  JsonArray *changes;
+  GError *error = NULL;
+  gint64 last_version;
+  gint64 version;
+  Peer *peer;
+
+  context = ide_context_new_finish (result, &error);
+  g_assert_no_error (error);
+  g_assert (IDE_IS_CONTEXT (context));
+
+  tmpdir = g_dir_make_tmp ("test-langserv-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (tmpdir, "test.ini", NULL);
+
+  peer = peer_new (&stream);
+
+  client = ide_langserv_client_new (context, stream);
+  ide_langserv_client_add_language (client, "ini");
+  ide_langserv_client_start (client);
+
+  params = peer_wait_for (peer, "initialize");
+
+  buffer = load_buffer (context, path);
+
+  g_clear_pointer (&params, json_node_unref);
+  params = peer_wait_for (peer, "textDocument/didOpen");
+
+  /* Typing and a backspace over the typed text are a single change */
+  insert_at (buffer, 0, 12, "a");
+  insert_at (buffer, 0, 13, "b");
+  insert_at (buffer, 0, 14, "c");
+  delete_at (buffer, 0, 14, 0, 15);
+
+  g_clear_pointer (&params, json_node_unref);
+  params = peer_wait_for (peer, "textDocument/didChange");
+  changes = get_content_changes (params, &version);
+
+  g_assert_cmpint (json_array_get_length (changes), ==, 1);
+  assert_change (changes, 0, 0, 12, 0, 12, 0, "ab");
+
+  peer_assert_no_more (peer, "textDocument/didChange");
+  last_version = version;
+
+  /*
+   * Backspaces and a forward delete, which joins the next line, are a
+   * single deletion from the document as it was before them.
+   */
+  delete_at (buffer, 1, 11, 1, 12);
+  delete_at (buffer, 1, 10, 1, 11);
+  delete_at (buffer, 1, 10, 2, 0);
+
+  g_clear_pointer (&params, json_node_unref);
+  params = peer_wait_for (peer, "textDocument/didChange");
+  changes = get_content_changes (params, &version);
+
+  g_assert_cmpint (json_array_get_length (changes), ==, 1);
+  assert_change (changes, 0, 1, 10, 2, 0, 3, "");
+  g_assert_cmpint (version, >, last_version);
+
+  peer_assert_no_more (peer, "textDocument/didChange");
+  last_version = version;
+
+  /* Edits which are not next to each other are sent together, in order */
+  insert_at (buffer, 10, 0, "x");
+  insert_at (buffer, 20, 0, "y");
+  delete_at (buffer, 30, 0, 30, 1);
+
+  g_clear_pointer (&params, json_node_unref);
+  params = peer_wait_for (peer, "textDocument/didChange");
+  changes = get_content_changes (params, &version);
+
+  g_assert_cmpint (json_array_get_length (changes), ==, 3);
+  assert_change (changes, 0, 10, 0, 10, 0, 0, "x");
+  assert_change (changes, 1, 20, 0, 20, 0, 0, "y");
+  assert_change (changes, 2, 30, 0, 30, 1, 1, "");
+  g_assert_cmpint (version, >, last_version);
+
+  peer_assert_no_more (peer, "textDocument/didChange");
+
+  ide_langserv_client_stop (client);
+  peer_free (peer);
+
+  g_unlink (path);
+  g_rmdir (tmpdir);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+test_coalesce (GCancellable        *cancellable,
+               GAsyncReadyCallback  callback,
+               gpointer             user_data)
+{
+  g_autoptr(GFile) project_file = NULL;
+  GTask *task;
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  project_file = g_file_new_for_path (TEST_DATA_DIR"/project1/configure.ac");
+  ide_context_new_async (project_file, NULL, test_coalesce_cb, task);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  IdeApplication *app;
+  gint ret;
+
+  g_test_init (&argc, &argv, NULL);
+
+  ide_log_init (TRUE, NULL);
+  ide_log_set_verbosity (4);
+
+  app = ide_application_new ();
+  ide_application_add_test (app, "/Ide/LangservClient/coalesce", test_coalesce, NULL);
+  ret = g_application_run (G_APPLICATION (app), argc, argv);
+  g_object_unref (app);
+
+  return ret;
+}
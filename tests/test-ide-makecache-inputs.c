@@ -0,0 +1,233 @@
+/* test-ide-makecache-inputs.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include <utime.h>
+
+#include "ide-makecache-inputs.h"
+
+typedef struct
+{
+  gchar *root;
+  gchar *srcdir;
+  gchar *builddir;
+} Project;
+
+static void
+write_file (const gchar *dir,
+            const gchar *name,
+            const gchar *contents)
+{
+  g_autofree gchar *path = g_build_filename (dir, name, NULL);
+  g_autofree gchar *parent = g_path_get_dirname (path);
+  g_autoptr(GError) error = NULL;
+
+  g_assert_cmpint (g_mkdir_with_parents (parent, 0750), ==, 0);
+  g_file_set_contents (path, contents, -1, &error);
+  g_assert_no_error (error);
+}
+
+static void
+set_mtime (const gchar *dir,
+           const gchar *name,
+           time_t       mtime)
+{
+  g_autofree gchar *path = g_build_filename (dir, name, NULL);
+  struct utimbuf buf = { mtime, mtime };
+
+  g_assert_cmpint (g_utime (path, &buf), ==, 0);
+}
+
+static void
+remove_file (const gchar *dir,
+             const gchar *name)
+{
+  g_autofree gchar *path = g_build_filename (dir, name, NULL);
+
+  g_assert_cmpint (g_unlink (path), ==, 0);
+}
+
+static void
+project_init (Project *project)
+{
+  g_autoptr(GError) error = NULL;
+
+  project->root = g_dir_make_tmp ("test-makecache-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  project->srcdir = g_build_filename (project->root, "src", NULL);
+  project->builddir = g_build_filename (project->root, "build", NULL);
+
+  write_file (project->srcdir, "configure.ac", "AC_INIT([test],[1])\n");
+  write_file (project->srcdir, "configure", "#!/bin/sh\n");
+  write_file (project->srcdir, "Makefile.am", "SUBDIRS = lib\n");
+  write_file (project->srcdir, "Makefile.in", "all:\n");
+  write_file (project->srcdir, "lib/Makefile.am", "noinst_LTLIBRARIES = libfoo.la\n");
+  write_file (project->srcdir, "lib/Makefile.in", "all:\n");
+  write_file (project->builddir, "config.status", "#!/bin/sh\n");
+  write_file (project->builddir, "Makefile", "all:\n");
+  write_file (project->builddir, "lib/Makefile", "all:\n");
+}
+
+static void
+project_clear (Project *project)
+{
+  static const gchar *files[] = {
+    "src/configure.ac", "src/configure", "src/aclocal.m4",
+    "src/Makefile.am", "src/Makefile.in",
+    "src/lib/Makefile.am", "src/lib/Makefile.in",
+    "build/config.status", "build/Makefile", "build/lib/Makefile",
+    "src/lib", "build/lib", "src", "build",
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (files); i++)
+    {
+      g_autofree gchar *path = g_build_filename (project->root, files [i], NULL);
+      g_remove (path);
+    }
+
+  g_rmdir (project->root);
+
+  g_clear_pointer (&project->root, g_free);
+  g_clear_pointer (&project->srcdir, g_free);
+  g_clear_pointer (&project->builddir, g_free);
+}
+
+static GVariant *
+collect_inputs (Project *project)
+{
+  GVariantBuilder builder;
+
+  ide_makecache_inputs_init (&builder);
+  ide_makecache_inputs_add_toplevel (&builder, project->srcdir, project->builddir);
+  ide_makecache_inputs_add_directory (&builder, project->srcdir, project->builddir, ".");
+  ide_makecache_inputs_add_directory (&builder, project->srcdir, project->builddir, "lib");
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static void
+test_inputs_unchanged (void)
+{
+  g_autoptr(GVariant) inputs = NULL;
+  Project project;
+  gint64 newest = 0;
+
+  project_init (&project);
+  set_mtime (project.srcdir, "configure.ac", 1000);
+  set_mtime (project.builddir, "lib/Makefile", 2000);
+
+  inputs = collect_inputs (&project);
+
+  g_assert (ide_makecache_inputs_check (inputs, &newest));
+  g_assert_cmpint (newest, >=, 2000);
+
+  project_clear (&project);
+}
+
+static void
+test_inputs_changed (void)
+{
+  static const struct {
+    gboolean     srcdir;
+    const gchar *name;
+  } changes[] = {
+    { TRUE,  "configure.ac" },
+    { TRUE,  "lib/Makefile.am" },
+    { TRUE,  "Makefile.in" },
+    { FALSE, "config.status" },
+    { FALSE, "lib/Makefile" },
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (changes); i++)
+    {
+      g_autoptr(GVariant) inputs = NULL;
+      Project project;
+      const gchar *dir;
+
+      project_init (&project);
+      dir = changes [i].srcdir ? project.srcdir : project.builddir;
+      set_mtime (dir, changes [i].name, 1000);
+
+      inputs = collect_inputs (&project);
+      g_assert (ide_makecache_inputs_check (inputs, NULL));
+
+      /* Same size, newer mtime */
+      set_mtime (dir, changes [i].name, 2000);
+      g_assert (!ide_makecache_inputs_check (inputs, NULL));
+
+      project_clear (&project);
+    }
+}
+
+static void
+test_inputs_size_changed (void)
+{
+  g_autoptr(GVariant) inputs = NULL;
+  Project project;
+
+  project_init (&project);
+  set_mtime (project.srcdir, "lib/Makefile.am", 1000);
+
+  inputs = collect_inputs (&project);
+  g_assert (ide_makecache_inputs_check (inputs, NULL));
+
+  write_file (project.srcdir, "lib/Makefile.am", "noinst_LTLIBRARIES = libfoo.la libbar.la\n");
+  set_mtime (project.srcdir, "lib/Makefile.am", 1000);
+  g_assert (!ide_makecache_inputs_check (inputs, NULL));
+
+  project_clear (&project);
+}
+
+static void
+test_inputs_created_and_removed (void)
+{
+  g_autoptr(GVariant) inputs = NULL;
+  Project project;
+
+  project_init (&project);
+
+  /* aclocal.m4 did not exist when the inputs were recorded */
+  inputs = collect_inputs (&project);
+  g_assert (ide_makecache_inputs_check (inputs, NULL));
+
+  write_file (project.srcdir, "aclocal.m4", "dnl\n");
+  g_assert (!ide_makecache_inputs_check (inputs, NULL));
+
+  remove_file (project.srcdir, "aclocal.m4");
+  g_assert (ide_makecache_inputs_check (inputs, NULL));
+
+  remove_file (project.srcdir, "lib/Makefile.in");
+  g_assert (!ide_makecache_inputs_check (inputs, NULL));
+
+  project_clear (&project);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/Makecache/Inputs/unchanged", test_inputs_unchanged);
+  g_test_add_func ("/Ide/Makecache/Inputs/changed", test_inputs_changed);
+  g_test_add_func ("/Ide/Makecache/Inputs/size-changed", test_inputs_size_changed);
+  g_test_add_func ("/Ide/Makecache/Inputs/created-and-removed", test_inputs_created_and_removed);
+  return g_test_run ();
+}
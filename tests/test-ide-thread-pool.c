@@ -0,0 +1,339 @@
+/* test-ide-thread-pool.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <string.h>
+
+#include "ide-internal.h"
+
+#define WAIT_TIMEOUT (G_USEC_PER_SEC * 10)
+
+/* Must match ide-thread-pool.c */
+#define COMPILER_MAX_RUNNING 4
+#define INDEXER_MAX_RUNNING  1
+
+typedef struct
+{
+  IdeThreadPoolKind kind;
+  gboolean          background;
+  gboolean          block;
+  guint             id;
+} Item;
+
+static GMutex  lock;
+static GCond   cond;
+static gboolean gate_open;
+static GArray *order;
+static guint   n_started;
+static guint   n_done;
+static guint   running [IDE_THREAD_POOL_LAST];
+static guint   max_running [IDE_THREAD_POOL_LAST];
+static guint   running_background;
+static guint   max_running_background;
+static guint   n_workers;
+static guint   compiler_limit;
+
+static void
+reset (void)
+{
+  g_mutex_lock (&lock);
+  gate_open = FALSE;
+  g_array_set_size (order, 0);
+  n_started = 0;
+  n_done = 0;
+  memset (running, 0, sizeof running);
+  memset (max_running, 0, sizeof max_running);
+  running_background = 0;
+  max_running_background = 0;
+  g_mutex_unlock (&lock);
+}
+
+static void
+work_func (gpointer data)
+{
+  Item *item = data;
+
+  g_mutex_lock (&lock);
+
+  g_array_append_val (order, item->id);
+  n_started++;
+  running [item->kind]++;
+  max_running [item->kind] = MAX (max_running [item->kind], running [item->kind]);
+  if (item->background)
+    {
+      running_background++;
+      max_running_background = MAX (max_running_background, running_background);
+    }
+  g_cond_broadcast (&cond);
+
+  while (item->block && !gate_open)
+    g_cond_wait (&cond, &lock);
+
+  running [item->kind]--;
+  if (item->background)
+    running_background--;
+  n_done++;
+  g_cond_broadcast (&cond);
+
+  g_mutex_unlock (&lock);
+}
+
+static void
+push (Item              *item,
+      IdeThreadPriority  priority)
+{
+  item->background = priority >= IDE_THREAD_PRIORITY_INDEX;
+  ide_thread_pool_push_with_priority (item->kind, priority, work_func, item);
+}
+
+static void
+wait_for (guint *counter,
+          guint  value)
+{
+  gint64 deadline = g_get_monotonic_time () + WAIT_TIMEOUT;
+
+  g_mutex_lock (&lock);
+  while (*counter < value)
+    {
+      if (!g_cond_wait_until (&cond, &lock, deadline))
+        g_error ("Timed out waiting for %u work items, got %u", value, *counter);
+    }
+  g_mutex_unlock (&lock);
+}
+
+/* Gives the workers a chance to (wrongly) pick up more work */
+static guint
+settle (guint *counter)
+{
+  guint ret;
+
+  g_usleep (G_USEC_PER_SEC / 10);
+
+  g_mutex_lock (&lock);
+  ret = *counter;
+  g_mutex_unlock (&lock);
+
+  return ret;
+}
+
+static void
+open_gate (void)
+{
+  g_mutex_lock (&lock);
+  gate_open = TRUE;
+  g_cond_broadcast (&cond);
+  g_mutex_unlock (&lock);
+}
+
+static void
+test_thread_pool_priority (void)
+{
+  static const struct {
+    IdeThreadPriority priority;
+    guint             id;
+  } pushes[] = {
+    { IDE_THREAD_PRIORITY_IDLE,        7 },
+    { IDE_THREAD_PRIORITY_INDEX,       5 },
+    { IDE_THREAD_PRIORITY_DIAGNOSE,    3 },
+    { IDE_THREAD_PRIORITY_IDLE,        8 },
+    { IDE_THREAD_PRIORITY_INTERACTIVE, 1 },
+    { IDE_THREAD_PRIORITY_DIAGNOSE,    4 },
+    { IDE_THREAD_PRIORITY_INDEX,       6 },
+    { IDE_THREAD_PRIORITY_INTERACTIVE, 2 },
+  };
+  Item blocker = { IDE_THREAD_POOL_INDEXER, FALSE, TRUE, 0 };
+  Item items [G_N_ELEMENTS (pushes)];
+  guint i;
+
+  reset ();
+
+  /*
+   * The indexer only runs one item at a time, so holding that slot queues
+   * everything else and the items then start in dequeue order.
+   */
+  push (&blocker, IDE_THREAD_PRIORITY_INDEX);
+  wait_for (&n_started, 1);
+
+  for (i = 0; i < G_N_ELEMENTS (pushes); i++)
+    {
+      items [i].kind = IDE_THREAD_POOL_INDEXER;
+      items [i].block = FALSE;
+      items [i].id = pushes [i].id;
+      push (&items [i], pushes [i].priority);
+    }
+
+  g_assert_cmpint (settle (&n_started), ==, 1);
+
+  open_gate ();
+  wait_for (&n_done, G_N_ELEMENTS (pushes) + 1);
+
+  /* Highest priority class first, FIFO within a class */
+  g_assert_cmpint (order->len, ==, G_N_ELEMENTS (pushes) + 1);
+  for (i = 0; i < order->len; i++)
+    g_assert_cmpint (g_array_index (order, guint, i), ==, i);
+
+  g_assert_cmpint (max_running [IDE_THREAD_POOL_INDEXER], ==, 1);
+}
+
+static void
+test_thread_pool_limits (void)
+{
+  Item compiler [COMPILER_MAX_RUNNING * 3];
+  Item indexer [3];
+  guint n_items = G_N_ELEMENTS (compiler) + G_N_ELEMENTS (indexer);
+  guint i;
+
+  reset ();
+
+  /* Interleave the kinds so that neither can hide behind the other */
+  for (i = 0; i < G_N_ELEMENTS (compiler); i++)
+    {
+      compiler [i].kind = IDE_THREAD_POOL_COMPILER;
+      compiler [i].block = TRUE;
+      compiler [i].id = i;
+      push (&compiler [i], IDE_THREAD_PRIORITY_DIAGNOSE);
+
+      if (i < G_N_ELEMENTS (indexer))
+        {
+          indexer [i].kind = IDE_THREAD_POOL_INDEXER;
+          indexer [i].block = TRUE;
+          indexer [i].id = G_N_ELEMENTS (compiler) + i;
+          push (&indexer [i], IDE_THREAD_PRIORITY_DIAGNOSE);
+        }
+    }
+
+  /* There is always a worker left for the indexer */
+  wait_for (&n_started, compiler_limit + INDEXER_MAX_RUNNING);
+  g_assert_cmpint (settle (&n_started), ==, compiler_limit + INDEXER_MAX_RUNNING);
+
+  g_mutex_lock (&lock);
+  g_assert_cmpint (running [IDE_THREAD_POOL_COMPILER], ==, compiler_limit);
+  g_assert_cmpint (running [IDE_THREAD_POOL_INDEXER], ==, INDEXER_MAX_RUNNING);
+  g_mutex_unlock (&lock);
+
+  open_gate ();
+  wait_for (&n_done, n_items);
+
+  g_assert_cmpint (max_running [IDE_THREAD_POOL_COMPILER], <=, compiler_limit);
+  g_assert_cmpint (max_running [IDE_THREAD_POOL_INDEXER], ==, INDEXER_MAX_RUNNING);
+}
+
+static void
+test_thread_pool_conserve (void)
+{
+  Item background [3];
+  Item interactive = { IDE_THREAD_POOL_INDEXER, FALSE, FALSE, 100 };
+  guint i;
+
+  if (compiler_limit < 2)
+    {
+      g_test_skip ("Not enough workers to observe throttling");
+      return;
+    }
+
+  reset ();
+
+  _ide_thread_pool_set_should_conserve (TRUE);
+
+  for (i = 0; i < G_N_ELEMENTS (background); i++)
+    {
+      background [i].kind = IDE_THREAD_POOL_COMPILER;
+      background [i].block = TRUE;
+      background [i].id = i;
+      push (&background [i], IDE_THREAD_PRIORITY_IDLE);
+    }
+
+  /* Only one background item may run while on battery */
+  wait_for (&n_started, 1);
+  g_assert_cmpint (settle (&n_started), ==, 1);
+
+  /* But foreground work is not held back */
+  push (&interactive, IDE_THREAD_PRIORITY_INTERACTIVE);
+  wait_for (&n_done, 1);
+
+  /* Plugging in wakes up the workers for the held back items */
+  _ide_thread_pool_set_should_conserve (FALSE);
+  wait_for (&n_started, 1 + MIN (G_N_ELEMENTS (background), compiler_limit));
+
+  open_gate ();
+  wait_for (&n_done, 1 + G_N_ELEMENTS (background));
+
+  g_assert_cmpint (max_running_background, >=, 2);
+}
+
+static void
+cancelled_worker (GTask        *task,
+                  gpointer      source_object,
+                  gpointer      task_data,
+                  GCancellable *cancellable)
+{
+  g_error ("Cancelled task should not be run");
+}
+
+static void
+cancelled_cb (GObject      *object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  GMainLoop *main_loop = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (!g_task_propagate_boolean (G_TASK (result), &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
+  g_main_loop_quit (main_loop);
+}
+
+static void
+test_thread_pool_cancelled (void)
+{
+  g_autoptr(GMainLoop) main_loop = g_main_loop_new (NULL, FALSE);
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  g_autoptr(GTask) task = NULL;
+
+  task = g_task_new (NULL, cancellable, cancelled_cb, main_loop);
+  g_cancellable_cancel (cancellable);
+
+  ide_thread_pool_push_task_with_priority (IDE_THREAD_POOL_COMPILER,
+                                           IDE_THREAD_PRIORITY_INTERACTIVE,
+                                           task,
+                                           cancelled_worker);
+
+  g_main_loop_run (main_loop);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  order = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  _ide_thread_pool_init (FALSE);
+
+  n_workers = CLAMP (g_get_num_processors (), 2, 16);
+  compiler_limit = MIN (COMPILER_MAX_RUNNING, n_workers - 1);
+
+  g_test_add_func ("/Ide/ThreadPool/priority", test_thread_pool_priority);
+  g_test_add_func ("/Ide/ThreadPool/limits", test_thread_pool_limits);
+  g_test_add_func ("/Ide/ThreadPool/conserve", test_thread_pool_conserve);
+  g_test_add_func ("/Ide/ThreadPool/cancelled", test_thread_pool_cancelled);
+
+  return g_test_run ();
+}
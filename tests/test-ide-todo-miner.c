@@ -0,0 +1,86 @@
+/* test-ide-todo-miner.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+#include <string.h>
+
+#include "ide-internal.h"
+
+static const gchar source[] =
+  "int a;\n"
+  "/* TODO: first item\n"
+  " * continues here\n"
+  " */\n"
+  "\n"
+  "x = y ? a : b; /* FIXME: second */\n"
+  "XXX: third FIXME: same line\n"
+  "next line\n"
+  "TODO without colon\n";
+
+static void
+test_todo_miner_scan (void)
+{
+  g_autoptr(GFile) file = g_file_new_for_path ("/tmp/todo.c");
+  g_autoptr(GPtrArray) items = NULL;
+  g_autofree gchar *summary = NULL;
+  IdeTodoItem *item;
+
+  items = _ide_todo_miner_scan (file, source, strlen (source));
+  g_assert (items != NULL);
+  g_assert_cmpint (items->len, ==, 3);
+
+  item = g_ptr_array_index (items, 0);
+  g_assert (ide_todo_item_get_file (item) == file);
+  g_assert_cmpint (ide_todo_item_get_line (item), ==, 2);
+  g_assert_cmpstr (ide_todo_item_get_message (item), ==,
+                   "/* TODO: first item\n * continues here\n */");
+  summary = ide_todo_item_get_summary (item);
+  g_assert_cmpstr (summary, ==, "/* TODO: first item");
+
+  /* The next item is not part of the message */
+  item = g_ptr_array_index (items, 1);
+  g_assert_cmpint (ide_todo_item_get_line (item), ==, 6);
+  g_assert_cmpstr (ide_todo_item_get_message (item), ==, "x = y ? a : b; /* FIXME: second */");
+
+  item = g_ptr_array_index (items, 2);
+  g_assert_cmpint (ide_todo_item_get_line (item), ==, 7);
+  g_assert_cmpstr (ide_todo_item_get_message (item), ==,
+                   "XXX: third FIXME: same line\nnext line\nTODO without colon");
+}
+
+static void
+test_todo_miner_scan_none (void)
+{
+  g_autoptr(GFile) file = g_file_new_for_path ("/tmp/todo.c");
+  static const gchar binary[] = "TODO: \0 binary";
+  static const gchar plain[] = "int main (void) { return a ? b : c; }\nlabel:\n";
+
+  g_assert (_ide_todo_miner_scan (file, "", 0) == NULL);
+  g_assert (_ide_todo_miner_scan (file, binary, sizeof binary - 1) == NULL);
+  g_assert (_ide_todo_miner_scan (file, plain, strlen (plain)) == NULL);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/TodoMiner/scan", test_todo_miner_scan);
+  g_test_add_func ("/Ide/TodoMiner/scan-none", test_todo_miner_scan_none);
+  return g_test_run ();
+}
@@ -0,0 +1,230 @@
+/* test-ide-tree.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ide.h>
+
+#include "tree/ide-tree-private.h"
+
+static gboolean have_display;
+
+static IdeTreeNode *
+new_node (const gchar *text,
+          gboolean     children_possible)
+{
+  return g_object_new (IDE_TYPE_TREE_NODE,
+                       "text", text,
+                       "children-possible", children_possible,
+                       NULL);
+}
+
+/*
+ * Returns the texts of the children of @node in the order they are stored,
+ * separated by spaces. Dummy children have no text and show up as "-".
+ */
+static gchar *
+get_children_text (IdeTree     *tree,
+                   IdeTreeNode *node)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (_ide_tree_get_store (tree));
+  GString *str = g_string_new (NULL);
+  GtkTreeIter parent;
+  GtkTreeIter iter;
+
+  g_assert_true (ide_tree_node_get_iter (node, &parent));
+
+  if (gtk_tree_model_iter_children (model, &iter, &parent))
+    {
+      do
+        {
+          g_autoptr(IdeTreeNode) child = NULL;
+          const gchar *text;
+
+          gtk_tree_model_get (model, &iter, 0, &child, -1);
+          text = ide_tree_node_get_text (child);
+
+          if (str->len > 0)
+            g_string_append_c (str, ' ');
+          g_string_append (str, text ? text : "-");
+        }
+      while (gtk_tree_model_iter_next (model, &iter));
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+/*
+ * Children of the root are built as soon as they are added, so "dir" is
+ * placed one level further down where it waits to be expanded like the
+ * directories of the project tree.
+ */
+static IdeTree *
+new_tree (IdeTreeBuilder  *builder,
+          IdeTreeNode    **dir)
+{
+  IdeTreeNode *root;
+  IdeTreeNode *top;
+  IdeTree *tree;
+
+  tree = g_object_ref_sink (g_object_new (IDE_TYPE_TREE, NULL));
+
+  if (builder != NULL)
+    ide_tree_add_builder (tree, builder);
+
+  root = ide_tree_node_new ();
+  ide_tree_set_root (tree, root);
+
+  top = new_node ("top", TRUE);
+  ide_tree_node_append (root, top);
+
+  *dir = new_node ("dir", TRUE);
+  ide_tree_node_append (top, *dir);
+
+  return tree;
+}
+
+static void
+test_tree_append_all (void)
+{
+  g_autoptr(GPtrArray) children = NULL;
+  g_autoptr(IdeTree) tree = NULL;
+  g_autofree gchar *text = NULL;
+  IdeTreeNode *dir = NULL;
+
+  if (!have_display)
+    {
+      g_test_skip ("No display available");
+      return;
+    }
+
+  tree = new_tree (NULL, &dir);
+
+  /* Drop the dummy child which is added for expanders */
+  _ide_tree_build_node (tree, dir);
+
+  children = g_ptr_array_new ();
+  g_ptr_array_add (children, new_node ("c", FALSE));
+  g_ptr_array_add (children, new_node ("a", TRUE));
+  g_ptr_array_add (children, new_node ("b", FALSE));
+  g_ptr_array_add (children, new_node ("d", TRUE));
+
+  ide_tree_node_append_all (dir, children);
+
+  /* The children are not sorted, and are inserted in the order given */
+  text = get_children_text (tree, dir);
+  g_assert_cmpstr (text, ==, "c a b d");
+
+  for (guint i = 0; i < children->len; i++)
+    {
+      IdeTreeNode *child = g_ptr_array_index (children, i);
+      g_autofree gchar *child_text = NULL;
+
+      g_assert (ide_tree_node_get_parent (child) == dir);
+      g_assert (ide_tree_node_get_tree (child) == tree);
+
+      /* Directories get a dummy child so that they can be expanded */
+      child_text = get_children_text (tree, child);
+      if (ide_tree_node_get_children_possible (child))
+        g_assert_cmpstr (child_text, ==, "-");
+      else
+        g_assert_cmpstr (child_text, ==, "");
+    }
+
+  /* Appending to a node that already has children keeps them first */
+  g_ptr_array_set_size (children, 0);
+  g_ptr_array_add (children, new_node ("e", FALSE));
+  ide_tree_node_append_all (dir, children);
+
+  g_clear_pointer (&text, g_free);
+  text = get_children_text (tree, dir);
+  g_assert_cmpstr (text, ==, "c a b d e");
+}
+
+/* Like the project tree, shows a placeholder while the children load */
+static void
+build_node_cb (IdeTreeBuilder *builder,
+               IdeTreeNode    *node,
+               IdeTreeNode    *placeholder)
+{
+  if (g_strcmp0 (ide_tree_node_get_text (node), "dir") == 0)
+    ide_tree_node_append (node, placeholder);
+}
+
+static void
+test_tree_replace_placeholder (void)
+{
+  g_autoptr(IdeTreeNode) placeholder = NULL;
+  g_autoptr(GPtrArray) children = NULL;
+  g_autoptr(IdeTree) tree = NULL;
+  g_autofree gchar *text = NULL;
+  IdeTreeBuilder *builder;
+  IdeTreeNode *dir = NULL;
+  GtkTreeIter iter;
+
+  if (!have_display)
+    {
+      g_test_skip ("No display available");
+      return;
+    }
+
+  placeholder = g_object_ref_sink (new_node ("Loading…", FALSE));
+
+  builder = g_object_new (IDE_TYPE_TREE_BUILDER, NULL);
+  g_signal_connect (builder, "build-node", G_CALLBACK (build_node_cb), placeholder);
+
+  tree = new_tree (builder, &dir);
+
+  text = get_children_text (tree, dir);
+  g_assert_cmpstr (text, ==, "-");
+
+  /* Expanding the row builds it, which swaps the dummy for the placeholder */
+  ide_tree_node_expand (dir, TRUE);
+  g_assert_true (ide_tree_node_get_expanded (dir));
+
+  g_clear_pointer (&text, g_free);
+  text = get_children_text (tree, dir);
+  g_assert_cmpstr (text, ==, "Loading…");
+
+  children = g_ptr_array_new ();
+  g_ptr_array_add (children, new_node ("a", TRUE));
+  g_ptr_array_add (children, new_node ("b", FALSE));
+
+  ide_tree_node_append_all (dir, children);
+  ide_tree_node_remove (dir, placeholder);
+
+  g_clear_pointer (&text, g_free);
+  text = get_children_text (tree, dir);
+  g_assert_cmpstr (text, ==, "a b");
+
+  g_assert_false (ide_tree_node_get_iter (placeholder, &iter));
+
+  /* The row never ran out of children, so it did not collapse */
+  g_assert_true (ide_tree_node_get_expanded (dir));
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  have_display = gtk_init_check (&argc, &argv);
+
+  g_test_add_func ("/Ide/Tree/append_all", test_tree_append_all);
+  g_test_add_func ("/Ide/Tree/replace_placeholder", test_tree_replace_placeholder);
+  return g_test_run ();
+}
@@ -0,0 +1,198 @@
+/* test-ide-unsaved-files.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include <ide.h>
+#include <string.h>
+#include <unistd.h>
+
+static GBytes *
+bytes_new (const gchar *str)
+{
+  return g_bytes_new (str, strlen (str));
+}
+
+static void
+test_changes_since (void)
+{
+  g_autoptr(IdeUnsavedFiles) unsaved_files = NULL;
+  g_autoptr(GFile) file1 = g_file_new_for_path ("/tmp/test-unsaved-1.c");
+  g_autoptr(GFile) file2 = g_file_new_for_path ("/tmp/test-unsaved-2.c");
+  g_autoptr(GBytes) bytes1 = bytes_new ("int a;\n");
+  g_autoptr(GBytes) bytes2 = bytes_new ("int b;\n");
+  g_autoptr(GBytes) bytes3 = bytes_new ("int c;\n");
+  GPtrArray *changed;
+  GPtrArray *removed;
+  gint64 sequence;
+
+  unsaved_files = g_object_new (IDE_TYPE_UNSAVED_FILES, NULL);
+
+  ide_unsaved_files_update (unsaved_files, file1, bytes1);
+  ide_unsaved_files_update (unsaved_files, file2, bytes2);
+
+  changed = ide_unsaved_files_get_changes_since (unsaved_files, 0, &removed);
+  g_assert_cmpint (changed->len, ==, 2);
+  g_assert_cmpint (removed->len, ==, 0);
+  g_ptr_array_unref (changed);
+  g_ptr_array_unref (removed);
+
+  sequence = ide_unsaved_files_get_sequence (unsaved_files);
+
+  changed = ide_unsaved_files_get_changes_since (unsaved_files, sequence, NULL);
+  g_assert_cmpint (changed->len, ==, 0);
+  g_ptr_array_unref (changed);
+
+  ide_unsaved_files_update (unsaved_files, file1, bytes3);
+  ide_unsaved_files_remove (unsaved_files, file2);
+
+  changed = ide_unsaved_files_get_changes_since (unsaved_files, sequence, &removed);
+  g_assert_cmpint (changed->len, ==, 1);
+  g_assert (g_file_equal (file1, ide_unsaved_file_get_file (g_ptr_array_index (changed, 0))));
+  g_assert (g_bytes_equal (bytes3, ide_unsaved_file_get_content (g_ptr_array_index (changed, 0))));
+  g_assert_cmpint (removed->len, ==, 1);
+  g_assert (g_file_equal (file2, g_ptr_array_index (removed, 0)));
+  g_ptr_array_unref (changed);
+  g_ptr_array_unref (removed);
+
+  /* Adding the file back means it is no longer removed */
+  ide_unsaved_files_update (unsaved_files, file2, bytes2);
+
+  changed = ide_unsaved_files_get_changes_since (unsaved_files, sequence, &removed);
+  g_assert_cmpint (changed->len, ==, 2);
+  g_assert_cmpint (removed->len, ==, 0);
+  g_ptr_array_unref (changed);
+  g_ptr_array_unref (removed);
+}
+
+static void
+test_remove_saved (void)
+{
+  g_autoptr(IdeUnsavedFiles) unsaved_files = NULL;
+  g_autoptr(GBytes) bytes1 = bytes_new ("int a;\n");
+  g_autoptr(GBytes) bytes2 = bytes_new ("int b;\n");
+  g_autoptr(GFile) file = NULL;
+  g_autofree gchar *dir = NULL;
+  g_autofree gchar *path = NULL;
+  GPtrArray *changed;
+  GPtrArray *removed;
+  GError *error = NULL;
+  gint64 before;
+  gint64 sequence;
+
+  dir = g_dir_make_tmp ("test-unsaved-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (dir, "saved.c", NULL);
+  file = g_file_new_for_path (path);
+
+  unsaved_files = g_object_new (IDE_TYPE_UNSAVED_FILES, NULL);
+
+  before = ide_unsaved_files_get_sequence (unsaved_files);
+  ide_unsaved_files_update (unsaved_files, file, bytes1);
+  ide_unsaved_files_update (unsaved_files, file, bytes2);
+  sequence = ide_unsaved_files_get_sequence (unsaved_files);
+
+  /* Saving the content does not change the sequence */
+  g_file_set_contents (path, "int b;\n", -1, &error);
+  g_assert_no_error (error);
+  ide_unsaved_files_remove (unsaved_files, file);
+  g_assert_cmpint (ide_unsaved_files_get_sequence (unsaved_files), ==, sequence);
+
+  changed = ide_unsaved_files_get_changes_since (unsaved_files, sequence, &removed);
+  g_assert_cmpint (changed->len, ==, 0);
+  g_assert_cmpint (removed->len, ==, 0);
+  g_ptr_array_unref (changed);
+  g_ptr_array_unref (removed);
+
+  /* But whoever saw an older content must reload it */
+  changed = ide_unsaved_files_get_changes_since (unsaved_files, before, &removed);
+  g_assert_cmpint (changed->len, ==, 0);
+  g_assert_cmpint (removed->len, ==, 1);
+  g_ptr_array_unref (changed);
+  g_ptr_array_unref (removed);
+
+  /* Discarding changes does */
+  ide_unsaved_files_update (unsaved_files, file, bytes1);
+  sequence = ide_unsaved_files_get_sequence (unsaved_files);
+  ide_unsaved_files_remove (unsaved_files, file);
+  g_assert_cmpint (ide_unsaved_files_get_sequence (unsaved_files), >, sequence);
+
+  changed = ide_unsaved_files_get_changes_since (unsaved_files, sequence, &removed);
+  g_assert_cmpint (removed->len, ==, 1);
+  g_ptr_array_unref (changed);
+  g_ptr_array_unref (removed);
+
+  g_unlink (path);
+  g_rmdir (dir);
+}
+
+static void
+test_shared_fd (void)
+{
+  g_autoptr(IdeUnsavedFiles) unsaved_files = NULL;
+  g_autoptr(GFile) file = g_file_new_for_path ("/tmp/test-unsaved-fd.c");
+  g_autoptr(GBytes) bytes1 = bytes_new ("int main (void) { return 0; }\n");
+  g_autoptr(GBytes) bytes2 = bytes_new ("int main (void) { return 1; }\n");
+  g_autoptr(IdeUnsavedFile) uf1 = NULL;
+  g_autoptr(IdeUnsavedFile) uf2 = NULL;
+  g_autoptr(IdeUnsavedFile) uf3 = NULL;
+  g_autoptr(GMappedFile) mapped = NULL;
+  GError *error = NULL;
+  gint fd;
+
+  unsaved_files = g_object_new (IDE_TYPE_UNSAVED_FILES, NULL);
+
+  ide_unsaved_files_update (unsaved_files, file, bytes1);
+
+  /* Unchanged content shares the same snapshot, and therefore the same fd */
+  uf1 = ide_unsaved_files_get_unsaved_file (unsaved_files, file);
+  uf2 = ide_unsaved_files_get_unsaved_file (unsaved_files, file);
+  g_assert (uf1 == uf2);
+
+  fd = ide_unsaved_file_get_fd (uf1, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (fd, !=, -1);
+  g_assert_cmpint (fd, ==, ide_unsaved_file_get_fd (uf2, NULL));
+
+  mapped = g_mapped_file_new_from_fd (fd, FALSE, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (g_mapped_file_get_length (mapped), ==, g_bytes_get_size (bytes1));
+  g_assert (memcmp (g_mapped_file_get_contents (mapped),
+                    g_bytes_get_data (bytes1, NULL),
+                    g_bytes_get_size (bytes1)) == 0);
+
+  /* Whoever the fd is passed to cannot modify the snapshot */
+  g_assert_cmpint (write (fd, "x", 1), ==, -1);
+  g_assert_cmpint (ftruncate (fd, 0), ==, -1);
+
+  ide_unsaved_files_update (unsaved_files, file, bytes2);
+  uf3 = ide_unsaved_files_get_unsaved_file (unsaved_files, file);
+  g_assert (uf3 != uf1);
+  g_assert (g_bytes_equal (bytes2, ide_unsaved_file_get_content (uf3)));
+  g_assert_cmpint (ide_unsaved_file_get_sequence (uf3), >, ide_unsaved_file_get_sequence (uf1));
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/UnsavedFiles/changes_since", test_changes_since);
+  g_test_add_func ("/Ide/UnsavedFiles/remove_saved", test_remove_saved);
+  g_test_add_func ("/Ide/UnsavedFiles/shared_fd", test_shared_fd);
+  return g_test_run ();
+}
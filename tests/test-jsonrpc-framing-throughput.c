@@ -0,0 +1,258 @@
+/* test-jsonrpc-framing-throughput.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares the throughput of JsonrpcInputStream and JsonrpcOutputStream
+ * against the previous implementation, which serialized each message into
+ * a temporary string before copying it into a framed buffer, and read the
+ * headers a line at a time before reading the body separately.
+ *
+ * This is not run with the tests, see test-jsonrpc-framing.c for those.
+ *
+ * usage: test-jsonrpc-framing-throughput [N_MESSAGES] [N_DIAGNOSTICS]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsonrpc-input-stream.h"
+#include "jsonrpc-output-stream.h"
+
+static JsonNode *
+create_message (guint n_diagnostics)
+{
+  g_autoptr(JsonBuilder) builder = json_builder_new ();
+  guint i;
+
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "jsonrpc");
+  json_builder_add_string_value (builder, "2.0");
+  json_builder_set_member_name (builder, "method");
+  json_builder_add_string_value (builder, "textDocument/publishDiagnostics");
+  json_builder_set_member_name (builder, "params");
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "uri");
+  json_builder_add_string_value (builder, "file:///home/user/src/project/src/lib.rs");
+  json_builder_set_member_name (builder, "diagnostics");
+  json_builder_begin_array (builder);
+
+  for (i = 0; i < n_diagnostics; i++)
+    {
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "severity");
+      json_builder_add_int_value (builder, 1 + (i % 4));
+      json_builder_set_member_name (builder, "message");
+      json_builder_add_string_value (builder, "unused variable: `foo`, consider prefixing it with an underscore");
+      json_builder_set_member_name (builder, "range");
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "line");
+      json_builder_add_int_value (builder, i);
+      json_builder_set_member_name (builder, "character");
+      json_builder_add_int_value (builder, i % 80);
+      json_builder_end_object (builder);
+      json_builder_end_object (builder);
+    }
+
+  json_builder_end_array (builder);
+  json_builder_end_object (builder);
+  json_builder_end_object (builder);
+
+  return json_builder_get_root (builder);
+}
+
+static GBytes *
+legacy_write (JsonNode *node,
+              guint     n_messages)
+{
+  g_autoptr(GOutputStream) stream = g_memory_output_stream_new_resizable ();
+  guint i;
+
+  for (i = 0; i < n_messages; i++)
+    {
+      g_autofree gchar *str = json_to_string (node, FALSE);
+      gsize len = strlen (str);
+      GString *message;
+
+      message = g_string_sized_new (len + 32);
+      g_string_append_printf (message, "Content-Length: %"G_GSIZE_FORMAT"\r\n\r\n", len);
+      g_string_append_len (message, str, len);
+
+      if (!g_output_stream_write_all (stream, message->str, message->len, NULL, NULL, NULL))
+        g_error ("Failed to write message");
+
+      g_string_free (message, TRUE);
+    }
+
+  g_output_stream_close (stream, NULL, NULL);
+
+  return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (stream));
+}
+
+static GBytes *
+jsonrpc_write (JsonNode *node,
+               guint     n_messages)
+{
+  g_autoptr(GOutputStream) base = g_memory_output_stream_new_resizable ();
+  g_autoptr(JsonrpcOutputStream) stream = jsonrpc_output_stream_new (base);
+  guint i;
+
+  for (i = 0; i < n_messages; i++)
+    {
+      if (!jsonrpc_output_stream_write_message (stream, node, NULL, NULL))
+        g_error ("Failed to write message");
+    }
+
+  g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, NULL);
+
+  return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (base));
+}
+
+static guint
+legacy_read (GBytes *bytes)
+{
+  g_autoptr(GInputStream) base = g_memory_input_stream_new_from_bytes (bytes);
+  g_autoptr(GDataInputStream) stream = g_data_input_stream_new (base);
+  gssize content_length = -1;
+  guint count = 0;
+
+  g_data_input_stream_set_newline_type (stream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+  for (;;)
+    {
+      g_autofree gchar *line = NULL;
+
+      if (NULL == (line = g_data_input_stream_read_line_utf8 (stream, NULL, NULL, NULL)))
+        break;
+
+      if (g_ascii_strncasecmp ("Content-Length: ", line, 16) == 0)
+        content_length = g_ascii_strtoll (line + 16, NULL, 10);
+
+      if (line[0] == '\0')
+        {
+          g_autoptr(JsonParser) parser = json_parser_new_immutable ();
+          g_autofree gchar *buffer = g_malloc (content_length + 1);
+          gsize n_read = 0;
+
+          if (!g_input_stream_read_all (G_INPUT_STREAM (stream), buffer, content_length, &n_read, NULL, NULL) ||
+              (gssize)n_read != content_length)
+            g_error ("Failed to read message body");
+
+          buffer[content_length] = '\0';
+
+          if (!json_parser_load_from_data (parser, buffer, content_length, NULL))
+            g_error ("Failed to parse message");
+
+          content_length = -1;
+          count++;
+        }
+    }
+
+  return count;
+}
+
+static guint
+jsonrpc_read (GBytes *bytes)
+{
+  g_autoptr(GInputStream) base = g_memory_input_stream_new_from_bytes (bytes);
+  g_autoptr(JsonrpcInputStream) stream = jsonrpc_input_stream_new (base);
+  guint count = 0;
+
+  for (;;)
+    {
+      g_autoptr(JsonNode) node = NULL;
+      g_autoptr(GError) error = NULL;
+
+      if (!jsonrpc_input_stream_read_message (stream, NULL, &node, &error))
+        {
+          if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED))
+            g_error ("%s", error->message);
+          break;
+        }
+
+      count++;
+    }
+
+  return count;
+}
+
+static void
+report (const gchar *name,
+        gint64       begin,
+        gint64       end,
+        gsize        n_bytes)
+{
+  gdouble seconds = (end - begin) / (gdouble)G_USEC_PER_SEC;
+
+  g_print ("%-16s %8.3lf sec  %8.2lf MB/sec\n",
+           name,
+           seconds,
+           n_bytes / seconds / (1024.0 * 1024.0));
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(JsonNode) node = NULL;
+  g_autoptr(GBytes) legacy_bytes = NULL;
+  g_autoptr(GBytes) jsonrpc_bytes = NULL;
+  guint n_messages = 100;
+  guint n_diagnostics = 10000;
+  guint count;
+  gint64 begin;
+  gint64 end;
+  gsize n_bytes;
+
+  if (argc > 1)
+    n_messages = MAX (1, atoi (argv[1]));
+
+  if (argc > 2)
+    n_diagnostics = MAX (1, atoi (argv[2]));
+
+  node = create_message (n_diagnostics);
+
+  begin = g_get_monotonic_time ();
+  legacy_bytes = legacy_write (node, n_messages);
+  end = g_get_monotonic_time ();
+  n_bytes = g_bytes_get_size (legacy_bytes);
+
+  g_print ("%u messages, %"G_GSIZE_FORMAT" bytes\n", n_messages, n_bytes);
+
+  report ("legacy write", begin, end, n_bytes);
+
+  begin = g_get_monotonic_time ();
+  jsonrpc_bytes = jsonrpc_write (node, n_messages);
+  end = g_get_monotonic_time ();
+  report ("jsonrpc write", begin, end, n_bytes);
+
+  g_assert (g_bytes_equal (legacy_bytes, jsonrpc_bytes));
+
+  begin = g_get_monotonic_time ();
+  count = legacy_read (legacy_bytes);
+  end = g_get_monotonic_time ();
+  report ("legacy read", begin, end, n_bytes);
+  g_assert_cmpint (count, ==, n_messages);
+
+  begin = g_get_monotonic_time ();
+  count = jsonrpc_read (jsonrpc_bytes);
+  end = g_get_monotonic_time ();
+  report ("jsonrpc read", begin, end, n_bytes);
+  g_assert_cmpint (count, ==, n_messages);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,403 @@
+/* test-jsonrpc-framing.c
+ *
+ * Copyright (C) 2016 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "jsonrpc-input-stream.h"
+#include "jsonrpc-output-stream.h"
+
+/*
+ * An input stream returning at most chunk_size bytes per read, so that
+ * messages arrive split across reads like they do from a pipe.
+ */
+#define TEST_TYPE_CHUNKED_INPUT_STREAM (test_chunked_input_stream_get_type())
+
+G_DECLARE_FINAL_TYPE (TestChunkedInputStream, test_chunked_input_stream, TEST, CHUNKED_INPUT_STREAM, GInputStream)
+
+struct _TestChunkedInputStream
+{
+  GInputStream  parent_instance;
+  GBytes       *bytes;
+  gsize         pos;
+  gsize         chunk_size;
+  guint         n_reads;
+};
+
+G_DEFINE_TYPE (TestChunkedInputStream, test_chunked_input_stream, G_TYPE_INPUT_STREAM)
+
+static gssize
+test_chunked_input_stream_read (GInputStream  *stream,
+                                void          *buffer,
+                                gsize          count,
+                                GCancellable  *cancellable,
+                                GError       **error)
+{
+  TestChunkedInputStream *self = (TestChunkedInputStream *)stream;
+  const guint8 *data;
+  gsize len;
+
+  data = g_bytes_get_data (self->bytes, &len);
+  count = MIN (count, MIN (self->chunk_size, len - self->pos));
+  memcpy (buffer, data + self->pos, count);
+  self->pos += count;
+  self->n_reads++;
+
+  return count;
+}
+
+static gboolean
+test_chunked_input_stream_close (GInputStream  *stream,
+                                 GCancellable  *cancellable,
+                                 GError       **error)
+{
+  return TRUE;
+}
+
+static void
+test_chunked_input_stream_finalize (GObject *object)
+{
+  TestChunkedInputStream *self = (TestChunkedInputStream *)object;
+
+  g_clear_pointer (&self->bytes, g_bytes_unref);
+
+  G_OBJECT_CLASS (test_chunked_input_stream_parent_class)->finalize (object);
+}
+
+static void
+test_chunked_input_stream_class_init (TestChunkedInputStreamClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GInputStreamClass *stream_class = G_INPUT_STREAM_CLASS (klass);
+
+  object_class->finalize = test_chunked_input_stream_finalize;
+
+  stream_class->read_fn = test_chunked_input_stream_read;
+  stream_class->close_fn = test_chunked_input_stream_close;
+}
+
+static void
+test_chunked_input_stream_init (TestChunkedInputStream *self)
+{
+}
+
+static TestChunkedInputStream *
+test_chunked_input_stream_new (const gchar *data,
+                               gsize        len,
+                               gsize        chunk_size)
+{
+  TestChunkedInputStream *self;
+
+  self = g_object_new (TEST_TYPE_CHUNKED_INPUT_STREAM, NULL);
+  self->bytes = g_bytes_new (data, len);
+  self->chunk_size = chunk_size;
+
+  return self;
+}
+
+static gchar *
+frame (const gchar *body)
+{
+  return g_strdup_printf ("Content-Length: %"G_GSIZE_FORMAT"\r\n\r\n%s", strlen (body), body);
+}
+
+static gint64
+read_id (JsonrpcInputStream  *stream,
+         GError             **error)
+{
+  g_autoptr(JsonNode) node = NULL;
+
+  if (!jsonrpc_input_stream_read_message (stream, NULL, &node, error))
+    return -1;
+
+  g_assert (JSON_NODE_HOLDS_OBJECT (node));
+
+  return json_object_get_int_member (json_node_get_object (node), "id");
+}
+
+static void
+test_framing_split (void)
+{
+  static const gsize chunk_sizes[] = { 1, 2, 7, 23, 64, G_MAXSIZE };
+  g_autoptr(GString) str = g_string_new (NULL);
+  g_autoptr(GString) large = g_string_new ("{\"id\":3,\"params\":\"");
+  guint i;
+
+  for (i = 0; i < 3; i++)
+    {
+      g_autofree gchar *body = g_strdup_printf ("{\"jsonrpc\":\"2.0\",\"id\":%u,\"method\":\"m\"}", i);
+      g_autofree gchar *message = frame (body);
+
+      g_string_append (str, message);
+    }
+
+  /* Larger than the initial read buffer, so it must grow */
+  for (i = 0; i < 100000; i++)
+    g_string_append_c (large, 'a' + i % 26);
+  g_string_append (large, "\"}");
+
+  {
+    g_autofree gchar *message = frame (large->str);
+    g_string_append (str, message);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (chunk_sizes); i++)
+    {
+      g_autoptr(TestChunkedInputStream) base = NULL;
+      g_autoptr(JsonrpcInputStream) stream = NULL;
+      g_autoptr(GError) error = NULL;
+      guint j;
+
+      base = test_chunked_input_stream_new (str->str, str->len, chunk_sizes [i]);
+      stream = jsonrpc_input_stream_new (G_INPUT_STREAM (base));
+
+      for (j = 0; j < 4; j++)
+        {
+          g_assert_cmpint (read_id (stream, &error), ==, j);
+          g_assert_no_error (error);
+        }
+
+      g_assert_cmpint (read_id (stream, &error), ==, -1);
+      g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+    }
+}
+
+static void
+test_framing_multiple_per_read (void)
+{
+  g_autoptr(TestChunkedInputStream) base = NULL;
+  g_autoptr(JsonrpcInputStream) stream = NULL;
+  g_autoptr(GString) str = g_string_new (NULL);
+  g_autoptr(GError) error = NULL;
+  guint i;
+
+  for (i = 0; i < 5; i++)
+    {
+      g_autofree gchar *body = g_strdup_printf ("{\"id\":%u}", i);
+      g_autofree gchar *message = frame (body);
+
+      g_string_append (str, message);
+    }
+
+  base = test_chunked_input_stream_new (str->str, str->len, G_MAXSIZE);
+  stream = jsonrpc_input_stream_new (G_INPUT_STREAM (base));
+
+  for (i = 0; i < 5; i++)
+    {
+      g_assert_cmpint (read_id (stream, &error), ==, i);
+      g_assert_no_error (error);
+    }
+
+  /* Every message was parsed from the first read */
+  g_assert_cmpint (base->n_reads, ==, 1);
+}
+
+static void
+test_framing_headers (void)
+{
+  static const gchar *inputs[] = {
+    "Content-Length: 8\r\n\r\n{\"id\":1}",
+    "Content-Length: 8\n\n{\"id\":1}",
+    "content-length:8\r\n\r\n{\"id\":1}",
+    "Content-Type: application/vscode-jsonrpc; charset=utf-8\r\nContent-Length:    8\r\n\r\n{\"id\":1}",
+    "Content-Length: 8\r\nContent-Type: application/vscode-jsonrpc\r\n\r\n{\"id\":1}",
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (inputs); i++)
+    {
+      g_autoptr(TestChunkedInputStream) base = NULL;
+      g_autoptr(JsonrpcInputStream) stream = NULL;
+      g_autoptr(GError) error = NULL;
+
+      base = test_chunked_input_stream_new (inputs [i], strlen (inputs [i]), 3);
+      stream = jsonrpc_input_stream_new (G_INPUT_STREAM (base));
+
+      g_assert_cmpint (read_id (stream, &error), ==, 1);
+      g_assert_no_error (error);
+    }
+}
+
+static void
+test_framing_malformed (void)
+{
+  static const struct {
+    const gchar *input;
+    gint         code;
+  } cases[] = {
+    { "\r\n{\"id\":1}", G_IO_ERROR_INVALID_DATA },
+    { "Content-Type: application/json\r\n\r\n{\"id\":1}", G_IO_ERROR_INVALID_DATA },
+    { "Content-Length: \r\n\r\n{\"id\":1}", G_IO_ERROR_INVALID_DATA },
+    { "Content-Length: 0\r\n\r\n{\"id\":1}", G_IO_ERROR_INVALID_DATA },
+    { "Content-Length: -8\r\n\r\n{\"id\":1}", G_IO_ERROR_INVALID_DATA },
+    { "Content-Length: 8x\r\n\r\n{\"id\":1}", G_IO_ERROR_INVALID_DATA },
+    { "Content-Length: 99999999999999999999\r\n\r\n{\"id\":1}", G_IO_ERROR_INVALID_DATA },
+    /* The peer went away in the middle of a message */
+    { "", G_IO_ERROR_CLOSED },
+    { "Content-Len", G_IO_ERROR_CLOSED },
+    { "Content-Length: 8\r\n", G_IO_ERROR_CLOSED },
+    { "Content-Length: 8\r\n\r\n{\"id\"", G_IO_ERROR_CLOSED },
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+      g_autoptr(TestChunkedInputStream) base = NULL;
+      g_autoptr(JsonrpcInputStream) stream = NULL;
+      g_autoptr(GError) error = NULL;
+
+      base = test_chunked_input_stream_new (cases [i].input, strlen (cases [i].input), 5);
+      stream = jsonrpc_input_stream_new (G_INPUT_STREAM (base));
+
+      g_assert_cmpint (read_id (stream, &error), ==, -1);
+      g_assert_error (error, G_IO_ERROR, cases [i].code);
+    }
+}
+
+static void
+test_framing_invalid_json (void)
+{
+  static const gchar input[] =
+    "Content-Length: 8\r\n\r\n{\"id\":1,"
+    "Content-Length: 8\r\n\r\n{\"id\":2}";
+  g_autoptr(TestChunkedInputStream) base = NULL;
+  g_autoptr(JsonrpcInputStream) stream = NULL;
+  g_autoptr(GError) error = NULL;
+
+  base = test_chunked_input_stream_new (input, strlen (input), 4);
+  stream = jsonrpc_input_stream_new (G_INPUT_STREAM (base));
+
+  g_assert_cmpint (read_id (stream, &error), ==, -1);
+  g_assert (error != NULL);
+  g_assert (error->domain == JSON_PARSER_ERROR);
+  g_clear_error (&error);
+
+  /* The broken body is skipped and the stream stays in sync */
+  g_assert_cmpint (read_id (stream, &error), ==, 2);
+  g_assert_no_error (error);
+}
+
+static void
+write_cb (GObject      *object,
+          GAsyncResult *result,
+          gpointer      user_data)
+{
+  guint *n_active = user_data;
+  g_autoptr(GError) error = NULL;
+
+  jsonrpc_output_stream_write_message_finish (JSONRPC_OUTPUT_STREAM (object), result, &error);
+  g_assert_no_error (error);
+
+  (*n_active)--;
+}
+
+static void
+test_framing_write_queued (void)
+{
+  g_autoptr(GOutputStream) base = g_memory_output_stream_new_resizable ();
+  g_autoptr(JsonrpcOutputStream) stream = jsonrpc_output_stream_new (base);
+  g_autoptr(GString) expected = g_string_new (NULL);
+  g_autoptr(JsonNode) node = json_node_new (JSON_NODE_OBJECT);
+  g_autoptr(JsonObject) object = json_object_new ();
+  guint n_active = 0;
+  guint i;
+
+  json_node_set_object (node, object);
+
+  /*
+   * Only the first message can be written right away, the others are
+   * queued. Modifying the node after queueing must not affect them.
+   */
+  for (i = 0; i < 4; i++)
+    {
+      g_autofree gchar *body = NULL;
+      g_autofree gchar *message = NULL;
+
+      json_object_set_int_member (object, "id", i);
+      body = json_to_string (node, FALSE);
+      message = frame (body);
+      g_string_append (expected, message);
+
+      n_active++;
+      jsonrpc_output_stream_write_message_async (stream, node, NULL, write_cb, &n_active);
+    }
+
+  json_object_set_int_member (object, "id", 100);
+
+  while (n_active > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpint (g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (base)), ==, expected->len);
+  g_assert (memcmp (g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (base)),
+                    expected->str,
+                    expected->len) == 0);
+}
+
+static void
+test_framing_round_trip (void)
+{
+  g_autoptr(GOutputStream) base = g_memory_output_stream_new_resizable ();
+  g_autoptr(JsonrpcOutputStream) output = jsonrpc_output_stream_new (base);
+  g_autoptr(GInputStream) input_base = NULL;
+  g_autoptr(JsonrpcInputStream) input = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) error = NULL;
+  guint i;
+
+  for (i = 0; i < 10; i++)
+    {
+      g_autoptr(JsonNode) node = json_node_new (JSON_NODE_OBJECT);
+      g_autoptr(JsonObject) object = json_object_new ();
+
+      json_object_set_int_member (object, "id", i);
+      json_object_set_string_member (object, "method", "textDocument/didChange\r\n\r\n");
+      json_node_set_object (node, object);
+
+      jsonrpc_output_stream_write_message (output, node, NULL, &error);
+      g_assert_no_error (error);
+    }
+
+  g_output_stream_close (G_OUTPUT_STREAM (output), NULL, NULL);
+  bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (base));
+
+  input_base = g_memory_input_stream_new_from_bytes (bytes);
+  input = jsonrpc_input_stream_new (input_base);
+
+  for (i = 0; i < 10; i++)
+    {
+      g_assert_cmpint (read_id (input, &error), ==, i);
+      g_assert_no_error (error);
+    }
+
+  g_assert_cmpint (read_id (input, &error), ==, -1);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Jsonrpc/Framing/split", test_framing_split);
+  g_test_add_func ("/Jsonrpc/Framing/multiple-per-read", test_framing_multiple_per_read);
+  g_test_add_func ("/Jsonrpc/Framing/headers", test_framing_headers);
+  g_test_add_func ("/Jsonrpc/Framing/malformed", test_framing_malformed);
+  g_test_add_func ("/Jsonrpc/Framing/invalid-json", test_framing_invalid_json);
+  g_test_add_func ("/Jsonrpc/Framing/write-queued", test_framing_write_queued);
+  g_test_add_func ("/Jsonrpc/Framing/round-trip", test_framing_round_trip);
+  return g_test_run ();
+}